@@ -28,7 +28,7 @@ defineTest(minQtVersion) {
     error("Cannot build with Qt version $${QT_VERSION}, this project requires at least Qt 5.2.0")
 }
 
-QT       += core gui widgets
+QT       += core gui widgets network multimedia opengl sql
 
 TARGET = TOX-Qt-GUI
 TEMPLATE = app
@@ -39,7 +39,16 @@ INCLUDEPATH += ../../src/
 win32:INCLUDEPATH += ../../libs/include/
 macx:INCLUDEPATH += /usr/local/include/
 
-win32 {
+fake_tox {
+    # src/faketox.cpp stands in for toxcore and toxav
+    win32 {
+        LIBS += ../../libs/lib/libsodium.a
+    } else:macx {
+        LIBS += -L/usr/local/lib -lsodium
+    } else {
+        LIBS += -lsodium
+    }
+} else:win32 {
     LIBS += ../../libs/lib/libtoxav.a ../../libs/lib/libopus.a ../../libs/lib/libvpx.a ../../libs/lib/libtoxcore.a -lws2_32 ../../libs/lib/libsodium.a -liphlpapi
 } else {
     macx {
@@ -50,43 +59,104 @@ win32 {
 }
 
 win32:DEFINES += WIN32
+# GetProcessMemoryInfo(), see MemoryPressure
+win32:LIBS += -lpsapi
+
+# Wake the core thread on Tox socket activity instead of polling tox_do(),
+# enable with "qmake CONFIG+=event_driven_core"
+event_driven_core {
+    DEFINES += EVENT_DRIVEN_CORE
+    SOURCES += ../../src/toxwaiter.cpp
+    HEADERS += ../../src/toxwaiter.hpp
+}
+
+# Simulated toxcore for load testing the GUI, scripted through TOX_FAKE_SCRIPT,
+# enable with "qmake CONFIG+=fake_tox"
+fake_tox {
+    DEFINES += FAKE_TOX
+    SOURCES += ../../src/faketox.cpp
+    HEADERS += ../../src/faketox.hpp
+}
 
 SOURCES += \
     ../../src/main.cpp \
     ../../src/mainwindow.cpp \
+    ../../src/notificationsound.cpp \
     ../../src/friendswidget.cpp \
+    ../../src/groupchatpagewidget.cpp \
+    ../../src/groupmembermodel.cpp \
     ../../src/addfrienddialog.cpp \
     ../../src/friendproxymodel.cpp \
+    ../../src/filetransfermanager.cpp \
+    ../../src/filetransferswidget.cpp \
     ../../src/filterwidget.cpp \
     ../../src/customhinttreeview.cpp \
     ../../src/chatpagewidget.cpp \
+    ../../src/chatwindow.cpp \
     ../../src/pageswidget.cpp \
     ../../src/inputtextwidget.cpp \
     ../../src/frienditemwidget.cpp \
     ../../src/ouruseritemwidget.cpp \
     ../../src/status.cpp \
     ../../src/friendrequestdialog.cpp \
+    ../../src/friendrequestmodel.cpp \
     ../../src/customhinttextedit.cpp \
     ../../src/elidelabel.cpp \
     ../../src/core.cpp \
+    ../../src/ipcserver.cpp \
+    ../../src/coreeventqueue.cpp \
+    ../../src/configurationwriter.cpp \
+    ../../src/historystore.cpp \
+    ../../src/historyindex.cpp \
+    ../../src/historyimporter.cpp \
+    ../../src/historyexporter.cpp \
+    ../../src/historysearchdialog.cpp \
+    ../../src/historywriter.cpp \
+    ../../src/bootstrapmanager.cpp \
+    ../../src/audiojitterbuffer.cpp \
+    ../../src/callmanager.cpp \
+    ../../src/callwidget.cpp \
+    ../../src/corethreadpool.cpp \
+    ../../src/profile.cpp \
+    ../../src/coremetrics.cpp \
+    ../../src/userid.cpp \
+    ../../src/videowidget.cpp \
     ../../src/Settings/abstractsettingspage.cpp \
     ../../src/Settings/basicsettingsdialog.cpp \
     ../../src/Settings/settings.cpp \
     ../../src/closeapplicationdialog.cpp \
     ../../src/starter.cpp \
+    ../../src/startuptrace.cpp \
+    ../../src/trace.cpp \
     ../../src/Settings/settingsdialog.cpp \
     ../../src/Settings/dhtbootstrapsettingspage.cpp \
+    ../../src/Settings/dhtprober.cpp \
     ../../src/Settings/dhtserverdialog.cpp \
     ../../src/Settings/customhintlistwidget.cpp \
     ../../src/Settings/loggingsettingspage.cpp \
     ../../src/Settings/networksettingspage.cpp \
     ../../src/aboutdialog.cpp \
+    ../../src/activityindex.cpp \
+    ../../src/animationdriver.cpp \
+    ../../src/avatarstore.cpp \
+    ../../src/delayedwriter.cpp \
+    ../../src/friendlistsnapshot.cpp \
+    ../../src/memorypressure.cpp \
+    ../../src/udpprober.cpp \
+    ../../src/coreeventlog.cpp \
+    ../../src/outboxjournal.cpp \
+    ../../src/logindialog.cpp \
+    ../../src/profilecipher.cpp \
+    ../../src/sessionstate.cpp \
     ../../src/emoticonmenu.cpp \
     ../../src/opacitywidget.cpp \
     ../../src/customhintwidget.cpp \
+    ../../src/daemon.cpp \
     ../../src/Settings/guisettingspage.cpp \
+    ../../src/Settings/emojifontcache.cpp \
     ../../src/Settings/emojifontcombobox.cpp \
     ../../src/smileypack.cpp \
+    ../../src/smileypackwatcher.cpp \
     ../../src/Settings/emojifontsettingsdialog.cpp \
     ../../src/frienditemdelegate.cpp \
     ../../src/editablelabelwidget.cpp \
@@ -94,8 +164,22 @@ SOURCES += \
     ../../src/copyableelidelabel.cpp \
     ../../src/messages/messagemodel.cpp \
     ../../src/messages/message.cpp \
+    ../../src/messages/messageaccessor.cpp \
+    ../../src/messages/messagecodec.cpp \
     ../../src/messages/messagemodelitem.cpp \
+    ../../src/messages/messagesbenchmark.cpp \
+    ../../src/messages/messagestore.cpp \
+    ../../src/messages/messagespans.cpp \
+    ../../src/messages/scrollbackstore.cpp \
     ../../src/messages/chatscene.cpp \
+    ../../src/messages/chatlayoutprefetcher.cpp \
+    ../../src/messages/chatstyle.cpp \
+    ../../src/messages/lineheightcache.cpp \
+    ../../src/messages/chatlinelayouter.cpp \
+    ../../src/messages/chatsearcher.cpp \
+    ../../src/messages/contentssnapshot.cpp \
+    ../../src/messages/selectionmimedata.cpp \
+    ../../src/messages/lineheightindex.cpp \
     ../../src/messages/chatitem.cpp \
     ../../src/messages/chatline.cpp \
     ../../src/messages/chatview.cpp \
@@ -104,48 +188,101 @@ SOURCES += \
     ../../src/messages/columnhandleitem.cpp \
     ../../src/messages/smileytextobject.cpp \
     ../../src/messages/smiley.cpp \
+    ../../src/messages/smileymatcher.cpp \
+    ../../src/messages/stringpool.cpp \
     ../../src/messages/messagefilter.cpp \
     ../../src/messages/chatviewsearchwidget.cpp \
+    ../../src/messages/chatviewstats.cpp \
+    ../../src/messages/chatmemoryusage.cpp \
+    ../../src/messages/plaintextlayout.cpp \
+    ../../src/messages/thumbnailcache.cpp \
     ../../src/Settings/privacysettingspage.cpp \
     ../../src/messages/typingitem.cpp \
     ../../src/Settings/informationiconlabel.cpp
 
 HEADERS  += \
     ../../src/mainwindow.hpp \
+    ../../src/notificationsound.hpp \
     ../../src/friendswidget.hpp \
+    ../../src/groupchat.hpp \
+    ../../src/groupchatpagewidget.hpp \
+    ../../src/groupmembermodel.hpp \
     ../../src/addfrienddialog.hpp \
     ../../src/friendproxymodel.hpp \
     ../../src/status.hpp \
+    ../../src/filetransfer.hpp \
+    ../../src/filetransfermanager.hpp \
+    ../../src/filetransferswidget.hpp \
     ../../src/filterwidget.hpp \
     ../../src/customhinttreeview.hpp \
     ../../src/chatpagewidget.hpp \
+    ../../src/chatwindow.hpp \
     ../../src/pageswidget.hpp \
     ../../src/inputtextwidget.hpp \
     ../../src/frienditemwidget.hpp \
     ../../src/ouruseritemwidget.hpp \
     ../../src/friendrequestdialog.hpp \
+    ../../src/friendrequestmodel.hpp \
     ../../src/customhinttextedit.hpp \
     ../../src/elidelabel.hpp \
     ../../src/core.hpp \
+    ../../src/ipcserver.hpp \
+    ../../src/coreevent.hpp \
+    ../../src/coreeventqueue.hpp \
+    ../../src/configurationwriter.hpp \
+    ../../src/historystore.hpp \
+    ../../src/historyindex.hpp \
+    ../../src/historyimporter.hpp \
+    ../../src/historyexporter.hpp \
+    ../../src/historysearchdialog.hpp \
+    ../../src/historywriter.hpp \
+    ../../src/bootstrapmanager.hpp \
+    ../../src/audiojitterbuffer.hpp \
+    ../../src/call.hpp \
+    ../../src/callmanager.hpp \
+    ../../src/callwidget.hpp \
+    ../../src/corethreadpool.hpp \
+    ../../src/profile.hpp \
+    ../../src/coremetrics.hpp \
+    ../../src/userid.hpp \
+    ../../src/videowidget.hpp \
     ../../src/Settings/abstractsettingspage.hpp \
     ../../src/Settings/basicsettingsdialog.hpp \
     ../../src/Settings/settings.hpp \
     ../../src/closeapplicationdialog.hpp \
     ../../src/starter.hpp \
+    ../../src/startuptrace.hpp \
+    ../../src/trace.hpp \
     ../../src/Settings/settingsdialog.hpp \
     ../../src/Settings/dhtbootstrapsettingspage.hpp \
+    ../../src/Settings/dhtprober.hpp \
     ../../src/Settings/dhtserverdialog.hpp \
     ../../src/Settings/customhintlistwidget.hpp \
     ../../src/Settings/loggingsettingspage.hpp \
     ../../src/Settings/networksettingspage.hpp \
     ../../src/aboutdialog.hpp \
+    ../../src/activityindex.hpp \
+    ../../src/animationdriver.hpp \
+    ../../src/avatarstore.hpp \
+    ../../src/delayedwriter.hpp \
+    ../../src/friendlistsnapshot.hpp \
+    ../../src/memorypressure.hpp \
+    ../../src/udpprober.hpp \
+    ../../src/coreeventlog.hpp \
+    ../../src/outboxjournal.hpp \
+    ../../src/logindialog.hpp \
+    ../../src/profilecipher.hpp \
+    ../../src/sessionstate.hpp \
     ../../src/appinfo.hpp \
     ../../src/emoticonmenu.hpp \
     ../../src/opacitywidget.hpp \
     ../../src/customhintwidget.hpp \
+    ../../src/daemon.hpp \
     ../../src/Settings/guisettingspage.hpp \
+    ../../src/Settings/emojifontcache.hpp \
     ../../src/Settings/emojifontcombobox.hpp \
     ../../src/smileypack.hpp \
+    ../../src/smileypackwatcher.hpp \
     ../../src/Settings/emojifontsettingsdialog.hpp \
     ../../src/frienditemdelegate.hpp \
     ../../src/editablelabelwidget.hpp \
@@ -154,8 +291,23 @@ HEADERS  += \
     ../../src/messages/id.hpp \
     ../../src/messages/messagemodel.hpp \
     ../../src/messages/message.hpp \
+    ../../src/messages/messageaccessor.hpp \
+    ../../src/messages/messagecodec.hpp \
     ../../src/messages/messagemodelitem.hpp \
+    ../../src/messages/messagesbenchmark.hpp \
+    ../../src/messages/messagestore.hpp \
+    ../../src/messages/messagespans.hpp \
+    ../../src/messages/objectpool.hpp \
+    ../../src/messages/scrollbackstore.hpp \
     ../../src/messages/chatscene.hpp \
+    ../../src/messages/chatlayoutprefetcher.hpp \
+    ../../src/messages/chatstyle.hpp \
+    ../../src/messages/lineheightcache.hpp \
+    ../../src/messages/chatlinelayouter.hpp \
+    ../../src/messages/chatsearcher.hpp \
+    ../../src/messages/contentssnapshot.hpp \
+    ../../src/messages/selectionmimedata.hpp \
+    ../../src/messages/lineheightindex.hpp \
     ../../src/messages/chatitem.hpp \
     ../../src/messages/chatline.hpp \
     ../../src/messages/chatview.hpp \
@@ -164,8 +316,14 @@ HEADERS  += \
     ../../src/messages/columnhandleitem.hpp \
     ../../src/messages/smileytextobject.hpp \
     ../../src/messages/smiley.hpp \
+    ../../src/messages/smileymatcher.hpp \
+    ../../src/messages/stringpool.hpp \
     ../../src/messages/messagefilter.hpp \
     ../../src/messages/chatviewsearchwidget.hpp \
+    ../../src/messages/chatviewstats.hpp \
+    ../../src/messages/chatmemoryusage.hpp \
+    ../../src/messages/plaintextlayout.hpp \
+    ../../src/messages/thumbnailcache.hpp \
     ../../src/Settings/privacysettingspage.hpp \
     ../../src/messages/typingitem.hpp \
     ../../src/Settings/informationiconlabel.hpp
@@ -16,11 +16,79 @@
 
 #include "abstractsettingspage.hpp"
 
+#include <QAbstractButton>
+#include <QAbstractItemModel>
+#include <QComboBox>
+#include <QGroupBox>
+#include <QLineEdit>
+#include <QSpinBox>
+
+namespace {
+
+// combo boxes keep their items, and their completers' in models of their own
+bool isInComboBox(const QObject* object)
+{
+    for (const QObject* parent = object->parent(); parent; parent = parent->parent()) {
+        if (qobject_cast<const QComboBox*>(parent)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}
+
 AbstractSettingsPage::AbstractSettingsPage(QWidget *parent) :
-    QWidget(parent)
+    QWidget(parent),
+    modified(false)
 {
 }
 
 AbstractSettingsPage::~AbstractSettingsPage()
 {
 }
+
+bool AbstractSettingsPage::isModified() const
+{
+    return modified;
+}
+
+void AbstractSettingsPage::setModified(bool newModified)
+{
+    modified = newModified;
+}
+
+void AbstractSettingsPage::watchForChanges()
+{
+    auto markModified = [this]() { setModified(); };
+
+    // only signals of user edits, e.g. a combo box being filled later on doesn't count
+    for (QAbstractButton* button : findChildren<QAbstractButton*>()) {
+        if (button->isCheckable()) {
+            connect(button, &QAbstractButton::toggled, this, markModified);
+        }
+    }
+    for (QGroupBox* group : findChildren<QGroupBox*>()) {
+        if (group->isCheckable()) {
+            connect(group, &QGroupBox::toggled, this, markModified);
+        }
+    }
+    for (QComboBox* comboBox : findChildren<QComboBox*>()) {
+        connect(comboBox, static_cast<void (QComboBox::*)(int)>(&QComboBox::activated), this, markModified);
+    }
+    for (QLineEdit* lineEdit : findChildren<QLineEdit*>()) {
+        connect(lineEdit, &QLineEdit::textEdited, this, markModified);
+    }
+    for (QSpinBox* spinBox : findChildren<QSpinBox*>()) {
+        connect(spinBox, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), this, markModified);
+    }
+    // lists edited through buttons and dialogs, like the DHT servers
+    for (QAbstractItemModel* model : findChildren<QAbstractItemModel*>()) {
+        if (isInComboBox(model)) {
+            continue;
+        }
+        connect(model, &QAbstractItemModel::rowsInserted, this, markModified);
+        connect(model, &QAbstractItemModel::rowsRemoved, this, markModified);
+        connect(model, &QAbstractItemModel::dataChanged, this, markModified);
+    }
+}
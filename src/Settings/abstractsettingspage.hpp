@@ -29,6 +29,17 @@ public:
     virtual void buildGui() = 0;
     virtual void setGui() = 0;
 
+    // Whether the user changed anything since setGui(), only modified pages get their changes applied
+    bool isModified() const;
+    void setModified(bool modified = true);
+
+    // Marks the page modified as soon as the user edits one of its input widgets.
+    // Call after setGui(), so filling the widgets doesn't count.
+    void watchForChanges();
+
+private:
+    bool modified;
+
 };
 
 #endif // ABSTRACTSETTINGSPAGE_HPP
@@ -49,26 +49,50 @@ BasicSettingsDialog::BasicSettingsDialog(QWidget *parent) :
     dialogLayout->addWidget(splitter,   0, 0, 1, 1);
     dialogLayout->addWidget(buttonBox,  1, 0, 1, 1);
 
-    connect(listWidget, &QListWidget::currentRowChanged, stackedWidget, &QStackedWidget::setCurrentIndex);
+    connect(listWidget, &QListWidget::currentRowChanged, this, &BasicSettingsDialog::showPage);
 }
 
 BasicSettingsDialog::~BasicSettingsDialog()
 {
 }
 
-void BasicSettingsDialog::addPage(const QString& iconPath, const QString& name, AbstractSettingsPage* page)
+void BasicSettingsDialog::addPage(const QString& iconPath, const QString& name, PageFactory createPage)
 {
     listWidget->addItem(new QListWidgetItem(QIcon(iconPath), name, listWidget));
-    page->buildGui();
-    page->setGui();
-    stackedWidget->addWidget(page);
+    pageFactories << createPage;
+    pages << nullptr;
+    stackedWidget->addWidget(new QWidget(stackedWidget));
+}
+
+void BasicSettingsDialog::showPage(int index)
+{
+    if (index < 0 || index >= pages.count()) {
+        return;
+    }
+
+    if (!pages.at(index)) {
+        AbstractSettingsPage* page = pageFactories.at(index)();
+        page->buildGui();
+        page->setGui();
+        page->watchForChanges();
+
+        QWidget* placeholder = stackedWidget->widget(index);
+        stackedWidget->insertWidget(index, page);
+        stackedWidget->removeWidget(placeholder);
+        delete placeholder;
+        pages[index] = page;
+    }
+
+    stackedWidget->setCurrentIndex(index);
 }
 
 void BasicSettingsDialog::accept()
 {
-    for (int i = 0; i < stackedWidget->count(); i ++) {
-        AbstractSettingsPage* settinsPage = static_cast<AbstractSettingsPage*>(stackedWidget->widget(i));
-        settinsPage->applyChanges();
+    // pages that weren't opened or changed keep the settings as they are
+    for (AbstractSettingsPage* page : pages) {
+        if (page && page->isModified()) {
+            page->applyChanges();
+        }
     }
 
     QDialog::accept();
@@ -22,6 +22,9 @@
 #include <QDialog>
 #include <QListWidget>
 #include <QStackedWidget>
+#include <QVector>
+
+#include <functional>
 
 class BasicSettingsDialog : public QDialog
 {
@@ -35,7 +38,17 @@ protected:
     QListWidget* listWidget;
     QStackedWidget* stackedWidget;
 
-    void addPage(const QString& iconPath, const QString& name, AbstractSettingsPage* page);
+    typedef std::function<AbstractSettingsPage*()> PageFactory;
+
+    // The page is only created once it's selected for the first time
+    void addPage(const QString& iconPath, const QString& name, PageFactory createPage);
+
+private:
+    void showPage(int index);
+
+    QVector<PageFactory> pageFactories;
+    // nullptr until the page is shown, a placeholder takes its place in stackedWidget
+    QVector<AbstractSettingsPage*> pages;
 };
 
 #endif // BASICSETTINGSDIALOG_HPP
@@ -22,9 +22,13 @@
 #include <QPushButton>
 #include <QVBoxLayout>
 
+#include <climits>
+
 DhtBootstrapSettingsPage::DhtBootstrapSettingsPage(QWidget* parent) :
     AbstractSettingsPage(parent), serverListIsDirty(false)
 {
+    connect(&prober, &DhtProber::serverProbed, this, &DhtBootstrapSettingsPage::onServerProbed);
+    connect(&prober, &DhtProber::finished, this, &DhtBootstrapSettingsPage::onProbingFinished);
 }
 
 void DhtBootstrapSettingsPage::buildGui()
@@ -42,26 +46,35 @@ QGroupBox* DhtBootstrapSettingsPage::buildServerGroup()
     QGridLayout* layout = new QGridLayout(group);
 
     serverListModel = new QStandardItemModel(group);
-    serverListModel->setHorizontalHeaderLabels(QStringList() << "Name");
+    serverListModel->setHorizontalHeaderLabels(QStringList() << "Name" << "Latency");
+    // names sort by name, latencies by their value with servers that weren't probed or are unreachable last
+    serverListModel->setSortRole(SortRole);
 
     serverListView = new CustomHintTreeView(group, QSize(10, 10));
     serverListView->setModel(serverListModel);
     serverListView->setIndentation(0);
     serverListView->setSortingEnabled(true);
-    serverListView->header()->setSortIndicator(0, Qt::AscendingOrder);
+    serverListView->header()->setSortIndicator(NameColumn, Qt::AscendingOrder);
+    serverListView->header()->setSectionResizeMode(NameColumn, QHeaderView::Stretch);
+    serverListView->header()->setSectionResizeMode(LatencyColumn, QHeaderView::ResizeToContents);
+    serverListView->header()->setStretchLastSection(false);
 
     QPushButton* serverAddButton = new QPushButton("Add", group);
     QPushButton* serverRemoveButton = new QPushButton("Remove", group);
     QPushButton* serverEditButton = new QPushButton("Edit", group);
+    serverProbeButton = new QPushButton("Probe all", group);
+    serverProbeButton->setToolTip("Measure how fast every server answers, the fastest ones are bootstrapped from first");
 
     connect(serverAddButton,    &QPushButton::clicked, this, &DhtBootstrapSettingsPage::serverAddButtonClicked);
     connect(serverRemoveButton, &QPushButton::clicked, this, &DhtBootstrapSettingsPage::serverRemoveButtonClicked);
     connect(serverEditButton,   &QPushButton::clicked, this, &DhtBootstrapSettingsPage::serverEditButtonClicked);
+    connect(serverProbeButton,  &QPushButton::clicked, this, &DhtBootstrapSettingsPage::serverProbeButtonClicked);
 
     layout->addWidget(serverListView,     0, 0, 6, 3);
     layout->addWidget(serverAddButton,    0, 3, 1, 1);
     layout->addWidget(serverEditButton,   1, 3, 1, 1);
     layout->addWidget(serverRemoveButton, 2, 3, 1, 1);
+    layout->addWidget(serverProbeButton,  3, 3, 1, 1);
 
     return group;
 }
@@ -72,15 +85,45 @@ void DhtBootstrapSettingsPage::setGui()
     const QList<Settings::DhtServer>& serverList = settings.getDhtServerList();
     uniqueKey = 0;
     for (const Settings::DhtServer& server : serverList) {
-        QStandardItem* serverItem = new QStandardItem(server.name);
-        serverItem->setEditable(false);
-        serverItem->setData(uniqueKey);
-        serverListModel->appendRow(serverItem);
-
+        appendServer(uniqueKey, server);
         serverHash[uniqueKey] = server;
         uniqueKey++;
     }
-    serverListModel->sort(0, Qt::AscendingOrder);
+    sortServers();
+}
+
+void DhtBootstrapSettingsPage::appendServer(int key, const Settings::DhtServer& server)
+{
+    QStandardItem* name = new QStandardItem(server.name);
+    name->setEditable(false);
+    name->setData(key, KeyRole);
+    name->setData(server.name.toLower(), SortRole);
+
+    QStandardItem* latency = new QStandardItem();
+    latency->setEditable(false);
+    setLatencyItem(latency, server.latency);
+
+    serverListModel->appendRow(QList<QStandardItem*>() << name << latency);
+}
+
+void DhtBootstrapSettingsPage::setLatencyItem(QStandardItem* item, int latency)
+{
+    if (latency >= 0) {
+        item->setText(QString("%1 ms").arg(latency));
+        item->setData(latency, SortRole);
+    } else if (latency == Settings::DhtServer::UNREACHABLE) {
+        item->setText("unreachable");
+        item->setData(INT_MAX - 1, SortRole);
+    } else {
+        item->setText(QString());
+        item->setData(INT_MAX, SortRole);
+    }
+}
+
+void DhtBootstrapSettingsPage::sortServers()
+{
+    QHeaderView* header = serverListView->header();
+    serverListModel->sort(header->sortIndicatorSection(), header->sortIndicatorOrder());
 }
 
 void DhtBootstrapSettingsPage::applyChanges()
@@ -106,15 +149,11 @@ void DhtBootstrapSettingsPage::serverAddButtonClicked()
     DhtServerDialog serverInfoDialog(this);
     if (serverInfoDialog.exec() == QDialog::Accepted) {
         Settings::DhtServer serverInfo = serverInfoDialog.getServerInformation();
-        QStandardItem* name = new QStandardItem(serverInfo.name);
-        name->setEditable(false);
-        name->setData(uniqueKey);
         serverHash[uniqueKey] = serverInfo;
+        appendServer(uniqueKey, serverInfo);
         uniqueKey++;
-        name->setFlags(name->flags() & ~Qt::ItemIsEditable);
-        serverListModel->appendRow(name);
-        serverListView->setCurrentIndex(serverListModel->indexFromItem(name));
-        serverListModel->sort(0, Qt::AscendingOrder);
+        serverListView->setCurrentIndex(serverListModel->index(serverListModel->rowCount() - 1, NameColumn));
+        sortServers();
         serverListIsDirty = true;
     }
 }
@@ -124,7 +163,7 @@ void DhtBootstrapSettingsPage::serverRemoveButtonClicked()
     QModelIndex currentIndex = serverListView->currentIndex();
     if (currentIndex != QModelIndex()) {
         QList<QStandardItem*> removedRow = serverListModel->takeRow(currentIndex.row());
-        serverHash.remove(removedRow.at(0)->data().toInt());
+        serverHash.remove(removedRow.at(NameColumn)->data(KeyRole).toInt());
         qDeleteAll(removedRow);
         serverListIsDirty = true;
     }
@@ -132,20 +171,64 @@ void DhtBootstrapSettingsPage::serverRemoveButtonClicked()
 
 void DhtBootstrapSettingsPage::serverEditButtonClicked()
 {
-    QModelIndex currentIndex = serverListView->currentIndex();
+    // the current index can be in any column, the key is kept by the name
+    QModelIndex currentIndex = serverListView->currentIndex().sibling(serverListView->currentIndex().row(), NameColumn);
     if (currentIndex == QModelIndex()) {
         return;
     }
 
     DhtServerDialog serverInfoDialog(this);
-    const int id = serverListModel->itemFromIndex(currentIndex)->data().toInt();
+    const int id = serverListModel->itemFromIndex(currentIndex)->data(KeyRole).toInt();
     Settings::DhtServer oldServerInfo = serverHash[id];
     serverInfoDialog.setServerInformation(oldServerInfo);
     if (serverInfoDialog.exec() == QDialog::Accepted) {
         Settings::DhtServer newServerInfo = serverInfoDialog.getServerInformation();
+        // the latency only holds as long as it's the same server
+        if (newServerInfo.address == oldServerInfo.address && newServerInfo.port == oldServerInfo.port) {
+            newServerInfo.latency = oldServerInfo.latency;
+        }
         serverListModel->setData(currentIndex, newServerInfo.name);
+        serverListModel->setData(currentIndex, newServerInfo.name.toLower(), SortRole);
+        setLatencyItem(serverListModel->item(currentIndex.row(), LatencyColumn), newServerInfo.latency);
         serverHash[id] = newServerInfo;
-        serverListModel->sort(0, Qt::AscendingOrder);
+        sortServers();
         serverListIsDirty = true;
     }
 }
+
+void DhtBootstrapSettingsPage::serverProbeButtonClicked()
+{
+    if (serverHash.isEmpty()) {
+        return;
+    }
+
+    serverProbeButton->setEnabled(false);
+    serverProbeButton->setText("Probing...");
+    prober.probe(serverHash);
+}
+
+void DhtBootstrapSettingsPage::onServerProbed(int key, int latency)
+{
+    // the server could have been removed meanwhile
+    QHash<int, Settings::DhtServer>::iterator it = serverHash.find(key);
+    if (it == serverHash.end()) {
+        return;
+    }
+    it.value().latency = latency;
+
+    for (int row = 0; row < serverListModel->rowCount(); row++) {
+        if (serverListModel->item(row, NameColumn)->data(KeyRole).toInt() == key) {
+            setLatencyItem(serverListModel->item(row, LatencyColumn), latency);
+            break;
+        }
+    }
+    // the ranking is passed on to the bootstrap order with the server list
+    serverListIsDirty = true;
+}
+
+void DhtBootstrapSettingsPage::onProbingFinished()
+{
+    serverProbeButton->setEnabled(true);
+    serverProbeButton->setText("Probe all");
+    sortServers();
+}
@@ -18,9 +18,11 @@
 #define DHTBOOTSTRAPSETTINGSPAGE_HPP
 
 #include "abstractsettingspage.hpp"
+#include "dhtprober.hpp"
 #include "settings.hpp"
 
 #include <QGroupBox>
+#include <QPushButton>
 #include <QSortFilterProxyModel>
 #include <QStandardItemModel>
 #include <QTreeView>
@@ -36,17 +38,28 @@ public:
 
 private:
     QGroupBox* buildServerGroup();
+    void appendServer(int key, const Settings::DhtServer& server);
+    void setLatencyItem(QStandardItem* item, int latency);
+    void sortServers();
+
+    enum Column {NameColumn = 0, LatencyColumn};
+    enum Role {KeyRole = Qt::UserRole + 1, SortRole};
 
     QHash<int, Settings::DhtServer> serverHash;
     int uniqueKey;
     QStandardItemModel* serverListModel;
     QTreeView* serverListView;
+    QPushButton* serverProbeButton;
+    DhtProber prober;
     bool serverListIsDirty;
 
 private slots:
     void serverAddButtonClicked();
     void serverRemoveButtonClicked();
     void serverEditButtonClicked();
+    void serverProbeButtonClicked();
+    void onServerProbed(int key, int latency);
+    void onProbingFinished();
 
 };
 
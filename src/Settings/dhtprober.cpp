@@ -0,0 +1,119 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "dhtprober.hpp"
+
+#include <QTcpSocket>
+
+DhtProber::DhtProber(QObject* parent) :
+    QObject(parent)
+{
+    timeoutTimer.setSingleShot(true);
+    timeoutTimer.setInterval(TIMEOUT);
+    connect(&timeoutTimer, &QTimer::timeout, this, &DhtProber::onTimeout);
+}
+
+DhtProber::~DhtProber()
+{
+    abort();
+}
+
+void DhtProber::probe(const QHash<int, Settings::DhtServer>& servers)
+{
+    abort();
+
+    for (QHash<int, Settings::DhtServer>::const_iterator it = servers.constBegin(); it != servers.constEnd(); ++it) {
+        QTcpSocket* socket = new QTcpSocket(this);
+        connect(socket, &QTcpSocket::hostFound, this, &DhtProber::onHostFound);
+        connect(socket, &QTcpSocket::connected, this, &DhtProber::onConnected);
+        connect(socket, static_cast<void (QTcpSocket::*)(QAbstractSocket::SocketError)>(&QTcpSocket::error), this, &DhtProber::onError);
+
+        Probe probe;
+        probe.key = it.key();
+        probe.time.start();
+        probes.insert(socket, probe);
+        socket->connectToHost(it.value().address, it.value().port);
+    }
+
+    if (probes.isEmpty()) {
+        emit finished();
+    } else {
+        timeoutTimer.start();
+    }
+}
+
+void DhtProber::abort()
+{
+    timeoutTimer.stop();
+    for (QTcpSocket* socket : probes.keys()) {
+        socket->disconnect(this);
+        socket->abort();
+        socket->deleteLater();
+    }
+    probes.clear();
+}
+
+bool DhtProber::isProbing() const
+{
+    return !probes.isEmpty();
+}
+
+void DhtProber::finishProbe(QTcpSocket* socket, int latency)
+{
+    QHash<QTcpSocket*, Probe>::iterator it = probes.find(socket);
+    if (it == probes.end()) {
+        return;
+    }
+
+    const int key = it.value().key;
+    probes.erase(it);
+    socket->disconnect(this);
+    socket->abort();
+    socket->deleteLater();
+
+    emit serverProbed(key, latency);
+    if (probes.isEmpty()) {
+        timeoutTimer.stop();
+        emit finished();
+    }
+}
+
+void DhtProber::onHostFound()
+{
+    // only the handshake is timed, the name lookup says nothing about the server
+    QHash<QTcpSocket*, Probe>::iterator it = probes.find(static_cast<QTcpSocket*>(sender()));
+    if (it != probes.end()) {
+        it.value().time.restart();
+    }
+}
+
+void DhtProber::onConnected()
+{
+    QTcpSocket* socket = static_cast<QTcpSocket*>(sender());
+    finishProbe(socket, probes.value(socket).time.elapsed());
+}
+
+void DhtProber::onError()
+{
+    finishProbe(static_cast<QTcpSocket*>(sender()), Settings::DhtServer::UNREACHABLE);
+}
+
+void DhtProber::onTimeout()
+{
+    for (QTcpSocket* socket : probes.keys()) {
+        finishProbe(socket, Settings::DhtServer::UNREACHABLE);
+    }
+}
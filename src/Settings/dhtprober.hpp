@@ -0,0 +1,72 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef DHTPROBER_HPP
+#define DHTPROBER_HPP
+
+#include "settings.hpp"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QTimer>
+
+class QTcpSocket;
+
+// Measures the reachability and round trip time of DHT servers, all of them at once.
+// A DHT ping needs toxcore's keys, so a TCP connect to the server's port is timed instead:
+// bootstrap nodes run their TCP relay there, and the handshake is a single round trip.
+// The sockets are non-blocking, so probing doesn't hold up the thread it runs in.
+class DhtProber : public QObject
+{
+    Q_OBJECT
+public:
+    explicit DhtProber(QObject* parent = 0);
+    ~DhtProber();
+
+    // Probes the servers, keyed by whatever the caller uses to tell them apart.
+    // Probes that are still running are aborted.
+    void probe(const QHash<int, Settings::DhtServer>& servers);
+    void abort();
+    bool isProbing() const;
+
+    static const int TIMEOUT = 3000; // ms
+
+signals:
+    // latency is in ms, or Settings::DhtServer::UNREACHABLE
+    void serverProbed(int key, int latency);
+    void finished();
+
+private:
+    struct Probe {
+        int key;
+        QElapsedTimer time;
+    };
+
+    void finishProbe(QTcpSocket* socket, int latency);
+
+    QHash<QTcpSocket*, Probe> probes;
+    QTimer timeoutTimer;
+
+private slots:
+    void onHostFound();
+    void onConnected();
+    void onError();
+    void onTimeout();
+
+};
+
+#endif // DHTPROBER_HPP
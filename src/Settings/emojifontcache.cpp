@@ -0,0 +1,177 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "emojifontcache.hpp"
+#include "settings.hpp"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDebug>
+#include <QFile>
+#include <QFontDatabase>
+#include <QFontMetrics>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QThreadPool>
+
+const QString EmojiFontCache::FILENAME = "emojifonts.cache";
+
+namespace {
+
+// Probes the families on QThreadPool and hands them back to the cache in chunks
+class EmojiFontProber : public QRunnable
+{
+public:
+    EmojiFontProber(EmojiFontCache* cache, const QStringList& families) :
+        cache(cache),
+        families(families)
+    {
+    }
+
+    void run()
+    {
+        QStringList found;
+        QFont font;
+        for (int i = 0; i < families.count(); i++) {
+            font.setFamily(families.at(i));
+            QFontMetrics metrics(font);
+            // Emoticons, Range: 1F600–1F64F
+            // http://www.unicode.org/charts/PDF/U1F600.pdf
+            if (metrics.inFontUcs4(EmojiFontCache::GRINNING_CAT_FACE_WITH_SMILING_EYES)) {
+                found << families.at(i);
+            }
+
+            const bool last = i == families.count() - 1;
+            if (last || (i + 1) % EmojiFontCache::CHUNK_SIZE == 0) {
+                QMetaObject::invokeMethod(cache, "onFamiliesProbed", Qt::QueuedConnection,
+                                          Q_ARG(QStringList, found), Q_ARG(bool, last));
+                found.clear();
+            }
+        }
+        if (families.isEmpty()) {
+            QMetaObject::invokeMethod(cache, "onFamiliesProbed", Qt::QueuedConnection,
+                                      Q_ARG(QStringList, found), Q_ARG(bool, true));
+        }
+    }
+
+private:
+    // the cache is a singleton, it outlives the pool's jobs
+    EmojiFontCache* cache;
+    QStringList families;
+};
+
+}
+
+EmojiFontCache::EmojiFontCache() :
+    complete(false),
+    probing(false)
+{
+}
+
+EmojiFontCache& EmojiFontCache::getInstance()
+{
+    static EmojiFontCache instance;
+    return instance;
+}
+
+const QStringList& EmojiFontCache::getFamilies() const
+{
+    return families;
+}
+
+bool EmojiFontCache::isComplete() const
+{
+    return complete;
+}
+
+void EmojiFontCache::probe()
+{
+    if (complete || probing) {
+        return;
+    }
+
+    // listing the families is quick, it's measuring them that isn't
+    const QStringList installedFamilies = QFontDatabase().families();
+    currentFingerprint = fingerprint(installedFamilies);
+    if (loadCache()) {
+        complete = true;
+        emit familiesFound(families);
+        emit probingFinished();
+        return;
+    }
+
+    probing = true;
+    QThreadPool::globalInstance()->start(new EmojiFontProber(this, installedFamilies));
+}
+
+void EmojiFontCache::onFamiliesProbed(const QStringList& found, bool last)
+{
+    families << found;
+    if (!found.isEmpty()) {
+        emit familiesFound(found);
+    }
+
+    if (last) {
+        probing = false;
+        complete = true;
+        saveCache();
+        emit probingFinished();
+    }
+}
+
+QByteArray EmojiFontCache::fingerprint(const QStringList& installedFamilies)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(QByteArray::number(installedFamilies.count()));
+    for (const QString& family : installedFamilies) {
+        hash.addData(family.toUtf8());
+        hash.addData("\n", 1);
+    }
+    return hash.result();
+}
+
+bool EmojiFontCache::loadCache()
+{
+    QFile file(Settings::getSettingsDirPath() + '/' + FILENAME);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream stream(&file);
+    quint32 version;
+    QByteArray cachedFingerprint;
+    QStringList cachedFamilies;
+    stream >> version >> cachedFingerprint >> cachedFamilies;
+    if (stream.status() != QDataStream::Ok || version != CACHE_VERSION || cachedFingerprint != currentFingerprint) {
+        return false;
+    }
+
+    families = cachedFamilies;
+    return true;
+}
+
+void EmojiFontCache::saveCache() const
+{
+    QSaveFile file(Settings::getSettingsDirPath() + '/' + FILENAME);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Emoji font cache" << file.fileName() << "cannot be written";
+        return;
+    }
+
+    QDataStream stream(&file);
+    stream << CACHE_VERSION << currentFingerprint << families;
+    file.commit();
+}
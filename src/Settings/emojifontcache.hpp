@@ -0,0 +1,69 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef EMOJIFONTCACHE_HPP
+#define EMOJIFONTCACHE_HPP
+
+#include <QObject>
+#include <QStringList>
+
+// Finds the installed fonts that can show emoji.
+// Probing every installed font takes seconds on systems with thousands of them, so it's done
+// once on QThreadPool and the result is kept in memory and on disk, keyed by a fingerprint of
+// the installed font families. Results arrive in chunks, so a combo box can fill up as it goes.
+class EmojiFontCache : public QObject
+{
+    Q_OBJECT
+public:
+    static EmojiFontCache& getInstance();
+
+    // Emoji fonts found so far
+    const QStringList& getFamilies() const;
+    bool isComplete() const;
+
+    // Starts probing unless it's done or running already. The disk cache is used if the
+    // installed fonts didn't change since it was written.
+    void probe();
+
+    static const uint GRINNING_CAT_FACE_WITH_SMILING_EYES = 0x1F638;
+    static const int CHUNK_SIZE = 50;
+
+signals:
+    // Emitted with the families found since the last time
+    void familiesFound(const QStringList& families);
+    void probingFinished();
+
+private slots:
+    void onFamiliesProbed(const QStringList& families, bool last);
+
+private:
+    EmojiFontCache();
+    Q_DISABLE_COPY(EmojiFontCache)
+
+    static QByteArray fingerprint(const QStringList& installedFamilies);
+    bool loadCache();
+    void saveCache() const;
+
+    QStringList families;
+    QByteArray currentFingerprint;
+    bool complete;
+    bool probing;
+
+    static const QString FILENAME;
+    static const quint32 CACHE_VERSION = 1;
+};
+
+#endif // EMOJIFONTCACHE_HPP
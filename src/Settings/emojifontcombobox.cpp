@@ -15,25 +15,55 @@
 */
 
 #include "emojifontcombobox.hpp"
-#include <QFontDatabase>
+#include "emojifontcache.hpp"
+
+#include <QLineEdit>
 
 EmojiFontComboBox::EmojiFontComboBox(QWidget *parent) :
     QComboBox(parent)
 {
-    QStringList emoticonFonts;
-    QFontDatabase db;
-    QFont f;
-    for (QString &family : db.families()) {
-        f.setFamily(family);
-        QFontMetrics fm (f);
-        // Emoticons, Range: 1F600–1F64F
-        // http://www.unicode.org/charts/PDF/U1F600.pdf
-        // check if a font has Emoticons support
-        if (fm.inFontUcs4(GRINNING_CAT_FACE_WITH_SMILING_EYES)) {
-            emoticonFonts << family;
+    setEditable(true);
+
+    EmojiFontCache& cache = EmojiFontCache::getInstance();
+    addFamilies(cache.getFamilies());
+    if (!cache.isComplete()) {
+        lineEdit()->setPlaceholderText(tr("Looking for emoji fonts..."));
+        connect(&cache, &EmojiFontCache::familiesFound, this, &EmojiFontComboBox::addFamilies);
+        connect(&cache, &EmojiFontCache::probingFinished, this, &EmojiFontComboBox::onProbingFinished);
+        cache.probe();
+    }
+}
+
+void EmojiFontComboBox::setCurrentFamily(const QString& family)
+{
+    if (family.isEmpty()) {
+        return;
+    }
+
+    int index = findText(family);
+    if (index == -1) {
+        addItem(family);
+        index = count() - 1;
+    }
+    setCurrentIndex(index);
+}
+
+void EmojiFontComboBox::addFamilies(const QStringList& families)
+{
+    // don't let the first item found replace the selection
+    const QString current = currentText();
+    for (const QString& family : families) {
+        if (findText(family) == -1) {
+            addItem(family);
         }
     }
-    addItems(emoticonFonts);
+    const int index = findText(current);
+    if (index != -1) {
+        setCurrentIndex(index);
+    }
+}
 
-    setEditable(true);
+void EmojiFontComboBox::onProbingFinished()
+{
+    lineEdit()->setPlaceholderText(QString());
 }
@@ -19,17 +19,22 @@
 
 #include <QComboBox>
 
+// Lists the fonts with emoji support, filled in as EmojiFontCache finds them
 class EmojiFontComboBox : public QComboBox
 {
     Q_OBJECT
 public:
     explicit EmojiFontComboBox(QWidget *parent = 0);
 
-    static const uint GRINNING_CAT_FACE_WITH_SMILING_EYES = 0x1F638;
+    // Selects family, it's added right away if the fonts weren't probed yet
+    void setCurrentFamily(const QString& family);
+
 signals:
     
-public slots:
-    
+private slots:
+    void addFamilies(const QStringList& families);
+    void onProbingFinished();
+
 };
 
 #endif // EMOJIFONTCOMBOBOX_HPP
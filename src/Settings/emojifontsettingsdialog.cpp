@@ -91,7 +91,7 @@ QString EmojiFontSettingsDialog::getFontFamily() const
 
 void EmojiFontSettingsDialog::setFontFamily(QString fontFamily)
 {
-    fontComboBox->setCurrentIndex(fontComboBox->findText(fontFamily));
+    fontComboBox->setCurrentFamily(fontFamily);
     defaultFontFamily = fontFamily;
 }
 
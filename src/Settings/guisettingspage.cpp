@@ -32,7 +32,9 @@
 #include <QLabel>
 #include <QToolButton>
 #include <QLineEdit>
+#include <QSpinBox>
 #include <QDateTime>
+#include <QGLFormat>
 
 #include "smileypack.hpp"
 #include "emojifontsettingsdialog.hpp"
@@ -58,6 +60,8 @@ void GuiSettingsPage::setGui()
     const Settings& settings = Settings::getInstance();
     enableAnimationCheckbox->setChecked(settings.isAnimationEnabled());
     minimizeToTrayCheckbox->setChecked(settings.isMinimizeOnCloseEnabled());
+    notificationSoundsCheckbox->setChecked(settings.isNotificationSoundsEnabled());
+    sortByActivityCheckbox->setChecked(settings.isSortFriendsByActivityEnabled());
 
     emojiSettings->setUseCustomFont(settings.isCurstomEmojiFont());
     emojiSettings->setFontFamily(settings.getEmojiFontFamily());
@@ -92,6 +96,14 @@ void GuiSettingsPage::setGui()
     smileypackCombobox->setCurrentIndex(index);
 
     timestampLineedit->setText(settings.getTimestampFormat());
+    scrollbackSpinbox->setValue(settings.getScrollbackLimit());
+    groupMessagesCheckbox->setChecked(settings.isGroupMessagesEnabled());
+    pixmapCacheCheckbox->setChecked(settings.isChatLinePixmapCacheEnabled());
+    documentCacheSpinbox->setValue(settings.getDocumentCacheSize());
+    memoryCeilingSpinbox->setValue(settings.getMemoryCeiling());
+    coldContentsSpinbox->setValue(settings.getColdContentsDistance());
+    inlinePreviewsCheckbox->setChecked(settings.isInlinePreviewsEnabled());
+    openGLCheckbox->setChecked(settings.isChatViewOpenGLEnabled());
 }
 
 void GuiSettingsPage::applyChanges()
@@ -105,7 +117,17 @@ void GuiSettingsPage::applyChanges()
     settings.setEmojiFontPointSize(emojiSettings->getFontPointSize());
     
     settings.setTimestampFormat(timestampLineedit->text());
+    settings.setScrollbackLimit(scrollbackSpinbox->value());
+    settings.setGroupMessages(groupMessagesCheckbox->isChecked());
+    settings.setChatLinePixmapCache(pixmapCacheCheckbox->isChecked());
+    settings.setDocumentCacheSize(documentCacheSpinbox->value());
+    settings.setMemoryCeiling(memoryCeilingSpinbox->value());
+    settings.setColdContentsDistance(coldContentsSpinbox->value());
+    settings.setInlinePreviews(inlinePreviewsCheckbox->isChecked());
+    settings.setChatViewOpenGL(openGLCheckbox->isChecked());
     settings.setMinimizeOnClose(minimizeToTrayCheckbox->isChecked());
+    settings.setNotificationSounds(notificationSoundsCheckbox->isChecked());
+    settings.setSortFriendsByActivity(sortByActivityCheckbox->isChecked());
 }
 
 QGroupBox *GuiSettingsPage::buildAnimationGroup()
@@ -158,6 +180,51 @@ QGroupBox *GuiSettingsPage::buildChatviewGroup()
 
     layout->addRow(tr("Timestamp format:"), horizontal);
 
+    scrollbackSpinbox = new QSpinBox(group);
+    scrollbackSpinbox->setRange(0, 1000000);
+    scrollbackSpinbox->setSingleStep(500);
+    scrollbackSpinbox->setSpecialValueText(tr("Unlimited"));
+    scrollbackSpinbox->setToolTip(tr("Older lines are kept on disk and loaded again when you scroll up."));
+    layout->addRow(tr("Lines kept in memory:"), scrollbackSpinbox);
+
+    documentCacheSpinbox = new QSpinBox(group);
+    documentCacheSpinbox->setRange(0, 1024);
+    documentCacheSpinbox->setSuffix(tr(" MB"));
+    documentCacheSpinbox->setToolTip(tr("Laid out text of lines that scrolled out of view is kept up to this size."));
+    layout->addRow(tr("Text layout cache:"), documentCacheSpinbox);
+
+    memoryCeilingSpinbox = new QSpinBox(group);
+    memoryCeilingSpinbox->setRange(0, 65536);
+    memoryCeilingSpinbox->setSingleStep(64);
+    memoryCeilingSpinbox->setSuffix(tr(" MB"));
+    memoryCeilingSpinbox->setSpecialValueText(tr("None"));
+    memoryCeilingSpinbox->setToolTip(tr("Caches are dropped when the application uses more memory than this."));
+    layout->addRow(tr("Memory ceiling:"), memoryCeilingSpinbox);
+
+    coldContentsSpinbox = new QSpinBox(group);
+    coldContentsSpinbox->setRange(0, 1000000);
+    coldContentsSpinbox->setSingleStep(500);
+    coldContentsSpinbox->setSpecialValueText(tr("Never"));
+    coldContentsSpinbox->setToolTip(tr("Text of lines farther than this from the view is kept compressed in memory."));
+    layout->addRow(tr("Compress lines beyond:"), coldContentsSpinbox);
+
+    groupMessagesCheckbox = new QCheckBox(tr("Group consecutive messages of the same sender"), group);
+    groupMessagesCheckbox->setToolTip(tr("The sender and time are only shown on the first message of a run."));
+    layout->addRow(groupMessagesCheckbox);
+
+    pixmapCacheCheckbox = new QCheckBox(tr("Cache rendered lines"), group);
+    pixmapCacheCheckbox->setToolTip(tr("Makes scrolling through long chats faster, at the cost of more memory."));
+    layout->addRow(pixmapCacheCheckbox);
+
+    inlinePreviewsCheckbox = new QCheckBox(tr("Show previews of linked and received images"), group);
+    inlinePreviewsCheckbox->setToolTip(tr("Linked images are downloaded from their servers, which can see your IP address."));
+    layout->addRow(inlinePreviewsCheckbox);
+
+    openGLCheckbox = new QCheckBox(tr("Render chats with OpenGL"), group);
+    openGLCheckbox->setToolTip(tr("Scrolling and animations are drawn by the graphics card. Turn it off if chats aren't drawn correctly."));
+    openGLCheckbox->setEnabled(QGLFormat::hasOpenGL());
+    layout->addRow(openGLCheckbox);
+
     connect(timestampLineedit, &QLineEdit::textChanged, this, &GuiSettingsPage::updateTimestampPreview);
 
     return group;
@@ -184,7 +251,7 @@ void GuiSettingsPage::searchSmileyPacks()
 
         // Parse theme file
         Smileypack newPack;
-        if (!newPack.parseFile(f.absoluteFilePath())) {
+        if (!newPack.load(f.absoluteFilePath())) {
             continue;
         }
 
@@ -228,7 +295,11 @@ QGroupBox* GuiSettingsPage::buildOthersGroup()
     QGroupBox *group = new QGroupBox(tr("Others"), this);
     QVBoxLayout* layout = new QVBoxLayout(group);
     minimizeToTrayCheckbox = new QCheckBox(tr("Minimize to tray on close"), group);
+    notificationSoundsCheckbox = new QCheckBox(tr("Play notification sounds"), group);
+    sortByActivityCheckbox = new QCheckBox(tr("Sort friends by recent activity"), group);
 
     layout->addWidget(minimizeToTrayCheckbox);
+    layout->addWidget(notificationSoundsCheckbox);
+    layout->addWidget(sortByActivityCheckbox);
     return group;
 }
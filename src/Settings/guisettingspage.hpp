@@ -26,6 +26,7 @@ class QLabel;
 class QToolButton;
 class EmojiFontSettingsDialog;
 class QLineEdit;
+class QSpinBox;
 
 class GuiSettingsPage : public AbstractSettingsPage
 {
@@ -52,12 +53,22 @@ private:
     EmojiFontSettingsDialog *emojiSettings;
     QCheckBox* enableAnimationCheckbox;
     QCheckBox* minimizeToTrayCheckbox;
+    QCheckBox* notificationSoundsCheckbox;
+    QCheckBox* sortByActivityCheckbox;
 
     QComboBox* smileypackCombobox;
     QToolButton *emojiButton;
     QLabel*    smileypackDescLabel;
     QLineEdit *timestampLineedit;
     QLabel    *timestampPreview;
+    QSpinBox  *scrollbackSpinbox;
+    QCheckBox *pixmapCacheCheckbox;
+    QCheckBox *inlinePreviewsCheckbox;
+    QCheckBox *groupMessagesCheckbox;
+    QCheckBox *openGLCheckbox;
+    QSpinBox  *documentCacheSpinbox;
+    QSpinBox  *memoryCeilingSpinbox;
+    QSpinBox  *coldContentsSpinbox;
 };
 
 
@@ -50,6 +50,10 @@ QGroupBox* NetworkSettingsPage::buildNetworkGroup()
 
     enableIPv4FallbackCheckBox = new QCheckBox("Fallback to IPv4", group);
 
+    raceTcpRelaysCheckBox = new QCheckBox("Try TCP relays alongside UDP", group);
+    raceTcpRelaysCheckBox->setToolTip("Connects through whichever gets through first on networks that block UDP, "
+                                      "and remembers it for the next start on the same network");
+
     connect(enableIPv6CheckBox, &QCheckBox::stateChanged, this, &NetworkSettingsPage::IPv6CheckBoxStateChanged);
 
     QHBoxLayout *IPv6Layout = new QHBoxLayout();
@@ -60,6 +64,7 @@ QGroupBox* NetworkSettingsPage::buildNetworkGroup()
 
     layout->addLayout(IPv6Layout);
     layout->addWidget(enableIPv4FallbackCheckBox);
+    layout->addWidget(raceTcpRelaysCheckBox);
 
     return group;
 }
@@ -69,6 +74,7 @@ void NetworkSettingsPage::setGui()
     const Settings& settings = Settings::getInstance();
     enableIPv6CheckBox->setChecked(settings.isIPv6Enabled());
     enableIPv4FallbackCheckBox->setChecked(settings.isIPv4FallbackEnabled());
+    raceTcpRelaysCheckBox->setChecked(settings.isTcpRelayRaceEnabled());
     IPv6CheckBoxStateChanged(enableIPv6CheckBox->isChecked() ? Qt::Checked : Qt::Unchecked);
 }
 
@@ -77,6 +83,7 @@ void NetworkSettingsPage::applyChanges()
     Settings& settings = Settings::getInstance();
     settings.setIPv6Enabled(enableIPv6CheckBox->isChecked());
     settings.setIPv4FallbackEnabled(enableIPv4FallbackCheckBox->isChecked());
+    settings.setTcpRelayRaceEnabled(raceTcpRelaysCheckBox->isChecked());
 }
 
 void NetworkSettingsPage::IPv6CheckBoxStateChanged(int state) {
@@ -36,6 +36,7 @@ private:
 
     QCheckBox *enableIPv6CheckBox;
     QCheckBox *enableIPv4FallbackCheckBox;
+    QCheckBox *raceTcpRelaysCheckBox;
 
 private slots:
     void IPv6CheckBoxStateChanged(int state);
@@ -30,6 +30,7 @@ void PrivacySettingsPage::buildGui()
     QVBoxLayout *layout = new QVBoxLayout(this);
 
     layout->addWidget(buildTypingGroup());
+    layout->addWidget(buildLocalApiGroup());
     layout->addStretch(0);
 }
 
@@ -37,12 +38,14 @@ void PrivacySettingsPage::setGui()
 {
     const Settings &settings = Settings::getInstance();
     mTypingCheckbox->setChecked(settings.isTypingNotificationEnabled());
+    mLocalApiCheckbox->setChecked(settings.isLocalApiEnabled());
 }
 
 void PrivacySettingsPage::applyChanges()
 {
     Settings &settings = Settings::getInstance();
     settings.setTypingNotification(mTypingCheckbox->isChecked());
+    settings.setLocalApiEnabled(mLocalApiCheckbox->isChecked());
 }
 
 QGroupBox *PrivacySettingsPage::buildTypingGroup()
@@ -53,3 +56,12 @@ QGroupBox *PrivacySettingsPage::buildTypingGroup()
     layout->addWidget(mTypingCheckbox);
     return group;
 }
+
+QGroupBox *PrivacySettingsPage::buildLocalApiGroup()
+{
+    QGroupBox *group = new QGroupBox(tr("Local API"), this);
+    QVBoxLayout *layout = new QVBoxLayout(group);
+    mLocalApiCheckbox = new QCheckBox(tr("Let my other programs send messages in my name"), group);
+    layout->addWidget(mLocalApiCheckbox);
+    return group;
+}
@@ -38,7 +38,9 @@ public slots:
 
 private:
     QGroupBox *buildTypingGroup();
+    QGroupBox *buildLocalApiGroup();
     QCheckBox *mTypingCheckbox;
+    QCheckBox *mLocalApiCheckbox;
 };
 
 #endif // PRIVACYSETTINGSPAGE_H
@@ -17,24 +17,56 @@
 #include "settings.hpp"
 #include "settingsdialog.hpp"
 #include "smileypack.hpp"
+#include "startuptrace.hpp"
 
 #include <QApplication>
 #include <QDir>
 #include <QFile>
+#include <QFileInfo>
+#include <QRunnable>
+#include <QSaveFile>
 #include <QSettings>
 #include <QStandardPaths>
 
 const QString Settings::FILENAME = "settings.ini";
+const QString Settings::SMILEYPACK_FILENAME = "smileypack.dat";
+
+namespace {
+template <class T>
+class Writer : public QRunnable
+{
+public:
+    Writer(const T& write, void (*function)(const T&)) :
+        write(write), function(function)
+    {
+    }
+
+    void run()
+    {
+        function(write);
+    }
+
+private:
+    T write;
+    void (*function)(const T&);
+};
+}
 
 Settings::Settings() :
-    loaded(false)
+    loaded(false),
+    smileyPackVersion(0)
 {
+    writerPool.setMaxThreadCount(1);
+    saveTimer.setSingleShot(true);
+    saveTimer.setInterval(SAVE_DELAY);
+    connect(&saveTimer, &QTimer::timeout, this, [this]() {save();});
+
     load();
 }
 
 Settings::~Settings()
 {
-    save();
+    save(true);
 }
 
 Settings& Settings::getInstance()
@@ -53,7 +85,8 @@ void Settings::load()
 
     //if no settings file exist -- use the default one
     QFile file(filePath);
-    if (!file.exists()) {
+    const bool defaults = !file.exists();
+    if (defaults) {
         filePath = ":/texts/" + FILENAME;
     }
 
@@ -67,24 +100,27 @@ void Settings::load()
             server.userId = s.value("userId").toString();
             server.address = s.value("address").toString();
             server.port = s.value("port").toInt();
+            server.latency = s.value("latency", DhtServer::NOT_PROBED).toInt();
             dhtServerList << server;
         }
         s.endArray();
     s.endGroup();
 
-    //NOTE: uncomment when logging will be implemented
-/*
     s.beginGroup("Logging");
-       enableLogging = s.value("enableLogging", false).toBool();
-       encryptLogs = s.value("encryptLogs", true).toBool();
+        enableLogging = s.value("enableLogging", false).toBool();
+        encryptLogs = s.value("encryptLogs", true).toBool();
     s.endGroup();
-*/
 
     s.beginGroup("General");
         username = s.value("username", "My name").toString();
         statusMessage = s.value("statusMessage", "My status").toString();
     s.endGroup();
 
+    s.beginGroup("Profiles");
+        profiles = s.value("profiles", QStringList() << "Default").toStringList();
+        currentProfile = s.value("currentProfile", "Default").toString();
+    s.endGroup();
+
     s.beginGroup("Widgets");
         QList<QString> objectNames = s.childKeys();
         for (const QString& name : objectNames) {
@@ -94,88 +130,231 @@ void Settings::load()
 
     s.beginGroup("GUI");
         enableSmoothAnimation = s.value("smoothAnimation", true).toBool();
-        smileyPack = s.value("smileyPack").toByteArray();
+        // older versions kept the smiley pack in the INI
+        QFile smileyPackFile(getSettingsDirPath() + '/' + SMILEYPACK_FILENAME);
+        if (smileyPackFile.open(QIODevice::ReadOnly)) {
+            smileyPack = smileyPackFile.readAll();
+        } else {
+            smileyPack = s.value("smileyPack").toByteArray();
+        }
         customEmojiFont = s.value("customEmojiFont", true).toBool();
         emojiFontFamily = s.value("emojiFontFamily", "DejaVu Sans").toString();
-        emojiFontPointSize = s.value("emojiFontPointSize", QApplication::font().pointSize()).toInt();
+        // there are no fonts when running headless
+        const int defaultPointSize = qobject_cast<QApplication*>(QCoreApplication::instance()) ? QApplication::font().pointSize() : 10;
+        emojiFontPointSize = s.value("emojiFontPointSize", defaultPointSize).toInt();
         firstColumnHandlePos = s.value("firstColumnHandlePos", 50).toInt();
         secondColumnHandlePosFromRight = s.value("secondColumnHandlePosFromRight", 50).toInt();
         timestampFormat = s.value("timestampFormat", "hh:mm").toString();
+        scrollbackLimit = s.value("scrollbackLimit", 2000).toInt();
+        groupMessages = s.value("groupMessages", false).toBool();
+        chatLinePixmapCache = s.value("chatLinePixmapCache", false).toBool();
+        documentCacheSize = s.value("documentCacheSize", 16).toInt();
+        memoryCeiling = s.value("memoryCeiling", 0).toInt();
+        coldContentsDistance = s.value("coldContentsDistance", 1000).toInt();
+        // remote images are fetched from their servers, which learn our address
+        inlinePreviews = s.value("inlinePreviews", false).toBool();
+        chatViewOpenGL = s.value("chatViewOpenGL", false).toBool();
         minimizeOnClose = s.value("minimizeOnClose", false).toBool();
+        notificationSounds = s.value("notificationSounds", true).toBool();
+        sortFriendsByActivity = s.value("sortFriendsByActivity", false).toBool();
     s.endGroup();
 
     s.beginGroup("Privacy");
         typingNotification = s.value("typingNotification", false).toBool();
+        localApi = s.value("localApi", false).toBool();
     s.endGroup();
 
     s.beginGroup("Network");
         enableIPv6 = s.value("enableIPv6", true).toBool();
         enableIPv4Fallback = s.value("enableIPv4Fallback", true).toBool();
+        raceTcpRelays = s.value("raceTcpRelays", true).toBool();
+        ipv6FailureTime = s.value("ipv6FailureTime", 0).toLongLong();
     s.endGroup();
 
+    // the first save writes every key if we started from the defaults
+    if (!defaults) {
+        savedValues = values();
+        savedSmileyPack = smileyPack;
+        if (s.contains("GUI/smileyPack")) {
+            // have the next save move it out of the INI
+            savedValues.insert("GUI/smileyPack", QVariant());
+            savedSmileyPack.clear();
+        }
+    }
+
     loaded = true;
+    publish();
+    StartupTrace::mark("settings loaded");
 }
 
-void Settings::save()
+QVariantMap Settings::values() const
 {
-    QString filePath = getSettingsDirPath() + '/' + FILENAME;
+    QVariantMap v;
 
-    QSettings s(filePath, QSettings::IniFormat);
+    v.insert("DHT Server/dhtServerList/size", dhtServerList.size());
+    for (int i = 0; i < dhtServerList.size(); i ++) {
+        // QSettings arrays are 1-based
+        const QString prefix = QString("DHT Server/dhtServerList/%1/").arg(i + 1);
+        v.insert(prefix + "name", dhtServerList[i].name);
+        v.insert(prefix + "userId", dhtServerList[i].userId);
+        v.insert(prefix + "address", dhtServerList[i].address);
+        v.insert(prefix + "port", dhtServerList[i].port);
+        v.insert(prefix + "latency", dhtServerList[i].latency);
+    }
 
-    s.clear();
+    v.insert("Logging/enableLogging", enableLogging);
+    v.insert("Logging/encryptLogs", encryptLogs);
 
-    s.beginGroup("DHT Server");
-        s.beginWriteArray("dhtServerList", dhtServerList.size());
-        for (int i = 0; i < dhtServerList.size(); i ++) {
-            s.setArrayIndex(i);
-            s.setValue("name", dhtServerList[i].name);
-            s.setValue("userId", dhtServerList[i].userId);
-            s.setValue("address", dhtServerList[i].address);
-            s.setValue("port", dhtServerList[i].port);
+    v.insert("General/username", username);
+    v.insert("General/statusMessage", statusMessage);
+
+    v.insert("Profiles/profiles", profiles);
+    v.insert("Profiles/currentProfile", currentProfile);
+
+    for (auto it = widgetSettings.constBegin(); it != widgetSettings.constEnd(); ++it) {
+        v.insert("Widgets/" + it.key(), it.value());
+    }
+
+    v.insert("GUI/smoothAnimation", enableSmoothAnimation);
+    v.insert("GUI/customEmojiFont", customEmojiFont);
+    v.insert("GUI/emojiFontFamily", emojiFontFamily);
+    v.insert("GUI/emojiFontPointSize", emojiFontPointSize);
+    v.insert("GUI/firstColumnHandlePos", firstColumnHandlePos);
+    v.insert("GUI/secondColumnHandlePosFromRight", secondColumnHandlePosFromRight);
+    v.insert("GUI/timestampFormat", timestampFormat);
+    v.insert("GUI/scrollbackLimit", scrollbackLimit);
+    v.insert("GUI/groupMessages", groupMessages);
+    v.insert("GUI/chatLinePixmapCache", chatLinePixmapCache);
+    v.insert("GUI/documentCacheSize", documentCacheSize);
+    v.insert("GUI/memoryCeiling", memoryCeiling);
+    v.insert("GUI/coldContentsDistance", coldContentsDistance);
+    v.insert("GUI/inlinePreviews", inlinePreviews);
+    v.insert("GUI/chatViewOpenGL", chatViewOpenGL);
+    v.insert("GUI/minimizeOnClose", minimizeOnClose);
+    v.insert("GUI/notificationSounds", notificationSounds);
+    v.insert("GUI/sortFriendsByActivity", sortFriendsByActivity);
+
+    v.insert("Privacy/typingNotification", typingNotification);
+    v.insert("Privacy/localApi", localApi);
+
+    v.insert("Network/enableIPv6", enableIPv6);
+    v.insert("Network/enableIPv4Fallback", enableIPv4Fallback);
+    v.insert("Network/raceTcpRelays", raceTcpRelays);
+    v.insert("Network/ipv6FailureTime", ipv6FailureTime);
+
+    return v;
+}
+
+void Settings::scheduleSave()
+{
+    saveTimer.start();
+}
+
+void Settings::save(bool wait)
+{
+    saveTimer.stop();
+
+    Write w;
+    w.filePath = getSettingsDirPath() + '/' + FILENAME;
+    w.smileyPackPath = getSettingsDirPath() + '/' + SMILEYPACK_FILENAME;
+
+    const QVariantMap current = values();
+    for (auto it = current.constBegin(); it != current.constEnd(); ++it) {
+        auto saved = savedValues.constFind(it.key());
+        if (saved == savedValues.constEnd() || saved.value() != it.value()) {
+            w.changed.insert(it.key(), it.value());
         }
-        s.endArray();
-    s.endGroup();
+    }
+    for (auto it = savedValues.constBegin(); it != savedValues.constEnd(); ++it) {
+        if (!current.contains(it.key())) {
+            w.removed << it.key();
+        }
+    }
 
-    //NOTE: uncomment when logging will be implemented
-/*
-    s.beginGroup("Logging");
-        s.setValue("storeLogs", enableLogging);
-        s.setValue("encryptLogs", encryptLogs);
-    s.endGroup();
-*/
+    w.writeSmileyPack = smileyPack != savedSmileyPack;
+    w.smileyPack = smileyPack;
 
-    s.beginGroup("General");
-        s.setValue("username", username);
-        s.setValue("statusMessage", statusMessage);
-    s.endGroup();
+    savedValues = current;
+    savedSmileyPack = smileyPack;
 
-    s.beginGroup("Widgets");
-    const QList<QString> widgetNames = widgetSettings.keys();
-    for (const QString& name : widgetNames) {
-        s.setValue(name, widgetSettings.value(name));
+    if (wait) {
+        writerPool.waitForDone();
     }
-    s.endGroup();
 
-    s.beginGroup("GUI");
-        s.setValue("smoothAnimation", enableSmoothAnimation);
-        s.setValue("smileyPack", smileyPack);
-        s.setValue("customEmojiFont", customEmojiFont);
-        s.setValue("emojiFontFamily", emojiFontFamily);
-        s.setValue("emojiFontPointSize", emojiFontPointSize);
-        s.setValue("firstColumnHandlePos", firstColumnHandlePos);
-        s.setValue("secondColumnHandlePosFromRight", secondColumnHandlePosFromRight);
-        s.setValue("timestampFormat", timestampFormat);
-        s.setValue("minimizeOnClose", minimizeOnClose);
-    s.endGroup();
+    if (w.changed.isEmpty() && w.removed.isEmpty() && !w.writeSmileyPack) {
+        return;
+    }
 
-    s.beginGroup("Privacy");
-        s.setValue("typingNotification", typingNotification);
-    s.endGroup();
+    if (wait) {
+        write(w);
+    } else {
+        writerPool.start(new Writer<Write>(w, &Settings::write));
+    }
+}
 
-    s.beginGroup("Network");
-        s.setValue("enableIPv6", enableIPv6);
-        s.setValue("enableIPv4Fallback", enableIPv4Fallback);
-    s.endGroup();
+void Settings::write(const Write& w)
+{
+    if (!w.changed.isEmpty() || !w.removed.isEmpty()) {
+        QSettings s(w.filePath, QSettings::IniFormat);
+        for (const QString& key : w.removed) {
+            s.remove(key);
+        }
+        for (auto it = w.changed.constBegin(); it != w.changed.constEnd(); ++it) {
+            s.setValue(it.key(), it.value());
+        }
+        s.sync();
+    }
+
+    if (w.writeSmileyPack) {
+        if (w.smileyPack.isEmpty()) {
+            QFile::remove(w.smileyPackPath);
+        } else {
+            QDir().mkpath(QFileInfo(w.smileyPackPath).path());
+            QSaveFile file(w.smileyPackPath);
+            if (file.open(QIODevice::WriteOnly)) {
+                file.write(w.smileyPack);
+                file.commit();
+            }
+        }
+    }
+}
+
+void Settings::publish()
+{
+    std::shared_ptr<const Snapshot> previous = std::atomic_load(&currentSnapshot);
+
+    Snapshot* snapshot = new Snapshot;
+    snapshot->version = previous ? previous->version + 1 : 1;
+    snapshot->dhtServerList = dhtServerList;
+    snapshot->username = username;
+    snapshot->statusMessage = statusMessage;
+    snapshot->enableLogging = enableLogging;
+    snapshot->encryptLogs = encryptLogs;
+    snapshot->enableSmoothAnimation = enableSmoothAnimation;
+    snapshot->smileyPack = smileyPack;
+    snapshot->smileyPackVersion = smileyPackVersion;
+    snapshot->customEmojiFont = customEmojiFont;
+    snapshot->emojiFontFamily = emojiFontFamily;
+    snapshot->emojiFontPointSize = emojiFontPointSize;
+    snapshot->timestampFormat = timestampFormat;
+    snapshot->chatLinePixmapCache = chatLinePixmapCache;
+    snapshot->documentCacheSize = documentCacheSize;
+    snapshot->inlinePreviews = inlinePreviews;
+    snapshot->typingNotification = typingNotification;
+    snapshot->localApi = localApi;
+    snapshot->notificationSounds = notificationSounds;
+    snapshot->enableIPv6 = enableIPv6;
+    snapshot->enableIPv4Fallback = enableIPv4Fallback;
+    snapshot->raceTcpRelays = raceTcpRelays;
+    snapshot->ipv6FailureTime = ipv6FailureTime;
+
+    std::atomic_store(&currentSnapshot, std::shared_ptr<const Snapshot>(snapshot));
+    emit snapshotChanged(snapshot->version);
+}
+
+std::shared_ptr<const Settings::Snapshot> Settings::snapshot() const
+{
+    return std::atomic_load(&currentSnapshot);
 }
 
 QString Settings::getSettingsDirPath()
@@ -184,14 +363,14 @@ QString Settings::getSettingsDirPath()
 #ifdef Q_OS_WIN
     return QStandardPaths::writableLocation(QStandardPaths::ConfigLocation);
 #else
-    return QStandardPaths::writableLocation(QStandardPaths::ConfigLocation) + '/' + qApp->organizationName() + '/' + qApp->applicationName();
+    return QStandardPaths::writableLocation(QStandardPaths::ConfigLocation) + '/' + QCoreApplication::organizationName() + '/' + QCoreApplication::applicationName();
 #endif
 }
 
 void Settings::executeSettingsDialog(QWidget* parent)
 {
     if (SettingsDialog::showDialog(parent) == QDialog::Accepted) {
-        save();
+        scheduleSave();
         //emit dataChanged();
     }
 }
@@ -204,7 +383,9 @@ const QList<Settings::DhtServer>& Settings::getDhtServerList() const
 void Settings::setDhtServerList(const QList<DhtServer>& newDhtServerList)
 {
     dhtServerList = newDhtServerList;
+    publish();
     emit dhtServerListChanged();
+    scheduleSave();
 }
 
 QString Settings::getUsername() const
@@ -215,6 +396,8 @@ QString Settings::getUsername() const
 void Settings::setUsername(const QString& newUsername)
 {
     username = newUsername;
+    publish();
+    scheduleSave();
 }
 
 QString Settings::getStatusMessage() const
@@ -225,6 +408,30 @@ QString Settings::getStatusMessage() const
 void Settings::setStatusMessage(const QString& newMessage)
 {
     statusMessage = newMessage;
+    publish();
+    scheduleSave();
+}
+
+const QStringList& Settings::getProfiles() const
+{
+    return profiles;
+}
+
+void Settings::setProfiles(const QStringList& newProfiles)
+{
+    profiles = newProfiles;
+    scheduleSave();
+}
+
+QString Settings::getCurrentProfile() const
+{
+    return currentProfile;
+}
+
+void Settings::setCurrentProfile(const QString& newProfile)
+{
+    currentProfile = newProfile;
+    scheduleSave();
 }
 
 bool Settings::getEnableLogging() const
@@ -234,7 +441,13 @@ bool Settings::getEnableLogging() const
 
 void Settings::setEnableLogging(bool newValue)
 {
+    if (enableLogging == newValue)
+        return;
+
     enableLogging = newValue;
+    publish();
+    emit logStorageOptsChanged();
+    scheduleSave();
 }
 
 bool Settings::getEncryptLogs() const
@@ -244,12 +457,19 @@ bool Settings::getEncryptLogs() const
 
 void Settings::setEncryptLogs(bool newValue)
 {
+    if (encryptLogs == newValue)
+        return;
+
     encryptLogs = newValue;
+    publish();
+    emit logStorageOptsChanged();
+    scheduleSave();
 }
 
 void Settings::setWidgetData(const QString& uniqueName, const QByteArray& data)
 {
     widgetSettings[uniqueName] = data;
+    scheduleSave();
 }
 
 QByteArray Settings::getWidgetData(const QString& uniqueName) const
@@ -265,6 +485,8 @@ bool Settings::isAnimationEnabled() const
 void Settings::setAnimationEnabled(bool newValue)
 {
     enableSmoothAnimation = newValue;
+    publish();
+    scheduleSave();
 }
 
 QByteArray Settings::getSmileyPack() const
@@ -274,8 +496,28 @@ QByteArray Settings::getSmileyPack() const
 
 void Settings::setSmileyPack(const QByteArray &value)
 {
+    if (smileyPack == value)
+        return;
+
     smileyPack = value;
+    smileyPackVersion++;
+    publish();
     emit smileyPackChanged();
+    scheduleSave();
+}
+
+void Settings::updateSmileyPack(const QByteArray &value, const QStringList &changedTexts)
+{
+    smileyPack = value;
+    smileyPackVersion++;
+    publish();
+    emit smileyPackUpdated(changedTexts);
+    scheduleSave();
+}
+
+int Settings::getSmileyPackVersion() const
+{
+    return smileyPackVersion;
 }
 
 bool Settings::isCurstomEmojiFont() const
@@ -286,7 +528,9 @@ bool Settings::isCurstomEmojiFont() const
 void Settings::setCurstomEmojiFont(bool value)
 {
     customEmojiFont = value;
+    publish();
     emit emojiFontChanged();
+    scheduleSave();
 }
 
 int Settings::getEmojiFontPointSize() const
@@ -297,7 +541,9 @@ int Settings::getEmojiFontPointSize() const
 void Settings::setEmojiFontPointSize(int value)
 {
     emojiFontPointSize = value;
+    publish();
     emit emojiFontChanged();
+    scheduleSave();
 }
 
 int Settings::getFirstColumnHandlePos() const
@@ -308,6 +554,7 @@ int Settings::getFirstColumnHandlePos() const
 void Settings::setFirstColumnHandlePos(const int pos)
 {
     firstColumnHandlePos = pos;
+    scheduleSave();
 }
 
 int Settings::getSecondColumnHandlePosFromRight() const
@@ -318,6 +565,7 @@ int Settings::getSecondColumnHandlePosFromRight() const
 void Settings::setSecondColumnHandlePosFromRight(const int pos)
 {
     secondColumnHandlePosFromRight = pos;
+    scheduleSave();
 }
 
 const QString &Settings::getTimestampFormat() const
@@ -328,7 +576,116 @@ const QString &Settings::getTimestampFormat() const
 void Settings::setTimestampFormat(const QString &format)
 {
     timestampFormat = format;
+    publish();
     emit timestampFormatChanged();
+    scheduleSave();
+}
+
+int Settings::getScrollbackLimit() const
+{
+    return scrollbackLimit;
+}
+
+void Settings::setScrollbackLimit(int limit)
+{
+    if (scrollbackLimit == limit)
+        return;
+
+    scrollbackLimit = limit;
+    emit scrollbackLimitChanged();
+    scheduleSave();
+}
+
+bool Settings::isGroupMessagesEnabled() const
+{
+    return groupMessages;
+}
+
+void Settings::setGroupMessages(bool enabled)
+{
+    if (groupMessages == enabled)
+        return;
+
+    groupMessages = enabled;
+    emit groupMessagesChanged();
+    scheduleSave();
+}
+
+bool Settings::isChatLinePixmapCacheEnabled() const
+{
+    return chatLinePixmapCache;
+}
+
+void Settings::setChatLinePixmapCache(bool enabled)
+{
+    chatLinePixmapCache = enabled;
+    publish();
+    scheduleSave();
+}
+
+int Settings::getDocumentCacheSize() const
+{
+    return documentCacheSize;
+}
+
+void Settings::setDocumentCacheSize(int size)
+{
+    documentCacheSize = size;
+    publish();
+    scheduleSave();
+}
+
+int Settings::getMemoryCeiling() const
+{
+    return memoryCeiling;
+}
+
+void Settings::setMemoryCeiling(int size)
+{
+    memoryCeiling = size;
+    scheduleSave();
+}
+
+int Settings::getColdContentsDistance() const
+{
+    return coldContentsDistance;
+}
+
+void Settings::setColdContentsDistance(int rows)
+{
+    coldContentsDistance = rows;
+    scheduleSave();
+}
+
+bool Settings::isInlinePreviewsEnabled() const
+{
+    return inlinePreviews;
+}
+
+void Settings::setInlinePreviews(bool enabled)
+{
+    if (inlinePreviews == enabled)
+        return;
+
+    inlinePreviews = enabled;
+    publish();
+    emit inlinePreviewsChanged();
+    scheduleSave();
+}
+
+bool Settings::isChatViewOpenGLEnabled() const
+{
+    return chatViewOpenGL;
+}
+
+void Settings::setChatViewOpenGL(bool enabled)
+{
+    if (chatViewOpenGL == enabled)
+        return;
+
+    chatViewOpenGL = enabled;
+    emit chatViewOpenGLChanged();
+    scheduleSave();
 }
 
 QString Settings::getEmojiFontFamily() const
@@ -339,7 +696,9 @@ QString Settings::getEmojiFontFamily() const
 void Settings::setEmojiFontFamily(const QString &value)
 {
     emojiFontFamily = value;
+    publish();
     emit emojiFontChanged();
+    scheduleSave();
 }
 
 bool Settings::isMinimizeOnCloseEnabled() const
@@ -350,6 +709,34 @@ bool Settings::isMinimizeOnCloseEnabled() const
 void Settings::setMinimizeOnClose(bool newValue)
 {
     minimizeOnClose = newValue;
+    scheduleSave();
+}
+
+bool Settings::isNotificationSoundsEnabled() const
+{
+    return notificationSounds;
+}
+
+void Settings::setNotificationSounds(bool enabled)
+{
+    notificationSounds = enabled;
+    publish();
+    scheduleSave();
+}
+
+bool Settings::isSortFriendsByActivityEnabled() const
+{
+    return sortFriendsByActivity;
+}
+
+void Settings::setSortFriendsByActivity(bool enabled)
+{
+    if (sortFriendsByActivity == enabled)
+        return;
+
+    sortFriendsByActivity = enabled;
+    emit sortFriendsByActivityChanged();
+    scheduleSave();
 }
 
 bool Settings::isTypingNotificationEnabled() const
@@ -360,6 +747,25 @@ bool Settings::isTypingNotificationEnabled() const
 void Settings::setTypingNotification(bool enabled)
 {
     typingNotification = enabled;
+    publish();
+    scheduleSave();
+}
+
+bool Settings::isLocalApiEnabled() const
+{
+    return localApi;
+}
+
+void Settings::setLocalApiEnabled(bool enabled)
+{
+    if (localApi == enabled) {
+        return;
+    }
+
+    localApi = enabled;
+    publish();
+    scheduleSave();
+    emit localApiChanged();
 }
 
 bool Settings::isIPv6Enabled() const
@@ -370,6 +776,8 @@ bool Settings::isIPv6Enabled() const
 void Settings::setIPv6Enabled(bool enabled)
 {
     enableIPv6 = enabled;
+    publish();
+    scheduleSave();
 }
 
 bool Settings::isIPv4FallbackEnabled() const
@@ -380,4 +788,33 @@ bool Settings::isIPv4FallbackEnabled() const
 void Settings::setIPv4FallbackEnabled(bool enabled)
 {
     enableIPv4Fallback = enabled;
+    publish();
+    scheduleSave();
+}
+
+bool Settings::isTcpRelayRaceEnabled() const
+{
+    return raceTcpRelays;
+}
+
+void Settings::setTcpRelayRaceEnabled(bool enabled)
+{
+    raceTcpRelays = enabled;
+    publish();
+    scheduleSave();
+}
+
+qint64 Settings::getIPv6FailureTime() const
+{
+    return ipv6FailureTime;
+}
+
+void Settings::setIPv6FailureTime(qint64 time)
+{
+    if (ipv6FailureTime == time)
+        return;
+
+    ipv6FailureTime = time;
+    publish();
+    scheduleSave();
 }
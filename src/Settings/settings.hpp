@@ -20,6 +20,12 @@
 #include <QHash>
 #include <QMainWindow>
 #include <QSplitter>
+#include <QStringList>
+#include <QThreadPool>
+#include <QTimer>
+#include <QVariantMap>
+
+#include <memory>
 
 class Settings : public QObject
 {
@@ -38,8 +44,51 @@ public:
         QString userId;
         QString address;
         int port;
+        // round trip time in ms of the last probe, see DhtProber
+        int latency = NOT_PROBED;
+
+        static const int NOT_PROBED = -1;
+        static const int UNREACHABLE = -2;
     };
 
+    // Immutable copy of the settings read from hot paths and from the core thread.
+    // A new one is published after every change to them, readers never lock.
+    struct Snapshot
+    {
+        // incremented with every published snapshot, see snapshotChanged()
+        quint64 version;
+
+        QList<DhtServer> dhtServerList;
+        QString username;
+        QString statusMessage;
+        bool enableLogging;
+        bool encryptLogs;
+
+        bool enableSmoothAnimation;
+        QByteArray smileyPack;
+        int smileyPackVersion;
+        bool customEmojiFont;
+        QString emojiFontFamily;
+        int emojiFontPointSize;
+        QString timestampFormat;
+        bool chatLinePixmapCache;
+        int documentCacheSize;
+        bool inlinePreviews;
+
+        bool typingNotification;
+        bool localApi;
+        bool notificationSounds;
+
+        bool enableIPv6;
+        bool enableIPv4Fallback;
+        qint64 ipv6FailureTime;
+        bool raceTcpRelays;
+    };
+
+    // Safe to call from any thread, keep the pointer around instead of
+    // calling it again when several values must be consistent with each other
+    std::shared_ptr<const Snapshot> snapshot() const;
+
     const QList<DhtServer>& getDhtServerList() const;
     void setDhtServerList(const QList<DhtServer>& newDhtServerList);
 
@@ -49,6 +98,13 @@ public:
     QString getStatusMessage() const;
     void setStatusMessage(const QString& newMessage);
 
+    // Profiles
+    const QStringList& getProfiles() const;
+    void setProfiles(const QStringList& newProfiles);
+
+    QString getCurrentProfile() const;
+    void setCurrentProfile(const QString& newProfile);
+
     bool getEnableLogging() const;
     void setEnableLogging(bool newValue);
 
@@ -82,6 +138,10 @@ public:
 
     QByteArray getSmileyPack() const;
     void setSmileyPack(const QByteArray &value);
+    // A new version of the same pack, only messages containing changedTexts are affected
+    void updateSmileyPack(const QByteArray &value, const QStringList &changedTexts);
+    // Changes whenever another smiley pack or a new version of it is set, see Smileypack::current()
+    int getSmileyPackVersion() const;
 
     bool isCurstomEmojiFont() const;
     void setCurstomEmojiFont(bool value);
@@ -102,13 +162,56 @@ public:
     const QString &getTimestampFormat() const;
     void setTimestampFormat(const QString &format);
 
+    // Number of lines a chat keeps in memory, older ones are moved to disk. 0 means no limit.
+    int getScrollbackLimit() const;
+    void setScrollbackLimit(int limit);
+
+    // Whether consecutive messages of the same sender show the sender and time only on the first line
+    bool isGroupMessagesEnabled() const;
+    void setGroupMessages(bool enabled);
+
+    // Whether chat lines are painted once into a pixmap and then blitted from the QPixmapCache
+    bool isChatLinePixmapCacheEnabled() const;
+    void setChatLinePixmapCache(bool enabled);
+
+    // Memory budget in MB for the laid out text of chat lines, the least recently seen are dropped first
+    int getDocumentCacheSize() const;
+    void setDocumentCacheSize(int size);
+
+    // Resident set size in MB above which caches are shed, see MemoryPressure, 0 for none
+    int getMemoryCeiling() const;
+    void setMemoryCeiling(int size);
+
+    // Rows farther than this from the viewport keep their contents compressed, see MessageStore, 0 for never
+    int getColdContentsDistance() const;
+    void setColdContentsDistance(int rows);
+
+    // Whether image links and received images are shown as thumbnails in the chat, see ThumbnailCache
+    bool isInlinePreviewsEnabled() const;
+    void setInlinePreviews(bool enabled);
+
+    // Whether chats are rendered through OpenGL, where the system has it
+    bool isChatViewOpenGLEnabled() const;
+    void setChatViewOpenGL(bool enabled);
+
     bool isMinimizeOnCloseEnabled() const;
     void setMinimizeOnClose(bool newValue);
 
+    bool isNotificationSoundsEnabled() const;
+    void setNotificationSounds(bool enabled);
+
+    // Whether the friend list puts the friends with the most recent messages first, see ActivityIndex
+    bool isSortFriendsByActivityEnabled() const;
+    void setSortFriendsByActivity(bool enabled);
+
     // Privacy
     bool isTypingNotificationEnabled() const;
     void setTypingNotification(bool enabled);
 
+    // lets programs of the same user send messages through a local socket, see IpcServer
+    bool isLocalApiEnabled() const;
+    void setLocalApiEnabled(bool enabled);
+
     // Network
     bool isIPv6Enabled() const;
     void setIPv6Enabled(bool enabled);
@@ -116,20 +219,63 @@ public:
     bool isIPv4FallbackEnabled() const;
     void setIPv4FallbackEnabled(bool enabled);
 
+    // bootstraps off the TCP relays in parallel to UDP on networks where we don't know yet
+    // which one works, see BootstrapManager
+    bool isTcpRelayRaceEnabled() const;
+    void setTcpRelayRaceEnabled(bool enabled);
+
+    // When tox_new() last failed with IPv6 on this host, in seconds since the epoch, 0 if it didn't.
+    // Cores call the setter from their threads, so it's invocable through a queued connection.
+    qint64 getIPv6FailureTime() const;
+    Q_INVOKABLE void setIPv6FailureTime(qint64 time);
+
 private:
     Settings();
     Settings(Settings &settings) = delete;
     Settings& operator=(const Settings&) = delete;
 
-    void save();
+    // Writes the keys that changed since the last save in the background,
+    // or right away on the calling thread if wait is set
+    void save(bool wait = false);
     void load();
 
+    // Saves SAVE_DELAY ms after the last change, so bursts of changes are written once
+    void scheduleSave();
+    // Flattened "group/key" values as they are stored in the INI
+    QVariantMap values() const;
+
+    struct Write
+    {
+        QString filePath;
+        QVariantMap changed;
+        QStringList removed;
+        bool writeSmileyPack;
+        QString smileyPackPath;
+        QByteArray smileyPack;
+    };
+    static void write(const Write& write);
+
+    // Publishes the current values as a new snapshot
+    void publish();
 
 
     static const QString FILENAME;
+    // the smiley pack is a large blob, it lives next to the INI so that it's only rewritten when it changes
+    static const QString SMILEYPACK_FILENAME;
+    static const int SAVE_DELAY = 1000;
 
     bool loaded;
 
+    QTimer saveTimer;
+    // a single thread, so that writes happen in order
+    QThreadPool writerPool;
+    // values and smiley pack as of the last save
+    QVariantMap savedValues;
+    QByteArray savedSmileyPack;
+
+    // only accessed through std::atomic_load() and std::atomic_store()
+    std::shared_ptr<const Snapshot> currentSnapshot;
+
     QList<DhtServer> dhtServerList;
     int dhtServerId;
     bool dontShowDhtDialog;
@@ -137,6 +283,9 @@ private:
     QString username;
     QString statusMessage;
 
+    QStringList profiles;
+    QString currentProfile;
+
     bool enableLogging;
     bool encryptLogs;
 
@@ -145,30 +294,53 @@ private:
     // GUI
     bool enableSmoothAnimation;
     QByteArray smileyPack;
+    int smileyPackVersion;
     bool customEmojiFont;
     QString emojiFontFamily;
     int     emojiFontPointSize;
     bool minimizeOnClose;
+    bool notificationSounds;
+    bool sortFriendsByActivity;
 
     // ChatView
     int firstColumnHandlePos;
     int secondColumnHandlePosFromRight;
     QString timestampFormat;
+    int scrollbackLimit;
+    bool groupMessages;
+    bool chatLinePixmapCache;
+    int documentCacheSize;
+    int memoryCeiling;
+    int coldContentsDistance;
+    bool inlinePreviews;
+    bool chatViewOpenGL;
 
     // Privacy
     bool typingNotification;
+    bool localApi;
 
     // Network
     bool enableIPv6;
     bool enableIPv4Fallback;
+    qint64 ipv6FailureTime;
+    bool raceTcpRelays;
 
 signals:
     //void dataChanged();
+    // emitted after a new snapshot was published, caches tagged with an older version are stale
+    void snapshotChanged(quint64 version);
     void dhtServerListChanged();
     void logStorageOptsChanged();
     void smileyPackChanged();
+    void smileyPackUpdated(const QStringList &changedTexts);
     void emojiFontChanged();
     void timestampFormatChanged();
+    void scrollbackLimitChanged();
+    void inlinePreviewsChanged();
+    void groupMessagesChanged();
+    void chatViewOpenGLChanged();
+    void sortFriendsByActivityChanged();
+    void localApiChanged();
 };
 
 #endif // SETTINGS_HPP
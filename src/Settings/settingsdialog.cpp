@@ -27,12 +27,12 @@ SettingsDialog::SettingsDialog(QWidget* parent) :
 {
     setWindowTitle("Settings");
 
-    addPage(":/icons/server.png", "DHT Bootstrap", new DhtBootstrapSettingsPage(this));
+    addPage(":/icons/server.png", "DHT Bootstrap", [this]() { return new DhtBootstrapSettingsPage(this); });
     //NOTE: make use of when logging will be implemented
-    //addPage(":/icons/database.png", "Logging", new LoggingSettingsPage(this));
-    addPage(":/icons/application_side_list.png", tr("GUI"), new GuiSettingsPage(this));
-    addPage(":/icons/eye.png", tr("Privacy"), new PrivacySettingsPage(this));
-    addPage(":/icons/globe_network.png", tr("Network"), new NetworkSettingsPage(this));
+    //addPage(":/icons/database.png", "Logging", [this]() { return new LoggingSettingsPage(this); });
+    addPage(":/icons/application_side_list.png", tr("GUI"), [this]() { return new GuiSettingsPage(this); });
+    addPage(":/icons/eye.png", tr("Privacy"), [this]() { return new PrivacySettingsPage(this); });
+    addPage(":/icons/globe_network.png", tr("Network"), [this]() { return new NetworkSettingsPage(this); });
 
     listWidget->setCurrentRow(0);
     listWidget->setMinimumWidth(130);
@@ -0,0 +1,188 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "activityindex.hpp"
+
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+
+ActivityIndex::ActivityIndex(const QString& filePath, QObject* parent) :
+    QObject(parent),
+    filePath(filePath),
+    totalUnreadCount(0)
+{
+    saveTimer.setSingleShot(true);
+    saveTimer.setInterval(SAVE_DELAY);
+    connect(&saveTimer, &QTimer::timeout, this, &ActivityIndex::save);
+
+    load();
+}
+
+ActivityIndex::~ActivityIndex()
+{
+    if (saveTimer.isActive()) {
+        save();
+    }
+}
+
+void ActivityIndex::load()
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    QDataStream stream(&file);
+    quint32 version;
+    quint32 count;
+    stream >> version >> count;
+    if (stream.status() != QDataStream::Ok || version != FILE_VERSION) {
+        qWarning() << "Activity index" << filePath << "is unreadable, unread counts start over";
+        return;
+    }
+
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; i++) {
+        QString userId;
+        qint32 unreadCount;
+        qint64 lastActivity;
+        stream >> userId >> unreadCount >> lastActivity;
+
+        Activity& activity = activities[userId];
+        activity.unreadCount = unreadCount;
+        if (lastActivity > 0) {
+            activity.lastActivity = QDateTime::fromMSecsSinceEpoch(lastActivity);
+        }
+    }
+}
+
+void ActivityIndex::save()
+{
+    saveTimer.stop();
+
+    QDir().mkpath(QFileInfo(filePath).absolutePath());
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Activity index" << filePath << "cannot be written";
+        return;
+    }
+
+    // only friends with something to remember
+    QDataStream stream(&file);
+    quint32 count = 0;
+    for (const Activity& activity : activities) {
+        if (activity.unreadCount > 0 || activity.lastActivity.isValid()) {
+            count++;
+        }
+    }
+    stream << FILE_VERSION << count;
+    for (QHash<QString, Activity>::const_iterator it = activities.constBegin(); it != activities.constEnd(); ++it) {
+        const Activity& activity = it.value();
+        if (activity.unreadCount > 0 || activity.lastActivity.isValid()) {
+            stream << it.key() << qint32(activity.unreadCount) << qint64(activity.lastActivity.isValid() ? activity.lastActivity.toMSecsSinceEpoch() : 0);
+        }
+    }
+    file.commit();
+}
+
+ActivityIndex::Activity ActivityIndex::getActivity(int friendId) const
+{
+    return activities.value(userIds.value(friendId));
+}
+
+int ActivityIndex::getTotalUnreadCount() const
+{
+    return totalUnreadCount;
+}
+
+void ActivityIndex::addFriend(int friendId, const UserId& userId)
+{
+    // friends from the FriendListSnapshot are added again once the Core has them
+    if (userIds.value(friendId) == userId.toString()) {
+        return;
+    }
+    userIds.insert(friendId, userId.toString());
+
+    Activity activity = activities.value(userId.toString());
+    if (activity.unreadCount > 0 || activity.lastActivity.isValid()) {
+        emit activityChanged(friendId, activity.unreadCount, activity.lastActivity);
+    }
+    if (activity.unreadCount > 0) {
+        totalUnreadCount += activity.unreadCount;
+        emit totalUnreadCountChanged(totalUnreadCount);
+    }
+}
+
+void ActivityIndex::removeFriend(int friendId)
+{
+    // a removed friend added again starts with a clean slate
+    const QString userId = userIds.take(friendId);
+    const int unreadCount = activities.value(userId).unreadCount;
+    if (activities.remove(userId) > 0) {
+        saveTimer.start();
+    }
+    if (unreadCount > 0) {
+        totalUnreadCount -= unreadCount;
+        emit totalUnreadCountChanged(totalUnreadCount);
+    }
+}
+
+void ActivityIndex::recordMessage(int friendId, bool unread)
+{
+    QHash<int, QString>::const_iterator it = userIds.constFind(friendId);
+    if (it == userIds.constEnd()) {
+        return;
+    }
+
+    Activity& activity = activities[it.value()];
+    activity.lastActivity = QDateTime::currentDateTime();
+    if (unread) {
+        activity.unreadCount++;
+    }
+    change(friendId, activity, unread ? 1 : 0);
+}
+
+void ActivityIndex::markRead(int friendId)
+{
+    QHash<int, QString>::const_iterator it = userIds.constFind(friendId);
+    if (it == userIds.constEnd()) {
+        return;
+    }
+
+    Activity& activity = activities[it.value()];
+    if (activity.unreadCount == 0) {
+        return;
+    }
+    const int unreadCount = activity.unreadCount;
+    activity.unreadCount = 0;
+    change(friendId, activity, -unreadCount);
+}
+
+void ActivityIndex::change(int friendId, const Activity& activity, int unreadDelta)
+{
+    // a burst of messages is written once
+    if (!saveTimer.isActive()) {
+        saveTimer.start();
+    }
+    emit activityChanged(friendId, activity.unreadCount, activity.lastActivity);
+    if (unreadDelta != 0) {
+        totalUnreadCount += unreadDelta;
+        emit totalUnreadCountChanged(totalUnreadCount);
+    }
+}
@@ -0,0 +1,80 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef ACTIVITYINDEX_HPP
+#define ACTIVITYINDEX_HPP
+
+#include "userid.hpp"
+
+#include <QDateTime>
+#include <QHash>
+#include <QObject>
+#include <QTimer>
+
+// The number of unread messages and the time of the last message of every friend, whether or
+// not their chat has a page. The Profile updates it as messages arrive and are sent, in O(1) per
+// message, and it is kept on disk by User ID, so the friend list shows badges and sorts by
+// activity right after the start without opening any history.
+class ActivityIndex : public QObject
+{
+    Q_OBJECT
+public:
+    struct Activity
+    {
+        int unreadCount;
+        QDateTime lastActivity;
+
+        Activity() : unreadCount(0) {}
+    };
+
+    ActivityIndex(const QString& filePath, QObject* parent);
+    ~ActivityIndex();
+
+    Activity getActivity(int friendId) const;
+    // of the friends that were added
+    int getTotalUnreadCount() const;
+
+public slots:
+    void addFriend(int friendId, const UserId& userId);
+    void removeFriend(int friendId);
+    // a message was received or sent, received ones the user didn't see are unread
+    void recordMessage(int friendId, bool unread);
+    void markRead(int friendId);
+
+signals:
+    void activityChanged(int friendId, int unreadCount, const QDateTime& lastActivity);
+    void totalUnreadCountChanged(int count);
+
+private slots:
+    void save();
+
+private:
+    void load();
+    void change(int friendId, const Activity& activity, int unreadDelta);
+
+    const QString filePath;
+    // by hex User ID, so the unread counts of friends the Core hasn't reported yet are kept till it does
+    QHash<QString, Activity> activities;
+    // friendId -> hex User ID
+    QHash<int, QString> userIds;
+    int totalUnreadCount;
+    QTimer saveTimer;
+
+    static const quint32 FILE_VERSION = 1;
+    static const int SAVE_DELAY = 5000;
+};
+
+#endif // ACTIVITYINDEX_HPP
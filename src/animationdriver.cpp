@@ -0,0 +1,120 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "animationdriver.hpp"
+#include "Settings/settings.hpp"
+
+#include <QGuiApplication>
+#include <QScreen>
+#include <QWidget>
+#include <QWindow>
+
+AnimationDriver& AnimationDriver::getInstance()
+{
+    static AnimationDriver driver;
+    return driver;
+}
+
+AnimationDriver::AnimationDriver() :
+    nextGeneration(0)
+{
+    frameTimer.setTimerType(Qt::PreciseTimer);
+    connect(&frameTimer, &QTimer::timeout, this, &AnimationDriver::frame);
+}
+
+bool AnimationDriver::isEnabled()
+{
+    return Settings::getInstance().snapshot()->enableSmoothAnimation;
+}
+
+qreal AnimationDriver::easeOut(qreal progress)
+{
+    const qreal remaining = 1 - qBound<qreal>(0, progress, 1);
+    return 1 - remaining * remaining * remaining;
+}
+
+void AnimationDriver::animate(QObject* receiver, const Step& step)
+{
+    if (!animations.contains(receiver)) {
+        connect(receiver, &QObject::destroyed, this, &AnimationDriver::onReceiverDestroyed);
+    }
+    Animation animation = {step, nextGeneration++};
+    animations.insert(receiver, animation);
+
+    if (!frameTimer.isActive()) {
+        // the screen may have changed since the last animation, or its refresh rate
+        QScreen* screen = QGuiApplication::primaryScreen();
+        QWidget* widget = qobject_cast<QWidget*>(receiver);
+        if (widget != nullptr && widget->window()->windowHandle() != nullptr) {
+            screen = widget->window()->windowHandle()->screen();
+        }
+        const qreal refreshRate = screen != nullptr ? screen->refreshRate() : 60;
+        frameTimer.setInterval(qMax(1, qRound(1000 / qMax<qreal>(refreshRate, 1))));
+        frameTimer.start();
+        frameClock.start();
+    }
+}
+
+void AnimationDriver::stop(QObject* receiver)
+{
+    if (animations.remove(receiver) > 0) {
+        disconnect(receiver, &QObject::destroyed, this, &AnimationDriver::onReceiverDestroyed);
+    }
+    if (animations.isEmpty()) {
+        frameTimer.stop();
+    }
+}
+
+bool AnimationDriver::isAnimating(QObject* receiver) const
+{
+    return animations.contains(receiver);
+}
+
+void AnimationDriver::onReceiverDestroyed(QObject* receiver)
+{
+    animations.remove(receiver);
+    if (animations.isEmpty()) {
+        frameTimer.stop();
+    }
+}
+
+void AnimationDriver::frame()
+{
+    // steps follow the time that really passed, timers don't fire exactly on the frame
+    const qreal elapsed = frameClock.restart() / 1000.0;
+
+    // a step may start, replace or stop animations, those take effect on the next frame
+    const QList<QObject*> receivers = animations.keys();
+    for (QObject* receiver : receivers) {
+        QHash<QObject*, Animation>::const_iterator it = animations.constFind(receiver);
+        if (it == animations.constEnd()) {
+            continue;
+        }
+
+        // copied, the step may replace the animation it belongs to
+        const Animation animation = it.value();
+        if (!animation.step(elapsed)) {
+            it = animations.constFind(receiver);
+            if (it != animations.constEnd() && it.value().generation == animation.generation) {
+                stop(receiver);
+            }
+        }
+    }
+
+    if (animations.isEmpty()) {
+        frameTimer.stop();
+    }
+}
@@ -0,0 +1,73 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef ANIMATIONDRIVER_HPP
+#define ANIMATIONDRIVER_HPP
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QTimer>
+
+#include <functional>
+
+// Drives the animations of the GUI (fades, smooth scrolling, drag selection autoscroll) from one
+// timer paced to the refresh rate of the screen, so all of them step on the same frame and
+// the window is repainted once per frame, however many run at once.
+// An animation only changes what is painted or scrolled, never the layout, so a frame is cheap.
+class AnimationDriver : public QObject
+{
+    Q_OBJECT
+public:
+    // Steps get the seconds since the previous frame and return whether the animation goes on
+    typedef std::function<bool (qreal elapsed)> Step;
+
+    static AnimationDriver& getInstance();
+
+    // Whether the user wants animations, otherwise they should jump to their end
+    static bool isEnabled();
+
+    // Runs step on every frame until it returns false, receiver is destroyed or the animation
+    // of receiver is replaced by another one
+    void animate(QObject* receiver, const Step& step);
+    void stop(QObject* receiver);
+    bool isAnimating(QObject* receiver) const;
+
+    // Eases a linear progress from 0 to 1 out, fast at first and slowing down at the end
+    static qreal easeOut(qreal progress);
+
+private slots:
+    void frame();
+    void onReceiverDestroyed(QObject* receiver);
+
+private:
+    AnimationDriver();
+    Q_DISABLE_COPY(AnimationDriver)
+
+    struct Animation
+    {
+        Step step;
+        // tells a step that replaced its own animation from one that ended
+        quint64 generation;
+    };
+
+    QHash<QObject*, Animation> animations;
+    quint64 nextGeneration;
+    QTimer frameTimer;
+    QElapsedTimer frameClock;
+};
+
+#endif // ANIMATIONDRIVER_HPP
@@ -0,0 +1,136 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "audiojitterbuffer.hpp"
+
+#include <QtGlobal>
+
+#include <cmath>
+#include <cstring>
+
+AudioJitterBuffer::AudioJitterBuffer(int sampleRate, int channels) :
+    sampleRate(sampleRate), channels(channels)
+{
+    clear();
+}
+
+void AudioJitterBuffer::clear()
+{
+    samples.clear();
+    readPos = 0;
+    playing = false;
+    underruns = 0;
+    sinceFirstFrame.invalidate();
+    sinceLastFrame.invalidate();
+    lastFrameMs = 0;
+    jitter = 0;
+    receivedMs = 0;
+}
+
+int AudioJitterBuffer::samplesToMs(int count) const
+{
+    return static_cast<int>(static_cast<qint64>(count) * 1000 / (sampleRate * channels));
+}
+
+void AudioJitterBuffer::push(const qint16* pcm, int count)
+{
+    const int frameMs = samplesToMs(count * channels);
+
+    if (sinceLastFrame.isValid()) {
+        // a frame should arrive one frame duration after the previous one
+        const double deviation = std::fabs(static_cast<double>(sinceLastFrame.restart() - lastFrameMs));
+        jitter += (deviation - jitter) / 16;
+    } else {
+        sinceFirstFrame.start();
+        sinceLastFrame.start();
+    }
+    lastFrameMs = frameMs;
+    receivedMs += frameMs;
+
+    // drop what has already been played before growing
+    if (readPos > 0 && readPos >= samples.size() / 2) {
+        samples.remove(0, readPos);
+        readPos = 0;
+    }
+
+    const int offset = samples.size();
+    samples.resize(offset + count * channels);
+    std::memcpy(samples.data() + offset, pcm, count * channels * sizeof(qint16));
+
+    // we fell behind, skip ahead instead of letting the delay build up
+    const int maxSamples = (getTargetMs() + MAX_DELAY) * sampleRate / 1000 * channels;
+    const int buffered = samples.size() - readPos;
+    if (buffered > maxSamples) {
+        readPos += buffered - getTargetMs() * sampleRate / 1000 * channels;
+    }
+}
+
+void AudioJitterBuffer::pull(qint16* out, int count)
+{
+    const int needed = count * channels;
+    const int buffered = samples.size() - readPos;
+
+    if (!playing && samplesToMs(buffered) >= getTargetMs()) {
+        playing = true;
+    }
+
+    if (!playing || buffered < needed) {
+        if (playing) {
+            playing = false;
+            underruns++;
+        }
+        std::memset(out, 0, needed * sizeof(qint16));
+        return;
+    }
+
+    std::memcpy(out, samples.constData() + readPos, needed * sizeof(qint16));
+    readPos += needed;
+}
+
+int AudioJitterBuffer::getBufferedMs() const
+{
+    return samplesToMs(samples.size() - readPos);
+}
+
+int AudioJitterBuffer::getJitterMs() const
+{
+    return static_cast<int>(jitter + 0.5);
+}
+
+int AudioJitterBuffer::getTargetMs() const
+{
+    return qBound(MIN_DELAY, qMax(lastFrameMs * 2, static_cast<int>(jitter * 3)), MAX_DELAY);
+}
+
+int AudioJitterBuffer::getUnderrunCount() const
+{
+    return underruns;
+}
+
+double AudioJitterBuffer::getLossRate() const
+{
+    if (!sinceFirstFrame.isValid()) {
+        return 0;
+    }
+
+    // the first frame arrived right when the timer started
+    const qint64 expectedMs = sinceFirstFrame.elapsed() + lastFrameMs;
+    if (expectedMs <= 0 || receivedMs >= expectedMs) {
+        return 0;
+    }
+    return 1.0 - static_cast<double>(receivedMs) / expectedMs;
+}
@@ -0,0 +1,69 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef AUDIOJITTERBUFFER_HPP
+#define AUDIOJITTERBUFFER_HPP
+
+#include <QElapsedTimer>
+#include <QVector>
+
+// Smooths out the arrival of decoded audio frames before they are played.
+// Playback starts once the target delay is buffered, the target follows the
+// measured arrival jitter, so it stays low on a steady connection and grows
+// on a bursty one. When playback runs dry it buffers again.
+class AudioJitterBuffer
+{
+public:
+    AudioJitterBuffer(int sampleRate, int channels);
+
+    // count is in samples per channel
+    void push(const qint16* pcm, int count);
+    // fills out with count samples per channel, with silence while buffering
+    void pull(qint16* out, int count);
+    void clear();
+
+    int getBufferedMs() const;
+    int getJitterMs() const;
+    int getTargetMs() const;
+    int getUnderrunCount() const;
+    // share of the frames expected since the first one that never arrived
+    double getLossRate() const;
+
+private:
+    int samplesToMs(int samples) const;
+
+    static const int MIN_DELAY = 40; // ms
+    static const int MAX_DELAY = 300; // ms
+
+    const int sampleRate;
+    const int channels;
+
+    QVector<qint16> samples;
+    int readPos;
+    bool playing;
+    int underruns;
+
+    QElapsedTimer sinceFirstFrame;
+    QElapsedTimer sinceLastFrame;
+    int lastFrameMs;
+    // in ms, smoothed like RTP's interarrival jitter
+    double jitter;
+    qint64 receivedMs;
+
+};
+
+#endif // AUDIOJITTERBUFFER_HPP
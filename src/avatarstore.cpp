@@ -0,0 +1,257 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "avatarstore.hpp"
+#include "memorypressure.hpp"
+#include "Settings/settings.hpp"
+
+#include <QBuffer>
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QImageReader>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QThreadPool>
+
+const QString AvatarStore::INDEX_FILENAME = "index";
+
+namespace {
+
+// Decodes one avatar on QThreadPool, straight to the size it's shown at where the format allows it
+class AvatarDecoder : public QRunnable
+{
+public:
+    AvatarDecoder(AvatarStore* store, const QString& hash, const QString& key, const QString& filePath, const QSize& size) :
+        store(store),
+        hash(hash),
+        key(key),
+        filePath(filePath),
+        size(size)
+    {
+    }
+
+    void run()
+    {
+        QImage image;
+        QImageReader reader(filePath);
+        const QSize source = reader.size();
+        // the header may announce anything, an avatar is never that big
+        if (source.isValid() && qint64(source.width()) * source.height() <= MAX_PIXELS) {
+            // filled and cropped to the middle, like a square avatar of a portrait photo would be
+            const QSize scaled = source.scaled(size, Qt::KeepAspectRatioByExpanding);
+            reader.setScaledSize(scaled);
+            reader.setScaledClipRect(QRect((scaled.width() - size.width()) / 2, (scaled.height() - size.height()) / 2, size.width(), size.height()));
+            image = reader.read();
+        }
+
+        QMetaObject::invokeMethod(store, "onDecoded", Qt::QueuedConnection,
+                                  Q_ARG(QString, hash), Q_ARG(QString, key), Q_ARG(QImage, image));
+    }
+
+private:
+    AvatarStore* store;
+    const QString hash;
+    const QString key;
+    const QString filePath;
+    const QSize size;
+
+    static const qint64 MAX_PIXELS = 16 * 1024 * 1024;
+};
+
+} // namespace
+
+AvatarStore& AvatarStore::getInstance()
+{
+    // goes with the application, pixmaps can't outlive it
+    static AvatarStore* store = new AvatarStore(QCoreApplication::instance());
+    return *store;
+}
+
+AvatarStore::AvatarStore(QObject* parent) :
+    QObject(parent),
+    dirPath(Settings::getSettingsDirPath() + "/avatars")
+{
+    pixmaps.setMaxCost(MEMORY_LIMIT);
+    MemoryPressure::getInstance().registerCache(this, MemoryPressure::Avatars, [this](MemoryPressure::Level) {
+        pixmaps.clear();
+    });
+
+    saveTimer.setSingleShot(true);
+    saveTimer.setInterval(SAVE_DELAY);
+    connect(&saveTimer, &QTimer::timeout, this, &AvatarStore::saveIndex);
+
+    loadIndex();
+}
+
+AvatarStore::~AvatarStore()
+{
+    if (saveTimer.isActive()) {
+        saveIndex();
+    }
+}
+
+QString AvatarStore::filePath(const QString& hash) const
+{
+    return dirPath + '/' + hash;
+}
+
+void AvatarStore::loadIndex()
+{
+    QFile file(dirPath + '/' + INDEX_FILENAME);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    QDataStream stream(&file);
+    quint32 version;
+    QHash<QString, QString> index;
+    stream >> version >> index;
+    if (stream.status() != QDataStream::Ok || version != INDEX_VERSION) {
+        qWarning() << "Avatar index" << file.fileName() << "is unreadable, avatars are forgotten";
+        return;
+    }
+    owners = index;
+}
+
+void AvatarStore::saveIndex()
+{
+    saveTimer.stop();
+
+    QSaveFile file(dirPath + '/' + INDEX_FILENAME);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Avatar index" << file.fileName() << "cannot be written";
+        return;
+    }
+
+    QDataStream stream(&file);
+    stream << INDEX_VERSION << owners;
+    file.commit();
+}
+
+bool AvatarStore::hasAvatar(const QString& userId) const
+{
+    return owners.contains(userId);
+}
+
+QPixmap AvatarStore::getAvatar(const QString& userId, const QSize& size, int devicePixelRatio)
+{
+    QHash<QString, QString>::const_iterator it = owners.constFind(userId);
+    if (it == owners.constEnd() || size.isEmpty()) {
+        return QPixmap();
+    }
+
+    const QString& hash = it.value();
+    const QString key = QString("%1-%2x%3@%4").arg(hash).arg(size.width()).arg(size.height()).arg(devicePixelRatio);
+    if (QPixmap* pixmap = pixmaps.object(key)) {
+        return *pixmap;
+    }
+
+    if (!decoding.contains(key) && !failed.contains(key)) {
+        decoding.insert(key);
+        QThreadPool::globalInstance()->start(new AvatarDecoder(this, hash, key, filePath(hash), size * devicePixelRatio));
+    }
+    return QPixmap();
+}
+
+void AvatarStore::onDecoded(const QString& hash, const QString& key, const QImage& image)
+{
+    decoding.remove(key);
+    if (image.isNull()) {
+        failed.insert(key);
+        return;
+    }
+
+    // pixmaps may only be created on the GUI thread
+    QPixmap* pixmap = new QPixmap(QPixmap::fromImage(image));
+    const int devicePixelRatio = key.section('@', -1).toInt();
+    pixmap->setDevicePixelRatio(devicePixelRatio);
+    pixmaps.insert(key, pixmap, qMax(1, image.width() * image.height() * 4 / 1024));
+
+    for (QHash<QString, QString>::const_iterator it = owners.constBegin(); it != owners.constEnd(); ++it) {
+        if (it.value() == hash) {
+            emit avatarChanged(it.key());
+        }
+    }
+}
+
+bool AvatarStore::setAvatar(const QString& userId, const QByteArray& data)
+{
+    if (data.size() > MAX_DATA_SIZE) {
+        return false;
+    }
+
+    // only looks at the header, decoding is left to the decoder
+    QBuffer buffer;
+    buffer.setData(data);
+    if (!QImageReader(&buffer).canRead()) {
+        return false;
+    }
+
+    const QString hash = QCryptographicHash::hash(data, QCryptographicHash::Sha256).toHex();
+    const QString oldHash = owners.value(userId);
+    if (hash == oldHash) {
+        return true;
+    }
+
+    // an image that is stored already, by this content address, is the same image
+    QFile file(filePath(hash));
+    if (!file.exists()) {
+        QDir().mkpath(dirPath);
+        QSaveFile saveFile(file.fileName());
+        if (!saveFile.open(QIODevice::WriteOnly) || saveFile.write(data) != data.size() || !saveFile.commit()) {
+            qWarning() << "Avatar" << saveFile.fileName() << "cannot be written";
+            return false;
+        }
+    }
+
+    owners.insert(userId, hash);
+    if (!oldHash.isEmpty()) {
+        releaseImage(oldHash);
+    }
+    saveTimer.start();
+
+    emit avatarChanged(userId);
+    return true;
+}
+
+void AvatarStore::removeAvatar(const QString& userId)
+{
+    const QString oldHash = owners.take(userId);
+    if (oldHash.isEmpty()) {
+        return;
+    }
+
+    releaseImage(oldHash);
+    saveTimer.start();
+
+    emit avatarChanged(userId);
+}
+
+void AvatarStore::releaseImage(const QString& hash)
+{
+    for (const QString& ownerHash : owners) {
+        if (ownerHash == hash) {
+            return;
+        }
+    }
+
+    // its pixmaps are evicted from the LRU like any other that isn't shown anymore
+    QFile::remove(filePath(hash));
+}
@@ -0,0 +1,84 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef AVATARSTORE_HPP
+#define AVATARSTORE_HPP
+
+#include <QCache>
+#include <QHash>
+#include <QImage>
+#include <QObject>
+#include <QPixmap>
+#include <QSet>
+#include <QTimer>
+
+// Avatars of friends and our own, by hex User ID.
+// The images are stored content-addressed, under the SHA-256 of their data, so an avatar several
+// friends share is stored once, next to an index of whose avatar is which. They are decoded on
+// QThreadPool at the sizes they are shown at, and the pixmaps are kept in a memory LRU that the
+// friend list, the chat headers and our own user widget share, so scrolling a list of a thousand
+// avatars doesn't decode anything on the GUI thread.
+class AvatarStore : public QObject
+{
+    Q_OBJECT
+public:
+    static AvatarStore& getInstance();
+
+    bool hasAvatar(const QString& userId) const;
+
+    // The avatar of userId cropped to size, which is in device independent pixels. A null pixmap if
+    // there is none or it's being decoded, avatarChanged() is emitted once it's decoded.
+    QPixmap getAvatar(const QString& userId, const QSize& size, int devicePixelRatio);
+
+    // Returns false if data isn't an image or is larger than MAX_DATA_SIZE
+    bool setAvatar(const QString& userId, const QByteArray& data);
+    void removeAvatar(const QString& userId);
+
+    static const int MAX_DATA_SIZE = 1024 * 1024;
+
+signals:
+    void avatarChanged(const QString& userId);
+
+private slots:
+    void onDecoded(const QString& hash, const QString& key, const QImage& image);
+    void saveIndex();
+
+private:
+    explicit AvatarStore(QObject* parent);
+    ~AvatarStore();
+    Q_DISABLE_COPY(AvatarStore)
+
+    void loadIndex();
+    QString filePath(const QString& hash) const;
+    // deletes the image of hash unless somebody still has it as their avatar
+    void releaseImage(const QString& hash);
+
+    const QString dirPath;
+    // User ID -> hash of their image
+    QHash<QString, QString> owners;
+    // decoded avatars, keyed by hash, size and device pixel ratio, the cost is in KB
+    QCache<QString, QPixmap> pixmaps;
+    QSet<QString> decoding;
+    QSet<QString> failed;
+    QTimer saveTimer;
+
+    static const QString INDEX_FILENAME;
+    static const quint32 INDEX_VERSION = 1;
+    static const int MEMORY_LIMIT = 16 * 1024;
+    static const int SAVE_DELAY = 1000;
+};
+
+#endif // AVATARSTORE_HPP
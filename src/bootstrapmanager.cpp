@@ -0,0 +1,311 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "bootstrapmanager.hpp"
+#include "udpprober.hpp"
+#include "userid.hpp"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QNetworkInterface>
+#include <QSettings>
+
+#include <algorithm>
+#include <limits>
+#include <tuple>
+
+const QString BootstrapManager::FILENAME = "bootstrap.ini";
+
+BootstrapManager::BootstrapManager(QObject* parent) :
+    QObject(parent), tox(nullptr), udp(true), tcpRelays(false), udpProber(nullptr),
+    probeResult(UnknownTransport), raceConnected(false)
+{
+    roundTimer.setSingleShot(true);
+    roundTimer.setInterval(ROUND_TIMEOUT);
+    connect(&roundTimer, &QTimer::timeout, this, &BootstrapManager::abort);
+
+    loadStats();
+}
+
+BootstrapManager::~BootstrapManager()
+{
+    // quitting before we got connected says nothing about the servers
+    abortLookups();
+}
+
+BootstrapManager::Transport BootstrapManager::rememberedTransport() const
+{
+    const NetworkTransport none = {UnknownTransport, 0};
+    const NetworkTransport remembered = transports.value(currentNetworkId(), none);
+    if (QDateTime::currentDateTime().toTime_t() - remembered.time >= TRANSPORT_RETRY_INTERVAL) {
+        return UnknownTransport;
+    }
+    return remembered.transport;
+}
+
+void BootstrapManager::setTransports(bool newUdp, bool newTcpRelays)
+{
+    udp = newUdp;
+    tcpRelays = newTcpRelays;
+}
+
+void BootstrapManager::bootstrap(Tox* newTox, const QList<Settings::DhtServer>& servers)
+{
+    abort();
+    tox = newTox;
+
+    delete udpProber;
+    udpProber = nullptr;
+    if (udp && tcpRelays) {
+        udpProber = new UdpProber(this);
+        connect(udpProber, &UdpProber::finished, this, &BootstrapManager::onProbeFinished);
+        probeResult = UnknownTransport;
+        raceConnected = false;
+    }
+
+    QList<Settings::DhtServer> sorted = servers;
+    std::stable_sort(sorted.begin(), sorted.end(), [this](const Settings::DhtServer& a, const Settings::DhtServer& b) {
+        return isBetter(a, b);
+    });
+
+    // lookups are started in order of preference, so that the best servers get bootstrapped first
+    // unless their DNS is slow
+    for (const Settings::DhtServer& server : sorted) {
+        PendingServer pendingServer;
+        pendingServer.server = server;
+        pendingServer.bootstrapped = false;
+        int lookupId = QHostInfo::lookupHost(server.address, this, SLOT(onHostLookedUp(QHostInfo)));
+        pending.insert(lookupId, pendingServer);
+    }
+    roundTimer.start();
+}
+
+void BootstrapManager::abort()
+{
+    if (pending.isEmpty()) {
+        return;
+    }
+
+    // the servers whose DNS didn't even answer in time were counted by onHostLookedUp() or never tried
+    for (const PendingServer& pendingServer : pending) {
+        if (pendingServer.bootstrapped) {
+            stats[pendingServer.server.userId].attempts++;
+        }
+    }
+
+    abortLookups();
+    saveStats();
+}
+
+void BootstrapManager::abortLookups()
+{
+    roundTimer.stop();
+    for (QHash<int, PendingServer>::const_iterator it = pending.constBegin(); it != pending.constEnd(); ++it) {
+        if (!it.value().bootstrapped) {
+            QHostInfo::abortHostLookup(it.key());
+        }
+    }
+    pending.clear();
+}
+
+void BootstrapManager::onHostLookedUp(const QHostInfo& hostInfo)
+{
+    QHash<int, PendingServer>::iterator it = pending.find(hostInfo.lookupId());
+    if (it == pending.end()) {
+        return;
+    }
+
+    PendingServer& pendingServer = it.value();
+    if (hostInfo.error() != QHostInfo::NoError || hostInfo.addresses().isEmpty()) {
+        qWarning() << "Couldn't resolve DHT server" << pendingServer.server.address << ":" << hostInfo.errorString();
+        stats[pendingServer.server.userId].attempts++;
+        pending.erase(it);
+        return;
+    }
+
+    // toxcore resolves the address again, passing it a numeric one makes that instant
+    QByteArray address = hostInfo.addresses().first().toString().toLatin1();
+    const UserId userId = UserId::fromString(pendingServer.server.userId);
+    if (!userId.isValid()) {
+        qWarning() << "DHT server" << pendingServer.server.name << "has an invalid User ID";
+        pending.erase(it);
+        return;
+    }
+
+    if (udp) {
+        tox_bootstrap_from_address(tox, address.data(), pendingServer.server.port, userId.data());
+    }
+    // bootstrap nodes run a TCP relay on the same port
+    if (tcpRelays) {
+        tox_add_tcp_relay(tox, address.data(), pendingServer.server.port, userId.data());
+    }
+    if (udpProber) {
+        udpProber->ping(hostInfo.addresses().first(), pendingServer.server.port, userId.data());
+    }
+    pendingServer.bootstrapped = true;
+    pendingServer.bootstrapTime.start();
+}
+
+void BootstrapManager::connected()
+{
+    if (udpProber) {
+        raceConnected = true;
+        recordTransport();
+    }
+
+    if (pending.isEmpty()) {
+        return;
+    }
+
+    // we can't tell which server exactly got us connected, crediting all of them would make
+    // every server of a round look equally good, so it goes to the one we bootstrapped from first.
+    // The others are neither credited nor blamed for this round
+    const PendingServer* first = nullptr;
+    for (const PendingServer& pendingServer : pending) {
+        if (pendingServer.bootstrapped && (!first || pendingServer.bootstrapTime.elapsed() > first->bootstrapTime.elapsed())) {
+            first = &pendingServer;
+        }
+    }
+    if (first) {
+        ServerStats& serverStats = stats[first->server.userId];
+        const qint64 elapsed = first->bootstrapTime.elapsed();
+        serverStats.attempts++;
+        serverStats.averageConnectTime = (serverStats.averageConnectTime * serverStats.successes + elapsed) / (serverStats.successes + 1);
+        serverStats.successes++;
+    }
+
+    abortLookups();
+    saveStats();
+}
+
+void BootstrapManager::onProbeFinished(bool udpWorks)
+{
+    probeResult = udpWorks ? Udp : TcpRelay;
+    recordTransport();
+}
+
+void BootstrapManager::recordTransport()
+{
+    // UDP being blocked doesn't tell that the relays work, only getting connected does
+    if (!raceConnected || probeResult == UnknownTransport) {
+        return;
+    }
+
+    const NetworkTransport networkTransport = {static_cast<Transport>(probeResult), QDateTime::currentDateTime().toTime_t()};
+    transports.insert(currentNetworkId(), networkTransport);
+
+    udpProber->deleteLater();
+    udpProber = nullptr;
+    saveStats();
+}
+
+QString BootstrapManager::currentNetworkId()
+{
+    QStringList subnets;
+    for (const QNetworkInterface& networkInterface : QNetworkInterface::allInterfaces()) {
+        const QNetworkInterface::InterfaceFlags flags = networkInterface.flags();
+        if (!(flags & QNetworkInterface::IsUp) || !(flags & QNetworkInterface::IsRunning) || (flags & QNetworkInterface::IsLoopBack)) {
+            continue;
+        }
+        // IPv6 addresses come and go with privacy extensions, the IPv4 subnet stays the same
+        for (const QNetworkAddressEntry& entry : networkInterface.addressEntries()) {
+            if (entry.ip().protocol() != QAbstractSocket::IPv4Protocol) {
+                continue;
+            }
+            const quint32 subnet = entry.ip().toIPv4Address() & entry.netmask().toIPv4Address();
+            subnets << QHostAddress(subnet).toString() + '/' + QString::number(entry.prefixLength());
+        }
+    }
+    subnets.sort();
+
+    return QCryptographicHash::hash(subnets.join(',').toUtf8(), QCryptographicHash::Sha1).toHex().left(16);
+}
+
+bool BootstrapManager::isBetter(const Settings::DhtServer& a, const Settings::DhtServer& b) const
+{
+    // compared as a single lexicographic key, skipping criteria that only one of the two has
+    // wouldn't be a strict weak ordering, which std::stable_sort() needs
+    const auto key = [this](const Settings::DhtServer& server) {
+        const ServerStats none = {0, 0, 0};
+        const ServerStats serverStats = stats.value(server.userId, none);
+
+        // a server the last probe couldn't reach goes last, whatever it did in the past
+        const bool unreachable = server.latency == Settings::DhtServer::UNREACHABLE;
+        // servers we know nothing about are assumed to be average
+        const double rate = serverStats.attempts > 0 ? static_cast<double>(serverStats.successes) / serverStats.attempts : 0.5;
+        // the probed round trip time is a fresher measure than the connect times of past rounds,
+        // probed servers go before the ones that weren't
+        const bool unprobed = server.latency < 0;
+        const int latency = unprobed ? 0 : server.latency;
+        const qint64 connectTime = serverStats.successes > 0 ? serverStats.averageConnectTime : std::numeric_limits<qint64>::max();
+
+        return std::make_tuple(unreachable, -rate, unprobed, latency, connectTime, -serverStats.successes);
+    };
+
+    return key(a) < key(b);
+}
+
+void BootstrapManager::loadStats()
+{
+    QSettings s(Settings::getSettingsDirPath() + '/' + FILENAME, QSettings::IniFormat);
+    int size = s.beginReadArray("serverStats");
+    for (int i = 0; i < size; i ++) {
+        s.setArrayIndex(i);
+        ServerStats serverStats;
+        serverStats.attempts = s.value("attempts").toInt();
+        serverStats.successes = s.value("successes").toInt();
+        serverStats.averageConnectTime = s.value("averageConnectTime").toLongLong();
+        stats.insert(s.value("userId").toString(), serverStats);
+    }
+    s.endArray();
+
+    size = s.beginReadArray("networkTransports");
+    for (int i = 0; i < size; i ++) {
+        s.setArrayIndex(i);
+        NetworkTransport networkTransport;
+        networkTransport.transport = static_cast<Transport>(s.value("transport").toInt());
+        networkTransport.time = s.value("time").toLongLong();
+        transports.insert(s.value("network").toString(), networkTransport);
+    }
+    s.endArray();
+}
+
+void BootstrapManager::saveStats() const
+{
+    QSettings s(Settings::getSettingsDirPath() + '/' + FILENAME, QSettings::IniFormat);
+    s.clear();
+    s.beginWriteArray("serverStats", stats.size());
+    int i = 0;
+    for (QHash<QString, ServerStats>::const_iterator it = stats.constBegin(); it != stats.constEnd(); ++it) {
+        s.setArrayIndex(i++);
+        s.setValue("userId", it.key());
+        s.setValue("attempts", it.value().attempts);
+        s.setValue("successes", it.value().successes);
+        s.setValue("averageConnectTime", it.value().averageConnectTime);
+    }
+    s.endArray();
+
+    s.beginWriteArray("networkTransports", transports.size());
+    i = 0;
+    for (QHash<QString, NetworkTransport>::const_iterator it = transports.constBegin(); it != transports.constEnd(); ++it) {
+        s.setArrayIndex(i++);
+        s.setValue("network", it.key());
+        s.setValue("transport", static_cast<int>(it.value().transport));
+        s.setValue("time", it.value().time);
+    }
+    s.endArray();
+}
@@ -0,0 +1,124 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef BOOTSTRAPMANAGER_HPP
+#define BOOTSTRAPMANAGER_HPP
+
+#include "Settings/settings.hpp"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QHostInfo>
+#include <QObject>
+#include <QTimer>
+
+#include <tox/tox.h>
+
+class UdpProber;
+
+// Bootstraps Tox off the DHT server list. Host names are resolved concurrently
+// by QHostInfo instead of one by one inside toxcore, and servers that got us
+// connected quickly in the past are bootstrapped from first, helped by the latencies
+// DhtProber measured.
+// The servers can be added as TCP relays as well, for networks that block UDP. Which
+// of the two a network lets through is remembered, so that the next start doesn't
+// have to wait for the one that doesn't work.
+class BootstrapManager : public QObject
+{
+    Q_OBJECT
+public:
+    enum Transport {
+        UnknownTransport,
+        Udp,
+        TcpRelay
+    };
+
+    explicit BootstrapManager(QObject* parent = 0);
+    ~BootstrapManager();
+
+    // What got us connected on the current network, UnknownTransport if we haven't been
+    // here yet or not for TRANSPORT_RETRY_INTERVAL, so that UDP gets another chance
+    Transport rememberedTransport() const;
+    // Whether Tox has UDP enabled and whether the servers are added as TCP relays too.
+    // With both toxcore races them, keeps whichever connects and UdpProber finds out
+    // which one it was.
+    void setTransports(bool udp, bool tcpRelays);
+
+    void bootstrap(Tox* tox, const QList<Settings::DhtServer>& servers);
+    // ends the current round, counting a failed attempt for every server bootstrapped from in it
+    void abort();
+
+    // has to be called once Tox gets connected, credits the first server bootstrapped from in the current round
+    void connected();
+
+    static const qint64 TRANSPORT_RETRY_INTERVAL = 24 * 60 * 60; // s
+    // a round that didn't get us connected by then counts as failed
+    static const int ROUND_TIMEOUT = 30000; // ms
+
+private:
+    struct ServerStats {
+        int attempts;
+        int successes;
+        qint64 averageConnectTime; // ms
+    };
+
+    struct PendingServer {
+        Settings::DhtServer server;
+        QElapsedTimer bootstrapTime;
+        bool bootstrapped;
+    };
+
+    struct NetworkTransport {
+        Transport transport;
+        qint64 time; // s since the epoch
+    };
+
+    bool isBetter(const Settings::DhtServer& a, const Settings::DhtServer& b) const;
+    // drops the current round without touching the stats
+    void abortLookups();
+    // remembers the outcome of a race once we're connected and the probe is done
+    void recordTransport();
+    // networks are told apart by the IPv4 subnets we're in
+    static QString currentNetworkId();
+
+    void loadStats();
+    void saveStats() const;
+
+    Tox* tox;
+    // lookup id -> server
+    QHash<int, PendingServer> pending;
+    QTimer roundTimer;
+    // userId -> stats
+    QHash<QString, ServerStats> stats;
+    // network id -> what worked there
+    QHash<QString, NetworkTransport> transports;
+
+    bool udp;
+    bool tcpRelays;
+    // only while racing
+    UdpProber* udpProber;
+    int probeResult; // Transport, UnknownTransport while probing
+    bool raceConnected;
+
+    static const QString FILENAME;
+
+private slots:
+    void onHostLookedUp(const QHostInfo& hostInfo);
+    void onProbeFinished(bool udpWorks);
+
+};
+
+#endif // BOOTSTRAPMANAGER_HPP
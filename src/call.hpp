@@ -0,0 +1,46 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef CALL_HPP
+#define CALL_HPP
+
+#include <QMetaType>
+
+// A call as the GUI sees it
+enum class CallState : int {
+    None,       // there is no call, or it has just ended
+    Incoming,   // the friend is calling us
+    Outgoing,   // we are calling the friend
+    Active
+};
+
+// Reported by CallManager about once a second for every active call
+struct CallStats
+{
+    int latency;        // incoming audio buffered on our side, including the output's buffer, in ms
+    int jitter;         // in the arrival of incoming audio frames, in ms
+    double packetLoss;  // share of the incoming audio frames that never arrived, from 0 to 1
+    int underruns;      // how often playback ran dry and had to buffer again
+
+    CallStats() :
+        latency(0), jitter(0), packetLoss(0), underruns(0) {}
+};
+
+Q_DECLARE_METATYPE(CallState)
+Q_DECLARE_METATYPE(CallStats)
+
+#endif // CALL_HPP
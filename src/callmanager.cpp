@@ -0,0 +1,415 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "callmanager.hpp"
+
+#include <QAudioInput>
+#include <QAudioOutput>
+#include <QDebug>
+#include <QMutexLocker>
+#include <QTimer>
+
+namespace {
+QAudioFormat audioFormat(int sampleRate, int channels)
+{
+    QAudioFormat format;
+    format.setCodec("audio/pcm");
+    format.setSampleRate(sampleRate);
+    format.setChannelCount(channels);
+    format.setSampleSize(16);
+    format.setSampleType(QAudioFormat::SignedInt);
+    format.setByteOrder(QAudioFormat::LittleEndian);
+    return format;
+}
+
+inline int clampByte(int value)
+{
+    return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+}
+
+CallManager::Call::Call(int friendId, bool video, CallState state) :
+    friendId(friendId), video(video), state(state), jitterBuffer(SAMPLE_RATE, CHANNELS),
+    input(nullptr), inputDevice(nullptr), output(nullptr), outputDevice(nullptr)
+{
+}
+
+CallManager::CallManager(ToxAv* av) :
+    QObject(nullptr), av(av)
+{
+    toxav_register_callstate_callback(av, onCallState<av_OnInvite>, av_OnInvite, this);
+    toxav_register_callstate_callback(av, onCallState<av_OnStart>, av_OnStart, this);
+    toxav_register_callstate_callback(av, onCallState<av_OnCancel>, av_OnCancel, this);
+    toxav_register_callstate_callback(av, onCallState<av_OnReject>, av_OnReject, this);
+    toxav_register_callstate_callback(av, onCallState<av_OnEnd>, av_OnEnd, this);
+    toxav_register_callstate_callback(av, onCallState<av_OnRequestTimeout>, av_OnRequestTimeout, this);
+    toxav_register_callstate_callback(av, onCallState<av_OnPeerTimeout>, av_OnPeerTimeout, this);
+    toxav_register_audio_callback(av, onAudio, this);
+    toxav_register_video_callback(av, onVideo, this);
+
+    avTimer = new QTimer(this);
+    avTimer->setSingleShot(true);
+    avTimer->setTimerType(Qt::PreciseTimer);
+    connect(avTimer, &QTimer::timeout, this, &CallManager::process);
+
+    playbackTimer = new QTimer(this);
+    playbackTimer->setInterval(PLAYBACK_INTERVAL);
+    playbackTimer->setTimerType(Qt::PreciseTimer);
+    connect(playbackTimer, &QTimer::timeout, this, &CallManager::playBack);
+
+    statsTimer = new QTimer(this);
+    statsTimer->setInterval(STATS_INTERVAL);
+    connect(statsTimer, &QTimer::timeout, this, &CallManager::reportStats);
+}
+
+CallManager::~CallManager()
+{
+    for (auto it = calls.begin(); it != calls.end(); ++it) {
+        if (it.value()->state == CallState::Active) {
+            toxav_kill_transmission(av, it.key());
+        }
+        delete it.value();
+    }
+}
+
+template <int event>
+void CallManager::onCallState(void* /*agent*/, int32_t callIndex, void* manager)
+{
+    // MSI calls us from within tox_do(), on Core's thread
+    QMetaObject::invokeMethod(static_cast<CallManager*>(manager), "onCallStateEvent", Qt::QueuedConnection,
+                              Q_ARG(int, callIndex), Q_ARG(int, event));
+}
+
+void CallManager::onAudio(void* /*agent*/, int32_t callIndex, const int16_t* pcm, uint16_t size, void* manager)
+{
+    CallManager* self = static_cast<CallManager*>(manager);
+    QMutexLocker locker(&self->mutex);
+
+    Call* call = self->calls.value(callIndex);
+    if (call != nullptr && call->state == CallState::Active) {
+        call->jitterBuffer.push(pcm, size);
+    }
+}
+
+void CallManager::onVideo(void* /*agent*/, int32_t callIndex, const vpx_image_t* image, void* manager)
+{
+    CallManager* self = static_cast<CallManager*>(manager);
+
+    int friendId;
+    {
+        QMutexLocker locker(&self->mutex);
+        Call* call = self->calls.value(callIndex);
+        if (call == nullptr || call->state != CallState::Active) {
+            return;
+        }
+        friendId = call->friendId;
+    }
+
+    emit self->videoFrameReceived(friendId, toImage(image));
+}
+
+QImage CallManager::toImage(const vpx_image_t* image)
+{
+    const int width = image->d_w;
+    const int height = image->d_h;
+    QImage frame(width, height, QImage::Format_RGB32);
+
+    // I420, chroma is subsampled by 2 in both directions
+    for (int y = 0; y < height; y ++) {
+        const uint8_t* yRow = image->planes[0] + y * image->stride[0];
+        const uint8_t* uRow = image->planes[1] + (y / 2) * image->stride[1];
+        const uint8_t* vRow = image->planes[2] + (y / 2) * image->stride[2];
+        QRgb* out = reinterpret_cast<QRgb*>(frame.scanLine(y));
+
+        for (int x = 0; x < width; x ++) {
+            const int c = yRow[x] - 16;
+            const int d = uRow[x / 2] - 128;
+            const int e = vRow[x / 2] - 128;
+            out[x] = qRgb(clampByte((298 * c + 409 * e + 128) >> 8),
+                          clampByte((298 * c - 100 * d - 208 * e + 128) >> 8),
+                          clampByte((298 * c + 516 * d + 128) >> 8));
+        }
+    }
+
+    return frame;
+}
+
+void CallManager::start()
+{
+    process();
+    statsTimer->start();
+}
+
+void CallManager::process()
+{
+    toxav_do(av);
+    avTimer->start(toxav_do_interval(av));
+}
+
+CallManager::Call* CallManager::findCall(int friendId, int* callIndex) const
+{
+    for (auto it = calls.constBegin(); it != calls.constEnd(); ++it) {
+        if (it.value()->friendId == friendId) {
+            if (callIndex != nullptr) {
+                *callIndex = it.key();
+            }
+            return it.value();
+        }
+    }
+    return nullptr;
+}
+
+void CallManager::setState(int callIndex, CallState state)
+{
+    Call* call = calls.value(callIndex);
+    {
+        QMutexLocker locker(&mutex);
+        call->state = state;
+    }
+    emit callStateChanged(call->friendId, state, call->video);
+}
+
+void CallManager::startCall(int friendId, bool video)
+{
+    if (findCall(friendId) != nullptr) {
+        return;
+    }
+
+    ToxAvCSettings settings = av_DefaultSettings;
+    settings.call_type = video ? av_TypeVideo : av_TypeAudio;
+
+    int32_t callIndex;
+    if (toxav_call(av, &callIndex, friendId, &settings, RINGING_TIME) != 0) {
+        emit callStateChanged(friendId, CallState::None, video);
+        return;
+    }
+
+    {
+        QMutexLocker locker(&mutex);
+        calls.insert(callIndex, new Call(friendId, video, CallState::Outgoing));
+    }
+    emit callStateChanged(friendId, CallState::Outgoing, video);
+}
+
+void CallManager::answerCall(int friendId)
+{
+    int callIndex;
+    Call* call = findCall(friendId, &callIndex);
+    if (call == nullptr || call->state != CallState::Incoming) {
+        return;
+    }
+
+    ToxAvCSettings settings = av_DefaultSettings;
+    settings.call_type = call->video ? av_TypeVideo : av_TypeAudio;
+    if (toxav_answer(av, callIndex, &settings) != 0) {
+        endCall(callIndex);
+        return;
+    }
+
+    startTransmission(callIndex);
+}
+
+void CallManager::hangUp(int friendId)
+{
+    int callIndex;
+    Call* call = findCall(friendId, &callIndex);
+    if (call == nullptr) {
+        return;
+    }
+
+    switch (call->state) {
+        case CallState::Incoming:
+            toxav_reject(av, callIndex, "Rejected");
+            break;
+        case CallState::Outgoing:
+            toxav_cancel(av, callIndex, 0, "Cancelled");
+            break;
+        case CallState::Active:
+            toxav_hangup(av, callIndex);
+            break;
+        case CallState::None:
+            break;
+    }
+
+    endCall(callIndex);
+}
+
+void CallManager::onCallStateEvent(int callIndex, int event)
+{
+    switch (event) {
+        case av_OnInvite: {
+            ToxAvCSettings peerSettings;
+            const int friendId = toxav_get_peer_id(av, callIndex, 0);
+            const bool video = toxav_get_peer_csettings(av, callIndex, 0, &peerSettings) == 0 && peerSettings.call_type == av_TypeVideo;
+            if (friendId < 0 || calls.contains(callIndex) || findCall(friendId) != nullptr) {
+                toxav_reject(av, callIndex, "Busy");
+                return;
+            }
+
+            {
+                QMutexLocker locker(&mutex);
+                calls.insert(callIndex, new Call(friendId, video, CallState::Incoming));
+            }
+            emit callStateChanged(friendId, CallState::Incoming, video);
+            break;
+        }
+        case av_OnStart:
+            if (calls.contains(callIndex)) {
+                startTransmission(callIndex);
+            }
+            break;
+        default:
+            // every other event we listen to ends the call
+            if (calls.contains(callIndex)) {
+                endCall(callIndex);
+            }
+            break;
+    }
+}
+
+void CallManager::startTransmission(int callIndex)
+{
+    Call* call = calls.value(callIndex);
+    if (call->state == CallState::Active) {
+        return;
+    }
+
+    if (toxav_prepare_transmission(av, callIndex, call->video) != 0) {
+        qWarning() << "Couldn't prepare the transmission of call" << callIndex;
+        hangUp(call->friendId);
+        return;
+    }
+
+    const QAudioFormat format = audioFormat(SAMPLE_RATE, CHANNELS);
+
+    call->output = new QAudioOutput(format, this);
+    call->output->setBufferSize(SAMPLE_RATE * CHANNELS * 2 * OUTPUT_LATENCY / 1000);
+    // push mode, we decide what's played and when
+    call->outputDevice = call->output->start();
+
+    call->input = new QAudioInput(format, this);
+    call->input->setBufferSize(FRAME_SAMPLES * 2 * 2);
+    call->inputDevice = call->input->start();
+    if (call->inputDevice != nullptr) {
+        connect(call->inputDevice, &QIODevice::readyRead, this, &CallManager::onAudioCaptured);
+    }
+
+    {
+        QMutexLocker locker(&mutex);
+        call->jitterBuffer.clear();
+    }
+    setState(callIndex, CallState::Active);
+
+    if (!playbackTimer->isActive()) {
+        playbackTimer->start();
+    }
+}
+
+void CallManager::endCall(int callIndex)
+{
+    Call* call = calls.value(callIndex);
+    if (call == nullptr) {
+        return;
+    }
+
+    if (call->state == CallState::Active) {
+        toxav_kill_transmission(av, callIndex);
+    }
+
+    const int friendId = call->friendId;
+    const bool video = call->video;
+    {
+        QMutexLocker locker(&mutex);
+        calls.remove(callIndex);
+    }
+
+    delete call->input;
+    delete call->output;
+    delete call;
+
+    emit callStateChanged(friendId, CallState::None, video);
+
+    if (calls.isEmpty()) {
+        playbackTimer->stop();
+    }
+}
+
+void CallManager::onAudioCaptured()
+{
+    uint8_t encoded[MAX_ENCODED_FRAME];
+
+    for (auto it = calls.begin(); it != calls.end(); ++it) {
+        Call* call = it.value();
+        if (call->inputDevice == nullptr || call->state != CallState::Active) {
+            continue;
+        }
+
+        call->captured += call->inputDevice->readAll();
+
+        const int frameBytes = FRAME_SAMPLES * 2;
+        int offset = 0;
+        while (call->captured.size() - offset >= frameBytes) {
+            const int16_t* frame = reinterpret_cast<const int16_t*>(call->captured.constData() + offset);
+            const int size = toxav_prepare_audio_frame(av, it.key(), encoded, MAX_ENCODED_FRAME, frame, FRAME_SAMPLES / CHANNELS);
+            if (size > 0) {
+                toxav_send_audio(av, it.key(), encoded, size);
+            }
+            offset += frameBytes;
+        }
+        call->captured.remove(0, offset);
+    }
+}
+
+void CallManager::playBack()
+{
+    const int frameBytes = FRAME_SAMPLES * 2;
+    QByteArray frame(frameBytes, 0);
+
+    for (Call* call : calls) {
+        if (call->outputDevice == nullptr || call->state != CallState::Active) {
+            continue;
+        }
+
+        // keep the output's small buffer full, silence included, so its delay stays constant
+        while (call->output->bytesFree() >= frameBytes) {
+            {
+                QMutexLocker locker(&mutex);
+                call->jitterBuffer.pull(reinterpret_cast<qint16*>(frame.data()), FRAME_SAMPLES / CHANNELS);
+            }
+            call->outputDevice->write(frame);
+        }
+    }
+}
+
+void CallManager::reportStats()
+{
+    for (Call* call : calls) {
+        if (call->state != CallState::Active) {
+            continue;
+        }
+
+        CallStats stats;
+        {
+            QMutexLocker locker(&mutex);
+            stats.latency = call->jitterBuffer.getBufferedMs() + OUTPUT_LATENCY;
+            stats.jitter = call->jitterBuffer.getJitterMs();
+            stats.packetLoss = call->jitterBuffer.getLossRate();
+            stats.underruns = call->jitterBuffer.getUnderrunCount();
+        }
+        emit statsReported(call->friendId, stats);
+    }
+}
@@ -0,0 +1,125 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef CALLMANAGER_HPP
+#define CALLMANAGER_HPP
+
+#include "audiojitterbuffer.hpp"
+#include "call.hpp"
+
+#include <tox/toxav.h>
+
+#include <QByteArray>
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QObject>
+
+class QAudioInput;
+class QAudioOutput;
+class QIODevice;
+class QTimer;
+
+// Audio and video calls of a single Core. It runs on its own thread, apart from
+// Core's tox_do() loop, so that a busy Core never delays audio. There it drives
+// toxav_do(), sends the captured audio and plays the received audio through a
+// jitter buffer. Received video frames are converted once and handed to the GUI
+// as implicitly shared QImages, so they aren't copied on their way to the screen.
+class CallManager : public QObject
+{
+    Q_OBJECT
+public:
+    // registers the callbacks with av, so it must be created before tox_do() runs
+    explicit CallManager(ToxAv* av);
+    ~CallManager();
+
+    static const int MAX_CALLS = 4;
+
+public slots:
+    // starts driving toxav, to be called once the manager is on its thread
+    void start();
+    // video asks the friend to send video too, we only send audio
+    void startCall(int friendId, bool video);
+    void answerCall(int friendId);
+    // rejects, cancels or ends the friend's call, whatever state it's in
+    void hangUp(int friendId);
+
+signals:
+    void callStateChanged(int friendId, CallState state, bool video);
+    void statsReported(int friendId, const CallStats& stats);
+    void videoFrameReceived(int friendId, const QImage& frame);
+
+private:
+    template <int event>
+    static void onCallState(void* agent, int32_t callIndex, void* manager);
+    static void onAudio(void* agent, int32_t callIndex, const int16_t* pcm, uint16_t size, void* manager);
+    static void onVideo(void* agent, int32_t callIndex, const vpx_image_t* image, void* manager);
+
+    static QImage toImage(const vpx_image_t* image);
+
+    struct Call
+    {
+        int friendId;
+        bool video;
+        CallState state;
+        AudioJitterBuffer jitterBuffer;
+
+        QAudioInput* input;
+        QIODevice* inputDevice;
+        QByteArray captured;
+
+        QAudioOutput* output;
+        QIODevice* outputDevice;
+
+        Call(int friendId, bool video, CallState state);
+    };
+
+    Call* findCall(int friendId, int* callIndex = nullptr) const;
+    void setState(int callIndex, CallState state);
+    void startTransmission(int callIndex);
+    void endCall(int callIndex);
+
+    static const int RINGING_TIME = 30; // s
+    static const int SAMPLE_RATE = 48000;
+    static const int CHANNELS = 1;
+    static const int FRAME_DURATION = 20; // ms
+    static const int FRAME_SAMPLES = SAMPLE_RATE * FRAME_DURATION / 1000 * CHANNELS;
+    static const int MAX_ENCODED_FRAME = 4000; // bytes
+    static const int PLAYBACK_INTERVAL = 5; // ms
+    static const int OUTPUT_LATENCY = 40; // ms
+    static const int STATS_INTERVAL = 1000; // ms
+
+    ToxAv* av;
+    QTimer* avTimer;
+    QTimer* playbackTimer;
+    QTimer* statsTimer;
+
+    // call index -> call. Audio and video callbacks may come from toxav's own threads,
+    // so the jitter buffers and the friend ids are guarded by mutex
+    QHash<int, Call*> calls;
+    mutable QMutex mutex;
+
+private slots:
+    void onCallStateEvent(int callIndex, int event);
+    void process();
+    void onAudioCaptured();
+    void playBack();
+    void reportStats();
+
+};
+
+#endif // CALLMANAGER_HPP
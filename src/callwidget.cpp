@@ -0,0 +1,98 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "callwidget.hpp"
+#include "videowidget.hpp"
+
+#include <QHBoxLayout>
+#include <QLabel>
+#include <QPushButton>
+#include <QVBoxLayout>
+
+CallWidget::CallWidget(QWidget* parent) :
+    QWidget(parent), state(CallState::None)
+{
+    stateLabel = new QLabel(this);
+    statsLabel = new QLabel(this);
+
+    answerButton = new QPushButton(tr("Answer"), this);
+    connect(answerButton, &QPushButton::clicked, this, &CallWidget::answerRequested);
+
+    hangUpButton = new QPushButton(QIcon(":/icons/cross.png"), tr("Hang up"), this);
+    connect(hangUpButton, &QPushButton::clicked, this, &CallWidget::hangUpRequested);
+
+    videoWidget = new VideoWidget(this);
+    videoWidget->hide();
+
+    QHBoxLayout* barLayout = new QHBoxLayout;
+    barLayout->setContentsMargins(0, 0, 0, 0);
+    barLayout->addWidget(stateLabel);
+    barLayout->addWidget(statsLabel, 1);
+    barLayout->addWidget(answerButton);
+    barLayout->addWidget(hangUpButton);
+
+    QVBoxLayout* layout = new QVBoxLayout(this);
+    layout->setContentsMargins(0, 0, 0, 0);
+    layout->addLayout(barLayout);
+    layout->addWidget(videoWidget);
+
+    hide();
+}
+
+CallState CallWidget::getState() const
+{
+    return state;
+}
+
+void CallWidget::setState(CallState newState, bool video)
+{
+    state = newState;
+
+    switch (state) {
+        case CallState::None:
+            videoWidget->clear();
+            hide();
+            return;
+        case CallState::Incoming:
+            stateLabel->setText(video ? tr("Incoming video call") : tr("Incoming call"));
+            break;
+        case CallState::Outgoing:
+            stateLabel->setText(tr("Calling..."));
+            break;
+        case CallState::Active:
+            stateLabel->setText(tr("In call"));
+            break;
+    }
+
+    statsLabel->clear();
+    answerButton->setVisible(state == CallState::Incoming);
+    hangUpButton->setText(state == CallState::Incoming ? tr("Reject") : tr("Hang up"));
+    videoWidget->setVisible(state == CallState::Active && video);
+    show();
+}
+
+void CallWidget::setStats(const CallStats& stats)
+{
+    statsLabel->setText(tr("latency %1 ms, jitter %2 ms, loss %3%")
+                        .arg(stats.latency).arg(stats.jitter).arg(stats.packetLoss * 100, 0, 'f', 1));
+    statsLabel->setToolTip(tr("Playback ran dry %1 times").arg(stats.underruns));
+}
+
+void CallWidget::setVideoFrame(const QImage& frame)
+{
+    videoWidget->setFrame(frame);
+}
@@ -0,0 +1,57 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef CALLWIDGET_HPP
+#define CALLWIDGET_HPP
+
+#include "call.hpp"
+
+#include <QWidget>
+
+class QLabel;
+class QPushButton;
+class VideoWidget;
+
+// The bar shown in a chat page while there is a call with the friend
+class CallWidget : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit CallWidget(QWidget* parent = 0);
+
+    CallState getState() const;
+
+public slots:
+    void setState(CallState state, bool video);
+    void setStats(const CallStats& stats);
+    void setVideoFrame(const QImage& frame);
+
+signals:
+    void answerRequested();
+    void hangUpRequested();
+
+private:
+    CallState state;
+    QLabel* stateLabel;
+    QLabel* statsLabel;
+    QPushButton* answerButton;
+    QPushButton* hangUpButton;
+    VideoWidget* videoWidget;
+
+};
+
+#endif // CALLWIDGET_HPP
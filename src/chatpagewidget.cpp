@@ -15,23 +15,35 @@
 */
 
 #include "chatpagewidget.hpp"
+#include "callwidget.hpp"
 #include "ouruseritemwidget.hpp"
 #include "status.hpp"
 #include "Settings/settings.hpp"
 #include "customhintwidget.hpp"
+#include "filetransferswidget.hpp"
 #include "emoticonmenu.hpp"
+#include "historystore.hpp"
+#include "historyindex.hpp"
 
 #include "messages/messagemodel.hpp"
 #include "messages/chatview.hpp"
 #include "messages/messagefilter.hpp"
 #include "messages/chatviewsearchwidget.hpp"
+#include "messages/chatscene.hpp"
+#include "messages/lineheightcache.hpp"
 
+#include <QFileDialog>
+#include <QMenu>
 #include <QSplitter>
+#include <QStandardPaths>
+#include <QUrl>
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 
-ChatPageWidget::ChatPageWidget(int friendId, QWidget* parent) :
-    QWidget(parent), friendId(friendId)
+#include <limits>
+
+ChatPageWidget::ChatPageWidget(int friendId, const QString& historyPath, const QByteArray& historyKey, HistoryIndex* historyIndex, QWidget* parent) :
+    QWidget(parent), friendId(friendId), historyPath(historyPath), historyKey(historyKey), history(nullptr), historyIndex(historyIndex), heightCache(nullptr)
 {
     friendItem = new FriendItemWidget(this);
 
@@ -39,6 +51,12 @@ ChatPageWidget::ChatPageWidget(int friendId, QWidget* parent) :
     filterModel = new MessageFilter(this);
     filterModel->setSourceModel(model);
     chatview = new ChatView(filterModel, this);
+    connect(chatview, &ChatView::atBottomChanged, model, &MessageModel::setScrollbackTrimmingEnabled);
+    connect(chatview, &ChatView::visibleRowsChanged, model, [this](int first, int last) {
+        model->setViewportRows(filterModel->mapToSource(filterModel->index(first, 0)).row(),
+                               filterModel->mapToSource(filterModel->index(last, 0)).row());
+    });
+    connect(model, &MessageModel::rowsInserted, this, &ChatPageWidget::onMessagesInserted);
 
     searchWidget = new ChatViewSearchWidget(this);
     searchWidget->setScene(chatview->scene());
@@ -59,11 +77,35 @@ ChatPageWidget::ChatPageWidget(int friendId, QWidget* parent) :
     emoticonButton->setMenu(menu);
     connect(menu, &EmoticonMenu::insertEmoticon, input, &InputTextWidget::insertHtml);
 
+    QMenu *callMenu = new QMenu(this);
+    callMenu->addAction(tr("Call"), this, SLOT(onCallActionTriggered()))->setData(false);
+    callMenu->addAction(tr("Video call"), this, SLOT(onCallActionTriggered()))->setData(true);
+    callButton = new QToolButton(inputPanel);
+    callButton->setPopupMode(QToolButton::InstantPopup);
+    callButton->setText(tr("Call"));
+    callButton->setSizePolicy(QSizePolicy::Fixed, QSizePolicy::Preferred);
+    callButton->setMenu(callMenu);
+
+    sendFileButton = new QToolButton(inputPanel);
+    sendFileButton->setText(tr("Send file"));
+    sendFileButton->setSizePolicy(QSizePolicy::Fixed, QSizePolicy::Preferred);
+    connect(sendFileButton, &QToolButton::clicked, this, &ChatPageWidget::onSendFileClicked);
+
+    callWidget = new CallWidget(this);
+    connect(callWidget, &CallWidget::answerRequested, this, &ChatPageWidget::answerCall);
+    connect(callWidget, &CallWidget::hangUpRequested, this, &ChatPageWidget::hangUpCall);
+
+    fileTransfersWidget = new FileTransfersWidget(this);
+    connect(fileTransfersWidget, &FileTransfersWidget::acceptRequested, this, &ChatPageWidget::onFileAcceptRequested);
+    connect(fileTransfersWidget, &FileTransfersWidget::cancelRequested, this, &ChatPageWidget::cancelFile);
+
     QHBoxLayout *inputLayout = new QHBoxLayout(inputPanel);
     inputLayout->setContentsMargins(0,0,0,0);
     inputLayout->setSpacing(2);
     inputLayout->addWidget(input);
     inputLayout->addWidget(emoticonButton);
+    inputLayout->addWidget(callButton);
+    inputLayout->addWidget(sendFileButton);
 
     QSplitter* splitter = new QSplitter(this);
     splitter->setOrientation(Qt::Vertical);
@@ -75,9 +117,163 @@ ChatPageWidget::ChatPageWidget(int friendId, QWidget* parent) :
     QVBoxLayout* layout = new QVBoxLayout(this);
     layout->addWidget(friendItem);
     layout->addWidget(searchWidget);
+    layout->addWidget(callWidget);
+    layout->addWidget(fileTransfersWidget);
     layout->addWidget(splitter);
     layout->setSpacing(2);
     layout->setContentsMargins(0, 0, 2, 3);
+
+    if (Settings::getInstance().getEnableLogging()) {
+        openHistory();
+        model->insertMessages(history->loadLast(HISTORY_LOAD_COUNT));
+    }
+    connect(&Settings::getInstance(), &Settings::logStorageOptsChanged, this, &ChatPageWidget::onLogStorageOptsChanged);
+}
+
+MsgId ChatPageWidget::insertNewMessage(const QString& content, const QString& sender, Message::Type type, Message::Flags flags)
+{
+    MsgId id = model->insertNewMessage(content, sender, type, flags);
+
+    if (history) {
+        // whether a message got delivered is only interesting for the current session
+        Message message(type, content, sender, flags & ~(Message::Pending | Message::Unconfirmed));
+        message.setMsgId(id);
+        history->append(message);
+        historyIndex->addMessage(friendId, message);
+    }
+
+    return id;
+}
+
+void ChatPageWidget::openHistory()
+{
+    history = new HistoryStore(historyPath, historyKey, this);
+    connect(history, &HistoryStore::imported, this, &ChatPageWidget::onHistoryImported);
+
+    heightCache = new LineHeightCache(LineHeightCache::filePath(historyPath), historyKey, this);
+    chatview->scene()->setHeightCache(heightCache);
+}
+
+void ChatPageWidget::closeHistory()
+{
+    chatview->scene()->setHeightCache(nullptr);
+    delete heightCache;
+    heightCache = nullptr;
+
+    delete history;
+    history = nullptr;
+}
+
+void ChatPageWidget::onLogStorageOptsChanged()
+{
+    bool enabled = Settings::getInstance().getEnableLogging();
+    if (enabled && !history) {
+        openHistory();
+    } else if (!enabled && history) {
+        closeHistory();
+    }
+}
+
+bool ChatPageWidget::isIdle() const
+{
+    return history && !history->isImporting() && pendingMessages.isEmpty() && unconfirmedMessages.isEmpty() && input->isEmpty() && callWidget->getState() == CallState::None
+           && !fileTransfersWidget->hasActiveTransfers();
+}
+
+ChatMemoryUsage ChatPageWidget::getMemoryUsage() const
+{
+    ChatMemoryUsage usage;
+    model->addMemoryUsage(usage);
+    chatview->scene()->addMemoryUsage(usage);
+    return usage;
+}
+
+bool ChatPageWidget::importHistory(HistoryImporter* importer)
+{
+    if (!history) {
+        return false;
+    }
+    history->import(importer);
+    return true;
+}
+
+bool ChatPageWidget::flushHistory(const std::function<void()>& written)
+{
+    if (!history) {
+        return false;
+    }
+    history->flushNow(written);
+    return true;
+}
+
+void ChatPageWidget::onHistoryImported(bool success)
+{
+    if (!success) {
+        return;
+    }
+
+    // imported messages may fall between the shown ones, those already in the model are dropped
+    if (model->rowCount() > 0) {
+        model->insertMessages(history->loadBetween(model->messageItemAt(0).msgId(), MsgId(std::numeric_limits<qint64>::max())));
+    } else {
+        model->insertMessages(history->loadLast(HISTORY_LOAD_COUNT));
+    }
+}
+
+void ChatPageWidget::setCallState(CallState state, bool video)
+{
+    callWidget->setState(state, video);
+    callButton->setEnabled(state == CallState::None);
+}
+
+void ChatPageWidget::setCallStats(const CallStats& stats)
+{
+    callWidget->setStats(stats);
+}
+
+void ChatPageWidget::setVideoFrame(const QImage& frame)
+{
+    callWidget->setVideoFrame(frame);
+}
+
+void ChatPageWidget::onCallActionTriggered()
+{
+    QAction* action = static_cast<QAction*>(sender());
+    emit startCall(action->data().toBool());
+}
+
+void ChatPageWidget::updateFileTransfer(const FileTransferInfo& info)
+{
+    fileTransfersWidget->updateTransfer(info);
+
+    // a received file is linked in the chat, which previews it if it's an image
+    if (info.direction == FileTransferInfo::Direction::Receiving && info.isOver()) {
+        const QString savePath = acceptedFiles.take(info.fileNumber);
+        if (info.state == FileTransferInfo::State::Finished && !savePath.isEmpty()) {
+            // the link detection needs an authority, file:/// isn't linked
+            QUrl url = QUrl::fromLocalFile(savePath);
+            url.setHost("localhost");
+            insertNewMessage(tr("Received %1").arg(url.toString(QUrl::FullyEncoded)), QString(), Message::Info);
+        }
+    }
+}
+
+void ChatPageWidget::onSendFileClicked()
+{
+    const QString filePath = QFileDialog::getOpenFileName(this, tr("Send file"));
+    if (!filePath.isEmpty()) {
+        emit sendFile(filePath);
+    }
+}
+
+void ChatPageWidget::onFileAcceptRequested(int fileNumber, const QString& fileName)
+{
+    const QString downloads = QStandardPaths::writableLocation(QStandardPaths::DownloadLocation);
+    const QString savePath = QFileDialog::getSaveFileName(this, tr("Save file"), downloads + "/" + fileName);
+    if (!savePath.isEmpty()) {
+        acceptedFiles.insert(fileNumber, savePath);
+        emit acceptFile(fileNumber, savePath);
+    }
 }
 
 int ChatPageWidget::getFriendId() const
@@ -85,9 +281,70 @@ int ChatPageWidget::getFriendId() const
     return friendId;
 }
 
+QString ChatPageWidget::getUsername() const
+{
+    return username;
+}
+
+Message ChatPageWidget::historyMessage(MsgId msgId) const
+{
+    return history ? history->loadMessage(msgId) : Message();
+}
+
+void ChatPageWidget::showMessage(MsgId msgId)
+{
+    // older messages are either in the scrollback or only in the log
+    while (model->rowCount() == 0 || model->messageItemAt(0).msgId() > msgId) {
+        if (!model->canFetchMore(QModelIndex())) {
+            break;
+        }
+        model->fetchMore(QModelIndex());
+    }
+
+    if (history && model->rowCount() > 0 && model->messageItemAt(0).msgId() > msgId) {
+        QList<Message> messages = history->loadBetween(msgId, model->messageItemAt(0).msgId());
+        if (!messages.isEmpty()) {
+            // big ranges are inserted over several event loop iterations, the oldest messages last
+            pendingShowMsgId = msgId;
+            pendingShowOldestMsgId = messages.first().msgId();
+            model->insertMessages(messages);
+            return;
+        }
+    }
+
+    chatview->scrollToMsgId(msgId);
+}
+
+MsgId ChatPageWidget::getAnchor() const
+{
+    // until its messages are inserted the view is still somewhere else
+    return pendingShowMsgId.isValid() ? pendingShowMsgId : chatview->anchorMsgId();
+}
+
+QString ChatPageWidget::getSearchString() const
+{
+    return searchWidget->searchString();
+}
+
+void ChatPageWidget::onMessagesInserted()
+{
+    for (QHash<MsgId, Message::Flags>::iterator it = restoredFlags.begin(); it != restoredFlags.end();) {
+        if (model->setMessageFlags(it.key(), it.value())) {
+            it = restoredFlags.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    if (pendingShowMsgId.isValid() && model->messageItemAt(0).msgId() <= pendingShowOldestMsgId) {
+        chatview->scrollToMsgId(pendingShowMsgId);
+        pendingShowMsgId = MsgId();
+    }
+}
+
 void ChatPageWidget::messageReceived(const QString& message)
 {
-    model->insertNewMessage(message, username, Message::Plain);
+    insertNewMessage(message, username, Message::Plain);
 }
 
 void ChatPageWidget::setUsername(const QString& newUsername)
@@ -100,8 +357,11 @@ void ChatPageWidget::setStatus(Status newStatus)
 {
     status = newStatus;
     friendItem->setStatus(status);
-    input->setDisabled(newStatus == Status::Offline);
-    emoticonButton->setDisabled(newStatus == Status::Offline);
+
+    // toxcore drops the receipts of a friend that went offline, the messages just stay marked as unconfirmed
+    if (status == Status::Offline) {
+        unconfirmedMessages.clear();
+    }
 }
 
 void ChatPageWidget::setStatusMessage(const QString& statusMessage)
@@ -109,22 +369,72 @@ void ChatPageWidget::setStatusMessage(const QString& statusMessage)
     friendItem->setStatusMessage(statusMessage);
 }
 
-void ChatPageWidget::messageSentResult(const QString& message, int messageId)
+void ChatPageWidget::setUserId(const QString& userId)
+{
+    friendItem->setUserId(userId);
+}
+
+MsgId ChatPageWidget::messageQueued(const QString& message, int queueId)
 {
-    if(messageId == 0)
-        model->insertNewMessage(message, Settings::getInstance().getUsername(), Message::Error, Message::Self);
-    else
-        model->insertNewMessage(message, Settings::getInstance().getUsername(), Message::Plain, Message::Self);
+    MsgId id = insertNewMessage(message, Settings::getInstance().getUsername(), Message::Plain, Message::Self | Message::Pending);
+    pendingMessages.insert(queueId, id);
+    return id;
 }
 
 void ChatPageWidget::actionReceived(const QString &message)
 {
-    model->insertNewMessage(message, username, Message::Action);
+    insertNewMessage(message, username, Message::Action);
 }
 
-void ChatPageWidget::actionSentResult(const QString &message)
+MsgId ChatPageWidget::actionQueued(const QString &message, int queueId)
 {
-    model->insertNewMessage(message, Settings::getInstance().getUsername(), Message::Action, Message::Self);
+    MsgId id = insertNewMessage(message, Settings::getInstance().getUsername(), Message::Action, Message::Self | Message::Pending);
+    pendingMessages.insert(queueId, id);
+    return id;
+}
+
+MsgId ChatPageWidget::messageRestored(const QString& message, bool isAction, MsgId id, int queueId)
+{
+    if (!history || !history->loadMessage(id).isValid()) {
+        return isAction ? actionQueued(message, queueId) : messageQueued(message, queueId);
+    }
+
+    pendingMessages.insert(queueId, id);
+    // the history is still being inserted into the model, or the message is older than what was loaded
+    if (!model->setMessageFlags(id, Message::Self | Message::Pending)) {
+        restoredFlags.insert(id, Message::Self | Message::Pending);
+    }
+    return id;
+}
+
+void ChatPageWidget::setMessageFlags(MsgId id, Message::Flags flags)
+{
+    if (!model->setMessageFlags(id, flags) && restoredFlags.contains(id)) {
+        restoredFlags.insert(id, flags);
+    }
+    // the history has the message without the delivery flags
+    if (flags == Message::Self) {
+        restoredFlags.remove(id);
+    }
+}
+
+MsgId ChatPageWidget::messageSent(int queueId, int messageId)
+{
+    if (!pendingMessages.contains(queueId)) {
+        return MsgId();
+    }
+
+    MsgId id = pendingMessages.take(queueId);
+    setMessageFlags(id, Message::Self | Message::Unconfirmed);
+    unconfirmedMessages.insert(messageId, id);
+    return id;
+}
+
+void ChatPageWidget::messageDelivered(int messageId)
+{
+    if (unconfirmedMessages.contains(messageId)) {
+        setMessageFlags(unconfirmedMessages.take(messageId), Message::Self);
+    }
 }
 
 void ChatPageWidget::onFriendUsernameChanged(const QString &newUsername)
@@ -133,13 +443,13 @@ void ChatPageWidget::onFriendUsernameChanged(const QString &newUsername)
         return;
     }
 
-    model->insertNewMessage(newUsername, username, Message::Nick);
+    insertNewMessage(newUsername, username, Message::Nick);
     setUsername(newUsername);
 }
 
 void ChatPageWidget::onOurUsernameChanged(const QString &newUsername)
 {
-    model->insertNewMessage(newUsername, Settings::getInstance().getUsername(), Message::Nick, Message::Self);
+    insertNewMessage(newUsername, Settings::getInstance().getUsername(), Message::Nick, Message::Self);
 }
 
 void ChatPageWidget::onFriendTypingChanged(bool isTyping)
@@ -152,3 +462,8 @@ void ChatPageWidget::showSearchBar()
     searchWidget->show();
     searchWidget->enableSearch();
 }
+
+void ChatPageWidget::openSearchBar(const QString& searchString)
+{
+    searchWidget->openSearch(searchString);
+}
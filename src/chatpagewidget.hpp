@@ -17,28 +17,65 @@
 #ifndef CHATPAGEWIDGET_HPP
 #define CHATPAGEWIDGET_HPP
 
+#include "call.hpp"
+#include "filetransfer.hpp"
 #include "frienditemwidget.hpp"
 #include "inputtextwidget.hpp"
+#include "messages/chatmemoryusage.hpp"
+#include "messages/id.hpp"
+#include "messages/message.hpp"
 
+#include <QHash>
+#include <QImage>
 #include <QTextBrowser>
 #include <QTextEdit>
 #include <QWidget>
 
+#include <functional>
+
 class MessageModel;
 class MessageFilter;
 class ChatView;
 class QToolButton;
 class ChatViewSearchWidget;
+class CallWidget;
+class FileTransfersWidget;
+class HistoryStore;
+class HistoryImporter;
+class HistoryIndex;
+class LineHeightCache;
 
 class ChatPageWidget : public QWidget
 {
     Q_OBJECT
 public:
-    ChatPageWidget(int friendId, QWidget* parent = 0);
+    // historyPath is where the chat history is logged to when logging is enabled, historyKey encrypts it,
+    // logged messages are added to historyIndex, which the owner of the page keeps the chat registered with
+    ChatPageWidget(int friendId, const QString& historyPath, const QByteArray& historyKey, HistoryIndex* historyIndex, QWidget* parent = 0);
     int getFriendId() const;
+    QString getUsername() const;
+    // a logged message, or an invalid one if logging is disabled
+    Message historyMessage(MsgId msgId) const;
+    // loads everything from msgId on into the view and scrolls to it
+    void showMessage(MsgId msgId);
+    // the message showMessage() brings back to where the chat is scrolled, invalid while it follows the newest one
+    MsgId getAnchor() const;
+    // of the open search bar, empty if it's closed
+    QString getSearchString() const;
+    void openSearchBar(const QString& searchString);
     void setUsername(const QString& username);
     void setStatus(Status status);
     void setStatusMessage(const QString& statusMessage);
+    void setUserId(const QString& userId);
+    // nothing would be lost by destroying the page: everything is logged, nothing is being typed or sent
+    // and there is no call or file transfer
+    bool isIdle() const;
+    // estimated memory held by the messages, lines, documents and highlights of the chat
+    ChatMemoryUsage getMemoryUsage() const;
+    // importer is run by the HistoryStore, returns false if logging is disabled
+    bool importHistory(HistoryImporter* importer);
+    // see HistoryStore::flushNow(), returns false if logging is disabled
+    bool flushHistory(const std::function<void()>& written);
 
 private:
     FriendItemWidget* friendItem;
@@ -50,16 +87,63 @@ private:
 
     InputTextWidget* input;
     QToolButton *emoticonButton;
+    QToolButton *callButton;
+    QToolButton *sendFileButton;
+    CallWidget *callWidget;
+    FileTransfersWidget *fileTransfersWidget;
 
     int friendId;
     QString username;
     Status status;
 
+    // Core's queueId -> our message of messages that are not sent yet
+    QHash<int, MsgId> pendingMessages;
+    // toxcore's message id -> our message of messages the friend didn't confirm yet
+    QHash<int, MsgId> unconfirmedMessages;
+    // flags of restored messages whose rows weren't loaded from the history yet
+    QHash<MsgId, Message::Flags> restoredFlags;
+    // file number -> where the user saves the file, of received files that are not done yet
+    QHash<int, QString> acceptedFiles;
+
+    const QString historyPath;
+    const QByteArray historyKey;
+    HistoryStore* history;
+    HistoryIndex* historyIndex;
+    // kept with the history, so a long chat opens with its line heights known
+    LineHeightCache* heightCache;
+
+    // message showMessage() waits for, until the oldest message it loaded is inserted
+    MsgId pendingShowMsgId;
+    MsgId pendingShowOldestMsgId;
+
+    // how many of the newest logged messages are shown when the page is created
+    static const int HISTORY_LOAD_COUNT = 500;
+
+    MsgId insertNewMessage(const QString& content, const QString& sender, Message::Type type, Message::Flags flags = Message::None);
+    void setMessageFlags(MsgId id, Message::Flags flags);
+    void openHistory();
+    void closeHistory();
+
+private slots:
+    void onLogStorageOptsChanged();
+    void onMessagesInserted();
+    void onHistoryImported(bool success);
+    void onCallActionTriggered();
+    void onSendFileClicked();
+    void onFileAcceptRequested(int fileNumber, const QString& fileName);
+
 public slots:
     void messageReceived(const QString& message);
-    void messageSentResult(const QString& message, int messageId);
+    // return the message shown for queueId
+    MsgId messageQueued(const QString& message, int queueId);
     void actionReceived(const QString& message);
-    void actionSentResult(const QString& message);
+    MsgId actionQueued(const QString& message, int queueId);
+    // of a message queued in the last session, which is pending again. Shown as a new message
+    // if it isn't logged, the message shown is returned
+    MsgId messageRestored(const QString& message, bool isAction, MsgId id, int queueId);
+    // returns the message that was sent, invalid if it's not ours
+    MsgId messageSent(int queueId, int messageId);
+    void messageDelivered(int messageId);
 
     void onFriendUsernameChanged(const QString &newUsername);
     void onOurUsernameChanged(const QString &newUsername);
@@ -67,10 +151,22 @@ public slots:
 
     void showSearchBar();
 
+    void setCallState(CallState state, bool video);
+    void setCallStats(const CallStats& stats);
+    void setVideoFrame(const QImage& frame);
+
+    void updateFileTransfer(const FileTransferInfo& info);
+
 signals:
     void sendMessage(const QString& message);
     void sendAction(const QString& action);
     void sendTyping(bool typing);
+    void startCall(bool video);
+    void answerCall();
+    void hangUpCall();
+    void sendFile(const QString& filePath);
+    void acceptFile(int fileNumber, const QString& savePath);
+    void cancelFile(int fileNumber, FileTransferInfo::Direction direction);
 };
 
 #endif // CHATPAGEWIDGET_HPP
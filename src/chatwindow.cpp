@@ -0,0 +1,74 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "chatwindow.hpp"
+
+#include "appinfo.hpp"
+#include "chatpagewidget.hpp"
+#include "Settings/settings.hpp"
+
+#include <QCloseEvent>
+#include <QVBoxLayout>
+
+ChatWindow::ChatWindow(ChatPageWidget* page, QWidget* parent) :
+    QWidget(parent, Qt::Window), page(page)
+{
+    // all chat windows share their last geometry
+    setObjectName("ChatWindow");
+    setAttribute(Qt::WA_DeleteOnClose);
+
+    QVBoxLayout* layout = new QVBoxLayout(this);
+    layout->setMargin(0);
+    layout->addWidget(page);
+    page->show();
+
+    updateTitle();
+    resize(600, 500);
+    restoreGeometry(Settings::getInstance().getWidgetData(objectName() + "Geometry"));
+}
+
+ChatPageWidget* ChatWindow::getPage() const
+{
+    return page;
+}
+
+ChatPageWidget* ChatWindow::takePage()
+{
+    ChatPageWidget* taken = page;
+    if (taken != nullptr) {
+        layout()->removeWidget(taken);
+        taken->setParent(nullptr);
+        page = nullptr;
+    }
+    return taken;
+}
+
+void ChatWindow::updateTitle()
+{
+    if (page != nullptr) {
+        setWindowTitle(page->getUsername() + " - " + AppInfo::name);
+    }
+}
+
+void ChatWindow::closeEvent(QCloseEvent* event)
+{
+    Settings::getInstance().setWidgetData(objectName() + "Geometry", saveGeometry());
+    if (page != nullptr) {
+        emit closed(page->getFriendId());
+    }
+    QWidget::closeEvent(event);
+}
@@ -0,0 +1,51 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef CHATWINDOW_HPP
+#define CHATWINDOW_HPP
+
+#include <QWidget>
+
+class ChatPageWidget;
+
+// A chat detached from the main window. It holds the very ChatPageWidget that was docked,
+// so the model, its parsed messages and the scene's caches move along instead of being
+// built a second time, and closing the window docks the page again.
+class ChatWindow : public QWidget
+{
+    Q_OBJECT
+public:
+    // takes the page out of its current parent
+    ChatWindow(ChatPageWidget* page, QWidget* parent);
+
+    ChatPageWidget* getPage() const;
+    // gives the page up, the window can be deleted afterwards
+    ChatPageWidget* takePage();
+    void updateTitle();
+
+protected:
+    void closeEvent(QCloseEvent* event);
+
+signals:
+    void closed(int friendId);
+
+private:
+    ChatPageWidget* page;
+
+};
+
+#endif // CHATWINDOW_HPP
@@ -0,0 +1,60 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "configurationwriter.hpp"
+
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QSaveFile>
+
+ConfigurationWriter::ConfigurationWriter(const QString& path, const QByteArray& data) :
+    path(path), data(data)
+{
+}
+
+bool ConfigurationWriter::writeFile(const QString& path, const QByteArray& data)
+{
+    QDir directory = QFileInfo(path).absoluteDir();
+
+    if (!directory.exists() && !directory.mkpath(directory.absolutePath())) {
+        qCritical() << "Error while creating directory " << directory.absolutePath();
+        return false;
+    }
+
+    QSaveFile configurationFile(path);
+    if (!configurationFile.open(QIODevice::WriteOnly)) {
+        qCritical() << "File " << path << " cannot be opened";
+        return false;
+    }
+
+    configurationFile.write(data);
+    if (!configurationFile.commit()) {
+        qCritical() << "File " << path << " cannot be written";
+        return false;
+    }
+
+    return true;
+}
+
+void ConfigurationWriter::run()
+{
+    QElapsedTimer timer;
+    timer.start();
+    bool success = writeFile(path, data);
+    emit written(success, timer.elapsed());
+}
@@ -0,0 +1,46 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef CONFIGURATIONWRITER_HPP
+#define CONFIGURATIONWRITER_HPP
+
+#include <QByteArray>
+#include <QObject>
+#include <QRunnable>
+
+// Writes serialized Tox state to disk. Meant to be run on QThreadPool, so that
+// core threads never wait for the disk and don't need a writer thread each.
+class ConfigurationWriter : public QObject, public QRunnable
+{
+    Q_OBJECT
+public:
+    ConfigurationWriter(const QString& path, const QByteArray& data);
+
+    void run();
+
+    static bool writeFile(const QString& path, const QByteArray& data);
+
+private:
+    QString path;
+    QByteArray data;
+
+signals:
+    // elapsed is the time it took to write and commit the file, in ms
+    void written(bool success, qint64 elapsed);
+
+};
+
+#endif // CONFIGURATIONWRITER_HPP
@@ -15,31 +15,151 @@
 */
 
 #include "core.hpp"
+#include "bootstrapmanager.hpp"
+#include "callmanager.hpp"
+#include "configurationwriter.hpp"
+#include "filetransfermanager.hpp"
+#include "ipcserver.hpp"
+#include "profilecipher.hpp"
 #include "Settings/settings.hpp"
+#include "startuptrace.hpp"
+#include "trace.hpp"
+#ifdef EVENT_DRIVEN_CORE
+#include "toxwaiter.hpp"
+#endif
 
 #include <cstdint>
+#include <sodium.h>
 
 #include <QDebug>
 #include <QDir>
+#include <QElapsedTimer>
 #include <QFile>
-#include <QSaveFile>
 #include <QStandardPaths>
 #include <QtEndian>
 #include <QThread>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
 
 const QString Core::CONFIG_FILE_NAME = "data.tox";
 
-Core::Core() :
-    tox(nullptr)
+namespace {
+// Reads the configuration file while tox_new() sets up the sockets
+class ConfigurationReader : public QRunnable
+{
+public:
+    ConfigurationReader(const QString& path, bool (*read)(const QString&, QByteArray&)) :
+        path(path), read(read)
+    {
+        setAutoDelete(false);
+    }
+
+    void run()
+    {
+        read(path, data);
+        done.release();
+    }
+
+    QByteArray wait()
+    {
+        done.acquire();
+        return data;
+    }
+
+private:
+    const QString path;
+    bool (*read)(const QString&, QByteArray&);
+    QByteArray data;
+    QSemaphore done;
+};
+
+// Derives the key of setPassword(), the password hashing is too slow for the Core's thread
+class KeyDeriver : public QRunnable
+{
+public:
+    KeyDeriver(Core* core, const QString& password) :
+        core(core), password(password)
+    {
+    }
+
+    void run()
+    {
+        // an empty password turns encryption off, it still goes through here to stay in order with the others
+        bool success = true;
+        QByteArray key;
+        QByteArray salt;
+        if (!password.isEmpty()) {
+            salt = ProfileCipher::generateSalt();
+            key = ProfileCipher::deriveKey(password, salt);
+            success = !key.isEmpty();
+        }
+
+        QMetaObject::invokeMethod(core, "onKeyDerived", Qt::QueuedConnection,
+                                  Q_ARG(bool, success), Q_ARG(QByteArray, key), Q_ARG(QByteArray, salt));
+    }
+
+private:
+    Core* core;
+    const QString password;
+};
+}
+
+Core::Core(const QString& configFileName, bool useSettingsIdentity) :
+    configFileName(configFileName), useSettingsIdentity(useSettingsIdentity),
+    tox(nullptr), av(nullptr), callManager(nullptr), mediaThread(nullptr), fileTransfers(nullptr), localApi(nullptr), localApiForced(false), waiterThread(nullptr), waiting(false), eventsQueued(false), lastQueueId(0),
+    powerSaving(false), idleIterations(0),
+    saveInProgress(false), configurationDirty(false), saveCount(0), lastSaveLatency(0), totalSaveLatency(0)
 {
     timer = new QTimer(this);
     timer->setSingleShot(true);
     connect(timer, &QTimer::timeout, this, &Core::process);
+
+    bootstrapManager = new BootstrapManager(this);
+
+    saveTimer = new QTimer(this);
+    saveTimer->setSingleShot(true);
+    saveTimer->setInterval(SAVE_DELAY);
+    connect(saveTimer, &QTimer::timeout, this, &Core::onSaveTimeout);
+    configurationWriter.setMaxThreadCount(1);
+
     connect(&Settings::getInstance(), &Settings::dhtServerListChanged, this, &Core::bootstrapDht);
+    connect(&Settings::getInstance(), &Settings::localApiChanged, this, &Core::updateLocalApi);
+
+#ifdef EVENT_DRIVEN_CORE
+    ToxWaiter* waiter = new ToxWaiter();
+    waiterThread = new QThread(this);
+    waiter->moveToThread(waiterThread);
+    connect(waiterThread, &QThread::finished, waiter, &ToxWaiter::deleteLater);
+    connect(this, &Core::waitRequested, waiter, &ToxWaiter::wait);
+    connect(waiter, &ToxWaiter::ready, this, &Core::onWaitFinished);
+    waiterThread->start();
+#endif
 }
 
 Core::~Core()
 {
+    // nothing may be sent through us anymore
+    delete localApi;
+
+    if (waiterThread) {
+        waiterThread->quit();
+        waiterThread->wait();
+    }
+
+    // toxav goes before tox, and nothing may use it by then
+    if (mediaThread) {
+        mediaThread->quit();
+        mediaThread->wait();
+    }
+    delete callManager;
+    if (av) {
+        toxav_kill(av);
+    }
+
+    // let an in-flight write finish, the final save below is done synchronously
+    configurationWriter.waitForDone();
+
     if (tox) {
         saveConfiguration();
         tox_kill(tox);
@@ -48,27 +168,36 @@ Core::~Core()
 
 void Core::onFriendRequest(Tox*/* tox*/, const uint8_t* cUserId, const uint8_t* cMessage, uint16_t cMessageSize, void* core)
 {
-    emit static_cast<Core*>(core)->friendRequestReceived(CUserId::toString(cUserId), CString::toString(cMessage, cMessageSize));
+    CoreEventRecord record(CoreEvent::Type::FriendRequestReceived, -1);
+    memcpy(record.userId, cUserId, UserId::SIZE);
+    static_cast<Core*>(core)->queueEvent(record, cMessage, cMessageSize);
 }
 
 void Core::onFriendMessage(Tox*/* tox*/, int friendId, const uint8_t* cMessage, uint16_t cMessageSize, void* core)
 {
-    emit static_cast<Core*>(core)->friendMessageReceived(friendId, CString::toString(cMessage, cMessageSize));
+    CoreEventRecord record(CoreEvent::Type::FriendMessageReceived, friendId);
+    static_cast<Core*>(core)->queueEvent(record, cMessage, cMessageSize);
 }
 
 void Core::onFriendNameChange(Tox*/* tox*/, int friendId, const uint8_t* cName, uint16_t cNameSize, void* core)
 {
-    emit static_cast<Core*>(core)->friendUsernameChanged(friendId, CString::toString(cName, cNameSize));
+    static_cast<Core*>(core)->markConfigurationDirty();
+    CoreEventRecord record(CoreEvent::Type::FriendUsernameChanged, friendId);
+    static_cast<Core*>(core)->queueEvent(record, cName, cNameSize);
 }
 
 void Core::onFriendTypingChange(Tox*/* tox*/, int friendId, uint8_t isTyping, void *core)
 {
-    emit static_cast<Core*>(core)->friendTypingChanged(friendId, isTyping ? true : false);
+    CoreEventRecord record(CoreEvent::Type::FriendTypingChanged, friendId);
+    record.flag = isTyping ? true : false;
+    static_cast<Core*>(core)->queueEvent(record);
 }
 
 void Core::onStatusMessageChanged(Tox*/* tox*/, int friendId, const uint8_t* cMessage, uint16_t cMessageSize, void* core)
 {
-    emit static_cast<Core*>(core)->friendStatusMessageChanged(friendId, CString::toString(cMessage, cMessageSize));
+    static_cast<Core*>(core)->markConfigurationDirty();
+    CoreEventRecord record(CoreEvent::Type::FriendStatusMessageChanged, friendId);
+    static_cast<Core*>(core)->queueEvent(record, cMessage, cMessageSize);
 }
 
 void Core::onUserStatusChanged(Tox*/* tox*/, int friendId, uint8_t userstatus, void* core)
@@ -88,30 +217,213 @@ void Core::onUserStatusChanged(Tox*/* tox*/, int friendId, uint8_t userstatus, v
             status = Status::Online;
             break;
     }
-    emit static_cast<Core*>(core)->friendStatusChanged(friendId, status);
+    CoreEventRecord record(CoreEvent::Type::FriendStatusChanged, friendId);
+    record.status = status;
+    static_cast<Core*>(core)->queueEvent(record);
 }
 
 void Core::onConnectionStatusChanged(Tox*/* tox*/, int friendId, uint8_t status, void* core)
 {
     Status friendStatus = status ? Status::Online : Status::Offline;
-    emit static_cast<Core*>(core)->friendStatusChanged(friendId, friendStatus);
+    static_cast<Core*>(core)->setFriendOnline(friendId, status);
+    CoreEventRecord record(CoreEvent::Type::FriendStatusChanged, friendId);
+    record.status = friendStatus;
+    static_cast<Core*>(core)->queueEvent(record);
     if (friendStatus == Status::Offline) {
-        static_cast<Core*>(core)->checkLastOnline(friendId);
+        static_cast<Core*>(core)->lastOnlinePending.insert(friendId);
     }
 }
 
 void Core::onAction(Tox*/* tox*/, int friendId, const uint8_t *cMessage, uint16_t cMessageSize, void *core)
 {
-    emit static_cast<Core*>(core)->actionReceived(friendId, CString::toString(cMessage, cMessageSize));
+    CoreEventRecord record(CoreEvent::Type::FriendActionReceived, friendId);
+    static_cast<Core*>(core)->queueEvent(record, cMessage, cMessageSize);
+}
+
+void Core::onReadReceipt(Tox*/* tox*/, int32_t friendId, uint32_t receipt, void* core)
+{
+    CoreEventRecord record(CoreEvent::Type::FriendMessageDelivered, friendId);
+    record.messageId = receipt;
+    static_cast<Core*>(core)->queueEvent(record);
+    emit static_cast<Core*>(core)->messageDelivered(friendId, receipt);
+}
+
+void Core::onGroupInvite(Tox*/* tox*/, int32_t friendId, const uint8_t* groupKey, void* core)
+{
+    GroupEvent event(GroupEvent::Type::Invited, -1, -1);
+    event.friendId = friendId;
+    event.inviteKey = QByteArray(reinterpret_cast<const char*>(groupKey), TOX_CLIENT_ID_SIZE);
+    static_cast<Core*>(core)->queueGroupEvent(event);
+}
+
+void Core::onGroupMessage(Tox*/* tox*/, int groupId, int peerId, const uint8_t* cMessage, uint16_t cMessageSize, void* core)
+{
+    GroupEvent event(GroupEvent::Type::MessageReceived, groupId, peerId);
+    event.name = static_cast<Core*>(core)->getGroupPeerName(groupId, peerId);
+    event.text = CString::toString(cMessage, cMessageSize);
+    static_cast<Core*>(core)->queueGroupEvent(event);
+}
+
+void Core::onGroupAction(Tox*/* tox*/, int groupId, int peerId, const uint8_t* cMessage, uint16_t cMessageSize, void* core)
+{
+    GroupEvent event(GroupEvent::Type::ActionReceived, groupId, peerId);
+    event.name = static_cast<Core*>(core)->getGroupPeerName(groupId, peerId);
+    event.text = CString::toString(cMessage, cMessageSize);
+    static_cast<Core*>(core)->queueGroupEvent(event);
+}
+
+void Core::onGroupNamelistChange(Tox*/* tox*/, int groupId, int peerId, uint8_t change, void* core)
+{
+    Core* self = static_cast<Core*>(core);
+
+    switch (change) {
+        case TOX_CHAT_CHANGE_PEER_ADD: {
+            GroupEvent event(GroupEvent::Type::PeerAdded, groupId, peerId);
+            event.name = self->getGroupPeerName(groupId, peerId);
+            self->queueGroupEvent(event);
+            break;
+        }
+        case TOX_CHAT_CHANGE_PEER_DEL:
+            self->queueGroupEvent(GroupEvent(GroupEvent::Type::PeerRemoved, groupId, peerId));
+            break;
+        case TOX_CHAT_CHANGE_PEER_NAME: {
+            const QString name = self->getGroupPeerName(groupId, peerId);
+            // a peer that got renamed several times in this iteration, or just joined, only needs its last name
+            QHash<int, int>& renames = self->groupRenameIndex[groupId];
+            QHash<int, int>::const_iterator it = renames.constFind(peerId);
+            if (it != renames.constEnd()) {
+                self->groupEvents[it.value()].name = name;
+            } else {
+                GroupEvent event(GroupEvent::Type::PeerRenamed, groupId, peerId);
+                event.name = name;
+                self->queueGroupEvent(event);
+            }
+            break;
+        }
+    }
+}
+
+QString Core::getGroupPeerName(int groupId, int peerId) const
+{
+    uint8_t name[TOX_MAX_NAME_LENGTH];
+    const int nameSize = tox_group_peername(tox, groupId, peerId, name);
+    return nameSize > 0 ? CString::toString(name, nameSize) : QString();
+}
+
+void Core::queueGroupEvent(const GroupEvent& event)
+{
+    eventsQueued = true;
+
+    switch (event.type) {
+        case GroupEvent::Type::PeerAdded:
+        case GroupEvent::Type::PeerRenamed:
+            groupRenameIndex[event.groupId].insert(event.peerId, groupEvents.size());
+            break;
+        case GroupEvent::Type::PeerRemoved:
+            groupRenameIndex.remove(event.groupId);
+            break;
+        default:
+            break;
+    }
+
+    groupEvents << event;
+}
+
+void Core::flushGroupEvents()
+{
+    if (groupEvents.isEmpty()) {
+        return;
+    }
+
+    emit groupEventsReceived(groupEvents);
+    groupEvents.clear();
+    groupRenameIndex.clear();
+}
+
+void Core::createGroup()
+{
+    const int groupId = tox_add_groupchat(tox);
+    if (groupId == -1) {
+        emit failedToCreateGroup();
+    } else {
+        emit groupCreated(groupId);
+    }
+}
+
+void Core::joinGroup(int friendId, const QByteArray& inviteKey)
+{
+    if (inviteKey.size() != TOX_CLIENT_ID_SIZE) {
+        emit failedToJoinGroup(friendId);
+        return;
+    }
+
+    const int groupId = tox_join_groupchat(tox, friendId, reinterpret_cast<const uint8_t*>(inviteKey.constData()));
+    if (groupId == -1) {
+        emit failedToJoinGroup(friendId);
+    } else {
+        emit groupCreated(groupId);
+    }
+    wakeUp();
+}
+
+void Core::inviteToGroup(int friendId, int groupId)
+{
+    if (tox_invite_friend(tox, friendId, groupId) == -1) {
+        emit failedToInviteToGroup(friendId, groupId);
+    }
+    wakeUp();
+}
+
+void Core::leaveGroup(int groupId)
+{
+    // events of the group that are still to be flushed refer to it
+    flushGroupEvents();
+    tox_del_groupchat(tox, groupId);
+    emit groupRemoved(groupId);
+}
+
+void Core::sendGroupMessage(int groupId, const QString& message)
+{
+    QByteArray byteArray = message.toUtf8();
+
+    for (const MessageChunk& chunk : splitMessage(message, TOX_MAX_MESSAGE_LENGTH)) {
+        if (chunk.utf8Offset + chunk.utf8Length > byteArray.size()) {
+            qWarning() << "Core: a group message was split past its end";
+            emit failedToSendGroupMessage(groupId, message.mid(chunk.utf16Offset));
+            break;
+        }
+        uint8_t* data = reinterpret_cast<uint8_t*>(byteArray.data() + chunk.utf8Offset);
+        if (tox_group_message_send(tox, groupId, data, chunk.utf8Length) == -1) {
+            emit failedToSendGroupMessage(groupId, message.mid(chunk.utf16Offset));
+            break;
+        }
+    }
+    wakeUp();
+}
+
+void Core::sendGroupAction(int groupId, const QString& action)
+{
+    QByteArray byteArray = action.toUtf8();
+    if (byteArray.size() > TOX_MAX_MESSAGE_LENGTH) {
+        // like friend actions, cut it on a codepoint boundary
+        byteArray.truncate(splitMessage(action, TOX_MAX_MESSAGE_LENGTH).first().utf8Length);
+    }
+
+    if (tox_group_action_send(tox, groupId, reinterpret_cast<uint8_t*>(byteArray.data()), byteArray.size()) == -1) {
+        emit failedToSendGroupMessage(groupId, action);
+    }
+    wakeUp();
 }
 
-void Core::acceptFriendRequest(const QString& userId)
+void Core::acceptFriendRequest(const UserId& userId)
 {
-    int friendId = tox_add_friend_norequest(tox, CUserId(userId).data());
+    int friendId = tox_add_friend_norequest(tox, userId.data());
     if (friendId == -1) {
-        emit failedToAddFriend(userId);
+        emit failedToAddFriend(userId.toString());
     } else {
         emit friendAdded(friendId, userId);
+        markConfigurationDirty();
+        wakeUp();
     }
 }
 
@@ -120,88 +432,279 @@ void Core::requestFriendship(const QString& friendAddress, const QString& messag
     CString cMessage(message);
 
     int friendId = tox_add_friend(tox, CFriendAddress(friendAddress).data(), cMessage.data(), cMessage.size());
-    const QString userId = friendAddress.mid(0, TOX_CLIENT_ID_SIZE * 2);
+    const UserId userId = UserId::fromString(friendAddress.left(UserId::SIZE * 2));
     // TODO: better error handling
     if (friendId < 0) {
-        emit failedToAddFriend(userId);
+        emit failedToAddFriend(friendAddress.left(UserId::SIZE * 2));
     } else {
         emit friendAdded(friendId, userId);
+        markConfigurationDirty();
+        wakeUp();
     }
 }
 
+QVector<Core::MessageChunk> Core::splitMessage(const QString& message, int maxLength)
+{
+    QVector<MessageChunk> chunks;
+
+    // try to split on whitespace or punctuation instead of just cutting off at a codepoint,
+    // but only if it doesn't leave us with a chunk shorter than 3/4 of maxLength
+    const int minSplitLength = maxLength - maxLength / 4;
+
+    MessageChunk chunk = {0, 0, 0, 0};
+    // the current chunk cut right after its last split char, empty if there is no such char
+    MessageChunk split = {0, 0, 0, 0};
+
+    const QChar* data = message.constData();
+    const int length = message.length();
+    for (int i = 0; i < length; ) {
+        const ushort c = data[i].unicode();
+
+        // size of the codepoint in UTF-16 and UTF-8 code units, lone surrogates
+        // are replaced by QString::toUtf8() with a '?'
+        int utf16Size = 1;
+        int utf8Size;
+        if (c < 0x80) {
+            utf8Size = 1;
+        } else if (c < 0x800) {
+            utf8Size = 2;
+        } else if (QChar::isHighSurrogate(c) && i + 1 < length && QChar::isLowSurrogate(data[i + 1].unicode())) {
+            utf8Size = 4;
+            utf16Size = 2;
+        } else if (QChar::isSurrogate(c)) {
+            utf8Size = 1;
+        } else {
+            utf8Size = 3;
+        }
+
+        if (chunk.utf8Length + utf8Size > maxLength) {
+            if (split.utf8Length > minSplitLength) {
+                chunks << split;
+                // keep split char on old line, carry the rest over
+                chunk.utf8Offset += split.utf8Length;
+                chunk.utf8Length -= split.utf8Length;
+                chunk.utf16Offset += split.utf16Length;
+                chunk.utf16Length -= split.utf16Length;
+            } else {
+                chunks << chunk;
+                chunk.utf8Offset += chunk.utf8Length;
+                chunk.utf8Length = 0;
+                chunk.utf16Offset += chunk.utf16Length;
+                chunk.utf16Length = 0;
+            }
+            split.utf8Length = 0;
+        }
+
+        chunk.utf8Length += utf8Size;
+        chunk.utf16Length += utf16Size;
+
+        if (c == ' ' || c == '.' || c == ',' || c == '-') {
+            split = chunk;
+        }
+
+        i += utf16Size;
+    }
+
+    if (chunk.utf8Length > 0) {
+        chunks << chunk;
+    }
+
+    return chunks;
+}
+
 void Core::sendMessage(int friendId, const QString& message)
 {
+    Trace::Span span("Core::sendMessage");
+
+    queueText(friendId, message, false);
+
+    flushOutbox(friendId);
+    wakeUp();
+}
+
+void Core::sendAction(int friendId, const QString &action)
+{
+    queueText(friendId, action, true);
+
+    flushOutbox(friendId);
+    wakeUp();
+}
+
+void Core::restoreMessage(int friendId, const QString& message, bool isAction, qint64 tag)
+{
+    if (tox == nullptr || !tox_friend_exists(tox, friendId)) {
+        return;
+    }
+
+    // it was a single chunk when it was queued, only cut anything that doesn't fit anymore
     QByteArray byteArray = message.toUtf8();
+    if (byteArray.size() > TOX_MAX_MESSAGE_LENGTH) {
+        byteArray.truncate(splitMessage(message, TOX_MAX_MESSAGE_LENGTH).first().utf8Length);
+    }
 
-    int messageOffset = 0;
-    int absoluteMaxLength = TOX_MAX_MESSAGE_LENGTH + messageOffset;
-    // keep splitting message while it's too big
-    while (byteArray.size() > absoluteMaxLength) {
-        int absoluteMaxPosition = absoluteMaxLength - 1;
-
-        static const char multibyteCodepoint = 1 << 7; // 1xxxxxxx mask
-        static const char multibyteCodepointStart = 1 << 6; // x1xxxxxx mask
-        int lastCodepointStart = -1;
-        // find a codepoint start position
-        // UTF-8 codepoints are maximum of 4 bytes in length
-        for (int i = absoluteMaxPosition; i > absoluteMaxPosition - 4; i --) {
-            // if we are at multibyte codepoint but not at its start yet -- keep moving back
-            if ((byteArray[i] & multibyteCodepoint) && !(byteArray[i] & multibyteCodepointStart)) {
-                continue;
-            }
-            // we are either at a single-byte codepoint or at the beginning of a multibyte one -- split the message
-            lastCodepointStart = i;
-            break;
+    emit messageRestored(friendId, message, isAction, tag, enqueueMessage(friendId, isAction, byteArray));
+
+    // the friend can't be online this early, the outbox is flushed once they are, in order and
+    // MAX_MESSAGES_PER_ITERATION at a time
+    flushOutbox(friendId);
+    wakeUp();
+}
+
+QVector<QVector<int>> Core::sendMessages(const QVector<OutgoingText>& texts)
+{
+    Trace::Span span("Core::sendMessages");
+
+    QVector<QVector<int>> queueIds;
+    queueIds.reserve(texts.size());
+    QSet<int> friendIds;
+
+    for (const OutgoingText& text : texts) {
+        if (tox == nullptr || !tox_friend_exists(tox, text.friendId)) {
+            queueIds << QVector<int>();
+            continue;
         }
+        queueIds << queueText(text.friendId, text.text, text.isAction);
+        friendIds.insert(text.friendId);
+    }
 
-        // try to split on whitespace or punctuation instead of just cutting off at a codepoint
-        static const char *splitOn = " .,-";
-        int splitPosition = -1;
-        for (int i = lastCodepointStart; i > absoluteMaxPosition - TOX_MAX_MESSAGE_LENGTH / 4; i --) {
-            // if we are at multibyte codepoint -- keep moving back
-            if (byteArray[i] & multibyteCodepoint) {
-                continue;
-            }
-            // we are at single-byte codepoint, check if it matches any of splitOn characters
-            for (const char *splitChar = splitOn; *splitChar != 0; splitChar ++) {
-                if (byteArray[i] == *splitChar) {
-                    // keep split char on old line
-                    splitPosition = i + 1;
-                    goto found;
-                }
-            }
+    // a single flush per friend, however many texts the batch had for it
+    for (int friendId : friendIds) {
+        flushOutbox(friendId);
+    }
+    wakeUp();
+
+    return queueIds;
+}
+
+QVector<int> Core::queueText(int friendId, const QString& text, bool isAction)
+{
+    QVector<int> queueIds;
+    QByteArray byteArray = text.toUtf8();
+
+    if (isAction) {
+        if (byteArray.size() > TOX_MAX_MESSAGE_LENGTH) {
+            // actions are not split, just cut it on a codepoint boundary
+            const MessageChunk chunk = splitMessage(text, TOX_MAX_MESSAGE_LENGTH).first();
+            byteArray.truncate(chunk.utf8Length);
         }
-found:
-        if (splitPosition <= messageOffset || splitPosition > absoluteMaxLength) {
-            splitPosition = lastCodepointStart;
+
+        int queueId = enqueueMessage(friendId, true, byteArray);
+        emit actionQueued(friendId, text, queueId);
+        queueIds << queueId;
+        return queueIds;
+    }
+
+    // the chunks are computed in a single pass and point both into the UTF-8 data we send
+    // and into the original message, so nothing has to be decoded back from UTF-8
+    for (const MessageChunk& chunk : splitMessage(text, TOX_MAX_MESSAGE_LENGTH)) {
+        if (chunk.utf8Offset + chunk.utf8Length > byteArray.size()) {
+            qWarning() << "Core: a message was split past its end";
+            break;
         }
+        int queueId = enqueueMessage(friendId, false, byteArray.mid(chunk.utf8Offset, chunk.utf8Length));
+        emit messageQueued(friendId, text.mid(chunk.utf16Offset, chunk.utf16Length), queueId);
+        queueIds << queueId;
+    }
 
-        int messageId = tox_send_message(tox, friendId, reinterpret_cast<uint8_t*>(byteArray.data() + messageOffset), splitPosition - messageOffset);
-        emit messageSentResult(friendId, QString::fromUtf8(byteArray.data() + messageOffset, splitPosition - messageOffset), messageId);
+    return queueIds;
+}
 
-        messageOffset = splitPosition;
-        absoluteMaxLength = TOX_MAX_MESSAGE_LENGTH + messageOffset;
+int Core::enqueueMessage(int friendId, bool isAction, const QByteArray& data)
+{
+    OutgoingMessage message;
+    message.queueId = ++lastQueueId;
+    message.isAction = isAction;
+    message.data = data;
+    outbox[friendId].enqueue(message);
+    return message.queueId;
+}
+
+void Core::flushOutbox(int friendId)
+{
+    if (!onlineFriends.contains(friendId)) {
+        // will be flushed once the friend comes online
+        return;
+    }
+
+    QHash<int, QQueue<OutgoingMessage>>::iterator it = outbox.find(friendId);
+    if (it == outbox.end()) {
+        return;
     }
 
-    if (byteArray.size() - messageOffset > 0) {
-        int messageId = tox_send_message(tox, friendId, reinterpret_cast<uint8_t*>(byteArray.data() + messageOffset), byteArray.size() - messageOffset);
-        emit messageSentResult(friendId, QString::fromUtf8(byteArray.data() + messageOffset, byteArray.size() - messageOffset), messageId);
+    QQueue<OutgoingMessage>& queue = it.value();
+    for (int sent = 0; sent < MAX_MESSAGES_PER_ITERATION && !queue.isEmpty(); sent ++) {
+        OutgoingMessage& message = queue.head();
+        uint8_t* data = reinterpret_cast<uint8_t*>(message.data.data());
+        uint32_t messageId = message.isAction ? tox_send_action(tox, friendId, data, message.data.size())
+                                              : tox_send_message(tox, friendId, data, message.data.size());
+        if (messageId == 0) {
+            // toxcore's send queue is full, retry on the next iteration
+            break;
+        }
+        emit messageSent(friendId, message.queueId, messageId);
+        queue.dequeue();
     }
 
+    if (queue.isEmpty()) {
+        outbox.erase(it);
+    }
 }
 
-void Core::sendAction(int friendId, const QString &action)
+void Core::flushOutboxes()
 {
-    CString cMessage(action);
-    int ret = tox_send_action(tox, friendId, cMessage.data(), cMessage.size());
-    emit actionSentResult(friendId, action, ret);
+    // flushOutbox() may erase from outbox, so iterate over a copy of the keys
+    for (int friendId : outbox.keys()) {
+        flushOutbox(friendId);
+    }
+}
+
+void Core::setFriendOnline(int friendId, bool online)
+{
+    if (online) {
+        onlineFriends.insert(friendId);
+        // back before we looked it up
+        lastOnlinePending.remove(friendId);
+        if (fileTransfers) {
+            fileTransfers->onFriendOnline(friendId);
+        }
+    } else {
+        onlineFriends.remove(friendId);
+        if (fileTransfers) {
+            fileTransfers->onFriendOffline(friendId);
+        }
+    }
+}
+
+void Core::sendFile(int friendId, const QString& filePath)
+{
+    fileTransfers->sendFile(friendId, filePath);
+    wakeUp();
+}
+
+void Core::acceptFile(int friendId, int fileNumber, const QString& savePath)
+{
+    fileTransfers->acceptFile(friendId, fileNumber, savePath);
+    wakeUp();
+}
+
+void Core::cancelFile(int friendId, int fileNumber, FileTransferInfo::Direction direction)
+{
+    fileTransfers->cancelFile(friendId, fileNumber, direction);
+    wakeUp();
 }
 
 void Core::sendTyping(int friendId, bool typing)
 {
+    if (typingSent.value(friendId, false) == typing)
+        return;
+
     int ret = tox_set_user_is_typing(tox, friendId, typing);
-    if (ret == -1)
+    if (ret == -1) {
         emit failedToSetTyping(typing);
+    } else {
+        typingSent[friendId] = typing;
+        wakeUp();
+    }
 }
 
 void Core::removeFriend(int friendId)
@@ -209,6 +712,12 @@ void Core::removeFriend(int friendId)
     if (tox_del_friend(tox, friendId) == -1) {
         emit failedToRemoveFriend(friendId);
     } else {
+        outbox.remove(friendId);
+        onlineFriends.remove(friendId);
+        typingSent.remove(friendId);
+        friendsWithoutDetails.removeAll(friendId);
+        lastOnlinePending.remove(friendId);
+        markConfigurationDirty();
         emit friendRemoved(friendId);
     }
 }
@@ -220,6 +729,7 @@ void Core::setUsername(const QString& username)
     if (tox_set_name(tox, cUsername.data(), cUsername.size()) == -1) {
         emit failedToSetUsername(username);
     } else {
+        markConfigurationDirty();
         emit usernameSet(username);
     }
 }
@@ -231,6 +741,7 @@ void Core::setStatusMessage(const QString& message)
     if (tox_set_status_message(tox, cMessage.data(), cMessage.size()) == -1) {
         emit failedToSetStatusMessage(message);
     } else {
+        markConfigurationDirty();
         emit statusMessageSet(message);
     }
 }
@@ -262,162 +773,574 @@ void Core::setStatus(Status status)
 
 void Core::bootstrapDht()
 {
-    const Settings& s = Settings::getInstance();
-    QList<Settings::DhtServer> dhtServerList = s.getDhtServerList();
-
-    for (const Settings::DhtServer& dhtServer : dhtServerList) {
-       tox_bootstrap_from_address(tox, dhtServer.address.toLatin1().data(), dhtServer.port, CUserId(dhtServer.userId).data());
-    }
+    bootstrapManager->bootstrap(tox, Settings::getInstance().snapshot()->dhtServerList);
 }
 
 void Core::process()
 {
-    tox_do(tox);
+    Trace::Span span("Core::process");
+
+    QElapsedTimer toxDoTime;
+    toxDoTime.start();
+    {
+        Trace::Span toxDoSpan("tox_do");
+        tox_do(tox);
+    }
+    const qint64 toxDoDuration = toxDoTime.nsecsElapsed() / 1000;
 #ifdef DEBUG
     //we want to see the debug messages immediately
     fflush(stdout);
 #endif
+    flushOutboxes();
+    if (fileTransfers) {
+        fileTransfers->process();
+    }
+    loadFriendDetails();
+    checkPendingLastOnline();
+    flushGroupEvents();
+    if (eventsQueued) {
+        resetIdle();
+    } else {
+        idleIterations++;
+    }
+    flushEvents();
     checkConnection();
-    timer->start(tox_do_interval(tox));
+
+    const int interval = tox_do_interval(tox);
+    metrics.recordToxDo(toxDoDuration, interval);
+    scheduleProcess(interval);
+}
+
+CoreEventQueue* Core::getEventQueue()
+{
+    return &eventQueue;
+}
+
+void Core::setLocalApiForced(bool forced)
+{
+    localApiForced = forced;
+}
+
+void Core::reportMetrics()
+{
+    emit metricsReported(metrics);
+}
+
+void Core::dumpMetrics(const QString& filePath)
+{
+    metrics.dumpToFile(filePath);
+}
+
+void Core::scheduleProcess(int interval)
+{
+    // still loading friends, get back to the next chunk shortly, the events of the last one
+    // are processed by the GUI meanwhile
+    if (!friendsWithoutDetails.isEmpty() && interval > FRIEND_DETAILS_INTERVAL) {
+        interval = FRIEND_DETAILS_INTERVAL;
+    }
+
+    // there are messages waiting for free space in toxcore's send buffers, come back soon
+    if (interval > OUTBOX_RETRY_INTERVAL) {
+        for (int friendId : outbox.keys()) {
+            if (onlineFriends.contains(friendId)) {
+                interval = OUTBOX_RETRY_INTERVAL;
+                break;
+            }
+        }
+    }
+
+    // same for file chunks
+    if (interval > OUTBOX_RETRY_INTERVAL && fileTransfers && fileTransfers->hasPendingData()) {
+        interval = OUTBOX_RETRY_INTERVAL;
+    }
+
+    // don't sleep past the next last seen lookup
+    if (!lastOnlinePending.isEmpty()) {
+        const qint64 untilCheck = lastOnlineCheck.isValid() ? LAST_SEEN_INTERVAL - lastOnlineCheck.elapsed() : 0;
+        interval = qBound<qint64>(0, untilCheck, interval);
+    }
+
+    const int stretched = stretchInterval(interval);
+    if (stretched != interval) {
+        metrics.recordStretchedInterval(stretched);
+        interval = stretched;
+    }
+
+#ifdef EVENT_DRIVEN_CORE
+    // a wait is already in flight, its completion will drive the next iteration
+    if (waiting) {
+        return;
+    }
+
+    waitData.resize(tox_wait_data_size());
+    if (tox_wait_prepare(tox, reinterpret_cast<uint8_t*>(waitData.data())) == 1) {
+        waiting = true;
+        emit waitRequested(waitData, interval);
+        return;
+    }
+
+    qWarning() << "tox_wait_prepare() failed, falling back to polling";
+#endif
+    timer->start(interval);
+}
+
+void Core::onWaitFinished()
+{
+#ifdef EVENT_DRIVEN_CORE
+    waiting = false;
+    tox_wait_cleanup(tox, reinterpret_cast<uint8_t*>(waitData.data()));
+    timer->stop();
+    process();
+#endif
+}
+
+void Core::wakeUp()
+{
+    resetIdle();
+    // there is outbound data queued in toxcore, don't wait for the next tick to send it
+    if (tox) {
+        timer->start(0);
+    }
+}
+
+bool Core::isIdle() const
+{
+    // anything still in flight is served at toxcore's pace
+    return powerSaving && idleIterations >= POWER_SAVING_IDLE_ITERATIONS && activeCalls.isEmpty() &&
+           outbox.isEmpty() && friendsWithoutDetails.isEmpty() &&
+           !(fileTransfers && (fileTransfers->hasPendingData() || fileTransfers->hasActiveTransfers()));
+}
+
+int Core::stretchInterval(int interval) const
+{
+    if (!isIdle()) {
+        return interval;
+    }
+
+    const int doublings = qMin(idleIterations - POWER_SAVING_IDLE_ITERATIONS + 1, 8);
+    return qMax(interval, qMin(interval << doublings, POWER_SAVING_MAX_INTERVAL));
+}
+
+void Core::resetIdle()
+{
+    idleIterations = 0;
+}
+
+void Core::setPowerSaving(bool enabled)
+{
+    if (powerSaving == enabled) {
+        return;
+    }
+
+    powerSaving = enabled;
+    metrics.setPowerSaving(enabled);
+    if (!enabled) {
+        // don't sit out the rest of a stretched interval
+        wakeUp();
+    }
+}
+
+void Core::onCallStateChanged(int friendId, CallState state)
+{
+    if (state == CallState::None) {
+        activeCalls.remove(friendId);
+    } else {
+        activeCalls.insert(friendId);
+        wakeUp();
+    }
+}
+
+void Core::queueEvent(CoreEventRecord& record, const uint8_t* text, int textSize)
+{
+    eventsQueued = true;
+    record.textSize = textSize;
+    if (Trace::isEnabled()) {
+        record.queuedAt = Trace::now();
+    }
+
+    // nothing may overtake the events still waiting for room in the ring
+    if (!overflowEvents.isEmpty() || !eventQueue.push(record, text, textSize)) {
+        overflowEvents.append(reinterpret_cast<const char*>(&record), sizeof(record));
+        overflowEvents.append(reinterpret_cast<const char*>(text), textSize);
+    }
+}
+
+void Core::flushEvents()
+{
+    // events that didn't fit last time go first, the GUI may have drained the ring meanwhile
+    int pos = 0;
+    while (pos < overflowEvents.size()) {
+        CoreEventRecord record(CoreEvent::Type::Superseded, -1);
+        memcpy(&record, overflowEvents.constData() + pos, sizeof(record));
+        const uint8_t* text = reinterpret_cast<const uint8_t*>(overflowEvents.constData() + pos + sizeof(record));
+        if (!eventQueue.push(record, text, record.textSize)) {
+            break;
+        }
+        pos += sizeof(record) + record.textSize;
+    }
+    overflowEvents.remove(0, pos);
+
+    if (eventQueue.shouldNotify()) {
+        emit eventsReady();
+    }
+    eventsQueued = false;
 }
 
 void Core::checkConnection()
 {
-    static bool isConnected = false;
+    const bool isConnected = metrics.isConnected();
 
     if (tox_isconnected(tox) && !isConnected) {
+        metrics.recordConnected();
+        bootstrapManager->connected();
         emit connected();
-        isConnected = true;
     } else if (!tox_isconnected(tox) && isConnected) {
+        metrics.recordDisconnected();
         emit disconnected();
-        isConnected = false;
     }
 }
 
-void Core::loadConfiguration()
+bool Core::readConfiguration(const QString& path, QByteArray& data)
 {
-    QString path = Settings::getSettingsDirPath() + '/' + CONFIG_FILE_NAME;
-
     QFile configurationFile(path);
 
     if (!configurationFile.exists()) {
         qWarning() << "The Tox configuration file was not found";
-        return;
+        return false;
     }
 
     if (!configurationFile.open(QIODevice::ReadOnly)) {
         qCritical() << "File " << path << " cannot be opened";
-        return;
+        return false;
     }
 
-    qint64 fileSize = configurationFile.size();
-    if (fileSize > 0) {
-        QByteArray data = configurationFile.readAll();
+    data = configurationFile.readAll();
+    return true;
+}
+
+void Core::loadConfiguration(QByteArray data)
+{
+    if (!data.isEmpty()) {
         tox_load(tox, reinterpret_cast<uint8_t *>(data.data()), data.size());
+        StartupTrace::mark("tox_load " + configFileName);
     }
 
-    configurationFile.close();
-
     loadFriends();
+    StartupTrace::mark("loadFriends " + configFileName);
+}
+
+QByteArray Core::serializeConfiguration()
+{
+    QByteArray data;
+
+    uint32_t fileSize = tox_size(tox);
+    if (fileSize > 0 && fileSize <= INT32_MAX) {
+        data.resize(fileSize);
+        tox_save(tox, reinterpret_cast<uint8_t*>(data.data()));
+    }
+
+    if (!configurationKey.isEmpty() && !data.isEmpty()) {
+        QByteArray encrypted = ProfileCipher::encrypt(data, configurationKey, configurationSalt);
+        sodium_memzero(data.data(), data.size());
+        return encrypted;
+    }
+
+    return data;
 }
 
 void Core::saveConfiguration()
 {
-    QString path = Settings::getSettingsDirPath();
+    QByteArray data = serializeConfiguration();
+    // stays dirty if the write failed, so that the next save retries it
+    configurationDirty = !data.isEmpty() && !ConfigurationWriter::writeFile(getConfigurationFilePath(), data);
+}
 
-    QDir directory(path);
+void Core::setPassword(const QString& password)
+{
+    if (tox == nullptr) {
+        emit failedToSetPassword();
+        return;
+    }
+
+    // ~Core waits for the pool, so the deriver can't outlive us
+    configurationWriter.start(new KeyDeriver(this, password));
+}
 
-    if (!directory.exists() && !directory.mkpath(directory.absolutePath())) {
-        qCritical() << "Error while creating directory " << path;
+void Core::onKeyDerived(bool success, const QByteArray& key, const QByteArray& salt)
+{
+    if (!success) {
+        emit failedToSetPassword();
         return;
     }
+    configurationKey = key;
+    configurationSalt = salt;
 
-    path += '/' + CONFIG_FILE_NAME;
-    QSaveFile configurationFile(path);
-    if (!configurationFile.open(QIODevice::WriteOnly)) {
-        qCritical() << "File " << path << " cannot be opened";
+    // don't leave the file in its old form any longer than needed
+    saveTimer->stop();
+    if (saveInProgress) {
+        configurationDirty = true;
+    } else {
+        saveConfiguration();
+        if (configurationDirty) {
+            saveTimer->start();
+        }
+    }
+    emit passwordSet(!configurationKey.isEmpty());
+}
+
+void Core::markConfigurationDirty()
+{
+    configurationDirty = true;
+    // don't restart the timer on every change, otherwise a steady stream of changes would postpone the save forever
+    if (!saveTimer->isActive() && !saveInProgress) {
+        saveTimer->start();
+    }
+}
+
+void Core::onSaveTimeout()
+{
+    QByteArray data = serializeConfiguration();
+    configurationDirty = false;
+    if (data.isEmpty()) {
         return;
     }
 
-    uint32_t fileSize = tox_size(tox);
-    if (fileSize > 0 && fileSize <= INT32_MAX) {
-        uint8_t *data = new uint8_t[fileSize];
-        tox_save(tox, data);
-        configurationFile.write(reinterpret_cast<char *>(data), fileSize);
-        configurationFile.commit();
-        delete[] data;
+    saveInProgress = true;
+    ConfigurationWriter* writer = new ConfigurationWriter(getConfigurationFilePath(), data);
+    connect(writer, &ConfigurationWriter::written, this, &Core::onConfigurationWritten);
+    configurationWriter.start(writer);
+}
+
+void Core::onConfigurationWritten(bool success, qint64 elapsed)
+{
+    saveInProgress = false;
+
+    if (success) {
+        saveCount++;
+        lastSaveLatency = elapsed;
+        totalSaveLatency += elapsed;
+        emit configurationSaved(saveCount, lastSaveLatency, totalSaveLatency / static_cast<qint64>(saveCount));
+    } else {
+        // the file still has the previous state, try again after the delay
+        configurationDirty = true;
+    }
+
+    // something has changed while we were writing, or the write failed
+    if (configurationDirty) {
+        saveTimer->start();
+    }
+}
+
+void Core::updateLocalApi()
+{
+    // called again from start(), once there is a tox to send through
+    if (tox == nullptr) {
+        return;
+    }
+
+    const bool enabled = localApiForced || Settings::getInstance().snapshot()->localApi;
+    if (enabled && localApi == nullptr) {
+        localApi = new IpcServer(this);
+        if (!localApi->listen(IpcServer::getServerName(configFileName))) {
+            delete localApi;
+            localApi = nullptr;
+        }
+    } else if (!enabled && localApi != nullptr) {
+        delete localApi;
+        localApi = nullptr;
     }
 }
 
 void Core::loadFriends()
 {
+    QList<int> friendIds;
     const uint32_t friendCount = tox_count_friendlist(tox);
     if (friendCount > 0) {
         // assuming there are not that many friends to fill up the whole stack
         int32_t *ids = new int32_t[friendCount];
         tox_get_friendlist(tox, ids, friendCount);
         uint8_t clientId[TOX_CLIENT_ID_SIZE];
+        // first stage: just ids and names, so that the friend list can be shown right away.
+        // Status messages and last seen times are loaded in chunks by loadFriendDetails()
         for (int32_t i = 0; i < static_cast<int32_t>(friendCount); ++i) {
             if (tox_get_client_id(tox, ids[i], clientId) == 0) {
-                emit friendAdded(ids[i], CUserId::toString(clientId));
+                CoreEventRecord addedRecord(CoreEvent::Type::FriendAdded, ids[i]);
+                memcpy(addedRecord.userId, clientId, UserId::SIZE);
+                queueEvent(addedRecord);
 
                 const int nameSize = tox_get_name_size(tox, ids[i]);
                 if (nameSize > 0) {
                     uint8_t *name = new uint8_t[nameSize];
                     if (tox_get_name(tox, ids[i], name) == nameSize) {
-                        emit friendUsernameLoaded(ids[i], CString::toString(name, nameSize));
+                        CoreEventRecord nameRecord(CoreEvent::Type::FriendUsernameLoaded, ids[i]);
+                        queueEvent(nameRecord, name, nameSize);
                     }
                     delete[] name;
                 }
 
-                const int statusMessageSize = tox_get_status_message_size(tox, ids[i]);
-                if (statusMessageSize > 0) {
-                    uint8_t *statusMessage = new uint8_t[statusMessageSize];
-                    if (tox_get_status_message(tox, ids[i], statusMessage, statusMessageSize) == statusMessageSize) {
-                        emit friendStatusMessageLoaded(ids[i], CString::toString(statusMessage, statusMessageSize));
-                    }
-                    delete[] statusMessage;
-                }
-
-                checkLastOnline(ids[i]);
+                friendsWithoutDetails.enqueue(ids[i]);
+                friendIds << ids[i];
             }
 
         }
         delete[] ids;
     }
+    emit friendListLoaded(friendIds);
+}
+
+void Core::loadFriendDetails()
+{
+    for (int loaded = 0; loaded < FRIEND_DETAILS_PER_ITERATION && !friendsWithoutDetails.isEmpty(); loaded ++) {
+        const int friendId = friendsWithoutDetails.dequeue();
+
+        const int statusMessageSize = tox_get_status_message_size(tox, friendId);
+        if (statusMessageSize > 0) {
+            uint8_t *statusMessage = new uint8_t[statusMessageSize];
+            if (tox_get_status_message(tox, friendId, statusMessage, statusMessageSize) == statusMessageSize) {
+                CoreEventRecord statusMessageRecord(CoreEvent::Type::FriendStatusMessageLoaded, friendId);
+                queueEvent(statusMessageRecord, statusMessage, statusMessageSize);
+            }
+            delete[] statusMessage;
+        }
+
+        checkLastOnline(friendId);
+    }
+}
+
+void Core::loadSelfIdentity()
+{
+    const int nameSize = tox_get_self_name_size(tox);
+    if (nameSize > 0) {
+        uint8_t *name = new uint8_t[nameSize];
+        if (tox_get_self_name(tox, name) == nameSize) {
+            emit usernameSet(CString::toString(name, nameSize));
+        }
+        delete[] name;
+    }
+
+    const int statusMessageSize = tox_get_self_status_message_size(tox);
+    if (statusMessageSize > 0) {
+        uint8_t *statusMessage = new uint8_t[statusMessageSize];
+        if (tox_get_self_status_message(tox, statusMessage, statusMessageSize) == statusMessageSize) {
+            emit statusMessageSet(CString::toString(statusMessage, statusMessageSize));
+        }
+        delete[] statusMessage;
+    }
+}
+
+void Core::generateHistoryKey()
+{
+    uint8_t publicKey[TOX_CLIENT_ID_SIZE];
+    uint8_t secretKey[crypto_box_SECRETKEYBYTES];
+    tox_get_keys(tox, publicKey, secretKey);
+
+    static const char context[] = "Tox Qt GUI chat history";
+    QByteArray key(crypto_aead_xchacha20poly1305_ietf_KEYBYTES, 0);
+    crypto_generichash(reinterpret_cast<unsigned char*>(key.data()), key.size(),
+                       reinterpret_cast<const unsigned char*>(context), sizeof(context) - 1,
+                       secretKey, sizeof(secretKey));
+    sodium_memzero(secretKey, sizeof(secretKey));
+
+    emit historyKeyGenerated(key);
+}
+
+QString Core::getConfigurationFilePath() const
+{
+    return Settings::getSettingsDirPath() + '/' + configFileName;
+}
+
+void Core::checkPendingLastOnline()
+{
+    if (lastOnlinePending.isEmpty() || (lastOnlineCheck.isValid() && !lastOnlineCheck.hasExpired(LAST_SEEN_INTERVAL))) {
+        return;
+    }
+
+    for (int friendId : lastOnlinePending) {
+        checkLastOnline(friendId);
+    }
+    lastOnlinePending.clear();
+    lastOnlineCheck.start();
 }
 
 void Core::checkLastOnline(int friendId) {
     const uint64_t lastOnline = tox_get_last_online(tox, friendId);
     if (lastOnline > 0) {
-        emit friendLastSeenChanged(friendId, QDateTime::fromTime_t(lastOnline));
+        CoreEventRecord record(CoreEvent::Type::FriendLastSeenChanged, friendId);
+        record.lastSeen = static_cast<qint64>(lastOnline);
+        queueEvent(record);
     }
 }
 
 void Core::start()
 {
-    const Settings &settings = Settings::getInstance();
+    std::shared_ptr<const Settings::Snapshot> settings = Settings::getInstance().snapshot();
+
+    metrics.start();
+
+    ConfigurationReader reader(getConfigurationFilePath(), &Core::readConfiguration);
+    if (!QThreadPool::globalInstance()->tryStart(&reader)) {
+        reader.run();
+    }
+
+    // IPv6 failed on this host not long ago, don't wait for it to fail again
+    const qint64 now = QDateTime::currentDateTime().toTime_t();
+    const bool skipIPv6 = settings->enableIPv6 && settings->enableIPv4Fallback && settings->ipv6FailureTime != 0
+                          && now - settings->ipv6FailureTime < IPV6_RETRY_INTERVAL;
+
+    // a network where only the TCP relays got through goes straight to them, an unknown one races both
+    const BootstrapManager::Transport transport = settings->raceTcpRelays ? bootstrapManager->rememberedTransport() : BootstrapManager::Udp;
 
     Tox_Options options;
-    options.ipv6enabled = settings.isIPv6Enabled();
+    options.ipv6enabled = settings->enableIPv6 && !skipIPv6;
     options.proxy_type = TOX_PROXY_NONE;
-    options.udp_disabled = 0;
+    options.udp_disabled = transport == BootstrapManager::TcpRelay;
 
     tox = tox_new(&options);
+    StartupTrace::mark("tox_new " + configFileName);
+
+    if (options.ipv6enabled) {
+        // remember the outcome for the next start
+        const qint64 failureTime = tox == nullptr ? now : 0;
+        if (failureTime != settings->ipv6FailureTime) {
+            QMetaObject::invokeMethod(&Settings::getInstance(), "setIPv6FailureTime", Qt::QueuedConnection, Q_ARG(qint64, failureTime));
+        }
+    }
 
     // if failed to initialize -- try to fallback to ipv4
-    if (tox == nullptr && settings.isIPv6Enabled() && settings.isIPv4FallbackEnabled()) {
+    if (tox == nullptr && options.ipv6enabled && settings->enableIPv4Fallback) {
           options.ipv6enabled = 0;
           tox = tox_new(&options);
     }
 
+    QByteArray configuration = reader.wait();
+
     // if still didn't manage to initialize -- throw an error
     if (tox == nullptr) {
         emit failedToStart();
         return;
     }
 
-    loadConfiguration();
+    if (ProfileCipher::isEncrypted(configuration)) {
+        // unlocked by the LoginDialog, which already ran the password hashing
+        const QByteArray key = ProfileCipher::takeKey(configFileName);
+        QByteArray plain;
+        if (!ProfileCipher::decrypt(configuration, key, plain)) {
+            qWarning() << "The Tox configuration file " << configFileName << " is encrypted and wasn't unlocked";
+            // no tox, so the locked file doesn't get overwritten on destruction
+            tox_kill(tox);
+            tox = nullptr;
+            emit failedToStart();
+            return;
+        }
+        configurationKey = key;
+        configurationSalt = ProfileCipher::getSalt(configuration);
+        configuration = plain;
+    }
+
+    loadConfiguration(configuration);
+    // chat pages are created for the friends just loaded, they need the key to open their logs
+    generateHistoryKey();
+    flushEvents();
 
     tox_callback_friend_request(tox, onFriendRequest, this);
     tox_callback_friend_message(tox, onFriendMessage, this);
@@ -427,21 +1350,52 @@ void Core::start()
     tox_callback_status_message(tox, onStatusMessageChanged, this);
     tox_callback_user_status(tox, onUserStatusChanged, this);
     tox_callback_connection_status(tox, onConnectionStatusChanged, this);
+    tox_callback_read_receipt(tox, onReadReceipt, this);
+    tox_callback_group_invite(tox, onGroupInvite, this);
+    tox_callback_group_message(tox, onGroupMessage, this);
+    tox_callback_group_action(tox, onGroupAction, this);
+    tox_callback_group_namelist_change(tox, onGroupNamelistChange, this);
+
+    fileTransfers = new FileTransferManager(tox, getConfigurationFilePath() + ".transfers", this);
+    connect(fileTransfers, &FileTransferManager::transfersUpdated, this, &Core::fileTransfersUpdated);
+    connect(fileTransfers, &FileTransferManager::failedToSendFile, this, &Core::failedToSendFile);
+
+    updateLocalApi();
+
+    // toxav hooks into tox, that has to happen before the first tox_do()
+    av = toxav_new(tox, CallManager::MAX_CALLS);
+    if (av != nullptr) {
+        callManager = new CallManager(av);
+        mediaThread = new QThread(this);
+        callManager->moveToThread(mediaThread);
+        connect(callManager, &CallManager::callStateChanged, this, &Core::onCallStateChanged);
+        mediaThread->start(QThread::TimeCriticalPriority);
+        QMetaObject::invokeMethod(callManager, "start", Qt::QueuedConnection);
+        emit callManagerCreated(callManager);
+    } else {
+        qWarning() << "Couldn't initialize toxav, calls are disabled";
+    }
 
     uint8_t friendAddress[TOX_FRIEND_ADDRESS_SIZE];
     tox_get_address(tox, friendAddress);
 
     emit friendAddressGenerated(CFriendAddress::toString(friendAddress));
 
-    CString cUsername(settings.getUsername());
-    tox_set_name(tox, cUsername.data(), cUsername.size());
+    if (useSettingsIdentity) {
+        CString cUsername(settings->username);
+        tox_set_name(tox, cUsername.data(), cUsername.size());
 
-    CString cStatusMessage(settings.getStatusMessage());
-    tox_set_status_message(tox, cStatusMessage.data(), cStatusMessage.size());
+        CString cStatusMessage(settings->statusMessage);
+        tox_set_status_message(tox, cStatusMessage.data(), cStatusMessage.size());
+    } else {
+        // the identity is whatever was saved in the profile's data file
+        loadSelfIdentity();
+    }
 
+    bootstrapManager->setTransports(!options.udp_disabled, transport != BootstrapManager::Udp);
     bootstrapDht();
 
-    timer->start(tox_do_interval(tox));
+    scheduleProcess(tox_do_interval(tox));
 }
 
 
@@ -475,26 +1429,12 @@ QString Core::CData::toString(const uint8_t *cData, const uint16_t cDataSize)
 
 uint16_t Core::CData::fromString(const QString& data, uint8_t* cData)
 {
-    QByteArray arr = QByteArray::fromHex(data.toLower().toLatin1());
+    QByteArray arr = QByteArray::fromHex(data.toLatin1());
     memcpy(cData, reinterpret_cast<uint8_t*>(arr.data()), arr.size());
     return arr.size();
 }
 
 
-// CUserId
-
-Core::CUserId::CUserId(const QString &userId) :
-    CData(userId, SIZE)
-{
-    // intentionally left empty
-}
-
-QString Core::CUserId::toString(const uint8_t* cUserId)
-{
-    return CData::toString(cUserId, SIZE);
-}
-
-
 // CFriendAddress
 
 Core::CFriendAddress::CFriendAddress(const QString &friendAddress) :
@@ -17,21 +17,62 @@
 #ifndef CORE_HPP
 #define CORE_HPP
 
+#include "call.hpp"
+#include "coreeventqueue.hpp"
+#include "coremetrics.hpp"
+#include "filetransfer.hpp"
+#include "groupchat.hpp"
 #include "status.hpp"
+#include "userid.hpp"
 
 #include <tox/tox.h>
+#include <tox/toxav.h>
 
+#include <QByteArray>
 #include <QDateTime>
+#include <QElapsedTimer>
+#include <QHash>
 #include <QObject>
+#include <QQueue>
+#include <QSet>
+#include <QThreadPool>
 #include <QTimer>
+#include <QVector>
+
+class BootstrapManager;
+class CallManager;
+class FileTransferManager;
+class IpcServer;
+class QThread;
 
 class Core : public QObject
 {
     Q_OBJECT
 public:
-    explicit Core();
+    // useSettingsIdentity makes the username and status message from Settings override the ones saved in configFileName
+    explicit Core(const QString& configFileName, bool useSettingsIdentity);
+
+    static const QString CONFIG_FILE_NAME;
     ~Core();
 
+    // to be drained by the GUI thread only
+    CoreEventQueue* getEventQueue();
+
+    // keeps the IpcServer running whatever the settings say, to be called before start()
+    void setLocalApiForced(bool forced);
+
+    // a message or an action handed over in bulk, see sendMessages()
+    struct OutgoingText {
+        int friendId;
+        QString text;
+        bool isAction;
+    };
+
+    // Queues all of the texts and flushes each friend's outbox once. Returns the queue ids
+    // of every text's chunks, in order, empty for texts to friends we don't have.
+    // Must be called on the Core's thread.
+    QVector<QVector<int>> sendMessages(const QVector<OutgoingText>& texts);
+
 private:
     static void onFriendRequest(Tox* tox, const uint8_t* cUserId, const uint8_t* cMessage, uint16_t cMessageSize, void* core);
     static void onFriendMessage(Tox* tox, int friendId, const uint8_t *cMessage, uint16_t cMessageSize, void* core);
@@ -41,19 +82,160 @@ private:
     static void onUserStatusChanged(Tox* tox, int friendId, uint8_t userstatus, void* core);
     static void onConnectionStatusChanged(Tox* tox, int friendId, uint8_t status, void* core);
     static void onAction(Tox* tox, int friendId, const uint8_t *cMessage, uint16_t cMessageSize, void* core);
+    static void onReadReceipt(Tox* tox, int32_t friendId, uint32_t receipt, void* core);
+    static void onGroupInvite(Tox* tox, int32_t friendId, const uint8_t* groupKey, void* core);
+    static void onGroupMessage(Tox* tox, int groupId, int peerId, const uint8_t* cMessage, uint16_t cMessageSize, void* core);
+    static void onGroupAction(Tox* tox, int groupId, int peerId, const uint8_t* cMessage, uint16_t cMessageSize, void* core);
+    static void onGroupNamelistChange(Tox* tox, int groupId, int peerId, uint8_t change, void* core);
+
+    QString getGroupPeerName(int groupId, int peerId) const;
+    // hands the group events of this iteration over to the GUI in one go
+    void flushGroupEvents();
 
     void checkConnection();
 
-    void loadConfiguration();
+    void queueEvent(CoreEventRecord& record, const uint8_t* text = nullptr, int textSize = 0);
+    // tells the GUI that there are events to drain
+    void flushEvents();
+
+    void scheduleProcess(int interval);
+    void wakeUp();
+
+    // power saving stretches the interval between tox_do() calls once nothing happened for a while
+    bool isIdle() const;
+    int stretchInterval(int interval) const;
+    void resetIdle();
+
+    // only touches the file, so it can run on any thread
+    static bool readConfiguration(const QString& path, QByteArray& data);
+    void loadConfiguration(QByteArray data);
+    QByteArray serializeConfiguration();
     void saveConfiguration();
+    void markConfigurationDirty();
     void loadFriends();
+    void loadFriendDetails();
 
     void checkLastOnline(int friendId);
+    // friends that went offline are looked up together, once per LAST_SEEN_INTERVAL
+    void checkPendingLastOnline();
+    void loadSelfIdentity();
+    void generateHistoryKey();
+
+    QString getConfigurationFilePath() const;
+
+    // once tox_new() failed with IPv6, cores start without it for this long, in seconds
+    static const qint64 IPV6_RETRY_INTERVAL = 7 * 24 * 60 * 60;
+
+    const QString configFileName;
+    const bool useSettingsIdentity;
+
+    // a part of a message that fits into a single Tox message
+    struct MessageChunk {
+        int utf8Offset;
+        int utf8Length;
+        int utf16Offset;
+        int utf16Length;
+    };
+
+    static QVector<MessageChunk> splitMessage(const QString& message, int maxLength);
+    // times splitMessage()
+    friend class MessagesBenchmark;
+
+    // a message or an action waiting to be handed over to toxcore
+    struct OutgoingMessage {
+        int queueId;
+        bool isAction;
+        QByteArray data; // UTF-8 encoded, already split to fit TOX_MAX_MESSAGE_LENGTH
+    };
+
+    int enqueueMessage(int friendId, bool isAction, const QByteArray& data);
+    // splits or cuts the text and queues it without flushing, emits messageQueued() or actionQueued()
+    QVector<int> queueText(int friendId, const QString& text, bool isAction);
+    void flushOutbox(int friendId);
+    void flushOutboxes();
+    void setFriendOnline(int friendId, bool online);
+
+    // group events since the last flushGroupEvents(), renames of a peer are merged into one
+    GroupEventList groupEvents;
+    // groupId -> peerId -> index into groupEvents of the peer's latest PeerAdded or PeerRenamed,
+    // reset by a PeerRemoved, which renumbers a peer
+    QHash<int, QHash<int, int>> groupRenameIndex;
+    void queueGroupEvent(const GroupEvent& event);
+
+    // per-friend queues of messages that weren't accepted by toxcore yet
+    QHash<int, QQueue<OutgoingMessage>> outbox;
+    QSet<int> onlineFriends;
+    int lastQueueId;
+    // what toxcore was last told about our typing, per friend, repeats aren't passed on
+    QHash<int, bool> typingSent;
+
+    // limits how much we push into toxcore's send buffers in one go when a long message was split
+    static const int MAX_MESSAGES_PER_ITERATION = 8;
+    static const int OUTBOX_RETRY_INTERVAL = 10; // ms
+
+    // friends whose status message and last seen time are still to be loaded
+    QQueue<int> friendsWithoutDetails;
+    static const int FRIEND_DETAILS_PER_ITERATION = 50;
+    // between the chunks, short enough that loading doesn't drag on, long enough not to spin the event loop
+    static const int FRIEND_DETAILS_INTERVAL = 2; // ms
+
+    // friends that went offline since the last checkPendingLastOnline()
+    QSet<int> lastOnlinePending;
+    QElapsedTimer lastOnlineCheck;
+    static const int LAST_SEEN_INTERVAL = 1000; // ms
+
+    bool powerSaving;
+    // tox_do() iterations in a row that had nothing to report
+    int idleIterations;
+    // friends with a call in any state, calls keep us at full speed
+    QSet<int> activeCalls;
+
+    // idle iterations before the interval starts to grow, it doubles with every further one
+    static const int POWER_SAVING_IDLE_ITERATIONS = 20;
+    // the longest we wait, well below the seconds toxcore's pings and keep-alives work with
+    static const int POWER_SAVING_MAX_INTERVAL = 250; // ms
 
     Tox* tox;
+    // calls run on mediaThread, apart from our tox_do() loop
+    ToxAv* av;
+    CallManager* callManager;
+    QThread* mediaThread;
+    FileTransferManager* fileTransfers;
+    // the local API for bots and scripts, only while enabled in the settings
+    IpcServer* localApi;
+    bool localApiForced;
     QTimer* timer;
-
-    static const QString CONFIG_FILE_NAME;
+    BootstrapManager* bootstrapManager;
+    CoreMetrics metrics;
+
+    // delays writing the configuration, so that a burst of changes results in a single save
+    QTimer* saveTimer;
+    bool saveInProgress;
+    bool configurationDirty;
+    quint64 saveCount;
+    qint64 lastSaveLatency;
+    qint64 totalSaveLatency;
+    // one thread, so that saves can't overtake each other and ~Core waits only for them.
+    // The keys of setPassword() are derived on it too, so they are applied in the order they were set
+    QThreadPool configurationWriter;
+
+    static const int SAVE_DELAY = 2000; // ms
+
+    // the key the configuration is encrypted with, empty if it's saved in plaintext.
+    // Derived once at login or in setPassword(), so that saving doesn't run the slow password hashing again
+    QByteArray configurationKey;
+    QByteArray configurationSalt;
+
+    QThread* waiterThread;
+    QByteArray waitData;
+    bool waiting;
+
+    // toxcore callbacks push their events straight into eventQueue, which the GUI drains
+    CoreEventQueue eventQueue;
+    // records and texts of the events that didn't fit into eventQueue, pushed again by flushEvents()
+    QByteArray overflowEvents;
+    // since the last flushEvents()
+    bool eventsQueued;
 
     class CData
     {
@@ -74,18 +256,6 @@ private:
         static uint16_t fromString(const QString& userId, uint8_t* cData);
     };
 
-    class CUserId : public CData
-    {
-    public:
-        explicit CUserId(const QString& userId);
-
-        static QString toString(const uint8_t *cUserId);
-
-    private:
-        static const uint16_t SIZE = TOX_CLIENT_ID_SIZE;
-
-    };
-
     class CFriendAddress : public CData
     {
     public:
@@ -121,7 +291,7 @@ private:
 public slots:
     void start();
 
-    void acceptFriendRequest(const QString& userId);
+    void acceptFriendRequest(const UserId& userId);
     void requestFriendship(const QString& friendAddress, const QString& message);
 
     void removeFriend(int friendId);
@@ -129,44 +299,95 @@ public slots:
     void sendMessage(int friendId, const QString& message);
     void sendAction(int friendId, const QString& action);
     void sendTyping(int friendId, bool typing);
+    // queues a message that was still waiting in the last session, emits messageRestored() instead of messageQueued()
+    void restoreMessage(int friendId, const QString& message, bool isAction, qint64 tag);
+
+    void createGroup();
+    void joinGroup(int friendId, const QByteArray& inviteKey);
+    void inviteToGroup(int friendId, int groupId);
+    void leaveGroup(int groupId);
+    // toxcore hands our own group messages back to us, they are shown once they arrive
+    void sendGroupMessage(int groupId, const QString& message);
+    void sendGroupAction(int groupId, const QString& action);
+
+    void sendFile(int friendId, const QString& filePath);
+    void acceptFile(int friendId, int fileNumber, const QString& savePath);
+    void cancelFile(int friendId, int fileNumber, FileTransferInfo::Direction direction);
 
     void setUsername(const QString& username);
     void setStatusMessage(const QString& message);
     void setStatus(Status status);
+    // derives the key off the Core's thread and then saves the configuration encrypted with it,
+    // an empty password turns encryption off
+    void setPassword(const QString& password);
 
     void process();
 
     void bootstrapDht();
 
+    void reportMetrics();
+    void dumpMetrics(const QString& filePath);
+
+    // the GUI isn't shown, tox_do() may run less often while there is nothing going on
+    void setPowerSaving(bool enabled);
+
+private slots:
+    void onWaitFinished();
+    void onCallStateChanged(int friendId, CallState state);
+    void onSaveTimeout();
+    void onConfigurationWritten(bool success, qint64 elapsed);
+    void onKeyDerived(bool success, const QByteArray& key, const QByteArray& salt);
+    void updateLocalApi();
+
 signals:
-    void connected();
-    void disconnected();
+    void waitRequested(const QByteArray& waitData, int timeout);
 
-    void friendRequestReceived(const QString& userId, const QString& message);
-    void friendMessageReceived(int friendId, const QString& message);
+    // save latency counters, latencies are in ms
+    void configurationSaved(quint64 saveCount, qint64 lastLatency, qint64 averageLatency);
 
-    void friendAdded(int friendId, const QString& userId);
+    void metricsReported(const CoreMetrics& metrics);
 
-    void friendStatusChanged(int friendId, Status status);
-    void friendStatusMessageChanged(int friendId, const QString& message);
-    void friendUsernameChanged(int friendId, const QString& username);
-    void friendTypingChanged(int friendId, bool isTyping);
+    void connected();
+    void disconnected();
 
-    void friendStatusMessageLoaded(int friendId, const QString& message);
-    void friendUsernameLoaded(int friendId, const QString& username);
+    // there are events in getEventQueue(), emitted once until the GUI has drained them
+    void eventsReady();
+
+    void friendAdded(int friendId, const UserId& userId);
+    // all friends of the loaded profile have been queued as FriendAdded events
+    void friendListLoaded(const QList<int>& friendIds);
 
     void friendAddressGenerated(const QString& friendAddress);
+    // key for encrypting chat histories, derived from our secret key
+    void historyKeyGenerated(const QByteArray& key);
 
     void friendRemoved(int friendId);
 
-    void friendLastSeenChanged(int friendId, const QDateTime& dateTime);
-
     void usernameSet(const QString& username);
     void statusMessageSet(const QString& message);
     void statusSet(Status status);
 
-    void messageSentResult(int friendId, const QString& message, int messageId);
-    void actionSentResult(int friendId, const QString& action, int success);
+    // the message is in the outbound queue, queueId identifies it in messageSent()
+    void messageQueued(int friendId, const QString& message, int queueId);
+    void actionQueued(int friendId, const QString& action, int queueId);
+    void messageSent(int friendId, int queueId, int messageId);
+    // tag is the one passed to restoreMessage()
+    void messageRestored(int friendId, const QString& message, bool isAction, qint64 tag, int queueId);
+    // emitted on the Core's thread, the GUI learns about receipts from the event queue
+    void messageDelivered(int friendId, int messageId);
+
+    void groupCreated(int groupId);
+    void groupRemoved(int groupId);
+    // once per tox_do() that had any
+    void groupEventsReceived(const GroupEventList& events);
+    void failedToCreateGroup();
+    void failedToJoinGroup(int friendId);
+    void failedToInviteToGroup(int friendId, int groupId);
+    void failedToSendGroupMessage(int groupId, const QString& message);
+
+    // batched progress of the file transfers, see FileTransferManager
+    void fileTransfersUpdated(const FileTransferInfoList& transfers);
+    void failedToSendFile(int friendId, const QString& filePath);
 
     void failedToAddFriend(const QString& userId);
     void failedToRemoveFriend(int friendId);
@@ -175,9 +396,12 @@ signals:
     void failedToSetStatus(Status status);
     void failedToSetTyping(bool typing);
 
-    void actionReceived(int friendId, const QString& acionMessage);
+    void passwordSet(bool encrypted);
+    void failedToSetPassword();
 
     void failedToStart();
+    // started on its own thread, connect to it to place and take calls
+    void callManagerCreated(CallManager* callManager);
 
 };
 
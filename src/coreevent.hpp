@@ -0,0 +1,74 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef COREEVENT_HPP
+#define COREEVENT_HPP
+
+#include "status.hpp"
+#include "userid.hpp"
+
+#include <QDateTime>
+#include <QList>
+#include <QString>
+
+// Something toxcore has told us about, as the GUI thread gets it from CoreEventQueue.
+struct CoreEvent
+{
+    enum class Type : int {
+        Superseded = 0, // replaced by a later event of the same kind, skip it
+        FriendRequestReceived,
+        FriendAdded,
+        FriendMessageReceived,
+        FriendActionReceived,
+        FriendUsernameChanged,
+        FriendUsernameLoaded,
+        FriendStatusMessageChanged,
+        FriendStatusMessageLoaded,
+        FriendStatusChanged,
+        FriendTypingChanged,
+        FriendLastSeenChanged,
+        FriendMessageDelivered  // the friend confirmed a message we sent
+    };
+
+    Type type;
+    int friendId;
+    QString text;       // message, username, status message or friend request message
+    UserId userId;
+    Status status;
+    bool flag;          // typing state
+    QDateTime dateTime;
+    quint32 messageId;  // as returned by tox_send_message(), of a delivered message
+    qint64 queuedAt;    // Trace::now() when Core queued it, 0 if it wasn't tracing
+
+    CoreEvent() :
+        type(Type::Superseded), friendId(-1), status(Status::Offline), flag(false), messageId(0), queuedAt(0) {}
+
+    CoreEvent(Type type, int friendId) :
+        type(type), friendId(friendId), status(Status::Offline), flag(false), messageId(0), queuedAt(0) {}
+
+    // events of these types only carry the latest state, so an older one
+    // for the same friend can be dropped
+    bool isCollapsible() const
+    {
+        return type == Type::FriendUsernameChanged || type == Type::FriendStatusMessageChanged ||
+               type == Type::FriendStatusChanged || type == Type::FriendTypingChanged ||
+               type == Type::FriendLastSeenChanged;
+    }
+};
+
+typedef QList<CoreEvent> CoreEventBatch;
+
+#endif // COREEVENT_HPP
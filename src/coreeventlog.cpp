@@ -0,0 +1,168 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "coreeventlog.hpp"
+
+#include <QDebug>
+
+const char* const CoreEventLog::RECORD_VARIABLE = "TOX_RECORD_EVENTS";
+const char* const CoreEventLog::REPLAY_VARIABLE = "TOX_REPLAY_EVENTS";
+const char* const CoreEventLog::SPEED_VARIABLE = "TOX_REPLAY_SPEED";
+
+QString CoreEventLog::getRecordPath()
+{
+    return QString::fromLocal8Bit(qgetenv(RECORD_VARIABLE));
+}
+
+QString CoreEventLog::getReplayPath()
+{
+    return QString::fromLocal8Bit(qgetenv(REPLAY_VARIABLE));
+}
+
+double CoreEventLog::getReplaySpeed()
+{
+    bool ok;
+    const double speed = qgetenv(SPEED_VARIABLE).toDouble(&ok);
+    return ok && speed >= 0 ? speed : 1.0;
+}
+
+void CoreEventLog::writeHeader(QDataStream& stream)
+{
+    stream.setVersion(QDataStream::Qt_5_2);
+    stream << MAGIC << FILE_VERSION;
+}
+
+bool CoreEventLog::readHeader(QDataStream& stream)
+{
+    stream.setVersion(QDataStream::Qt_5_2);
+    quint32 magic;
+    quint32 version;
+    stream >> magic >> version;
+    return stream.status() == QDataStream::Ok && magic == MAGIC && version == FILE_VERSION;
+}
+
+void CoreEventLog::writeBatch(QDataStream& stream, qint64 time, const CoreEventBatch& events)
+{
+    stream << time << quint32(events.size());
+    for (const CoreEvent& event : events) {
+        stream << qint32(event.type) << qint32(event.friendId) << event.text.toUtf8()
+               << (event.userId.isValid() ? QByteArray(reinterpret_cast<const char*>(event.userId.data()), UserId::SIZE) : QByteArray())
+               << qint32(event.status) << event.flag
+               << (event.dateTime.isValid() ? event.dateTime.toMSecsSinceEpoch() : qint64(-1)) << event.messageId;
+    }
+}
+
+bool CoreEventLog::readBatch(QDataStream& stream, qint64& time, CoreEventBatch& events)
+{
+    quint32 count;
+    stream >> time >> count;
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; i++) {
+        qint32 type;
+        qint32 friendId;
+        QByteArray text;
+        QByteArray userId;
+        qint32 status;
+        qint64 dateTime;
+        CoreEvent event;
+        stream >> type >> friendId >> text >> userId >> status >> event.flag >> dateTime >> event.messageId;
+
+        event.type = static_cast<CoreEvent::Type>(type);
+        event.friendId = friendId;
+        event.text = QString::fromUtf8(text);
+        if (userId.size() == UserId::SIZE) {
+            event.userId = UserId(reinterpret_cast<const uint8_t*>(userId.constData()));
+        }
+        event.status = static_cast<Status>(status);
+        if (dateTime >= 0) {
+            event.dateTime = QDateTime::fromMSecsSinceEpoch(dateTime);
+        }
+        events << event;
+    }
+    return stream.status() == QDataStream::Ok;
+}
+
+CoreEventRecorder::CoreEventRecorder(const QString& path, QObject* parent) :
+    QObject(parent), file(path)
+{
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Core events can't be recorded to" << path;
+        return;
+    }
+    stream.setDevice(&file);
+    CoreEventLog::writeHeader(stream);
+    clock.start();
+}
+
+void CoreEventRecorder::record(const CoreEventBatch& events)
+{
+    // QFile buffers, the disk is only hit every few batches
+    if (file.isOpen() && !events.isEmpty()) {
+        CoreEventLog::writeBatch(stream, clock.nsecsElapsed() / 1000, events);
+    }
+}
+
+CoreEventReplayer::CoreEventReplayer(const QString& path, double speed, QObject* parent) :
+    QObject(parent), file(path), speed(speed), nextTime(0), batchCount(0), eventCount(0), maxLag(0)
+{
+    timer.setSingleShot(true);
+    timer.setTimerType(Qt::PreciseTimer);
+    connect(&timer, &QTimer::timeout, this, &CoreEventReplayer::replayNext);
+}
+
+void CoreEventReplayer::start()
+{
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Core events can't be replayed from" << file.fileName();
+        emit finished();
+        return;
+    }
+    stream.setDevice(&file);
+    if (!CoreEventLog::readHeader(stream)) {
+        qWarning() << file.fileName() << "isn't a recording of core events";
+        emit finished();
+        return;
+    }
+
+    clock.start();
+    scheduleNext();
+}
+
+void CoreEventReplayer::scheduleNext()
+{
+    nextBatch.clear();
+    if (stream.atEnd() || !CoreEventLog::readBatch(stream, nextTime, nextBatch)) {
+        qWarning("core event replay: %d batches with %d events in %lld ms, up to %lld ms behind schedule",
+                 batchCount, eventCount, clock.elapsed(), maxLag);
+        emit finished();
+        return;
+    }
+
+    const qint64 due = speed > 0 ? static_cast<qint64>(nextTime / 1000 / speed) : 0;
+    timer.start(qMax<qint64>(0, due - clock.elapsed()));
+}
+
+void CoreEventReplayer::replayNext()
+{
+    if (speed > 0) {
+        maxLag = qMax(maxLag, clock.elapsed() - static_cast<qint64>(nextTime / 1000 / speed));
+    }
+    batchCount++;
+    eventCount += nextBatch.size();
+
+    emit eventsReplayed(nextBatch);
+    scheduleNext();
+}
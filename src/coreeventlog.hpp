@@ -0,0 +1,113 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef COREEVENTLOG_HPP
+#define COREEVENTLOG_HPP
+
+#include "coreevent.hpp"
+
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QObject>
+#include <QTimer>
+
+// Captures the events the default profile gets from its Core, to play a real session back
+// into the GUI as often as it takes to profile it. Both are opt in through the environment:
+//
+//   TOX_RECORD_EVENTS=<file>       every drained CoreEventBatch is appended to the file, with
+//                                  the time since the recording started
+//   TOX_REPLAY_EVENTS=<file>       the default profile's Core isn't started, the batches of the
+//                                  file are fed to the Profile instead, under its own settings
+//                                  directory so the real profile's histories aren't touched
+//   TOX_REPLAY_SPEED=<factor>      how much faster than recorded, 0 replays without any pauses
+//
+// The file is a header, then per batch its time in µs and its events, with the texts in UTF-8.
+class CoreEventLog
+{
+public:
+    static const char* const RECORD_VARIABLE;
+    static const char* const REPLAY_VARIABLE;
+    static const char* const SPEED_VARIABLE;
+
+    // empty if not requested
+    static QString getRecordPath();
+    static QString getReplayPath();
+    static double getReplaySpeed();
+
+    static void writeHeader(QDataStream& stream);
+    // false if the stream isn't a log this version can read
+    static bool readHeader(QDataStream& stream);
+    static void writeBatch(QDataStream& stream, qint64 time, const CoreEventBatch& events);
+    static bool readBatch(QDataStream& stream, qint64& time, CoreEventBatch& events);
+
+private:
+    static const quint32 MAGIC = 0x54514556; // "TQEV"
+    static const quint32 FILE_VERSION = 1;
+
+};
+
+class CoreEventRecorder : public QObject
+{
+    Q_OBJECT
+public:
+    CoreEventRecorder(const QString& path, QObject* parent);
+
+    void record(const CoreEventBatch& events);
+
+private:
+    QFile file;
+    QDataStream stream;
+    QElapsedTimer clock;
+
+};
+
+class CoreEventReplayer : public QObject
+{
+    Q_OBJECT
+public:
+    CoreEventReplayer(const QString& path, double speed, QObject* parent);
+
+    void start();
+
+private:
+    QFile file;
+    QDataStream stream;
+    const double speed;
+    QElapsedTimer clock;
+    QTimer timer;
+
+    // read ahead, emitted once its time has come
+    qint64 nextTime;
+    CoreEventBatch nextBatch;
+
+    int batchCount;
+    int eventCount;
+    qint64 maxLag;
+
+    void scheduleNext();
+
+private slots:
+    void replayNext();
+
+signals:
+    void eventsReplayed(const CoreEventBatch& events);
+    void finished();
+
+};
+
+#endif // COREEVENTLOG_HPP
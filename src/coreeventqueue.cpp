@@ -0,0 +1,130 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "coreeventqueue.hpp"
+
+#include <QHash>
+
+#include <cstring>
+
+CoreEventRecord::CoreEventRecord(CoreEvent::Type type, int friendId) :
+    size(0), type(type), friendId(friendId), status(Status::Offline), flag(false), lastSeen(0), messageId(0), queuedAt(0), textSize(0)
+{
+    memset(userId, 0, sizeof(userId));
+}
+
+CoreEventQueue::CoreEventQueue() :
+    ring(new char[CAPACITY]), writePos(0), readPos(0), notified(0)
+{
+}
+
+CoreEventQueue::~CoreEventQueue()
+{
+    delete[] ring;
+}
+
+int CoreEventQueue::entrySize(int textSize)
+{
+    return (static_cast<int>(sizeof(CoreEventRecord)) + textSize + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+bool CoreEventQueue::push(const CoreEventRecord& record, const uint8_t* text, int textSize)
+{
+    const int size = entrySize(textSize);
+    int head = writePos.load();
+    const int tail = readPos.loadAcquire();
+    // a byte stays unused, otherwise a full ring would look like an empty one
+    int free = (tail - head - 1 + CAPACITY) % CAPACITY;
+
+    // entries don't wrap around, if it doesn't fit before the end of the ring it goes to the start
+    const int room = CAPACITY - head;
+    const bool wrap = size > room;
+    if (size + (wrap ? room : 0) > free) {
+        return false;
+    }
+    if (wrap) {
+        reinterpret_cast<CoreEventRecord*>(ring + head)->size = 0;
+        head = 0;
+    }
+
+    CoreEventRecord* entry = reinterpret_cast<CoreEventRecord*>(ring + head);
+    *entry = record;
+    entry->size = size;
+    entry->textSize = textSize;
+    if (textSize > 0) {
+        memcpy(ring + head + sizeof(CoreEventRecord), text, textSize);
+    }
+
+    writePos.storeRelease((head + size) % CAPACITY);
+    return true;
+}
+
+bool CoreEventQueue::shouldNotify()
+{
+    return writePos.load() != readPos.loadAcquire() && notified.testAndSetOrdered(0, 1);
+}
+
+void CoreEventQueue::drain(CoreEventBatch& events)
+{
+    // anything pushed from now on needs a new notification, it might be missed below
+    notified.fetchAndStoreOrdered(0);
+
+    // (event type, friendId) -> position in events, used to collapse superseded events
+    QHash<quint64, int> latest;
+
+    int tail = readPos.load();
+    const int head = writePos.loadAcquire();
+    while (tail != head) {
+        const CoreEventRecord* record = reinterpret_cast<const CoreEventRecord*>(ring + tail);
+        if (record->size == 0) {
+            tail = 0;
+            continue;
+        }
+
+        CoreEvent event(record->type, record->friendId);
+        event.status = record->status;
+        event.flag = record->flag;
+        event.messageId = record->messageId;
+        event.queuedAt = record->queuedAt;
+        if (record->textSize > 0) {
+            event.text = QString::fromUtf8(ring + tail + sizeof(CoreEventRecord), record->textSize);
+        }
+        if (record->type == CoreEvent::Type::FriendRequestReceived || record->type == CoreEvent::Type::FriendAdded) {
+            event.userId = UserId(record->userId);
+        }
+        if (record->lastSeen > 0) {
+            event.dateTime = QDateTime::fromTime_t(record->lastSeen);
+        }
+
+        if (event.isCollapsible()) {
+            const quint64 key = (static_cast<quint64>(event.type) << 32) | static_cast<quint32>(event.friendId);
+            QHash<quint64, int>::iterator it = latest.find(key);
+            if (it != latest.end()) {
+                // keep the later position so that the event is ordered after anything it followed
+                events[it.value()].type = CoreEvent::Type::Superseded;
+                it.value() = events.size();
+            } else {
+                latest.insert(key, events.size());
+            }
+        }
+        events << event;
+
+        tail = (tail + record->size) % CAPACITY;
+    }
+
+    readPos.storeRelease(tail);
+}
@@ -0,0 +1,80 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef COREEVENTQUEUE_HPP
+#define COREEVENTQUEUE_HPP
+
+#include "coreevent.hpp"
+
+#include <QAtomicInt>
+
+// What a toxcore callback records about an event, a plain struct that is copied
+// into CoreEventQueue's ring as is. The event's text follows it in the ring.
+struct CoreEventRecord
+{
+    quint32 size;       // of the whole entry, text and padding included, 0 marks the end of the used part of the ring
+    CoreEvent::Type type;
+    int friendId;
+    Status status;
+    bool flag;
+    uint8_t userId[UserId::SIZE];
+    qint64 lastSeen;    // seconds since the epoch, 0 if the event has none
+    quint32 messageId;
+    qint64 queuedAt;
+    quint32 textSize;   // bytes of UTF-8
+
+    CoreEventRecord(CoreEvent::Type type, int friendId);
+};
+
+// Hands events from Core's thread over to the GUI thread without taking locks or
+// allocating anything on Core's side, so that tox_do() stays short. Core pushes
+// records into a fixed ring buffer, the GUI thread turns them into CoreEvents when
+// it drains the ring, once per frame. Only one thread may push and only one may drain.
+class CoreEventQueue
+{
+public:
+    CoreEventQueue();
+    ~CoreEventQueue();
+
+    // Core's thread.
+    // Returns false if there is no room for the event, nothing is queued then
+    bool push(const CoreEventRecord& record, const uint8_t* text, int textSize);
+    // true once after events were pushed, until the next drain(), so the GUI thread is told only once
+    bool shouldNotify();
+
+    // GUI thread.
+    // Appends the queued events to events, an event superseded by a later one from the same drain is marked as such
+    void drain(CoreEventBatch& events);
+
+    static const int CAPACITY = 256 * 1024; // bytes
+
+private:
+    Q_DISABLE_COPY(CoreEventQueue)
+
+    static int entrySize(int textSize);
+
+    // entries start at multiples of this, the records need it
+    static const int ALIGNMENT = 8;
+
+    char* ring;
+    // offsets into ring, writePos is only changed by push(), readPos only by drain()
+    QAtomicInt writePos;
+    QAtomicInt readPos;
+    QAtomicInt notified;
+};
+
+#endif // COREEVENTQUEUE_HPP
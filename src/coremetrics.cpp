@@ -0,0 +1,253 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "coremetrics.hpp"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QFile>
+#include <QTextStream>
+
+CoreMetrics::CoreMetrics() :
+    timeToFirstConnection(-1), connected(false), connectCount(0), disconnectCount(0),
+    toxDoCount(0), toxDoTotalUsec(0), toxDoMaxUsec(0), toxDoHistogram(HISTOGRAM_BUCKETS, 0),
+    minInterval(-1), maxInterval(-1), totalInterval(0), intervalHistogram(HISTOGRAM_BUCKETS, 0),
+    powerSaving(false), powerSavingTime(0), powerSavingWakeups(0), stretchedCount(0), maxStretchedInterval(0)
+{
+}
+
+void CoreMetrics::start()
+{
+    startTime.start();
+}
+
+void CoreMetrics::recordConnected()
+{
+    if (timeToFirstConnection == -1 && startTime.isValid()) {
+        timeToFirstConnection = startTime.elapsed();
+    }
+    connected = true;
+    connectCount++;
+}
+
+void CoreMetrics::recordDisconnected()
+{
+    connected = false;
+    disconnectCount++;
+}
+
+void CoreMetrics::recordToxDo(qint64 durationUsec, int interval)
+{
+    toxDoCount++;
+    toxDoTotalUsec += durationUsec;
+    if (durationUsec > toxDoMaxUsec) {
+        toxDoMaxUsec = durationUsec;
+    }
+    toxDoHistogram[bucketFor(durationUsec)]++;
+
+    if (minInterval == -1 || interval < minInterval) {
+        minInterval = interval;
+    }
+    if (interval > maxInterval) {
+        maxInterval = interval;
+    }
+    totalInterval += interval;
+    intervalHistogram[bucketFor(interval)]++;
+
+    if (powerSaving) {
+        powerSavingWakeups++;
+    }
+}
+
+void CoreMetrics::setPowerSaving(bool enabled)
+{
+    if (powerSaving == enabled) {
+        return;
+    }
+
+    powerSaving = enabled;
+    if (enabled) {
+        powerSavingTimer.start();
+    } else {
+        powerSavingTime += powerSavingTimer.elapsed();
+    }
+}
+
+void CoreMetrics::recordStretchedInterval(int interval)
+{
+    stretchedCount++;
+    if (interval > maxStretchedInterval) {
+        maxStretchedInterval = interval;
+    }
+}
+
+bool CoreMetrics::isConnected() const
+{
+    return connected;
+}
+
+qint64 CoreMetrics::getTimeToFirstConnection() const
+{
+    return timeToFirstConnection;
+}
+
+int CoreMetrics::getConnectCount() const
+{
+    return connectCount;
+}
+
+int CoreMetrics::getReconnectCount() const
+{
+    return connectCount > 0 ? connectCount - 1 : 0;
+}
+
+int CoreMetrics::getDisconnectCount() const
+{
+    return disconnectCount;
+}
+
+quint64 CoreMetrics::getToxDoCount() const
+{
+    return toxDoCount;
+}
+
+qint64 CoreMetrics::getToxDoAverageUsec() const
+{
+    return toxDoCount > 0 ? toxDoTotalUsec / static_cast<qint64>(toxDoCount) : 0;
+}
+
+qint64 CoreMetrics::getToxDoMaxUsec() const
+{
+    return toxDoMaxUsec;
+}
+
+int CoreMetrics::getMinInterval() const
+{
+    return minInterval;
+}
+
+int CoreMetrics::getMaxInterval() const
+{
+    return maxInterval;
+}
+
+int CoreMetrics::getAverageInterval() const
+{
+    return toxDoCount > 0 ? static_cast<int>(totalInterval / static_cast<qint64>(toxDoCount)) : -1;
+}
+
+double CoreMetrics::getWakeupRate() const
+{
+    const qint64 uptime = startTime.isValid() ? startTime.elapsed() : 0;
+    return uptime > 0 ? toxDoCount * 1000.0 / uptime : 0;
+}
+
+qint64 CoreMetrics::getPowerSavingTime() const
+{
+    return powerSavingTime + (powerSaving ? powerSavingTimer.elapsed() : 0);
+}
+
+quint64 CoreMetrics::getPowerSavingWakeups() const
+{
+    return powerSavingWakeups;
+}
+
+double CoreMetrics::getPowerSavingWakeupRate() const
+{
+    const qint64 time = getPowerSavingTime();
+    return time > 0 ? powerSavingWakeups * 1000.0 / time : 0;
+}
+
+quint64 CoreMetrics::getStretchedCount() const
+{
+    return stretchedCount;
+}
+
+int CoreMetrics::getMaxStretchedInterval() const
+{
+    return maxStretchedInterval;
+}
+
+int CoreMetrics::bucketFor(qint64 value)
+{
+    int bucket = 0;
+    while (value > 0 && bucket < HISTOGRAM_BUCKETS - 1) {
+        value >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+QString CoreMetrics::histogramToString(const QVector<quint64>& histogram, const QString& unit)
+{
+    QString result;
+    for (int i = 0; i < histogram.size(); i ++) {
+        if (histogram[i] == 0) {
+            continue;
+        }
+        const qint64 lower = i == 0 ? 0 : (Q_INT64_C(1) << (i - 1));
+        if (i == histogram.size() - 1) {
+            result += QString("  >= %1 %2: %3\n").arg(lower).arg(unit).arg(histogram[i]);
+        } else {
+            result += QString("  %1-%2 %3: %4\n").arg(lower).arg((Q_INT64_C(1) << i) - 1).arg(unit).arg(histogram[i]);
+        }
+    }
+    return result;
+}
+
+QString CoreMetrics::toString() const
+{
+    QString result;
+    QTextStream out(&result);
+
+    out << "Uptime: " << (startTime.isValid() ? startTime.elapsed() : 0) << " ms\n";
+    out << "Connected: " << (connected ? "yes" : "no") << "\n";
+    if (timeToFirstConnection == -1) {
+        out << "Time to first connection: not connected yet\n";
+    } else {
+        out << "Time to first connection: " << timeToFirstConnection << " ms\n";
+    }
+    out << "Reconnects: " << getReconnectCount() << "\n";
+    out << "Disconnects: " << disconnectCount << "\n";
+    out << "\n";
+    out << "tox_do() calls: " << toxDoCount << "\n";
+    out << "tox_do() average: " << getToxDoAverageUsec() << " us, max: " << toxDoMaxUsec << " us\n";
+    out << histogramToString(toxDoHistogram, "us");
+    out << "\n";
+    out << "tox_do_interval() min: " << minInterval << " ms, max: " << maxInterval << " ms, average: " << getAverageInterval() << " ms\n";
+    out << histogramToString(intervalHistogram, "ms");
+    out << "\n";
+    out << "Wakeups: " << QString::number(getWakeupRate(), 'f', 1) << " per second\n";
+    out << "Power saving: " << getPowerSavingTime() << " ms, " << powerSavingWakeups << " wakeups, "
+        << QString::number(getPowerSavingWakeupRate(), 'f', 1) << " per second\n";
+    out << "Stretched intervals: " << stretchedCount << ", longest: " << maxStretchedInterval << " ms\n";
+
+    out.flush();
+    return result;
+}
+
+bool CoreMetrics::dumpToFile(const QString& filePath) const
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)) {
+        qWarning() << "File " << filePath << " cannot be opened";
+        return false;
+    }
+
+    QTextStream out(&file);
+    out << QDateTime::currentDateTime().toString(Qt::ISODate) << "\n" << toString() << "\n";
+    return true;
+}
@@ -0,0 +1,102 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef COREMETRICS_HPP
+#define COREMETRICS_HPP
+
+#include <QElapsedTimer>
+#include <QMetaType>
+#include <QString>
+#include <QVector>
+
+// Connection and event loop statistics collected by Core. It's a plain value,
+// Core hands out copies of it, so it's safe to read from any thread.
+class CoreMetrics
+{
+public:
+    CoreMetrics();
+
+    void start();
+    void recordConnected();
+    void recordDisconnected();
+    void recordToxDo(qint64 durationUsec, int interval);
+    // the time and the tox_do() wakeups while power saving are counted separately
+    void setPowerSaving(bool enabled);
+    // power saving waited for interval instead of what toxcore asked for
+    void recordStretchedInterval(int interval);
+
+    bool isConnected() const;
+
+    // in ms since start(), -1 if we haven't connected yet
+    qint64 getTimeToFirstConnection() const;
+    int getConnectCount() const;
+    int getReconnectCount() const;
+    int getDisconnectCount() const;
+
+    quint64 getToxDoCount() const;
+    qint64 getToxDoAverageUsec() const;
+    qint64 getToxDoMaxUsec() const;
+
+    int getMinInterval() const;
+    int getMaxInterval() const;
+    int getAverageInterval() const;
+
+    // tox_do() calls per second since start()
+    double getWakeupRate() const;
+    // in ms
+    qint64 getPowerSavingTime() const;
+    quint64 getPowerSavingWakeups() const;
+    double getPowerSavingWakeupRate() const;
+    quint64 getStretchedCount() const;
+    int getMaxStretchedInterval() const;
+
+    QString toString() const;
+    bool dumpToFile(const QString& filePath) const;
+
+    // bucket i counts values in [2^(i-1), 2^i) of their unit, the last bucket is open-ended
+    static const int HISTOGRAM_BUCKETS = 16;
+
+private:
+    static int bucketFor(qint64 value);
+    static QString histogramToString(const QVector<quint64>& histogram, const QString& unit);
+
+    QElapsedTimer startTime;
+    qint64 timeToFirstConnection;
+    bool connected;
+    int connectCount;
+    int disconnectCount;
+
+    quint64 toxDoCount;
+    qint64 toxDoTotalUsec;
+    qint64 toxDoMaxUsec;
+    QVector<quint64> toxDoHistogram;   // in us
+
+    int minInterval;
+    int maxInterval;
+    qint64 totalInterval;
+    QVector<quint64> intervalHistogram; // in ms
+
+    bool powerSaving;
+    QElapsedTimer powerSavingTimer;
+    qint64 powerSavingTime; // in ms, without the current stretch
+    quint64 powerSavingWakeups;
+    quint64 stretchedCount;
+    int maxStretchedInterval;
+};
+
+Q_DECLARE_METATYPE(CoreMetrics)
+
+#endif // COREMETRICS_HPP
@@ -0,0 +1,64 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "corethreadpool.hpp"
+#include "core.hpp"
+
+#include <QMetaObject>
+#include <QThread>
+
+CoreThreadPool::CoreThreadPool(int maxThreadCount, QObject* parent) :
+    QObject(parent), maxThreadCount(maxThreadCount > 0 ? maxThreadCount : 1)
+{
+}
+
+CoreThreadPool::~CoreThreadPool()
+{
+    shutdown();
+}
+
+void CoreThreadPool::start(Core* core)
+{
+    QThread* thread = nullptr;
+
+    if (threads.size() < maxThreadCount) {
+        thread = new QThread(this);
+        thread->start();
+        threads << thread;
+        load[thread] = 0;
+    } else {
+        thread = threads.first();
+        for (QThread* candidate : threads) {
+            if (load[candidate] < load[thread]) {
+                thread = candidate;
+            }
+        }
+    }
+
+    load[thread]++;
+    core->moveToThread(thread);
+    QMetaObject::invokeMethod(core, "start", Qt::QueuedConnection);
+}
+
+void CoreThreadPool::shutdown()
+{
+    for (QThread* thread : threads) {
+        thread->quit();
+    }
+    for (QThread* thread : threads) {
+        thread->wait();
+    }
+}
@@ -0,0 +1,48 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef CORETHREADPOOL_HPP
+#define CORETHREADPOOL_HPP
+
+#include <QHash>
+#include <QList>
+#include <QObject>
+
+class Core;
+class QThread;
+
+// A small set of threads shared by all Core instances. Core is entirely
+// event driven, so several of them can share a thread's event loop.
+class CoreThreadPool : public QObject
+{
+    Q_OBJECT
+public:
+    explicit CoreThreadPool(int maxThreadCount, QObject* parent = 0);
+    ~CoreThreadPool();
+
+    // moves core to the least loaded thread and starts it there
+    void start(Core* core);
+    // stops all threads, cores can be safely deleted after that
+    void shutdown();
+
+private:
+    int maxThreadCount;
+    QList<QThread*> threads;
+    QHash<QThread*, int> load;
+
+};
+
+#endif // CORETHREADPOOL_HPP
@@ -0,0 +1,166 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "daemon.hpp"
+#include "core.hpp"
+#include "corethreadpool.hpp"
+#include "profile.hpp"
+#include "Settings/settings.hpp"
+
+#include <csignal>
+#include <cstring>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QThread>
+
+#ifdef Q_OS_UNIX
+#include <cerrno>
+#include <QSocketNotifier>
+#include <sys/socket.h>
+#include <unistd.h>
+#else
+#include <QTimer>
+#endif
+
+const char* const Daemon::ARGUMENT = "--headless";
+
+#ifdef Q_OS_UNIX
+int Daemon::quitSignalFds[2] = {-1, -1};
+#else
+volatile std::sig_atomic_t Daemon::quitRequested = 0;
+#endif
+
+Daemon::Daemon(QObject* parent) :
+    QObject(parent), failedCores(0)
+{
+    qRegisterMetaType<Status>("Status");
+    qRegisterMetaType<FileTransferInfoList>("FileTransferInfoList");
+
+#ifdef Q_OS_UNIX
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, quitSignalFds) == 0) {
+        QSocketNotifier* quitNotifier = new QSocketNotifier(quitSignalFds[1], QSocketNotifier::Read, this);
+        connect(quitNotifier, &QSocketNotifier::activated, this, &Daemon::onQuitRequested);
+        std::signal(SIGINT, &Daemon::onQuitSignal);
+        std::signal(SIGTERM, &Daemon::onQuitSignal);
+    } else {
+        qWarning() << "Daemon: couldn't create a socket pair, SIGINT and SIGTERM quit without saving";
+    }
+#else
+    QTimer* quitPoll = new QTimer(this);
+    quitPoll->setInterval(QUIT_POLL_INTERVAL);
+    connect(quitPoll, &QTimer::timeout, this, &Daemon::onQuitRequested);
+    quitPoll->start();
+    std::signal(SIGINT, &Daemon::onQuitSignal);
+    std::signal(SIGTERM, &Daemon::onQuitSignal);
+#endif
+
+    corePool = new CoreThreadPool(QThread::idealThreadCount() > 1 ? 2 : 1, this);
+
+    QStringList profileNames = Settings::getInstance().getProfiles();
+    if (!profileNames.contains(Profile::DEFAULT_NAME)) {
+        profileNames.prepend(Profile::DEFAULT_NAME);
+    }
+    for (const QString& name : profileNames) {
+        addCore(name);
+    }
+}
+
+Daemon::~Daemon()
+{
+    // the Cores save their configurations when deleted, with their threads stopped
+    corePool->shutdown();
+    qDeleteAll(cores);
+
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+#ifdef Q_OS_UNIX
+    if (quitSignalFds[0] != -1) {
+        ::close(quitSignalFds[0]);
+        ::close(quitSignalFds[1]);
+        quitSignalFds[0] = quitSignalFds[1] = -1;
+    }
+#endif
+}
+
+bool Daemon::isRequested(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; i ++) {
+        if (std::strcmp(argv[i], ARGUMENT) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Daemon::addCore(const QString& profileName)
+{
+    const QString configFileName = Profile::getConfigFileName(profileName);
+    Core* core = new Core(configFileName, profileName == Profile::DEFAULT_NAME);
+    core->setLocalApiForced(true);
+    cores << core;
+
+    connect(core, &Core::eventsReady, this, &Daemon::onEventsReady);
+    connect(core, &Core::failedToStart, this, &Daemon::onFailedToStart);
+    corePool->start(core);
+}
+
+void Daemon::onQuitSignal(int /*signal*/)
+{
+    // nothing that allocates or locks in here, the handler may interrupt either
+#ifdef Q_OS_UNIX
+    const int savedErrno = errno;
+    const char byte = 1;
+    if (::write(quitSignalFds[0], &byte, sizeof(byte)) < 0) {
+        // the socket is full, a quit is on its way already
+    }
+    errno = savedErrno;
+#else
+    quitRequested = 1;
+#endif
+}
+
+void Daemon::onQuitRequested()
+{
+#ifdef Q_OS_UNIX
+    char byte;
+    if (::read(quitSignalFds[1], &byte, sizeof(byte)) <= 0) {
+        return;
+    }
+#else
+    if (!quitRequested) {
+        return;
+    }
+#endif
+    QCoreApplication::quit();
+}
+
+void Daemon::onEventsReady()
+{
+    // nobody shows the events, but the queue must be drained for the Core to keep queueing
+    Core* core = static_cast<Core*>(sender());
+    CoreEventBatch events;
+    core->getEventQueue()->drain(events);
+}
+
+void Daemon::onFailedToStart()
+{
+    qWarning() << "Daemon: a core failed to start";
+    // the Core stays on its thread until we're destroyed, there is just nothing left to do once all of them failed
+    failedCores++;
+    if (failedCores == cores.size()) {
+        QCoreApplication::exit(1);
+    }
+}
@@ -0,0 +1,66 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef DAEMON_HPP
+#define DAEMON_HPP
+
+#include <QList>
+#include <QObject>
+
+#include <csignal>
+
+class Core;
+class CoreThreadPool;
+
+// Runs the profiles' Cores without any widgets, under a QCoreApplication.
+// Messages are sent through each Core's IpcServer, which is always on here.
+class Daemon : public QObject
+{
+    Q_OBJECT
+public:
+    explicit Daemon(QObject* parent = 0);
+    ~Daemon();
+
+    static const char* const ARGUMENT;
+    // checked before any application object exists, to decide which one to create
+    static bool isRequested(int argc, char* argv[]);
+
+private:
+    CoreThreadPool* corePool;
+    QList<Core*> cores;
+    int failedCores;
+
+    void addCore(const QString& profileName);
+    // SIGINT and SIGTERM, only tells onQuitRequested() on the event loop
+    static void onQuitSignal(int signal);
+
+#ifdef Q_OS_UNIX
+    // the handler writes a byte into the first, a QSocketNotifier on the second calls onQuitRequested()
+    static int quitSignalFds[2];
+#else
+    // no socket pairs there, the flag is polled instead
+    static volatile std::sig_atomic_t quitRequested;
+    static const int QUIT_POLL_INTERVAL = 200; // ms
+#endif
+
+private slots:
+    void onQuitRequested();
+    void onEventsReady();
+    void onFailedToStart();
+
+};
+
+#endif // DAEMON_HPP
@@ -0,0 +1,122 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "delayedwriter.hpp"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QRunnable>
+#include <QSaveFile>
+
+namespace {
+
+class FileWriter : public QRunnable
+{
+public:
+    FileWriter(const QString& filePath, const QByteArray& data, bool replace, const QString& description) :
+        filePath(filePath), data(data), replace(replace), description(description)
+    {
+    }
+
+    void run()
+    {
+        QDir().mkpath(QFileInfo(filePath).absolutePath());
+        bool success;
+        if (replace) {
+            QSaveFile file(filePath);
+            success = file.open(QIODevice::WriteOnly) && file.write(data) == data.size() && file.commit();
+        } else {
+            QFile file(filePath);
+            success = file.open(QIODevice::WriteOnly | QIODevice::Append) && file.write(data) == data.size();
+        }
+        if (!success) {
+            qWarning() << description << filePath << "cannot be written";
+        }
+    }
+
+private:
+    const QString filePath;
+    const QByteArray data;
+    const bool replace;
+    const QString description;
+};
+
+}
+
+DelayedWriter::DelayedWriter(const QString& filePath, int delay, const QString& description, QObject* parent) :
+    QObject(parent),
+    filePath(filePath),
+    description(description)
+{
+    timer.setSingleShot(true);
+    timer.setInterval(delay);
+    connect(&timer, &QTimer::timeout, this, &DelayedWriter::due);
+
+    // a single thread keeps the writes in order
+    writer.setMaxThreadCount(1);
+}
+
+DelayedWriter::~DelayedWriter()
+{
+    writer.waitForDone();
+}
+
+void DelayedWriter::schedule()
+{
+    if (!timer.isActive()) {
+        timer.start();
+    }
+}
+
+bool DelayedWriter::isScheduled() const
+{
+    return timer.isActive();
+}
+
+void DelayedWriter::flush()
+{
+    if (timer.isActive()) {
+        timer.stop();
+        emit due();
+    }
+}
+
+void DelayedWriter::replace(const QByteArray& data)
+{
+    timer.stop();
+    writer.start(new FileWriter(filePath, data, true, description));
+}
+
+void DelayedWriter::append(const QByteArray& data)
+{
+    timer.stop();
+    writer.start(new FileWriter(filePath, data, false, description));
+}
+
+void DelayedWriter::remove()
+{
+    timer.stop();
+    writer.waitForDone();
+    QFile::remove(filePath);
+}
+
+void DelayedWriter::waitForDone()
+{
+    writer.waitForDone();
+}
@@ -0,0 +1,65 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef DELAYEDWRITER_HPP
+#define DELAYEDWRITER_HPP
+
+#include <QByteArray>
+#include <QObject>
+#include <QThreadPool>
+#include <QTimer>
+
+// Writes a file of its owner on a thread of its own, a while after the owner reported a change,
+// so that a burst of changes results in a single write. The owner serializes its state in a slot
+// connected to due(), on its own thread, and passes the bytes to replace() or append(); the
+// thread only puts them on disk. Writes are done one at a time in the order they were made, and
+// a replaced file is never seen half written.
+class DelayedWriter : public QObject
+{
+    Q_OBJECT
+public:
+    // what is logged when a write fails
+    DelayedWriter(const QString& filePath, int delay, const QString& description, QObject* parent = 0);
+    // waits for the writes in progress, the owner calls flush() first if it wants the last change kept
+    ~DelayedWriter();
+
+    // due() is emitted once delay passed, unless it's scheduled already
+    void schedule();
+    bool isScheduled() const;
+    // emits due() right away if it's scheduled
+    void flush();
+
+    // these cancel the schedule, the owner just took its snapshot
+    void replace(const QByteArray& data);
+    void append(const QByteArray& data);
+    // waits for the writes in progress and removes the file
+    void remove();
+
+    void waitForDone();
+
+signals:
+    void due();
+
+private:
+    const QString filePath;
+    const QString description;
+    QTimer timer;
+    QThreadPool writer;
+
+};
+
+#endif // DELAYEDWRITER_HPP
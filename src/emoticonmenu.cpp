@@ -16,80 +16,119 @@
 
 #include "emoticonmenu.hpp"
 
-#include <QGridLayout>
-#include <QToolButton>
+#include <QListView>
+#include <QScrollBar>
+#include <QStandardItemModel>
 #include <QWidgetAction>
 
 #include "smileypack.hpp"
 #include "Settings/settings.hpp"
 
-EmoticonMenu::EmoticonMenu(QWidget *parent) :
-    QMenu(parent)
-{
-    action              = new QWidgetAction(this);
-    actionDefaultWidget = new QWidget(this);
-    layout              = new QGridLayout(actionDefaultWidget);
-    updateEmoticons();
+namespace {
+QStandardItemModel *sharedModel = nullptr;
+bool sharedModelDirty = true;
 
-    connect(&Settings::getInstance(), &Settings::smileyPackChanged, this, &EmoticonMenu::updateEmoticons);
-    connect(&Settings::getInstance(), &Settings::emojiFontChanged, this, &EmoticonMenu::updateEmoticons);
+void fillModel(QStandardItemModel *model)
+{
+    std::shared_ptr<const Settings::Snapshot> settings = Settings::getInstance().snapshot();
+    QSharedPointer<const Smileypack> pack = Smileypack::current();
+
+    QFont font;
+    font.setPixelSize(16);
+    if (pack->isEmoji() && settings->customEmojiFont)
+        font.setFamily(settings->emojiFontFamily);
+
+    model->clear();
+    for (const auto& pair : pack->getList()) {
+        const QString &imgPath = pair.first;
+        QStandardItem *item = new QStandardItem;
+        if (pack->isEmoji()) {
+            item->setText(imgPath);
+            item->setFont(font);
+            item->setTextAlignment(Qt::AlignCenter);
+            item->setData(settings->customEmojiFont ? Smileypack::resizeEmoji(imgPath) : imgPath, EmoticonMenu::SmileyRole);
+        }
+        else {
+            // QIcon only reads the file when the item is painted
+            item->setIcon(QIcon(imgPath));
+            item->setData(QString("<img src=\"%1\" />").arg(imgPath), EmoticonMenu::SmileyRole);
+        }
+        if (!pair.second.isEmpty())
+            item->setToolTip(pair.second.first());
+        item->setEditable(false);
+        model->appendRow(item);
+    }
+}
 }
 
-void EmoticonMenu::updateEmoticons()
+EmoticonMenu::EmoticonMenu(QWidget *parent) :
+    QMenu(parent),
+    action(nullptr),
+    view(nullptr)
 {
-    // Delete old menu
-    action->deleteLater();
-    actionDefaultWidget->deleteLater();
-    layout->deleteLater();
-
-    // Create new menu
-    action = new QWidgetAction(this);
-    actionDefaultWidget = new QWidget(this);
-    layout = new QGridLayout(actionDefaultWidget);
-    layout->setMargin(1);
-    layout->setSpacing(0);
-    action->setDefaultWidget(actionDefaultWidget);
-    addAction(action);
-
-    // Add new pack
-    Smileypack pack(Settings::getInstance().getSmileyPack());
-    for (const auto& pair : pack.getList()) {
-        addEmoticon(pair.first, pair.second, pack.isEmoji());
-    }
+    // Nothing is built until the menu opens for the first time
+    connect(this, &EmoticonMenu::aboutToShow, this, &EmoticonMenu::createGrid);
 }
 
-void EmoticonMenu::addEmoticon(const QString &imgPath, const QStringList &texts, bool isEmoji)
+QStandardItemModel *EmoticonMenu::emoticonModel()
 {
-    Settings &settings = Settings::getInstance();
-
-    QToolButton *button = new QToolButton(this);
-    if (isEmoji) {
-        QFont font;
-        font.setPixelSize(16);
-        if (settings.isCurstomEmojiFont()) {
-            font.setFamily(settings.getEmojiFontFamily());
-            button->setProperty("smiley", Smileypack::resizeEmoji(imgPath));
-        } else {
-            button->setProperty("smiley", imgPath);
-        }
-        button->setFont(font);
-        button->setText(imgPath);
+    if (!sharedModel) {
+        sharedModel = new QStandardItemModel(&Settings::getInstance());
+        auto invalidate = [] { sharedModelDirty = true; };
+        QObject::connect(&Settings::getInstance(), &Settings::smileyPackChanged, sharedModel, invalidate);
+        QObject::connect(&Settings::getInstance(), &Settings::smileyPackUpdated, sharedModel, invalidate);
+        QObject::connect(&Settings::getInstance(), &Settings::emojiFontChanged, sharedModel, invalidate);
     }
-    else {
-        button->setIcon(QIcon(imgPath));
-        button->setProperty("smiley", QString("<img src=\"%1\" />").arg(imgPath));
+    if (sharedModelDirty) {
+        fillModel(sharedModel);
+        sharedModelDirty = false;
     }
-    button->setAutoRaise(true);
-    button->setToolTip(texts.first());
+    return sharedModel;
+}
 
-    connect(button, &QToolButton::clicked, this, &EmoticonMenu::onEmoticonTriggered);
-    connect(button, &QToolButton::clicked, this, &EmoticonMenu::close);
+void EmoticonMenu::createGrid()
+{
+    QStandardItemModel *model = emoticonModel();
+
+    if (!view) {
+        view = new QListView(this);
+        view->setViewMode(QListView::IconMode);
+        view->setMovement(QListView::Static);
+        view->setResizeMode(QListView::Adjust);
+        view->setUniformItemSizes(true);
+        view->setGridSize(QSize(EMOTICON_CELL_SIZE, EMOTICON_CELL_SIZE));
+        view->setIconSize(QSize(16, 16));
+        view->setSpacing(0);
+        view->setFrameShape(QFrame::NoFrame);
+        view->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+        view->setMouseTracking(true);
+        view->setAttribute(Qt::WA_Hover);
+        view->setModel(model);
+        connect(view, &QListView::clicked, this, &EmoticonMenu::onEmoticonTriggered);
+
+        action = new QWidgetAction(this);
+        action->setDefaultWidget(view);
+        addAction(action);
+    }
 
-    layout->addWidget(button, layout->count() / EMOTICONS_IN_A_ROW, layout->count() % EMOTICONS_IN_A_ROW);
+    // Show every row up to a limit, scroll beyond it
+    int rows = (model->rowCount() + EMOTICONS_IN_A_ROW - 1) / EMOTICONS_IN_A_ROW;
+    int height = qBound(1, rows, int(MAX_VISIBLE_ROWS)) * EMOTICON_CELL_SIZE;
+    int width = EMOTICONS_IN_A_ROW * EMOTICON_CELL_SIZE;
+    if (rows > MAX_VISIBLE_ROWS)
+        width += view->verticalScrollBar()->sizeHint().width();
+    QSize size(width + 2, height + 2);
+    if (view->size() != size) {
+        view->setFixedSize(size);
+        // Re-adding the action makes the menu lay out the resized grid
+        removeAction(action);
+        addAction(action);
+    }
 }
 
 /*! Signal sends the (first) textual form of the clicked smiley. */
-void EmoticonMenu::onEmoticonTriggered()
+void EmoticonMenu::onEmoticonTriggered(const QModelIndex &index)
 {
-    emit insertEmoticon("&nbsp;"+QObject::sender()->property("smiley").toString()+"&nbsp;");
+    emit insertEmoticon("&nbsp;"+index.data(SmileyRole).toString()+"&nbsp;");
+    close();
 }
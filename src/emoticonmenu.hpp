@@ -19,11 +19,14 @@
 
 #include <QMenu>
 
-class QGridLayout;
+class QListView;
+class QModelIndex;
+class QStandardItemModel;
 class QWidgetAction;
 
 /*! This Class represents a menu with all smileys for adding into text input field.
- * And it holds a hash of the smileys for translating image to text.
+ * The smileys are kept in one model shared by all menus, which is filled the first time
+ * any menu opens and refilled on the next opening after the pack or emoji font changed.
  */
 class EmoticonMenu : public QMenu
 {
@@ -31,23 +34,27 @@ class EmoticonMenu : public QMenu
 public:
     explicit EmoticonMenu(QWidget *parent = 0);
 
-public slots:
-    void updateEmoticons();
+    enum Roles {
+        SmileyRole = Qt::UserRole  //!< The HTML inserted into the input field
+    };
 
-private:
-    void addEmoticon(const QString &imgPath, const QStringList &texts, bool isEmoji = false);
+    //! The smileys of the current pack, up to date
+    static QStandardItemModel *emoticonModel();
 
-    QGridLayout *layout;
+private:
     QWidgetAction *action;
-    QWidget* actionDefaultWidget;
+    QListView *view;
 
     const static int EMOTICONS_IN_A_ROW = 5;
-    
+    const static int EMOTICON_CELL_SIZE = 24;
+    const static int MAX_VISIBLE_ROWS = 10;
+
 signals:
     void insertEmoticon(QString);
 
 private slots:
-    void onEmoticonTriggered();
+    void createGrid();
+    void onEmoticonTriggered(const QModelIndex &index);
 
 };
 
@@ -0,0 +1,782 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "faketox.hpp"
+
+#include <tox/toxav.h>
+
+#include <cstring>
+
+#include <QDateTime>
+#include <QFile>
+#include <QStringList>
+#include <QTextStream>
+
+const char* const FakeTox::SCRIPT_VARIABLE = "TOX_FAKE_SCRIPT";
+
+struct Tox
+{
+    FakeTox fake;
+};
+
+FakeTox::FakeTox() :
+    status(TOX_USERSTATUS_NONE), connected(false), lastMessageId(0),
+    onFriendRequest(nullptr), friendRequestData(nullptr), onFriendMessage(nullptr), friendMessageData(nullptr),
+    onFriendAction(nullptr), friendActionData(nullptr), onNameChange(nullptr), nameChangeData(nullptr),
+    onStatusMessage(nullptr), statusMessageData(nullptr), onUserStatus(nullptr), userStatusData(nullptr),
+    onTypingChange(nullptr), typingChangeData(nullptr), onConnectionStatus(nullptr), connectionStatusData(nullptr),
+    onReadReceipt(nullptr), readReceiptData(nullptr),
+    currentStep(0), stepStarted(false), stepStart(0), delivered(0), maxLag(0), seed(1)
+{
+    for (int i = 0; i < TOX_CLIENT_ID_SIZE; i++) {
+        publicKey.append(char(random()));
+        secretKey.append(char(random()));
+    }
+
+    loadScript();
+    clock.start();
+}
+
+quint32 FakeTox::random()
+{
+    // an LCG is plenty for picking friends, and the same on every platform
+    seed = seed * 1103515245 + 12345;
+    return seed >> 16;
+}
+
+int FakeTox::randomFriend()
+{
+    return friends.isEmpty() ? -1 : int(random() % friends.size());
+}
+
+bool FakeTox::isFriend(int32_t friendId) const
+{
+    return friendId >= 0 && friendId < friends.size() && !friends[friendId].clientId.isEmpty();
+}
+
+void FakeTox::addFriends(int count)
+{
+    for (int i = 0; i < count; i++) {
+        Friend f;
+        for (int j = 0; j < TOX_CLIENT_ID_SIZE; j++) {
+            f.clientId.append(char(random()));
+        }
+        f.name = QString("Friend %1").arg(friends.size()).toUtf8();
+        f.statusMessage = QString("Status message of friend %1").arg(friends.size()).toUtf8();
+        f.status = TOX_USERSTATUS_NONE;
+        f.online = false;
+        f.lastOnline = 0;
+        friends << f;
+    }
+    typing.resize(friends.size());
+}
+
+void FakeTox::loadScript()
+{
+    const QString path = QString::fromLocal8Bit(qgetenv(SCRIPT_VARIABLE));
+    QFile file(path);
+    if (path.isEmpty() || !file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        // a bit of everything
+        static const char* const defaultScript[] = {
+            "friends 1000", "connect", "wait 1000", "messages 100 5000", "statusflaps 200 5000",
+            "typing 500 5000", "reconnects 1 3000", "wait 2000"
+        };
+        qWarning("fake tox: %s isn't set or can't be read, running the default script", SCRIPT_VARIABLE);
+        for (const char* line : defaultScript) {
+            parseLine(line);
+        }
+        return;
+    }
+
+    QTextStream stream(&file);
+    int lineNumber = 0;
+    while (!stream.atEnd()) {
+        lineNumber++;
+        if (!parseLine(stream.readLine())) {
+            qWarning("fake tox: can't parse line %d of %s", lineNumber, qPrintable(path));
+        }
+    }
+}
+
+bool FakeTox::parseLine(const QString& line)
+{
+    const QStringList words = line.section('#', 0, 0).split(' ', QString::SkipEmptyParts);
+    if (words.isEmpty()) {
+        return true;
+    }
+
+    Step step;
+    step.name = words[0];
+    step.rate = 0;
+    step.duration = 0;
+
+    bool ok = true;
+    if (step.name == "friends" && words.size() == 2) {
+        addFriends(words[1].toInt(&ok));
+        return ok;
+    } else if (step.name == "connect" && words.size() == 1) {
+        step.kind = Step::Connect;
+    } else if (step.name == "disconnect" && words.size() == 1) {
+        step.kind = Step::Disconnect;
+    } else if (step.name == "wait" && words.size() == 2) {
+        step.kind = Step::Wait;
+        step.duration = words[1].toLongLong(&ok);
+    } else if (words.size() == 3) {
+        if (step.name == "messages") {
+            step.kind = Step::Messages;
+        } else if (step.name == "statusflaps") {
+            step.kind = Step::StatusFlaps;
+        } else if (step.name == "typing") {
+            step.kind = Step::Typing;
+        } else if (step.name == "reconnects") {
+            step.kind = Step::Reconnects;
+        } else {
+            return false;
+        }
+        bool durationOk;
+        step.rate = words[1].toDouble(&ok);
+        step.duration = words[2].toLongLong(&durationOk);
+        ok = ok && durationOk && step.rate > 0;
+    } else {
+        return false;
+    }
+
+    if (ok) {
+        script << step;
+    }
+    return ok;
+}
+
+void FakeTox::startStep()
+{
+    stepStarted = true;
+    stepStart = clock.elapsed();
+    delivered = 0;
+    maxLag = 0;
+}
+
+void FakeTox::finishStep()
+{
+    const Step& step = script[currentStep];
+    if (step.rate > 0) {
+        qWarning("fake tox: %s delivered %lld events in %lld ms, up to %lld ms behind schedule",
+                 qPrintable(step.name), delivered, clock.elapsed() - stepStart, maxLag);
+    }
+
+    currentStep++;
+    stepStarted = false;
+}
+
+void FakeTox::process(Tox* tox)
+{
+    // Core may have added friends since
+    typing.resize(friends.size());
+
+    for (const QPair<int32_t, uint32_t>& message : unconfirmed) {
+        if (onReadReceipt && isFriend(message.first)) {
+            onReadReceipt(tox, message.first, message.second, readReceiptData);
+        }
+    }
+    unconfirmed.clear();
+
+    while (currentStep < script.size()) {
+        if (!stepStarted) {
+            startStep();
+        }
+
+        const Step& step = script[currentStep];
+        const qint64 now = clock.elapsed() - stepStart;
+
+        switch (step.kind) {
+            case Step::Connect:
+            case Step::Disconnect:
+                connected = step.kind == Step::Connect;
+                for (int i = 0; i < friends.size(); i++) {
+                    if (isFriend(i)) {
+                        setFriendOnline(tox, i, connected);
+                    }
+                }
+                finishStep();
+                continue;
+            case Step::Wait:
+                if (now < step.duration) {
+                    return;
+                }
+                finishStep();
+                continue;
+            default:
+                break;
+        }
+
+        const qint64 total = qint64(step.rate * step.duration / 1000);
+        const qint64 due = qMin(total, qint64(step.rate * now / 1000));
+        for (int i = 0; delivered < due && i < MAX_EVENTS_PER_ITERATION; i++) {
+            const qint64 scheduledTime = qint64(delivered * 1000 / step.rate);
+            maxLag = qMax(maxLag, now - scheduledTime);
+            runEvent(tox, step, stepStart + scheduledTime);
+            delivered++;
+        }
+
+        if (delivered < total || now < step.duration) {
+            return;
+        }
+        finishStep();
+    }
+}
+
+void FakeTox::runEvent(Tox* tox, const Step& step, qint64 scheduledTime)
+{
+    const int friendId = randomFriend();
+    if (!isFriend(friendId)) {
+        return;
+    }
+    Friend& f = friends[friendId];
+
+    switch (step.kind) {
+        case Step::Messages: {
+            if (!f.online) {
+                break;
+            }
+            QByteArray text = QString("message %1 scheduled at %2 ms").arg(delivered).arg(scheduledTime).toUtf8();
+            if (delivered % 10 == 0) {
+                // long enough to wrap and be searched through
+                text += QByteArray(" lorem ipsum dolor sit amet").repeated(30);
+            }
+            text.truncate(TOX_MAX_MESSAGE_LENGTH);
+            if (onFriendMessage) {
+                onFriendMessage(tox, friendId, reinterpret_cast<const uint8_t*>(text.constData()), text.size(), friendMessageData);
+            }
+            break;
+        }
+        case Step::StatusFlaps:
+            if (random() % 2 == 0) {
+                setFriendOnline(tox, friendId, !f.online);
+            } else if (f.online) {
+                f.status = (f.status + 1) % TOX_USERSTATUS_INVALID;
+                if (onUserStatus) {
+                    onUserStatus(tox, friendId, f.status, userStatusData);
+                }
+            }
+            break;
+        case Step::Typing:
+            if (f.online) {
+                typing[friendId] = !typing[friendId];
+                if (onTypingChange) {
+                    onTypingChange(tox, friendId, typing[friendId], typingChangeData);
+                }
+            }
+            break;
+        case Step::Reconnects:
+            for (int i = 0; i < friends.size(); i++) {
+                if (isFriend(i) && friends[i].online) {
+                    setFriendOnline(tox, i, false);
+                    setFriendOnline(tox, i, true);
+                }
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void FakeTox::setFriendOnline(Tox* tox, int friendId, bool online)
+{
+    Friend& f = friends[friendId];
+    if (f.online == online) {
+        return;
+    }
+
+    f.online = online;
+    if (!online) {
+        f.lastOnline = uint64_t(QDateTime::currentDateTimeUtc().toTime_t());
+        typing[friendId] = false;
+    }
+    if (onConnectionStatus) {
+        onConnectionStatus(tox, friendId, online, connectionStatusData);
+    }
+}
+
+uint32_t FakeTox::interval() const
+{
+    if (currentStep < script.size() && script[currentStep].rate > 0) {
+        return ACTIVE_INTERVAL;
+    }
+    return IDLE_INTERVAL;
+}
+
+// The toxcore API, as far as Core and the managers use it
+
+namespace {
+uint16_t copyOut(const QByteArray& data, uint8_t* out, uint32_t maxLength = UINT32_MAX)
+{
+    const uint32_t length = qMin<uint32_t>(data.size(), maxLength);
+    memcpy(out, data.constData(), length);
+    return length;
+}
+}
+
+Tox* tox_new(Tox_Options*/* options*/)
+{
+    return new Tox();
+}
+
+void tox_kill(Tox* tox)
+{
+    delete tox;
+}
+
+void tox_do(Tox* tox)
+{
+    tox->fake.process(tox);
+}
+
+uint32_t tox_do_interval(Tox* tox)
+{
+    return tox->fake.interval();
+}
+
+int tox_isconnected(const Tox* tox)
+{
+    return tox->fake.connected;
+}
+
+int tox_bootstrap_from_address(Tox*/* tox*/, const char*/* address*/, uint16_t/* port*/, const uint8_t*/* public_key*/)
+{
+    return 1;
+}
+
+int tox_add_tcp_relay(Tox*/* tox*/, const char*/* address*/, uint16_t/* port*/, const uint8_t*/* public_key*/)
+{
+    return 1;
+}
+
+// nothing is saved, a fake run must not overwrite a real profile
+uint32_t tox_size(const Tox*/* tox*/)
+{
+    return 0;
+}
+
+void tox_save(const Tox*/* tox*/, uint8_t*/* data*/)
+{
+}
+
+int tox_load(Tox*/* tox*/, const uint8_t*/* data*/, uint32_t/* length*/)
+{
+    return 0;
+}
+
+void tox_get_address(const Tox* tox, uint8_t* address)
+{
+    memset(address, 0, TOX_FRIEND_ADDRESS_SIZE);
+    copyOut(tox->fake.publicKey, address);
+}
+
+void tox_get_keys(Tox* tox, uint8_t* public_key, uint8_t* secret_key)
+{
+    copyOut(tox->fake.publicKey, public_key);
+    copyOut(tox->fake.secretKey, secret_key);
+}
+
+int32_t tox_add_friend(Tox* tox, const uint8_t* address, const uint8_t*/* data*/, uint16_t/* length*/)
+{
+    return tox_add_friend_norequest(tox, address);
+}
+
+int32_t tox_add_friend_norequest(Tox* tox, const uint8_t* client_id)
+{
+    FakeTox::Friend f;
+    f.clientId = QByteArray(reinterpret_cast<const char*>(client_id), TOX_CLIENT_ID_SIZE);
+    f.status = TOX_USERSTATUS_NONE;
+    f.online = false;
+    f.lastOnline = 0;
+    tox->fake.friends << f;
+    return tox->fake.friends.size() - 1;
+}
+
+int tox_del_friend(Tox* tox, int32_t friendnumber)
+{
+    if (!tox->fake.isFriend(friendnumber)) {
+        return -1;
+    }
+    tox->fake.friends[friendnumber] = FakeTox::Friend();
+    return 0;
+}
+
+int tox_get_client_id(const Tox* tox, int32_t friendnumber, uint8_t* client_id)
+{
+    if (!tox->fake.isFriend(friendnumber)) {
+        return -1;
+    }
+    copyOut(tox->fake.friends[friendnumber].clientId, client_id);
+    return 0;
+}
+
+int tox_friend_exists(const Tox* tox, int32_t friendnumber)
+{
+    return tox->fake.isFriend(friendnumber);
+}
+
+uint32_t tox_count_friendlist(const Tox* tox)
+{
+    uint32_t count = 0;
+    for (int i = 0; i < tox->fake.friends.size(); i++) {
+        count += tox->fake.isFriend(i);
+    }
+    return count;
+}
+
+uint32_t tox_get_friendlist(const Tox* tox, int32_t* out_list, uint32_t list_size)
+{
+    uint32_t count = 0;
+    for (int i = 0; i < tox->fake.friends.size() && count < list_size; i++) {
+        if (tox->fake.isFriend(i)) {
+            out_list[count++] = i;
+        }
+    }
+    return count;
+}
+
+uint32_t tox_send_message(Tox* tox, int32_t friendnumber, const uint8_t*/* message*/, uint32_t/* length*/)
+{
+    if (!tox->fake.isFriend(friendnumber) || !tox->fake.friends[friendnumber].online) {
+        return 0;
+    }
+    tox->fake.unconfirmed << qMakePair(friendnumber, ++tox->fake.lastMessageId);
+    return tox->fake.lastMessageId;
+}
+
+uint32_t tox_send_action(Tox* tox, int32_t friendnumber, const uint8_t* action, uint32_t length)
+{
+    return tox_send_message(tox, friendnumber, action, length);
+}
+
+int tox_set_user_is_typing(Tox* tox, int32_t friendnumber, uint8_t/* is_typing*/)
+{
+    return tox->fake.isFriend(friendnumber) ? 0 : -1;
+}
+
+int tox_set_name(Tox* tox, const uint8_t* name, uint16_t length)
+{
+    tox->fake.name = QByteArray(reinterpret_cast<const char*>(name), length);
+    return 0;
+}
+
+int tox_get_self_name_size(const Tox* tox)
+{
+    return tox->fake.name.size();
+}
+
+uint16_t tox_get_self_name(const Tox* tox, uint8_t* name)
+{
+    return copyOut(tox->fake.name, name);
+}
+
+int tox_get_name_size(const Tox* tox, int32_t friendnumber)
+{
+    return tox->fake.isFriend(friendnumber) ? tox->fake.friends[friendnumber].name.size() : -1;
+}
+
+int tox_get_name(const Tox* tox, int32_t friendnumber, uint8_t* name)
+{
+    return tox->fake.isFriend(friendnumber) ? copyOut(tox->fake.friends[friendnumber].name, name) : -1;
+}
+
+int tox_set_status_message(Tox* tox, const uint8_t* status, uint16_t length)
+{
+    tox->fake.statusMessage = QByteArray(reinterpret_cast<const char*>(status), length);
+    return 0;
+}
+
+int tox_set_user_status(Tox* tox, uint8_t userstatus)
+{
+    tox->fake.status = userstatus;
+    return 0;
+}
+
+int tox_get_self_status_message_size(const Tox* tox)
+{
+    return tox->fake.statusMessage.size();
+}
+
+int tox_get_self_status_message(const Tox* tox, uint8_t* buf, uint32_t maxlen)
+{
+    return copyOut(tox->fake.statusMessage, buf, maxlen);
+}
+
+int tox_get_status_message_size(const Tox* tox, int32_t friendnumber)
+{
+    return tox->fake.isFriend(friendnumber) ? tox->fake.friends[friendnumber].statusMessage.size() : -1;
+}
+
+int tox_get_status_message(const Tox* tox, int32_t friendnumber, uint8_t* buf, uint32_t maxlen)
+{
+    return tox->fake.isFriend(friendnumber) ? copyOut(tox->fake.friends[friendnumber].statusMessage, buf, maxlen) : -1;
+}
+
+uint64_t tox_get_last_online(const Tox* tox, int32_t friendnumber)
+{
+    return tox->fake.isFriend(friendnumber) ? tox->fake.friends[friendnumber].lastOnline : 0;
+}
+
+void tox_callback_friend_request(Tox* tox, void (*function)(Tox*, const uint8_t*, const uint8_t*, uint16_t, void*), void* userdata)
+{
+    tox->fake.onFriendRequest = function;
+    tox->fake.friendRequestData = userdata;
+}
+
+void tox_callback_friend_message(Tox* tox, void (*function)(Tox*, int32_t, const uint8_t*, uint16_t, void*), void* userdata)
+{
+    tox->fake.onFriendMessage = function;
+    tox->fake.friendMessageData = userdata;
+}
+
+void tox_callback_friend_action(Tox* tox, void (*function)(Tox*, int32_t, const uint8_t*, uint16_t, void*), void* userdata)
+{
+    tox->fake.onFriendAction = function;
+    tox->fake.friendActionData = userdata;
+}
+
+void tox_callback_name_change(Tox* tox, void (*function)(Tox*, int32_t, const uint8_t*, uint16_t, void*), void* userdata)
+{
+    tox->fake.onNameChange = function;
+    tox->fake.nameChangeData = userdata;
+}
+
+void tox_callback_status_message(Tox* tox, void (*function)(Tox*, int32_t, const uint8_t*, uint16_t, void*), void* userdata)
+{
+    tox->fake.onStatusMessage = function;
+    tox->fake.statusMessageData = userdata;
+}
+
+void tox_callback_user_status(Tox* tox, void (*function)(Tox*, int32_t, uint8_t, void*), void* userdata)
+{
+    tox->fake.onUserStatus = function;
+    tox->fake.userStatusData = userdata;
+}
+
+void tox_callback_typing_change(Tox* tox, void (*function)(Tox*, int32_t, uint8_t, void*), void* userdata)
+{
+    tox->fake.onTypingChange = function;
+    tox->fake.typingChangeData = userdata;
+}
+
+void tox_callback_connection_status(Tox* tox, void (*function)(Tox*, int32_t, uint8_t, void*), void* userdata)
+{
+    tox->fake.onConnectionStatus = function;
+    tox->fake.connectionStatusData = userdata;
+}
+
+void tox_callback_read_receipt(Tox* tox, void (*function)(Tox*, int32_t, uint32_t, void*), void* userdata)
+{
+    tox->fake.onReadReceipt = function;
+    tox->fake.readReceiptData = userdata;
+}
+
+// friends of a fake never send or accept files
+void tox_callback_file_send_request(Tox*/* tox*/, void (*/* function*/)(Tox*, int32_t, uint8_t, uint64_t, const uint8_t*, uint16_t, void*), void*/* userdata*/)
+{
+}
+
+void tox_callback_file_control(Tox*/* tox*/, void (*/* function*/)(Tox*, int32_t, uint8_t, uint8_t, uint8_t, const uint8_t*, uint16_t, void*), void*/* userdata*/)
+{
+}
+
+void tox_callback_file_data(Tox*/* tox*/, void (*/* function*/)(Tox*, int32_t, uint8_t, const uint8_t*, uint16_t, void*), void*/* userdata*/)
+{
+}
+
+int tox_new_file_sender(Tox*/* tox*/, int32_t/* friendnumber*/, uint64_t/* filesize*/, const uint8_t*/* filename*/, uint16_t/* filename_length*/)
+{
+    return -1;
+}
+
+int tox_file_send_control(Tox*/* tox*/, int32_t/* friendnumber*/, uint8_t/* send_receive*/, uint8_t/* filenumber*/, uint8_t/* message_id*/, const uint8_t*/* data*/, uint16_t/* length*/)
+{
+    return -1;
+}
+
+int tox_file_send_data(Tox*/* tox*/, int32_t/* friendnumber*/, uint8_t/* filenumber*/, const uint8_t*/* data*/, uint16_t/* length*/)
+{
+    return -1;
+}
+
+int tox_file_data_size(const Tox*/* tox*/, int32_t/* friendnumber*/)
+{
+    return -1;
+}
+
+// friends of a fake never invite us, and groups can't be created without peers to join them
+void tox_callback_group_invite(Tox*/* tox*/, void (*/* function*/)(Tox*, int32_t, const uint8_t*, void*), void*/* userdata*/)
+{
+}
+
+void tox_callback_group_message(Tox*/* tox*/, void (*/* function*/)(Tox*, int, int, const uint8_t*, uint16_t, void*), void*/* userdata*/)
+{
+}
+
+void tox_callback_group_action(Tox*/* tox*/, void (*/* function*/)(Tox*, int, int, const uint8_t*, uint16_t, void*), void*/* userdata*/)
+{
+}
+
+void tox_callback_group_namelist_change(Tox*/* tox*/, void (*/* function*/)(Tox*, int, int, uint8_t, void*), void*/* userdata*/)
+{
+}
+
+int tox_add_groupchat(Tox*/* tox*/)
+{
+    return -1;
+}
+
+int tox_del_groupchat(Tox*/* tox*/, int/* groupnumber*/)
+{
+    return -1;
+}
+
+int tox_join_groupchat(Tox*/* tox*/, int32_t/* friendnumber*/, const uint8_t*/* friend_group_public_key*/)
+{
+    return -1;
+}
+
+int tox_invite_friend(Tox*/* tox*/, int32_t/* friendnumber*/, int/* groupnumber*/)
+{
+    return -1;
+}
+
+int tox_group_peername(const Tox*/* tox*/, int/* groupnumber*/, int/* peernumber*/, uint8_t*/* name*/)
+{
+    return -1;
+}
+
+int tox_group_message_send(Tox*/* tox*/, int/* groupnumber*/, const uint8_t*/* message*/, uint32_t/* length*/)
+{
+    return -1;
+}
+
+int tox_group_action_send(Tox*/* tox*/, int/* groupnumber*/, const uint8_t*/* action*/, uint32_t/* length*/)
+{
+    return -1;
+}
+
+#ifdef EVENT_DRIVEN_CORE
+// there are no sockets to wait on, Core falls back to polling
+size_t tox_wait_data_size()
+{
+    return 0;
+}
+
+int tox_wait_prepare(Tox*/* tox*/, uint8_t*/* data*/)
+{
+    return 0;
+}
+
+int tox_wait_execute(uint8_t*/* data*/, long/* seconds*/, long/* microseconds*/)
+{
+    return 0;
+}
+
+void tox_wait_cleanup(Tox*/* tox*/, uint8_t*/* data*/)
+{
+}
+#endif
+
+// There is no toxav without toxcore. toxav_new() failing disables calls, so the
+// rest is never called, it just has to link
+
+ToxAv* toxav_new(Tox*/* messenger*/, int32_t/* max_calls*/)
+{
+    return nullptr;
+}
+
+void toxav_kill(ToxAv*/* av*/)
+{
+}
+
+void toxav_do(ToxAv*/* av*/)
+{
+}
+
+uint32_t toxav_do_interval(ToxAv*/* av*/)
+{
+    return 1000;
+}
+
+void toxav_register_callstate_callback(ToxAv*/* av*/, ToxAVCallback/* cb*/, ToxAvCallbackID/* id*/, void*/* userdata*/)
+{
+}
+
+void toxav_register_audio_callback(ToxAv*/* av*/, void (*/* cb*/)(void*, int32_t, const int16_t*, uint16_t, void*), void*/* userdata*/)
+{
+}
+
+void toxav_register_video_callback(ToxAv*/* av*/, void (*/* cb*/)(void*, int32_t, const vpx_image_t*, void*), void*/* userdata*/)
+{
+}
+
+int toxav_call(ToxAv*/* av*/, int32_t*/* call_index*/, int/* friend_id*/, const ToxAvCSettings*/* csettings*/, int/* ringing_seconds*/)
+{
+    return -1;
+}
+
+int toxav_answer(ToxAv*/* av*/, int32_t/* call_index*/, const ToxAvCSettings*/* csettings*/)
+{
+    return -1;
+}
+
+int toxav_reject(ToxAv*/* av*/, int32_t/* call_index*/, const char*/* reason*/)
+{
+    return -1;
+}
+
+int toxav_cancel(ToxAv*/* av*/, int32_t/* call_index*/, int/* peer_id*/, const char*/* reason*/)
+{
+    return -1;
+}
+
+int toxav_hangup(ToxAv*/* av*/, int32_t/* call_index*/)
+{
+    return -1;
+}
+
+int toxav_get_peer_id(ToxAv*/* av*/, int32_t/* call_index*/, int/* peer*/)
+{
+    return -1;
+}
+
+int toxav_get_peer_csettings(ToxAv*/* av*/, int32_t/* call_index*/, int/* peer*/, ToxAvCSettings*/* dest*/)
+{
+    return -1;
+}
+
+int toxav_prepare_transmission(ToxAv*/* av*/, int32_t/* call_index*/, int/* support_video*/)
+{
+    return -1;
+}
+
+int toxav_kill_transmission(ToxAv*/* av*/, int32_t/* call_index*/)
+{
+    return -1;
+}
+
+int toxav_prepare_audio_frame(ToxAv*/* av*/, int32_t/* call_index*/, uint8_t*/* dest*/, int/* dest_max*/, const int16_t*/* frame*/, int/* frame_size*/)
+{
+    return -1;
+}
+
+int toxav_send_audio(ToxAv*/* av*/, int32_t/* call_index*/, const uint8_t*/* frame*/, unsigned int/* size*/)
+{
+    return -1;
+}
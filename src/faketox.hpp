@@ -0,0 +1,139 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef FAKETOX_HPP
+#define FAKETOX_HPP
+
+#include <tox/tox.h>
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QVector>
+
+// A simulated toxcore for load testing the GUI without a network. It's built
+// with "qmake CONFIG+=fake_tox" and then defines the tox_* functions Core and
+// the managers call, in place of linking toxcore. The friends and what they do
+// come from a script named by the TOX_FAKE_SCRIPT environment variable, one
+// step per line, steps run one after another:
+//
+//   friends <count>                    friends we have, only read when the script is loaded
+//   connect | disconnect               our DHT connection
+//   wait <ms>
+//   messages <per second> <ms>         messages from random friends, every tenth is long
+//   statusflaps <per second> <ms>      random friends change their status or go offline and back
+//   typing <per second> <ms>           random friends start or stop typing
+//   reconnects <per second> <ms>       all friends go offline and come back at once
+//
+// Random choices come from a fixed seed, so every run of a script is the same.
+// Each message carries the time it was scheduled for, and the end of each step
+// prints how many events it delivered and how far behind the schedule it got.
+class FakeTox
+{
+public:
+    FakeTox();
+
+    static const char* const SCRIPT_VARIABLE;
+
+    struct Friend
+    {
+        QByteArray clientId; // empty for removed friends
+        QByteArray name;
+        QByteArray statusMessage;
+        uint8_t status;
+        bool online;
+        uint64_t lastOnline;
+    };
+
+    QVector<Friend> friends;
+    QByteArray name;
+    QByteArray statusMessage;
+    uint8_t status;
+    bool connected;
+    uint32_t lastMessageId;
+    QByteArray publicKey;
+    QByteArray secretKey;
+
+    void (*onFriendRequest)(Tox*, const uint8_t*, const uint8_t*, uint16_t, void*);
+    void* friendRequestData;
+    void (*onFriendMessage)(Tox*, int32_t, const uint8_t*, uint16_t, void*);
+    void* friendMessageData;
+    void (*onFriendAction)(Tox*, int32_t, const uint8_t*, uint16_t, void*);
+    void* friendActionData;
+    void (*onNameChange)(Tox*, int32_t, const uint8_t*, uint16_t, void*);
+    void* nameChangeData;
+    void (*onStatusMessage)(Tox*, int32_t, const uint8_t*, uint16_t, void*);
+    void* statusMessageData;
+    void (*onUserStatus)(Tox*, int32_t, uint8_t, void*);
+    void* userStatusData;
+    void (*onTypingChange)(Tox*, int32_t, uint8_t, void*);
+    void* typingChangeData;
+    void (*onConnectionStatus)(Tox*, int32_t, uint8_t, void*);
+    void* connectionStatusData;
+    void (*onReadReceipt)(Tox*, int32_t, uint32_t, void*);
+    void* readReceiptData;
+
+    // (friend, message id) of the messages we sent, friends confirm them on the next process()
+    QVector<QPair<int32_t, uint32_t>> unconfirmed;
+
+    bool isFriend(int32_t friendId) const;
+
+    // runs the script up to now, tox is passed to the callbacks
+    void process(Tox* tox);
+    // ms until the script wants process() to run again
+    uint32_t interval() const;
+
+private:
+    struct Step
+    {
+        enum Kind {Connect, Disconnect, Wait, Messages, StatusFlaps, Typing, Reconnects};
+        Kind kind;
+        QString name;
+        double rate;     // events per second
+        qint64 duration; // ms
+    };
+
+    void loadScript();
+    bool parseLine(const QString& line);
+    void addFriends(int count);
+    quint32 random();
+    int randomFriend();
+
+    void startStep();
+    void finishStep();
+    void runEvent(Tox* tox, const Step& step, qint64 scheduledTime);
+    void setFriendOnline(Tox* tox, int friendId, bool online);
+
+    // with thousands of events due at once the GUI is flooded anyway, the rest waits for the next tox_do()
+    static const int MAX_EVENTS_PER_ITERATION = 1000;
+    static const uint32_t IDLE_INTERVAL = 50;   // ms
+    static const uint32_t ACTIVE_INTERVAL = 5;  // ms
+
+    QList<Step> script;
+    int currentStep;
+    bool stepStarted;
+    QElapsedTimer clock;
+    qint64 stepStart;   // ms on clock
+    qint64 delivered;   // events of the current step
+    qint64 maxLag;      // ms
+    quint32 seed;
+    QVector<bool> typing;
+};
+
+#endif // FAKETOX_HPP
@@ -0,0 +1,68 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef FILETRANSFER_HPP
+#define FILETRANSFER_HPP
+
+#include <QList>
+#include <QMetaType>
+#include <QString>
+
+// A file transfer as the GUI sees it, reported by Core's FileTransferManager
+struct FileTransferInfo
+{
+    enum class Direction : int {
+        Sending,
+        Receiving
+    };
+
+    enum class State : int {
+        Pending,        // waiting for the receiving side to accept
+        Transferring,
+        Paused,         // by the friend
+        Interrupted,    // the friend went offline, it's resumed once they are back
+        Finished,
+        Cancelled,      // by either side
+        Failed          // couldn't read or write the file
+    };
+
+    int friendId;
+    // toxcore's file number, unique per friend and direction
+    int fileNumber;
+    Direction direction;
+    State state;
+    QString fileName;
+    qint64 size;
+    qint64 transferred;
+    qint64 bytesPerSecond;
+
+    FileTransferInfo() :
+        friendId(-1), fileNumber(-1), direction(Direction::Sending), state(State::Pending), size(0), transferred(0), bytesPerSecond(0) {}
+
+    bool isOver() const
+    {
+        return state == State::Finished || state == State::Cancelled || state == State::Failed;
+    }
+};
+
+typedef QList<FileTransferInfo> FileTransferInfoList;
+
+Q_DECLARE_METATYPE(FileTransferInfo)
+Q_DECLARE_METATYPE(FileTransferInfoList)
+Q_DECLARE_METATYPE(FileTransferInfo::Direction)
+
+#endif // FILETRANSFER_HPP
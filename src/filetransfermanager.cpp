@@ -0,0 +1,667 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "filetransfermanager.hpp"
+
+#include <cstring>
+
+#include <QDataStream>
+#include <QDebug>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QTimer>
+
+const qint64 FileTransferManager::MappedFile::WINDOW_SIZE;
+
+FileTransferManager::MappedFile::MappedFile() :
+    window(nullptr), windowOffset(0), windowSize(0), mappable(true)
+{
+}
+
+FileTransferManager::MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool FileTransferManager::MappedFile::openForReading(const QString& path)
+{
+    mappable = true;
+    file.setFileName(path);
+    return file.open(QIODevice::ReadOnly);
+}
+
+bool FileTransferManager::MappedFile::openForWriting(const QString& path, qint64 size)
+{
+    mappable = true;
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+        return false;
+    }
+
+    // a file that can't be preallocated can still be written to sequentially
+    if (!file.resize(size)) {
+        mappable = false;
+    }
+
+    return true;
+}
+
+bool FileTransferManager::MappedFile::reopenForWriting(const QString& path)
+{
+    mappable = true;
+    file.setFileName(path);
+    return file.open(QIODevice::ReadWrite);
+}
+
+bool FileTransferManager::MappedFile::isOpen() const
+{
+    return file.isOpen();
+}
+
+void FileTransferManager::MappedFile::close(bool remove)
+{
+    if (window) {
+        file.unmap(window);
+        window = nullptr;
+    }
+    buffer.clear();
+
+    if (remove) {
+        file.remove();
+    } else {
+        file.close();
+    }
+}
+
+qint64 FileTransferManager::MappedFile::size() const
+{
+    return file.size();
+}
+
+uchar* FileTransferManager::MappedFile::map(qint64 pos, int length)
+{
+    if (!mappable) {
+        return nullptr;
+    }
+
+    if (!window || pos < windowOffset || pos + length > windowOffset + windowSize) {
+        if (window) {
+            file.unmap(window);
+        }
+
+        windowOffset = pos - pos % WINDOW_ALIGNMENT;
+        windowSize = qMin(WINDOW_SIZE, file.size() - windowOffset);
+        window = windowSize >= pos - windowOffset + length ? file.map(windowOffset, windowSize) : nullptr;
+        if (!window) {
+            qWarning() << "Couldn't map" << file.fileName() << "falling back to buffered I/O";
+            mappable = false;
+            return nullptr;
+        }
+    }
+
+    return window + (pos - windowOffset);
+}
+
+const uchar* FileTransferManager::MappedFile::read(qint64 pos, int length)
+{
+    if (const uchar* data = map(pos, length)) {
+        return data;
+    }
+
+    buffer.resize(length);
+    if (!file.seek(pos) || file.read(buffer.data(), length) != length) {
+        return nullptr;
+    }
+    return reinterpret_cast<const uchar*>(buffer.constData());
+}
+
+bool FileTransferManager::MappedFile::write(qint64 pos, const uchar* data, int length)
+{
+    if (uchar* target = map(pos, length)) {
+        memcpy(target, data, length);
+        return true;
+    }
+
+    return file.seek(pos) && file.write(reinterpret_cast<const char*>(data), length) == length;
+}
+
+FileTransferManager::Transfer::Transfer() :
+    blockHash(QCryptographicHash::Sha1), blockFill(0), dirty(false), sampledBytes(0)
+{
+}
+
+FileTransferManager::FileTransferManager(Tox* tox, const QString& journalPath, QObject* parent) :
+    QObject(parent), tox(tox), journalPath(journalPath), journalDirty(false)
+{
+    cleanUpJournal();
+
+    reportTimer = new QTimer(this);
+    reportTimer->setInterval(REPORT_INTERVAL);
+    connect(reportTimer, &QTimer::timeout, this, &FileTransferManager::report);
+
+    tox_callback_file_send_request(tox, onFileSendRequest, this);
+    tox_callback_file_control(tox, onFileControl, this);
+    tox_callback_file_data(tox, onFileData, this);
+}
+
+FileTransferManager::~FileTransferManager()
+{
+    if (journalDirty) {
+        saveJournal();
+    }
+    qDeleteAll(transfers);
+    qDeleteAll(ended);
+}
+
+quint64 FileTransferManager::key(int friendId, int fileNumber, FileTransferInfo::Direction direction)
+{
+    return (quint64(quint32(friendId)) << 32) | (quint64(direction) << 8) | quint8(fileNumber);
+}
+
+FileTransferManager::Transfer* FileTransferManager::find(int friendId, int fileNumber, FileTransferInfo::Direction direction) const
+{
+    return transfers.value(key(friendId, fileNumber, direction), nullptr);
+}
+
+void FileTransferManager::onFileSendRequest(Tox*/* tox*/, int32_t friendId, uint8_t fileNumber, uint64_t fileSize, const uint8_t* cFileName, uint16_t cFileNameSize, void* manager)
+{
+    FileTransferManager* self = static_cast<FileTransferManager*>(manager);
+
+    Transfer* transfer = new Transfer();
+    FileTransferInfo& info = transfer->info;
+    info.friendId = friendId;
+    info.fileNumber = fileNumber;
+    info.direction = FileTransferInfo::Direction::Receiving;
+    // the friend doesn't get to pick the directory
+    info.fileName = QFileInfo(QString::fromUtf8(reinterpret_cast<const char*>(cFileName), cFileNameSize)).fileName();
+    info.size = fileSize;
+
+    // toxcore reuses the numbers of finished transfers
+    delete self->transfers.take(key(friendId, fileNumber, info.direction));
+    self->transfers.insert(key(friendId, fileNumber, info.direction), transfer);
+    self->markChanged(transfer);
+}
+
+void FileTransferManager::onFileControl(Tox*/* tox*/, int32_t friendId, uint8_t receiveSend, uint8_t fileNumber, uint8_t controlType, const uint8_t* data, uint16_t size, void* manager)
+{
+    FileTransferManager* self = static_cast<FileTransferManager*>(manager);
+
+    // receiveSend is 1 for the files we send
+    const FileTransferInfo::Direction direction = receiveSend == 1 ? FileTransferInfo::Direction::Sending : FileTransferInfo::Direction::Receiving;
+    Transfer* transfer = self->find(friendId, fileNumber, direction);
+    if (!transfer) {
+        return;
+    }
+
+    FileTransferInfo& info = transfer->info;
+    switch (controlType) {
+        case TOX_FILECONTROL_ACCEPT:
+            if (direction == FileTransferInfo::Direction::Sending && info.state != FileTransferInfo::State::Transferring) {
+                self->setState(transfer, FileTransferInfo::State::Transferring);
+                self->sending[friendId].append(key(friendId, fileNumber, direction));
+            } else if (info.state == FileTransferInfo::State::Paused) {
+                self->setState(transfer, FileTransferInfo::State::Transferring);
+            }
+            break;
+        case TOX_FILECONTROL_PAUSE:
+            if (info.state == FileTransferInfo::State::Transferring) {
+                self->setState(transfer, FileTransferInfo::State::Paused);
+                if (direction == FileTransferInfo::Direction::Sending) {
+                    self->sending[friendId].removeOne(key(friendId, fileNumber, direction));
+                }
+            }
+            break;
+        case TOX_FILECONTROL_KILL:
+            self->end(transfer, FileTransferInfo::State::Cancelled);
+            break;
+        case TOX_FILECONTROL_RESUME_BROKEN:
+            // the friend tells us how much of our file it has kept
+            if (direction == FileTransferInfo::Direction::Sending && info.state == FileTransferInfo::State::Interrupted && size == sizeof(uint64_t)) {
+                uint64_t position;
+                memcpy(&position, data, sizeof(position));
+                if (position > quint64(info.size) || (!transfer->file.isOpen() && !transfer->file.openForReading(transfer->filePath))) {
+                    self->kill(transfer, FileTransferInfo::State::Failed);
+                    break;
+                }
+                info.transferred = position;
+                tox_file_send_control(self->tox, friendId, 0, fileNumber, TOX_FILECONTROL_ACCEPT, nullptr, 0);
+                self->setState(transfer, FileTransferInfo::State::Transferring);
+                self->sending[friendId].append(key(friendId, fileNumber, direction));
+            }
+            break;
+        case TOX_FILECONTROL_FINISHED:
+            if (direction == FileTransferInfo::Direction::Sending) {
+                // the friend confirmed it got all of it
+                self->end(transfer, FileTransferInfo::State::Finished);
+            } else if (info.transferred == info.size) {
+                tox_file_send_control(self->tox, friendId, 1, fileNumber, TOX_FILECONTROL_FINISHED, nullptr, 0);
+                self->end(transfer, FileTransferInfo::State::Finished);
+            } else {
+                qWarning() << "Friend" << friendId << "finished sending" << info.fileName << "before sending all of it";
+                self->kill(transfer, FileTransferInfo::State::Failed);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void FileTransferManager::onFileData(Tox*/* tox*/, int32_t friendId, uint8_t fileNumber, const uint8_t* data, uint16_t size, void* manager)
+{
+    FileTransferManager* self = static_cast<FileTransferManager*>(manager);
+
+    Transfer* transfer = self->find(friendId, fileNumber, FileTransferInfo::Direction::Receiving);
+    if (!transfer || transfer->info.state != FileTransferInfo::State::Transferring) {
+        return;
+    }
+
+    FileTransferInfo& info = transfer->info;
+    if (info.transferred + size > info.size || !transfer->file.write(info.transferred, data, size)) {
+        qWarning() << "Couldn't write" << info.fileName;
+        self->kill(transfer, FileTransferInfo::State::Failed);
+        return;
+    }
+
+    info.transferred += size;
+    self->hashReceived(transfer, data, size);
+    self->markChanged(transfer);
+}
+
+void FileTransferManager::hashReceived(Transfer* transfer, const uint8_t* data, int size)
+{
+    while (size > 0) {
+        const int length = qMin(JOURNAL_BLOCK_SIZE - transfer->blockFill, size);
+        transfer->blockHash.addData(reinterpret_cast<const char*>(data), length);
+        transfer->blockFill += length;
+        data += length;
+        size -= length;
+
+        if (transfer->blockFill == JOURNAL_BLOCK_SIZE) {
+            transfer->blockHashes << transfer->blockHash.result();
+            transfer->blockHash.reset();
+            transfer->blockFill = 0;
+            journalDirty = true;
+        }
+    }
+}
+
+qint64 FileTransferManager::verifyReceived(Transfer* transfer)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    for (int i = qMax(0, transfer->blockHashes.size() - VERIFIED_BLOCKS); i < transfer->blockHashes.size(); i++) {
+        const uchar* block = transfer->file.read(qint64(i) * JOURNAL_BLOCK_SIZE, JOURNAL_BLOCK_SIZE);
+        hash.reset();
+        if (block) {
+            hash.addData(reinterpret_cast<const char*>(block), JOURNAL_BLOCK_SIZE);
+        }
+        if (!block || hash.result() != transfer->blockHashes[i]) {
+            qWarning() << "Block" << i << "of" << transfer->info.fileName << "is damaged, resuming from there";
+            transfer->blockHashes.resize(i);
+            break;
+        }
+    }
+
+    return qint64(transfer->blockHashes.size()) * JOURNAL_BLOCK_SIZE;
+}
+
+void FileTransferManager::resume(Transfer* transfer)
+{
+    FileTransferInfo& info = transfer->info;
+    if (!transfer->file.reopenForWriting(transfer->filePath)) {
+        qWarning() << "Couldn't open" << transfer->filePath << "again";
+        kill(transfer, FileTransferInfo::State::Failed);
+        return;
+    }
+
+    // whatever came after the last complete block is received again
+    const uint64_t position = verifyReceived(transfer);
+    info.transferred = position;
+    transfer->blockHash.reset();
+    transfer->blockFill = 0;
+    journalDirty = true;
+
+    if (tox_file_send_control(tox, info.friendId, 1, info.fileNumber, TOX_FILECONTROL_RESUME_BROKEN, reinterpret_cast<const uint8_t*>(&position), sizeof(position)) == -1) {
+        end(transfer, FileTransferInfo::State::Failed);
+        return;
+    }
+    setState(transfer, FileTransferInfo::State::Transferring);
+}
+
+void FileTransferManager::sendFile(int friendId, const QString& filePath)
+{
+    Transfer* transfer = new Transfer();
+    FileTransferInfo& info = transfer->info;
+    info.friendId = friendId;
+    info.direction = FileTransferInfo::Direction::Sending;
+    info.fileName = QFileInfo(filePath).fileName();
+
+    transfer->filePath = filePath;
+
+    if (!transfer->file.openForReading(filePath)) {
+        delete transfer;
+        emit failedToSendFile(friendId, filePath);
+        return;
+    }
+    info.size = transfer->file.size();
+
+    QByteArray cFileName = info.fileName.toUtf8();
+    cFileName.truncate(MAX_FILENAME_SIZE);
+    info.fileNumber = tox_new_file_sender(tox, friendId, info.size, reinterpret_cast<const uint8_t*>(cFileName.constData()), cFileName.size());
+    if (info.fileNumber == -1) {
+        delete transfer;
+        emit failedToSendFile(friendId, filePath);
+        return;
+    }
+
+    transfers.insert(key(friendId, info.fileNumber, info.direction), transfer);
+    markChanged(transfer);
+}
+
+void FileTransferManager::acceptFile(int friendId, int fileNumber, const QString& savePath)
+{
+    Transfer* transfer = find(friendId, fileNumber, FileTransferInfo::Direction::Receiving);
+    if (!transfer || transfer->info.state != FileTransferInfo::State::Pending) {
+        return;
+    }
+
+    if (!transfer->file.openForWriting(savePath, transfer->info.size)) {
+        qWarning() << "Couldn't open" << savePath << "for writing";
+        kill(transfer, FileTransferInfo::State::Failed);
+        return;
+    }
+
+    transfer->filePath = savePath;
+    tox_file_send_control(tox, friendId, 1, fileNumber, TOX_FILECONTROL_ACCEPT, nullptr, 0);
+    setState(transfer, FileTransferInfo::State::Transferring);
+    journalDirty = true;
+}
+
+void FileTransferManager::cancelFile(int friendId, int fileNumber, FileTransferInfo::Direction direction)
+{
+    if (Transfer* transfer = find(friendId, fileNumber, direction)) {
+        kill(transfer, FileTransferInfo::State::Cancelled);
+    }
+}
+
+void FileTransferManager::onFriendOffline(int friendId)
+{
+    for (Transfer* transfer : transfers.values()) {
+        FileTransferInfo& info = transfer->info;
+        if (info.friendId != friendId) {
+            continue;
+        }
+
+        if (info.direction == FileTransferInfo::Direction::Receiving && info.state == FileTransferInfo::State::Pending) {
+            // can't be accepted anymore
+            end(transfer, FileTransferInfo::State::Failed);
+            continue;
+        }
+
+        sending[friendId].removeOne(key(friendId, info.fileNumber, info.direction));
+        if (info.direction == FileTransferInfo::Direction::Receiving) {
+            // flushes what was written, it's verified against the journal on resume
+            transfer->file.close();
+        }
+        setState(transfer, FileTransferInfo::State::Interrupted);
+    }
+}
+
+void FileTransferManager::onFriendOnline(int friendId)
+{
+    // the receiving side asks for the rest, the sending side waits for it to do so
+    for (Transfer* transfer : transfers.values()) {
+        const FileTransferInfo& info = transfer->info;
+        if (info.friendId == friendId && info.direction == FileTransferInfo::Direction::Receiving
+                && info.state == FileTransferInfo::State::Interrupted) {
+            resume(transfer);
+        }
+    }
+}
+
+void FileTransferManager::process()
+{
+    for (auto it = sending.begin(); it != sending.end(); ) {
+        const int friendId = it.key();
+        QList<quint64>& queue = it.value();
+        const int chunkSize = tox_file_data_size(tox, friendId);
+
+        // one chunk of every transfer in turn, so that a big file doesn't hold up the rest
+        int chunks = 0;
+        int i = 0;
+        while (!queue.isEmpty() && chunks < MAX_CHUNKS_PER_ITERATION && chunkSize > 0) {
+            i %= queue.size();
+            Transfer* transfer = transfers.value(queue[i]);
+            FileTransferInfo& info = transfer->info;
+
+            const int length = int(qMin<qint64>(chunkSize, info.size - info.transferred));
+            if (length > 0) {
+                const uchar* data = transfer->file.read(info.transferred, length);
+                if (!data) {
+                    qWarning() << "Couldn't read" << info.fileName;
+                    // takes it off the queue
+                    kill(transfer, FileTransferInfo::State::Failed);
+                    continue;
+                }
+
+                if (tox_file_send_data(tox, friendId, info.fileNumber, data, length) == -1) {
+                    // toxcore's send buffer is full, the rest waits for the next iteration
+                    break;
+                }
+
+                info.transferred += length;
+                chunks++;
+                markChanged(transfer);
+            }
+
+            if (info.transferred == info.size) {
+                // the transfer ends once the friend confirms
+                tox_file_send_control(tox, friendId, 0, info.fileNumber, TOX_FILECONTROL_FINISHED, nullptr, 0);
+                transfer->file.close();
+                queue.removeAt(i);
+                continue;
+            }
+
+            ++i;
+        }
+
+        if (queue.isEmpty()) {
+            it = sending.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+bool FileTransferManager::hasPendingData() const
+{
+    for (const QList<quint64>& queue : sending) {
+        if (!queue.isEmpty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool FileTransferManager::hasActiveTransfers() const
+{
+    for (const Transfer* transfer : transfers) {
+        if (transfer->info.state == FileTransferInfo::State::Transferring) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void FileTransferManager::setState(Transfer* transfer, FileTransferInfo::State state)
+{
+    if (state == FileTransferInfo::State::Transferring) {
+        transfer->sampledBytes = transfer->info.transferred;
+        transfer->sampleTimer.start();
+    } else {
+        transfer->info.bytesPerSecond = 0;
+    }
+
+    transfer->info.state = state;
+    markChanged(transfer);
+}
+
+void FileTransferManager::markChanged(Transfer* transfer)
+{
+    transfer->dirty = true;
+    if (!reportTimer->isActive()) {
+        reportTimer->start();
+    }
+}
+
+void FileTransferManager::kill(Transfer* transfer, FileTransferInfo::State state)
+{
+    const int sendReceive = transfer->info.direction == FileTransferInfo::Direction::Receiving ? 1 : 0;
+    tox_file_send_control(tox, transfer->info.friendId, sendReceive, transfer->info.fileNumber, TOX_FILECONTROL_KILL, nullptr, 0);
+    end(transfer, state);
+}
+
+void FileTransferManager::end(Transfer* transfer, FileTransferInfo::State state)
+{
+    const FileTransferInfo& info = transfer->info;
+    const quint64 transferKey = key(info.friendId, info.fileNumber, info.direction);
+
+    transfers.remove(transferKey);
+    // empty queues are dropped by process(), which may be iterating over them right now
+    auto queue = sending.find(info.friendId);
+    if (queue != sending.end()) {
+        queue->removeOne(transferKey);
+    }
+
+    if (info.direction == FileTransferInfo::Direction::Receiving && !transfer->filePath.isEmpty()) {
+        journalDirty = true;
+    }
+
+    // a partially received file is of no use
+    transfer->file.close(info.direction == FileTransferInfo::Direction::Receiving && state != FileTransferInfo::State::Finished);
+
+    setState(transfer, state);
+    ended.append(transfer);
+}
+
+void FileTransferManager::report()
+{
+    FileTransferInfoList changes;
+    bool active = false;
+
+    for (Transfer* transfer : transfers) {
+        FileTransferInfo& info = transfer->info;
+        if (info.state == FileTransferInfo::State::Transferring) {
+            active = true;
+
+            const qint64 elapsed = transfer->sampleTimer.restart();
+            if (elapsed > 0) {
+                // smoothed over the last few samples, so the number doesn't jump around
+                const qint64 rate = (info.transferred - transfer->sampledBytes) * 1000 / elapsed;
+                info.bytesPerSecond = (info.bytesPerSecond + rate) / 2;
+                transfer->sampledBytes = info.transferred;
+                transfer->dirty = true;
+            }
+        }
+
+        if (transfer->dirty) {
+            transfer->dirty = false;
+            changes << info;
+        }
+    }
+
+    for (Transfer* transfer : ended) {
+        changes << transfer->info;
+    }
+    qDeleteAll(ended);
+    ended.clear();
+
+    if (journalDirty) {
+        saveJournal();
+    }
+
+    if (!active) {
+        reportTimer->stop();
+    }
+
+    if (!changes.isEmpty()) {
+        emit transfersUpdated(changes);
+    }
+}
+
+void FileTransferManager::saveJournal()
+{
+    journalDirty = false;
+
+    QList<const Transfer*> received;
+    for (const Transfer* transfer : transfers) {
+        if (transfer->info.direction == FileTransferInfo::Direction::Receiving && !transfer->filePath.isEmpty()) {
+            received << transfer;
+        }
+    }
+
+    if (received.isEmpty()) {
+        QFile::remove(journalPath);
+        return;
+    }
+
+    QSaveFile file(journalPath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Couldn't write the file transfer journal" << journalPath;
+        return;
+    }
+
+    QDataStream stream(&file);
+    stream << JOURNAL_VERSION << quint32(received.size());
+    for (const Transfer* transfer : received) {
+        const FileTransferInfo& info = transfer->info;
+        stream << qint32(info.friendId) << qint32(info.fileNumber) << info.fileName << transfer->filePath << info.size
+               << transfer->blockHashes;
+    }
+
+    file.commit();
+}
+
+void FileTransferManager::cleanUpJournal()
+{
+    QFile file(journalPath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    QDataStream stream(&file);
+    quint32 version;
+    quint32 count;
+    stream >> version >> count;
+    if (version == JOURNAL_VERSION) {
+        for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; i++) {
+            qint32 friendId;
+            qint32 fileNumber;
+            QString fileName;
+            QString filePath;
+            qint64 size;
+            QVector<QByteArray> blockHashes;
+            stream >> friendId >> fileNumber >> fileName >> filePath >> size >> blockHashes;
+            if (stream.status() == QDataStream::Ok) {
+                qWarning() << "Removing" << filePath << "left behind by an unfinished transfer";
+                QFile::remove(filePath);
+            }
+        }
+    }
+
+    file.close();
+    file.remove();
+}
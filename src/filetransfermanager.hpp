@@ -0,0 +1,185 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef FILETRANSFERMANAGER_HPP
+#define FILETRANSFERMANAGER_HPP
+
+#include "filetransfer.hpp"
+
+#include <tox/tox.h>
+
+#include <QByteArray>
+#include <QCryptographicHash>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QVector>
+
+class QTimer;
+
+// File transfers of a single Core, driven from its tox_do() loop. Outgoing files
+// are sent straight out of a memory-mapped window of the file and received chunks
+// are copied straight into one, so no chunk passes through an intermediate buffer
+// unless the file can't be mapped. Several transfers to the same friend are sent
+// a chunk at a time in turn until toxcore's send buffer is full. Progress is
+// collected and reported to the GUI in batches, at most every REPORT_INTERVAL.
+//
+// Transfers survive the friend going offline. What was received is recorded in a
+// journal as hashes of JOURNAL_BLOCK_SIZE blocks, and once the friend is back
+// the transfer resumes from the end of the last block found intact on disk.
+class FileTransferManager : public QObject
+{
+    Q_OBJECT
+public:
+    // registers the file callbacks with tox, so it must be created before tox_do() runs.
+    // The journal of received files is kept at journalPath
+    FileTransferManager(Tox* tox, const QString& journalPath, QObject* parent);
+    ~FileTransferManager();
+
+    // hands as much of the accepted outgoing files to toxcore as it takes, called after every tox_do()
+    void process();
+    // there is outgoing data toxcore didn't take yet, process() should be called again soon
+    bool hasPendingData() const;
+    // a file is being sent or received right now, paused and pending ones don't count
+    bool hasActiveTransfers() const;
+    // toxcore keeps the transfers of friends that went offline as broken, they are resumed when they are back
+    void onFriendOffline(int friendId);
+    void onFriendOnline(int friendId);
+
+public slots:
+    void sendFile(int friendId, const QString& filePath);
+    // the file is written to savePath, which is overwritten if it exists
+    void acceptFile(int friendId, int fileNumber, const QString& savePath);
+    // rejects, cancels or stops the transfer, whatever state it's in
+    void cancelFile(int friendId, int fileNumber, FileTransferInfo::Direction direction);
+
+signals:
+    // transfers that changed since the last report, the ones that are over are reported one last time
+    void transfersUpdated(const FileTransferInfoList& transfers);
+    void failedToSendFile(int friendId, const QString& filePath);
+
+private:
+    static void onFileSendRequest(Tox* tox, int32_t friendId, uint8_t fileNumber, uint64_t fileSize, const uint8_t* cFileName, uint16_t cFileNameSize, void* manager);
+    static void onFileControl(Tox* tox, int32_t friendId, uint8_t receiveSend, uint8_t fileNumber, uint8_t controlType, const uint8_t* data, uint16_t size, void* manager);
+    static void onFileData(Tox* tox, int32_t friendId, uint8_t fileNumber, const uint8_t* data, uint16_t size, void* manager);
+
+    // A file accessed through a window mapped into memory, which is moved along as
+    // the transfer progresses. Files that can't be mapped are read and written
+    // through a single buffer that's reused for every chunk.
+    class MappedFile
+    {
+    public:
+        MappedFile();
+        ~MappedFile();
+
+        bool openForReading(const QString& path);
+        // the file is created at its full size up front, so that it can be mapped
+        bool openForWriting(const QString& path, qint64 size);
+        // opens a file created by openForWriting() again, keeping what is in it
+        bool reopenForWriting(const QString& path);
+        bool isOpen() const;
+        // removing deletes what was written of an incomplete file
+        void close(bool remove = false);
+        qint64 size() const;
+
+        // length bytes at pos, valid until the next call, null on error
+        const uchar* read(qint64 pos, int length);
+        bool write(qint64 pos, const uchar* data, int length);
+
+    private:
+        // the mapped memory at pos, remapping the window if needed, null if the file can't be mapped
+        uchar* map(qint64 pos, int length);
+
+        // windows start at multiples of this, which is a multiple of the page size
+        // and of the allocation granularity on Windows
+        static const qint64 WINDOW_ALIGNMENT = 64 * 1024;
+        static const qint64 WINDOW_SIZE = 16 * 1024 * 1024;
+
+        QFile file;
+        uchar* window;
+        qint64 windowOffset;
+        qint64 windowSize;
+        bool mappable;
+        QByteArray buffer;
+
+        Q_DISABLE_COPY(MappedFile)
+    };
+
+    struct Transfer
+    {
+        FileTransferInfo info;
+        QString filePath;
+        MappedFile file;
+        // hashes of the received blocks, the file is intact up to the end of the last one
+        QVector<QByteArray> blockHashes;
+        QCryptographicHash blockHash;
+        int blockFill;
+        // there are changes the GUI wasn't told about yet
+        bool dirty;
+        // transferred at the last throughput sample
+        qint64 sampledBytes;
+        QElapsedTimer sampleTimer;
+
+        Transfer();
+    };
+
+    static quint64 key(int friendId, int fileNumber, FileTransferInfo::Direction direction);
+    Transfer* find(int friendId, int fileNumber, FileTransferInfo::Direction direction) const;
+    void setState(Transfer* transfer, FileTransferInfo::State state);
+    void markChanged(Transfer* transfer);
+    // notifies the friend and ends the transfer
+    void kill(Transfer* transfer, FileTransferInfo::State state);
+    // the transfer is over, it's reported once more and freed
+    void end(Transfer* transfer, FileTransferInfo::State state);
+    void hashReceived(Transfer* transfer, const uint8_t* data, int size);
+    // checks the last blocks that were written against their hashes, returns where to resume from
+    qint64 verifyReceived(Transfer* transfer);
+    void resume(Transfer* transfer);
+
+    // the journal is only good for the transfers of this session, toxcore forgets
+    // the rest on exit, so partial files a crash left behind are removed
+    void cleanUpJournal();
+    void saveJournal();
+
+    static const int REPORT_INTERVAL = 250; // ms
+    // limits how long a single iteration of the tox_do() loop spends on files
+    static const int MAX_CHUNKS_PER_ITERATION = 512;
+    static const int MAX_FILENAME_SIZE = 255; // bytes
+    static const int JOURNAL_BLOCK_SIZE = 1024 * 1024;
+    static const quint32 JOURNAL_VERSION = 1;
+    // writes made through the mapping just before a disconnect might have been lost,
+    // checking the whole file would stall tox_do() for too long on big files
+    static const int VERIFIED_BLOCKS = 4;
+
+    Tox* tox;
+    QHash<quint64, Transfer*> transfers;
+    // friendId -> keys of the friend's transfers that are being sent, served in turn
+    QHash<int, QList<quint64>> sending;
+    // transfers that are over and are waiting to be reported for the last time
+    QList<Transfer*> ended;
+    QTimer* reportTimer;
+    const QString journalPath;
+    bool journalDirty;
+
+private slots:
+    void report();
+
+};
+
+#endif // FILETRANSFERMANAGER_HPP
@@ -0,0 +1,174 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "filetransferswidget.hpp"
+
+#include <QHBoxLayout>
+#include <QLabel>
+#include <QProgressBar>
+#include <QPushButton>
+#include <QVBoxLayout>
+
+FileTransfersWidget::FileTransfersWidget(QWidget* parent) :
+    QWidget(parent)
+{
+    layout = new QVBoxLayout(this);
+    layout->setContentsMargins(0, 0, 0, 0);
+    layout->setSpacing(2);
+
+    hide();
+}
+
+quint64 FileTransfersWidget::key(int fileNumber, FileTransferInfo::Direction direction)
+{
+    return (quint64(direction) << 32) | quint32(fileNumber);
+}
+
+QString FileTransfersWidget::formatSize(qint64 bytes)
+{
+    if (bytes < 1024) {
+        return tr("%1 B").arg(bytes);
+    } else if (bytes < 1024 * 1024) {
+        return tr("%1 KiB").arg(bytes / 1024.0, 0, 'f', 1);
+    } else if (bytes < 1024 * 1024 * 1024) {
+        return tr("%1 MiB").arg(bytes / (1024.0 * 1024), 0, 'f', 1);
+    }
+    return tr("%1 GiB").arg(bytes / (1024.0 * 1024 * 1024), 0, 'f', 2);
+}
+
+bool FileTransfersWidget::hasActiveTransfers() const
+{
+    for (const Row* row : rows) {
+        if (!row->info.isOver()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+FileTransfersWidget::Row* FileTransfersWidget::createRow(const FileTransferInfo& info)
+{
+    Row* row = new Row();
+    row->widget = new QWidget(this);
+    row->nameLabel = new QLabel(row->widget);
+    row->progressBar = new QProgressBar(row->widget);
+    row->progressBar->setRange(0, 1000);
+    row->rateLabel = new QLabel(row->widget);
+
+    const quint64 rowKey = key(info.fileNumber, info.direction);
+
+    row->acceptButton = new QPushButton(tr("Accept"), row->widget);
+    row->acceptButton->setProperty("rowKey", rowKey);
+    connect(row->acceptButton, &QPushButton::clicked, this, &FileTransfersWidget::onAcceptClicked);
+
+    row->cancelButton = new QPushButton(QIcon(":/icons/cross.png"), QString(), row->widget);
+    row->cancelButton->setProperty("rowKey", rowKey);
+    connect(row->cancelButton, &QPushButton::clicked, this, &FileTransfersWidget::onCancelClicked);
+
+    QHBoxLayout* rowLayout = new QHBoxLayout(row->widget);
+    rowLayout->setContentsMargins(0, 0, 0, 0);
+    rowLayout->addWidget(row->nameLabel);
+    rowLayout->addWidget(row->progressBar, 1);
+    rowLayout->addWidget(row->rateLabel);
+    rowLayout->addWidget(row->acceptButton);
+    rowLayout->addWidget(row->cancelButton);
+
+    layout->addWidget(row->widget);
+    rows.insert(rowKey, row);
+    show();
+
+    return row;
+}
+
+void FileTransfersWidget::removeRow(quint64 rowKey)
+{
+    Row* row = rows.take(rowKey);
+    if (!row) {
+        return;
+    }
+
+    delete row->widget;
+    delete row;
+
+    if (rows.isEmpty()) {
+        hide();
+    }
+}
+
+void FileTransfersWidget::updateTransfer(const FileTransferInfo& info)
+{
+    Row* row = rows.value(key(info.fileNumber, info.direction), nullptr);
+    if (!row) {
+        // toxcore reuses file numbers, a new transfer replaces the ended one that had it
+        row = createRow(info);
+    }
+    row->info = info;
+
+    const bool sending = info.direction == FileTransferInfo::Direction::Sending;
+    row->nameLabel->setText((sending ? tr("Sending %1") : tr("Receiving %1")).arg(info.fileName));
+    row->progressBar->setValue(info.size > 0 ? int(info.transferred * 1000 / info.size) : 0);
+    row->progressBar->setFormat(tr("%1 of %2").arg(formatSize(info.transferred)).arg(formatSize(info.size)));
+
+    switch (info.state) {
+        case FileTransferInfo::State::Pending:
+            row->rateLabel->setText(sending ? tr("Waiting...") : QString());
+            break;
+        case FileTransferInfo::State::Transferring:
+            row->rateLabel->setText(tr("%1/s").arg(formatSize(info.bytesPerSecond)));
+            break;
+        case FileTransferInfo::State::Paused:
+            row->rateLabel->setText(tr("Paused"));
+            break;
+        case FileTransferInfo::State::Interrupted:
+            row->rateLabel->setText(tr("Interrupted"));
+            break;
+        case FileTransferInfo::State::Finished:
+            row->rateLabel->setText(tr("Done"));
+            break;
+        case FileTransferInfo::State::Cancelled:
+            row->rateLabel->setText(tr("Cancelled"));
+            break;
+        case FileTransferInfo::State::Failed:
+            row->rateLabel->setText(tr("Failed"));
+            break;
+    }
+
+    row->acceptButton->setVisible(!sending && info.state == FileTransferInfo::State::Pending);
+    row->cancelButton->setToolTip(info.isOver() ? tr("Dismiss") : tr("Cancel"));
+}
+
+void FileTransfersWidget::onAcceptClicked()
+{
+    if (Row* row = rows.value(sender()->property("rowKey").toULongLong(), nullptr)) {
+        emit acceptRequested(row->info.fileNumber, row->info.fileName);
+    }
+}
+
+void FileTransfersWidget::onCancelClicked()
+{
+    const quint64 rowKey = sender()->property("rowKey").toULongLong();
+    Row* row = rows.value(rowKey, nullptr);
+    if (!row) {
+        return;
+    }
+
+    if (row->info.isOver()) {
+        removeRow(rowKey);
+    } else {
+        emit cancelRequested(row->info.fileNumber, row->info.direction);
+    }
+}
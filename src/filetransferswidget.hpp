@@ -0,0 +1,76 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef FILETRANSFERSWIDGET_HPP
+#define FILETRANSFERSWIDGET_HPP
+
+#include "filetransfer.hpp"
+
+#include <QHash>
+#include <QWidget>
+
+class QLabel;
+class QProgressBar;
+class QPushButton;
+class QVBoxLayout;
+
+// The file transfers of a chat page, one row each. Rows of transfers that are
+// over stay until dismissed.
+class FileTransfersWidget : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit FileTransfersWidget(QWidget* parent = 0);
+
+    // there are transfers that haven't ended yet
+    bool hasActiveTransfers() const;
+
+public slots:
+    void updateTransfer(const FileTransferInfo& info);
+
+signals:
+    void acceptRequested(int fileNumber, const QString& fileName);
+    void cancelRequested(int fileNumber, FileTransferInfo::Direction direction);
+
+private:
+    struct Row
+    {
+        FileTransferInfo info;
+        QWidget* widget;
+        QLabel* nameLabel;
+        QProgressBar* progressBar;
+        QLabel* rateLabel;
+        QPushButton* acceptButton;
+        QPushButton* cancelButton;
+    };
+
+    static quint64 key(int fileNumber, FileTransferInfo::Direction direction);
+    static QString formatSize(qint64 bytes);
+
+    Row* createRow(const FileTransferInfo& info);
+    void removeRow(quint64 rowKey);
+
+    QHash<quint64, Row*> rows;
+    QVBoxLayout* layout;
+
+private slots:
+    void onAcceptClicked();
+    void onCancelClicked();
+
+};
+
+#endif // FILETRANSFERSWIDGET_HPP
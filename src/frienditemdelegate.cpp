@@ -15,24 +15,57 @@
 */
 
 #include "frienditemdelegate.hpp"
+#include "avatarstore.hpp"
 #include "status.hpp"
 
+#include <QAbstractItemView>
 #include <QApplication>
+#include <QDateTime>
 #include <QDebug>
+#include <QHelpEvent>
 #include <QPainter>
 #include <QPen>
+#include <QToolTip>
 
 FriendItemDelegate::FriendItemDelegate(QObject* parent) :
     QStyledItemDelegate(parent)
 {
 }
 
-QSize FriendItemDelegate::sizeHint(const QStyleOptionViewItem& option, const QModelIndex& index) const
+const FriendItemDelegate::StatusIcon& FriendItemDelegate::statusIcon(Status status, const QSize& decorationSize, int devicePixelRatio) const
 {
-    QIcon statusIcon = QIcon(StatusHelper::getInfo(getStatus(index)).iconPath);
-    QSize statusIconSize = statusIcon.actualSize(option.decorationSize);
+    const quint64 key = (quint64(status) << 48) | (quint64(decorationSize.width() & 0xFFFF) << 32) | (quint64(decorationSize.height() & 0xFFFF) << 16) | quint64(devicePixelRatio & 0xFFFF);
+    QHash<quint64, StatusIcon>::const_iterator it = statusIcons.constFind(key);
+    if (it != statusIcons.constEnd()) {
+        return it.value();
+    }
+
+    QIcon icon = QIcon(StatusHelper::getInfo(status).iconPath);
+    StatusIcon statusIcon;
+    statusIcon.size = icon.actualSize(decorationSize);
+    statusIcon.pixmap = icon.pixmap(statusIcon.size * devicePixelRatio);
+    statusIcon.pixmap.setDevicePixelRatio(devicePixelRatio);
+    return statusIcons.insert(key, statusIcon).value();
+}
+
+QString FriendItemDelegate::elidedText(const QString& text, const QFontMetrics& fontMetrics, int width) const
+{
+    if (elideFont != QApplication::font() || elidedTexts.size() > MAX_ELIDED_TEXTS) {
+        elidedTexts.clear();
+        elideFont = QApplication::font();
+    }
 
-    static const int VERTICAL_PADDING = 2;
+    const QPair<QString, int> key(text, width);
+    QHash<QPair<QString, int>, QString>::const_iterator it = elidedTexts.constFind(key);
+    if (it != elidedTexts.constEnd()) {
+        return it.value();
+    }
+    return elidedTexts.insert(key, fontMetrics.elidedText(text, Qt::ElideRight, width)).value();
+}
+
+QSize FriendItemDelegate::sizeHint(const QStyleOptionViewItem& option, const QModelIndex& index) const
+{
+    QSize statusIconSize = statusIcon(getStatus(index), option.decorationSize, 1).size;
 
     return QSize(statusIconSize.width(), VERTICAL_PADDING + statusIconSize.height() + VERTICAL_PADDING);
 }
@@ -43,30 +76,68 @@ void FriendItemDelegate::paint(QPainter* painter, const QStyleOptionViewItem& op
 
     painter->save();
 
-    QSize hint = sizeHint(option, index);
-
     //Status Icon
-    QIcon statusIcon = QIcon(StatusHelper::getInfo(getStatus(index)).iconPath);
-    QSize statusIconSize = statusIcon.actualSize(option.decorationSize);
+    const StatusIcon& icon = statusIcon(getStatus(index), option.decorationSize, painter->device()->devicePixelRatio());
+    QSize statusIconSize = icon.size;
+
+    QSize hint(statusIconSize.width(), VERTICAL_PADDING + statusIconSize.height() + VERTICAL_PADDING);
 
     static const int ICON_X_OFFSET = 0;
 
-    painter->drawPixmap(ICON_X_OFFSET, option.rect.top() + (hint.height() - statusIconSize.height())/2, statusIcon.pixmap(statusIconSize.width(), statusIconSize.height()));
+    painter->drawPixmap(ICON_X_OFFSET, option.rect.top() + (hint.height() - statusIconSize.height())/2, icon.pixmap);
+
+    //Avatar, at the right and as high as the status icon, the space stays reserved while it's decoded
+    static const int AVATAR_X_OFFSET = 2;
+    int textRight = option.rect.right();
+    const QString userId = index.data(UserIdRole).toString();
+    AvatarStore& avatars = AvatarStore::getInstance();
+    if (!userId.isEmpty() && avatars.hasAvatar(userId)) {
+        const QSize avatarSize(statusIconSize.height(), statusIconSize.height());
+        textRight -= avatarSize.width() + AVATAR_X_OFFSET;
+        const QPixmap avatar = avatars.getAvatar(userId, avatarSize, painter->device()->devicePixelRatio());
+        if (!avatar.isNull()) {
+            painter->drawPixmap(option.rect.right() - avatarSize.width() + 1, option.rect.top() + (hint.height() - avatarSize.height())/2, avatar);
+        }
+    }
+
 
+    //Unread badge, left of the avatar
+    const int unreadCount = index.data(UnreadCountRole).toInt();
+    if (unreadCount > 0) {
+        static const int BADGE_X_OFFSET = 2;
+        static const int BADGE_PADDING = 4;
+        QFont badgeFont = QApplication::font();
+        badgeFont.setBold(true);
+        painter->setFont(badgeFont);
+        const QString badgeText = unreadCount > MAX_BADGE_COUNT ? QString("%1+").arg(MAX_BADGE_COUNT) : QString::number(unreadCount);
+        const int badgeHeight = painter->fontMetrics().height();
+        const int badgeWidth = qMax(badgeHeight, painter->fontMetrics().width(badgeText) + 2 * BADGE_PADDING);
+        const QRect badgeRect(textRight - badgeWidth + 1, option.rect.top() + (hint.height() - badgeHeight)/2, badgeWidth, badgeHeight);
+        textRight -= badgeWidth + BADGE_X_OFFSET;
+
+        painter->setRenderHint(QPainter::Antialiasing);
+        painter->setPen(Qt::NoPen);
+        painter->setBrush(option.palette.brush(QPalette::Highlight));
+        painter->drawRoundedRect(badgeRect, badgeHeight / 2.0, badgeHeight / 2.0);
+        painter->setPen(option.palette.color(QPalette::HighlightedText));
+        painter->drawText(badgeRect, Qt::AlignCenter, badgeText);
+        painter->setPen(option.palette.color(QPalette::Text));
+    }
 
-    //Username
+    //Username, in bold while there are unread messages
     QString username = index.data(UsernameRole).toString();
 
     QString statusMessage = index.data(StatusMessageRole).toString();
     const bool statusMessageIsVisible = statusMessage.trimmed().length() != 0;
 
     QFont usernameFont = QApplication::font();
+    usernameFont.setBold(unreadCount > 0);
 
     static const int USERNAME_X_OFFSET = 2;
     static const int USERNAME_Y_OFFSET = -3;
 
     painter->setFont(usernameFont);
-    QString elidedUsername = painter->fontMetrics().elidedText(username, Qt::ElideRight, option.rect.right() - (ICON_X_OFFSET + statusIconSize.width() + USERNAME_X_OFFSET));
+    QString elidedUsername = elidedText(username, painter->fontMetrics(), textRight - (ICON_X_OFFSET + statusIconSize.width() + USERNAME_X_OFFSET));
     painter->drawText(ICON_X_OFFSET + statusIconSize.width() + USERNAME_X_OFFSET, option.rect.top() + hint.height()/2 + ((statusMessageIsVisible ? 0 : painter->fontMetrics().ascent()) - painter->fontMetrics().descent())/2 + (statusMessageIsVisible ? USERNAME_Y_OFFSET : 0), elidedUsername);
 
     if (statusMessageIsVisible) {
@@ -78,7 +149,7 @@ void FriendItemDelegate::paint(QPainter* painter, const QStyleOptionViewItem& op
         static const int STATUSMESSAGE_X_OFFSET = USERNAME_X_OFFSET;
 
         painter->setFont(statusMessageFont);
-        QString elidedStatuseMessage = painter->fontMetrics().elidedText(statusMessage, Qt::ElideRight, option.rect.right() - (ICON_X_OFFSET + statusIconSize.width() + STATUSMESSAGE_X_OFFSET));
+        QString elidedStatuseMessage = elidedText(statusMessage, painter->fontMetrics(), textRight - (ICON_X_OFFSET + statusIconSize.width() + STATUSMESSAGE_X_OFFSET));
         painter->drawText(ICON_X_OFFSET + statusIconSize.width() + STATUSMESSAGE_X_OFFSET, option.rect.top() + hint.height()/2 + painter->fontMetrics().ascent(), elidedStatuseMessage);
     }
 
@@ -99,3 +170,32 @@ QString FriendItemDelegate::getUsername(const QModelIndex& index)
 {
     return index.data(UsernameRole).toString();
 }
+
+QString FriendItemDelegate::getToolTip(const QModelIndex& index)
+{
+    const QString userIdString = QString("User ID: %1").arg(index.data(UserIdRole).toString());
+    QString lastSeenString = "Last seen: ";
+
+    if (getStatus(index) == Status::Offline) {
+        QDateTime lastSeenDateTime = index.data(LastSeenRole).toDateTime();
+        if (lastSeenDateTime.isValid()) {
+            lastSeenString += lastSeenDateTime.toString(Qt::SystemLocaleShortDate);
+        } else {
+            lastSeenString += "Never";
+        }
+    } else {
+        lastSeenString += "Now";
+    }
+
+    return userIdString + "\n" + lastSeenString;
+}
+
+bool FriendItemDelegate::helpEvent(QHelpEvent* event, QAbstractItemView* view, const QStyleOptionViewItem& option, const QModelIndex& index)
+{
+    if (event->type() != QEvent::ToolTip || !index.isValid()) {
+        return QStyledItemDelegate::helpEvent(event, view, option, index);
+    }
+
+    QToolTip::showText(event->globalPos(), getToolTip(index), view);
+    return true;
+}
@@ -17,6 +17,9 @@
 #ifndef FRIENDITEMDELEGATE_HPP
 #define FRIENDITEMDELEGATE_HPP
 
+#include <QFont>
+#include <QHash>
+#include <QPixmap>
 #include <QStyledItemDelegate>
 #include "status.hpp"
 
@@ -25,15 +28,40 @@ class FriendItemDelegate : public QStyledItemDelegate
 public:
     FriendItemDelegate(QObject *parent = 0);
 
-    enum {UsernameRole = Qt::UserRole, StatusRole, StatusMessageRole, UserIdRole, FriendIdRole, LastSeenRole};
+    enum {UsernameRole = Qt::UserRole, StatusRole, StatusMessageRole, UserIdRole, FriendIdRole, LastSeenRole, GroupIdRole, UnreadCountRole, LastActivityRole};
 
     static Status getStatus(const QModelIndex& index);
     static QString getUsername(const QModelIndex& index);
+    static QString getToolTip(const QModelIndex& index);
+
+    // the tool tip is only built when it's about to be shown
+    bool helpEvent(QHelpEvent* event, QAbstractItemView* view, const QStyleOptionViewItem& option, const QModelIndex& index) Q_DECL_OVERRIDE;
 
 protected:
     void paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const Q_DECL_OVERRIDE;
     QSize sizeHint(const QStyleOptionViewItem&  option, const QModelIndex& index) const Q_DECL_OVERRIDE;
 
+private:
+    struct StatusIcon
+    {
+        QSize size;
+        QPixmap pixmap;
+    };
+
+    // rasterized status icons, keyed by status, decoration size and device pixel ratio
+    mutable QHash<quint64, StatusIcon> statusIcons;
+    // elided usernames and status messages, keyed by text and available width, for elideFont
+    mutable QHash<QPair<QString, int>, QString> elidedTexts;
+    mutable QFont elideFont;
+
+    static const int MAX_ELIDED_TEXTS = 2000;
+    static const int VERTICAL_PADDING = 2;
+    // higher counts are shown as this and a plus
+    static const int MAX_BADGE_COUNT = 99;
+
+    const StatusIcon& statusIcon(Status status, const QSize& decorationSize, int devicePixelRatio) const;
+    QString elidedText(const QString& text, const QFontMetrics& fontMetrics, int width) const;
+
 };
 
 #endif // FRIENDITEMDELEGATE_HPP
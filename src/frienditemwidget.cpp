@@ -15,9 +15,11 @@
 */
 
 #include "frienditemwidget.hpp"
+#include "avatarstore.hpp"
 
 #include <QHBoxLayout>
 #include <QVBoxLayout>
+#include <QWindow>
 
 FriendItemWidget::FriendItemWidget(QWidget* parent) :
     QWidget(parent)
@@ -59,6 +61,12 @@ FriendItemWidget::FriendItemWidget(QWidget* parent) :
     layout->setSpacing(2);
     layout->addWidget(statusLabel, 0, Qt::AlignVCenter);
     layout->addWidget(textWidget);
+
+    avatarLabel = new QLabel(this);
+    avatarLabel->setFixedSize(AVATAR_SIZE, AVATAR_SIZE);
+    avatarLabel->hide();
+    layout->addWidget(avatarLabel, 0, Qt::AlignVCenter);
+    connect(&AvatarStore::getInstance(), &AvatarStore::avatarChanged, this, &FriendItemWidget::onAvatarChanged);
 }
 
 void FriendItemWidget::setStatus(Status status)
@@ -76,3 +84,34 @@ void FriendItemWidget::setStatusMessage(const QString& statusMessage)
     statusMessageLabel->setText(statusMessage);
     statusMessageLabel->setVisible(statusMessage.trimmed().length() != 0);
 }
+
+void FriendItemWidget::setUserId(const QString& userId)
+{
+    this->userId = userId;
+    updateAvatar();
+}
+
+void FriendItemWidget::onAvatarChanged(const QString& changedUserId)
+{
+    if (changedUserId == userId) {
+        updateAvatar();
+    }
+}
+
+void FriendItemWidget::showEvent(QShowEvent* event)
+{
+    QWidget::showEvent(event);
+    // the avatar is rendered at the pixel density of the screen the window is on
+    if (QWindow* handle = window()->windowHandle()) {
+        connect(handle, &QWindow::screenChanged, this, &FriendItemWidget::updateAvatar, Qt::UniqueConnection);
+    }
+    updateAvatar();
+}
+
+void FriendItemWidget::updateAvatar()
+{
+    AvatarStore& avatars = AvatarStore::getInstance();
+    avatarLabel->setVisible(avatars.hasAvatar(userId));
+    // null while it's decoded, onAvatarChanged() sets it then
+    avatarLabel->setPixmap(avatars.getAvatar(userId, avatarLabel->size(), devicePixelRatio()));
+}
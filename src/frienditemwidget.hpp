@@ -31,15 +31,28 @@ public:
 
 private:
     QLabel* statusLabel;
+    QLabel* avatarLabel;
     CopyableElideLabel* usernameLabel;
     CopyableElideLabel* statusMessageLabel;
 
+    QString userId;
+
     static const int LINE_SPACING_OFFSET = 2;
+    static const int AVATAR_SIZE = 32;
 
 public slots:
     void setStatus(Status status);
     void setUsername(const QString& username);
     void setStatusMessage(const QString& statusMessage);
+    void setUserId(const QString& userId);
+
+protected:
+    void showEvent(QShowEvent* event);
+
+private slots:
+    // also when the window moves to a screen of another pixel density
+    void updateAvatar();
+    void onAvatarChanged(const QString& changedUserId);
 
 };
 
@@ -0,0 +1,173 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "friendlistsnapshot.hpp"
+
+#include <QBuffer>
+#include <QDataStream>
+#include <QDebug>
+#include <QFile>
+#include <QSet>
+
+FriendListSnapshot::FriendListSnapshot(const QString& filePath, QObject* parent) :
+    QObject(parent),
+    filePath(filePath),
+    enabled(true),
+    writer(filePath, SAVE_DELAY, "Friend list snapshot")
+{
+    connect(&writer, &DelayedWriter::due, this, &FriendListSnapshot::save);
+
+    load();
+}
+
+FriendListSnapshot::~FriendListSnapshot()
+{
+    writer.flush();
+}
+
+void FriendListSnapshot::load()
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_2);
+    quint32 version;
+    quint32 count;
+    stream >> version >> count;
+    if (stream.status() != QDataStream::Ok || version != FILE_VERSION) {
+        qWarning() << "Friend list snapshot" << filePath << "is unreadable, the friend list waits for the Core";
+        return;
+    }
+
+    for (quint32 i = 0; i < count; i++) {
+        qint32 friendId;
+        QString userId;
+        Friend f;
+        stream >> friendId >> userId >> f.username >> f.statusMessage >> f.lastSeen;
+        if (stream.status() != QDataStream::Ok) {
+            break;
+        }
+        f.friendId = friendId;
+        f.userId = UserId::fromString(userId);
+        if (f.userId.isValid()) {
+            friends.insert(f.friendId, f);
+        }
+    }
+}
+
+void FriendListSnapshot::save()
+{
+    if (!enabled) {
+        return;
+    }
+
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    QDataStream stream(&buffer);
+    stream.setVersion(QDataStream::Qt_5_2);
+    stream << FILE_VERSION << quint32(friends.size());
+    for (const Friend& f : friends) {
+        stream << qint32(f.friendId) << f.userId.toString() << f.username << f.statusMessage << f.lastSeen;
+    }
+
+    writer.replace(data);
+}
+
+void FriendListSnapshot::changed()
+{
+    if (enabled) {
+        writer.schedule();
+    }
+}
+
+void FriendListSnapshot::disable()
+{
+    enabled = false;
+    friends.clear();
+    writer.remove();
+}
+
+QList<FriendListSnapshot::Friend> FriendListSnapshot::getFriends() const
+{
+    return friends.values();
+}
+
+void FriendListSnapshot::addFriend(int friendId, const UserId& userId)
+{
+    QMap<int, Friend>::iterator it = friends.find(friendId);
+    if (it != friends.end() && it->userId == userId) {
+        return;
+    }
+
+    Friend f;
+    f.friendId = friendId;
+    f.userId = userId;
+    friends.insert(friendId, f);
+    changed();
+}
+
+void FriendListSnapshot::removeFriend(int friendId)
+{
+    if (friends.remove(friendId) > 0) {
+        changed();
+    }
+}
+
+void FriendListSnapshot::setUsername(int friendId, const QString& username)
+{
+    QMap<int, Friend>::iterator it = friends.find(friendId);
+    if (it != friends.end() && it->username != username) {
+        it->username = username;
+        changed();
+    }
+}
+
+void FriendListSnapshot::setStatusMessage(int friendId, const QString& statusMessage)
+{
+    QMap<int, Friend>::iterator it = friends.find(friendId);
+    if (it != friends.end() && it->statusMessage != statusMessage) {
+        it->statusMessage = statusMessage;
+        changed();
+    }
+}
+
+void FriendListSnapshot::setLastSeen(int friendId, const QDateTime& lastSeen)
+{
+    QMap<int, Friend>::iterator it = friends.find(friendId);
+    if (it != friends.end() && it->lastSeen != lastSeen) {
+        it->lastSeen = lastSeen;
+        changed();
+    }
+}
+
+void FriendListSnapshot::retainFriends(const QList<int>& friendIds)
+{
+    const QSet<int> retained = friendIds.toSet();
+    QMap<int, Friend>::iterator it = friends.begin();
+    while (it != friends.end()) {
+        if (!retained.contains(it.key())) {
+            it = friends.erase(it);
+            changed();
+        } else {
+            ++it;
+        }
+    }
+}
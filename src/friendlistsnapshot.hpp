@@ -0,0 +1,79 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef FRIENDLISTSNAPSHOT_HPP
+#define FRIENDLISTSNAPSHOT_HPP
+
+#include "delayedwriter.hpp"
+#include "userid.hpp"
+
+#include <QDateTime>
+#include <QList>
+#include <QMap>
+#include <QObject>
+
+// The friend list as the Core last reported it, so that the next start can show it right away
+// instead of waiting for the Core to load its configuration. The Profile keeps it up to date from
+// what the Core reports. Names and status messages change in bursts when friends come online, so
+// the file is rewritten only once things have been quiet for a while, and on exit.
+class FriendListSnapshot : public QObject
+{
+    Q_OBJECT
+public:
+    struct Friend {
+        int friendId;
+        UserId userId;
+        QString username;
+        QString statusMessage;
+        QDateTime lastSeen;
+    };
+
+    FriendListSnapshot(const QString& filePath, QObject* parent);
+    ~FriendListSnapshot();
+
+    // as they were at the end of the last session, by friendId
+    QList<Friend> getFriends() const;
+
+    // stops keeping the snapshot, and removes the one on disk
+    void disable();
+
+public slots:
+    void addFriend(int friendId, const UserId& userId);
+    void removeFriend(int friendId);
+    void setUsername(int friendId, const QString& username);
+    void setStatusMessage(int friendId, const QString& statusMessage);
+    void setLastSeen(int friendId, const QDateTime& lastSeen);
+    // the Core loaded its friends, the others of the snapshot are gone
+    void retainFriends(const QList<int>& friendIds);
+
+private slots:
+    void save();
+
+private:
+    void load();
+    void changed();
+
+    const QString filePath;
+    QMap<int, Friend> friends;
+    bool enabled;
+    DelayedWriter writer;
+
+    static const quint32 FILE_VERSION = 1;
+    static const int SAVE_DELAY = 30 * 1000;
+};
+
+#endif // FRIENDLISTSNAPSHOT_HPP
@@ -18,24 +18,149 @@
 #include "friendswidget.hpp"
 #include "frienditemdelegate.hpp"
 
+#include <QDateTime>
 #include <QModelIndex>
 
 FriendProxyModel::FriendProxyModel(QObject* parent) :
-    QSortFilterProxyModel(parent)
+    QSortFilterProxyModel(parent), narrowing(false), sortByActivity(false)
 {
 }
 
+void FriendProxyModel::setSourceModel(QAbstractItemModel* sourceModel)
+{
+    if (this->sourceModel() != nullptr) {
+        disconnect(this->sourceModel(), 0, this, 0);
+    }
+
+    // connected before QSortFilterProxyModel connects itself, so the rows
+    // are up to date by the time it sorts or filters inserted or changed ones
+    if (sourceModel != nullptr) {
+        connect(sourceModel, &QAbstractItemModel::rowsInserted, this, &FriendProxyModel::onRowsInserted);
+        connect(sourceModel, &QAbstractItemModel::rowsRemoved, this, &FriendProxyModel::onRowsRemoved);
+        connect(sourceModel, &QAbstractItemModel::dataChanged, this, &FriendProxyModel::onDataChanged);
+        connect(sourceModel, &QAbstractItemModel::modelReset, this, &FriendProxyModel::rebuildRows);
+        connect(sourceModel, &QAbstractItemModel::layoutChanged, this, &FriendProxyModel::rebuildRows);
+    }
+
+    rebuildRows();
+    QSortFilterProxyModel::setSourceModel(sourceModel);
+}
+
+void FriendProxyModel::setFilterQuery(const QString& query)
+{
+    const QString folded = query.toCaseFolded();
+    if (folded == filterQuery) {
+        return;
+    }
+
+    // a friend not containing the old query can't contain a longer one
+    narrowing = !filterQuery.isEmpty() && folded.contains(filterQuery);
+    filterQuery = folded;
+    invalidateFilter();
+    narrowing = false;
+}
+
+void FriendProxyModel::setSortByActivity(bool enabled)
+{
+    if (enabled == sortByActivity) {
+        return;
+    }
+
+    sortByActivity = enabled;
+    invalidate();
+}
+
+FriendProxyModel::Row FriendProxyModel::row(int sourceRow) const
+{
+    QModelIndex index = sourceModel()->index(sourceRow, 0);
+    const QString username = FriendItemDelegate::getUsername(index);
+    const QDateTime lastActivity = index.data(FriendItemDelegate::LastActivityRole).toDateTime();
+    Row row = {static_cast<int>(FriendItemDelegate::getStatus(index)), lastActivity.isValid() ? lastActivity.toMSecsSinceEpoch() : 0,
+               collator.sortKey(username),
+               (username + '\n' + index.data(FriendItemDelegate::StatusMessageRole).toString() + '\n' + index.data(FriendItemDelegate::UserIdRole).toString()).toCaseFolded(),
+               true};
+    return row;
+}
+
+void FriendProxyModel::rebuildRows()
+{
+    rows.clear();
+    if (sourceModel() == nullptr) {
+        return;
+    }
+
+    const int count = sourceModel()->rowCount();
+    rows.reserve(count);
+    for (int r = 0; r < count; r++) {
+        rows.push_back(row(r));
+    }
+}
+
+void FriendProxyModel::onRowsInserted(const QModelIndex& parent, int first, int last)
+{
+    if (parent.isValid()) {
+        return;
+    }
+
+    for (int r = first; r <= last; r++) {
+        rows.insert(rows.begin() + r, row(r));
+    }
+}
+
+void FriendProxyModel::onRowsRemoved(const QModelIndex& parent, int first, int last)
+{
+    if (parent.isValid()) {
+        return;
+    }
+
+    rows.erase(rows.begin() + first, rows.begin() + last + 1);
+}
+
+void FriendProxyModel::onDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight, const QVector<int>& roles)
+{
+    if (topLeft.parent().isValid()) {
+        return;
+    }
+
+    // tooltips, last seen times and unread counts neither affect the order nor the filter
+    if (!roles.isEmpty() && !roles.contains(FriendItemDelegate::StatusRole) && !roles.contains(FriendItemDelegate::UsernameRole)
+            && !roles.contains(FriendItemDelegate::StatusMessageRole) && !roles.contains(FriendItemDelegate::UserIdRole)
+            && !roles.contains(FriendItemDelegate::LastActivityRole)) {
+        return;
+    }
+
+    for (int r = topLeft.row(); r <= bottomRight.row(); r++) {
+        rows[r] = row(r);
+    }
+}
+
+bool FriendProxyModel::filterAcceptsRow(int sourceRow, const QModelIndex& sourceParent) const
+{
+    if (sourceParent.isValid() || sourceRow >= static_cast<int>(rows.size())) {
+        return true;
+    }
+
+    Row& r = rows[sourceRow];
+    if (narrowing && !r.accepted) {
+        return false;
+    }
+    r.accepted = filterQuery.isEmpty() || r.filterText.contains(filterQuery);
+    return r.accepted;
+}
+
 bool FriendProxyModel::lessThan(const QModelIndex& left, const QModelIndex& right) const
 {
-    Status leftStatus = FriendItemDelegate::getStatus(left);
-    QString leftName = FriendItemDelegate::getUsername(left);
+    const Row& leftRow = rows[left.row()];
+    const Row& rightRow = rows[right.row()];
 
-    Status rightStatus = FriendItemDelegate::getStatus(right);
-    QString rightName = FriendItemDelegate::getUsername(right);
+    // the view sorts in descending order, the most recent activity is the greatest
+    if (sortByActivity && leftRow.lastActivity != rightRow.lastActivity) {
+        return leftRow.lastActivity < rightRow.lastActivity;
+    }
 
-    if (leftStatus == rightStatus) {
-        return leftName.localeAwareCompare(rightName) > 0;
+    if (leftRow.statusRank == rightRow.statusRank) {
+        return leftRow.nameKey.compare(rightRow.nameKey) > 0;
     } else {
-        return leftStatus > rightStatus;
+        return leftRow.statusRank > rightRow.statusRank;
     }
 }
@@ -19,16 +19,58 @@
 
 #include "status.hpp"
 
+#include <QCollator>
 #include <QSortFilterProxyModel>
 
+#include <vector>
+
+// Sorts friends by status, then by name, and filters them by a query. Optionally the friends
+// with the most recent messages come first, by the LastActivityRole the ActivityIndex sets.
+// Sort keys and filter texts are computed once per source row and updated when
+// the row changes, comparisons only look at integers and collation keys.
 class FriendProxyModel : public QSortFilterProxyModel
 {
 public:
     FriendProxyModel(QObject* parent = 0);
 
+    void setSourceModel(QAbstractItemModel* sourceModel) Q_DECL_OVERRIDE;
+
+    // shows friends whose name, status message or user id contain query, case insensitively
+    void setFilterQuery(const QString& query);
+    void setSortByActivity(bool enabled);
+
 protected:
+    bool filterAcceptsRow(int sourceRow, const QModelIndex& sourceParent) const Q_DECL_OVERRIDE;
     bool lessThan(const QModelIndex& left, const QModelIndex& right) const;
 
+private:
+    struct Row
+    {
+        int statusRank;
+        // ms since epoch, 0 without any activity
+        qint64 lastActivity;
+        QCollatorSortKey nameKey;
+        // case folded name, status message and user id
+        QString filterText;
+        bool accepted;
+    };
+
+    QCollator collator;
+    // one per source row, QCollatorSortKey can't be default constructed
+    mutable std::vector<Row> rows;
+
+    QString filterQuery;
+    // set while the query only got longer, rows that didn't match before are skipped
+    bool narrowing;
+    bool sortByActivity;
+
+    Row row(int sourceRow) const;
+    void rebuildRows();
+
+    void onRowsInserted(const QModelIndex& parent, int first, int last);
+    void onRowsRemoved(const QModelIndex& parent, int first, int last);
+    void onDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight, const QVector<int>& roles);
+
 };
 
 #endif // FRIENDPROXYMODEL_HPP
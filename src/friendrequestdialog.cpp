@@ -15,41 +15,69 @@
 */
 
 #include "friendrequestdialog.hpp"
+#include "friendrequestmodel.hpp"
 
 #include <QVBoxLayout>
 #include <QDialogButtonBox>
+#include <QHeaderView>
 #include <QLabel>
 #include <QLineEdit>
 #include <QPlainTextEdit>
 #include <QPushButton>
+#include <QTableView>
 
-FriendRequestDialog::FriendRequestDialog(QWidget *parent, const QString &userId, const QString &message) :
-    QDialog(parent)
+FriendRequestDialog::FriendRequestDialog(QWidget *parent, FriendRequestModel* model) :
+    QDialog(parent), model(model)
 {
     setWindowFlags(windowFlags() & ~Qt::WindowContextHelpButtonHint);
-    setWindowTitle("Friend request");
+    setWindowTitle(tr("Friend requests"));
 
-    QLabel *friendsLabel = new QLabel("Someone wants to make friends with you.", this);
-    QLabel *userIdLabel = new QLabel("User ID:", this);
-    QLineEdit *userIdEdit = new QLineEdit(userId, this);
-    userIdEdit->setCursorPosition(0);
+    countLabel = new QLabel(this);
+    droppedLabel = new QLabel(this);
+    droppedLabel->setWordWrap(true);
+    droppedLabel->hide();
+
+    view = new QTableView(this);
+    view->setModel(model);
+    view->setSelectionBehavior(QAbstractItemView::SelectRows);
+    view->setSelectionMode(QAbstractItemView::SingleSelection);
+    view->setWordWrap(false);
+    view->setShowGrid(false);
+    view->verticalHeader()->hide();
+    // rows of a fixed height, so the view doesn't measure every one of a flood
+    view->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    view->verticalHeader()->setDefaultSectionSize(view->fontMetrics().height() + 4);
+    view->horizontalHeader()->setSectionResizeMode(FriendRequestModel::MessageColumn, QHeaderView::Stretch);
+
+    QLabel *userIdLabel = new QLabel(tr("User ID:"), this);
+    userIdEdit = new QLineEdit(this);
     userIdEdit->setReadOnly(true);
-    QLabel *messageLabel = new QLabel("Friend request message:", this);
-    QPlainTextEdit *messageEdit = new QPlainTextEdit(message, this);
+    QLabel *messageLabel = new QLabel(tr("Friend request message:"), this);
+    messageEdit = new QPlainTextEdit(this);
     messageEdit->setReadOnly(true);
 
-
     QDialogButtonBox *buttonBox = new QDialogButtonBox(Qt::Horizontal, this);
+    acceptButton = buttonBox->addButton(tr("Accept"), QDialogButtonBox::ActionRole);
+    rejectButton = buttonBox->addButton(tr("Reject"), QDialogButtonBox::ActionRole);
+    QPushButton* rejectAllButton = buttonBox->addButton(tr("Reject all"), QDialogButtonBox::ActionRole);
+    buttonBox->addButton(QDialogButtonBox::Close);
 
-    buttonBox->addButton("Accept", QDialogButtonBox::AcceptRole);
-    buttonBox->addButton("Reject", QDialogButtonBox::RejectRole);
+    connect(acceptButton, &QPushButton::clicked, this, &FriendRequestDialog::onAcceptButtonClicked);
+    connect(rejectButton, &QPushButton::clicked, this, &FriendRequestDialog::onRejectButtonClicked);
+    connect(rejectAllButton, &QPushButton::clicked, this, &FriendRequestDialog::onRejectAllButtonClicked);
+    connect(buttonBox, &QDialogButtonBox::rejected, this, &FriendRequestDialog::hide);
 
-    connect(buttonBox, &QDialogButtonBox::accepted, this, &FriendRequestDialog::accept);
-    connect(buttonBox, &QDialogButtonBox::rejected, this, &FriendRequestDialog::reject);
+    connect(model, &FriendRequestModel::rowsInserted, this, &FriendRequestDialog::updateCount);
+    connect(model, &FriendRequestModel::rowsRemoved, this, &FriendRequestDialog::updateCount);
+    connect(model, &FriendRequestModel::modelReset, this, &FriendRequestDialog::updateCount);
+    connect(model, &FriendRequestModel::droppedCountChanged, this, &FriendRequestDialog::updateDroppedCount);
+    connect(view->selectionModel(), &QItemSelectionModel::currentRowChanged, this, &FriendRequestDialog::showCurrent);
 
     QVBoxLayout *layout = new QVBoxLayout(this);
 
-    layout->addWidget(friendsLabel);
+    layout->addWidget(countLabel);
+    layout->addWidget(droppedLabel);
+    layout->addWidget(view);
     layout->addSpacing(12);
     layout->addWidget(userIdLabel);
     layout->addWidget(userIdEdit);
@@ -57,5 +85,80 @@ FriendRequestDialog::FriendRequestDialog(QWidget *parent, const QString &userId,
     layout->addWidget(messageEdit);
     layout->addWidget(buttonBox);
 
-    resize(300, 200);
+    updateCount();
+    updateDroppedCount(model->getDroppedCount());
+
+    resize(500, 400);
+}
+
+int FriendRequestDialog::getCurrentRow() const
+{
+    const QModelIndex current = view->selectionModel()->currentIndex();
+    return current.isValid() ? current.row() : -1;
+}
+
+void FriendRequestDialog::updateCount()
+{
+    const int count = model->rowCount();
+    countLabel->setText(tr("%n people want to make friends with you.", "", count));
+
+    // answering the first request of a wave doesn't need a click on it first
+    if (getCurrentRow() == -1 && count > 0) {
+        view->selectionModel()->setCurrentIndex(model->index(0, 0), QItemSelectionModel::ClearAndSelect | QItemSelectionModel::Rows);
+    }
+    showCurrent();
+}
+
+void FriendRequestDialog::updateDroppedCount(int count)
+{
+    droppedLabel->setText(tr("%n more requests were ignored, because too many were waiting for an answer.", "", count));
+    droppedLabel->setVisible(count > 0);
+}
+
+void FriendRequestDialog::showCurrent()
+{
+    const int row = getCurrentRow();
+    if (row == -1) {
+        userIdEdit->clear();
+        messageEdit->clear();
+    } else {
+        userIdEdit->setText(model->getUserId(row).toString());
+        userIdEdit->setCursorPosition(0);
+        messageEdit->setPlainText(model->getMessage(row));
+    }
+    acceptButton->setEnabled(row != -1);
+    rejectButton->setEnabled(row != -1);
+}
+
+void FriendRequestDialog::answerCurrent(bool accept)
+{
+    const int row = getCurrentRow();
+    if (row == -1) {
+        return;
+    }
+
+    if (accept) {
+        emit friendRequestAccepted(model->getUserId(row));
+    }
+    model->removeRequest(row);
+
+    if (model->rowCount() == 0) {
+        hide();
+    }
+}
+
+void FriendRequestDialog::onAcceptButtonClicked()
+{
+    answerCurrent(true);
+}
+
+void FriendRequestDialog::onRejectButtonClicked()
+{
+    answerCurrent(false);
+}
+
+void FriendRequestDialog::onRejectAllButtonClicked()
+{
+    model->clear();
+    hide();
 }
@@ -17,14 +17,49 @@
 #ifndef FRIENDREQUESTDIALOG_HPP
 #define FRIENDREQUESTDIALOG_HPP
 
+#include "userid.hpp"
+
 #include <QDialog>
 
+class FriendRequestModel;
+class QLabel;
+class QLineEdit;
+class QPlainTextEdit;
+class QPushButton;
+class QTableView;
+
+// All friend requests waiting for an answer, in a single list, so that a flood of
+// them costs a few rows of a view instead of a dialog each
 class FriendRequestDialog : public QDialog
 {
     Q_OBJECT
 public:
-    explicit FriendRequestDialog(QWidget *parent, const QString &userId, const QString &message);
-    
+    explicit FriendRequestDialog(QWidget *parent, FriendRequestModel* model);
+
+signals:
+    void friendRequestAccepted(const UserId& userId);
+
+private:
+    FriendRequestModel* model;
+    QLabel* countLabel;
+    QLabel* droppedLabel;
+    QTableView* view;
+    QLineEdit* userIdEdit;
+    QPlainTextEdit* messageEdit;
+    QPushButton* acceptButton;
+    QPushButton* rejectButton;
+
+    int getCurrentRow() const;
+    void answerCurrent(bool accept);
+
+private slots:
+    void updateCount();
+    void updateDroppedCount(int count);
+    void showCurrent();
+    void onAcceptButtonClicked();
+    void onRejectButtonClicked();
+    void onRejectAllButtonClicked();
+
 };
 
 #endif // FRIENDREQUESTDIALOG_HPP
@@ -0,0 +1,156 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "friendrequestmodel.hpp"
+
+#include <QTimer>
+
+FriendRequestModel::FriendRequestModel(QObject* parent) :
+    QAbstractTableModel(parent), droppedCount(0)
+{
+    batchTimer = new QTimer(this);
+    batchTimer->setSingleShot(true);
+    batchTimer->setInterval(BATCH_INTERVAL);
+    connect(batchTimer, &QTimer::timeout, this, &FriendRequestModel::addQueuedRequests);
+}
+
+int FriendRequestModel::rowCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : requests.size();
+}
+
+int FriendRequestModel::columnCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : ColumnCount;
+}
+
+QVariant FriendRequestModel::data(const QModelIndex& index, int role) const
+{
+    if (!index.isValid() || index.row() >= requests.size()) {
+        return QVariant();
+    }
+
+    const Request& request = requests[index.row()];
+    if (role == Qt::DisplayRole) {
+        switch (index.column()) {
+            case UserIdColumn:
+                return request.userId.toString();
+            case MessageColumn:
+                // a single line, the whole message is shown below the list
+                return request.message.simplified();
+            case ReceivedColumn:
+                return request.received.toString(Qt::DefaultLocaleShortDate);
+        }
+    } else if (role == Qt::ToolTipRole && index.column() == MessageColumn) {
+        return request.message;
+    }
+    return QVariant();
+}
+
+QVariant FriendRequestModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole) {
+        return QVariant();
+    }
+
+    switch (section) {
+        case UserIdColumn:
+            return tr("User ID");
+        case MessageColumn:
+            return tr("Message");
+        case ReceivedColumn:
+            return tr("Received");
+    }
+    return QVariant();
+}
+
+void FriendRequestModel::addRequest(const UserId& userId, const QString& message)
+{
+    if (knownUsers.contains(userId)) {
+        return;
+    }
+
+    if (knownUsers.size() >= MAX_REQUESTS) {
+        droppedCount++;
+        emit droppedCountChanged(droppedCount);
+        return;
+    }
+
+    Request request;
+    request.userId = userId;
+    request.message = message;
+    request.received = QDateTime::currentDateTime();
+    queuedRequests.enqueue(request);
+    knownUsers.insert(userId);
+
+    // the first request of a wave is shown right away, the rest follows in batches
+    if (!batchTimer->isActive()) {
+        addQueuedRequests();
+    }
+}
+
+void FriendRequestModel::addQueuedRequests()
+{
+    const int count = qMin(BATCH_SIZE, queuedRequests.size());
+    if (count == 0) {
+        return;
+    }
+
+    beginInsertRows(QModelIndex(), requests.size(), requests.size() + count - 1);
+    for (int i = 0; i < count; i++) {
+        requests << queuedRequests.dequeue();
+    }
+    endInsertRows();
+    emit requestsAdded();
+
+    batchTimer->start();
+}
+
+void FriendRequestModel::removeRequest(int row)
+{
+    if (row < 0 || row >= requests.size()) {
+        return;
+    }
+
+    beginRemoveRows(QModelIndex(), row, row);
+    knownUsers.remove(requests.takeAt(row).userId);
+    endRemoveRows();
+}
+
+void FriendRequestModel::clear()
+{
+    beginResetModel();
+    requests.clear();
+    queuedRequests.clear();
+    knownUsers.clear();
+    endResetModel();
+}
+
+const UserId& FriendRequestModel::getUserId(int row) const
+{
+    return requests[row].userId;
+}
+
+const QString& FriendRequestModel::getMessage(int row) const
+{
+    return requests[row].message;
+}
+
+int FriendRequestModel::getDroppedCount() const
+{
+    return droppedCount;
+}
@@ -0,0 +1,85 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef FRIENDREQUESTMODEL_HPP
+#define FRIENDREQUESTMODEL_HPP
+
+#include "userid.hpp"
+
+#include <QAbstractTableModel>
+#include <QDateTime>
+#include <QList>
+#include <QQueue>
+#include <QSet>
+
+class QTimer;
+
+// Friend requests waiting for the user's answer. Repeated requests from the same
+// user are ignored, and a flood of them is let into the model in batches at a
+// limited rate. Once MAX_REQUESTS are waiting, further ones are only counted.
+class FriendRequestModel : public QAbstractTableModel
+{
+    Q_OBJECT
+public:
+    enum Column {UserIdColumn, MessageColumn, ReceivedColumn, ColumnCount};
+
+    explicit FriendRequestModel(QObject* parent);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const;
+    QVariant data(const QModelIndex& index, int role) const;
+    QVariant headerData(int section, Qt::Orientation orientation, int role) const;
+
+    void addRequest(const UserId& userId, const QString& message);
+    void removeRequest(int row);
+    // removes the requests that are shown as well as the ones still queued
+    void clear();
+
+    const UserId& getUserId(int row) const;
+    const QString& getMessage(int row) const;
+    int getDroppedCount() const;
+
+    static const int MAX_REQUESTS = 1000;
+    // at most this many requests are added per BATCH_INTERVAL
+    static const int BATCH_SIZE = 50;
+    static const int BATCH_INTERVAL = 250; // ms
+
+signals:
+    // once per batch
+    void requestsAdded();
+    void droppedCountChanged(int count);
+
+private slots:
+    void addQueuedRequests();
+
+private:
+    struct Request
+    {
+        UserId userId;
+        QString message;
+        QDateTime received;
+    };
+
+    QList<Request> requests;
+    QQueue<Request> queuedRequests;
+    // everyone in requests or queuedRequests
+    QSet<UserId> knownUsers;
+    QTimer* batchTimer;
+    int droppedCount;
+};
+
+#endif // FRIENDREQUESTMODEL_HPP
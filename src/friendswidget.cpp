@@ -14,9 +14,11 @@
     See the COPYING file for more details.
 */
 
+#include "avatarstore.hpp"
 #include "friendproxymodel.hpp"
 #include "friendswidget.hpp"
 #include "frienditemdelegate.hpp"
+#include "Settings/settings.hpp"
 
 #include <QAction>
 #include <QClipboard>
@@ -37,26 +39,42 @@ FriendsWidget::FriendsWidget(QWidget* parent) :
     QAction* removeFriendAction = new QAction(QIcon(":/icons/user_delete.png"), "Remove", this);
     connect(removeFriendAction, &QAction::triggered, this, &FriendsWidget::onRemoveFriendActionTriggered);
 
+    QAction* openInWindowAction = new QAction(tr("Open in New Window"), this);
+    connect(openInWindowAction, &QAction::triggered, this, &FriendsWidget::onOpenInWindowActionTriggered);
+
     friendContextMenu = new QMenu(this);
+    friendContextMenu->addAction(openInWindowAction);
+    friendContextMenu->addSeparator();
     friendContextMenu->addActions(QList<QAction*>() << copyUserIdAction << removeFriendAction);
+    // filled with the groups when the menu is shown
+    inviteMenu = friendContextMenu->addMenu(tr("Invite to group chat"));
+
+    groupContextMenu = new QMenu(this);
+    groupContextMenu->addAction(tr("Leave group chat"), this, SLOT(onLeaveGroupActionTriggered()));
 
     friendView = new QTreeView(this);
     friendView->setSizePolicy(QSizePolicy::Ignored, QSizePolicy::Expanding);
     friendView->setIconSize(QSize(32, 32));
     friendView->setSortingEnabled(true);
     friendView->setIndentation(0);
+    // every row has the same height, so the view only lays out and paints the visible ones
+    friendView->setUniformRowHeights(true);
     friendView->setHeaderHidden(true);
     friendView->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
     friendView->setItemDelegateForColumn(0, new FriendItemDelegate(this));
+    // avatars are decoded in the background, the rows showing them are painted once they are there
+    connect(&AvatarStore::getInstance(), &AvatarStore::avatarChanged, friendView->viewport(), static_cast<void (QWidget::*)()>(&QWidget::update));
     friendView->setContextMenuPolicy(Qt::CustomContextMenu);
     connect(friendView, &QTreeView::customContextMenuRequested, this, &FriendsWidget::onFriendContextMenuRequested);
 
     friendModel = new QStandardItemModel(this);
 
     friendProxyModel = new FriendProxyModel(this);
-    friendProxyModel->setFilterRole(FriendItemDelegate::UsernameRole);
-    friendProxyModel->setFilterCaseSensitivity(Qt::CaseInsensitive);
     friendProxyModel->setSourceModel(friendModel);
+    friendProxyModel->setSortByActivity(Settings::getInstance().isSortFriendsByActivityEnabled());
+    connect(&Settings::getInstance(), &Settings::sortFriendsByActivityChanged, this, [this]() {
+        friendProxyModel->setSortByActivity(Settings::getInstance().isSortFriendsByActivityEnabled());
+    });
 
     friendView->setModel(friendProxyModel);
     connect(friendView->selectionModel(), &QItemSelectionModel::currentChanged, this, &FriendsWidget::onFriendSelectionChanged);
@@ -64,29 +82,63 @@ FriendsWidget::FriendsWidget(QWidget* parent) :
     filterEdit = new FilterWidget(this);
     filterEdit->setPlaceholderText("Search");
     filterEdit->setSizePolicy(QSizePolicy::Ignored, QSizePolicy::Preferred);
-    connect(filterEdit, &FilterWidget::textChanged, friendProxyModel, &FriendProxyModel::setFilterFixedString);
+    connect(filterEdit, &FilterWidget::textChanged, friendProxyModel, &FriendProxyModel::setFilterQuery);
 
     layout->addWidget(filterEdit);
     layout->addWidget(friendView);
 }
 
-void FriendsWidget::addFriend(int friendId, const QString& userId)
+void FriendsWidget::addFriend(int friendId, const UserId& userId)
 {
+    if (cachedFriends.remove(friendId)) {
+        QStandardItem* cachedItem = findFriendItem(friendId);
+        if (cachedItem->data(FriendItemDelegate::UserIdRole).toString() == userId.toString()) {
+            // what the Core loads next replaces the cached name and status message
+            emit friendAdded(friendId, userId);
+            // a chat selected before the Core had it gets its page only now
+            if (friendModel->itemFromIndex(friendProxyModel->mapToSource(friendView->currentIndex())) == cachedItem) {
+                emit friendSelectionChanged(friendId);
+            }
+            return;
+        }
+        removeFriend(friendId);
+    }
+
     QStandardItem* item = new QStandardItem();
 
-    item->setData(userId, FriendItemDelegate::UsernameRole);
-    item->setData(userId, FriendItemDelegate::UserIdRole);
+    item->setData(userId.toString(), FriendItemDelegate::UsernameRole);
+    item->setData(userId.toString(), FriendItemDelegate::UserIdRole);
     item->setData(friendId, FriendItemDelegate::FriendIdRole);
     item->setData(QVariant::fromValue(Status::Offline), FriendItemDelegate::StatusRole);
     item->setFlags(item->flags() & ~Qt::ItemIsEditable);
 
     friendModel->appendRow(item);
-
-    updateToolTip(item);
+    friendItems.insert(friendId, item);
 
     emit friendAdded(friendId, userId);
 }
 
+void FriendsWidget::addCachedFriend(int friendId, const UserId& userId, const QString& username, const QString& statusMessage, const QDateTime& lastSeen)
+{
+    if (findFriendItem(friendId) != nullptr) {
+        return;
+    }
+
+    QStandardItem* item = new QStandardItem();
+
+    item->setData(username.isEmpty() ? userId.toString() : username, FriendItemDelegate::UsernameRole);
+    item->setData(userId.toString(), FriendItemDelegate::UserIdRole);
+    item->setData(friendId, FriendItemDelegate::FriendIdRole);
+    item->setData(QVariant::fromValue(Status::Offline), FriendItemDelegate::StatusRole);
+    item->setData(statusMessage, FriendItemDelegate::StatusMessageRole);
+    item->setData(lastSeen, FriendItemDelegate::LastSeenRole);
+    item->setFlags(item->flags() & ~Qt::ItemIsEditable);
+
+    friendModel->appendRow(item);
+    friendItems.insert(friendId, item);
+    cachedFriends.insert(friendId);
+}
+
 void FriendsWidget::setStatus(int friendId, Status status)
 {
     QStandardItem* friendItem = findFriendItem(friendId);
@@ -96,8 +148,6 @@ void FriendsWidget::setStatus(int friendId, Status status)
     }
 
     friendItem->setData(QVariant::fromValue(status), FriendItemDelegate::StatusRole);
-
-    updateToolTip(friendItem);
 }
 
 void FriendsWidget::setUsername(int friendId, const QString& username)
@@ -124,12 +174,7 @@ void FriendsWidget::setStatusMessage(int friendId, const QString& statusMessage)
 
 QStandardItem* FriendsWidget::findFriendItem(int friendId) const
 {
-    QModelIndexList indexList = friendModel->match(friendModel->index(0, 0), FriendItemDelegate::FriendIdRole, friendId);
-    if (indexList.size() == 1) {
-        return friendModel->itemFromIndex(indexList.at(0));
-    }
-
-    return nullptr;
+    return friendItems.value(friendId, nullptr);
 }
 
 void FriendsWidget::onFriendContextMenuRequested(const QPoint& pos)
@@ -140,9 +185,38 @@ void FriendsWidget::onFriendContextMenuRequested(const QPoint& pos)
     if (selectedIndexes.size() != 1) {
         return;
     }
+
+    if (friendProxyModel->mapToSource(selectedIndexes.first()).data(FriendItemDelegate::GroupIdRole).isValid()) {
+        groupContextMenu->exec(globalPos);
+        return;
+    }
+
+    inviteMenu->clear();
+    for (QStandardItem* groupItem : groupItems) {
+        QAction* action = inviteMenu->addAction(groupItem->data(FriendItemDelegate::UsernameRole).toString(), this, SLOT(onInviteActionTriggered()));
+        action->setData(groupItem->data(FriendItemDelegate::GroupIdRole));
+    }
+    inviteMenu->setEnabled(!groupItems.isEmpty());
     friendContextMenu->exec(globalPos);
 }
 
+void FriendsWidget::onInviteActionTriggered()
+{
+    QModelIndex selectedIndex = friendView->selectionModel()->selectedIndexes().at(0);
+    int friendId = friendProxyModel->mapToSource(selectedIndex).data(FriendItemDelegate::FriendIdRole).toInt();
+    int groupId = static_cast<QAction*>(sender())->data().toInt();
+
+    emit inviteToGroupRequested(friendId, groupId);
+}
+
+void FriendsWidget::onLeaveGroupActionTriggered()
+{
+    QModelIndex selectedIndex = friendView->selectionModel()->selectedIndexes().at(0);
+    int groupId = friendProxyModel->mapToSource(selectedIndex).data(FriendItemDelegate::GroupIdRole).toInt();
+
+    emit leaveGroupRequested(groupId);
+}
+
 void FriendsWidget::onCopyUserIdActionTriggered()
 {
     // friendContextMenuRequested already made sure that there is only one index selected
@@ -159,6 +233,15 @@ void FriendsWidget::onRemoveFriendActionTriggered()
     emit friendRemoved(friendId);
 }
 
+void FriendsWidget::onOpenInWindowActionTriggered()
+{
+    QModelIndex selectedIndex = friendView->selectionModel()->selectedIndexes().at(0);
+
+    int friendId = friendProxyModel->mapToSource(selectedIndex).data(FriendItemDelegate::FriendIdRole).toInt();
+
+    emit chatDetachRequested(friendId);
+}
+
 void FriendsWidget::removeFriend(int friendId)
 {
     QStandardItem* friendItem = findFriendItem(friendId);
@@ -167,17 +250,41 @@ void FriendsWidget::removeFriend(int friendId)
         return;
     }
 
+    friendItems.remove(friendId);
+    cachedFriends.remove(friendId);
     qDeleteAll(friendModel->takeRow(friendItem->row()));
 }
 
 void FriendsWidget::onFriendSelectionChanged(const QModelIndex& current, const QModelIndex& /*previous*/)
 {
     QStandardItem* item = friendModel->itemFromIndex(friendProxyModel->mapToSource(current));
-    if (item != nullptr) {
+    if (item == nullptr) {
+        return;
+    }
+
+    QVariant groupId = item->data(FriendItemDelegate::GroupIdRole);
+    if (groupId.isValid()) {
+        emit groupSelectionChanged(groupId.toInt());
+    } else {
         emit friendSelectionChanged(item->data(FriendItemDelegate::FriendIdRole).toInt());
     }
 }
 
+void FriendsWidget::selectFriend(int friendId)
+{
+    QStandardItem* friendItem = findFriendItem(friendId);
+
+    if (friendItem == nullptr) {
+        return;
+    }
+
+    // a friend hidden by the filter stays unselected
+    QModelIndex index = friendProxyModel->mapFromSource(friendItem->index());
+    if (index.isValid()) {
+        friendView->setCurrentIndex(index);
+    }
+}
+
 QString FriendsWidget::getUsername(int friendId)
 {
     QStandardItem* friendItem = findFriendItem(friendId);
@@ -197,26 +304,56 @@ void FriendsWidget::setLastSeen(int friendId, const QDateTime &dateTime) {
     }
 
     friendItem->setData(dateTime, FriendItemDelegate::LastSeenRole);
+}
 
-    updateToolTip(friendItem);
+void FriendsWidget::setActivity(int friendId, int unreadCount, const QDateTime& lastActivity)
+{
+    QStandardItem* friendItem = findFriendItem(friendId);
+
+    if (friendItem == nullptr) {
+        return;
+    }
+
+    friendItem->setData(unreadCount, FriendItemDelegate::UnreadCountRole);
+    friendItem->setData(lastActivity, FriendItemDelegate::LastActivityRole);
 }
 
-void FriendsWidget::updateToolTip(QStandardItem* friendItem) const
+void FriendsWidget::addGroup(int groupId, const QString& title)
 {
-    const Status status = FriendItemDelegate::getStatus(friendItem->index());
-    const QString userIdString = QString("User ID: %1").arg(friendItem->data(FriendItemDelegate::UserIdRole).toString());
-    QString lastSeenString = "Last seen: ";
+    QStandardItem* item = new QStandardItem();
 
-    if (status == Status::Offline) {
-        QDateTime lastSeenDateTime = friendItem->data(FriendItemDelegate::LastSeenRole).toDateTime();
-        if (lastSeenDateTime.isValid()) {
-            lastSeenString += lastSeenDateTime.toString(Qt::SystemLocaleShortDate);
-        } else {
-            lastSeenString += "Never";
-        }
-    } else {
-        lastSeenString += "Now";
+    item->setData(title, FriendItemDelegate::UsernameRole);
+    item->setData(-1, FriendItemDelegate::FriendIdRole);
+    item->setData(groupId, FriendItemDelegate::GroupIdRole);
+    // sorted with the friends that are online
+    item->setData(QVariant::fromValue(Status::Online), FriendItemDelegate::StatusRole);
+    item->setFlags(item->flags() & ~Qt::ItemIsEditable);
+
+    friendModel->appendRow(item);
+    groupItems.insert(groupId, item);
+}
+
+void FriendsWidget::removeGroup(int groupId)
+{
+    QStandardItem* groupItem = groupItems.take(groupId);
+
+    if (groupItem == nullptr) {
+        return;
+    }
+
+    qDeleteAll(friendModel->takeRow(groupItem->row()));
+}
+
+void FriendsWidget::selectGroup(int groupId)
+{
+    QStandardItem* groupItem = groupItems.value(groupId, nullptr);
+
+    if (groupItem == nullptr) {
+        return;
     }
 
-    friendItem->setData(userIdString + "\n" + lastSeenString, Qt::ToolTipRole);
+    QModelIndex index = friendProxyModel->mapFromSource(groupItem->index());
+    if (index.isValid()) {
+        friendView->setCurrentIndex(index);
+    }
 }
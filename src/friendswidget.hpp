@@ -20,11 +20,13 @@
 #include "filterwidget.hpp"
 #include "friendproxymodel.hpp"
 #include "status.hpp"
+#include "userid.hpp"
 
 #include <QDateTime>
 #include <QHash>
 #include <QMenu>
 #include <QPushButton>
+#include <QSet>
 #include <QStandardItemModel>
 #include <QTreeView>
 #include <QWidget>
@@ -42,28 +44,49 @@ private:
     QStandardItemModel* friendModel;
     FriendProxyModel* friendProxyModel;
     QMenu* friendContextMenu;
+    // friendId -> item of friendModel, kept in sync with the model so lookups don't scan it
+    QHash<int, QStandardItem*> friendItems;
+    // friends shown from the FriendListSnapshot that the Core hasn't added yet
+    QSet<int> cachedFriends;
+    // group chats are listed along with the friends, their FriendIdRole is -1
+    QMenu* groupContextMenu;
+    QMenu* inviteMenu;
+    QHash<int, QStandardItem*> groupItems;
 
     QStandardItem* findFriendItem(int friendId) const;
-    void updateToolTip(QStandardItem *friendItem) const;
 
 private slots:
     void onFriendContextMenuRequested(const QPoint& pos);
     void onCopyUserIdActionTriggered();
     void onRemoveFriendActionTriggered();
+    void onOpenInWindowActionTriggered();
+    void onInviteActionTriggered();
+    void onLeaveGroupActionTriggered();
     void onFriendSelectionChanged(const QModelIndex& current, const QModelIndex& previous);
 
 public slots:
-    void addFriend(int friendId, const QString& userId);
+    void addFriend(int friendId, const UserId& userId);
+    // Shown until the Core adds the friend for real, which keeps the item, or the Profile removes it
+    void addCachedFriend(int friendId, const UserId& userId, const QString& username, const QString& statusMessage, const QDateTime& lastSeen);
     void removeFriend(int friendId);
     void setUsername(int friendId, const QString& username);
     void setStatus(int friendId, Status status);
     void setStatusMessage(int friendId, const QString& statusMessage);
     void setLastSeen(int friendId, const QDateTime& dateTime);
+    void setActivity(int friendId, int unreadCount, const QDateTime& lastActivity);
+    void selectFriend(int friendId);
+    void addGroup(int groupId, const QString& title);
+    void removeGroup(int groupId);
+    void selectGroup(int groupId);
 
 signals:
-    void friendAdded(int friendId, const QString& userId);
+    void friendAdded(int friendId, const UserId& userId);
     void friendRemoved(int friendId);
     void friendSelectionChanged(int friendId);
+    void chatDetachRequested(int friendId);
+    void groupSelectionChanged(int groupId);
+    void inviteToGroupRequested(int friendId, int groupId);
+    void leaveGroupRequested(int groupId);
 
 };
 
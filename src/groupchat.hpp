@@ -0,0 +1,57 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef GROUPCHAT_HPP
+#define GROUPCHAT_HPP
+
+#include <QByteArray>
+#include <QList>
+#include <QMetaType>
+#include <QString>
+
+// Something that happened in a group chat during one tox_do(), Core hands
+// them over in order, all events of an iteration at once.
+struct GroupEvent
+{
+    enum class Type : int {
+        Invited,        // friendId invited us, inviteKey is what joinGroup() needs
+        PeerAdded,
+        PeerRemoved,    // toxcore moves the last peer into the number of the removed one
+        PeerRenamed,
+        MessageReceived,
+        ActionReceived
+    };
+
+    Type type;
+    int groupId;
+    int peerId;
+    int friendId;
+    QString name;       // of the peer, as it was when the event happened
+    QString text;
+    QByteArray inviteKey;
+
+    GroupEvent() :
+        type(Type::PeerAdded), groupId(-1), peerId(-1), friendId(-1) {}
+
+    GroupEvent(Type type, int groupId, int peerId) :
+        type(type), groupId(groupId), peerId(peerId), friendId(-1) {}
+};
+
+typedef QList<GroupEvent> GroupEventList;
+
+Q_DECLARE_METATYPE(GroupEventList)
+
+#endif // GROUPCHAT_HPP
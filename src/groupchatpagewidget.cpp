@@ -0,0 +1,192 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "groupchatpagewidget.hpp"
+#include "groupmembermodel.hpp"
+#include "inputtextwidget.hpp"
+
+#include "messages/chatview.hpp"
+#include "messages/messagefilter.hpp"
+#include "messages/messagemodel.hpp"
+
+#include <QHBoxLayout>
+#include <QListView>
+#include <QSortFilterProxyModel>
+#include <QSplitter>
+#include <QVBoxLayout>
+
+GroupChatPageWidget::GroupChatPageWidget(int groupId, QWidget* parent) :
+    QWidget(parent), groupId(groupId)
+{
+    titleLabel = new QLabel(this);
+    titleLabel->setTextInteractionFlags(Qt::TextSelectableByMouse);
+
+    model = new MessageModel(this);
+    filterModel = new MessageFilter(this);
+    filterModel->setSourceModel(model);
+    chatview = new ChatView(filterModel, this);
+    connect(chatview, &ChatView::atBottomChanged, model, &MessageModel::setScrollbackTrimmingEnabled);
+
+    input = new InputTextWidget(this);
+    connect(input, &InputTextWidget::sendMessage, this, &GroupChatPageWidget::sendMessage);
+    connect(input, &InputTextWidget::sendAction,  this, &GroupChatPageWidget::sendAction);
+
+    members = new GroupMemberModel(this);
+    // sorted by the proxy, so that the rows of the model can follow toxcore's peer numbers
+    sortedMembers = new QSortFilterProxyModel(this);
+    sortedMembers->setSourceModel(members);
+    sortedMembers->setSortCaseSensitivity(Qt::CaseInsensitive);
+    sortedMembers->setSortLocaleAware(true);
+    sortedMembers->setDynamicSortFilter(true);
+    sortedMembers->sort(0);
+
+    memberView = new QListView(this);
+    memberView->setModel(sortedMembers);
+    // hundreds of peers, only the visible ones are laid out
+    memberView->setUniformItemSizes(true);
+    memberView->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    memberView->setSizePolicy(QSizePolicy::Preferred, QSizePolicy::Expanding);
+
+    summaryTimer.setSingleShot(true);
+    summaryTimer.setInterval(SUMMARY_DELAY);
+    connect(&summaryTimer, &QTimer::timeout, this, &GroupChatPageWidget::flushSummary);
+
+    QSplitter* chatSplitter = new QSplitter(this);
+    chatSplitter->setOrientation(Qt::Vertical);
+    chatSplitter->setChildrenCollapsible(false);
+    chatSplitter->addWidget(chatview);
+    chatSplitter->addWidget(input);
+    chatSplitter->setStretchFactor(0, 3);
+
+    QSplitter* splitter = new QSplitter(this);
+    splitter->setChildrenCollapsible(false);
+    splitter->addWidget(chatSplitter);
+    splitter->addWidget(memberView);
+    splitter->setStretchFactor(0, 4);
+
+    QVBoxLayout* layout = new QVBoxLayout(this);
+    layout->addWidget(titleLabel);
+    layout->addWidget(splitter);
+    layout->setSpacing(2);
+    layout->setContentsMargins(0, 0, 2, 3);
+
+    updateTitle();
+}
+
+int GroupChatPageWidget::getGroupId() const
+{
+    return groupId;
+}
+
+QString GroupChatPageWidget::getTitle() const
+{
+    return tr("Group chat #%1").arg(groupId + 1);
+}
+
+void GroupChatPageWidget::updateTitle()
+{
+    titleLabel->setText(tr("%1 (%n peer(s))", "", members->rowCount()).arg(getTitle()));
+}
+
+void GroupChatPageWidget::applyEvents(const GroupEventList& events)
+{
+    const int peerCount = members->rowCount();
+
+    for (const GroupEvent& event : events) {
+        applyEvent(event);
+    }
+
+    if ((!pendingJoined.isEmpty() || !pendingLeft.isEmpty()) && !summaryTimer.isActive()) {
+        summaryTimer.start();
+    }
+    if (members->rowCount() != peerCount) {
+        updateTitle();
+    }
+}
+
+void GroupChatPageWidget::applyEvent(const GroupEvent& event)
+{
+    switch (event.type) {
+        case GroupEvent::Type::PeerAdded:
+            members->apply(event);
+            pendingJoined << members->getSerial(members->rowCount() - 1);
+            break;
+        case GroupEvent::Type::PeerRemoved: {
+            const qint64 serial = members->getSerial(event.peerId);
+            const QString name = members->apply(event);
+            // came and went within the same summary, not worth mentioning
+            if (!pendingJoined.removeOne(serial)) {
+                pendingLeft << GroupMemberModel::displayName(name);
+            }
+            break;
+        }
+        case GroupEvent::Type::PeerRenamed: {
+            const QString oldName = members->apply(event);
+            // a new peer telling us its name isn't a rename
+            if (!oldName.isEmpty() && oldName != event.name) {
+                model->insertNewMessage(event.name, oldName, Message::Nick);
+            }
+            break;
+        }
+        case GroupEvent::Type::MessageReceived:
+        case GroupEvent::Type::ActionReceived:
+            // the joins and quits so far happened before the message
+            flushSummary();
+            model->insertNewMessage(event.text, GroupMemberModel::displayName(event.name),
+                                    event.type == GroupEvent::Type::MessageReceived ? Message::Plain : Message::Action);
+            break;
+        case GroupEvent::Type::Invited:
+            break;
+    }
+}
+
+void GroupChatPageWidget::flushSummary()
+{
+    summaryTimer.stop();
+
+    if (!pendingJoined.isEmpty()) {
+        QStringList names;
+        names.reserve(pendingJoined.size());
+        for (qint64 serial : pendingJoined) {
+            names << GroupMemberModel::displayName(members->getNameOfSerial(serial));
+        }
+        model->insertNewMessage(tr("%1 joined.").arg(summarizeNames(names)), QString(), Message::Join);
+        pendingJoined.clear();
+    }
+
+    if (!pendingLeft.isEmpty()) {
+        model->insertNewMessage(tr("%1 left.").arg(summarizeNames(pendingLeft)), QString(), Message::Quit);
+        pendingLeft.clear();
+    }
+}
+
+QString GroupChatPageWidget::summarizeNames(const QStringList& names)
+{
+    if (names.size() == 1) {
+        return names.first();
+    }
+
+    if (names.size() <= MAX_SUMMARY_NAMES) {
+        return tr("%1 and %2").arg(QStringList(names.mid(0, names.size() - 1)).join(", "), names.last());
+    }
+
+    return tr("%1 and %n other(s)", "", names.size() - MAX_SUMMARY_NAMES).arg(QStringList(names.mid(0, MAX_SUMMARY_NAMES)).join(", "));
+}
+
+void GroupChatPageWidget::messageFailed(const QString& message)
+{
+    model->insertNewMessage(message, QString(), Message::Error);
+}
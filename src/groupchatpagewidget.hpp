@@ -0,0 +1,88 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef GROUPCHATPAGEWIDGET_HPP
+#define GROUPCHATPAGEWIDGET_HPP
+
+#include "groupchat.hpp"
+
+#include <QLabel>
+#include <QList>
+#include <QStringList>
+#include <QTimer>
+#include <QWidget>
+
+class ChatView;
+class GroupMemberModel;
+class InputTextWidget;
+class MessageFilter;
+class MessageModel;
+class QListView;
+class QSortFilterProxyModel;
+
+// A group chat with its member list. Joins and quits are collected for a few
+// seconds and shown as one summary line, so a big group filling up or a netsplit
+// doesn't produce a line per peer.
+class GroupChatPageWidget : public QWidget
+{
+    Q_OBJECT
+public:
+    GroupChatPageWidget(int groupId, QWidget* parent = 0);
+
+    int getGroupId() const;
+    QString getTitle() const;
+
+private:
+    int groupId;
+
+    QLabel* titleLabel;
+    MessageModel* model;
+    MessageFilter* filterModel;
+    ChatView* chatview;
+    InputTextWidget* input;
+    GroupMemberModel* members;
+    QSortFilterProxyModel* sortedMembers;
+    QListView* memberView;
+
+    // peers that joined or left since the last summary line, the ones that joined are
+    // kept by serial so that their names are the latest ones when the line is written
+    QList<qint64> pendingJoined;
+    QStringList pendingLeft;
+    QTimer summaryTimer;
+
+    static const int SUMMARY_DELAY = 3000; // ms
+    // names listed in a summary line, the rest are only counted
+    static const int MAX_SUMMARY_NAMES = 5;
+
+    void applyEvent(const GroupEvent& event);
+    void updateTitle();
+    static QString summarizeNames(const QStringList& names);
+
+private slots:
+    void flushSummary();
+
+public slots:
+    // the events of this group from one tox_do()
+    void applyEvents(const GroupEventList& events);
+    void messageFailed(const QString& message);
+
+signals:
+    void sendMessage(const QString& message);
+    void sendAction(const QString& action);
+
+};
+
+#endif // GROUPCHATPAGEWIDGET_HPP
@@ -0,0 +1,128 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "groupmembermodel.hpp"
+
+GroupMemberModel::GroupMemberModel(QObject* parent) :
+    QAbstractListModel(parent), nextSerial(0)
+{
+}
+
+int GroupMemberModel::rowCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : peers.size();
+}
+
+QVariant GroupMemberModel::data(const QModelIndex& index, int role) const
+{
+    if (!index.isValid() || index.row() >= peers.size()) {
+        return QVariant();
+    }
+
+    const Peer& peer = peers[index.row()];
+    switch (role) {
+        case NameRole:
+            return displayName(peer.name);
+        case SerialRole:
+            return peer.serial;
+        default:
+            return QVariant();
+    }
+}
+
+QString GroupMemberModel::apply(const GroupEvent& event)
+{
+    const QString oldName = getName(event.peerId);
+
+    switch (event.type) {
+        case GroupEvent::Type::PeerAdded:
+            addPeer(event.peerId, event.name);
+            break;
+        case GroupEvent::Type::PeerRemoved:
+            removePeer(event.peerId);
+            break;
+        case GroupEvent::Type::PeerRenamed:
+            if (event.peerId >= 0 && event.peerId < peers.size()) {
+                peers[event.peerId].name = event.name;
+                const QModelIndex changed = index(event.peerId);
+                emit dataChanged(changed, changed);
+            }
+            break;
+        default:
+            break;
+    }
+
+    return oldName;
+}
+
+void GroupMemberModel::addPeer(int peerId, const QString& name)
+{
+    // toxcore adds peers at the end, anything else means we went out of sync with it
+    if (peerId != peers.size()) {
+        qWarning("GroupMemberModel: peer %d added with %d peers", peerId, peers.size());
+    }
+    peerId = peers.size();
+
+    beginInsertRows(QModelIndex(), peerId, peerId);
+    Peer peer;
+    peer.name = name;
+    peer.serial = nextSerial++;
+    peers << peer;
+    peerOfSerial.insert(peer.serial, peerId);
+    endInsertRows();
+}
+
+void GroupMemberModel::removePeer(int peerId)
+{
+    if (peerId < 0 || peerId >= peers.size()) {
+        return;
+    }
+
+    // like toxcore, the last peer takes the number of the removed one
+    const int last = peers.size() - 1;
+    peerOfSerial.remove(peers[peerId].serial);
+    if (peerId != last) {
+        peers[peerId] = peers[last];
+        peerOfSerial.insert(peers[peerId].serial, peerId);
+        const QModelIndex moved = index(peerId);
+        emit dataChanged(moved, moved);
+    }
+
+    beginRemoveRows(QModelIndex(), last, last);
+    peers.removeLast();
+    endRemoveRows();
+}
+
+QString GroupMemberModel::getName(int peerId) const
+{
+    return peerId >= 0 && peerId < peers.size() ? peers[peerId].name : QString();
+}
+
+qint64 GroupMemberModel::getSerial(int peerId) const
+{
+    return peerId >= 0 && peerId < peers.size() ? peers[peerId].serial : -1;
+}
+
+QString GroupMemberModel::getNameOfSerial(qint64 serial) const
+{
+    QHash<qint64, int>::const_iterator it = peerOfSerial.constFind(serial);
+    return it != peerOfSerial.constEnd() ? peers[it.value()].name : QString();
+}
+
+QString GroupMemberModel::displayName(const QString& name)
+{
+    return name.isEmpty() ? tr("Unknown") : name;
+}
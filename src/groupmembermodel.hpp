@@ -0,0 +1,68 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef GROUPMEMBERMODEL_HPP
+#define GROUPMEMBERMODEL_HPP
+
+#include "groupchat.hpp"
+
+#include <QAbstractListModel>
+#include <QHash>
+#include <QVector>
+
+// The peers of a group chat, one row per toxcore peer number, so a peer is
+// found by its number without searching. Sorting by name is left to a proxy.
+class GroupMemberModel : public QAbstractListModel
+{
+    Q_OBJECT
+public:
+    explicit GroupMemberModel(QObject* parent = 0);
+
+    enum {NameRole = Qt::DisplayRole, SerialRole = Qt::UserRole};
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const Q_DECL_OVERRIDE;
+    QVariant data(const QModelIndex& index, int role) const Q_DECL_OVERRIDE;
+
+    // peer events go through here, returns the name the peer had before the event
+    QString apply(const GroupEvent& event);
+
+    QString getName(int peerId) const;
+    // serials stay with a peer while toxcore renumbers it, -1 if there is no such peer
+    qint64 getSerial(int peerId) const;
+    // the name of the peer with the serial, empty if it has left
+    QString getNameOfSerial(qint64 serial) const;
+
+    // what is shown for peers that didn't tell us their name yet
+    static QString displayName(const QString& name);
+
+private:
+    struct Peer
+    {
+        QString name;
+        qint64 serial;
+    };
+
+    QVector<Peer> peers;
+    // serial -> peer number
+    QHash<qint64, int> peerOfSerial;
+    qint64 nextSerial;
+
+    void addPeer(int peerId, const QString& name);
+    void removePeer(int peerId);
+
+};
+
+#endif // GROUPMEMBERMODEL_HPP
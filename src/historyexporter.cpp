@@ -0,0 +1,322 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "historyexporter.hpp"
+#include "historystore.hpp"
+
+#include "messages/clickable.hpp"
+#include "messages/smileymatcher.hpp"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QUrl>
+
+HistoryExporter::HistoryExporter(const QString& historyPath, const QByteArray& key, const QString& chatName, const QString& outputPath,
+                                 Format format, QSharedPointer<const Smileypack> pack) :
+    historyPath(historyPath), key(key), chatName(chatName), outputPath(outputPath), format(format), pack(pack), matcher(nullptr), cancelled(0)
+{
+    setAutoDelete(false);
+}
+
+HistoryExporter::~HistoryExporter()
+{
+    delete matcher;
+}
+
+void HistoryExporter::cancel()
+{
+    cancelled.store(1);
+}
+
+HistoryExporter::Format HistoryExporter::formatForPath(const QString& path)
+{
+    const QString suffix = QFileInfo(path).suffix().toLower();
+    if (suffix == "html" || suffix == "htm") {
+        return Format::Html;
+    } else if (suffix == "jsonl" || suffix == "json") {
+        return Format::JsonLines;
+    }
+    return Format::PlainText;
+}
+
+void HistoryExporter::run()
+{
+    // built here rather than in the constructor, the automaton of a big pack takes a moment
+    if (pack && format != Format::JsonLines) {
+        matcher = new SmileyMatcher(pack->getList());
+    }
+
+    const QString logPath = HistoryStore::logFilePath(historyPath);
+    const QString indexPath = HistoryStore::indexFilePath(historyPath);
+    const qint64 count = HistoryStore::indexEntryCount(indexPath);
+
+    // the old export stays in place until the new one is complete
+    QSaveFile file(outputPath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        emit finished(false, file.errorString());
+        return;
+    }
+
+    buffer.reserve(BUFFER_SIZE + 4096);
+    if (!write(file, header())) {
+        emit finished(false, file.errorString());
+        return;
+    }
+
+    for (qint64 first = 0; first < count; first += CHUNK_SIZE) {
+        if (cancelled.load()) {
+            file.cancelWriting();
+            emit finished(false, QString());
+            return;
+        }
+
+        for (const Message& message : HistoryStore::load(logPath, indexPath, key, first, CHUNK_SIZE)) {
+            if (!write(file, formatMessage(message))) {
+                emit finished(false, file.errorString());
+                return;
+            }
+        }
+        emit progress(qMin(first + CHUNK_SIZE, count), count);
+    }
+
+    if (!write(file, footer()) || !flush(file) || !file.commit()) {
+        emit finished(false, file.errorString());
+        return;
+    }
+
+    emit finished(true, QString());
+}
+
+bool HistoryExporter::write(QFileDevice& file, const QString& text)
+{
+    buffer += text.toUtf8();
+    return buffer.size() < BUFFER_SIZE || flush(file);
+}
+
+bool HistoryExporter::flush(QFileDevice& file)
+{
+    const bool written = file.write(buffer) == buffer.size();
+    buffer.clear();
+    return written;
+}
+
+QString HistoryExporter::header() const
+{
+    switch (format) {
+        case Format::Html:
+            return QString("<!DOCTYPE html>\n<html>\n<head>\n<meta charset=\"utf-8\">\n<title>%1</title>\n</head>\n<body>\n<table>\n")
+                   .arg(chatName.toHtmlEscaped());
+        case Format::PlainText:
+            return chatName + "\n\n";
+        case Format::JsonLines:
+            return QString();
+    }
+    return QString();
+}
+
+QString HistoryExporter::footer() const
+{
+    return format == Format::Html ? QString("</table>\n</body>\n</html>\n") : QString();
+}
+
+QString HistoryExporter::formatMessage(const Message& message) const
+{
+    switch (format) {
+        case Format::Html:
+            return formatHtml(message);
+        case Format::PlainText:
+            return formatPlainText(message);
+        case Format::JsonLines:
+            return formatJson(message);
+    }
+    return QString();
+}
+
+QString HistoryExporter::formatHtml(const Message& message) const
+{
+    QString sender = message.sender().toHtmlEscaped();
+    QString contents = convertContents(message.contents(), true);
+
+    switch (message.type()) {
+        case Message::Action:
+            contents = QString("<i>%1 %2</i>").arg(sender, contents);
+            sender = "*";
+            break;
+        case Message::Nick:
+            contents = tr("%1 is now known as %2").arg(sender, contents);
+            sender = "&lt;-&gt;";
+            break;
+        case Message::Join:
+            contents = contents.isEmpty() ? tr("%1 has joined.").arg(sender) : contents;
+            sender = "--&gt;";
+            break;
+        case Message::Quit:
+            contents = contents.isEmpty() ? tr("%1 has gone.").arg(sender) : contents;
+            sender = "&lt;--";
+            break;
+        default:
+            break;
+    }
+
+    return QString("<tr><td>%1</td><td><b>%2</b></td><td>%3</td></tr>\n")
+           .arg(message.timestamp().toString("yyyy-MM-dd hh:mm:ss"), sender, contents);
+}
+
+QString HistoryExporter::formatPlainText(const Message& message) const
+{
+    const QString timestamp = message.timestamp().toString("yyyy-MM-dd hh:mm:ss");
+    const QString contents = convertContents(message.contents(), false);
+
+    QString line;
+    switch (message.type()) {
+        case Message::Action:
+            line = QString("* %1 %2").arg(message.sender(), contents);
+            break;
+        case Message::Nick:
+            line = tr("%1 is now known as %2").arg(message.sender(), contents);
+            break;
+        case Message::Join:
+            line = contents.isEmpty() ? tr("%1 has joined.").arg(message.sender()) : contents;
+            break;
+        case Message::Quit:
+            line = contents.isEmpty() ? tr("%1 has gone.").arg(message.sender()) : contents;
+            break;
+        default:
+            line = message.sender().isEmpty() ? contents : QString("%1: %2").arg(message.sender(), contents);
+            break;
+    }
+
+    return QString("[%1] %2\n").arg(timestamp, line);
+}
+
+QString HistoryExporter::formatJson(const Message& message) const
+{
+    QJsonObject object;
+    object.insert("id", QString::number(message.msgId().toLong()));
+    object.insert("time", message.timestamp().toString(Qt::ISODate));
+    object.insert("type", typeName(message.type()));
+    object.insert("sender", message.sender());
+    object.insert("text", message.contents());
+    object.insert("self", message.flags().testFlag(Message::Self));
+
+    return QString::fromUtf8(QJsonDocument(object).toJson(QJsonDocument::Compact)) + '\n';
+}
+
+QString HistoryExporter::convertContents(const QString& contents, bool html) const
+{
+    const ClickableList clickables = html ? ClickableList::fromString(contents) : ClickableList();
+    const QVector<SmileyMatcher::Match> smileys = matcher ? matcher->findAll(contents) : QVector<SmileyMatcher::Match>();
+    const bool emoji = pack && pack->isEmoji();
+
+    if (clickables.isEmpty() && (smileys.isEmpty() || (!html && !emoji))) {
+        return html ? contents.toHtmlEscaped() : contents;
+    }
+
+    // a single pass, links and smileys are sorted by position and smileys inside links were skipped
+    QString result;
+    result.reserve(contents.size() + contents.size() / 4);
+    int pos = 0;
+    int nextClickable = 0;
+    int nextSmiley = 0;
+    while (pos < contents.size()) {
+        while (nextSmiley < smileys.size() && (smileys[nextSmiley].start < pos || clickables.atCursorPos(smileys[nextSmiley].start).isValid())) {
+            nextSmiley++;
+        }
+
+        const int clickableStart = nextClickable < clickables.size() ? clickables[nextClickable].start() : contents.size();
+        const int smileyStart = nextSmiley < smileys.size() ? smileys[nextSmiley].start : contents.size();
+        const int next = qMin(clickableStart, smileyStart);
+
+        const QString plain = contents.mid(pos, next - pos);
+        result += html ? plain.toHtmlEscaped() : plain;
+        pos = next;
+        if (pos >= contents.size()) {
+            break;
+        }
+
+        if (clickableStart == pos) {
+            const QString url = contents.mid(clickableStart, clickables[nextClickable].length());
+            const QString href = url.startsWith("www.", Qt::CaseInsensitive) ? "http://" + url : url;
+            result += QString("<a href=\"%1\">%2</a>").arg(href.toHtmlEscaped(), url.toHtmlEscaped());
+            pos += url.size();
+            nextClickable++;
+            continue;
+        }
+
+        const SmileyMatcher::Match& match = smileys[nextSmiley];
+        const QString text = contents.mid(match.start, match.length);
+        const QString graphics = pack->getList().at(match.smiley).first;
+        if (emoji) {
+            result += html ? graphics.toHtmlEscaped() : graphics;
+        } else if (html) {
+            result += QString("<img src=\"%1\" alt=\"%2\">").arg(imageSource(match.smiley), text.toHtmlEscaped());
+        } else {
+            result += text;
+        }
+        pos += match.length;
+        nextSmiley++;
+    }
+
+    return result;
+}
+
+QString HistoryExporter::imageSource(int smiley) const
+{
+    QHash<int, QString>::const_iterator it = imageSources.constFind(smiley);
+    if (it != imageSources.constEnd()) {
+        return it.value();
+    }
+
+    // embedded, so that the export can be read anywhere, the same few smileys come up again and again
+    const QString path = pack->getList().at(smiley).first;
+    QFile image(path);
+    QString source;
+    if (image.open(QIODevice::ReadOnly)) {
+        const QString mimeType = path.endsWith(".gif", Qt::CaseInsensitive) ? "image/gif" : "image/png";
+        source = QString("data:%1;base64,%2").arg(mimeType, QString::fromLatin1(image.readAll().toBase64()));
+    } else {
+        source = QUrl::fromLocalFile(path).toString().toHtmlEscaped();
+    }
+    return imageSources.insert(smiley, source).value();
+}
+
+QString HistoryExporter::typeName(Message::Type type)
+{
+    switch (type) {
+        case Message::Plain:
+            return "message";
+        case Message::Action:
+            return "action";
+        case Message::Nick:
+            return "nick";
+        case Message::Join:
+            return "join";
+        case Message::Quit:
+            return "quit";
+        case Message::Info:
+            return "info";
+        case Message::Error:
+            return "error";
+        case Message::DayChange:
+            return "daychange";
+        case Message::Invite:
+            return "invite";
+    }
+    return "unknown";
+}
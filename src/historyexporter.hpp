@@ -0,0 +1,97 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef HISTORYEXPORTER_HPP
+#define HISTORYEXPORTER_HPP
+
+#include "messages/message.hpp"
+#include "smileypack.hpp"
+
+#include <QAtomicInt>
+#include <QFileDevice>
+#include <QHash>
+#include <QObject>
+#include <QRunnable>
+#include <QSharedPointer>
+
+class SmileyMatcher;
+
+// Writes a chat log to a file, meant to be run on QThreadPool. The log is read in
+// chunks and every message is formatted and written as it's read, so exporting
+// years of chat takes as much memory as a single chunk. It isn't auto-deleted,
+// delete it once finished() was emitted.
+class HistoryExporter : public QObject, public QRunnable
+{
+    Q_OBJECT
+public:
+    enum class Format : int {
+        Html,       // links and smileys converted like in the chat
+        PlainText,  // emoji packs are applied, pixmap smileys stay as typed
+        JsonLines   // one object per message, the contents as they were logged
+    };
+
+    // pack is the smiley pack to apply, Smileypack::current() can only be called on the GUI thread
+    HistoryExporter(const QString& historyPath, const QByteArray& key, const QString& chatName, const QString& outputPath,
+                    Format format, QSharedPointer<const Smileypack> pack);
+    ~HistoryExporter();
+
+    void run();
+    // safe to call from any thread, the export stops after the current chunk
+    void cancel();
+
+    // by the file extension, defaults to PlainText
+    static Format formatForPath(const QString& path);
+
+private:
+    const QString historyPath;
+    const QByteArray key;
+    const QString chatName;
+    const QString outputPath;
+    const Format format;
+    QSharedPointer<const Smileypack> pack;
+    SmileyMatcher* matcher;
+    QAtomicInt cancelled;
+
+    // formatted messages are collected and written in blocks of this size
+    QByteArray buffer;
+    static const int BUFFER_SIZE = 64 * 1024;
+    static const int CHUNK_SIZE = 1000;
+
+    bool write(QFileDevice& file, const QString& text);
+    bool flush(QFileDevice& file);
+
+    QString header() const;
+    QString footer() const;
+    QString formatMessage(const Message& message) const;
+    QString formatHtml(const Message& message) const;
+    QString formatPlainText(const Message& message) const;
+    QString formatJson(const Message& message) const;
+    // contents with the emoji of emoji packs in place of their texts, and for HTML with links and pixmaps
+    QString convertContents(const QString& contents, bool html) const;
+    // the src of a pixmap smiley's img, by its index in the pack
+    QString imageSource(int smiley) const;
+    mutable QHash<int, QString> imageSources;
+    static QString typeName(Message::Type type);
+
+signals:
+    // messages written so far out of the total
+    void progress(qint64 done, qint64 total);
+    // error is empty on success or when cancelled
+    void finished(bool success, const QString& error);
+
+};
+
+#endif // HISTORYEXPORTER_HPP
@@ -0,0 +1,428 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "historyimporter.hpp"
+#include "historystore.hpp"
+#include "historywriter.hpp"
+
+#include "messages/messagemodel.hpp"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QSet>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QtEndian>
+
+#include <algorithm>
+#include <cstring>
+
+HistoryImporter::HistoryImporter(const QString& sourcePath, Format format, const QString& ownName, const QString& friendKey) :
+    sourcePath(sourcePath), format(format), ownName(ownName), friendKey(friendKey), cancelled(0)
+{
+    setAutoDelete(false);
+}
+
+void HistoryImporter::setHistory(const QString& logPath, const QString& indexPath, const QByteArray& key, const QByteArray& writeKey)
+{
+    this->logPath = logPath;
+    this->indexPath = indexPath;
+    this->key = key;
+    this->writeKey = writeKey;
+}
+
+void HistoryImporter::cancel()
+{
+    cancelled.store(1);
+}
+
+HistoryImporter::Format HistoryImporter::formatForPath(const QString& path)
+{
+    const QString suffix = QFileInfo(path).suffix().toLower();
+    if (suffix == "jsonl" || suffix == "json") {
+        return Format::JsonLines;
+    } else if (suffix == "db" || suffix == "sqlite" || suffix == "sqlite3") {
+        return Format::QtoxDatabase;
+    }
+    return Format::PlainText;
+}
+
+void HistoryImporter::run()
+{
+    QVector<Message> messages;
+    QString error;
+    emit progress(0);
+    if (!parse(messages, error) || cancelled.load()) {
+        emit finished(false, error, 0, 0);
+        return;
+    }
+
+    const int parsed = messages.size();
+    deduplicate(messages);
+    emit progress(50);
+
+    if (!messages.isEmpty() && !write(messages, error)) {
+        emit finished(false, error, 0, 0);
+        return;
+    }
+
+    emit progress(100);
+    emit finished(true, QString(), messages.size(), parsed - messages.size());
+}
+
+bool HistoryImporter::parse(QVector<Message>& messages, QString& error)
+{
+    switch (format) {
+        case Format::PlainText:
+            return parseText(messages, error);
+        case Format::JsonLines:
+            return parseJson(messages, error);
+        case Format::QtoxDatabase:
+            return parseDatabase(messages, error);
+    }
+    return false;
+}
+
+bool HistoryImporter::parseText(QVector<Message>& messages, QString& error)
+{
+    QFile file(sourcePath);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        error = file.errorString();
+        return false;
+    }
+
+    // a message lasts until the next line starting with a timestamp, so that multi-line messages stay whole
+    QDateTime timestamp;
+    Message::Type type = Message::Plain;
+    QString sender;
+    QString contents;
+    auto addMessage = [&]() {
+        if (timestamp.isValid()) {
+            messages << Message(timestamp, type, contents, sender, sender == ownName ? Message::Self : Message::None);
+        }
+    };
+
+    const qint64 size = qMax<qint64>(1, file.size());
+    int lines = 0;
+    while (!file.atEnd()) {
+        QString line = QString::fromUtf8(file.readLine());
+        line.chop(line.endsWith('\n') ? 1 : 0);
+
+        const int timestampEnd = line.startsWith('[') ? line.indexOf("] ") : -1;
+        const QDateTime lineTimestamp = timestampEnd > 0 ? QDateTime::fromString(line.mid(1, timestampEnd - 1), "yyyy-MM-dd hh:mm:ss") : QDateTime();
+        if (!lineTimestamp.isValid()) {
+            // text before the first message is the header HistoryExporter writes
+            if (timestamp.isValid()) {
+                contents += '\n' + line;
+            }
+            continue;
+        }
+
+        addMessage();
+        timestamp = lineTimestamp;
+        const QString text = line.mid(timestampEnd + 2);
+        const int separator = text.indexOf(": ");
+        if (text.startsWith("* ")) {
+            // names can have spaces, ours is the only one we can tell apart for sure
+            type = Message::Action;
+            const bool own = !ownName.isEmpty() && text.midRef(2).startsWith(ownName + ' ');
+            const int nameEnd = own ? 2 + ownName.size() : text.indexOf(' ', 2);
+            sender = nameEnd > 0 ? text.mid(2, nameEnd - 2) : QString();
+            contents = nameEnd > 0 ? text.mid(nameEnd + 1) : text.mid(2);
+        } else if (separator > 0) {
+            type = Message::Plain;
+            sender = text.left(separator);
+            contents = text.mid(separator + 2);
+        } else {
+            // name changes and the like
+            type = Message::Info;
+            sender.clear();
+            contents = text;
+        }
+
+        if (++lines % 10000 == 0) {
+            if (cancelled.load()) {
+                return false;
+            }
+            emit progress(file.pos() * 40 / size);
+        }
+    }
+    addMessage();
+
+    return true;
+}
+
+bool HistoryImporter::parseJson(QVector<Message>& messages, QString& error)
+{
+    QFile file(sourcePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        error = file.errorString();
+        return false;
+    }
+
+    const qint64 size = qMax<qint64>(1, file.size());
+    int lines = 0;
+    while (!file.atEnd()) {
+        const QByteArray line = file.readLine().trimmed();
+        if (line.isEmpty()) {
+            continue;
+        }
+
+        QJsonParseError parseError;
+        const QJsonObject object = QJsonDocument::fromJson(line, &parseError).object();
+        if (parseError.error != QJsonParseError::NoError) {
+            error = tr("Line %1 isn't valid JSON: %2").arg(lines + 1).arg(parseError.errorString());
+            return false;
+        }
+
+        const QDateTime timestamp = QDateTime::fromString(object.value("time").toString(), Qt::ISODate);
+        const Message::Type type = typeForName(object.value("type").toString());
+        if (timestamp.isValid() && type != Message::DayChange) {
+            messages << Message(timestamp, type, object.value("text").toString(), object.value("sender").toString(),
+                                object.value("self").toBool() ? Message::Self : Message::None);
+        }
+
+        if (++lines % 10000 == 0) {
+            if (cancelled.load()) {
+                return false;
+            }
+            emit progress(file.pos() * 40 / size);
+        }
+    }
+
+    return true;
+}
+
+bool HistoryImporter::parseDatabase(QVector<Message>& messages, QString& error)
+{
+    // a connection can only be used by the thread that created it
+    const QString connectionName = QString("HistoryImporter-%1").arg(reinterpret_cast<quintptr>(this));
+    bool success = false;
+    {
+        QSqlDatabase database = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+        database.setDatabaseName(sourcePath);
+        database.setConnectOptions("QSQLITE_OPEN_READONLY");
+        if (database.open()) {
+            // qTox keeps every chat in one database, a sender is an alias of either the friend or us
+            QSqlQuery query(database);
+            query.setForwardOnly(true);
+            query.prepare("SELECT history.timestamp, history.message, aliases.display_name, senders.id = peers.id "
+                          "FROM history "
+                          "JOIN peers ON history.chat_id = peers.id "
+                          "JOIN aliases ON history.sender_alias = aliases.id "
+                          "JOIN peers AS senders ON aliases.owner = senders.id "
+                          "WHERE UPPER(SUBSTR(peers.public_key, 1, 64)) = ?");
+            query.addBindValue(friendKey.left(64).toUpper());
+            if (query.exec()) {
+                while (query.next()) {
+                    const QDateTime timestamp = QDateTime::fromMSecsSinceEpoch(query.value(0).toLongLong());
+                    QString contents = query.value(1).toString();
+                    const QString sender = QString::fromUtf8(query.value(2).toByteArray());
+                    const Message::Flags flags = query.value(3).toBool() ? Message::None : Message::Self;
+
+                    Message::Type type = Message::Plain;
+                    if (contents.startsWith("/me ")) {
+                        type = Message::Action;
+                        contents.remove(0, 4);
+                    }
+                    messages << Message(timestamp, type, contents, sender, flags);
+
+                    if (messages.size() % 10000 == 0 && cancelled.load()) {
+                        break;
+                    }
+                }
+                success = true;
+            } else {
+                error = query.lastError().text();
+            }
+        } else {
+            error = database.lastError().text();
+        }
+    }
+    QSqlDatabase::removeDatabase(connectionName);
+
+    emit progress(40);
+    return success;
+}
+
+quint64 HistoryImporter::duplicateKey(const Message& message)
+{
+    // two differently seeded 32-bit hashes, so that a million messages don't collide
+    const quint64 contents = (quint64(qHash(message.contents(), 0)) << 32) | qHash(message.contents(), 0x9e3779b9u);
+    const quint64 second = message.timestamp().toMSecsSinceEpoch() / 1000;
+    return contents ^ (second * Q_UINT64_C(0x9e3779b97f4a7c15)) ^ message.type();
+}
+
+void HistoryImporter::deduplicate(QVector<Message>& messages) const
+{
+    // messages newer than this would get msgIds above the ones handed out from now on
+    const QDateTime now = QDateTime::currentDateTime();
+    messages.erase(std::remove_if(messages.begin(), messages.end(), [&now](const Message& message) {
+        return message.timestamp() > now;
+    }), messages.end());
+    if (messages.isEmpty()) {
+        return;
+    }
+
+    std::stable_sort(messages.begin(), messages.end(), [](const Message& a, const Message& b) {
+        return a.timestamp() < b.timestamp();
+    });
+
+    // only the logged messages within the imported time range can be duplicates or share msgIds with them
+    const qint64 firstSecond = messages.first().timestamp().toMSecsSinceEpoch() / 1000;
+    const qint64 lastSecond = messages.last().timestamp().toMSecsSinceEpoch() / 1000;
+    const qint64 first = HistoryStore::lowerBound(indexPath, MsgId((firstSecond * 1000) << MessageModel::MSGID_SEQUENCE_BITS));
+    const qint64 end = HistoryStore::lowerBound(indexPath, MsgId(((lastSecond + 1) * 1000) << MessageModel::MSGID_SEQUENCE_BITS));
+
+    // a count rather than a set, a message said twice in a second is logged twice
+    QHash<quint64, int> logged;
+    QSet<qint64> loggedMsgIds;
+    for (qint64 chunk = first; chunk < end; chunk += CHUNK_SIZE) {
+        for (const Message& message : HistoryStore::load(logPath, indexPath, key, chunk, qMin<qint64>(CHUNK_SIZE, end - chunk))) {
+            logged[duplicateKey(message)]++;
+            loggedMsgIds.insert(message.msgId().toLong());
+        }
+    }
+
+    int kept = 0;
+    qint64 lastMsgId = 0;
+    for (int i = 0; i < messages.size(); i++) {
+        if (!logged.isEmpty()) {
+            QHash<quint64, int>::iterator it = logged.find(duplicateKey(messages[i]));
+            if (it != logged.end()) {
+                if (--it.value() == 0) {
+                    logged.erase(it);
+                }
+                continue;
+            }
+        }
+
+        // text logs only have seconds, the sequence bits keep their messages apart
+        qint64 msgId = qMax(messages[i].timestamp().toMSecsSinceEpoch() << MessageModel::MSGID_SEQUENCE_BITS, lastMsgId + 1);
+        while (loggedMsgIds.contains(msgId)) {
+            msgId++;
+        }
+        lastMsgId = msgId;
+
+        messages[kept] = messages[i];
+        messages[kept].setMsgId(MsgId(msgId));
+        kept++;
+    }
+    messages.resize(kept);
+}
+
+bool HistoryImporter::write(const QVector<Message>& messages, QString& error)
+{
+    QDir directory = QFileInfo(logPath).absoluteDir();
+    if (!directory.exists() && !directory.mkpath(directory.absolutePath())) {
+        error = tr("Couldn't create %1").arg(directory.absolutePath());
+        return false;
+    }
+
+    QFile logFile(logPath);
+    if (!logFile.open(QIODevice::ReadWrite | QIODevice::Append)) {
+        error = logFile.errorString();
+        return false;
+    }
+
+    QByteArray index;
+    QFile indexFile(indexPath);
+    if (indexFile.open(QIODevice::ReadOnly)) {
+        index = indexFile.readAll();
+        indexFile.close();
+    }
+    // like HistoryWriter, a partially written entry doesn't count
+    index.truncate(index.size() - index.size() % HistoryWriter::INDEX_ENTRY_SIZE);
+
+    // the records go after everything that's logged, nothing refers to them until the index is replaced
+    const qint64 logSize = logFile.size();
+    QByteArray imported;
+    imported.reserve(messages.size() * HistoryWriter::INDEX_ENTRY_SIZE);
+    for (int first = 0; first < messages.size(); first += BATCH_SIZE) {
+        if (cancelled.load()) {
+            logFile.resize(logSize);
+            return false;
+        }
+
+        QByteArray records;
+        HistoryWriter::encodeRecords(messages.mid(first, BATCH_SIZE).toList(), writeKey, logFile.size(), records, imported);
+        if (logFile.write(records) != records.size() || !logFile.flush()) {
+            error = logFile.errorString();
+            logFile.resize(logSize);
+            return false;
+        }
+        emit progress(50 + qMin(first + BATCH_SIZE, messages.size()) * 45LL / messages.size());
+    }
+
+    // both are sorted by msgId, and none is in both
+    QByteArray merged(index.size() + imported.size(), Qt::Uninitialized);
+    const char* a = index.constData();
+    const char* aEnd = a + index.size();
+    const char* b = imported.constData();
+    const char* bEnd = b + imported.size();
+    char* out = merged.data();
+    while (a < aEnd || b < bEnd) {
+        const bool takeA = b == bEnd || (a < aEnd && qFromBigEndian<qint64>(reinterpret_cast<const uchar*>(a)) < qFromBigEndian<qint64>(reinterpret_cast<const uchar*>(b)));
+        const char*& entry = takeA ? a : b;
+        memcpy(out, entry, HistoryWriter::INDEX_ENTRY_SIZE);
+        entry += HistoryWriter::INDEX_ENTRY_SIZE;
+        out += HistoryWriter::INDEX_ENTRY_SIZE;
+    }
+
+    // readers see either the old index or the merged one
+    QSaveFile mergedFile(indexPath);
+    if (!mergedFile.open(QIODevice::WriteOnly) || mergedFile.write(merged) != merged.size()) {
+        error = mergedFile.errorString();
+        mergedFile.cancelWriting();
+        logFile.resize(logSize);
+        return false;
+    }
+    if (cancelled.load()) {
+        mergedFile.cancelWriting();
+        logFile.resize(logSize);
+        return false;
+    }
+    if (!mergedFile.commit()) {
+        error = mergedFile.errorString();
+        logFile.resize(logSize);
+        return false;
+    }
+
+    return true;
+}
+
+Message::Type HistoryImporter::typeForName(const QString& name)
+{
+    // the names HistoryExporter writes
+    static const QHash<QString, Message::Type> types = {
+        {"message", Message::Plain},
+        {"action", Message::Action},
+        {"nick", Message::Nick},
+        {"join", Message::Join},
+        {"quit", Message::Quit},
+        {"info", Message::Info},
+        {"error", Message::Error},
+        {"daychange", Message::DayChange},
+        {"invite", Message::Invite}
+    };
+    return types.value(name, Message::Plain);
+}
@@ -0,0 +1,94 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef HISTORYIMPORTER_HPP
+#define HISTORYIMPORTER_HPP
+
+#include "messages/message.hpp"
+
+#include <QAtomicInt>
+#include <QHash>
+#include <QObject>
+#include <QRunnable>
+#include <QVector>
+
+// Imports the log of another client into a chat's history, meant to be run on
+// QThreadPool by the chat's HistoryStore, which sets where to import to.
+// The source is parsed in one go, messages that are already logged are dropped, and
+// the rest is appended to the log in large batches. Their entries are merged into
+// the index, which replaces the old one only once everything is written, so an
+// interrupted import leaves the history as it was. It isn't auto-deleted, delete it
+// once finished() was emitted.
+class HistoryImporter : public QObject, public QRunnable
+{
+    Q_OBJECT
+public:
+    enum class Format : int {
+        PlainText,  // "[yyyy-MM-dd hh:mm:ss] sender: text" lines, as written by HistoryExporter and others
+        JsonLines,  // HistoryExporter's JSON Lines
+        QtoxDatabase // qTox's unencrypted sqlite history
+    };
+
+    // ownName tells our messages of text logs apart, friendKey selects the chat of a database
+    HistoryImporter(const QString& sourcePath, Format format, const QString& ownName, const QString& friendKey);
+
+    // set by HistoryStore, key decrypts the logged messages and writeKey encrypts the imported ones if not empty
+    void setHistory(const QString& logPath, const QString& indexPath, const QByteArray& key, const QByteArray& writeKey);
+
+    void run();
+    // safe to call from any thread, nothing is imported if the index wasn't replaced yet
+    void cancel();
+
+    // by the file extension, defaults to PlainText
+    static Format formatForPath(const QString& path);
+
+private:
+    const QString sourcePath;
+    const Format format;
+    const QString ownName;
+    const QString friendKey;
+    QString logPath;
+    QString indexPath;
+    QByteArray key;
+    QByteArray writeKey;
+    QAtomicInt cancelled;
+
+    // imported messages are encoded and written in batches of this many
+    static const int BATCH_SIZE = 10000;
+    // logged messages are read in chunks of this many while looking for duplicates
+    static const int CHUNK_SIZE = 1000;
+
+    bool parse(QVector<Message>& messages, QString& error);
+    bool parseText(QVector<Message>& messages, QString& error);
+    bool parseJson(QVector<Message>& messages, QString& error);
+    bool parseDatabase(QVector<Message>& messages, QString& error);
+    // drops the messages that are logged already, same second, type and contents, and gives the rest msgIds
+    void deduplicate(QVector<Message>& messages) const;
+    bool write(const QVector<Message>& messages, QString& error);
+
+    // text logs only have seconds, so that's what messages are compared by
+    static quint64 duplicateKey(const Message& message);
+    static Message::Type typeForName(const QString& name);
+
+signals:
+    void progress(int percent);
+    // error is empty on success or when cancelled, skipped messages were already logged
+    void finished(bool success, const QString& error, int imported, int skipped);
+
+};
+
+#endif // HISTORYIMPORTER_HPP
@@ -0,0 +1,205 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "historyindex.hpp"
+#include "historystore.hpp"
+
+#include <QSet>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <limits>
+
+HistoryIndex::HistoryIndex(QObject* parent) :
+    QObject(parent), lastIndexer(0)
+{
+    qRegisterMetaType<HistoryWords>("HistoryWords");
+}
+
+void HistoryIndex::addChat(int friendId, const QString& historyPath, const QByteArray& key)
+{
+    Chat chat;
+    chat.indexer = ++lastIndexer;
+    chat.firstAddedMsgId = std::numeric_limits<qint64>::max();
+    chats.insert(friendId, chat);
+
+    HistoryIndexer* indexer = new HistoryIndexer(friendId, chat.indexer, historyPath, key);
+    connect(indexer, &HistoryIndexer::indexed, this, &HistoryIndex::onChatIndexed);
+    QThreadPool::globalInstance()->start(indexer);
+}
+
+void HistoryIndex::removeChat(int friendId)
+{
+    if (!chats.remove(friendId)) {
+        return;
+    }
+
+    QMutableHashIterator<QString, QVector<Posting>> it(postings);
+    while (it.hasNext()) {
+        QVector<Posting>& list = it.next().value();
+        list.erase(std::remove_if(list.begin(), list.end(), [friendId](const Posting& posting) {
+            return posting.friendId == friendId;
+        }), list.end());
+        if (list.isEmpty()) {
+            it.remove();
+        }
+    }
+}
+
+void HistoryIndex::addMessage(int friendId, const Message& message)
+{
+    QHash<int, Chat>::iterator chat = chats.find(friendId);
+    if (chat == chats.end() || !isIndexed(message)) {
+        return;
+    }
+
+    const qint64 msgId = message.msgId().toLong();
+    chat->firstAddedMsgId = qMin(chat->firstAddedMsgId, msgId);
+
+    QStringList messageWords = words(message.contents());
+    messageWords.removeDuplicates();
+    foreach (const QString& word, messageWords) {
+        Posting posting = {friendId, msgId};
+        postings[word].append(posting);
+    }
+}
+
+void HistoryIndex::onChatIndexed(int friendId, int indexer, const HistoryWords& words)
+{
+    QHash<int, Chat>::const_iterator chat = chats.constFind(friendId);
+    if (chat == chats.constEnd() || chat->indexer != indexer) {
+        return;
+    }
+
+    for (HistoryWords::const_iterator it = words.constBegin(); it != words.constEnd(); ++it) {
+        QVector<Posting>& list = postings[it.key()];
+        foreach (qint64 msgId, it.value()) {
+            // added ones are already indexed
+            if (msgId < chat->firstAddedMsgId) {
+                Posting posting = {friendId, msgId};
+                list.append(posting);
+            }
+        }
+    }
+}
+
+QList<HistoryIndex::Result> HistoryIndex::search(const QString& query, int maxResults) const
+{
+    QList<Result> results;
+
+    QStringList queryWords = words(query);
+    queryWords.removeDuplicates();
+    if (queryWords.isEmpty()) {
+        return results;
+    }
+
+    // the rarest word gives the fewest candidates, the others can only drop some of them
+    const QVector<Posting>* rarest = nullptr;
+    QList<const QVector<Posting>*> others;
+    foreach (const QString& word, queryWords) {
+        QHash<QString, QVector<Posting>>::const_iterator it = postings.constFind(word);
+        if (it == postings.constEnd()) {
+            return results;
+        }
+        if (!rarest || it->size() < rarest->size()) {
+            if (rarest) {
+                others << rarest;
+            }
+            rarest = &it.value();
+        } else {
+            others << &it.value();
+        }
+    }
+
+    QSet<QPair<int, qint64>> candidates;
+    foreach (const Posting& posting, *rarest) {
+        candidates.insert(qMakePair(posting.friendId, posting.msgId));
+    }
+    foreach (const QVector<Posting>* list, others) {
+        QSet<QPair<int, qint64>> matches;
+        foreach (const Posting& posting, *list) {
+            QPair<int, qint64> key = qMakePair(posting.friendId, posting.msgId);
+            if (candidates.contains(key)) {
+                matches.insert(key);
+            }
+        }
+        candidates = matches;
+    }
+
+    QList<QPair<int, qint64>> sorted = candidates.toList();
+    std::sort(sorted.begin(), sorted.end(), [](const QPair<int, qint64>& a, const QPair<int, qint64>& b) {
+        return a.second > b.second;
+    });
+
+    for (int i = 0; i < sorted.size() && i < maxResults; i++) {
+        Result result = {sorted.at(i).first, MsgId(sorted.at(i).second)};
+        results << result;
+    }
+    return results;
+}
+
+bool HistoryIndex::isIndexed(const Message& message)
+{
+    return message.type() == Message::Plain || message.type() == Message::Action;
+}
+
+QStringList HistoryIndex::words(const QString& text)
+{
+    QStringList words;
+    int start = -1;
+    for (int i = 0; i <= text.size(); i++) {
+        if (i < text.size() && text.at(i).isLetterOrNumber()) {
+            if (start < 0) {
+                start = i;
+            }
+        } else if (start >= 0) {
+            if (i - start >= MIN_WORD_LENGTH) {
+                words << text.mid(start, i - start).toCaseFolded();
+            }
+            start = -1;
+        }
+    }
+    return words;
+}
+
+HistoryIndexer::HistoryIndexer(int friendId, int indexer, const QString& historyPath, const QByteArray& key) :
+    friendId(friendId), indexer(indexer), historyPath(historyPath), key(key)
+{
+}
+
+void HistoryIndexer::run()
+{
+    const QString logPath = HistoryStore::logFilePath(historyPath);
+    const QString indexPath = HistoryStore::indexFilePath(historyPath);
+    const qint64 count = HistoryStore::indexEntryCount(indexPath);
+
+    HistoryWords words;
+    for (qint64 first = 0; first < count; first += CHUNK_SIZE) {
+        foreach (const Message& message, HistoryStore::load(logPath, indexPath, key, first, CHUNK_SIZE)) {
+            if (!HistoryIndex::isIndexed(message)) {
+                continue;
+            }
+            QStringList messageWords = HistoryIndex::words(message.contents());
+            messageWords.removeDuplicates();
+            foreach (const QString& word, messageWords) {
+                words[word].append(message.msgId().toLong());
+            }
+        }
+    }
+
+    emit indexed(friendId, indexer, words);
+}
@@ -0,0 +1,111 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef HISTORYINDEX_HPP
+#define HISTORYINDEX_HPP
+
+#include "messages/message.hpp"
+
+#include <QHash>
+#include <QObject>
+#include <QRunnable>
+#include <QVector>
+
+// word -> msgIds of the messages of a single chat containing it
+typedef QHash<QString, QVector<qint64>> HistoryWords;
+Q_DECLARE_METATYPE(HistoryWords)
+
+// Inverted index over the logged messages of every chat, so that a search
+// doesn't have to look at the messages themselves.
+// It's kept only in memory and rebuilt from the logs on startup, that way
+// encrypted logs don't get an unencrypted copy of their words on disk.
+class HistoryIndex : public QObject
+{
+    Q_OBJECT
+public:
+    struct Result
+    {
+        int friendId;
+        MsgId msgId;
+    };
+
+    explicit HistoryIndex(QObject* parent = 0);
+
+    // indexes the log of a chat on QThreadPool, messages logged from now on
+    // should be passed to addMessage()
+    void addChat(int friendId, const QString& historyPath, const QByteArray& key);
+    void removeChat(int friendId);
+    void addMessage(int friendId, const Message& message);
+
+    // messages containing every word of the query, newest first
+    QList<Result> search(const QString& query, int maxResults) const;
+
+    static bool isIndexed(const Message& message);
+    // lowercased words of the text, shorter ones are skipped
+    static QStringList words(const QString& text);
+
+private:
+    struct Posting
+    {
+        int friendId;
+        qint64 msgId;
+    };
+
+    struct Chat
+    {
+        // identifies the indexing run of the chat, results of older ones are dropped
+        int indexer;
+        // the first message passed to addMessage(), the log might contain it
+        // by the time the indexer reads it
+        qint64 firstAddedMsgId;
+    };
+
+    QHash<QString, QVector<Posting>> postings;
+    QHash<int, Chat> chats;
+    int lastIndexer;
+
+    static const int MIN_WORD_LENGTH = 2;
+
+private slots:
+    void onChatIndexed(int friendId, int indexer, const HistoryWords& words);
+
+};
+
+// Reads a log and collects the words of its messages, meant to be run on QThreadPool
+class HistoryIndexer : public QObject, public QRunnable
+{
+    Q_OBJECT
+public:
+    HistoryIndexer(int friendId, int indexer, const QString& historyPath, const QByteArray& key);
+
+    void run();
+
+private:
+    int friendId;
+    int indexer;
+    QString historyPath;
+    QByteArray key;
+
+    // messages are read in chunks, so that the whole log is never in memory at once
+    static const int CHUNK_SIZE = 1000;
+
+signals:
+    void indexed(int friendId, int indexer, const HistoryWords& words);
+
+};
+
+#endif // HISTORYINDEX_HPP
@@ -0,0 +1,89 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "historysearchdialog.hpp"
+#include "pageswidget.hpp"
+
+#include <QDialogButtonBox>
+#include <QVBoxLayout>
+
+HistorySearchDialog::HistorySearchDialog(PagesWidget* pages, QWidget* parent) :
+    QDialog(parent), pages(pages)
+{
+    setWindowFlags(windowFlags() & ~Qt::WindowContextHelpButtonHint);
+    setWindowTitle(tr("Search all chats"));
+
+    queryEdit = new QLineEdit(this);
+    queryEdit->setPlaceholderText(tr("Words to search for"));
+
+    resultList = new QListWidget(this);
+    resultList->setWordWrap(true);
+    connect(resultList, &QListWidget::itemActivated, this, &HistorySearchDialog::onResultActivated);
+
+    // don't search on every keystroke while typing fast
+    searchDelayTimer = new QTimer(this);
+    searchDelayTimer->setSingleShot(true);
+    searchDelayTimer->setInterval(SEARCH_DELAY);
+    connect(searchDelayTimer, &QTimer::timeout, this, &HistorySearchDialog::search);
+    connect(queryEdit, &QLineEdit::textChanged, searchDelayTimer, static_cast<void (QTimer::*)()>(&QTimer::start));
+
+    QDialogButtonBox* buttonBox = new QDialogButtonBox(QDialogButtonBox::Close, Qt::Horizontal, this);
+    connect(buttonBox, &QDialogButtonBox::rejected, this, &HistorySearchDialog::reject);
+
+    QVBoxLayout* layout = new QVBoxLayout(this);
+    layout->addWidget(queryEdit);
+    layout->addWidget(resultList);
+    layout->addWidget(buttonBox);
+
+    resize(480, 360);
+}
+
+void HistorySearchDialog::search()
+{
+    resultList->clear();
+
+    foreach (const HistoryIndex::Result& result, pages->searchHistory(queryEdit->text(), MAX_RESULTS)) {
+        // only the shown results are read back from the logs
+        Message message = pages->historyMessage(result.friendId, result.msgId);
+        if (!message.isValid()) {
+            continue;
+        }
+
+        QListWidgetItem* item = new QListWidgetItem(QString("%1 [%2]\n%3").arg(pages->getUsername(result.friendId))
+                                                                            .arg(message.timestamp().toString(Qt::SystemLocaleShortDate))
+                                                                            .arg(message.contents()), resultList);
+        item->setData(FriendIdRole, result.friendId);
+        item->setData(MsgIdRole, result.msgId.toLong());
+    }
+}
+
+void HistorySearchDialog::onResultActivated()
+{
+    accept();
+}
+
+int HistorySearchDialog::getFriendId() const
+{
+    QListWidgetItem* item = resultList->currentItem();
+    return item ? item->data(FriendIdRole).toInt() : -1;
+}
+
+MsgId HistorySearchDialog::getMsgId() const
+{
+    QListWidgetItem* item = resultList->currentItem();
+    return item ? MsgId(item->data(MsgIdRole).toLongLong()) : MsgId();
+}
@@ -0,0 +1,61 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef HISTORYSEARCHDIALOG_HPP
+#define HISTORYSEARCHDIALOG_HPP
+
+#include "messages/id.hpp"
+
+#include <QDialog>
+#include <QLineEdit>
+#include <QListWidget>
+#include <QTimer>
+
+class PagesWidget;
+
+// Searches the logged messages of every chat of a profile
+class HistorySearchDialog : public QDialog
+{
+    Q_OBJECT
+public:
+    HistorySearchDialog(PagesWidget* pages, QWidget* parent);
+
+    // the message chosen when the dialog was accepted
+    int getFriendId() const;
+    MsgId getMsgId() const;
+
+private:
+    PagesWidget* pages;
+    QLineEdit* queryEdit;
+    QListWidget* resultList;
+    QTimer* searchDelayTimer;
+
+    enum {
+        FriendIdRole = Qt::UserRole,
+        MsgIdRole
+    };
+
+    static const int MAX_RESULTS = 100;
+    static const int SEARCH_DELAY = 200;
+
+private slots:
+    void search();
+    void onResultActivated();
+
+};
+
+#endif // HISTORYSEARCHDIALOG_HPP
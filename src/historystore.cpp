@@ -0,0 +1,334 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "historystore.hpp"
+#include "historyimporter.hpp"
+#include "historywriter.hpp"
+#include "Settings/settings.hpp"
+#include "messages/messagecodec.hpp"
+
+#include <QDataStream>
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QtEndian>
+
+#include <limits>
+
+HistoryStore::HistoryStore(const QString& basePath, const QByteArray& key, QObject* parent) :
+    QObject(parent), logPath(logFilePath(basePath)), indexPath(indexFilePath(basePath)), key(key), writeInProgress(false),
+    importer(nullptr), importStarted(false)
+{
+    flushTimer = new QTimer(this);
+    flushTimer->setSingleShot(true);
+    flushTimer->setInterval(FLUSH_DELAY);
+    connect(flushTimer, &QTimer::timeout, this, &HistoryStore::flush);
+
+    worker.setMaxThreadCount(1);
+}
+
+HistoryStore::~HistoryStore()
+{
+    // let an in-flight write or import finish, the rest is written synchronously
+    worker.waitForDone();
+
+    if (importer && !importStarted) {
+        // the owner of the store is going away, only the one who started the import is told
+        disconnect(importer, nullptr, this, nullptr);
+        importer->run();
+    }
+    if (!pendingMessages.isEmpty()) {
+        HistoryWriter::writeMessages(logPath, indexPath, pendingMessages, writeKey());
+    }
+    for (const std::function<void()>& written : flushCallbacks) {
+        written();
+    }
+}
+
+void HistoryStore::append(const Message& message)
+{
+    pendingMessages << message;
+    if (!writeInProgress && !flushTimer->isActive()) {
+        flushTimer->start();
+    }
+}
+
+void HistoryStore::flush()
+{
+    if (pendingMessages.isEmpty() || writeInProgress) {
+        return;
+    }
+
+    writeInProgress = true;
+    HistoryWriter* writer = new HistoryWriter(logPath, indexPath, pendingMessages, writeKey());
+    pendingMessages.clear();
+    connect(writer, &HistoryWriter::written, this, &HistoryStore::onWritten);
+    worker.start(writer);
+}
+
+void HistoryStore::onWritten(bool success)
+{
+    writeInProgress = false;
+    if (!success) {
+        qWarning() << "History couldn't be written to" << logPath;
+    }
+
+    if (importer) {
+        startImport();
+        return;
+    }
+
+    writeNext();
+}
+
+void HistoryStore::flushNow(const std::function<void()>& written)
+{
+    flushCallbacks << written;
+    // otherwise writeNext() follows
+    if (!writeInProgress) {
+        flushTimer->stop();
+        writeNext();
+    }
+}
+
+void HistoryStore::writeNext()
+{
+    // messages that arrived while writing
+    if (!pendingMessages.isEmpty()) {
+        if (flushCallbacks.isEmpty()) {
+            flushTimer->start();
+        } else {
+            flush();
+        }
+        return;
+    }
+
+    // a callback may flush again
+    const QList<std::function<void()>> callbacks = flushCallbacks;
+    flushCallbacks.clear();
+    for (const std::function<void()>& written : callbacks) {
+        written();
+    }
+}
+
+void HistoryStore::import(HistoryImporter* newImporter)
+{
+    importer = newImporter;
+    importStarted = false;
+    importer->setHistory(logPath, indexPath, key, writeKey());
+    connect(importer, &HistoryImporter::finished, this, &HistoryStore::onImported);
+
+    if (!writeInProgress) {
+        startImport();
+    }
+}
+
+bool HistoryStore::isImporting() const
+{
+    return importer != nullptr;
+}
+
+void HistoryStore::startImport()
+{
+    // the importer replaces the index, an append meanwhile would be lost
+    flushTimer->stop();
+    writeInProgress = true;
+    importStarted = true;
+    worker.start(importer);
+}
+
+void HistoryStore::onImported(bool success)
+{
+    importer = nullptr;
+    importStarted = false;
+    writeInProgress = false;
+    writeNext();
+    emit imported(success);
+}
+
+QByteArray HistoryStore::writeKey() const
+{
+    return Settings::getInstance().snapshot()->encryptLogs ? key : QByteArray();
+}
+
+QString HistoryStore::logFilePath(const QString& basePath)
+{
+    return basePath + ".log";
+}
+
+QString HistoryStore::indexFilePath(const QString& basePath)
+{
+    return basePath + ".idx";
+}
+
+qint64 HistoryStore::indexEntryCount(const QString& indexPath)
+{
+    // a partially written entry at the end doesn't count
+    return QFileInfo(indexPath).size() / HistoryWriter::INDEX_ENTRY_SIZE;
+}
+
+qint64 HistoryStore::lowerBound(MsgId msgId) const
+{
+    return lowerBound(indexPath, msgId);
+}
+
+qint64 HistoryStore::lowerBound(const QString& indexPath, MsgId msgId)
+{
+    QFile indexFile(indexPath);
+    if (!indexFile.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+
+    qint64 first = 0;
+    qint64 count = indexFile.size() / HistoryWriter::INDEX_ENTRY_SIZE;
+    while (count > 0) {
+        const qint64 half = count / 2;
+        const qint64 middle = first + half;
+
+        uchar entry[sizeof(qint64)];
+        indexFile.seek(middle * HistoryWriter::INDEX_ENTRY_SIZE);
+        if (indexFile.read(reinterpret_cast<char*>(entry), sizeof(entry)) != sizeof(entry)) {
+            break;
+        }
+
+        if (qFromBigEndian<qint64>(entry) < msgId.toLong()) {
+            first = middle + 1;
+            count -= half + 1;
+        } else {
+            count = half;
+        }
+    }
+    return first;
+}
+
+QList<Message> HistoryStore::load(const QString& logPath, const QString& indexPath, const QByteArray& key, qint64 firstEntry, qint64 count)
+{
+    QList<Message> messages;
+    if (count <= 0) {
+        return messages;
+    }
+
+    QFile indexFile(indexPath);
+    QFile logFile(logPath);
+    if (!indexFile.open(QIODevice::ReadOnly) || !logFile.open(QIODevice::ReadOnly)) {
+        return messages;
+    }
+
+    indexFile.seek(firstEntry * HistoryWriter::INDEX_ENTRY_SIZE);
+    const QByteArray index = indexFile.read(count * HistoryWriter::INDEX_ENTRY_SIZE);
+    count = index.size() / HistoryWriter::INDEX_ENTRY_SIZE;
+    if (count == 0) {
+        return messages;
+    }
+
+    const uchar* entries = reinterpret_cast<const uchar*>(index.constData());
+    qint64 firstOffset = std::numeric_limits<qint64>::max();
+    for (qint64 i = 0; i < count; i++) {
+        firstOffset = qMin(firstOffset, qFromBigEndian<qint64>(entries + i * HistoryWriter::INDEX_ENTRY_SIZE + sizeof(qint64)));
+    }
+    const qint64 size = logFile.size() - firstOffset;
+    if (firstOffset < 0 || size <= 0) {
+        return messages;
+    }
+
+    // a single mapping covers every record we need, imported records may lie before the
+    // ones logged later, but only the pages we read are actually loaded
+    uchar* data = logFile.map(firstOffset, size);
+    if (!data) {
+        qWarning() << "History" << logPath << "couldn't be mapped";
+        return messages;
+    }
+
+    messages.reserve(count);
+    for (qint64 i = 0; i < count; i++) {
+        const uchar* entry = entries + i * HistoryWriter::INDEX_ENTRY_SIZE;
+        const MsgId msgId(qFromBigEndian<qint64>(entry));
+        const qint64 offset = qFromBigEndian<qint64>(entry + sizeof(qint64)) - firstOffset;
+        if (offset + (qint64)sizeof(quint32) > size) {
+            break;
+        }
+        const quint32 recordHeader = qFromBigEndian<quint32>(data + offset);
+        const quint32 recordSize = recordHeader & ~HistoryWriter::ENCRYPTED_RECORD;
+        if (offset + (qint64)sizeof(quint32) + recordSize > size) {
+            break;
+        }
+
+        QByteArray record = QByteArray::fromRawData(reinterpret_cast<const char*>(data + offset + sizeof(quint32)), recordSize);
+        if (recordHeader & HistoryWriter::ENCRYPTED_RECORD) {
+            // only the records we return get decrypted
+            record = HistoryWriter::decryptRecord(record, msgId, key);
+            if (record.isEmpty()) {
+                continue;
+            }
+        }
+        if (MessageCodec::isEncoded(record)) {
+            MessageDecoder decoder(record, msgId);
+            MessageDecoder::Record decoded;
+            if (decoder.next(decoded)) {
+                messages << decoded.toMessage();
+            }
+        } else {
+            // written before MessageCodec
+            QDataStream stream(record);
+            Message message;
+            stream >> message;
+            messages << message;
+        }
+    }
+
+    logFile.unmap(data);
+    return messages;
+}
+
+QList<Message> HistoryStore::loadLast(int count) const
+{
+    const qint64 entries = indexEntryCount(indexPath);
+    const qint64 first = qMax<qint64>(0, entries - count);
+    return load(logPath, indexPath, key, first, entries - first);
+}
+
+QList<Message> HistoryStore::loadBefore(MsgId msgId, int count) const
+{
+    const qint64 end = lowerBound(msgId);
+    const qint64 first = qMax<qint64>(0, end - count);
+    return load(logPath, indexPath, key, first, end - first);
+}
+
+QList<Message> HistoryStore::loadBetween(MsgId from, MsgId to) const
+{
+    const qint64 first = lowerBound(from);
+    return load(logPath, indexPath, key, first, lowerBound(to) - first);
+}
+
+Message HistoryStore::loadMessage(MsgId msgId) const
+{
+    QList<Message> messages = load(logPath, indexPath, key, lowerBound(msgId), 1);
+    if (messages.isEmpty() || messages.first().msgId() != msgId) {
+        return Message();
+    }
+    return messages.first();
+}
+
+Message HistoryStore::loadMessage(const QString& basePath, const QByteArray& key, MsgId msgId)
+{
+    const QString indexPath = indexFilePath(basePath);
+    QList<Message> messages = load(logFilePath(basePath), indexPath, key, lowerBound(indexPath, msgId), 1);
+    if (messages.isEmpty() || messages.first().msgId() != msgId) {
+        return Message();
+    }
+    return messages.first();
+}
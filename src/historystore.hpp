@@ -0,0 +1,109 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef HISTORYSTORE_HPP
+#define HISTORYSTORE_HPP
+
+#include "messages/message.hpp"
+
+#include <QObject>
+#include <QThreadPool>
+#include <QTimer>
+
+#include <functional>
+
+class HistoryImporter;
+
+// Message history of a single chat, stored as an append-only log plus an
+// index sorted by MsgId, see HistoryWriter for the format.
+// Appends are collected for a moment and written on a thread of the store, reads map
+// the log into memory and pick records through the index.
+class HistoryStore : public QObject
+{
+    Q_OBJECT
+public:
+    // basePath is the path of the log without extension, key is used to
+    // encrypt new messages when Settings::getEncryptLogs() is set, and to
+    // decrypt the ones that were encrypted
+    HistoryStore(const QString& basePath, const QByteArray& key, QObject* parent = 0);
+    ~HistoryStore();
+
+    void append(const Message& message);
+    // starts importer once the write in progress is done, appends wait until imported() is emitted,
+    // the caller connects to the importer before and deletes it once it finished
+    void import(HistoryImporter* importer);
+    bool isImporting() const;
+    // writes the pending messages without waiting for FLUSH_DELAY, written is called on this thread
+    // once everything appended so far is on disk, for readers of the files like HistoryExporter
+    void flushNow(const std::function<void()>& written);
+
+    // the newest count messages on disk, oldest first
+    QList<Message> loadLast(int count) const;
+    // up to count messages older than msgId, oldest first
+    QList<Message> loadBefore(MsgId msgId, int count) const;
+    // messages with from <= msgId < to, oldest first
+    QList<Message> loadBetween(MsgId from, MsgId to) const;
+    // the message with msgId, or an invalid one if it isn't logged
+    Message loadMessage(MsgId msgId) const;
+
+    // these only touch the files, so they can be used from any thread
+    static QString logFilePath(const QString& basePath);
+    static QString indexFilePath(const QString& basePath);
+    static qint64 indexEntryCount(const QString& indexPath);
+    // index of the first entry with msgId >= the given one
+    static qint64 lowerBound(const QString& indexPath, MsgId msgId);
+    static QList<Message> load(const QString& logPath, const QString& indexPath, const QByteArray& key, qint64 firstEntry, qint64 count);
+    // loadMessage() for a chat without a HistoryStore, messages not written yet aren't found
+    static Message loadMessage(const QString& basePath, const QByteArray& key, MsgId msgId);
+
+private:
+    const QString logPath;
+    const QString indexPath;
+    const QByteArray key;
+
+    QTimer* flushTimer;
+    QList<Message> pendingMessages;
+    bool writeInProgress;
+    // waiting for writeInProgress, or running if importStarted
+    HistoryImporter* importer;
+    bool importStarted;
+    // of flushNow(), called once pendingMessages is empty and nothing is being written
+    QList<std::function<void()>> flushCallbacks;
+    // runs the writers and the importer, one at a time anyway, so that ~HistoryStore waits only for its own
+    QThreadPool worker;
+
+    // delays writing, so that a burst of messages results in a single write
+    static const int FLUSH_DELAY = 500;
+
+    QByteArray writeKey() const;
+    qint64 lowerBound(MsgId msgId) const;
+    void startImport();
+    // once a write or import is done
+    void writeNext();
+
+private slots:
+    void flush();
+    void onWritten(bool success);
+    void onImported(bool success);
+
+signals:
+    // the imported messages are logged, they still have to be loaded into a view showing the chat
+    void imported(bool success);
+
+};
+
+#endif // HISTORYSTORE_HPP
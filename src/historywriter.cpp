@@ -0,0 +1,143 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "historywriter.hpp"
+#include "messages/messagecodec.hpp"
+
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QtEndian>
+
+#include <sodium.h>
+
+const int HistoryWriter::INDEX_ENTRY_SIZE;
+const quint32 HistoryWriter::ENCRYPTED_RECORD;
+
+HistoryWriter::HistoryWriter(const QString& logPath, const QString& indexPath, const QList<Message>& messages, const QByteArray& key) :
+    logPath(logPath), indexPath(indexPath), messages(messages), key(key)
+{
+}
+
+QByteArray HistoryWriter::encryptRecord(const QByteArray& payload, MsgId msgId, const QByteArray& key)
+{
+    unsigned char additionalData[sizeof(qint64)];
+    qToBigEndian<qint64>(msgId.toLong(), additionalData);
+
+    QByteArray record(crypto_aead_xchacha20poly1305_ietf_NPUBBYTES + payload.size() + crypto_aead_xchacha20poly1305_ietf_ABYTES, 0);
+    unsigned char* nonce = reinterpret_cast<unsigned char*>(record.data());
+    randombytes_buf(nonce, crypto_aead_xchacha20poly1305_ietf_NPUBBYTES);
+
+    unsigned long long cipherLength;
+    crypto_aead_xchacha20poly1305_ietf_encrypt(nonce + crypto_aead_xchacha20poly1305_ietf_NPUBBYTES, &cipherLength,
+                                               reinterpret_cast<const unsigned char*>(payload.constData()), payload.size(),
+                                               additionalData, sizeof(additionalData), nullptr, nonce,
+                                               reinterpret_cast<const unsigned char*>(key.constData()));
+    return record;
+}
+
+QByteArray HistoryWriter::decryptRecord(const QByteArray& record, MsgId msgId, const QByteArray& key)
+{
+    const int overhead = crypto_aead_xchacha20poly1305_ietf_NPUBBYTES + crypto_aead_xchacha20poly1305_ietf_ABYTES;
+    if (key.size() != crypto_aead_xchacha20poly1305_ietf_KEYBYTES || record.size() < overhead) {
+        return QByteArray();
+    }
+
+    unsigned char additionalData[sizeof(qint64)];
+    qToBigEndian<qint64>(msgId.toLong(), additionalData);
+
+    const unsigned char* nonce = reinterpret_cast<const unsigned char*>(record.constData());
+    QByteArray payload(record.size() - overhead, 0);
+    unsigned long long payloadLength;
+    if (crypto_aead_xchacha20poly1305_ietf_decrypt(reinterpret_cast<unsigned char*>(payload.data()), &payloadLength, nullptr,
+                                                   nonce + crypto_aead_xchacha20poly1305_ietf_NPUBBYTES, record.size() - crypto_aead_xchacha20poly1305_ietf_NPUBBYTES,
+                                                   additionalData, sizeof(additionalData), nonce,
+                                                   reinterpret_cast<const unsigned char*>(key.constData())) != 0) {
+        return QByteArray();
+    }
+    return payload;
+}
+
+bool HistoryWriter::writeMessages(const QString& logPath, const QString& indexPath, const QList<Message>& messages, const QByteArray& key)
+{
+    QDir directory = QFileInfo(logPath).absoluteDir();
+
+    if (!directory.exists() && !directory.mkpath(directory.absolutePath())) {
+        qCritical() << "Error while creating directory " << directory.absolutePath();
+        return false;
+    }
+
+    QFile logFile(logPath);
+    QFile indexFile(indexPath);
+    if (!logFile.open(QIODevice::WriteOnly | QIODevice::Append) || !indexFile.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qCritical() << "File " << logPath << " cannot be opened";
+        return false;
+    }
+
+    // drop whatever an interrupted write left behind the last indexed record
+    const qint64 indexSize = indexFile.size() - indexFile.size() % INDEX_ENTRY_SIZE;
+    if (indexSize != indexFile.size()) {
+        indexFile.resize(indexSize);
+    }
+
+    QByteArray records;
+    QByteArray index;
+    const qint64 logSize = logFile.size();
+    encodeRecords(messages, key, logSize, records, index);
+
+    if (logFile.write(records) != records.size() || !logFile.flush()) {
+        qCritical() << "File " << logPath << " cannot be written";
+        logFile.resize(logSize);
+        return false;
+    }
+
+    if (indexFile.write(index) != index.size() || !indexFile.flush()) {
+        qCritical() << "File " << indexPath << " cannot be written";
+        indexFile.resize(indexSize);
+        return false;
+    }
+
+    return true;
+}
+
+void HistoryWriter::encodeRecords(const QList<Message>& messages, const QByteArray& key, qint64 logSize, QByteArray& records, QByteArray& index)
+{
+    QDataStream recordStream(&records, QIODevice::WriteOnly | QIODevice::Append);
+    QDataStream indexStream(&index, QIODevice::WriteOnly | QIODevice::Append);
+
+    for (const Message& message : messages) {
+        // the index already has the msgId, so it's the base the record is encoded against
+        QByteArray payload = MessageCodec::encode(message, message.msgId());
+
+        quint32 flags = 0;
+        if (!key.isEmpty()) {
+            payload = encryptRecord(payload, message.msgId(), key);
+            flags = ENCRYPTED_RECORD;
+        }
+
+        indexStream << message.msgId().toLong() << (logSize + records.size());
+        recordStream << ((quint32)payload.size() | flags);
+        recordStream.writeRawData(payload.constData(), payload.size());
+    }
+}
+
+void HistoryWriter::run()
+{
+    emit written(writeMessages(logPath, indexPath, messages, key));
+}
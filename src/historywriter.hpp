@@ -0,0 +1,73 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef HISTORYWRITER_HPP
+#define HISTORYWRITER_HPP
+
+#include "messages/message.hpp"
+
+#include <QObject>
+#include <QRunnable>
+
+// Appends a batch of messages to a history log and its index. Meant to be run
+// on QThreadPool, so that the GUI thread never waits for the disk.
+//
+// The log is a sequence of records, each one a quint32 size followed by a
+// QDataStream serialized Message. The index is a sequence of fixed-size
+// (qint64 msgId, qint64 offset) pairs, big-endian, one per record. Records are
+// written before their index entries, so every indexed record is complete.
+// The index is sorted by msgId, the log isn't necessarily: a HistoryImporter
+// appends older messages to it and merges their entries into the index.
+//
+// Encrypted records have ENCRYPTED_RECORD set in their size and hold a random
+// nonce followed by the XChaCha20-Poly1305 sealed Message, authenticated together
+// with its msgId. Every record can be decrypted on its own, so appending never
+// touches what is already written and readers decrypt only what they show.
+class HistoryWriter : public QObject, public QRunnable
+{
+    Q_OBJECT
+public:
+    // messages are encrypted if key is not empty
+    HistoryWriter(const QString& logPath, const QString& indexPath, const QList<Message>& messages, const QByteArray& key);
+
+    void run();
+
+    static bool writeMessages(const QString& logPath, const QString& indexPath, const QList<Message>& messages, const QByteArray& key);
+    // appends the records of messages to records and their index entries to index, logSize is where
+    // records is going to be written in the log
+    static void encodeRecords(const QList<Message>& messages, const QByteArray& key, qint64 logSize, QByteArray& records, QByteArray& index);
+
+    // seals payload together with msgId, see the format above
+    static QByteArray encryptRecord(const QByteArray& payload, MsgId msgId, const QByteArray& key);
+    // returns the serialized Message of a record, or an empty array if it can't be decrypted
+    static QByteArray decryptRecord(const QByteArray& record, MsgId msgId, const QByteArray& key);
+
+    static const int INDEX_ENTRY_SIZE = 16;
+    static const quint32 ENCRYPTED_RECORD = 0x80000000;
+
+private:
+    QString logPath;
+    QString indexPath;
+    QList<Message> messages;
+    QByteArray key;
+
+signals:
+    void written(bool success);
+
+};
+
+#endif // HISTORYWRITER_HPP
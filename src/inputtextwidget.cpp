@@ -17,13 +17,17 @@
 
 #include "inputtextwidget.hpp"
 
+#include <QAbstractTextDocumentLayout>
 #include <QAction>
 #include <QApplication>
 #include <QClipboard>
 #include <QIcon>
 #include <QKeyEvent>
 #include <QMenu>
-#include <QTextDocumentFragment>
+#include <QMimeData>
+#include <QScrollBar>
+#include <QTextCursor>
+#include <QToolButton>
 
 #include "smileypack.hpp"
 #include "Settings/settings.hpp"
@@ -73,9 +77,20 @@ InputTextWidget::InputTextWidget(QWidget* parent) :
         actionCopy->setEnabled(enabled);
     });
 
+    mPastedTextChip = new QToolButton(this);
+    mPastedTextChip->setIcon(QIcon(":/icons/cross.png"));
+    mPastedTextChip->setToolButtonStyle(Qt::ToolButtonTextBesideIcon);
+    mPastedTextChip->setAutoRaise(true);
+    mPastedTextChip->setToolTip(tr("Pasted text, sent along with the next message. Click to remove it."));
+    mPastedTextChip->hide();
+    connect(mPastedTextChip, &QToolButton::clicked, this, &InputTextWidget::clearPastedText);
+
+    // the layout tells when the content grows past the view, from the blocks it relaid out
+    connect(document()->documentLayout(), &QAbstractTextDocumentLayout::documentSizeChanged, this, &InputTextWidget::onDocumentSizeChanged);
+
     mTyping = false;
     mTypingTimer.setSingleShot(true);
-    connect(&mTypingTimer, &QTimer::timeout, this, &InputTextWidget::endTyping);
+    connect(&mTypingTimer, &QTimer::timeout, this, &InputTextWidget::onTypingTimeout);
 }
 
 /*! Handle keyboard events. */
@@ -87,19 +102,25 @@ void InputTextWidget::keyPressEvent(QKeyEvent* event)
 
         endTyping();
 
+        QString text = Smileypack::desmilify(document());
+
         // Prevents empty messages
-        if (toPlainText().trimmed().isEmpty()) {
+        if (text.trimmed().isEmpty() && mPastedText.isEmpty()) {
             return;
         }
-        if (toPlainText().startsWith("/me ") ) {
-            QString html = toHtml();
-            html.remove(html.indexOf("/me "), 4);
-            emit sendAction(Smileypack::desmilify(html));
+        // the pasted text goes to the Core as it is, which splits it into messages
+        if (!mPastedText.isEmpty()) {
+            text = text.trimmed().isEmpty() ? mPastedText : text + '\n' + mPastedText;
+        }
+        if (text.startsWith("/me ")) {
+            emit sendAction(text.mid(4));
         } else {
-            emit sendMessage(Smileypack::desmilify(toHtml()));
+            emit sendMessage(text);
         }
         // not only clears the text, but also removes undo/redo history
         clear();
+        clearPastedText();
+        setVerticalScrollBarPolicy(Qt::ScrollBarAsNeeded);
 
     // Override default shortcuts
     } else if (event == QKeySequence::Copy) {
@@ -127,31 +148,92 @@ QSize InputTextWidget::sizeHint() const
     return QSize(10, 50);
 }
 
+bool InputTextWidget::isEmpty() const
+{
+    return document()->isEmpty() && mPastedText.isEmpty();
+}
+
+void InputTextWidget::resizeEvent(QResizeEvent *event)
+{
+    QTextEdit::resizeEvent(event);
+    placePastedTextChip();
+}
+
+void InputTextWidget::placePastedTextChip()
+{
+    // below the text, along the viewport margin kept free for it
+    QSize size = mPastedTextChip->sizeHint();
+    int right = width() - frameWidth() - (verticalScrollBar()->isVisible() ? verticalScrollBar()->width() : 0);
+    mPastedTextChip->setGeometry(right - size.width(), height() - frameWidth() - size.height(), size.width(), size.height());
+}
+
+bool InputTextWidget::canInsertFromMimeData(const QMimeData *source) const
+{
+    return source->hasText();
+}
+
+/*! Dropped and pasted data is inserted as plain text, large texts are kept aside. */
+void InputTextWidget::insertFromMimeData(const QMimeData *source)
+{
+    const QString text = source->text();
+    if (text.size() >= LARGE_PASTE_SIZE) {
+        setPastedText(text);
+    } else {
+        insertPlainText(text);
+    }
+}
+
+void InputTextWidget::setPastedText(const QString &text)
+{
+    // a second large paste follows the first one
+    mPastedText = mPastedText.isEmpty() ? text : mPastedText + '\n' + text;
+
+    const int kilobytes = qMax(1, mPastedText.toUtf8().size() / 1024);
+    mPastedTextChip->setText(tr("%1 KB attachment").arg(kilobytes));
+    mPastedTextChip->show();
+    setViewportMargins(0, 0, 0, mPastedTextChip->sizeHint().height());
+    placePastedTextChip();
+    startTyping();
+}
+
+void InputTextWidget::clearPastedText()
+{
+    if (mPastedText.isEmpty()) {
+        return;
+    }
+    // releases the clipboard's copy of a multi-MB string
+    mPastedText = QString();
+    mPastedTextChip->hide();
+    setViewportMargins(0, 0, 0, 0);
+}
+
 /*! Copy text without images, but textual representations of the smileys. */
 void InputTextWidget::copyPlainText()
 {
-    QTextDocumentFragment selection = textCursor().selection();
-    if (!selection.isEmpty()) {
+    QTextCursor cursor = textCursor();
+    if (cursor.hasSelection()) {
         QClipboard *clipboard = QApplication::clipboard();
-        clipboard->setText(Smileypack::desmilify(selection.toHtml()));
+        clipboard->setText(Smileypack::desmilify(document(), cursor.selectionStart(), cursor.selectionEnd()));
     }
 }
 
 /*! Paste only plain text. */
 void InputTextWidget::pastePlainText()
 {
-    QClipboard *clipboard = QApplication::clipboard();
-    insertPlainText(clipboard->text());
+    const QMimeData *data = QApplication::clipboard()->mimeData();
+    if (data && data->hasText()) {
+        insertFromMimeData(data);
+    }
 }
 
 /*! Cut text without images, but textual representations of the smileys. */
 void InputTextWidget::cutPlainText()
 {
-    QTextDocumentFragment selection = textCursor().selection();
-    if (!selection.isEmpty()) {
+    QTextCursor cursor = textCursor();
+    if (cursor.hasSelection()) {
         QClipboard *clipboard = QApplication::clipboard();
-        clipboard->setText(Smileypack::desmilify(selection.toHtml()));
-        textCursor().removeSelectedText();
+        clipboard->setText(Smileypack::desmilify(document(), cursor.selectionStart(), cursor.selectionEnd()));
+        cursor.removeSelectedText();
     }
 }
 
@@ -160,19 +242,52 @@ void InputTextWidget::endTyping()
     mTypingTimer.stop();
     if (mTyping) {
         mTyping = false;
-        if(Settings::getInstance().isTypingNotificationEnabled())
+        mLastTypingEdge.start();
+        if(Settings::getInstance().snapshot()->typingNotification)
             emit sendTyping(false);
     }
 }
 
 void InputTextWidget::startTyping()
 {
-    if(!mTyping) {
-        mTyping = true;
-        if(Settings::getInstance().isTypingNotificationEnabled())
-            emit sendTyping(true);
+    mLastKeystroke.start();
+    if (mTyping)
+        return;
+
+    // we've just stopped, the next keystroke will try again
+    if (mLastTypingEdge.isValid() && mLastTypingEdge.elapsed() < TYPING_EDGE_INTERVAL)
+        return;
+
+    mTyping = true;
+    mLastTypingEdge.start();
+    if(Settings::getInstance().snapshot()->typingNotification)
+        emit sendTyping(true);
+    mTypingTimer.start(TYPING_TIMEOUT);
+}
+
+// Every change of the viewport's width relays out the whole draft. With the scroll bar
+// shown as needed it would come and go while a long draft is edited around the height of
+// the view, so once it's needed it stays until the draft is emptied or fits into the view
+// next to it, and keystrokes only lay out the block they change. A draft that fits at the
+// narrower width fits at the wider one too, so hiding it again can't bring it back.
+void InputTextWidget::onDocumentSizeChanged(const QSizeF &size)
+{
+    if (verticalScrollBarPolicy() == Qt::ScrollBarAsNeeded) {
+        if (size.height() > viewport()->height()) {
+            setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOn);
+        }
+    } else if (document()->isEmpty() || size.height() <= viewport()->height()) {
+        setVerticalScrollBarPolicy(Qt::ScrollBarAsNeeded);
     }
-    mTypingTimer.start(2000);
+}
+
+void InputTextWidget::onTypingTimeout()
+{
+    const qint64 idle = mLastKeystroke.elapsed();
+    if (idle < TYPING_TIMEOUT)
+        mTypingTimer.start(TYPING_TIMEOUT - idle);
+    else
+        endTyping();
 }
 
 void InputTextWidget::showContextMenu(const QPoint &pos)
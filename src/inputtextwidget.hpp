@@ -18,19 +18,27 @@
 #ifndef INPUTTEXTWIDGET_HPP
 #define INPUTTEXTWIDGET_HPP
 
+#include <QElapsedTimer>
 #include <QTextEdit>
 #include <QTimer>
 
+class QToolButton;
+
 class InputTextWidget : public QTextEdit
 {
     Q_OBJECT
 public:
     InputTextWidget(QWidget* parent);
     QSize sizeHint() const;
+    // neither typed nor pasted text is waiting to be sent
+    bool isEmpty() const;
 
 protected:
     void keyPressEvent(QKeyEvent* event);
     void focusOutEvent(QFocusEvent * event);
+    void resizeEvent(QResizeEvent* event);
+    bool canInsertFromMimeData(const QMimeData* source) const;
+    void insertFromMimeData(const QMimeData* source);
 
 signals:
     void sendMessage(const QString& message);
@@ -44,9 +52,13 @@ private slots:
     void cutPlainText();
     void endTyping();
     void startTyping();
+    void clearPastedText();
 
 private:
     QString desmile(QString htmlText);
+    // large pastes aren't laid out by the editor, they're kept aside and sent after the typed text
+    void setPastedText(const QString& text);
+    void placePastedTextChip();
 
     QAction *actionUndo;
     QAction *actionRedo;
@@ -54,8 +66,27 @@ private:
     QAction *actionCopy;
     QAction *actionPaste;
 
+    QString mPastedText;
+    // shows the size of mPastedText, a click drops it
+    QToolButton *mPastedTextChip;
+    // from this many characters on, pasted text is kept out of the document
+    static const int LARGE_PASTE_SIZE = 64 * 1024;
+
     bool mTyping;
+    // started once per typing period, keystrokes only touch mLastKeystroke
     QTimer mTypingTimer;
+    QElapsedTimer mLastKeystroke;
+    // when we last told the friend we started or stopped typing
+    QElapsedTimer mLastTypingEdge;
+
+    // typing stops being reported after this many ms without a keystroke
+    static const int TYPING_TIMEOUT = 2000;
+    // a stop is followed by a start no sooner than this, so bursty typing doesn't flap
+    static const int TYPING_EDGE_INTERVAL = 500;
+
+private slots:
+    void onTypingTimeout();
+    void onDocumentSizeChanged(const QSizeF& size);
 };
 
 #endif // INPUTTEXTWIDGET_HPP
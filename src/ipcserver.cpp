@@ -0,0 +1,233 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "ipcserver.hpp"
+#include "core.hpp"
+
+#include <QDebug>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLocalServer>
+#include <QLocalSocket>
+
+IpcServer::IpcServer(Core* core) :
+    QObject(core), core(core), queueing(false)
+{
+    server = new QLocalServer(this);
+    // only our own user may connect
+    server->setSocketOptions(QLocalServer::UserAccessOption);
+    connect(server, &QLocalServer::newConnection, this, &IpcServer::onNewConnection);
+
+    connect(core, &Core::messageSent, this, &IpcServer::onMessageSent);
+    connect(core, &Core::messageDelivered, this, &IpcServer::onMessageDelivered);
+}
+
+IpcServer::~IpcServer()
+{
+    for (QLocalSocket* socket : buffers.keys()) {
+        disconnect(socket, 0, this, 0);
+        socket->abort();
+    }
+}
+
+bool IpcServer::listen(const QString& name)
+{
+    if (!server->listen(name)) {
+        // another instance has the profile open, its socket mustn't be taken over
+        QLocalSocket running;
+        running.connectToServer(name);
+        if (running.waitForConnected(100)) {
+            qWarning() << "IpcServer:" << name << "is in use by another instance";
+            return false;
+        }
+
+        // a stale socket file left behind by a crash
+        QLocalServer::removeServer(name);
+        if (!server->listen(name)) {
+            qWarning() << "IpcServer: couldn't listen on" << name << server->errorString();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+QString IpcServer::getServerName(const QString& configFileName)
+{
+    return QString("tox-qt-gui.%1").arg(configFileName);
+}
+
+void IpcServer::onNewConnection()
+{
+    while (QLocalSocket* socket = server->nextPendingConnection()) {
+        buffers.insert(socket, QByteArray());
+        connect(socket, &QLocalSocket::readyRead, this, &IpcServer::onReadyRead);
+        connect(socket, &QLocalSocket::disconnected, this, &IpcServer::onDisconnected);
+    }
+}
+
+void IpcServer::onReadyRead()
+{
+    QLocalSocket* socket = static_cast<QLocalSocket*>(sender());
+    QByteArray& buffer = buffers[socket];
+    buffer.append(socket->readAll());
+
+    // every complete line is a request, all of them are handled before we go back to the event loop
+    int start = 0;
+    int end;
+    while ((end = buffer.indexOf('\n', start)) != -1) {
+        handleRequest(socket, buffer.mid(start, end - start));
+        start = end + 1;
+    }
+    buffer.remove(0, start);
+
+    if (buffer.size() > MAX_REQUEST_SIZE) {
+        qWarning() << "IpcServer: request too large, dropping the client";
+        socket->abort();
+    }
+}
+
+void IpcServer::onDisconnected()
+{
+    QLocalSocket* socket = static_cast<QLocalSocket*>(sender());
+    forget(socket);
+    socket->deleteLater();
+}
+
+void IpcServer::forget(QLocalSocket* socket)
+{
+    buffers.remove(socket);
+
+    for (QHash<int, QLocalSocket*>::iterator it = pendingSent.begin(); it != pendingSent.end(); ) {
+        if (it.value() == socket) {
+            it = pendingSent.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (QHash<QPair<int, int>, QPair<QLocalSocket*, int>>::iterator it = pendingDelivered.begin(); it != pendingDelivered.end(); ) {
+        if (it.value().first == socket) {
+            it = pendingDelivered.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void IpcServer::handleRequest(QLocalSocket* socket, const QByteArray& line)
+{
+    if (line.trimmed().isEmpty()) {
+        return;
+    }
+
+    QJsonParseError error;
+    const QJsonObject request = QJsonDocument::fromJson(line, &error).object();
+    QJsonObject response;
+    response.insert("id", request.value("id"));
+
+    if (error.error != QJsonParseError::NoError || !request.value("messages").isArray()) {
+        response.insert("error", error.error != QJsonParseError::NoError ? error.errorString() : QString("no messages"));
+        reply(socket, response);
+        return;
+    }
+
+    const QJsonArray messages = request.value("messages").toArray();
+    QVector<Core::OutgoingText> texts;
+    texts.reserve(messages.size());
+    for (const QJsonValue& value : messages) {
+        const QJsonObject message = value.toObject();
+        Core::OutgoingText text;
+        text.friendId = message.value("friend").toInt(-1);
+        text.text = message.value("text").toString();
+        text.isAction = message.value("action").toBool(false);
+        if (text.text.isEmpty()) {
+            // queued as nothing, reported the same as an unknown friend
+            text.friendId = -1;
+        }
+        texts << text;
+    }
+
+    // the whole batch goes in with one flush per friend
+    queueing = true;
+    const QVector<QVector<int>> queueIds = core->sendMessages(texts);
+    queueing = false;
+
+    QJsonArray queued;
+    for (const QVector<int>& chunks : queueIds) {
+        QJsonArray ids;
+        for (int queueId : chunks) {
+            ids.append(queueId);
+            pendingSent.insert(queueId, socket);
+        }
+        queued.append(ids);
+    }
+    response.insert("queued", queued);
+    reply(socket, response);
+
+    for (const SentMessage& sent : sentWhileQueueing) {
+        onMessageSent(sent.friendId, sent.queueId, sent.messageId);
+    }
+    sentWhileQueueing.clear();
+}
+
+void IpcServer::reply(QLocalSocket* socket, const QJsonObject& object)
+{
+    // buffered by the socket and written once we're back in the event loop
+    QByteArray line = QJsonDocument(object).toJson(QJsonDocument::Compact);
+    line.append('\n');
+    socket->write(line);
+}
+
+void IpcServer::onMessageSent(int friendId, int queueId, int messageId)
+{
+    if (queueing) {
+        SentMessage sent;
+        sent.friendId = friendId;
+        sent.queueId = queueId;
+        sent.messageId = messageId;
+        sentWhileQueueing << sent;
+        return;
+    }
+
+    QLocalSocket* socket = pendingSent.take(queueId);
+    if (socket == nullptr) {
+        // sent from the GUI
+        return;
+    }
+
+    pendingDelivered.insert(qMakePair(friendId, messageId), qMakePair(socket, queueId));
+
+    QJsonObject response;
+    response.insert("queueId", queueId);
+    response.insert("messageId", messageId);
+    reply(socket, response);
+}
+
+void IpcServer::onMessageDelivered(int friendId, int messageId)
+{
+    QHash<QPair<int, int>, QPair<QLocalSocket*, int>>::iterator it = pendingDelivered.find(qMakePair(friendId, messageId));
+    if (it == pendingDelivered.end()) {
+        return;
+    }
+
+    QJsonObject response;
+    response.insert("queueId", it.value().second);
+    response.insert("delivered", true);
+    reply(it.value().first, response);
+    pendingDelivered.erase(it);
+}
@@ -0,0 +1,87 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef IPCSERVER_HPP
+#define IPCSERVER_HPP
+
+#include <QHash>
+#include <QObject>
+#include <QPair>
+#include <QVector>
+
+class Core;
+class QJsonObject;
+class QLocalServer;
+class QLocalSocket;
+
+// Lets bots and scripts of the same user send messages through a local socket,
+// straight into the Core's outbound queue. Lives on the Core's thread, so sending
+// never waits for the GUI.
+//
+// The protocol is line-delimited JSON, requests can be pipelined without waiting for replies:
+//   -> {"id": 1, "messages": [{"friend": 0, "text": "hi"}, {"friend": 3, "text": "waves", "action": true}]}
+//   <- {"id": 1, "queued": [[17, 18], [19]]}     queue ids of each message's chunks, [] for unknown friends
+//   <- {"queueId": 17, "messageId": 5}           once toxcore took the chunk
+//   <- {"queueId": 17, "delivered": true}        once the friend confirmed it
+//   <- {"id": 1, "error": "..."}                 for malformed requests
+class IpcServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit IpcServer(Core* core);
+    ~IpcServer();
+
+    bool listen(const QString& name);
+
+    static QString getServerName(const QString& configFileName);
+
+private:
+    Core* core;
+    QLocalServer* server;
+    // pending line of each client
+    QHash<QLocalSocket*, QByteArray> buffers;
+
+    // who to tell about a queued chunk leaving the outbox
+    QHash<int, QLocalSocket*> pendingSent;
+    // who to tell about a receipt, keyed by friend and message id
+    QHash<QPair<int, int>, QPair<QLocalSocket*, int>> pendingDelivered;
+
+    // chunks the Core sent right away while queueing a batch, before we knew their queue ids
+    struct SentMessage {
+        int friendId;
+        int queueId;
+        int messageId;
+    };
+    bool queueing;
+    QVector<SentMessage> sentWhileQueueing;
+
+    // a client that doesn't send a newline within this much is dropped
+    static const int MAX_REQUEST_SIZE = 4 * 1024 * 1024;
+
+    void handleRequest(QLocalSocket* socket, const QByteArray& line);
+    void reply(QLocalSocket* socket, const QJsonObject& object);
+    void forget(QLocalSocket* socket);
+
+private slots:
+    void onNewConnection();
+    void onReadyRead();
+    void onDisconnected();
+    void onMessageSent(int friendId, int queueId, int messageId);
+    void onMessageDelivered(int friendId, int messageId);
+
+};
+
+#endif // IPCSERVER_HPP
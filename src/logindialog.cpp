@@ -0,0 +1,123 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "logindialog.hpp"
+#include "appinfo.hpp"
+#include "profilecipher.hpp"
+#include "Settings/settings.hpp"
+
+#include <QDialogButtonBox>
+#include <QFile>
+#include <QLabel>
+#include <QLineEdit>
+#include <QPushButton>
+#include <QThreadPool>
+#include <QVBoxLayout>
+
+#include <sodium.h>
+
+ProfileUnlocker::ProfileUnlocker(const QString& path, const QString& password) :
+    path(path), password(password)
+{
+}
+
+void ProfileUnlocker::run()
+{
+    QByteArray key;
+
+    QFile file(path);
+    if (file.open(QIODevice::ReadOnly)) {
+        const QByteArray data = file.readAll();
+        key = ProfileCipher::deriveKey(password, ProfileCipher::getSalt(data));
+
+        QByteArray plain;
+        if (!ProfileCipher::decrypt(data, key, plain)) {
+            key.clear();
+        }
+        // only the key is needed, the configuration is decrypted again once the profile loads
+        sodium_memzero(plain.data(), plain.size());
+    }
+
+    emit finished(key);
+}
+
+LoginDialog::LoginDialog(const QString& profileName, const QString& configFileName, QWidget* parent) :
+    QDialog(parent), configFileName(configFileName)
+{
+    setWindowFlags(windowFlags() & ~Qt::WindowContextHelpButtonHint);
+    setWindowTitle(tr("%1 - Login").arg(AppInfo::name));
+
+    QLabel* passwordLabel = new QLabel(tr("Password of profile \"%1\":").arg(profileName), this);
+    passwordEdit = new QLineEdit(this);
+    passwordEdit->setEchoMode(QLineEdit::Password);
+
+    statusLabel = new QLabel(this);
+
+    buttonBox = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, Qt::Horizontal, this);
+    buttonBox->button(QDialogButtonBox::Ok)->setText(tr("Unlock"));
+    buttonBox->button(QDialogButtonBox::Ok)->setDefault(true);
+    connect(buttonBox, &QDialogButtonBox::accepted, this, &LoginDialog::accept);
+    connect(buttonBox, &QDialogButtonBox::rejected, this, &LoginDialog::reject);
+
+    QVBoxLayout* layout = new QVBoxLayout(this);
+    layout->addWidget(passwordLabel);
+    layout->addWidget(passwordEdit);
+    layout->addWidget(statusLabel);
+    layout->addWidget(buttonBox);
+
+    resize(324, 100);
+}
+
+void LoginDialog::setUnlocking(bool unlocking)
+{
+    passwordEdit->setEnabled(!unlocking);
+    buttonBox->setEnabled(!unlocking);
+    statusLabel->setText(unlocking ? tr("Unlocking...") : QString());
+}
+
+void LoginDialog::accept()
+{
+    setUnlocking(true);
+
+    // the key derivation takes a noticeable while, the dialog stays responsive meanwhile
+    ProfileUnlocker* unlocker = new ProfileUnlocker(Settings::getSettingsDirPath() + '/' + configFileName, passwordEdit->text());
+    connect(unlocker, &ProfileUnlocker::finished, this, &LoginDialog::onUnlocked);
+    QThreadPool::globalInstance()->start(unlocker);
+}
+
+void LoginDialog::reject()
+{
+    // the unlocker would report to a deleted dialog
+    if (buttonBox->isEnabled()) {
+        QDialog::reject();
+    }
+}
+
+void LoginDialog::onUnlocked(const QByteArray& key)
+{
+    setUnlocking(false);
+
+    if (key.isEmpty()) {
+        statusLabel->setText(tr("Wrong password"));
+        passwordEdit->selectAll();
+        passwordEdit->setFocus();
+        return;
+    }
+
+    ProfileCipher::storeKey(configFileName, key);
+    QDialog::accept();
+}
@@ -0,0 +1,71 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef LOGINDIALOG_HPP
+#define LOGINDIALOG_HPP
+
+#include <QDialog>
+#include <QRunnable>
+
+class QDialogButtonBox;
+class QLabel;
+class QLineEdit;
+
+// derives the key of an encrypted configuration file and checks it against the file, off the GUI thread
+class ProfileUnlocker : public QObject, public QRunnable
+{
+    Q_OBJECT
+public:
+    ProfileUnlocker(const QString& path, const QString& password);
+
+    void run();
+
+private:
+    QString path;
+    QString password;
+
+signals:
+    // key is empty if the password is wrong or the file couldn't be read
+    void finished(const QByteArray& key);
+
+};
+
+// asks for the password of an encrypted profile, accepted once the profile's key is stored in ProfileCipher
+class LoginDialog : public QDialog
+{
+    Q_OBJECT
+public:
+    LoginDialog(const QString& profileName, const QString& configFileName, QWidget* parent = 0);
+
+private:
+    QString configFileName;
+    QLineEdit* passwordEdit;
+    QLabel* statusLabel;
+    QDialogButtonBox* buttonBox;
+
+    void setUnlocking(bool unlocking);
+
+private slots:
+    void onUnlocked(const QByteArray& key);
+
+public slots:
+    void accept();
+    void reject();
+
+};
+
+#endif // LOGINDIALOG_HPP
@@ -14,15 +14,70 @@
     See the COPYING file for more details.
 */
 
+#include "core.hpp"
+#include "coreeventlog.hpp"
+#include "daemon.hpp"
+#include "ipcserver.hpp"
 #include "starter.hpp"
+#include "startuptrace.hpp"
+#include "Settings/settings.hpp"
+#include "messages/messagesbenchmark.hpp"
 #include <QApplication>
+#include <QDir>
+#include <QLocalSocket>
+#include <QMessageBox>
+#include <QTextStream>
+#include <sodium.h>
 
 int main(int argc, char *argv[])
 {
-    QApplication a(argc, argv);
+    StartupTrace::start();
+
+    // history encryption uses libsodium outside of toxcore
+    if (sodium_init() == -1) {
+        return 1;
+    }
+
     // used in QStandardPaths
-    a.setApplicationName("Qt GUI");
-    a.setOrganizationName("Tox");
+#ifdef FAKE_TOX
+    // keep the simulated friends and their histories away from the real profile
+    QCoreApplication::setApplicationName("Qt GUI (fake Tox)");
+#else
+    QCoreApplication::setApplicationName("Qt GUI");
+#endif
+    QCoreApplication::setOrganizationName("Tox");
+
+    // same for a replayed session, which starts from empty histories every time so that runs compare
+    if (!CoreEventLog::getReplayPath().isEmpty()) {
+        QCoreApplication::setApplicationName(QCoreApplication::applicationName() + " (replay)");
+        for (const char* directory : {"history", "activity", "session", "outbox", "friends"}) {
+            QDir(Settings::getSettingsDirPath() + '/' + directory).removeRecursively();
+        }
+    }
+
+    // no widgets at all, the Cores are driven through their local APIs
+    if (Daemon::isRequested(argc, argv)) {
+        QCoreApplication a(argc, argv);
+        Daemon d;
+        return a.exec();
+    }
+
+    QApplication a(argc, argv);
+
+    if (a.arguments().contains(MessagesBenchmark::ARGUMENT)) {
+        QTextStream out(stdout);
+        return MessagesBenchmark(out).run();
+    }
+
+    // a headless instance, or another GUI with the local API on, already has the profile open
+    QLocalSocket running;
+    running.connectToServer(IpcServer::getServerName(Core::CONFIG_FILE_NAME));
+    if (running.waitForConnected(100)) {
+        QMessageBox::warning(nullptr, QObject::tr("Already running"),
+                             QObject::tr("The default profile is already in use by another instance, started with %1 or with the local API enabled.").arg(Daemon::ARGUMENT));
+        return 1;
+    }
+
     qApp->setQuitOnLastWindowClosed(false);
     Starter s;
     return a.exec();
@@ -19,23 +19,48 @@
 #include "aboutdialog.hpp"
 #include "addfrienddialog.hpp"
 #include "appinfo.hpp"
+#include "callmanager.hpp"
 #include "closeapplicationdialog.hpp"
-#include "friendrequestdialog.hpp"
+#include "coreeventlog.hpp"
+#include "historyexporter.hpp"
+#include "historyimporter.hpp"
+#include "historysearchdialog.hpp"
+#include "memorypressure.hpp"
+#include "messages/chatviewstats.hpp"
+#include "messages/plaintextlayout.hpp"
+#include "messages/smileytextobject.hpp"
 #include "pageswidget.hpp"
 #include "Settings/settings.hpp"
+#include "smileypack.hpp"
+#include "smileypackwatcher.hpp"
+#include "trace.hpp"
 
 #include <QApplication>
 #include <QDesktopWidget>
+#include <QDir>
+#include <QFileDialog>
 #include <QFontDatabase>
 #include <QHBoxLayout>
+#include <QInputDialog>
 #include <QMenuBar>
 #include <QMessageBox>
+#include <QPainter>
+#include <QPixmapCache>
+#include <QProgressDialog>
+#include <QRegularExpression>
 #include <QStackedWidget>
+#include <QStandardPaths>
+#include <QThreadPool>
 #include <QToolBar>
 #include <QToolButton>
 
+#include <algorithm>
+#include <functional>
+
+const QString MainWindow::WINDOW_TITLE = "developers' test version, not for public use";
+
 MainWindow::MainWindow(QWidget* parent)
-    : QMainWindow(parent)
+    : QMainWindow(parent), trayIcon(nullptr), trayMenuShowHideAction(nullptr), shownUnreadCount(0), shownStatus(Status::Offline)
 {
     const int screenWidth = QApplication::desktop()->width();
     const int screenHeight = QApplication::desktop()->height();
@@ -45,7 +70,12 @@ MainWindow::MainWindow(QWidget* parent)
     setGeometry((screenWidth - appWidth) / 2, (screenHeight - appHeight) / 2, appWidth, appHeight);
 
     setObjectName("MainWindow");
-    setWindowTitle("developers' test version, not for public use");
+    setWindowTitle(WINDOW_TITLE);
+
+    indicatorTimer = new QTimer(this);
+    indicatorTimer->setSingleShot(true);
+    indicatorTimer->setInterval(INDICATOR_INTERVAL);
+    connect(indicatorTimer, &QTimer::timeout, this, &MainWindow::updateIndicators);
     setWindowIcon(QIcon(":/icons/icon64.png"));
     setContextMenuPolicy(Qt::PreventContextMenu);
 
@@ -60,8 +90,9 @@ MainWindow::MainWindow(QWidget* parent)
     layout->setMargin(0);
     layout->setSpacing(0);
 
-    ourUserItem = new OurUserItemWidget(this);
-    friendsWidget = new FriendsWidget(friendsLayout);
+    // every profile has its own friends panel and chat pages, only the current one is shown
+    friendsPanels = new QStackedWidget(friendsLayout);
+    pagesPanels = new QStackedWidget(this);
 
     // Create toolbar
     QToolBar *toolBar = new QToolBar(this);
@@ -74,6 +105,10 @@ MainWindow::MainWindow(QWidget* parent)
     addFriendButton->setToolTip(tr("Add friend"));
     connect(addFriendButton, &QToolButton::clicked, this, &MainWindow::onAddFriendButtonClicked);
 
+    profileComboBox = new QComboBox(toolBar);
+    profileComboBox->setToolTip(tr("Profile"));
+    profileComboBox->setFocusPolicy(Qt::ClickFocus);
+
     QWidget *spacer = new QWidget(toolBar);
     spacer->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Preferred);
 
@@ -84,7 +119,22 @@ MainWindow::MainWindow(QWidget* parent)
     QMenu *menu = new QMenu(menuButton);
     settingsAction = menu->addAction(QIcon(":/icons/setting_tools.png"), tr("Settings"), this, SLOT(onSettingsActionTriggered()));
     menu->addAction(QIcon(":/icons/find.png"), tr("Find"), this, SLOT(onSearchActionTriggered()), QKeySequence::Find);
+    menu->addAction(tr("Search all chats..."), this, SLOT(onSearchAllChatsActionTriggered()), QKeySequence(Qt::CTRL + Qt::SHIFT + Qt::Key_F));
+    menu->addAction(tr("Export chat..."), this, SLOT(onExportChatActionTriggered()));
+    menu->addAction(tr("Import chat history..."), this, SLOT(onImportChatActionTriggered()));
+    menu->addAction(tr("New profile..."), this, SLOT(onNewProfileActionTriggered()));
+    menu->addAction(tr("Set profile password..."), this, SLOT(onSetPasswordActionTriggered()));
+    menu->addAction(tr("New group chat"), this, SLOT(onNewGroupChatActionTriggered()));
     menu->addSeparator();
+    menu->addAction(tr("Connection statistics"), this, SLOT(onConnectionStatisticsActionTriggered()));
+    menu->addAction(tr("Chat memory usage"), this, SLOT(onChatMemoryUsageActionTriggered()));
+    QAction *paintStatisticsAction = menu->addAction(tr("Show paint statistics"));
+    paintStatisticsAction->setCheckable(true);
+    connect(paintStatisticsAction, &QAction::toggled, ChatViewStats::instance(), &ChatViewStats::setEnabled);
+    QAction *recordTraceAction = menu->addAction(tr("Record trace"));
+    recordTraceAction->setCheckable(true);
+    connect(recordTraceAction, &QAction::toggled, [](bool checked) {Trace::setEnabled(checked);});
+    menu->addAction(tr("Save trace..."), this, SLOT(onSaveTraceActionTriggered()));
     menu->addAction(tr("About %1").arg(AppInfo::name), this, SLOT(onAboutAppActionTriggered()));
     menu->addAction(tr("About Qt"), qApp, SLOT(aboutQt()));
     menu->addSeparator();
@@ -92,91 +142,66 @@ MainWindow::MainWindow(QWidget* parent)
     menuButton->setMenu(menu);
 
     toolBar->addWidget(addFriendButton);
+    toolBar->addWidget(profileComboBox);
     toolBar->addWidget(spacer);
     toolBar->addWidget(menuButton);
     // Create toolbar end
 
-    layout->addWidget(ourUserItem);
-    layout->addWidget(friendsWidget);
+    layout->addWidget(friendsPanels);
     layout->addWidget(toolBar);
 
-    pages = new PagesWidget(this);
-    connect(friendsWidget, &FriendsWidget::friendSelectionChanged, pages, &PagesWidget::activatePage);
-
-    //FIXME: start core in a separate function
-    //all connections to `core` should be done after its creation because it registers some types
-    core = new Core();
-
-    coreThread = new QThread(this);
-    core->moveToThread(coreThread);
-    connect(coreThread, &QThread::started, core, &Core::start);
-
     qRegisterMetaType<Status>("Status");
+    qRegisterMetaType<CoreMetrics>("CoreMetrics");
+    qRegisterMetaType<UserId>("UserId");
+    qRegisterMetaType<CallState>("CallState");
+    qRegisterMetaType<CallStats>("CallStats");
+    qRegisterMetaType<CallManager*>("CallManager*");
+    qRegisterMetaType<FileTransferInfoList>("FileTransferInfoList");
+    qRegisterMetaType<GroupEventList>("GroupEventList");
+    qRegisterMetaType<FileTransferInfo::Direction>("FileTransferInfo::Direction");
+
+    // Cores spend nearly all of their time waiting for their timers,
+    // so a couple of threads is plenty no matter how many profiles there are
+    corePool = new CoreThreadPool(QThread::idealThreadCount() > 1 ? 2 : 1, this);
+
+    // picks up edits to the smiley pack folder while the chats are open
+    SmileypackWatcher::getInstance();
+
+    // caches all chats share, they're rebuilt while painting
+    MemoryPressure::getInstance().registerCache(this, MemoryPressure::RenderCaches, [](MemoryPressure::Level) {
+        QPixmapCache::clear();
+        PlainTextLayout::clearShared();
+        SmileyTextObject::clearImages();
+    });
+
+    QStringList profileNames = Settings::getInstance().getProfiles();
+    if (!profileNames.contains(Profile::DEFAULT_NAME)) {
+        profileNames.prepend(Profile::DEFAULT_NAME);
+    }
+    for (const QString& name : profileNames) {
+        addProfile(name);
+    }
 
-    connect(core, &Core::connected, this, &MainWindow::onConnected);
-    connect(core, &Core::disconnected, this, &MainWindow::onDisconnected);
-    connect(core, &Core::friendRequestReceived, this, &MainWindow::onFriendRequestReceived);
-    connect(core, SIGNAL(friendStatusChanged(int, Status)), friendsWidget, SLOT(setStatus(int, Status)));
-    connect(core, &Core::friendAddressGenerated, ourUserItem, &OurUserItemWidget::setFriendAddress);
-    connect(core, &Core::friendAdded, pages, &PagesWidget::addPage);
-    connect(core, &Core::friendAdded, friendsWidget, &FriendsWidget::addFriend);
-    connect(core, &Core::friendMessageReceived, pages, &PagesWidget::messageReceived);
-    connect(core, &Core::actionReceived, pages, &PagesWidget::actionReceived);
-    connect(core, &Core::friendUsernameChanged, friendsWidget, &FriendsWidget::setUsername);
-    connect(core, &Core::friendUsernameLoaded,  friendsWidget, &FriendsWidget::setUsername);
-    connect(core, &Core::friendUsernameChanged, pages, &PagesWidget::onFriendUsernameChanged);
-    connect(core, &Core::friendUsernameLoaded,  pages, &PagesWidget::onFriendUsernameLoaded);
-    connect(core, &Core::friendTypingChanged, pages, &PagesWidget::onFriendTypingChanged);
-    connect(core, &Core::friendRemoved, friendsWidget, &FriendsWidget::removeFriend);
-    connect(core, &Core::friendRemoved, pages, &PagesWidget::removePage);
-    connect(core, &Core::failedToRemoveFriend, this, &MainWindow::onFailedToRemoveFriend);
-    connect(core, &Core::failedToAddFriend, this, &MainWindow::onFailedToAddFriend);
-    connect(core, &Core::messageSentResult, pages, &PagesWidget::messageSentResult);
-    connect(core, &Core::actionSentResult, pages, &PagesWidget::actionResult);
-    connect(core, &Core::friendStatusMessageChanged, friendsWidget, &FriendsWidget::setStatusMessage);
-    connect(core, &Core::friendStatusMessageLoaded,  friendsWidget, &FriendsWidget::setStatusMessage);
-    connect(core, &Core::friendStatusMessageChanged, pages, &PagesWidget::onFriendStatusMessageChanged);
-    connect(core, &Core::friendStatusMessageLoaded,  pages, &PagesWidget::onFriendStatusMessageLoaded);
-
-    connect(core, &Core::failedToStart, this, &MainWindow::onFailedToStartCore);
-
-    connect(core, &Core::friendStatusChanged, pages, &PagesWidget::onFriendStatusChanged);
-
-    connect(this, &MainWindow::statusSet, core, &Core::setStatus);
-    connect(core, &Core::statusSet, this, &MainWindow::onStatusSet);
-
-    connect(core, &Core::friendLastSeenChanged, friendsWidget, &FriendsWidget::setLastSeen);
-
-    connect(this, &MainWindow::friendRequested, core, &Core::requestFriendship);
-
-    connect(this, &MainWindow::friendRequestAccepted, core, &Core::acceptFriendRequest);
-
-    connect(ourUserItem, &OurUserItemWidget::usernameChanged, core, &Core::setUsername);
-    connect(core, &Core::usernameSet, ourUserItem, &OurUserItemWidget::setUsername);
-    connect(core, &Core::usernameSet, pages, &PagesWidget::onOurUsernameChanged);
-
-    connect(ourUserItem, &OurUserItemWidget::statusMessageChanged, core, &Core::setStatusMessage);
-    connect(core, &Core::statusMessageSet, ourUserItem, &OurUserItemWidget::setStatusMessage);
-
-    connect(ourUserItem, &OurUserItemWidget::statusSelected, core, &Core::setStatus);
-    connect(core, &Core::statusSet, ourUserItem, &OurUserItemWidget::setStatus);
-
-    connect(pages, &PagesWidget::sendMessage, core, &Core::sendMessage);
-    connect(pages, &PagesWidget::sendAction,  core, &Core::sendAction);
-    connect(pages, &PagesWidget::sendTyping,  core, &Core::sendTyping);
-
-    connect(friendsWidget, &FriendsWidget::friendRemoved, core, &Core::removeFriend);
-
-    coreThread->start();
+    int currentIndex = profileNames.indexOf(Settings::getInstance().getCurrentProfile());
+    profileComboBox->setCurrentIndex(currentIndex == -1 ? 0 : currentIndex);
+    onProfileSelected(profileComboBox->currentIndex());
+    connect(profileComboBox, static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged), this, &MainWindow::onProfileSelected);
 
     splitterWidget->addWidget(friendsLayout);
-    splitterWidget->addWidget(pages);
+    splitterWidget->addWidget(pagesPanels);
     splitterWidget->setStretchFactor(0, 0);
     splitterWidget->setStretchFactor(1, 1);
     setCentralWidget(splitterWidget);
 
     Settings::getInstance().restoreGeometryState(splitterWidget);
     Settings::getInstance().restoreGeometryState(this);
+}
+
+void MainWindow::createTrayIcon()
+{
+    if (trayIcon != nullptr) {
+        return;
+    }
 
     trayIcon = new QSystemTrayIcon(QIcon(":/icons/icon64.png"), this);
     QMenu* trayMenu = new QMenu(this);
@@ -197,13 +222,119 @@ MainWindow::MainWindow(QWidget* parent)
     trayIcon->setContextMenu(trayMenu);
     connect(trayIcon, &QSystemTrayIcon::activated, this, &MainWindow::onTrayIconClick);
     trayIcon->show();
+
+    if (!profiles.isEmpty()) {
+        onStatusSet(currentProfile()->getStatus());
+    }
+    // the icon and the tool tip are brought up to date with the next update
+    shownUnreadCount = -1;
+    scheduleIndicatorUpdate();
 }
 
 MainWindow::~MainWindow()
 {
-    coreThread->quit();
-    coreThread->wait();
-    delete core;
+    corePool->shutdown();
+    qDeleteAll(profiles);
+}
+
+Profile* MainWindow::currentProfile() const
+{
+    return profiles[friendsPanels->currentIndex()];
+}
+
+Profile* MainWindow::addProfile(const QString& name)
+{
+    Profile* profile = new Profile(name, this);
+    profiles << profile;
+
+    friendsPanels->addWidget(profile->getFriendsPanel());
+    pagesPanels->addWidget(profile->getPages());
+    profileComboBox->addItem(name);
+
+    connect(profile, &Profile::statusChanged, this, &MainWindow::onProfileStatusChanged);
+    connect(profile, &Profile::unreadCountChanged, this, &MainWindow::scheduleIndicatorUpdate);
+    connect(profile->getCore(), &Core::metricsReported, this, &MainWindow::onMetricsReported);
+
+    profile->setPowerSaving(!isVisible() || isMinimized());
+    const QString replayPath = CoreEventLog::getReplayPath();
+    if (profile->isDefault() && !replayPath.isEmpty()) {
+        profile->startReplay(replayPath, CoreEventLog::getReplaySpeed());
+    } else {
+        corePool->start(profile->getCore());
+    }
+
+    return profile;
+}
+
+void MainWindow::onProfileSelected(int index)
+{
+    if (index < 0 || index >= profiles.size()) {
+        return;
+    }
+
+    friendsPanels->setCurrentIndex(index);
+    pagesPanels->setCurrentIndex(index);
+    onStatusSet(profiles[index]->getStatus());
+
+    Settings::getInstance().setCurrentProfile(profiles[index]->getName());
+}
+
+void MainWindow::onNewProfileActionTriggered()
+{
+    bool ok;
+    QString name = QInputDialog::getText(this, tr("New profile"), tr("Profile name:"), QLineEdit::Normal, QString(), &ok).trimmed();
+    if (!ok || name.isEmpty()) {
+        return;
+    }
+
+    // the name is used as a file name
+    if (name.contains(QRegularExpression("[\\\\/:*?\"<>|]")) || profileComboBox->findText(name) != -1) {
+        QMessageBox critical(this);
+        critical.setText(tr("Couldn't create profile \"%1\"").arg(name));
+        critical.setIcon(QMessageBox::Critical);
+        critical.exec();
+        return;
+    }
+
+    addProfile(name);
+
+    QStringList profileNames = Settings::getInstance().getProfiles();
+    profileNames << name;
+    Settings::getInstance().setProfiles(profileNames);
+
+    profileComboBox->setCurrentIndex(profiles.size() - 1);
+}
+
+void MainWindow::onSetPasswordActionTriggered()
+{
+    bool ok;
+    const QString password = QInputDialog::getText(this, tr("Profile password"), tr("New password, leave it empty to store the profile unencrypted:"), QLineEdit::Password, QString(), &ok);
+    if (!ok) {
+        return;
+    }
+
+    if (!password.isEmpty()) {
+        const QString confirmation = QInputDialog::getText(this, tr("Profile password"), tr("Repeat the password:"), QLineEdit::Password, QString(), &ok);
+        if (!ok) {
+            return;
+        }
+        if (confirmation != password) {
+            QMessageBox critical(this);
+            critical.setText(tr("The passwords don't match"));
+            critical.setIcon(QMessageBox::Critical);
+            critical.exec();
+            return;
+        }
+    }
+
+    currentProfile()->setPassword(password);
+}
+
+void MainWindow::onProfileStatusChanged(Status status)
+{
+    if (sender() == currentProfile()) {
+        onStatusSet(status);
+    }
 }
 
 void MainWindow::closeEvent(QCloseEvent *event)
@@ -220,12 +351,37 @@ void MainWindow::closeEvent(QCloseEvent *event)
     }
 }
 
-void MainWindow::onFriendRequestReceived(const QString& userId, const QString& message)
+void MainWindow::showEvent(QShowEvent *event)
 {
-    FriendRequestDialog dialog(this, userId, message);
+    QMainWindow::showEvent(event);
+    updatePowerSaving();
+}
 
-    if (dialog.exec() == QDialog::Accepted) {
-        emit friendRequestAccepted(userId);
+void MainWindow::hideEvent(QHideEvent *event)
+{
+    QMainWindow::hideEvent(event);
+    updatePowerSaving();
+}
+
+void MainWindow::changeEvent(QEvent *event)
+{
+    QMainWindow::changeEvent(event);
+    if (event->type() == QEvent::WindowStateChange) {
+        updatePowerSaving();
+
+        // nothing is drawn until the window comes back, and then only one chat
+        const QWindowStateChangeEvent* stateEvent = static_cast<QWindowStateChangeEvent*>(event);
+        if (isMinimized() && !(stateEvent->oldState() & Qt::WindowMinimized)) {
+            MemoryPressure::getInstance().shed(MemoryPressure::Moderate);
+        }
+    }
+}
+
+void MainWindow::updatePowerSaving()
+{
+    const bool hidden = !isVisible() || isMinimized();
+    for (Profile* profile : profiles) {
+        profile->setPowerSaving(hidden);
     }
 }
 
@@ -234,78 +390,218 @@ void MainWindow::onAddFriendButtonClicked()
     AddFriendDialog dialog(this);
 
     if (dialog.exec() == QDialog::Accepted) {
-        emit friendRequested(dialog.getFriendAddress(), dialog.getMessage());
+        currentProfile()->requestFriendship(dialog.getFriendAddress(), dialog.getMessage());
     }
 }
 
-void MainWindow::onConnected()
+void MainWindow::onSettingsActionTriggered()
 {
-    emit statusSet(Status::Online);
+    Settings::getInstance().executeSettingsDialog(this);
 }
 
-void MainWindow::onDisconnected()
+void MainWindow::onAboutAppActionTriggered()
 {
-    emit statusSet(Status::Offline);
+    AboutDialog dialog(this);
+    dialog.exec();
 }
 
-void MainWindow::onFailedToRemoveFriend(int friendId)
+void MainWindow::onTrayMenuQuitApplicationActionTriggered()
 {
-    QMessageBox critical(this);
-    critical.setText(QString("Couldn't remove friend \"%1\"").arg(friendsWidget->getUsername(friendId)));
-    critical.setIcon(QMessageBox::Critical);
-    critical.exec();
+    CloseApplicationDialog dialog(this);
+    dialog.exec();
 }
 
-void MainWindow::onFailedToAddFriend(const QString& userId)
+void MainWindow::onSearchActionTriggered()
 {
-    QMessageBox critical(this);
-    critical.setText(QString("Couldn't add friend with User ID\n\"%1\"").arg(userId));
-    critical.setIcon(QMessageBox::Critical);
-    critical.exec();
+    ChatPageWidget *chatpage = qobject_cast<ChatPageWidget*>(currentProfile()->getPages()->currentWidget());
+    if(chatpage)
+        chatpage->showSearchBar();
 }
 
-void MainWindow::onFailedToStartCore()
+void MainWindow::onNewGroupChatActionTriggered()
 {
-    QMessageBox critical(this);
-    critical.setText("If you see this message that means that something very bad has happened.\n\nYou could have reached a limit on how many instances of this program can be run on a single computer, or you could just run out of memory, or something else horrible has happened.\n\nWhichever is the case, the application will terminate after you close this message.");
-    critical.setIcon(QMessageBox::Critical);
-    critical.exec();
-    qApp->quit();
+    currentProfile()->createGroup();
 }
 
-void MainWindow::onSettingsActionTriggered()
+void MainWindow::onSearchAllChatsActionTriggered()
 {
-    Settings::getInstance().executeSettingsDialog(this);
+    HistorySearchDialog dialog(currentProfile()->getPages(), this);
+    if (dialog.exec() == QDialog::Accepted && dialog.getFriendId() != -1) {
+        currentProfile()->showMessage(dialog.getFriendId(), dialog.getMsgId());
+    }
 }
 
-void MainWindow::onAboutAppActionTriggered()
+void MainWindow::onExportChatActionTriggered()
 {
-    AboutDialog dialog(this);
-    dialog.exec();
+    PagesWidget* pages = currentProfile()->getPages();
+    ChatPageWidget* chatpage = qobject_cast<ChatPageWidget*>(pages->currentWidget());
+    if (!chatpage) {
+        return;
+    }
+
+    if (!Settings::getInstance().getEnableLogging()) {
+        QMessageBox::information(this, tr("Export chat"), tr("Only logged chats can be exported, logging is disabled in the settings."));
+        return;
+    }
+
+    const QString username = chatpage->getUsername();
+    const QString documents = QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation);
+    const QString path = QFileDialog::getSaveFileName(this, tr("Export chat"), documents + "/" + username + ".html",
+                                                      tr("HTML (*.html);;Plain text (*.txt);;JSON Lines (*.jsonl)"));
+    if (path.isEmpty()) {
+        return;
+    }
+
+    HistoryExporter* exporter = new HistoryExporter(pages->getHistoryPath(chatpage->getFriendId()), pages->getHistoryKey(), username, path,
+                                                    HistoryExporter::formatForPath(path), Smileypack::current());
+
+    QProgressDialog* progressDialog = new QProgressDialog(tr("Exporting the chat with %1...").arg(username), tr("Cancel"), 0, 100, this);
+    progressDialog->setMinimumDuration(500);
+    progressDialog->setAttribute(Qt::WA_DeleteOnClose);
+    connect(progressDialog, &QProgressDialog::canceled, this, [exporter]() {exporter->cancel();});
+
+    // emitted on the pool's thread, so these are queued
+    connect(exporter, &HistoryExporter::progress, progressDialog, [progressDialog](qint64 done, qint64 total) {
+        progressDialog->setValue(total > 0 ? done * 100 / total : 100);
+    });
+    connect(exporter, &HistoryExporter::finished, this, [this, exporter, progressDialog](bool success, const QString& error) {
+        progressDialog->close();
+        exporter->deleteLater();
+        if (!success && !error.isEmpty()) {
+            QMessageBox::warning(this, tr("Export chat"), tr("Couldn't export the chat: %1").arg(error));
+        }
+    });
+
+    // the exporter reads the files, so the messages still waiting to be written go first
+    const std::function<void()> start = [exporter]() {QThreadPool::globalInstance()->start(exporter);};
+    if (!chatpage->flushHistory(start)) {
+        start();
+    }
 }
 
-void MainWindow::onTrayMenuQuitApplicationActionTriggered()
+void MainWindow::onImportChatActionTriggered()
 {
-    CloseApplicationDialog dialog(this);
-    dialog.exec();
+    PagesWidget* pages = currentProfile()->getPages();
+    ChatPageWidget* chatpage = qobject_cast<ChatPageWidget*>(pages->currentWidget());
+    if (!chatpage) {
+        return;
+    }
+
+    if (!Settings::getInstance().getEnableLogging()) {
+        QMessageBox::information(this, tr("Import chat history"), tr("History can only be imported into logged chats, logging is disabled in the settings."));
+        return;
+    }
+
+    const QString username = chatpage->getUsername();
+    const QString path = QFileDialog::getOpenFileName(this, tr("Import chat history with %1").arg(username), QDir::homePath(),
+                                                      tr("Text logs (*.txt *.log);;JSON Lines (*.jsonl);;qTox history (*.db *.sqlite)"));
+    if (path.isEmpty()) {
+        return;
+    }
+
+    const int friendId = chatpage->getFriendId();
+    HistoryImporter* importer = new HistoryImporter(path, HistoryImporter::formatForPath(path), Settings::getInstance().getUsername(),
+                                                    pages->getUserId(friendId).toString());
+
+    QProgressDialog* progressDialog = new QProgressDialog(tr("Importing the chat history with %1...").arg(username), tr("Cancel"), 0, 100, this);
+    progressDialog->setMinimumDuration(500);
+    progressDialog->setAttribute(Qt::WA_DeleteOnClose);
+    connect(progressDialog, &QProgressDialog::canceled, this, [importer]() {importer->cancel();});
+
+    // emitted on the pool's thread, so these are queued
+    connect(importer, &HistoryImporter::progress, progressDialog, &QProgressDialog::setValue);
+    connect(importer, &HistoryImporter::finished, this, [this, importer, progressDialog](bool success, const QString& error, int imported, int skipped) {
+        progressDialog->close();
+        importer->deleteLater();
+        if (success) {
+            QMessageBox::information(this, tr("Import chat history"), tr("%n message(s) imported.", "", imported) + ' '
+                                     + tr("%n message(s) were already in the history.", "", skipped));
+        } else if (!error.isEmpty()) {
+            QMessageBox::warning(this, tr("Import chat history"), tr("Couldn't import the chat history: %1").arg(error));
+        }
+    });
+
+    if (!pages->importHistory(friendId, importer)) {
+        progressDialog->close();
+        delete importer;
+    }
 }
 
-void MainWindow::onSearchActionTriggered()
+void MainWindow::onConnectionStatisticsActionTriggered()
 {
-    ChatPageWidget *chatpage = qobject_cast<ChatPageWidget*>(pages->currentWidget());
-    if(chatpage)
-        chatpage->showSearchBar();
+    currentProfile()->requestMetrics();
+}
+
+void MainWindow::onChatMemoryUsageActionTriggered()
+{
+    QList<QPair<QString, ChatMemoryUsage>> chats;
+    ChatMemoryUsage total;
+    for (Profile* profile : profiles) {
+        for (const QPair<QString, ChatMemoryUsage>& chat : profile->getPages()->getMemoryUsage()) {
+            chats << qMakePair(QString("%1 (%2)").arg(chat.first, profile->getName()), chat.second);
+            total += chat.second;
+        }
+    }
+
+    // the chats that bloat the most come first
+    std::sort(chats.begin(), chats.end(), [](const QPair<QString, ChatMemoryUsage>& a, const QPair<QString, ChatMemoryUsage>& b) {
+        return a.second.totalBytes() > b.second.totalBytes();
+    });
+
+    QString details;
+    for (const QPair<QString, ChatMemoryUsage>& chat : chats) {
+        details += QString("%1\n%2\n\n").arg(chat.first, chat.second.toString());
+    }
+
+    QMessageBox information(this);
+    information.setWindowTitle(tr("Chat memory usage"));
+    information.setText(tr("%n open chat(s)", "", chats.size()) + "\n" + total.toString() + "\n"
+                        + tr("Smiley images, shared by all chats: %1").arg(ChatMemoryUsage::formatBytes(SmileyTextObject::cachedImageBytes())) + "\n"
+                        + tr("Timestamp and sender layouts, shared by all chats: %1").arg(PlainTextLayout::sharedCount()));
+    information.setDetailedText(details.trimmed());
+    information.setIcon(QMessageBox::Information);
+    information.exec();
+}
+
+void MainWindow::onMetricsReported(const CoreMetrics& metrics)
+{
+    QMessageBox information(this);
+    information.setWindowTitle(tr("Connection statistics"));
+    information.setText(metrics.toString());
+    information.setIcon(QMessageBox::Information);
+    information.setStandardButtons(QMessageBox::Save | QMessageBox::Close);
+    information.setDefaultButton(QMessageBox::Close);
+    if (information.exec() == QMessageBox::Save) {
+        QString filePath = QFileDialog::getSaveFileName(this, tr("Save connection statistics"), QDir::homePath(), tr("Text files (*.txt)"));
+        if (!filePath.isEmpty()) {
+            metrics.dumpToFile(filePath);
+        }
+    }
 }
 
 void MainWindow::onShowHideWindow()
 {
     if (isVisible()) {
         hide();
-        trayMenuShowHideAction->setText(tr("Show"));
     } else {
         show();
         setFocus();
-        trayMenuShowHideAction->setText(tr("Hide"));
+    }
+
+    if (trayMenuShowHideAction != nullptr) {
+        trayMenuShowHideAction->setText(isVisible() ? tr("Hide") : tr("Show"));
+    }
+}
+
+void MainWindow::onSaveTraceActionTriggered()
+{
+    const QString filePath = QFileDialog::getSaveFileName(this, tr("Save trace"), QDir::homePath() + "/trace.json", tr("Chrome trace (*.json)"));
+    if (filePath.isEmpty()) {
+        return;
+    }
+
+    if (!Trace::exportJson(filePath)) {
+        QMessageBox::warning(this, tr("Save trace"), tr("Couldn't write the trace to %1.").arg(filePath));
     }
 }
 
@@ -318,7 +614,7 @@ void MainWindow::onTrayMenuStatusActionTriggered()
         CloseApplicationDialog dialog(this);
         dialog.exec();
     } else {
-        emit statusSet(selectedStatus);
+        currentProfile()->setStatus(selectedStatus);
     }
 }
 
@@ -332,11 +628,76 @@ void MainWindow::onTrayIconClick(QSystemTrayIcon::ActivationReason reason)
 void MainWindow::onStatusSet(Status status)
 {
     int statusValue = static_cast<int>(status);
-    for (int i = 0; i <= StatusHelper::MAX_STATUS; i ++) {
+    for (int i = 0; i < trayMenuStatusActions.size(); i ++) {
         if (trayMenuStatusActions[i]->data().toInt() == statusValue) {
             trayMenuStatusActions[i]->setEnabled(false);
         } else if (!trayMenuStatusActions[i]->isEnabled()) {
             trayMenuStatusActions[i]->setEnabled(true);
         }
     }
+    scheduleIndicatorUpdate();
+}
+
+void MainWindow::scheduleIndicatorUpdate()
+{
+    if (!indicatorTimer->isActive()) {
+        indicatorTimer->start();
+    }
+}
+
+void MainWindow::updateIndicators()
+{
+    // every profile's messages count, the status is the shown profile's
+    int unreadCount = 0;
+    for (Profile* profile : profiles) {
+        unreadCount += profile->getUnreadCount();
+    }
+    const Status status = profiles.isEmpty() ? Status::Offline : currentProfile()->getStatus();
+
+    const bool unreadChanged = unreadCount != shownUnreadCount;
+    if (unreadChanged) {
+        setWindowTitle(unreadCount > 0 ? QString("(%1) %2").arg(unreadCount).arg(WINDOW_TITLE) : WINDOW_TITLE);
+    }
+
+    if (trayIcon != nullptr && (unreadChanged || status != shownStatus)) {
+        if (unreadChanged) {
+            trayIcon->setIcon(trayIconFor(unreadCount));
+        }
+        QString toolTip = QCoreApplication::applicationName() + " - " + StatusHelper::getInfo(status).name;
+        if (unreadCount > 0) {
+            toolTip += "\n" + tr("%n unread message(s)", "", unreadCount);
+        }
+        trayIcon->setToolTip(toolTip);
+    }
+
+    shownUnreadCount = unreadCount;
+    shownStatus = status;
+}
+
+const QIcon& MainWindow::trayIconFor(int unreadCount)
+{
+    // the count is capped, so there are only a few of them
+    const int shownCount = qMin(unreadCount, MAX_TRAY_COUNT + 1);
+    QHash<int, QIcon>::const_iterator it = unreadTrayIcons.constFind(shownCount);
+    if (it != unreadTrayIcons.constEnd()) {
+        return it.value();
+    }
+
+    QPixmap pixmap(":/icons/icon64.png");
+    if (shownCount > 0) {
+        QPainter painter(&pixmap);
+        painter.setRenderHint(QPainter::Antialiasing);
+        const QRectF badge(pixmap.width() / 3.0, pixmap.height() / 3.0, pixmap.width() * 2 / 3.0, pixmap.height() * 2 / 3.0);
+        painter.setPen(Qt::NoPen);
+        painter.setBrush(QColor("#d9261c"));
+        painter.drawEllipse(badge);
+
+        QFont font = QApplication::font();
+        font.setBold(true);
+        font.setPixelSize(badge.height() / (shownCount > MAX_TRAY_COUNT ? 2.5 : 2));
+        painter.setFont(font);
+        painter.setPen(Qt::white);
+        painter.drawText(badge, Qt::AlignCenter, shownCount > MAX_TRAY_COUNT ? QString("%1+").arg(MAX_TRAY_COUNT) : QString::number(shownCount));
+    }
+    return unreadTrayIcons.insert(shownCount, QIcon(pixmap)).value();
 }
@@ -18,18 +18,19 @@
 #define MAINWINDOW_HPP
 
 #include "core.hpp"
-#include "friendswidget.hpp"
-#include "ouruseritemwidget.hpp"
+#include "corethreadpool.hpp"
+#include "profile.hpp"
 
+#include <QComboBox>
 #include <QLineEdit>
 #include <QListView>
 #include <QMainWindow>
 #include <QTextBrowser>
 #include <QThread>
 #include <QSplitter>
+#include <QStackedWidget>
 #include <QSystemTrayIcon>
-
-class PagesWidget;
+#include <QTimer>
 
 class MainWindow : public QMainWindow
 {
@@ -39,42 +40,68 @@ public:
     MainWindow(QWidget *parent = 0);
     ~MainWindow();
 
+    // isn't needed for the first frame, so it's created once the window is shown
+    void createTrayIcon();
+
 protected:
     void closeEvent(QCloseEvent *event);
+    void showEvent(QShowEvent *event);
+    void hideEvent(QHideEvent *event);
+    void changeEvent(QEvent *event);
 
 private:
-    Core* core;
-    QThread* coreThread;
-    FriendsWidget* friendsWidget;
-    OurUserItemWidget* ourUserItem;
+    CoreThreadPool* corePool;
+    QList<Profile*> profiles;
+    QComboBox* profileComboBox;
+    QStackedWidget* friendsPanels;
+    QStackedWidget* pagesPanels;
     QSplitter* splitterWidget;
-    PagesWidget *pages;
     QSystemTrayIcon* trayIcon;
     QAction* settingsAction;
     QAction* trayMenuShowHideAction;
     QList<QAction*> trayMenuStatusActions;
 
+    // the tray icon, its tool tip and the window title follow the status and the unread messages,
+    // a burst of messages updates them once per frame, since some shells are slow to take a new icon
+    QTimer* indicatorTimer;
+    int shownUnreadCount;
+    Status shownStatus;
+    QHash<int, QIcon> unreadTrayIcons;
+    static const int INDICATOR_INTERVAL = 16; // ms
+    // higher counts are shown as this and a plus
+    static const int MAX_TRAY_COUNT = 99;
+    static const QString WINDOW_TITLE;
+
+    Profile* currentProfile() const;
+    Profile* addProfile(const QString& name);
+    // the cores save power while the window is hidden or minimized
+    void updatePowerSaving();
+    void scheduleIndicatorUpdate();
+    const QIcon& trayIconFor(int unreadCount);
+
 private slots:
     void onAddFriendButtonClicked();
-    void onConnected();
-    void onDisconnected();
-    void onFriendRequestReceived(const QString &userId, const QString &message);
-    void onFailedToRemoveFriend(int friendId);
-    void onFailedToAddFriend(const QString& userId);
-    void onFailedToStartCore();
+    void onProfileSelected(int index);
+    void onNewProfileActionTriggered();
+    void onSetPasswordActionTriggered();
+    void onProfileStatusChanged(Status status);
     void onSettingsActionTriggered();
     void onAboutAppActionTriggered();
     void onSearchActionTriggered();
+    void onNewGroupChatActionTriggered();
+    void onSearchAllChatsActionTriggered();
+    void onExportChatActionTriggered();
+    void onImportChatActionTriggered();
+    void onConnectionStatisticsActionTriggered();
+    void onChatMemoryUsageActionTriggered();
+    void onMetricsReported(const CoreMetrics& metrics);
+    void onSaveTraceActionTriggered();
     void onTrayMenuStatusActionTriggered();
     void onTrayMenuQuitApplicationActionTriggered();
     void onShowHideWindow();
     void onTrayIconClick(QSystemTrayIcon::ActivationReason reason);
     void onStatusSet(Status status);
-
-signals:
-    void friendRequestAccepted(const QString& userId);
-    void friendRequested(const QString& friendAddress, const QString& message);
-    void statusSet(Status status);
+    void updateIndicators();
 
 };
 
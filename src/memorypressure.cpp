@@ -0,0 +1,221 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "memorypressure.hpp"
+#include "Settings/settings.hpp"
+
+#include <QCoreApplication>
+#include <QFile>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(Q_OS_MAC)
+#include <dispatch/dispatch.h>
+#include <mach/mach.h>
+#elif defined(Q_OS_LINUX)
+#include <unistd.h>
+#endif
+
+MemoryPressure& MemoryPressure::getInstance()
+{
+    static MemoryPressure* pressure = new MemoryPressure(QCoreApplication::instance());
+    return *pressure;
+}
+
+MemoryPressure::MemoryPressure(QObject* parent) :
+    QObject(parent), lastLevel(-1), ceilingLevel(-1)
+{
+    lastShed.invalidate();
+
+#if defined(Q_OS_WIN)
+    lowMemoryNotification = CreateMemoryResourceNotification(LowMemoryResourceNotification);
+#elif defined(Q_OS_MAC)
+    // the system tells us right away, on the main queue, which the GUI thread's event loop runs
+    dispatch_source_t source = dispatch_source_create(DISPATCH_SOURCE_TYPE_MEMORYPRESSURE, 0,
+                                                      DISPATCH_MEMORYPRESSURE_WARN | DISPATCH_MEMORYPRESSURE_CRITICAL,
+                                                      dispatch_get_main_queue());
+    dispatchSource = source;
+    if (source) {
+        dispatch_set_context(source, this);
+        dispatch_source_set_event_handler_f(source, &MemoryPressure::onDispatchEvent);
+        dispatch_resume(source);
+    }
+#endif
+
+    checkTimer.setInterval(CHECK_INTERVAL);
+    connect(&checkTimer, &QTimer::timeout, this, &MemoryPressure::check);
+    checkTimer.start();
+}
+
+MemoryPressure::~MemoryPressure()
+{
+#if defined(Q_OS_WIN)
+    if (lowMemoryNotification) {
+        CloseHandle(lowMemoryNotification);
+    }
+#elif defined(Q_OS_MAC)
+    if (dispatchSource) {
+        dispatch_source_t source = static_cast<dispatch_source_t>(dispatchSource);
+        dispatch_source_cancel(source);
+        dispatch_release(source);
+    }
+#endif
+}
+
+void MemoryPressure::registerCache(QObject* context, Priority priority, const std::function<void(Level)>& shed)
+{
+    Registration registration = {context, priority, shed};
+
+    // kept in the order they're shed in, in the order of registration within a priority
+    int i = registrations.size();
+    while (i > 0 && registrations.at(i - 1).priority > priority) {
+        i--;
+    }
+    registrations.insert(i, registration);
+
+    connect(context, &QObject::destroyed, this, &MemoryPressure::onContextDestroyed, Qt::UniqueConnection);
+}
+
+void MemoryPressure::onContextDestroyed(QObject* context)
+{
+    for (int i = registrations.size() - 1; i >= 0; i--) {
+        if (registrations.at(i).context == context) {
+            registrations.removeAt(i);
+        }
+    }
+}
+
+void MemoryPressure::shed(Level level)
+{
+    lastShed.start();
+
+    // shedding may destroy a context, which unregisters it
+    const QList<Registration> shedding = registrations;
+    for (const Registration& registration : shedding) {
+        if (level == Moderate && registration.priority > MODERATE_PRIORITY) {
+            break;
+        }
+        registration.shed(level);
+    }
+}
+
+void MemoryPressure::onPressure(Level level)
+{
+    shed(level);
+}
+
+void MemoryPressure::check()
+{
+    // a lasting shortage is shed again once in a while, a worse one right away
+    const int level = systemLevel();
+    if (level >= 0 && (level > lastLevel || lastShed.hasExpired(REPEAT_INTERVAL))) {
+        onPressure(static_cast<Level>(level));
+    }
+    lastLevel = level;
+
+    const qint64 ceiling = qint64(Settings::getInstance().getMemoryCeiling()) * 1024 * 1024;
+    const qint64 resident = ceiling > 0 ? residentSetSize() : -1;
+    if (resident < 0 || resident <= ceiling) {
+        ceilingLevel = -1;
+        return;
+    }
+
+    // the cheap caches first, the others once that wasn't enough
+    if (ceilingLevel < 0) {
+        ceilingLevel = Moderate;
+        onPressure(Moderate);
+    } else if (ceilingLevel == Moderate || lastShed.hasExpired(REPEAT_INTERVAL)) {
+        ceilingLevel = Critical;
+        onPressure(Critical);
+    }
+}
+
+int MemoryPressure::systemLevel() const
+{
+#if defined(Q_OS_WIN)
+    BOOL low = FALSE;
+    if (lowMemoryNotification && QueryMemoryResourceNotification(lowMemoryNotification, &low) && low) {
+        return Critical;
+    }
+#elif defined(Q_OS_LINUX)
+    // the part of the memory that can be had without swapping
+    QFile file("/proc/meminfo");
+    if (!file.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+    qint64 total = -1;
+    qint64 available = -1;
+    for (const QByteArray& line : file.readAll().split('\n')) {
+        const QList<QByteArray> fields = line.simplified().split(' ');
+        if (fields.size() < 2) {
+            continue;
+        }
+        if (fields.at(0) == "MemTotal:") {
+            total = fields.at(1).toLongLong();
+        } else if (fields.at(0) == "MemAvailable:") {
+            available = fields.at(1).toLongLong();
+        }
+    }
+    // older kernels don't have MemAvailable
+    if (total > 0 && available >= 0) {
+        if (available * 100 < total * 5) {
+            return Critical;
+        }
+        if (available * 100 < total * 10) {
+            return Moderate;
+        }
+    }
+#endif
+    // macOS tells us through the dispatch source instead
+    return -1;
+}
+
+qint64 MemoryPressure::residentSetSize()
+{
+#if defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.WorkingSetSize;
+    }
+#elif defined(Q_OS_MAC)
+    mach_task_basic_info info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) == KERN_SUCCESS) {
+        return info.resident_size;
+    }
+#elif defined(Q_OS_LINUX)
+    // size and resident set, in pages
+    QFile file("/proc/self/statm");
+    if (file.open(QIODevice::ReadOnly)) {
+        const QList<QByteArray> fields = file.readAll().simplified().split(' ');
+        if (fields.size() >= 2) {
+            return fields.at(1).toLongLong() * sysconf(_SC_PAGESIZE);
+        }
+    }
+#endif
+    return -1;
+}
+
+#if defined(Q_OS_MAC)
+void MemoryPressure::onDispatchEvent(void* context)
+{
+    MemoryPressure* pressure = static_cast<MemoryPressure*>(context);
+    const unsigned long flags = dispatch_source_get_data(static_cast<dispatch_source_t>(pressure->dispatchSource));
+    pressure->onPressure(flags & DISPATCH_MEMORYPRESSURE_CRITICAL ? Critical : Moderate);
+}
+#endif
@@ -0,0 +1,100 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef MEMORYPRESSURE_HPP
+#define MEMORYPRESSURE_HPP
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QObject>
+#include <QTimer>
+
+#include <functional>
+
+// Sheds caches when memory gets tight. Caches register a function that drops them, and are told
+// to shed in the order of their priority, the ones that are the cheapest to rebuild first.
+// Shedding is triggered by the OS's low memory notifications where it has them, by the
+// resident set size exceeding Settings::getMemoryCeiling(), and by the main window getting
+// minimized. Only to be used on the GUI thread.
+class MemoryPressure : public QObject
+{
+    Q_OBJECT
+public:
+    enum Priority {
+        LineDocuments,   // laid out text of chat lines out of view
+        RenderCaches,    // rendered chat lines, shared text layouts and smiley images
+        Thumbnails,      // the memory copy only, they stay in the disk cache
+        Avatars,
+        ChatLines        // lines of chats beyond the last screenfuls, they go to the scrollback store
+    };
+
+    enum Level {
+        Moderate,        // the window was minimized or the ceiling was reached
+        Critical         // the system is short of memory, or the ceiling is still exceeded
+    };
+
+    static MemoryPressure& getInstance();
+
+    // shed is called on every shedding, until context is destroyed, with the level it's for
+    void registerCache(QObject* context, Priority priority, const std::function<void(Level)>& shed);
+
+    // Moderate sheds the caches up to and including MODERATE_PRIORITY, Critical all of them
+    void shed(Level level);
+
+    // bytes, -1 where we don't know how to tell
+    static qint64 residentSetSize();
+
+    static const Priority MODERATE_PRIORITY = Thumbnails;
+    static const int CHECK_INTERVAL = 5000; // ms
+    // a lasting shortage isn't shed more often than this
+    static const int REPEAT_INTERVAL = 60 * 1000; // ms
+
+private:
+    struct Registration {
+        QObject* context;
+        Priority priority;
+        std::function<void(Level)> shed;
+    };
+
+    explicit MemoryPressure(QObject* parent);
+    ~MemoryPressure();
+    Q_DISABLE_COPY(MemoryPressure)
+
+    // the level the OS reports, -1 if memory is fine or we can't tell
+    int systemLevel() const;
+    void onPressure(Level level);
+
+    QList<Registration> registrations;
+    QTimer checkTimer;
+    QElapsedTimer lastShed;
+    int lastLevel;    // what the OS reported at the last check, -1 for nothing
+    int ceilingLevel; // what was shed for the ceiling since it was exceeded, -1 while it isn't
+
+#if defined(Q_OS_WIN)
+    void* lowMemoryNotification;
+#elif defined(Q_OS_MAC)
+    void* dispatchSource;
+    static void onDispatchEvent(void* context);
+#endif
+
+private slots:
+    void check();
+    void onContextDestroyed(QObject* context);
+
+};
+
+#endif // MEMORYPRESSURE_HPP
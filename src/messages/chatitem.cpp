@@ -18,6 +18,8 @@
 #include "chatitem.hpp"
 #include "chatline.hpp"
 #include "chatview.hpp"
+#include "chatmemoryusage.hpp"
+#include "objectpool.hpp"
 #include <QPainter>
 #include <QGraphicsSceneMouseEvent>
 #include <QPixmap>
@@ -28,7 +30,10 @@
 #include <QTextDocument>
 #include <QTextCursor>
 #include <QTextBlock>
-#include "smileytextobject.hpp"
+#include "plaintextlayout.hpp"
+#include "thumbnailcache.hpp"
+#include "trace.hpp"
+#include "Settings/settings.hpp"
 #include <QStyleOption>
 #include <QTextDocumentFragment>
 
@@ -64,6 +69,11 @@ ChatView *ChatItem::chatView() const
     return chatScene()->chatView();
 }
 
+const MessageAccessor *ChatItem::accessor() const
+{
+    return chatLine()->accessor();
+}
+
 int ChatItem::row() const
 {
     return chatLine()->row();
@@ -87,16 +97,27 @@ void ChatItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option,
 
     QAbstractTextDocumentLayout::PaintContext ctx;
     ctx.palette = QApplication::palette();
-    ctx.palette.setBrush(QPalette::Active, QPalette::Text, data(MessageModel::ForegroundRole).value<QBrush>());
+    ctx.palette.setBrush(QPalette::Active, QPalette::Text, accessor()->foreground(row(), column()));
     QPalette::ColorGroup cg = chatView()->hasFocus() ? QPalette::Active : QPalette::Inactive;
 
+    if (!usesDocument()) {
+        paintPlain(painter, ctx.palette, cg);
+        painter->restore();
+        return;
+    }
+
     //qDebug() << "-A--------";
     // Highlights (search results)
+    int end = document()->characterCount() - 1;
     for (Highlight *h : mHighlights) {
         //qDebug() << h->start() << h->length() << h->type();
+        // matches in the hidden part of a collapsed message
+        if (h->start() >= end)
+            continue;
+
         QTextCursor c(document());
         c.setPosition(h->start());
-        c.setPosition(h->start() + h->length(), QTextCursor::KeepAnchor);
+        c.setPosition(qMin(h->start() + h->length(), end), QTextCursor::KeepAnchor);
 
         QTextCharFormat f;
         if(h->type() == Highlight::Current)
@@ -124,6 +145,40 @@ void ChatItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option,
     painter->restore();
 }
 
+void ChatItem::paintPlain(QPainter *painter, const QPalette &palette, QPalette::ColorGroup cg)
+{
+    QVector<QTextLayout::FormatRange> selections;
+
+    // Highlights (search results)
+    for (Highlight *h : mHighlights) {
+        QTextLayout::FormatRange highlight;
+        highlight.start = h->start();
+        highlight.length = h->length();
+        highlight.format.setBackground(QBrush(h->type() == Highlight::Current ? "#a40000" : "#C4A000"));
+        highlight.format.setForeground(Qt::white);
+        selections << highlight;
+    }
+
+    // Selection
+    if (hasSelection()) {
+        QTextLayout::FormatRange selection;
+        if (selectionMode() == FullSelection) {
+            selection.start = 0;
+            selection.length = characterCount() - 1;
+        }
+        else {
+            selection.start = qMin(selectionStart(), selectionEnd());
+            selection.length = qAbs(selectionStart() - selectionEnd());
+        }
+        selection.format.setBackground(palette.brush(cg, QPalette::Highlight));
+        selection.format.setForeground(palette.brush(cg, QPalette::HighlightedText));
+        selections << selection;
+    }
+
+    painter->setPen(QPen(palette.brush(QPalette::Active, QPalette::Text), 0));
+    plainLayout()->draw(painter, pos(), selections);
+}
+
 QVariant ChatItem::data(int role) const
 {
     QModelIndex index = model()->index(row(), column());
@@ -137,15 +192,11 @@ QVariant ChatItem::data(int role) const
 QString ChatItem::selection() const
 {
     if (selectionMode() == FullSelection)
-        return data(MessageModel::DisplayRole).toString();
+        return displayText();
     if (selectionMode() == PartialSelection) {
         int start = qMin(selectionStart(), selectionEnd());
         int end   = start + qAbs(selectionStart() - selectionEnd());
-
-        QTextCursor cSelect(document());
-        cSelect.setPosition(start);
-        cSelect.setPosition(end, QTextCursor::KeepAnchor);
-        return cSelect.selectedText();
+        return textBetween(start, end);
     }
     return QString();
 }
@@ -241,6 +292,23 @@ void ChatItem::clearCache()
         delete mDoc;
         mDoc = NULL;
     }
+    mPlain.clear();
+}
+
+void ChatItem::addMemoryUsage(ChatMemoryUsage &usage) const
+{
+    if (mDoc) {
+        usage.cachedDocuments++;
+        usage.documentBytes += sizeof(ChatItemDocument) + ChatMemoryUsage::documentBytes(&mDoc->doc);
+    }
+    // shared layouts belong to no chat in particular
+    if (mPlain && !sharesLayout()) {
+        usage.plainLayouts++;
+        usage.documentBytes += ChatMemoryUsage::plainLayoutBytes(mPlain.data());
+    }
+
+    usage.highlights += mHighlights.count();
+    usage.highlightBytes += mHighlights.count() * (sizeof(Highlight) + sizeof(Highlight *));
 }
 
 void ChatItem::mouseMoveEvent(QGraphicsSceneMouseEvent *event)
@@ -317,7 +385,10 @@ QTextDocument *ChatItem::document() const
 
     ChatItem *that = const_cast<ChatItem *>(this);
     mDoc = new ChatItemDocument(that);
-    mDoc->callInitDocument();
+    {
+        Trace::Span span("ChatItem::initDocument");
+        mDoc->callInitDocument();
+    }
 
     if(chatScene())
         chatView()->setHasCache(chatLine(), true);
@@ -327,8 +398,121 @@ QTextDocument *ChatItem::document() const
 
 void ChatItem::initDocument(QTextDocument *doc)
 {
-    doc->setPlainText(data(MessageModel::DisplayRole).toString());
+    doc->setPlainText(plainText());
     doc->setTextWidth(width());
+    doc->setDefaultTextOption(textOption());
+}
+
+QString ChatItem::plainText() const
+{
+    return displayText();
+}
+
+QTextOption ChatItem::textOption() const
+{
+    // what a QTextDocument uses by default
+    QTextOption o;
+    o.setWrapMode(QTextOption::WrapAtWordBoundaryOrAnywhere);
+    return o;
+}
+
+PlainTextLayout *ChatItem::plainLayout() const
+{
+    if (mPlain)
+        return mPlain.data();
+
+    if (sharesLayout()) {
+        mPlain = PlainTextLayout::shared(plainText(), QApplication::font(), textOption(), width());
+    }
+    else {
+        mPlain = QSharedPointer<PlainTextLayout>(new PlainTextLayout(plainText(), QApplication::font(), textOption()));
+        mPlain->setTextWidth(width());
+    }
+
+    if(chatScene())
+        chatView()->setHasCache(chatLine(), true);
+
+    return mPlain.data();
+}
+
+bool ChatItem::needsPlainLayout() const
+{
+    return !mDoc && !mPlain && !sharesLayout() && !hasRichText();
+}
+
+bool ChatItem::adoptPlainLayout(const QSharedPointer<PlainTextLayout> &layout)
+{
+    // the text or the width may have changed while the layout was built
+    if (!needsPlainLayout() || layout->textWidth() != width() || layout->text() != plainText())
+        return false;
+
+    mPlain = layout;
+    if(chatScene())
+        chatView()->setHasCache(chatLine(), true);
+    return true;
+}
+
+bool ChatItem::usesDocument() const
+{
+    // the choice is made once per cache, clearCache() lets it be made again
+    if (mDoc)
+        return true;
+    if (mPlain)
+        return false;
+    return hasRichText();
+}
+
+void ChatItem::prepareLayout() const
+{
+    if (usesDocument())
+        document();
+    else
+        plainLayout();
+}
+
+int ChatItem::characterCount() const
+{
+    return usesDocument() ? document()->characterCount() : plainLayout()->characterCount();
+}
+
+qreal ChatItem::textHeight() const
+{
+    return usesDocument() ? document()->size().height() : plainLayout()->height();
+}
+
+void ChatItem::setTextWidth(qreal width)
+{
+    if (usesDocument())
+        document()->setTextWidth(width);
+    else if (sharesLayout() && mPlain)
+        mPlain = PlainTextLayout::shared(mPlain->text(), QApplication::font(), textOption(), width);
+    else
+        plainLayout()->setTextWidth(width);
+}
+
+QString ChatItem::textBetween(int start, int end) const
+{
+    if (!usesDocument())
+        return plainLayout()->text().mid(start, end - start);
+
+    QTextCursor cSelect(document());
+    cSelect.setPosition(start);
+    cSelect.setPosition(end, QTextCursor::KeepAnchor);
+    return cSelect.selectedText();
+}
+
+void ChatItem::wordAt(int pos, int &start, int &end) const
+{
+    if (!usesDocument()) {
+        plainLayout()->wordAt(pos, start, end);
+        return;
+    }
+
+    QTextCursor c(document());
+    c.setPosition(pos);
+    c.select(QTextCursor::WordUnderCursor);
+    start = c.selectionStart();
+    end = c.selectionEnd();
 }
 
 void ChatItem::setSelection(ChatItem::SelectionMode mode, qint16 start, qint16 end)
@@ -343,11 +527,11 @@ qint16 ChatItem::posToCursor(const QPointF &posInLine) const
 {
     QPointF pos = mapFromLine(posInLine);
     if (pos.y() > height())
-        return document()->characterCount()-1;
+        return characterCount()-1;
     if (pos.y() < 0)
         return 0;
 
-    int found = document()->documentLayout()->hitTest(pos, Qt::FuzzyHit);
+    int found = usesDocument() ? document()->documentLayout()->hitTest(pos, Qt::FuzzyHit) : plainLayout()->hitTest(pos);
 
     if(found < 0)
         return 0;
@@ -358,13 +542,13 @@ qint16 ChatItem::posToCursor(const QPointF &posInLine) const
 void ChatItem::setGeometry(qreal width, qreal height)
 {
     _boundingRect.setSize(QSizeF(width, height));
-    document()->setTextWidth(width);
+    setTextWidth(width);
 }
 
 void ChatItem::setWidth(const qreal &width)
 {
     _boundingRect.setWidth(width);
-    document()->setTextWidth(width);
+    setTextWidth(width);
 }
 
 
@@ -378,25 +562,24 @@ SenderChatItem::SenderChatItem(const QRectF &boundingRect, ChatLine *parent) :
 {
 }
 
-void SenderChatItem::initDocument(QTextDocument *doc)
+QString SenderChatItem::plainText() const
 {
     // Hide double sender names
-    QModelIndex lastIndex = model()->index(row()-1, column());
-    if (lastIndex.isValid()
-            && data(MessageModel::TypeRole).toInt() == Message::Plain
-            && model()->data(lastIndex, MessageModel::TypeRole).toInt() == Message::Plain
-            && (data(MessageModel::FlagsRole).toInt() & Message::Self) == (model()->data(lastIndex, MessageModel::FlagsRole).toInt() & Message::Self)) {
-        doc->setPlainText("");
-    }
-    else {
-        doc->setPlainText(data(MessageModel::DisplayRole).toString());
+    const MessageAccessor *rows = accessor();
+    if (row() > 0
+            && rows->msgType(row()) == Message::Plain
+            && rows->msgType(row() - 1) == Message::Plain
+            && rows->msgFlags(row()).testFlag(Message::Self) == rows->msgFlags(row() - 1).testFlag(Message::Self)) {
+        return QString("");
     }
+    return ChatItem::plainText();
+}
 
-    doc->setTextWidth(width());
-
+QTextOption SenderChatItem::textOption() const
+{
     QTextOption o;
     o.setWrapMode(QTextOption::NoWrap);
-    doc->setDefaultTextOption(o);
+    return o;
 }
 
 // ************************************************************
@@ -405,12 +588,30 @@ void SenderChatItem::initDocument(QTextDocument *doc)
 
 ContentsChatItem::ActionProxy ContentsChatItem::mActionProxy;
 
-ContentsChatItem::ContentsChatItem(const QPointF &pos, const qreal &width, ChatLine *parent) :
+namespace {
+ObjectPool<ContentsChatItemPrivate> contentsPrivatePool;
+}
+
+void *ContentsChatItemPrivate::operator new(size_t size)
+{
+    return contentsPrivatePool.allocate(size);
+}
+
+void ContentsChatItemPrivate::operator delete(void *p, size_t size)
+{
+    contentsPrivatePool.release(p, size);
+}
+
+ContentsChatItem::ContentsChatItem(const QPointF &pos, const qreal &width, bool layout, ChatLine *parent) :
     ChatItem(QRectF(pos, QSizeF(width, 0)), parent),
+    _expanded(false),
+    _collapsedLength(-2),
     _data(NULL)
 {
     setPos(pos);
-    setGeometryByWidth(width);
+    // the line sets an estimated geometry otherwise
+    if (layout)
+        setGeometryByWidth(width);
 }
 
 ContentsChatItem::~ContentsChatItem()
@@ -429,26 +630,30 @@ void ContentsChatItem::clearCache()
     }
 }
 
+void ContentsChatItem::addMemoryUsage(ChatMemoryUsage &usage) const
+{
+    ChatItem::addMemoryUsage(usage);
+
+    if (_data) {
+        usage.lineBytes += sizeof(ContentsChatItemPrivate) + _data->clickables.count() * sizeof(Clickable);
+        usage.addSmileys(_data->smileys);
+    }
+}
+
 QString ContentsChatItem::selection() const
 {
     if (selectionMode() == FullSelection)
-        return data(MessageModel::DisplayRole).toString();
+        return displayText();
     if (selectionMode() == PartialSelection) {
         int start = qMin(selectionStart(), selectionEnd());
         int end   = start + qAbs(selectionStart() - selectionEnd());
-        int endOffset = 0;
-        int startOffset = 0;
 
-        for (const Smiley &s : privateData()->smileys) {
-            if (start > s.smileyfiedStart()) {
-                startOffset += s.text().count() - ((s.type() == Smiley::Emoji) ? s.graphics().count() : 1);
-            }
-            if (s.smileyfiedStart() >= start && s.smileyfiedStart()+1 <= end) {
-                endOffset += s.text().count() - ((s.type() == Smiley::Emoji) ? s.graphics().count() : 1);
-            }
-        }
+        // a smiley starting inside the selection is taken with its whole text
+        const SmileyList &smileys = privateData()->smileys;
+        int originalStart = smileys.originalPosition(start);
+        int originalEnd   = smileys.originalPosition(end);
 
-        return data(MessageModel::DisplayRole).toString().mid(start+startOffset, end-start+endOffset);
+        return displayText().mid(originalStart, originalEnd - originalStart);
     }
     return QString();
 }
@@ -458,67 +663,102 @@ const SmileyList *ContentsChatItem::smileyList() const
     return &(privateData()->smileys);
 }
 
-void ContentsChatItem::initDocument(QTextDocument *doc)
+int ContentsChatItem::collapsedLength(const QString &text)
 {
-    QString text = data(MessageModel::DisplayRole).toString();
+    if (text.length() <= COLLAPSE_CHAR_COUNT && text.count(QLatin1Char('\n')) < COLLAPSE_LINE_COUNT)
+        return -1;
+
+    // cut at the end of a line if there is one in reach
+    int length = 0;
+    for (int line = 0; line < COLLAPSED_LINE_COUNT && length >= 0; line++)
+        length = text.indexOf(QLatin1Char('\n'), length + (line ? 1 : 0));
+    if (length < 0 || length > COLLAPSED_CHAR_COUNT)
+        length = COLLAPSED_CHAR_COUNT;
+
+    // don't split a surrogate pair
+    if (length > 0 && text.at(length - 1).isHighSurrogate())
+        length--;
+    return length;
+}
 
-    privateData()->smileys = SmileyList::fromText(text);
+bool ContentsChatItem::isCollapsed() const
+{
+    if (_expanded)
+        return false;
 
-    doc->setPlainText(text);
-    doc->setTextWidth(width());
+    // the contents of a row never change, so this is only looked at once
+    if (_collapsedLength == -2)
+        _collapsedLength = collapsedLength(displayText());
+    return _collapsedLength >= 0;
+}
 
-    // Replace smileys
-    QTextCursor c(doc);
-    int i=0;
-    for(const Smiley &smiley : privateData()->smileys) {
+void ContentsChatItem::setExpanded(bool expanded)
+{
+    bool wasCollapsed = isCollapsed();
+    _expanded = expanded;
+    if (isCollapsed() == wasCollapsed)
+        return;
 
-        // Remove textual smiley representation
-        c.setPosition(smiley.smileyfiedStart());
-        c.setPosition(smiley.smileyfiedStart()+smiley.text().count(), QTextCursor::KeepAnchor);
-        c.removeSelectedText();
+    // the highlights stay, they're positions in the full text anyway
+    chatLine()->clearCache();
+    if (chatScene())
+        chatScene()->layout(row(), row(), chatScene()->sceneRect().width());
+}
 
-        if (smiley.type() == Smiley::Pixmap) {
+QString ContentsChatItem::collapseNote() const
+{
+    QString text = displayText();
+    int hiddenLines = text.midRef(_collapsedLength).count(QLatin1Char('\n'));
+    if (hiddenLines > 0)
+        return tr("\n[... %n more line(s), click to show all]", "", hiddenLines);
+    return tr(" [... %n more character(s), click to show all]", "", text.length() - _collapsedLength);
+}
 
-            QObject *smileyInterface = new SmileyTextObject(smiley.graphics());
-            doc->documentLayout()->registerHandler(QTextFormat::UserObject + i+1, smileyInterface);
+QString ContentsChatItem::shownText() const
+{
+    QString text = displayText();
+    if (!isCollapsed())
+        return text;
+    return text.left(_collapsedLength) + collapseNote();
+}
 
-            QTextCharFormat smileyFormat;
-            smileyFormat.setObjectType(QTextFormat::UserObject + i+1);
-            c.insertText(QString(QChar::ObjectReplacementCharacter), smileyFormat);
-            i++;
-        }
-        else if (smiley.type() == Smiley::Emoji) {
+int ContentsChatItem::shownLength() const
+{
+    if (!isCollapsed())
+        return characterCount() - 1;
+    return characterCount() - 1 - collapseNote().length();
+}
 
-            c.insertText(smiley.graphics());
-            c.setPosition(smiley.smileyfiedStart(), QTextCursor::KeepAnchor);
-            QTextCharFormat format;
-            format.setFont(smiley.emojiFont());
-            c.mergeCharFormat(format);
-        }
-    }
+MessageSpansPtr ContentsChatItem::spans() const
+{
+    // only the shown part of a collapsed message is parsed, and not kept by the model
+    if (isCollapsed())
+        return MessageSpans::fromText(shownText());
 
-    // Clickables
-    QString dummtext = text;
-    for(const Smiley &smiley : privateData()->smileys) {
-        QString dummy = "#";
-        if(smiley.type() == Smiley::Emoji) {
-            for(int i=1; i<smiley.graphics().count(); i++)
-                dummy += "#";
-        }
-        dummtext.replace(smiley.smileyfiedStart(), smiley.text().count(), dummy);
-    }
+    // parsed once per message by the model
+    return accessor()->contentsSpans(row());
+}
 
-    privateData()->clickables = ClickableList::fromString(dummtext);
-    foreach(Clickable click, privateData()->clickables) {
-        QTextCursor c(doc);
-        c.setPosition(click.start());
-        c.setPosition(click.start()+click.length(), QTextCursor::KeepAnchor);
-        QTextCharFormat f;
-        f.setAnchor(true);
-        f.setAnchorHref(c.selectedText());
-        f.setForeground(QApplication::palette().brush(QPalette::Link));
-        c.mergeCharFormat(f);
-    }
+void ContentsChatItem::initDocument(QTextDocument *doc)
+{
+    MessageSpansPtr spans = this->spans();
+
+    privateData()->smileys = spans->smileys();
+    privateData()->clickables = spans->clickables();
+
+    spans->buildDocument(doc);
+    doc->setTextWidth(width());
+}
+
+bool ContentsChatItem::hasRichText() const
+{
+    MessageSpansPtr spans = this->spans();
+    return !spans->smileys().isEmpty() || !spans->clickables().isEmpty();
+}
+
+QString ContentsChatItem::plainText() const
+{
+    return spans()->text();
 }
 
 void ContentsChatItem::mouseMoveEvent(QGraphicsSceneMouseEvent *event)
@@ -531,45 +771,82 @@ void ContentsChatItem::mouseMoveEvent(QGraphicsSceneMouseEvent *event)
 void ContentsChatItem::hoverLeaveEvent(QGraphicsSceneHoverEvent *event)
 {
     endHoverMode();
+    if (isCollapsed() || (_data && _data->overPreview))
+        chatLine()->unsetCursor();
+    if (_data)
+        _data->overPreview = false;
     event->accept();
 }
 
 void ContentsChatItem::hoverMoveEvent(QGraphicsSceneHoverEvent *event)
 {
-    bool onClickable = false;
-    Clickable click = clickableAt(event->pos());
-    if (click.isValid()) {
-        if (click.type() == Clickable::Url) {
-            onClickable = true;
-        }
-        if (onClickable) {
-            privateData()->currentClickable = click;
+    event->accept();
 
-            // Set hand cursor
+    // the preview opens its image like a link
+    bool overPreview = hasPreview() && previewRect().contains(event->pos());
+    if (overPreview != (_data && _data->overPreview)) {
+        privateData()->overPreview = overPreview;
+        if (overPreview)
             chatLine()->setCursor(Qt::PointingHandCursor);
+        else
+            chatLine()->unsetCursor();
+    }
+    if (overPreview)
+        return;
 
-            // Underline clickable
-            QTextCursor c(document());
-            c.setPosition(click.start());
-            c.setPosition(click.start()+click.length(), QTextCursor::KeepAnchor);
-            QTextCharFormat f;
-            f.setUnderlineStyle(QTextCharFormat::SingleUnderline);
-            c.mergeCharFormat(f);
-
-            chatLine()->update();
-            return;
-        }
+    if (isCollapsed()) {
+        if (posToCursor(event->pos()) >= shownLength())
+            chatLine()->setCursor(Qt::PointingHandCursor);
+        else if (!_data || !_data->currentClickable.isValid())
+            chatLine()->unsetCursor();
     }
-    if (!onClickable)
+
+    // plain messages have nothing to hover, and no document to hit-test
+    if (!_data || _data->clickables.isEmpty())
+        return;
+
+    Clickable click = clickableAt(event->pos());
+    if (click.type() != Clickable::Url) {
         endHoverMode();
+        return;
+    }
 
-    event->accept();
+    // most moves stay on the same link, that needs neither a format change nor a repaint
+    if (click == _data->currentClickable)
+        return;
+
+    endHoverMode();
+    _data->currentClickable = click;
+
+    // Set hand cursor
+    chatLine()->setCursor(Qt::PointingHandCursor);
+
+    setUnderline(click, true);
+    chatLine()->update();
+}
+
+void ContentsChatItem::setUnderline(const Clickable &click, bool underline)
+{
+    QTextCursor c(document());
+    c.setPosition(click.start());
+    c.setPosition(click.start()+click.length(), QTextCursor::KeepAnchor);
+    QTextCharFormat f;
+    f.setUnderlineStyle(underline ? QTextCharFormat::SingleUnderline : QTextCharFormat::NoUnderline);
+    c.mergeCharFormat(f);
 }
 
 void ContentsChatItem::handleClick(const QPointF &pos, ChatScene::ClickMode clickMode)
 {
     if (clickMode == ChatScene::SingleClick) {
+        if (hasPreview() && previewRect().contains(pos)) {
+            Clickable(Clickable::Url).activate(spans()->previewUrl());
+            return;
+        }
         qint16 idx = posToCursor(pos);
+        if (isCollapsed() && idx >= shownLength()) {
+            setExpanded(true);
+            return;
+        }
         Clickable foo = privateData()->clickables.atCursorPos(idx);
         if (foo.isValid()) {
             QTextCursor c(document());
@@ -587,20 +864,15 @@ void ContentsChatItem::handleClick(const QPointF &pos, ChatScene::ClickMode clic
         }
         else {
             // find word boundary
-            qint16 cursor = posToCursor(pos);
-            QTextCursor c(document());
-            c.setPosition(cursor);
-
-            c.select(QTextCursor::WordUnderCursor);
-            setSelectionStart(c.selectionStart()); // TODO MKO write SelectionLayout directly?
-            setSelectionEnd(c.selectionEnd());
+            int start, end;
+            wordAt(posToCursor(pos), start, end);
+            setSelectionStart(start); // TODO MKO write SelectionLayout directly?
+            setSelectionEnd(end);
         }
         chatLine()->update();
     }
     else if (clickMode == ChatScene::TripleClick) {
-        QTextCursor c(document());
-        c.select(QTextCursor::Document);
-        setSelection(PartialSelection, 0, c.selectionEnd());
+        setSelection(PartialSelection, 0, characterCount() - 1);
     }
     ChatItem::handleClick(pos, clickMode);
 }
@@ -622,6 +894,10 @@ void ContentsChatItem::addActionsToMenu(QMenu *menu, const QPointF &pos)
         // Buffer-specific actions
         ChatItem::addActionsToMenu(menu, pos);
     }
+
+    bool collapsed = isCollapsed();
+    if (_collapsedLength >= 0)
+        menu->addAction(collapsed ? tr("Show Whole Message") : tr("Collapse Message"), &mActionProxy, SLOT(toggleExpanded()))->setData(QVariant::fromValue<void *>(this));
 }
 
 void ContentsChatItem::copyLinkToClipboard()
@@ -642,29 +918,21 @@ Clickable ContentsChatItem::clickableAt(const QPointF &pos) const
 
 void ContentsChatItem::endHoverMode()
 {
-    if (privateData()) {
-        if (privateData()->currentClickable.isValid()) {
-            privateData()->currentClickable = Clickable();
-
-            // Unset hand cursor
-            chatLine()->unsetCursor();
+    if (_data && _data->currentClickable.isValid()) {
+        // clearCache() drops _data with the document, so the document is still there
+        setUnderline(_data->currentClickable, false);
+        _data->currentClickable = Clickable();
 
-            // De-underline clickable
-            QTextCursor c(document());
-            c.setPosition(0);
-            c.setPosition(document()->characterCount()-1, QTextCursor::KeepAnchor);
-            QTextCharFormat f;
-            f.setUnderlineStyle(QTextCharFormat::NoUnderline);
-            c.mergeCharFormat(f);
-        }
+        // Unset hand cursor
+        chatLine()->unsetCursor();
         chatLine()->update();
     }
 }
 
 qreal ContentsChatItem::setGeometryByWidth(qreal w)
 {
-    document()->setTextWidth(w);
-    qreal h = document()->size().height();
+    setTextWidth(w);
+    qreal h = textHeight() + previewHeight();
 
     if (w != width() || h != height())
         setGeometry(w, h);
@@ -673,6 +941,61 @@ qreal ContentsChatItem::setGeometryByWidth(qreal w)
 
 }
 
+void ContentsChatItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
+{
+    ChatItem::paint(painter, option, widget);
+    if (hasPreview())
+        paintPreview(painter);
+}
+
+bool ContentsChatItem::hasPreview() const
+{
+    return Settings::getInstance().snapshot()->inlinePreviews && !isCollapsed() && !spans()->previewUrl().isEmpty();
+}
+
+bool ContentsChatItem::isPreviewPending() const
+{
+    return hasPreview() && !ThumbnailCache::instance()->isLoaded(spans()->previewUrl(), chatView()->devicePixelRatio());
+}
+
+qreal ContentsChatItem::previewHeight() const
+{
+    return hasPreview() ? ThumbnailCache::PREVIEW_HEIGHT + PREVIEW_MARGIN : 0;
+}
+
+QRectF ContentsChatItem::previewRect() const
+{
+    // at the bottom of the item, below the text and aligned with it
+    qreal margin = PlainTextLayout::DOCUMENT_MARGIN;
+    return QRectF(x() + margin, y() + height() - ThumbnailCache::PREVIEW_HEIGHT - PREVIEW_MARGIN,
+                  qMin<qreal>(ThumbnailCache::PREVIEW_WIDTH, width() - 2 * margin), ThumbnailCache::PREVIEW_HEIGHT);
+}
+
+void ContentsChatItem::paintPreview(QPainter *painter)
+{
+    QRectF rect = previewRect();
+    QString url = spans()->previewUrl();
+    ThumbnailCache *cache = ThumbnailCache::instance();
+    const int dpr = painter->device()->devicePixelRatio();
+    QPixmap pixmap = cache->thumbnail(url, dpr);
+
+    painter->save();
+    painter->setClipRect(boundingRect());
+    if (!pixmap.isNull()) {
+        QSizeF size = QSizeF(pixmap.size()) / pixmap.devicePixelRatio();
+        if (size.width() > rect.width())
+            size.scale(rect.size(), Qt::KeepAspectRatio);
+        painter->drawPixmap(QRectF(rect.topLeft(), size), pixmap, pixmap.rect());
+    }
+    else {
+        // the space stays reserved for images that can't be previewed too, the line would jump otherwise
+        painter->setPen(QApplication::palette().mid().color());
+        painter->drawRect(rect.adjusted(0.5, 0.5, -0.5, -0.5));
+        painter->drawText(rect, Qt::AlignCenter, cache->isLoaded(url, dpr) ? tr("No preview") : tr("Loading preview..."));
+    }
+    painter->restore();
+}
+
 ContentsChatItemPrivate *ContentsChatItem::privateData() const
 {
     if (!_data) {
@@ -692,12 +1015,10 @@ TimestampChatItem::TimestampChatItem(const QRectF &boundingRect, ChatLine *paren
 {
 }
 
-void TimestampChatItem::initDocument(QTextDocument *doc)
+QTextOption TimestampChatItem::textOption() const
 {
-    ChatItem::initDocument(doc);
-
     QTextOption o;
     o.setAlignment(Qt::AlignRight);
     o.setWrapMode(QTextOption::NoWrap);
-    doc->setDefaultTextOption(o);
+    return o;
 }
@@ -25,12 +25,16 @@
 #include "chatscene.hpp"
 #include "clickable.hpp"
 #include "smiley.hpp"
+#include "messagespans.hpp"
 
 #include <QAbstractTextDocumentLayout>
+#include <QPalette>
+#include <QTextOption>
 
 class ChatLine;
 class ChatView;
 class ChatItemDocument;
+class PlainTextLayout;
 
 /* All external positions are relative to the parent ChatLine */
 /* Yes, that's also true for the boundingRect() and related things */
@@ -44,6 +48,7 @@ protected:
 
 public:
     const QAbstractItemModel *model() const;
+    const MessageAccessor *accessor() const;
     inline ChatLine *chatLine() const { return _parent; }
     ChatScene *chatScene() const;
     ChatView *chatView() const;
@@ -68,6 +73,8 @@ public:
     virtual inline int type() const { return ChatScene::ChatItemType; }
 
     QVariant data(int role) const;
+    //! What data() has for DisplayRole, without the QVariant
+    inline QString displayText() const { return accessor()->displayText(row(), column()); }
 
     // selection stuff, to be called by the scene
     virtual QString selection() const;
@@ -88,6 +95,17 @@ public:
     //! This removes the cached QTextDocument to avoid wasting space for nonvisible ChatLines.
     virtual void clearCache();
 
+    //! Adds the item, its cached document and highlights to usage
+    virtual void addMemoryUsage(ChatMemoryUsage &usage) const;
+
+    //! Whether the item will draw from a plain layout of its own, but has none yet
+    bool needsPlainLayout() const;
+    // what the plain layout is built from, for building it elsewhere
+    inline QString layoutText() const { return plainText(); }
+    inline QTextOption layoutOption() const { return textOption(); }
+    //! Takes a plain layout built elsewhere, see ChatLayoutPrefetcher, unless it no longer fits the item
+    bool adoptPlainLayout(const QSharedPointer<PlainTextLayout> &layout);
+
 protected:
     enum SelectionMode {
         NoSelection,
@@ -106,6 +124,26 @@ protected:
     QTextDocument *document() const;
     virtual void initDocument(QTextDocument *doc);
 
+    //! Whether the item needs a QTextDocument, plain text is laid out by a PlainTextLayout
+    virtual bool hasRichText() const { return false; }
+    //! The text as it's shown, for both the document and the plain layout
+    virtual QString plainText() const;
+    virtual QTextOption textOption() const;
+    //! Whether the plain layout comes from PlainTextLayout::shared(), rather than being the item's own
+    virtual bool sharesLayout() const { return false; }
+    PlainTextLayout *plainLayout() const;
+    //! Whether the text is drawn by document() rather than plainLayout()
+    bool usesDocument() const;
+    //! Creates the document or layout, so it's ready when the line scrolls into view
+    void prepareLayout() const;
+
+    // these go to the document or the plain layout, whichever the item uses
+    int characterCount() const;
+    qreal textHeight() const;
+    void setTextWidth(qreal width);
+    QString textBetween(int start, int end) const;
+    void wordAt(int pos, int &start, int &end) const;
+
     inline qint16 selectionStart() const { return _selectionStart; }
     inline void setSelectionStart(qint16 start) { _selectionStart = start; }
     inline qint16 selectionEnd() const { return _selectionEnd; }
@@ -122,6 +160,8 @@ protected:
     inline void setPos(const QPointF &pos) {_boundingRect.moveTopLeft(pos); }
 
 private:
+    void paintPlain(QPainter *painter, const QPalette &palette, QPalette::ColorGroup cg);
+
     ChatLine *_parent;
     QRectF _boundingRect;
 
@@ -130,6 +170,7 @@ private:
     int _selectionEnd;
 
     mutable ChatItemDocument *mDoc;
+    mutable QSharedPointer<PlainTextLayout> mPlain;
 
     // Search results
     QList<Highlight*> mHighlights;
@@ -161,7 +202,8 @@ public:
     virtual inline MessageModel::ColumnType column() const { return MessageModel::TimestampColumn; }
 
 protected:
-    virtual void initDocument(QTextDocument *doc);
+    virtual QTextOption textOption() const;
+    virtual bool sharesLayout() const { return true; }
 };
 
 // ************************************************************
@@ -176,7 +218,9 @@ public:
     virtual inline MessageModel::ColumnType column() const { return MessageModel::SenderColumn; }
 
 protected:
-    virtual void initDocument(QTextDocument *doc);
+    virtual QString plainText() const;
+    virtual QTextOption textOption() const;
+    virtual bool sharesLayout() const { return true; }
 };
 
 // ************************************************************
@@ -190,18 +234,50 @@ class ContentsChatItem : public ChatItem
     Q_DECLARE_TR_FUNCTIONS(ContentsChatItem)
 
 public:
-    ContentsChatItem(const QPointF &pos, const qreal &width, ChatLine *parent);
+    ContentsChatItem(const QPointF &pos, const qreal &width, bool layout, ChatLine *parent);
     ~ContentsChatItem();
 
     void clearCache();
+    void addMemoryUsage(ChatMemoryUsage &usage) const;
 
     virtual inline int type() const { return ChatScene::ContentsChatItemType; }
     inline MessageModel::ColumnType column() const { return MessageModel::ContentsColumn; }
     virtual QString selection() const;
     const SmileyList *smileyList() const;
 
+    //! Whether the message is too long to be shown in full and the user didn't expand it
+    /** A collapsed message shows its first lines and a note how many more there are, so a huge paste
+     *  doesn't have to be laid out at all. Copying a full selection and searching use the whole text. */
+    bool isCollapsed() const;
+    void setExpanded(bool expanded);
+    //! Length of the part of the message that is shown, in smileyfied positions
+    int shownLength() const;
+    //! The unsmileyfied text that is laid out, for measuring the line elsewhere
+    QString shownText() const;
+
+    // messages with more lines or characters than this are collapsed...
+    static const int COLLAPSE_LINE_COUNT = 50;
+    static const int COLLAPSE_CHAR_COUNT = 8000;
+    // ...to about this much
+    static const int COLLAPSED_LINE_COUNT = 20;
+    static const int COLLAPSED_CHAR_COUNT = 2000;
+
+    virtual void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget = 0);
+
+    //! Whether an image linked in the message is previewed below its text
+    bool hasPreview() const;
+    //! Whether the preview is still loading, the line can't be cached as a pixmap until it's there
+    bool isPreviewPending() const;
+    //! The space reserved below the text for the preview, 0 without one
+    /** It doesn't depend on the image, so lines can be measured before the thumbnail is loaded
+     *  and don't jump when it arrives. */
+    qreal previewHeight() const;
+
 protected:
     virtual void initDocument(QTextDocument *doc);
+    //! Messages with links or smileys need a document, the others are plain
+    virtual bool hasRichText() const;
+    virtual QString plainText() const;
 
     virtual void mouseMoveEvent(QGraphicsSceneMouseEvent *event);
     virtual void hoverLeaveEvent(QGraphicsSceneHoverEvent *event);
@@ -210,19 +286,33 @@ protected:
 
     virtual void addActionsToMenu(QMenu *menu, const QPointF &pos);
     virtual void copyLinkToClipboard();
+    inline void toggleExpanded() { setExpanded(isCollapsed()); }
 
 private:
     class ActionProxy;
 
+    //! Length of the shown part of text, -1 if the whole text is shown
+    static int collapsedLength(const QString &text);
+    QString collapseNote() const;
+    bool _expanded;
+    mutable int _collapsedLength; // of the display text, -2 until it's known
+
     Clickable clickableAt(const QPointF &pos) const;
 
     void endHoverMode();
+    void setUnderline(const Clickable &click, bool underline);
+
+    QRectF previewRect() const;
+    void paintPreview(QPainter *painter);
+    static const int PREVIEW_MARGIN = 4;
 
     qreal setGeometryByWidth(qreal w);
 
     // we need a receiver for Action signals
     static ActionProxy mActionProxy;
 
+    MessageSpansPtr spans() const;
+
     ContentsChatItemPrivate *privateData() const;
     mutable ContentsChatItemPrivate *_data;
 
@@ -238,8 +328,13 @@ public:
     Clickable activeClickable;
 
     SmileyList smileys;
+    bool overPreview;
+
+    ContentsChatItemPrivate(ContentsChatItem *parent) : contentsItem(parent), overPreview(false) {}
 
-    ContentsChatItemPrivate(ContentsChatItem *parent) : contentsItem(parent) {}
+    // created for every contents item that is shown, see ObjectPool
+    static void *operator new(size_t size);
+    static void operator delete(void *p, size_t size);
 };
 
 //! Acts as a proxy for Action signals targetted at a ContentsChatItem
@@ -253,6 +348,7 @@ class ContentsChatItem::ActionProxy : public QObject
 
 public slots:
     inline void copyLinkToClipboard() { item()->copyLinkToClipboard(); }
+    inline void toggleExpanded() { item()->toggleExpanded(); }
 
 private:
     /// Returns the ContentsChatItem that should receive the action event.
@@ -0,0 +1,55 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "chatlayoutprefetcher.hpp"
+
+#include "plaintextlayout.hpp"
+
+ChatLayoutPrefetcher::ChatLayoutPrefetcher(const QSharedPointer<QAtomicInt> &currentGeneration, const QVector<int> &rows,
+                                           const QVector<qint64> &msgIds, const QStringList &texts, const QVector<qreal> &widths,
+                                           const QFont &font, const QTextOption &option) :
+    _currentGeneration(currentGeneration),
+    _generation(currentGeneration->load()),
+    _rows(rows),
+    _msgIds(msgIds),
+    _texts(texts),
+    _widths(widths),
+    _font(font),
+    _option(option)
+{
+}
+
+void ChatLayoutPrefetcher::run()
+{
+    for (int first = 0; first < _rows.count(); first += BATCH_SIZE) {
+        if (_currentGeneration->load() != _generation)
+            return;
+
+        ChatLayoutBatch batch;
+        batch.generation = _generation;
+        batch.rows = _rows.mid(first, BATCH_SIZE);
+        batch.msgIds = _msgIds.mid(first, BATCH_SIZE);
+        batch.layouts.reserve(batch.rows.count());
+        for (int i = first; i < first + batch.rows.count(); i++) {
+            QSharedPointer<PlainTextLayout> layout(new PlainTextLayout(_texts.at(i), _font, _option));
+            layout->setTextWidth(_widths.at(i));
+            batch.layouts << layout;
+        }
+
+        emit batchReady(batch);
+    }
+}
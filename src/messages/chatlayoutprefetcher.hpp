@@ -0,0 +1,77 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef CHATLAYOUTPREFETCHER_HPP
+#define CHATLAYOUTPREFETCHER_HPP
+
+#include <QAtomicInt>
+#include <QFont>
+#include <QObject>
+#include <QRunnable>
+#include <QSharedPointer>
+#include <QStringList>
+#include <QTextOption>
+#include <QVector>
+
+class PlainTextLayout;
+
+//! Contents layouts of some rows, built for one prefetch of a ChatScene
+struct ChatLayoutBatch
+{
+    int generation;
+    QVector<int> rows;
+    QVector<qint64> msgIds; // the rows may have moved meanwhile
+    QVector<QSharedPointer<PlainTextLayout> > layouts;
+};
+Q_DECLARE_METATYPE(ChatLayoutBatch)
+
+/**
+ * Builds the PlainTextLayouts of chat lines that are about to scroll into view on QThreadPool, so
+ * the GUI thread only has to draw them. A PlainTextLayout is a QTextLayout, which unlike a QTextDocument
+ * may be built on another thread as long as only one thread uses it at a time, the scene hands it to
+ * its line once it's back on the GUI thread. Lines with smileys or links need their QTextDocument and
+ * are left to ChatLine::prefetchDocuments(). The job stops as soon as a newer prefetch started, the view
+ * is heading somewhere else then.
+ */
+class ChatLayoutPrefetcher : public QObject, public QRunnable
+{
+    Q_OBJECT
+public:
+    ChatLayoutPrefetcher(const QSharedPointer<QAtomicInt> &currentGeneration, const QVector<int> &rows,
+                         const QVector<qint64> &msgIds, const QStringList &texts, const QVector<qreal> &widths,
+                         const QFont &font, const QTextOption &option);
+
+    void run();
+
+    // small batches, the rows closest to the viewport are in the first one
+    static const int BATCH_SIZE = 20;
+
+signals:
+    void batchReady(const ChatLayoutBatch &batch);
+
+private:
+    QSharedPointer<QAtomicInt> _currentGeneration;
+    int _generation;
+    QVector<int> _rows;
+    QVector<qint64> _msgIds;
+    QStringList _texts;
+    QVector<qreal> _widths;
+    QFont _font;
+    QTextOption _option;
+};
+
+#endif // CHATLAYOUTPREFETCHER_HPP
@@ -18,28 +18,64 @@
 #include "chatline.hpp"
 #include "chatview.hpp"
 #include "chatitem.hpp"
+#include "chatviewstats.hpp"
+#include "chatmemoryusage.hpp"
+#include "objectpool.hpp"
+#include "plaintextlayout.hpp"
 #include <QGraphicsSceneMouseEvent>
 #include <QApplication>
+#include <QFontMetricsF>
+#include <QPainter>
+#include <QPixmapCache>
+#include <qmath.h>
 
-ChatLine::ChatLine(int row, QAbstractItemModel *model, const qreal &width, const qreal &firstWidth, const qreal &secondWidth, const qreal &thirdWidth, const QPointF &secondPos, const QPointF &thirdPos, QGraphicsItem *parent) :
+#include "Settings/settings.hpp"
+
+// the QPixmapCache budget, in KB, while rendered lines are cached
+static const int pixmapCacheLimit = 32 * 1024;
+
+quint64 ChatLine::_lastPixmapCacheId = 0;
+
+namespace {
+ObjectPool<ChatLine> linePool;
+}
+
+ChatLine::ChatLine(int row, QAbstractItemModel *model, const MessageAccessor *accessor, const qreal &width, const qreal &firstWidth, const qreal &secondWidth, const qreal &thirdWidth, const QPointF &secondPos, const QPointF &thirdPos, bool layout, QGraphicsItem *parent) :
     QGraphicsItem(parent),
     _row(row), // needs to be set before the items
     _model(model),
-    _contentsItem(secondPos, secondWidth, this),
+    _accessor(accessor),
+    _msgType(accessor->msgType(row)),
+    _contentsItem(secondPos, secondWidth, layout, this),
     _senderItem(QRectF(0, 0, firstWidth, _contentsItem.height()), this),
     _timestampItem(QRectF(thirdPos, QSizeF(thirdWidth, _contentsItem.height())), this),
     _width(width),
     _height(_contentsItem.height()),
+    _heightEstimated(false),
+    _self(false),
+    _separatorAbove(false),
+    _continuation(false),
+    _pixmapCacheId(++_lastPixmapCacheId),
     _selection(0),
     _mouseGrabberItem(0),
     _hoverItem(0)
 {
-    Q_ASSERT(model);
+    Q_ASSERT(model && accessor);
     setZValue(0);
     setAcceptHoverEvents(true);
 
-    QModelIndex index = model->index(row, MessageModel::ContentsColumn);
-    setHighlighted(index.data(MessageModel::FlagsRole).toInt() & Message::Highlight);
+    Message::Flags flags = accessor->msgFlags(row);
+    _self = flags.testFlag(Message::Self);
+    setHighlighted(flags.testFlag(Message::Highlight));
+
+    // Without layout the line reserves a single line of text. A width of 0 makes the scene's
+    // layout pass treat the line like one of a resize, it is laid out once it comes into view
+    // or measured in the background together with the others.
+    if (!layout) {
+        QFontMetricsF metrics(QApplication::font());
+        qreal height = metrics.lineSpacing() + 2 * PlainTextLayout::DOCUMENT_MARGIN;
+        setGeometryByHeight(0, secondWidth, thirdWidth, thirdPos, height);
+    }
 }
 
 ChatLine::~ChatLine()
@@ -48,6 +84,16 @@ ChatLine::~ChatLine()
         chatView()->setHasCache(this, false);
 }
 
+void *ChatLine::operator new(size_t size)
+{
+    return linePool.allocate(size);
+}
+
+void ChatLine::operator delete(void *p, size_t size)
+{
+    linePool.release(p, size);
+}
+
 ChatItem *ChatLine::item(MessageModel::ColumnType column)
 {
     switch (column) {
@@ -75,12 +121,64 @@ ChatItem *ChatLine::itemAt(const QPointF &pos)
 
 void ChatLine::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
 {
-    Q_UNUSED(option);
-    Q_UNUSED(widget);
+    ChatViewStats::Timer statsTimer(ChatViewStats::LinePaint);
+
+    if (!Settings::getInstance().snapshot()->chatLinePixmapCache || !canCachePixmap()) {
+        paintLine(painter, option, widget);
+        return;
+    }
+
+    static bool limitSet = false;
+    if (!limitSet) {
+        QPixmapCache::setCacheLimit(qMax(QPixmapCache::cacheLimit(), pixmapCacheLimit));
+        limitSet = true;
+    }
+
+    // everything the rendering depends on besides the documents, which renew _pixmapCacheId
+    int dpr = painter->device()->devicePixelRatio();
+    bool focus = chatView() && chatView()->hasFocus();
+    QString key = QString("chatline-%1-%2x%3-%4-%5%6%7-%8-%9")
+            .arg(_pixmapCacheId).arg(width()).arg(height()).arg(_selection)
+            .arg(_senderItem.selectionMode()).arg(_contentsItem.selectionMode()).arg(_timestampItem.selectionMode())
+            .arg(focus).arg(dpr);
+
+    QPixmap pixmap;
+    if (!QPixmapCache::find(key, &pixmap)) {
+        pixmap = QPixmap(qCeil(width() * dpr), qCeil(height() * dpr));
+        pixmap.setDevicePixelRatio(dpr);
+        pixmap.fill(Qt::transparent);
+        QPainter pixmapPainter(&pixmap);
+        paintLine(&pixmapPainter, option, widget);
+        pixmapPainter.end();
+        QPixmapCache::insert(key, pixmap);
+    }
+    painter->drawPixmap(0, 0, pixmap);
+}
+
+//! Whether the line looks the same every time it is painted in its current state
+/** Partial selections, search highlights and hovered links change the rendering without any
+ *  state the pixmap key could cover, those lines are painted directly. */
+bool ChatLine::canCachePixmap() const
+{
+    const ChatItem *items[] = { &_senderItem, &_contentsItem, &_timestampItem };
+    for (const ChatItem *chatItem : items) {
+        if (chatItem->selectionMode() == ChatItem::PartialSelection || !chatItem->mHighlights.isEmpty())
+            return false;
+    }
+    if (_contentsItem._data && _contentsItem._data->currentClickable.isValid())
+        return false;
+    if (_contentsItem.isPreviewPending())
+        return false;
+    return true;
+}
 
-    const QAbstractItemModel *model_ = model();
-    QModelIndex myIdx = model_->index(row(), 0);
+void ChatLine::invalidatePixmap()
+{
+    _pixmapCacheId = ++_lastPixmapCacheId;
+}
 
+void ChatLine::paintLine(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
+{
     // Draw a rect for the whole selection (all colums with seperators).
     if (_selection & Selected) {
         ChatItem *rightItem = item((MessageModel::ColumnType)((_selection & 0x0C)>>2));
@@ -92,27 +190,40 @@ void ChatLine::paint(QPainter *painter, const QStyleOptionGraphicsItem *option,
 
     // draw chatitems
     // the items draw themselves at the correct position
-    senderItem()->paint(painter, option, widget);
+    if (!_continuation)
+        senderItem()->paint(painter, option, widget);
     contentsItem()->paint(painter, option, widget);
-    timestampItem()->paint(painter, option, widget);
+    if (!_continuation)
+        timestampItem()->paint(painter, option, widget);
 
     // draw seperator line
-    if(row()-1 >= 0) {
-        QModelIndex lastIdx = model_->index(row()-1, 0);
-        if ((model_->data(lastIdx, MessageModel::FlagsRole).toInt() & Message::Self) != (model_->data(myIdx, MessageModel::FlagsRole).toInt() & Message::Self)) {
-            painter->save();
-            QLinearGradient g(0, 0, width(), 1);
-            g.setColorAt(0  , Qt::transparent);
-            g.setColorAt(0.5, QApplication::palette().mid().color());
-            g.setColorAt(1  , Qt::transparent);
-            painter->fillRect(0, 0, width(), 1, g);
-            painter->restore();
-        }
+    if (_separatorAbove)
+        painter->fillRect(QRectF(0, 0, width(), 1), separatorBrush());
+}
+
+// One gradient for the separators of all lines, it's stretched to the width of the line
+// it is drawn on. Only rebuilt when the palette changes.
+const QBrush &ChatLine::separatorBrush()
+{
+    static QBrush brush;
+    static QColor color;
+
+    QColor mid = QApplication::palette().mid().color();
+    if (!brush.gradient() || mid != color) {
+        color = mid;
+        QLinearGradient g(0, 0, 1, 0);
+        g.setCoordinateMode(QGradient::ObjectBoundingMode);
+        g.setColorAt(0  , Qt::transparent);
+        g.setColorAt(0.5, color);
+        g.setColorAt(1  , Qt::transparent);
+        brush = QBrush(g);
     }
+    return brush;
 }
 
 void ChatLine::setFirstColumn(const qreal &firstWidth, const qreal &secondwidth, const QPointF &secondPos, qreal &linePos)
 {
+    invalidatePixmap();
     // linepos is the *bottom* position for the line
     qreal height = _contentsItem.setGeometryByWidth(secondwidth);
     _contentsItem.setPos(secondPos);
@@ -126,12 +237,14 @@ void ChatLine::setFirstColumn(const qreal &firstWidth, const qreal &secondwidth,
         prepareGeometryChange();
 
     _height = height;
+    _heightEstimated = false;
 
     setPos(0, linePos);
 }
 
 void ChatLine::setSecondColumn(const qreal &secondWidth, const qreal &thirdWidth, const QPointF &thirdPos, qreal &linePos)
 {
+    invalidatePixmap();
     // linepos is the *bottom* position for the line
     qreal height = _contentsItem.setGeometryByWidth(secondWidth);
     linePos -= height;
@@ -145,12 +258,14 @@ void ChatLine::setSecondColumn(const qreal &secondWidth, const qreal &thirdWidth
         prepareGeometryChange();
 
     _height = height;
+    _heightEstimated = false;
 
     setPos(0, linePos);
 }
 
 void ChatLine::setGeometryByWidth(const qreal &width, const qreal &secondWidth, const qreal &thirdWidth, const QPointF &thirdPos, qreal &linePos)
 {
+    invalidatePixmap();
     Q_UNUSED(width)
     Q_UNUSED(linePos)
     // linepos is the *bottom* position for the line
@@ -173,10 +288,29 @@ void ChatLine::setGeometryByWidth(const qreal &width, const qreal &secondWidth,
             _height = height;
             _width = width;
         }
+        _heightEstimated = false;
 
         setPos(0, linePos); // set pos is _very_ cheap if nothing changes.*/
 }
 
+void ChatLine::setGeometryByHeight(const qreal &width, const qreal &secondWidth, const qreal &thirdWidth, const QPointF &thirdPos, const qreal &height)
+{
+    // the items' setGeometry() would lay out their documents again, the bounding rects are enough,
+    // the documents pick up the new sizes when they are created
+    clearCache();
+    _contentsItem._boundingRect.setSize(QSizeF(secondWidth, height));
+    _senderItem.setHeight(height);
+    _timestampItem._boundingRect.setSize(QSizeF(thirdWidth, height));
+    _timestampItem.setPos(thirdPos);
+
+    if (height != _height || width != _width) {
+        prepareGeometryChange();
+        _height = height;
+        _width = width;
+    }
+    _heightEstimated = true;
+}
+
 void ChatLine::setSelected(bool selected, MessageModel::ColumnType minColumn, MessageModel::ColumnType maxColumn)
 {
     if (selected) {
@@ -208,6 +342,28 @@ void ChatLine::setSelected(bool selected, MessageModel::ColumnType minColumn, Me
     }
 }
 
+void ChatLine::setSeparatorAbove(bool separator)
+{
+    if (separator != _separatorAbove) {
+        _separatorAbove = separator;
+        update();
+    }
+}
+
+void ChatLine::setContinuation(bool continuation)
+{
+    if (continuation == _continuation)
+        return;
+
+    _continuation = continuation;
+    if (continuation) {
+        _timestampItem.clearCache();
+        _senderItem.clearCache();
+    }
+    invalidatePixmap();
+    update();
+}
+
 void ChatLine::setHighlighted(bool highlighted)
 {
     if (highlighted) _selection |= Highlighted;
@@ -217,11 +373,32 @@ void ChatLine::setHighlighted(bool highlighted)
 
 void ChatLine::clearCache()
 {
+    invalidatePixmap();
     _timestampItem.clearCache();
     _senderItem.clearCache();
     _contentsItem.clearCache();
 }
 
+void ChatLine::addMemoryUsage(ChatMemoryUsage &usage) const
+{
+    usage.lines++;
+    usage.lineBytes += sizeof(ChatLine);
+    _timestampItem.addMemoryUsage(usage);
+    _senderItem.addMemoryUsage(usage);
+    _contentsItem.addMemoryUsage(usage);
+}
+
+void ChatLine::prefetchDocuments()
+{
+    if (!_continuation) {
+        _timestampItem.prepareLayout();
+        _senderItem.prepareLayout();
+    }
+    // plain contents are built by ChatScene::prefetchLayouts() on a worker thread
+    if (!_contentsItem.needsPlainLayout())
+        _contentsItem.prepareLayout();
+}
+
 bool ChatLine::sceneEvent(QEvent *event)
 {
     if (event->type() == QEvent::GrabMouse) {
@@ -27,22 +27,28 @@
 class ChatLine : public QGraphicsItem
 {
 public:
-    ChatLine(int row, QAbstractItemModel *model,
+    ChatLine(int row, QAbstractItemModel *model, const MessageAccessor *accessor,
              const qreal &width,
              const qreal &firstWidth, const qreal &secondWidth, const qreal &thirdWidth,
              const QPointF &secondPos, const QPointF &thirdPos,
-             QGraphicsItem *parent = 0);
+             bool layout = true, QGraphicsItem *parent = 0);
     virtual ~ChatLine();
 
+    // lines are taken from an ObjectPool, with their items as members
+    static void *operator new(size_t size);
+    static void operator delete(void *p, size_t size);
+
     virtual inline QRectF boundingRect() const { return QRectF(0, 0, _width, _height); }
     inline QModelIndex index() const { return model()->index(row(), 0); }
-    inline MsgId msgId() const { return index().data(MessageModel::MsgIdRole).value<MsgId>(); }
-    inline Message::Type msgType() const { return (Message::Type)index().data(MessageModel::TypeRole).toInt(); }
+    inline MsgId msgId() const { return _accessor->msgId(row()); }
+    inline Message::Type msgType() const { return _msgType; }
+    inline bool isSelf() const { return _self; }
 
     inline int row() const { return _row; }
     inline void setRow(int row) { _row = row; }
 
     inline const QAbstractItemModel *model() const { return _model; }
+    inline const MessageAccessor *accessor() const { return _accessor; }
     inline ChatScene *chatScene() const { return qobject_cast<ChatScene *>(scene()); }
     inline ChatView *chatView() const { return chatScene() ? chatScene()->chatView() : 0; }
 
@@ -65,13 +71,35 @@ public:
     // the _bottom_ position is passed via linePos. linePos is updated to the top of the chatLine.
     void setSecondColumn(const qreal &secondWidth, const qreal &thirdWidth, const QPointF &thirdPos, qreal &linePos);
     void setGeometryByWidth(const qreal &width, const qreal &secondWidth, const qreal &thirdWidth, const QPointF &thirdPos, qreal &linePos);
+    // takes a contents height measured elsewhere, see ChatLineLayouter. Drops the documents, which are
+    // laid out for the old width, and doesn't move the line
+    void setGeometryByHeight(const qreal &width, const qreal &secondWidth, const qreal &thirdWidth, const QPointF &thirdPos, const qreal &height);
+    // whether the height came from setGeometryByHeight() and still needs a real layout
+    inline bool isHeightEstimated() const { return _heightEstimated; }
 
     void setSelected(bool selected, MessageModel::ColumnType minColumn = MessageModel::SenderColumn, MessageModel::ColumnType maxColumn = MessageModel::TimestampColumn);
     void setHighlighted(bool highlighted);
+    // whether the Self/other separator is drawn on top of the line, kept up to date by the scene
+    void setSeparatorAbove(bool separator);
+    // a line continuing the run of its sender leaves the sender and timestamp to the run's first line,
+    // they don't get a document or layout then, kept up to date by the scene
+    void setContinuation(bool continuation);
+    inline bool isContinuation() const { return _continuation; }
 
     void clearCache();
+    //! Creates the documents of the items now, so they're ready when the line scrolls into view
+    /** Plain contents are left to ChatScene::prefetchLayouts(), which builds them on a worker thread */
+    void prefetchDocuments();
+    //! Adds the line, its items and their caches to usage
+    void addMemoryUsage(ChatMemoryUsage &usage) const;
 
 protected:
+    static const QBrush &separatorBrush();
+    void paintLine(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget);
+    bool canCachePixmap() const;
+    // gives the line a new key in the QPixmapCache, the old pixmap there is no longer used
+    void invalidatePixmap();
+
     virtual bool sceneEvent(QEvent *event);
 
     // These need to be relayed to the appropriate ChatItem
@@ -90,11 +118,19 @@ protected:
 private:
     int _row;
     QAbstractItemModel *_model;
+    const MessageAccessor *_accessor;
+    Message::Type _msgType; // a row never changes its type, so it's only looked up once
     ContentsChatItem  _contentsItem;
     SenderChatItem    _senderItem;
     TimestampChatItem _timestampItem;
     qreal _width;
     qreal _height;
+    bool _heightEstimated;
+    bool _self;
+    bool _separatorAbove;
+    bool _continuation;
+    quint64 _pixmapCacheId;
+    static quint64 _lastPixmapCacheId;
 
     enum { Selected = 0x40,
            Highlighted = 0x80 };
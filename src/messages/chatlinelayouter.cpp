@@ -0,0 +1,57 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "chatlinelayouter.hpp"
+
+#include "plaintextlayout.hpp"
+
+ChatLineLayouter::ChatLineLayouter(const QSharedPointer<QAtomicInt> &currentGeneration, const QVector<int> &rows,
+                                   const QStringList &texts, const QFont &font, qreal width) :
+    _currentGeneration(currentGeneration),
+    _generation(currentGeneration->load()),
+    _rows(rows),
+    _texts(texts),
+    _font(font),
+    _width(width)
+{
+}
+
+void ChatLineLayouter::run()
+{
+    for (int first = 0; first < _rows.count(); first += CHUNK_SIZE) {
+        if (_currentGeneration->load() != _generation)
+            return;
+
+        ChatLineLayoutChunk chunk;
+        chunk.generation = _generation;
+        chunk.rows = _rows.mid(first, CHUNK_SIZE);
+        chunk.heights.reserve(chunk.rows.count());
+        for (int i = first; i < first + chunk.rows.count(); i++)
+            chunk.heights << textHeight(_texts.at(i), _font, _width);
+
+        emit chunkMeasured(chunk);
+    }
+}
+
+qreal ChatLineLayouter::textHeight(const QString &text, const QFont &font, qreal width)
+{
+    QTextOption option;
+    option.setWrapMode(QTextOption::WrapAtWordBoundaryOrAnywhere);
+
+    PlainTextLayout layout(text, font, option);
+    layout.setTextWidth(width);
+    return layout.height();
+}
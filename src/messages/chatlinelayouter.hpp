@@ -0,0 +1,71 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef CHATLINELAYOUTER_HPP
+#define CHATLINELAYOUTER_HPP
+
+#include <QAtomicInt>
+#include <QFont>
+#include <QObject>
+#include <QRunnable>
+#include <QSharedPointer>
+#include <QStringList>
+#include <QVector>
+
+//! Contents heights of some rows, measured for one relayout of a ChatScene
+struct ChatLineLayoutChunk
+{
+    int generation;
+    QVector<int> rows;
+    QVector<qreal> heights;
+};
+Q_DECLARE_METATYPE(ChatLineLayoutChunk)
+
+/**
+ * Measures the contents heights of chat lines for a new width on QThreadPool, using QTextLayout
+ * instead of the QTextDocuments of the lines, which may only be used on the GUI thread.
+ * Results are sent back in chunks, so the scene can apply them a bit at a time. The job stops
+ * as soon as the shared generation counter no longer matches its own, i.e. a newer relayout started.
+ * Heights are estimates where QTextDocument would differ, e.g. for pixmap smileys, lines correct
+ * them with a real layout once they come into view.
+ */
+class ChatLineLayouter : public QObject, public QRunnable
+{
+    Q_OBJECT
+public:
+    ChatLineLayouter(const QSharedPointer<QAtomicInt> &currentGeneration, const QVector<int> &rows,
+                     const QStringList &texts, const QFont &font, qreal width);
+
+    void run();
+
+    //! The height of a QTextDocument with the given plain text, font and text width
+    static qreal textHeight(const QString &text, const QFont &font, qreal width);
+
+    static const int CHUNK_SIZE = 500;
+
+signals:
+    void chunkMeasured(const ChatLineLayoutChunk &chunk);
+
+private:
+    QSharedPointer<QAtomicInt> _currentGeneration;
+    int _generation;
+    QVector<int> _rows;
+    QStringList _texts;
+    QFont _font;
+    qreal _width;
+};
+
+#endif // CHATLINELAYOUTER_HPP
@@ -0,0 +1,123 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "chatmemoryusage.hpp"
+#include "plaintextlayout.hpp"
+#include "smiley.hpp"
+#include <QCoreApplication>
+#include <QTextBlock>
+#include <QTextDocument>
+#include <QTextLayout>
+
+// rough costs of the private parts of QString and QTextDocument
+static const int STRING_HEADER_SIZE = 24;
+static const int DOCUMENT_BASE_SIZE = 2048;  // QTextDocumentPrivate, its layout and root frame
+static const int BLOCK_SIZE         = 256;   // fragment map entry, block data and QTextLayout
+static const int LINE_SIZE          = 64;    // QTextLine data of a laid out block
+
+ChatMemoryUsage::ChatMemoryUsage()
+    : rows(0),
+      modelBytes(0),
+      lines(0),
+      lineBytes(0),
+      cachedDocuments(0),
+      plainLayouts(0),
+      documentBytes(0),
+      smileys(0),
+      smileyBytes(0),
+      highlights(0),
+      highlightBytes(0)
+{
+}
+
+ChatMemoryUsage &ChatMemoryUsage::operator+=(const ChatMemoryUsage &other)
+{
+    rows            += other.rows;
+    modelBytes      += other.modelBytes;
+    lines           += other.lines;
+    lineBytes       += other.lineBytes;
+    cachedDocuments += other.cachedDocuments;
+    plainLayouts    += other.plainLayouts;
+    documentBytes   += other.documentBytes;
+    smileys         += other.smileys;
+    smileyBytes     += other.smileyBytes;
+    highlights      += other.highlights;
+    highlightBytes  += other.highlightBytes;
+    return *this;
+}
+
+QString ChatMemoryUsage::toString() const
+{
+    return QCoreApplication::translate("ChatMemoryUsage",
+                                       "Total: %1\n"
+                                       "Model: %2 rows, %3\n"
+                                       "Scene: %4 lines, %5\n"
+                                       "Documents: %6 cached, %7 plain layouts, %8\n"
+                                       "Smileys: %9, %10\n"
+                                       "Highlights: %11, %12")
+            .arg(formatBytes(totalBytes()))
+            .arg(rows).arg(formatBytes(modelBytes))
+            .arg(lines).arg(formatBytes(lineBytes))
+            .arg(cachedDocuments).arg(plainLayouts).arg(formatBytes(documentBytes))
+            .arg(smileys).arg(formatBytes(smileyBytes))
+            .arg(highlights).arg(formatBytes(highlightBytes));
+}
+
+void ChatMemoryUsage::addSmileys(const SmileyList &list)
+{
+    smileys += list.count();
+    for (const Smiley &smiley : list)
+        smileyBytes += sizeof(Smiley) + stringBytes(smiley.text()) + stringBytes(smiley.graphics());
+}
+
+qint64 ChatMemoryUsage::stringBytes(const QString &string)
+{
+    // shared empty strings don't cost anything
+    if (string.isNull())
+        return 0;
+    return STRING_HEADER_SIZE + string.capacity() * sizeof(QChar);
+}
+
+qint64 ChatMemoryUsage::documentBytes(const QTextDocument *doc)
+{
+    if (!doc)
+        return 0;
+
+    // the text is kept once in the piece table and once more in each block's layout
+    qint64 bytes = DOCUMENT_BASE_SIZE + 2 * qint64(doc->characterCount()) * sizeof(QChar);
+    for (QTextBlock block = doc->begin(); block.isValid(); block = block.next()) {
+        bytes += BLOCK_SIZE;
+        if (block.layout())
+            bytes += block.layout()->lineCount() * LINE_SIZE;
+    }
+    return bytes;
+}
+
+qint64 ChatMemoryUsage::plainLayoutBytes(const PlainTextLayout *layout)
+{
+    // the text, its copy in the layout and the glyphs of the layout's engine
+    return sizeof(PlainTextLayout) + 3 * stringBytes(layout->text()) + BLOCK_SIZE;
+}
+
+QString ChatMemoryUsage::formatBytes(qint64 bytes)
+{
+    if (bytes < 1024)
+        return QCoreApplication::translate("ChatMemoryUsage", "%1 B").arg(bytes);
+    if (bytes < 1024 * 1024)
+        return QCoreApplication::translate("ChatMemoryUsage", "%1 KiB").arg(bytes / 1024.0, 0, 'f', 1);
+    return QCoreApplication::translate("ChatMemoryUsage", "%1 MiB").arg(bytes / (1024.0 * 1024.0), 0, 'f', 1);
+}
@@ -0,0 +1,64 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef CHATMEMORYUSAGE_HPP
+#define CHATMEMORYUSAGE_HPP
+
+#include <QString>
+#include <QtGlobal>
+
+class QTextDocument;
+class SmileyList;
+class PlainTextLayout;
+
+//! Estimated heap usage of one chat, split by what holds it
+/** The numbers are estimates: containers are counted by their capacity and element size, strings by
+ *  their characters plus Qt's header, QTextDocuments by their characters, blocks and layouts. They are
+ *  meant to compare chats with each other and to see which part grows, not to match the allocator.
+ */
+struct ChatMemoryUsage
+{
+    int rows;
+    qint64 modelBytes;          //!< MessageStore columns, cached display strings and parsed spans
+    int lines;
+    qint64 lineBytes;           //!< ChatLine and ChatItem objects of the scene
+    int cachedDocuments;
+    int plainLayouts;
+    qint64 documentBytes;       //!< QTextDocuments and PlainTextLayouts of lines that were shown or prefetched
+    int smileys;
+    qint64 smileyBytes;         //!< Smiley entries of the parsed spans and of the items
+    int highlights;
+    qint64 highlightBytes;      //!< search highlights
+
+    ChatMemoryUsage();
+
+    inline qint64 totalBytes() const { return modelBytes + lineBytes + documentBytes + smileyBytes + highlightBytes; }
+    ChatMemoryUsage &operator+=(const ChatMemoryUsage &other);
+
+    //! One line per category, for the diagnostic dialog
+    QString toString() const;
+
+    void addSmileys(const SmileyList &list);
+
+    static qint64 stringBytes(const QString &string);
+    static qint64 documentBytes(const QTextDocument *doc);
+    static qint64 plainLayoutBytes(const PlainTextLayout *layout);
+    //! Human readable size, e.g. "1.4 MiB"
+    static QString formatBytes(qint64 bytes);
+};
+
+#endif // CHATMEMORYUSAGE_HPP
@@ -30,24 +30,56 @@
 #include <QGraphicsSceneContextMenuEvent>
 #include "chatview.hpp"
 #include "typingitem.hpp"
+#include "chatlayoutprefetcher.hpp"
+#include "chatlinelayouter.hpp"
+#include "lineheightcache.hpp"
+#include "plaintextlayout.hpp"
+#include "chatviewstats.hpp"
+#include "chatmemoryusage.hpp"
+#include "trace.hpp"
+#include "selectionmimedata.hpp"
+#include <QThreadPool>
+
+#include <algorithm>
 
 #include "Settings/settings.hpp"
 
 const qreal minContentsWidth = 100;
+// how far above and below the viewport lines stay materialized, in viewport heights
+const qreal materializeMargin = 1;
+// relayouts of fewer rows are done right away
+const int backgroundLayoutMinRows = 200;
 
 ChatScene::ChatScene(QAbstractItemModel *model, qreal width, ChatView *parent) :
     QGraphicsScene(0, 0, width, 0, (QObject *)parent),
     _chatView(parent),
     _model(model),
+    _fallbackAccessor(model),
+    _accessor(MessageAccessor::fromModel(model) ? MessageAccessor::fromModel(model) : &_fallbackAccessor),
+    _groupLines(Settings::getInstance().isGroupMessagesEnabled()),
     _sceneRect(0, 0, width, 0),
     _firstLineRow(-1),
     _viewportHeight(0),
+    _originY(0),
+    _layoutGeneration(new QAtomicInt(0)),
+    _backgroundLayoutPending(0),
+    _prefetchGeneration(new QAtomicInt(0)),
+    _heightCache(0),
+    _flushPending(false),
+    _layoutChangedPending(false),
+    _lastLineChangedPending(false),
+    _lastLineOffset(0),
+    _virtualized(true),
+    _suspended(false),
+    _visibleTop(0),
+    _visibleBottom(0),
     _markerLine(new MarkerLineItem(width)),
     _markerLineVisible(false),
     _markerLineValid(false),
     _selectingItem(0),
     _selectionStartRow(-1),
     _isSelecting(false),
+    _selectionUpdatePending(false),
     _clickMode(NoClick),
     _clickHandled(true),
     _leftButtonPressed(false),
@@ -69,17 +101,21 @@ ChatScene::ChatScene(QAbstractItemModel *model, qreal width, ChatView *parent) :
     addItem(_firstColHandle);
     _firstColHandle->setXPos(_firstColHandlePos);
     connect(_firstColHandle, SIGNAL(positionChanged(qreal)), this, SLOT(firstHandlePositionChanged(qreal)));
+    connect(_firstColHandle, SIGNAL(positionMoving(qreal)), this, SLOT(firstHandleMoving(qreal)));
     connect(this, SIGNAL(sceneRectChanged(const QRectF &)), _firstColHandle, SLOT(sceneRectChanged(const QRectF &)));
 
     _secondColHandle = new ColumnHandleItem(6);
     addItem(_secondColHandle);
     _secondColHandle->setXPos(_sceneRect.width() - _secondColHandlePosFromRight);
     connect(_secondColHandle, SIGNAL(positionChanged(qreal)), this, SLOT(secondHandlePositionChanged(qreal)));
+    connect(_secondColHandle, SIGNAL(positionMoving(qreal)), this, SLOT(secondHandleMoving(qreal)));
 
     connect(this, SIGNAL(sceneRectChanged(const QRectF &)), _secondColHandle, SLOT(sceneRectChanged(const QRectF &)));
 
     setHandleXLimits();
 
+    connect(&s, SIGNAL(groupMessagesChanged()), SLOT(onGroupMessagesChanged()));
+
     if (model->rowCount() > 0)
         rowsInserted(QModelIndex(), 0, model->rowCount() - 1);
 
@@ -91,6 +127,10 @@ ChatScene::ChatScene(QAbstractItemModel *model, qreal width, ChatView *parent) :
         this, SLOT(rowsRemoved()));
     connect(model, SIGNAL(dataChanged(QModelIndex, QModelIndex)), SLOT(dataChanged(QModelIndex, QModelIndex)));
 
+    qRegisterMetaType<ChatLineLayoutChunk>("ChatLineLayoutChunk");
+    qRegisterMetaType<ChatLayoutBatch>("ChatLayoutBatch");
+    qRegisterMetaType<QClipboard::Mode>("QClipboard::Mode");
+
     _clickTimer.setInterval(QApplication::doubleClickInterval());
     _clickTimer.setSingleShot(true);
     connect(&_clickTimer, SIGNAL(timeout()), SLOT(clickTimeout()));
@@ -100,19 +140,27 @@ ChatScene::ChatScene(QAbstractItemModel *model, qreal width, ChatView *parent) :
 
 ChatScene::~ChatScene()
 {
+    // stop a background layout or prefetch that is still running
+    _layoutGeneration->ref();
+    _prefetchGeneration->ref();
+
+    // materialized lines are deleted together with the scene
+    foreach(ChatLine *line, _lines) {
+        if (!_materializedLines.contains(line))
+            delete line;
+    }
 }
 
 int ChatScene::rowByScenePos(qreal y) const
 {
-    QList<QGraphicsItem *> itemList = items(QPointF(0, y));
-
-    // ChatLine should be at the bottom of the list
-    for (int i = itemList.count()-1; i >= 0; i--) {
-        ChatLine *line = qgraphicsitem_cast<ChatLine *>(itemList.at(i));
-        if (line)
-            return line->row();
-    }
-    return -1;
+    // answered by the height index, without asking the scene for its items
+    if (y < _originY || y >= _originY + _lineHeights.total())
+        return -1;
+
+    int row = rowAtOrBelow(y);
+    if (row >= _lines.count() || !_lines.at(row)->isVisible())
+        return -1;
+    return row;
 }
 
 MessageModel::ColumnType ChatScene::columnByScenePos(qreal x) const
@@ -127,12 +175,22 @@ MessageModel::ColumnType ChatScene::columnByScenePos(qreal x) const
 
 ChatItem *ChatScene::chatItemAt(const QPointF &scenePos) const
 {
-    foreach(QGraphicsItem *item, items(scenePos, Qt::IntersectsItemBoundingRect, Qt::AscendingOrder)) {
-        ChatLine *line = qgraphicsitem_cast<ChatLine *>(item);
-        if (line)
-            return line->itemAt(line->mapFromScene(scenePos));
-    }
-    return 0;
+    int row = rowByScenePos(scenePos.y());
+    if (row < 0)
+        return 0;
+
+    ChatLine *line = _lines.at(row);
+    if (!line->boundingRect().contains(scenePos.x(), scenePos.y() - lineTop(row)))
+        return 0;
+    // lines outside the scene don't have a valid pos(), map through the index instead
+    return line->itemAt(QPointF(scenePos.x(), scenePos.y() - lineTop(row)));
+}
+
+void ChatScene::addMemoryUsage(ChatMemoryUsage &usage) const
+{
+    usage.lineBytes += _lines.count() * sizeof(ChatLine *);
+    foreach (ChatLine *line, _lines)
+        line->addMemoryUsage(usage);
 }
 
 //! Find the ChatLine belonging to a MsgId
@@ -150,56 +208,28 @@ ChatLine *ChatScene::chatLine(MsgId msgId, bool matchExact, bool ignoreDayChange
     if (!_lines.count())
             return 0;
 
-        QList<ChatLine *>::ConstIterator start = _lines.begin();
-        QList<ChatLine *>::ConstIterator end = _lines.end();
-        QList<ChatLine *>::ConstIterator middle;
-
-        int n = int(end - start);
-        int half;
-
-        while (n > 0) {
-            half = n >> 1;
-            middle = start + half;
-            if ((*middle)->msgId() < msgId) {
-                start = middle + 1;
-                n -= half + 1;
-            }
-            else {
-                n = half;
-            }
-        }
+        const qint64 *first = _lineMsgIds.constData();
+        const qint64 *last = first + _lineMsgIds.count();
+        int row = int(std::lower_bound(first, last, msgId.toLong()) - first);
 
-        if (start != end && (*start)->msgId() == msgId && (ignoreDayChange ? (*start)->msgType() != Message::DayChange : true))
-            return *start;
+        if (row < _lines.count() && first[row] == msgId.toLong() && (ignoreDayChange ? _lines.at(row)->msgType() != Message::DayChange : true))
+            return _lines.at(row);
 
         if (matchExact)
             return 0;
 
-        if (start == _lines.begin()) // not (yet?) in our scene
+        if (row == 0) // not (yet?) in our scene
             return 0;
 
-        // if we didn't find the exact msgId, take the next-lower one (this makes sense for lastSeen)
-
-        if (start == end) { // higher than last element
-            if (!ignoreDayChange)
-                return _lines.last();
-
-            for (int i = _lines.count() -1; i >= 0; i--) {
-                if (_lines.at(i)->msgType() != Message::DayChange)
-                    return _lines.at(i);
-            }
-            return 0;
-        }
-
-        // return the next-lower line
+        // if we didn't find the exact msgId, take the next-lower one (this makes sense for lastSeen),
+        // which is the last line if it's higher than all of them
         if (!ignoreDayChange)
-            return *(--start);
+            return _lines.at(row - 1);
 
-        do {
-            if ((*(--start))->msgType() != Message::DayChange)
-                return *start;
+        while (--row >= 0) {
+            if (_lines.at(row)->msgType() != Message::DayChange)
+                return _lines.at(row);
         }
-        while (start != _lines.begin());
         return 0;
 }
 
@@ -207,30 +237,56 @@ ChatLine *ChatScene::chatLine(MsgId msgId, bool matchExact, bool ignoreDayChange
 QString ChatScene::selection() const
 {
     if (hasGlobalSelection()) {
-        int start = qMin(_selectionStartRow, _selectionEndRow);
-        int end = qMax(_selectionStartRow, _selectionEndRow);
-        if (start < 0 || end >= _lines.count()) {
-            qDebug() << "Invalid selection range:" << start << end;
-            return QString();
-        }
-        QString result;
-        for (int l = start; l <= end; l++) {
-            if (_selectionMaxCol == MessageModel::TimestampColumn)
-                result += QString("[%1] ").arg(_lines[l]->item(MessageModel::TimestampColumn)->data(MessageModel::DisplayRole).toString());
+        QScopedPointer<SelectionMimeData> mimeData(createSelectionMimeData());
+        return mimeData ? mimeData->plainText() : QString();
+    }
+    else if (selectingItem())
+        return selectingItem()->selection();
+    return QString();
+}
+
+SelectionMimeData *ChatScene::createSelectionMimeData() const
+{
+    int start = qMin(_selectionStartRow, _selectionEndRow);
+    int end = qMax(_selectionStartRow, _selectionEndRow);
+    if (start < 0 || end >= _lines.count()) {
+        qDebug() << "Invalid selection range:" << start << end;
+        return 0;
+    }
 
-            if (_selectionMinCol <= MessageModel::SenderColumn)
-                result += QString("%1: ").arg(_lines[l]->item(MessageModel::SenderColumn)->data(MessageModel::DisplayRole).toString());
+    int columns = 0;
+    if (_selectionMaxCol == MessageModel::TimestampColumn)
+        columns |= SelectionMimeData::Timestamps;
+    if (_selectionMinCol <= MessageModel::SenderColumn)
+        columns |= SelectionMimeData::Senders;
+    if (_selectionMinCol <= MessageModel::ContentsColumn && _selectionMaxCol >= MessageModel::ContentsColumn)
+        columns |= SelectionMimeData::Contents;
 
-            if (_selectionMinCol <= MessageModel::ContentsColumn && _selectionMaxCol >= MessageModel::ContentsColumn)
-                result += _lines[l]->item(MessageModel::ContentsColumn)->data(MessageModel::DisplayRole).toString();
+    return new SelectionMimeData(_model, start, end, columns);
+}
 
-            result += "\n";
+//! Sets the selection state of the lines from start to end that are in the scene
+/** Lines outside the scene aren't touched, they take their state from the selection range when
+ *  they are materialized. So moving a selection boundary only repaints the lines it passes in view. */
+void ChatScene::setRowsSelected(int start, int end, bool selected)
+{
+    start = qMax(start, 0);
+    end = qMin(end, _lines.count() - 1);
+    MessageModel::ColumnType minColumn = (MessageModel::ColumnType)_selectionMinCol;
+    MessageModel::ColumnType maxColumn = (MessageModel::ColumnType)_selectionMaxCol;
+
+    if (end - start + 1 > _materializedLines.count()) {
+        foreach(ChatLine *line, _materializedLines) {
+            if (line->row() >= start && line->row() <= end)
+                line->setSelected(selected, minColumn, maxColumn);
+        }
+    }
+    else {
+        for (int row = start; row <= end; row++) {
+            if (_materializedLines.contains(_lines.at(row)))
+                _lines.at(row)->setSelected(selected, minColumn, maxColumn);
         }
-        return result;
     }
-    else if (selectingItem())
-        return selectingItem()->selection();
-    return QString();
 }
 
 bool ChatScene::hasSelection() const
@@ -256,9 +312,13 @@ bool ChatScene::isPosOverSelection(const QPointF &pos) const
 
 void ChatScene::initiateDrag(QWidget *source)
 {
+    QMimeData *mimeData = hasGlobalSelection() ? createSelectionMimeData() : 0;
+    if (!mimeData) {
+        mimeData = new QMimeData;
+        mimeData->setText(selection());
+    }
+
     QDrag *drag = new QDrag(source);
-    QMimeData *mimeData = new QMimeData;
-    mimeData->setText(selection());
     drag->setMimeData(mimeData);
 
     drag->exec(Qt::CopyAction);
@@ -272,10 +332,347 @@ bool ChatScene::isScrollingAllowed() const
     return true;
 }
 
+void ChatScene::setVirtualized(bool virtualized)
+{
+    if (_virtualized == virtualized)
+        return;
+
+    _virtualized = virtualized;
+    updateMaterializedLines();
+}
+
+void ChatScene::setSuspended(bool suspended)
+{
+    if (_suspended == suspended)
+        return;
+
+    _suspended = suspended;
+    if (_suspended) {
+        // nobody waits for the measurements of a hidden page
+        _layoutGeneration->ref();
+        _backgroundLayoutPending = 0;
+        updateMaterializedLines();
+    }
+    else {
+        // the lines in view get their layout on materializing, the rows added or resized meanwhile are measured
+        // in the background, those with cached heights first get them, so the right lines are in view
+        startBackgroundLayout(0, _lines.count() - 1, _sceneRect.width());
+        updateMaterializedLines();
+        setMarkerLine();
+        scheduleLayoutChanged();
+    }
+}
+
+void ChatScene::setHeightCache(LineHeightCache *cache)
+{
+    _heightCache = cache;
+}
+
+void ChatScene::setVisibleRange(qreal top, qreal bottom)
+{
+    _visibleTop = top;
+    _visibleBottom = bottom;
+    updateMaterializedLines();
+}
+
+int ChatScene::rowAtOrBelow(qreal y) const
+{
+    return _lineHeights.rowAt(y - _originY);
+}
+
+//! Decides once whether a line shows the separator between own and other messages, so paint doesn't ask the model
+void ChatScene::updateSeparator(int row)
+{
+    if (row < 0 || row >= _lines.count())
+        return;
+    ChatLine *line = _lines.at(row);
+    line->setSeparatorAbove(row > 0 && _lines.at(row - 1)->isSelf() != line->isSelf());
+    line->setContinuation(continuesRun(row));
+}
+
+bool ChatScene::continuesRun(int row) const
+{
+    if (!_groupLines || row <= 0)
+        return false;
+
+    const ChatLine *line = _lines.at(row);
+    const ChatLine *previous = _lines.at(row - 1);
+    if (line->msgType() != Message::Plain || previous->msgType() != Message::Plain || line->isSelf() != previous->isSelf())
+        return false;
+
+    // the time of a message makes up the high bits of its msgId
+    qint64 interval = (_lineMsgIds.at(row) >> MessageModel::MSGID_SEQUENCE_BITS) - (_lineMsgIds.at(row - 1) >> MessageModel::MSGID_SEQUENCE_BITS);
+    if (interval > RUN_INTERVAL)
+        return false;
+
+    // group chats have several senders that aren't us
+    return accessor()->displayText(row, MessageModel::SenderColumn) == accessor()->displayText(row - 1, MessageModel::SenderColumn);
+}
+
+void ChatScene::onGroupMessagesChanged()
+{
+    _groupLines = Settings::getInstance().isGroupMessagesEnabled();
+    for (int row = 1; row < _lines.count(); row++)
+        _lines.at(row)->setContinuation(continuesRun(row));
+}
+
+void ChatScene::updateLineHeights(int start, int end)
+{
+    qreal delta = 0;
+    for (int row = start; row <= end; row++) {
+        qreal height = _lines.at(row)->height();
+        delta += height - _lineHeights.height(row);
+        _lineHeights.setHeight(row, height);
+    }
+    // the bottom of the last line keeps its position, the rows above make room
+    _originY -= delta;
+}
+
+void ChatScene::updateMaterializedLines()
+{
+    int first = 0;
+    int last = _lines.count() - 1;
+    if (_suspended)
+        last = -1;
+    else if (_virtualized) {
+        qreal margin = materializeMargin * qMax(_viewportHeight, _visibleBottom - _visibleTop);
+        first = rowAtOrBelow(_visibleTop - margin);
+        last = qMin(rowAtOrBelow(_visibleBottom + margin), last);
+    }
+
+    QSet<ChatLine *>::iterator iter = _materializedLines.begin();
+    while (iter != _materializedLines.end()) {
+        ChatLine *line = *iter;
+        // the line the user is selecting in holds the mouse grab, keep it
+        bool selecting = _selectingItem && _selectingItem->chatLine() == line;
+        if ((line->row() < first || line->row() > last) && !selecting) {
+            iter = _materializedLines.erase(iter);
+            dematerialize(line);
+        }
+        else
+            ++iter;
+    }
+
+    for (int row = first; row <= last; row++)
+        materialize(_lines.at(row));
+
+    // only lines in the scene are moved to the positions the index gives them,
+    // the others get theirs once they come back
+    foreach(ChatLine *line, _materializedLines)
+        line->setPos(0, lineTop(line->row()));
+}
+
+void ChatScene::materialize(ChatLine *line)
+{
+    if (line->scene())
+        return;
+
+    // the line may have been out of the scene while the selection moved over it
+    int row = line->row();
+    if (hasGlobalSelection() && row >= qMin(_selectionStartRow, _selectionEndRow) && row <= qMax(_selectionStartRow, _selectionEndRow))
+        line->setSelected(true, (MessageModel::ColumnType)_selectionMinCol, (MessageModel::ColumnType)_selectionMaxCol);
+    else
+        line->setSelected(false);
+
+    // a line still waiting for the background layout, or laid out from an estimate, gets a real layout now
+    qreal width = _sceneRect.width();
+    if (line->isHeightEstimated() || line->width() != width) {
+        qreal linePos = 0;
+        line->setGeometryByWidth(width,
+                                 secondColumnHandle()->sceneLeft() - firstColumnHandle()->sceneRight(),
+                                 width - secondColumnHandle()->sceneRight(),
+                                 QPointF(secondColumnHandle()->sceneRight(), 0),
+                                 linePos);
+        updateLineHeights(line->row(), line->row());
+        if (_heightCache)
+            cacheHeight(line, line->contentsItem()->shownText());
+    }
+
+    addItem(line);
+    _materializedLines.insert(line);
+}
+
+void ChatScene::dematerialize(ChatLine *line)
+{
+    // the selection and the marker line only need the geometry, which stays with the line
+    chatView()->setHasCache(line, false);
+    line->clearCache();
+    removeItem(line);
+}
+
+void ChatScene::startBackgroundLayout(int start, int end, qreal width)
+{
+    // a running layout is for an older width or for rows that have moved since
+    _layoutGeneration->ref();
+    _backgroundLayoutPending = 0;
+    if (_suspended)
+        return;
+
+    QVector<int> rows;
+    for (int row = start; row <= end; row++) {
+        ChatLine *line = _lines.at(row);
+        if (line->width() != width && !_materializedLines.contains(line))
+            rows << row;
+    }
+    if (rows.isEmpty())
+        return;
+
+    // rows closest to the viewport first, those are the next ones to scroll into view
+    int centerRow = rowAtOrBelow((_visibleTop + _visibleBottom) / 2);
+    std::sort(rows.begin(), rows.end(), [centerRow](int a, int b) {
+        return qAbs(a - centerRow) < qAbs(b - centerRow);
+    });
+
+    QStringList texts;
+    texts.reserve(rows.count());
+    foreach(int row, rows)
+        texts << _lines.at(row)->contentsItem()->shownText();
+
+    if (_heightCache) {
+        applyCachedHeights(rows, texts, width);
+        if (rows.isEmpty())
+            return;
+    }
+
+    qreal contentsWidth = secondColumnHandle()->sceneLeft() - firstColumnHandle()->sceneRight();
+    ChatLineLayouter *layouter = new ChatLineLayouter(_layoutGeneration, rows, texts, QApplication::font(), contentsWidth);
+    connect(layouter, SIGNAL(chunkMeasured(ChatLineLayoutChunk)), this, SLOT(applyLayoutChunk(ChatLineLayoutChunk)));
+    _backgroundLayoutPending = rows.count();
+    QThreadPool::globalInstance()->start(layouter);
+}
+
+void ChatScene::applyLayoutChunk(const ChatLineLayoutChunk &chunk)
+{
+    if (chunk.generation != _layoutGeneration->load())
+        return;
+
+    qreal width = _sceneRect.width();
+    qreal secondWidth = secondColumnHandle()->sceneLeft() - firstColumnHandle()->sceneRight();
+    qreal thirdWidth = width - secondColumnHandle()->sceneRight();
+    QPointF thirdColumnPos(secondColumnHandle()->sceneRight(), 0);
+
+    qreal delta = 0;
+    for (int i = 0; i < chunk.rows.count(); i++) {
+        int row = chunk.rows.at(i);
+        ChatLine *line = _lines.at(row);
+        // lines that came into view meanwhile already got a real layout
+        if (_materializedLines.contains(line))
+            continue;
+
+        line->setGeometryByHeight(width, secondWidth, thirdWidth, thirdColumnPos, chunk.heights.at(i) + line->contentsItem()->previewHeight());
+        delta += line->height() - _lineHeights.height(row);
+        _lineHeights.setHeight(row, line->height());
+        if (_heightCache)
+            cacheHeight(line, line->contentsItem()->shownText());
+    }
+    // like in layout(), the bottom stays in place
+    _originY -= delta;
+    _backgroundLayoutPending -= chunk.rows.count();
+
+    updateSceneRect();
+    updateMaterializedLines();
+    setMarkerLine();
+    scheduleLayoutChanged();
+}
+
+void ChatScene::applyCachedHeights(QVector<int> &rows, QStringList &texts, qreal width)
+{
+    qreal secondWidth = secondColumnHandle()->sceneLeft() - firstColumnHandle()->sceneRight();
+    qreal thirdWidth = width - secondColumnHandle()->sceneRight();
+    QPointF thirdColumnPos(secondColumnHandle()->sceneRight(), 0);
+    _heightCache->setLayout(QApplication::font(), secondWidth);
+
+    QVector<int> missingRows;
+    QStringList missingTexts;
+    qreal delta = 0;
+    for (int i = 0; i < rows.count(); i++) {
+        qreal height;
+        if (!_heightCache->height(_heightCache->hash(texts.at(i)), height)) {
+            missingRows << rows.at(i);
+            missingTexts << texts.at(i);
+            continue;
+        }
+
+        // like a measurement of the background layout, the line is laid out for real once it comes into view
+        ChatLine *line = _lines.at(rows.at(i));
+        line->setGeometryByHeight(width, secondWidth, thirdWidth, thirdColumnPos, height + line->contentsItem()->previewHeight());
+        delta += line->height() - _lineHeights.height(rows.at(i));
+        _lineHeights.setHeight(rows.at(i), line->height());
+    }
+    if (missingRows.count() == rows.count())
+        return;
+
+    // like in layout(), the bottom stays in place
+    _originY -= delta;
+    rows = missingRows;
+    texts = missingTexts;
+    updateSceneRect();
+}
+
+void ChatScene::cacheHeight(ChatLine *line, const QString &text)
+{
+    _heightCache->setLayout(QApplication::font(), secondColumnHandle()->sceneLeft() - firstColumnHandle()->sceneRight());
+    _heightCache->setHeight(_heightCache->hash(text), line->height() - line->contentsItem()->previewHeight());
+}
+
+void ChatScene::prefetchLayouts(int first, int last)
+{
+    _prefetchGeneration->ref();
+    if (_suspended)
+        return;
+
+    QVector<int> rows;
+    QVector<qint64> msgIds;
+    QStringList texts;
+    QVector<qreal> widths;
+    int step = first <= last ? 1 : -1;
+    for (int row = first; row != last + step; row += step) {
+        if (row < 0 || row >= _lines.count())
+            continue;
+        // only lines in the scene keep their layouts in the view's cache budget
+        ChatLine *line = _lines.at(row);
+        ContentsChatItem *item = line->contentsItem();
+        if (!_materializedLines.contains(line) || !item->needsPlainLayout())
+            continue;
+
+        rows << row;
+        msgIds << _lineMsgIds.at(row);
+        texts << item->layoutText();
+        widths << item->width();
+    }
+    if (rows.isEmpty())
+        return;
+
+    // contents items all use the default option, see ChatItem::textOption()
+    QTextOption option = _lines.at(rows.first())->contentsItem()->layoutOption();
+    ChatLayoutPrefetcher *prefetcher = new ChatLayoutPrefetcher(_prefetchGeneration, rows, msgIds, texts, widths,
+                                                                QApplication::font(), option);
+    connect(prefetcher, SIGNAL(batchReady(ChatLayoutBatch)), this, SLOT(applyLayoutBatch(ChatLayoutBatch)));
+    QThreadPool::globalInstance()->start(prefetcher);
+}
+
+void ChatScene::applyLayoutBatch(const ChatLayoutBatch &batch)
+{
+    if (batch.generation != _prefetchGeneration->load())
+        return;
+
+    for (int i = 0; i < batch.rows.count(); i++) {
+        int row = batch.rows.at(i);
+        if (row >= _lines.count() || _lineMsgIds.at(row) != batch.msgIds.at(i))
+            continue;
+        ChatLine *line = _lines.at(row);
+        if (_materializedLines.contains(line))
+            line->contentsItem()->adoptPlainLayout(batch.layouts.at(i));
+    }
+}
+
 void ChatScene::updateForViewport(qreal width, qreal height)
 {
     _viewportHeight = height;
     setWidth(width);
+
+    // the view reads the new scene rect right after this
+    flushChanges();
 }
 
 // Move second column handle while changing scene width
@@ -287,8 +684,28 @@ void ChatScene::setWidth(qreal width)
     layout(0, _lines.count()-1, width);
 }
 
+void ChatScene::relayout()
+{
+    // layouts prefetched so far are of the old texts
+    _prefetchGeneration->ref();
+
+    // the background layout only measures lines laid out for another width
+    qreal secondWidth = secondColumnHandle()->sceneLeft() - firstColumnHandle()->sceneRight();
+    qreal thirdWidth = _sceneRect.width() - secondColumnHandle()->sceneRight();
+    QPointF thirdColumnPos(secondColumnHandle()->sceneRight(), 0);
+    foreach(ChatLine *line, _lines) {
+        if (!_materializedLines.contains(line))
+            line->setGeometryByHeight(0, secondWidth, thirdWidth, thirdColumnPos, line->height());
+    }
+
+    layout(0, _lines.count()-1, _sceneRect.width());
+}
+
 void ChatScene::layout(int start, int end, qreal width)
 {
+    ChatViewStats::Timer statsTimer(ChatViewStats::Layout);
+    Trace::Span span("ChatScene::layout");
+
     // Update second handle position
     qreal newSecondHandlePos = width - _secondColHandlePosFromRight;
     if(newSecondHandlePos < width) {
@@ -298,32 +715,45 @@ void ChatScene::layout(int start, int end, qreal width)
     }
 
     if (end >= 0) {
-        int row = end;
-        qreal linePos = _lines.at(row)->scenePos().y() + _lines.at(row)->height();
         qreal thirdWidth = width - secondColumnHandle()->sceneRight();
         qreal secondWidth = secondColumnHandle()->sceneLeft() - firstColumnHandle()->sceneRight();
         QPointF thirdColumnPos(secondColumnHandle()->sceneRight(), 0);
-        while (row >= start) {
-            _lines.at(row--)->setGeometryByWidth(width, secondWidth, thirdWidth, thirdColumnPos, linePos);
-        }
 
-        if (row >= 0) {
-            // remaining items don't need geometry changes, but maybe repositioning?
-            ChatLine *line = _lines.at(row);
-            qreal offset = linePos - (line->scenePos().y() + line->height());
-            if (offset != 0) {
-                while (row >= 0) {
-                    line = _lines.at(row--);
-                    line->setPos(0, line->scenePos().y() + offset);
+        if (!_suspended && (!_virtualized || end - start + 1 < backgroundLayoutMinRows)) {
+            int row = end;
+            qreal linePos = lineTop(row) + _lines.at(row)->height();
+            while (row >= start) {
+                _lines.at(row--)->setGeometryByWidth(width, secondWidth, thirdWidth, thirdColumnPos, linePos);
+            }
+
+            // remaining items don't need geometry changes, their new positions follow from the index
+            updateLineHeights(start, end);
+
+            // lines outside the scene don't hand their documents to the view for cleanup
+            for (row = start; row <= end; row++) {
+                if (!_materializedLines.contains(_lines.at(row)))
+                    _lines.at(row)->clearCache();
+            }
+        }
+        else {
+            // the lines in view are laid out right away, the others are measured in the background,
+            // a suspended scene has no lines in view and measures nothing until it resumes
+            foreach(ChatLine *line, _materializedLines) {
+                if (line->row() >= start && line->row() <= end) {
+                    qreal linePos = 0;
+                    line->setGeometryByWidth(width, secondWidth, thirdWidth, thirdColumnPos, linePos);
+                    updateLineHeights(line->row(), line->row());
                 }
             }
+            startBackgroundLayout(start, end, width);
         }
     }
 
     updateSceneRect(width);
+    updateMaterializedLines();
     setHandleXLimits();
     setMarkerLine();
-    emit layoutChanged();
+    scheduleLayoutChanged();
 }
 
 void ChatScene::setMarkerLineValid(bool valid)
@@ -340,14 +770,14 @@ void ChatScene::setMarkerLineVisible(bool visible)
         markerLine()->setVisible(false);
 }
 
-void ChatScene::setMarkerLine(ChatLine *line)
+void ChatScene::setMarkerLine(int row)
 {
-    if(!line)
-        line = markerLine()->chatLine();
+    if (row < 0)
+        row = markerLine()->row();
 
-    if (line) {
-        markerLine()->setChatLine(line);
-        markerLine()->setPos(line->pos());
+    if (row >= 0) {
+        markerLine()->setRow(row);
+        markerLine()->setPos(0, lineTop(row));
     }
 }
 
@@ -369,8 +799,7 @@ void ChatScene::startGlobalSelection(ChatItem *item, const QPointF &itemPos)
 void ChatScene::clearGlobalSelection()
 {
     if (hasGlobalSelection()) {
-        for (int l = qMin(_selectionStartRow, _selectionEndRow); l <= qMax(_selectionStartRow, _selectionEndRow); l++)
-            _lines[l]->setSelected(false);
+        setRowsSelected(qMin(_selectionStartRow, _selectionEndRow), qMax(_selectionStartRow, _selectionEndRow), false);
         _isSelecting = false;
         _selectionStartRow = -1;
     }
@@ -388,6 +817,17 @@ void ChatScene::selectionToClipboard(QClipboard::Mode mode)
     if (!hasSelection())
             return;
 
+    // the rows are only formatted when someone pastes them
+    if (hasGlobalSelection()) {
+        if (mode == QClipboard::Selection && !QApplication::clipboard()->supportsSelection())
+            return;
+
+        SelectionMimeData *mimeData = createSelectionMimeData();
+        if (mimeData)
+            QApplication::clipboard()->setMimeData(mimeData, mode);
+        return;
+    }
+
     stringToClipboard(selection(), mode);
 }
 
@@ -448,7 +888,7 @@ void ChatScene::mouseMoveEvent(QGraphicsSceneMouseEvent *event)
             _clickMode = NoClick;
         }
         if (_isSelecting) {
-            updateSelection(event->scenePos());
+            selectTo(event->scenePos());
             emit mouseMoveWhileSelecting(event->scenePos());
             event->accept();
         }
@@ -509,6 +949,7 @@ void ChatScene::mouseReleaseEvent(QGraphicsSceneMouseEvent *event)
         else {
             // no click -> drag or selection move
             if (isGloballySelecting()) {
+                flushSelection();
                 selectionToClipboard(QClipboard::Selection);
                 _isSelecting = false;
                 event->accept();
@@ -541,10 +982,23 @@ void ChatScene::handleClick(Qt::MouseButton button, const QPointF &scenePos)
 
 void ChatScene::setTypingNotificationVisible(const QString &name, bool visible)
 {
+    // repeating the current state mustn't relayout the scene
+    if (visible == mTypingShown && (!visible || name == mTypingName))
+        return;
+
+    const bool wasShown = mTypingShown;
+    mTypingShown = visible;
+    mTypingName = name;
+
     if (visible) {
         mTypingItem->setVisible(name);
+        // only the name changed, the item keeps its height
+        if (wasShown) {
+            mTypingItem->update();
+            return;
+        }
         updateSceneRect();
-        emit lastLineChanged(nullptr, height());
+        scheduleLastLineChanged(_sceneRect.height());
     }
     else {
         mTypingItem->hide();
@@ -555,19 +1009,14 @@ void ChatScene::setTypingNotificationVisible(const QString &name, bool visible)
 void ChatScene::rowsInserted(const QModelIndex &index, int start, int end)
 {
     Q_UNUSED(index)
+    ChatViewStats::Timer statsTimer(ChatViewStats::RowsInserted);
+    Trace::Span span("ChatScene::rowsInserted");
 
     qreal h = 0;
-    qreal y = 0;
     qreal width = _sceneRect.width();
     bool atBottom = (start == _lines.count());
     bool atTop = !atBottom && (start == 0);
-
-    if (start < _lines.count()) {
-        y = _lines.value(start)->y();
-    }
-    else if (atBottom && !_lines.isEmpty()) {
-        y = _lines.last()->y() + _lines.last()->height();
-    }
+    QVector<qreal> heights(end - start + 1);
 
     qreal contentsWidth = width - secondColumnHandle()->sceneRight();
     qreal senderWidth = secondColumnHandle()->sceneLeft() - firstColumnHandle()->sceneRight();
@@ -575,42 +1024,46 @@ void ChatScene::rowsInserted(const QModelIndex &index, int start, int end)
     QPointF contentsPos(secondColumnHandle()->sceneRight(), 0);
     QPointF senderPos(firstColumnHandle()->sceneRight(), 0);
 
-    ChatLine *firstBottomLine = nullptr;
+    // the lines of a suspended scene are created without layout, see ChatLine's constructor
 
     if (atTop) {
         for (int i = end; i >= start; i--) {
-            ChatLine *line = new ChatLine(i, model(),
+            ChatLine *line = new ChatLine(i, model(), accessor(),
                                           width,
                                           timestampWidth, senderWidth, contentsWidth,
-                                          senderPos, contentsPos);
+                                          senderPos, contentsPos,
+                                          !_suspended);
             h += line->height();
-            line->setPos(0, y-h);
+            heights[i - start] = line->height();
             _lines.insert(start, line);
-            addItem(line);
         }
     }
     else {
         for (int i = start; i <= end; i++) {
-            ChatLine *line = new ChatLine(i, model(),
+            ChatLine *line = new ChatLine(i, model(), accessor(),
                                           width,
                                           timestampWidth, senderWidth, contentsWidth,
-                                          senderPos, contentsPos);
-            line->setPos(0, y+h);
+                                          senderPos, contentsPos,
+                                          !_suspended);
             h += line->height();
+            heights[i - start] = line->height();
             _lines.insert(i, line);
-            addItem(line);
-
-            // Get the first added lines
-            if(i==start && atBottom)
-                firstBottomLine = line;
         }
     }
 
+    _lineMsgIds.insert(start, end - start + 1, 0);
+    for (int i = start; i <= end; i++) {
+        _lineMsgIds[i] = accessor()->msgId(i).toLong();
+    }
+
     // update existing items
     for (int i = end+1; i < _lines.count(); i++) {
         _lines[i]->setRow(i);
     }
 
+    for (int i = start; i <= end + 1; i++)
+        updateSeparator(i);
+
     // update selection
     if (_selectionStartRow >= 0) {
         int offset = end - start + 1;
@@ -627,49 +1080,62 @@ void ChatScene::rowsInserted(const QModelIndex &index, int start, int end)
             _firstSelectionRow += offset;
     }
 
-    // neither pre- or append means we have to do dirty work: move items...
-    if (!(atTop || atBottom)) {
-        ChatLine *line = 0;
-        for (int i = 0; i <= end; i++) {
-            line = _lines.at(i);
-            line->setPos(0, line->pos().y() - h);
-            if (line == markerLine()->chatLine())
-                markerLine()->setPos(line->pos() + QPointF(0, line->height()));
+    // the lines below stay where they are, everything above moves up to make room,
+    // which only shifts the origin of the height index
+    _lineHeights.insert(start, heights);
+    if (!atBottom)
+        _originY -= h;
+
+    // the marker line only knows its row, no line has to be compared against it
+    if (markerLine()->row() >= start)
+        markerLine()->setRow(markerLine()->row() + end - start + 1);
+
+    // rows inserted behind the first proper line don't change it, otherwise only
+    // the inserted lines need to be looked at
+    if (_firstLineRow >= 0 && start <= _firstLineRow) {
+        int firstLineRow = start;
+        while (firstLineRow <= end && _lines.at(firstLineRow)->msgType() == Message::DayChange) {
+            _lines.at(firstLineRow)->hide();
+            firstLineRow++;
         }
-    }
-
-    // Move typing notification
-    if (mTypingItem->isVisible()) {
-        mTypingItem->setPos(0, _lines.last()->y() + h);
-    }
-
-    // check if all went right
-    Q_ASSERT(start == 0 || _lines.at(start - 1)->pos().y() + _lines.at(start - 1)->height() == _lines.at(start)->pos().y());
-    Q_ASSERT(end + 1 == _lines.count() || _lines.at(end)->pos().y() + _lines.at(end)->height() == _lines.at(end + 1)->pos().y());
-
-    if (!atBottom) {
-        if (start < _firstLineRow) {
+        if (firstLineRow <= end) {
+            // the previously leading day changes are followed by a proper line now
             int prevFirstLineRow = _firstLineRow + (end - start + 1);
             for (int i = end + 1; i < prevFirstLineRow; i++) {
                 _lines.at(i)->show();
             }
+            _firstLineRow = firstLineRow;
+        }
+        else {
+            _firstLineRow += end - start + 1;
         }
-        // force new search for first proper line
-        _firstLineRow = -1;
     }
     updateSceneRect();
+    updateMaterializedLines();
+
+    // lines outside the scene don't hand their documents to the view for cleanup
+    for (int i = start; i <= end; i++) {
+        if (!_materializedLines.contains(_lines.at(i)))
+            _lines.at(i)->clearCache();
+    }
+
+    // the rows of a running background layout have moved
+    if (_backgroundLayoutPending > 0)
+        startBackgroundLayout(0, _lines.count() - 1, _sceneRect.width());
+
     if (atBottom) {
-        emit lastLineChanged(_lines.last(), h);
+        scheduleLastLineChanged(h);
     }
 
     // now show and move the marker line if necessary
     if (!_markerLineValid && atBottom && (!chatView()->isVisible() || !chatView()->isActiveWindow())) {
         setMarkerLineValid(true);
-        setMarkerLine(firstBottomLine);
+        setMarkerLine(start);
         setMarkerLineVisible(true);
     }
-    else {
-        setMarkerLine();
+    else if (!atBottom && markerLine()->row() >= 0 && markerLine()->row() < start) {
+        // everything above the inserted rows moved up by their height, the rest stayed where it was
+        markerLine()->moveBy(0, -h);
     }
 
     emit rowsInserted();
@@ -696,18 +1162,25 @@ void ChatScene::rowsAboutToBeRemoved(const QModelIndex &parent, int start, int e
     QList<ChatLine *>::iterator lineIter = _lines.begin() + start;
     int lineCount = start;
     while (lineIter != _lines.end() && lineCount <= end) {
-        if ((*lineIter) == markerLine()->chatLine())
-            markerLine()->setChatLine(nullptr);
         h += (*lineIter)->height();
+        _materializedLines.remove(*lineIter);
         delete *lineIter;
         lineIter = _lines.erase(lineIter);
         lineCount++;
     }
+    _lineMsgIds.remove(start, end - start + 1);
 
     // update rows of remaining chatlines
     for (int i = start; i < _lines.count(); i++) {
         _lines.at(i)->setRow(i);
     }
+    updateSeparator(start);
+
+    // the marker line moves up with its line, or goes with it
+    if (markerLine()->row() > end)
+        markerLine()->setRow(markerLine()->row() - (end - start + 1));
+    else if (markerLine()->row() >= start)
+        markerLine()->setRow(-1);
 
     // update selection
     if (_selectionStartRow >= 0) {
@@ -725,53 +1198,42 @@ void ChatScene::rowsAboutToBeRemoved(const QModelIndex &parent, int start, int e
         }
     }
 
-    // neither removing at bottom or top means we have to move items...
-    if (!(atTop || atBottom)) {
-        qreal offset = h;
-        int moveStart = 0;
-        int moveEnd = _lines.count() - 1;
-        if (start < _lines.count() - start) {
-            // move top part
-            moveEnd = start - 1;
-        }
-        else {
-            // move bottom part
-            moveStart = start;
-            offset = -offset;
-        }
-        ChatLine *line = 0;
-        for (int i = moveStart; i <= moveEnd; i++) {
-            line = _lines.at(i);
-            line->setPos(0, line->pos().y() + offset);
-        }
-    }
-
-    Q_ASSERT(start == 0 || start >= _lines.count() || _lines.at(start - 1)->pos().y() + _lines.at(start - 1)->height() == _lines.at(start)->pos().y());
+    // close the gap by moving the smaller part, moving the top part down only shifts the origin
+    _lineHeights.remove(start, end - start + 1);
+    if (atTop || (!atBottom && start < _lines.count() - start))
+        _originY += h;
 
     // update sceneRect
-    // when searching for the first non-date-line we have to take into account that our
-    // model still contains the just removed lines so we cannot simply call updateSceneRect()
-    int numRows = model()->rowCount();
-    QModelIndex firstLineIdx;
-    _firstLineRow = -1;
-    bool needOffset = false;
-    do {
-        _firstLineRow++;
-        if (_firstLineRow >= start && _firstLineRow <= end) {
-            _firstLineRow = end + 1;
-            needOffset = true;
+    // our model still contains the just removed lines, so the first proper line
+    // is looked up in _lines, which doesn't anymore
+    if (_firstLineRow >= 0) {
+        if (end < _firstLineRow) {
+            _firstLineRow -= end - start + 1;
+        }
+        else if (start <= _firstLineRow) {
+            // the first proper line is gone, day changes following it are leading now
+            _firstLineRow = start;
+            while (_firstLineRow < _lines.count() && _lines.at(_firstLineRow)->msgType() == Message::DayChange) {
+                _lines.at(_firstLineRow)->hide();
+                _firstLineRow++;
+            }
         }
-        firstLineIdx = model()->index(_firstLineRow, 0);
     }
-    while ((Message::Type)(model()->data(firstLineIdx, MessageModel::TypeRole).toInt()) == Message::DayChange && _firstLineRow < numRows);
-
-    if (needOffset)
-        _firstLineRow -= end - start + 1;
     updateSceneRect();
+    updateMaterializedLines();
+
+    // the rows of a running background layout have moved
+    if (_backgroundLayoutPending > 0)
+        startBackgroundLayout(0, _lines.count() - 1, _sceneRect.width());
 }
 
 void ChatScene::dataChanged(const QModelIndex &tl, const QModelIndex &br)
 {
+    // the documents were rendered from the old data
+    for (int row = tl.row(); row <= br.row(); row++) {
+        _lines.at(row)->clearCache();
+        _lines.at(row)->update();
+    }
     layout(tl.row(), br.row(), _sceneRect.width());
 }
 
@@ -803,11 +1265,13 @@ void ChatScene::firstHandlePositionChanged(qreal xpos)
         (*lineIter)->setFirstColumn(firstColumnWidth, secondColumnWidth, secondColumnPos, linePos);
     }
     //setItemIndexMethod(QGraphicsScene::BspTreeIndex);
+    updateLineHeights(0, _lines.count() - 1);
 
     updateSceneRect();
+    updateMaterializedLines();
     setHandleXLimits();
     setMarkerLine();
-    emit layoutChanged();
+    scheduleLayoutChanged();
 }
 
 void ChatScene::secondHandlePositionChanged(qreal xpos)
@@ -818,9 +1282,10 @@ void ChatScene::secondHandlePositionChanged(qreal xpos)
     secondHandlePositionChanged(xpos, _sceneRect.width());
 
     updateSceneRect();
+    updateMaterializedLines();
     setHandleXLimits();
     setMarkerLine();
-    emit layoutChanged();
+    scheduleLayoutChanged();
 }
 
 // Extracted the core of secondHandlePositionChanged(qreal xpos) because of it's needed for scene resizing, too. But with a changed scene width.
@@ -849,6 +1314,46 @@ void ChatScene::secondHandlePositionChanged(qreal xpos, qreal sceneWidth)
         (*lineIter)->setSecondColumn(secondColumnWidth, thirdColumnWidth, thirdColumnPos, linePos);
     }
     //setItemIndexMethod(QGraphicsScene::BspTreeIndex);
+    updateLineHeights(0, _lines.count() - 1);
+}
+
+// While a handle is dragged only the lines in the scene follow it, the release does the full relayout.
+void ChatScene::firstHandleMoving(qreal xpos)
+{
+    Q_UNUSED(xpos)
+
+    qreal firstColumnWidth = firstColumnHandle()->sceneLeft();
+    qreal secondColumnWidth = secondColumnHandle()->sceneLeft() - firstColumnHandle()->sceneRight();
+    QPointF secondColumnPos(firstColumnHandle()->sceneRight(), 0);
+    foreach(ChatLine *line, _materializedLines) {
+        qreal linePos = 0;
+        line->setFirstColumn(firstColumnWidth, secondColumnWidth, secondColumnPos, linePos);
+        updateLineHeights(line->row(), line->row());
+    }
+
+    updateSceneRect();
+    updateMaterializedLines();
+    setMarkerLine();
+    scheduleLayoutChanged();
+}
+
+void ChatScene::secondHandleMoving(qreal xpos)
+{
+    Q_UNUSED(xpos)
+
+    qreal secondColumnWidth = secondColumnHandle()->sceneLeft() - firstColumnHandle()->sceneRight();
+    qreal thirdColumnWidth = _sceneRect.width() - secondColumnHandle()->sceneRight();
+    QPointF thirdColumnPos(secondColumnHandle()->sceneRight(), 0);
+    foreach(ChatLine *line, _materializedLines) {
+        qreal linePos = 0;
+        line->setSecondColumn(secondColumnWidth, thirdColumnWidth, thirdColumnPos, linePos);
+        updateLineHeights(line->row(), line->row());
+    }
+
+    updateSceneRect();
+    updateMaterializedLines();
+    setMarkerLine();
+    scheduleLayoutChanged();
 }
 
 void ChatScene::rowsRemoved()
@@ -866,10 +1371,26 @@ void ChatScene::clickTimeout()
 void ChatScene::setHandleXLimits()
 {
     _firstColHandle->setXLimits(0, _secondColHandle->sceneLeft() - minContentsWidth);
-    _secondColHandle->setXLimits(_firstColHandle->sceneRight() + minContentsWidth, width());
+    _secondColHandle->setXLimits(_firstColHandle->sceneRight() + minContentsWidth, _sceneRect.width());
     update();
 }
 
+void ChatScene::selectTo(const QPointF &scenePos)
+{
+    _pendingSelectionPos = scenePos;
+    _selectionUpdatePending = true;
+}
+
+void ChatScene::flushSelection()
+{
+    if (!_selectionUpdatePending)
+        return;
+
+    _selectionUpdatePending = false;
+    if (_isSelecting)
+        updateSelection(_pendingSelectionPos);
+}
+
 void ChatScene::updateSelection(const QPointF &pos)
 {
     int curRow = rowByScenePos(pos);
@@ -882,29 +1403,21 @@ void ChatScene::updateSelection(const QPointF &pos)
         if (minColumn != _selectionMinCol || maxColumn != _selectionMaxCol) {
             _selectionMaxCol = maxColumn;
             _selectionMinCol = minColumn;
-            for (int l = qMin(_selectionStartRow, _selectionEndRow); l <= qMax(_selectionStartRow, _selectionEndRow); l++)
-                _lines[l]->setSelected(true, minColumn, maxColumn);
+            setRowsSelected(qMin(_selectionStartRow, _selectionEndRow), qMax(_selectionStartRow, _selectionEndRow), true);
         }
 
 
+        // only the rows between the old and the new boundaries change
         int newstartRow = qMin(curRow, _firstSelectionRow);
         int newend = qMax(curRow, _firstSelectionRow);
-        if (newstartRow < _selectionStartRow) {
-            for (int l = newstartRow; l < _selectionStartRow; l++)
-                _lines[l]->setSelected(true, minColumn, maxColumn);
-        }
-        if (newstartRow > _selectionStartRow) {
-            for (int l = _selectionStartRow; l < newstartRow; l++)
-                _lines[l]->setSelected(false);
-        }
-        if (newend > _selectionEndRow) {
-            for (int l = _selectionEndRow+1; l <= newend; l++)
-                _lines[l]->setSelected(true, minColumn, maxColumn);
-        }
-        if (newend < _selectionEndRow) {
-            for (int l = newend+1; l <= _selectionEndRow; l++)
-                _lines[l]->setSelected(false);
-        }
+        if (newstartRow < _selectionStartRow)
+            setRowsSelected(newstartRow, _selectionStartRow - 1, true);
+        if (newstartRow > _selectionStartRow)
+            setRowsSelected(_selectionStartRow, newstartRow - 1, false);
+        if (newend > _selectionEndRow)
+            setRowsSelected(_selectionEndRow + 1, newend, true);
+        if (newend < _selectionEndRow)
+            setRowsSelected(newend + 1, _selectionEndRow, false);
 
         _selectionStartRow = newstartRow;
         _selectionEndRow = newend;
@@ -934,13 +1447,8 @@ void ChatScene::updateSceneRect(qreal width)
     // the second for cases where the viewport is larger then the set scenerect
     //  (in this case the items are shown anyways)
     if (_firstLineRow == -1) {
-        int numRows = model()->rowCount();
         _firstLineRow = 0;
-        QModelIndex firstLineIdx;
-        while (_firstLineRow < numRows) {
-            firstLineIdx = model()->index(_firstLineRow, 0);
-            if ((Message::Type)(model()->data(firstLineIdx, MessageModel::TypeRole).toInt()) != Message::DayChange)
-                break;
+        while (_firstLineRow < _lines.count() && _lines.at(_firstLineRow)->msgType() == Message::DayChange) {
             _lines.at(_firstLineRow)->hide();
             _firstLineRow++;
         }
@@ -948,16 +1456,15 @@ void ChatScene::updateSceneRect(qreal width)
 
     // the following call should be safe. If it crashes something went wrong during insert/remove
     if (_firstLineRow < _lines.count()) {
-        ChatLine *firstLine = _lines.at(_firstLineRow);
-        ChatLine *lastLine = _lines.last();
-        qreal y = lastLine->pos().y() + lastLine->height();
+        qreal top = lineTop(_firstLineRow);
+        qreal y = lineTop(_lines.count());
 
         // Update typing notification position
         if(mTypingItem->isVisible()) {
             mTypingItem->setPos(0, y);
             y += mTypingItem->height();
         }
-        updateSceneRect(QRectF(0, firstLine->pos().y(), width, y - firstLine->pos().y()));
+        updateSceneRect(QRectF(0, top, width, y - top));
     }
     else {
         // empty scene rect
@@ -967,7 +1474,63 @@ void ChatScene::updateSceneRect(qreal width)
 
 void ChatScene::updateSceneRect(const QRectF &rect)
 {
+    // the scene and the views take the new rect once per event loop turn, not for every line of a burst
     _sceneRect = rect;
-    setSceneRect(rect);
-    update();
+    scheduleFlush();
+}
+
+void ChatScene::scheduleLayoutChanged()
+{
+    _layoutChangedPending = true;
+    scheduleFlush();
+}
+
+//! Collects the offsets of all lines added at the bottom until the next flush
+void ChatScene::scheduleLastLineChanged(qreal offset)
+{
+    _lastLineOffset += offset;
+    _lastLineChangedPending = true;
+    scheduleFlush();
+}
+
+void ChatScene::scheduleFlush()
+{
+    if (_flushPending)
+        return;
+    _flushPending = true;
+    QMetaObject::invokeMethod(this, "flushChanges", Qt::QueuedConnection);
+}
+
+void ChatScene::flushChanges()
+{
+    _flushPending = false;
+
+    QRectF oldRect = sceneRect();
+    if (oldRect != _sceneRect) {
+        setSceneRect(_sceneRect);
+
+        // moved lines repaint themselves, only the background the rect gained or lost needs an update
+        if (oldRect.width() != _sceneRect.width()) {
+            update(oldRect.united(_sceneRect));
+        }
+        else {
+            if (oldRect.top() != _sceneRect.top())
+                update(QRectF(0, qMin(oldRect.top(), _sceneRect.top()), _sceneRect.width(), qAbs(oldRect.top() - _sceneRect.top())));
+            if (oldRect.bottom() != _sceneRect.bottom())
+                update(QRectF(0, qMin(oldRect.bottom(), _sceneRect.bottom()), _sceneRect.width(), qAbs(oldRect.bottom() - _sceneRect.bottom())));
+        }
+    }
+
+    if (_layoutChangedPending) {
+        _layoutChangedPending = false;
+        emit layoutChanged();
+    }
+
+    // after the views took the new rect, so their scroll ranges include the new lines
+    if (_lastLineChangedPending) {
+        _lastLineChangedPending = false;
+        qreal offset = _lastLineOffset;
+        _lastLineOffset = 0;
+        emit lastLineChanged(_lines.isEmpty() ? nullptr : _lines.last(), offset);
+    }
 }
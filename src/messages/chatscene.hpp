@@ -22,7 +22,14 @@
 #include <QGraphicsScene>
 #include <QAbstractItemModel>
 #include <QClipboard>
+#include <QAtomicInt>
+#include <QSet>
+#include <QSharedPointer>
+#include <QVector>
 #include "messagemodel.hpp"
+#include "lineheightindex.hpp"
+
+class LineHeightCache;
 
 class QGraphicsSceneMouseEvent;
 class ChatView;
@@ -31,6 +38,9 @@ class ChatItem;
 class ColumnHandleItem;
 class MarkerLineItem;
 class TypingItem;
+struct ChatLineLayoutChunk;
+struct ChatLayoutBatch;
+class SelectionMimeData;
 
 class ChatScene : public QGraphicsScene
 {
@@ -59,6 +69,8 @@ public:
     virtual ~ChatScene();
 
     inline QAbstractItemModel *model() const { return _model; }
+    //! Typed access to the rows of model(), through data() if the model has nothing better
+    inline const MessageAccessor *accessor() const { return _accessor; }
 
     int rowByScenePos(qreal y) const;
     inline int rowByScenePos(const QPointF &pos) const { return rowByScenePos(pos.y()); }
@@ -73,8 +85,18 @@ public:
 
     inline ChatLine *lastLine() const { return _lines.count() ? _lines.last() : 0; }
 
+    //! The scene position of the top of a row's line, also valid for lines that aren't materialized
+    /** Lines outside the scene are not moved along when rows above them change, so their pos() is stale.
+     *  \param row The row, or the row count for the bottom of the last line */
+    inline qreal lineTop(int row) const { return _originY + _lineHeights.offset(row); }
+    //! The first row whose line reaches below y, or the row count
+    int rowAtOrBelow(qreal y) const;
+
     inline MarkerLineItem *markerLine() const { return _markerLine; }
 
+    //! Adds the lines of the scene to usage, whether or not they are materialized
+    void addMemoryUsage(ChatMemoryUsage &usage) const;
+
     ColumnHandleItem *firstColumnHandle() const  { return _firstColHandle;  }
     ColumnHandleItem *secondColumnHandle() const { return _secondColHandle; }
 
@@ -83,10 +105,34 @@ public:
     bool hasGlobalSelection() const { return _selectionStartRow >= 0; }
     bool isPosOverSelection(const QPointF &pos) const;
     bool isGloballySelecting() const { return _isSelecting; }
+    //! Extends the global selection to scenePos on the next flushSelection()
+    /** Mouse moves only record the position, the view flushes once per frame, so a burst of moves
+     *  or an autoscroll step costs one selection update. */
+    void selectTo(const QPointF &scenePos);
+    void flushSelection();
     void initiateDrag(QWidget *source);
 
     bool isScrollingAllowed() const;
 
+    //! Whether only the lines around the viewport are added to the QGraphicsScene
+    /** Every row keeps its ChatLine for its geometry, but lines far from the viewport are taken
+     *  out of the scene and drop their cached layouts, so painting and item lookups only ever
+     *  deal with a screenful of lines, no matter how long the chat is. */
+    inline bool isVirtualized() const { return _virtualized; }
+    void setVirtualized(bool virtualized);
+
+    //! Whether the scene is rendered at all
+    /** A suspended scene keeps no line in the QGraphicsScene and gives new rows only an estimated
+     *  height instead of a layout. The lines are laid out again, lazily like after a resize, once
+     *  rendering resumes. Used while the page is hidden or the main window is minimized. */
+    inline bool isSuspended() const { return _suspended; }
+    void setSuspended(bool suspended);
+
+    //! Heights of earlier sessions, used for the lines waiting for the background layout
+    /** Lines found there get their height right away, the others are measured as before,
+     *  and every measured height is handed back to the cache. May be 0. */
+    void setHeightCache(LineHeightCache *cache);
+
 signals:
     void lastLineChanged(QGraphicsItem *item, qreal offset);
     void layoutChanged(); // indicates changes to the scenerect due to resizing of the contentsitems
@@ -96,12 +142,23 @@ signals:
 
 public slots:
     void updateForViewport(qreal width, qreal height);
+    //! Tells the scene which part of it is shown, lines around it are materialized
+    void setVisibleRange(qreal top, qreal bottom);
+    //! Builds the plain contents layouts of the materialized lines from first to last on QThreadPool
+    /** Rows are built in the given order, a new call drops what's left of the previous one. */
+    void prefetchLayouts(int first, int last);
     void setWidth(qreal width);
     void layout(int start, int end, qreal width);
+    //! Lays out all lines again at the current width, after something besides the width changed their height
+    void relayout();
+    //! Hands pending scene rect changes to the scene and views and emits the held back signals
+    /** Done once per event loop turn by itself, call it when the scene rect is needed right away. */
+    void flushChanges();
 
     void setMarkerLineValid(bool valid = true);
     void setMarkerLineVisible(bool visible = true);
-    void setMarkerLine(ChatLine *line = nullptr);
+    //! Moves the marker line to the line at row, or to where its line is now if row is -1
+    void setMarkerLine(int row = -1);
 
     void setTypingNotificationVisible(const QString &name, bool visible = true);
 
@@ -131,26 +188,82 @@ private slots:
     void firstHandlePositionChanged(qreal xpos);
     void secondHandlePositionChanged(qreal xpos);
     void secondHandlePositionChanged(qreal xpos, qreal sceneWidth);
+    void firstHandleMoving(qreal xpos);
+    void secondHandleMoving(qreal xpos);
 
     void rowsRemoved();
+    void onGroupMessagesChanged();
     void clickTimeout();
+    void applyLayoutChunk(const ChatLineLayoutChunk &chunk);
+    void applyLayoutBatch(const ChatLayoutBatch &batch);
 
 private:
     void setHandleXLimits();
     void updateSelection(const QPointF &pos);
+    void setRowsSelected(int start, int end, bool selected);
+    //! Updates the separator above the line at row and whether it continues the run of the line above
+    void updateSeparator(int row);
+    bool continuesRun(int row) const;
+    void scheduleLayoutChanged();
+    void scheduleLastLineChanged(qreal offset);
+    void scheduleFlush();
+    //! The rows of the global selection, formatted only when the data is asked for
+    SelectionMimeData *createSelectionMimeData() const;
 
     void updateSceneRect(qreal width);
     inline void updateSceneRect() { updateSceneRect(_sceneRect.width()); }
     void updateSceneRect(const QRectF &rect);
 
+    //! Takes new line heights into the index, keeping the bottom of the end row in place
+    void updateLineHeights(int start, int end);
+    void updateMaterializedLines();
+    void materialize(ChatLine *line);
+    void dematerialize(ChatLine *line);
+    //! Measures the rows not laid out for width yet on QThreadPool, cancels the previous run
+    void startBackgroundLayout(int start, int end, qreal width);
+    //! Gives the rows found in the LineHeightCache their height and takes them out of rows and texts
+    void applyCachedHeights(QVector<int> &rows, QStringList &texts, qreal width);
+    //! Hands the contents height of a line to the LineHeightCache
+    void cacheHeight(ChatLine *line, const QString &text);
+
     ChatView *          _chatView;
     QAbstractItemModel *_model;
+    ItemModelMessageAccessor _fallbackAccessor;
+    const MessageAccessor *_accessor;
     QList<ChatLine *>   _lines;
+    QVector<qint64>     _lineMsgIds; // the msgIds of _lines, so that chatLine(MsgId) doesn't go through the model
+    bool                _groupLines; // see Settings::isGroupMessagesEnabled()
+
+    //! Messages further apart than this, in ms, start a new run
+    static const qint64 RUN_INTERVAL = 5 * 60 * 1000;
 
     QRectF _sceneRect; // calls to QChatScene::sceneRect() are very expensive. As we manage the scenerect ourselves we store the size in a member variable.
     int    _firstLineRow; // the first row to display (aka: not a daychange msg)
     qreal  _viewportHeight;
 
+    // line positions are _originY plus the height of the rows above
+    LineHeightIndex _lineHeights;
+    qreal _originY;
+
+    // bumped for every background layout, running ones stop when it changes
+    QSharedPointer<QAtomicInt> _layoutGeneration;
+    int _backgroundLayoutPending; // rows the current background layout hasn't delivered yet
+    // bumped for every prefetch, see prefetchLayouts()
+    QSharedPointer<QAtomicInt> _prefetchGeneration;
+    LineHeightCache *_heightCache;
+
+    // changes waiting for flushChanges()
+    bool _flushPending;
+    bool _layoutChangedPending;
+    bool _lastLineChangedPending;
+    qreal _lastLineOffset;
+
+    bool  _virtualized;
+    bool  _suspended;
+    qreal _visibleTop;
+    qreal _visibleBottom;
+    QSet<ChatLine *> _materializedLines;
+
     MarkerLineItem *_markerLine;
     bool _markerLineVisible;
     bool _markerLineValid;
@@ -168,6 +281,8 @@ private:
     int  _selectionEndRow;
     int  _firstSelectionRow;
     bool _isSelecting;
+    QPointF _pendingSelectionPos;
+    bool _selectionUpdatePending;
 
     QTimer _clickTimer;
     ClickMode _clickMode;
@@ -178,6 +293,7 @@ private:
     // Typing notification
     TypingItem *mTypingItem;
     bool mTypingShown;
+    QString mTypingName;
 };
 
 #endif // CHATSCENE_HPP
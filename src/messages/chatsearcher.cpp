@@ -0,0 +1,91 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "chatsearcher.hpp"
+#include "trace.hpp"
+
+#include <QElapsedTimer>
+
+ChatSearcher::ChatSearcher(const QSharedPointer<QAtomicInt> &currentGeneration, const ContentsSnapshot &contents,
+                           const QStringMatcher &matcher, const QRegularExpression &expression, bool useExpression) :
+    _currentGeneration(currentGeneration),
+    _generation(currentGeneration->load()),
+    _contents(contents),
+    _matcher(matcher),
+    _expression(expression),
+    _useExpression(useExpression)
+{
+}
+
+void ChatSearcher::run()
+{
+    Trace::Span span("ChatSearcher::run");
+    ChatSearchChunk chunk;
+    chunk.generation = _generation;
+    bool foundAny = false;
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < _contents.count(); i++) {
+        if (_currentGeneration->load() != _generation)
+            return;
+
+        find(i, chunk);
+
+        if ((!foundAny && !chunk.indexes.isEmpty()) || timer.hasExpired(CHUNK_INTERVAL)) {
+            foundAny = foundAny || !chunk.indexes.isEmpty();
+            chunk.scanned = i + 1;
+            emit chunkFound(chunk);
+
+            chunk.indexes.clear();
+            chunk.starts.clear();
+            chunk.lengths.clear();
+            timer.restart();
+        }
+    }
+
+    chunk.scanned = _contents.count();
+    emit chunkFound(chunk);
+}
+
+void ChatSearcher::find(int index, ChatSearchChunk &chunk) const
+{
+    const QString text = _contents.text(index);
+
+    if (_useExpression) {
+        QRegularExpressionMatchIterator it = _expression.globalMatch(text);
+        while (it.hasNext()) {
+            QRegularExpressionMatch match = it.next();
+            if (match.capturedLength() > 0) {
+                chunk.indexes << index;
+                chunk.starts << match.capturedStart();
+                chunk.lengths << match.capturedLength();
+            }
+        }
+        return;
+    }
+
+    int searchIdx = 0;
+    do {
+        searchIdx = _matcher.indexIn(text, searchIdx);
+        if(searchIdx!=-1) {
+            chunk.indexes << index;
+            chunk.starts << searchIdx;
+            chunk.lengths << _matcher.pattern().count();
+            searchIdx++;
+        }
+    } while (searchIdx != -1);
+}
@@ -0,0 +1,73 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef CHATSEARCHER_HPP
+#define CHATSEARCHER_HPP
+
+#include <QAtomicInt>
+#include <QObject>
+#include <QRegularExpression>
+#include <QRunnable>
+#include <QSharedPointer>
+#include <QStringMatcher>
+#include <QVector>
+#include "contentssnapshot.hpp"
+
+//! Matches found in a part of the texts of one ChatSearcher run
+struct ChatSearchChunk
+{
+    int generation;
+    int scanned;            // texts scanned so far, this chunk included
+    QVector<int> indexes;   // into the searched texts
+    QVector<int> starts;
+    QVector<int> lengths;
+};
+Q_DECLARE_METATYPE(ChatSearchChunk)
+
+/**
+ * Finds the search string in a snapshot of message contents on QThreadPool, where the contents
+ * are also decompressed and copied out of the snapshot, the GUI thread only collects their places.
+ * Literal strings are looked for with a QStringMatcher, whole words and regular expressions
+ * with a compiled QRegularExpression. The first match is sent back right away, the rest in
+ * chunks every CHUNK_INTERVAL ms, so highlights show up while older history is still scanned.
+ * The job stops as soon as the shared generation counter no longer matches its own.
+ */
+class ChatSearcher : public QObject, public QRunnable
+{
+    Q_OBJECT
+public:
+    ChatSearcher(const QSharedPointer<QAtomicInt> &currentGeneration, const ContentsSnapshot &contents,
+                 const QStringMatcher &matcher, const QRegularExpression &expression, bool useExpression);
+
+    void run();
+
+    static const int CHUNK_INTERVAL = 50; // ms
+
+signals:
+    void chunkFound(const ChatSearchChunk &chunk);
+
+private:
+    void find(int index, ChatSearchChunk &chunk) const;
+
+    QSharedPointer<QAtomicInt> _currentGeneration;
+    int _generation;
+    ContentsSnapshot _contents;
+    QStringMatcher _matcher;
+    QRegularExpression _expression;
+    bool _useExpression;
+};
+
+#endif // CHATSEARCHER_HPP
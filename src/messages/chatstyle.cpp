@@ -0,0 +1,54 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+
+#include "chatstyle.hpp"
+#include "Settings/settings.hpp"
+#include <QCoreApplication>
+
+ChatStyle::ChatStyle() :
+    QObject(QCoreApplication::instance()),
+    _generation(0)
+{
+    _timer.setSingleShot(true);
+    _timer.setInterval(0);
+    connect(&_timer, &QTimer::timeout, this, &ChatStyle::invalidate);
+
+    Settings &s = Settings::getInstance();
+    connect(&s, &Settings::emojiFontChanged, this, &ChatStyle::scheduleInvalidation);
+    connect(&s, &Settings::smileyPackChanged, this, &ChatStyle::scheduleInvalidation);
+    connect(&s, &Settings::timestampFormatChanged, this, &ChatStyle::scheduleInvalidation);
+    connect(&s, &Settings::inlinePreviewsChanged, this, &ChatStyle::scheduleInvalidation);
+}
+
+ChatStyle *ChatStyle::instance()
+{
+    static ChatStyle *style = new ChatStyle();
+    return style;
+}
+
+void ChatStyle::scheduleInvalidation()
+{
+    if (!_timer.isActive())
+        _timer.start();
+}
+
+void ChatStyle::invalidate()
+{
+    _generation++;
+    emit invalidated(_generation);
+}
@@ -0,0 +1,54 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+
+#ifndef CHATSTYLE_HPP
+#define CHATSTYLE_HPP
+
+#include <QObject>
+#include <QTimer>
+
+//! Tells all ChatViews that the settings their lines are rendered with have changed
+/** Emoji font, smileys, timestamp format and inline previews change how every line looks. The
+ *  settings page sets several of them at once, so the changes are collected and announced once,
+ *  after the MessageModels have dropped the texts and spans they derived from them.
+ *  Shown views rebuild right away, hidden ones compare generation() when they are shown again.
+ */
+class ChatStyle : public QObject
+{
+    Q_OBJECT
+public:
+    static ChatStyle *instance();
+
+    //! Incremented with every invalidated() signal
+    inline quint64 generation() const { return _generation; }
+
+signals:
+    void invalidated(quint64 generation);
+
+private slots:
+    void scheduleInvalidation();
+    void invalidate();
+
+private:
+    ChatStyle();
+
+    quint64 _generation;
+    QTimer _timer;
+};
+
+#endif // CHATSTYLE_HPP
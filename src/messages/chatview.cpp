@@ -18,15 +18,50 @@
 #include "chatview.hpp"
 #include "chatscene.hpp"
 #include "chatline.hpp"
+#include "chatstyle.hpp"
+#include "chatviewstats.hpp"
+#include "thumbnailcache.hpp"
+#include "animationdriver.hpp"
 #include <QAbstractSlider>
+#include <QGLWidget>
+#if QT_VERSION >= QT_VERSION_CHECK(5, 4, 0)
+#include <QOpenGLWidget>
+#endif
+#include <QPainter>
 #include <QScrollBar>
+#include <QtMath>
 #include <QApplication>
 #include "Settings/settings.hpp"
 #include "messagefilter.hpp"
+#include "memorypressure.hpp"
 #include <QMenu>
 
+#include <algorithm>
+
+// rough memory use of the three documents of a line and of each character of its contents
+static const int documentCost = 3 * 2048;
+static const int documentCharCost = 32;
+static const int statsInterval = 500; // ms
+static const qreal scrollSpeedPerPixel = 12;   // px/s of autoscroll per px the cursor is outside the view
+static const qreal maxScrollSpeed = 6000;      // px/s
+static const int smoothScrollDuration = 200;    // ms
+static const int smoothScrollMaxPages = 2;      // farther scrolls jump this close to their target first
+static const int prefetchHorizon = 300;         // ms of scrolling at the current velocity that are prefetched
+static const int prefetchMaxPages = 4;
+
 ChatView::ChatView(MessageFilter *model, QWidget *parent) :
-    QGraphicsView(parent)
+    QGraphicsView(parent),
+    _selectionFrameRunning(false),
+    _scrollSpeed(0),
+    _scrollRemainder(0),
+    _cacheCost(0),
+    _cacheTick(0),
+    _lastCacheTop(0),
+    _cacheVelocity(0),
+    _openGL(false),
+    _styleGeneration(ChatStyle::instance()->generation()),
+    _visibleFirst(-1),
+    _visibleLast(-1)
 {
     setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
     setVerticalScrollBarPolicy(Qt::ScrollBarAsNeeded);
@@ -38,21 +73,30 @@ ChatView::ChatView(MessageFilter *model, QWidget *parent) :
     setBackgroundBrush(QApplication::palette().window());
     setFrameShape(QFrame::NoFrame);
 
-    _scrollTimer.setInterval(100);
-    _scrollTimer.setSingleShot(true);
-    connect(&_scrollTimer, SIGNAL(timeout()), SLOT(scrollTimerTimeout()));
+    _cacheClock.start();
+
+    _statsTimer.setInterval(statsInterval);
+    // the viewport is replaced when OpenGL is switched, so it isn't the receiver
+    connect(&_statsTimer, &QTimer::timeout, this, [this]() { viewport()->update(); });
+    connect(ChatViewStats::instance(), &ChatViewStats::enabledChanged, this, &ChatView::setStatsOverlayEnabled);
+    if (ChatViewStats::isEnabled())
+        setStatsOverlayEnabled(true);
 
     _scene = new ChatScene(model, viewport()->width(), this);
     connect(_scene, SIGNAL(sceneRectChanged(const QRectF &)), this, SLOT(adjustSceneRect()));
     connect(_scene, SIGNAL(lastLineChanged(QGraphicsItem *, qreal)), this, SLOT(lastLineChanged(QGraphicsItem *, qreal)));
     connect(_scene, SIGNAL(mouseMoveWhileSelecting(const QPointF &)), this, SLOT(mouseMoveWhileSelecting(const QPointF &)));
     setScene(_scene);
+    // a page created in the background doesn't render until it is shown
+    _scene->setSuspended(true);
 
     connect(verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(verticalScrollbarChanged(int)));
     _lastScrollbarPos = verticalScrollBar()->value();
+    _atBottom = true;
 
-    // Update timstamps
-    connect(&Settings::getInstance(), &Settings::timestampFormatChanged, this, &ChatView::clearCache);
+    // Timestamps, smileys, emoji font and image previews
+    connect(ChatStyle::instance(), &ChatStyle::invalidated, this, &ChatView::onStyleInvalidated);
+    connect(ThumbnailCache::instance(), &ThumbnailCache::thumbnailReady, this, [this]() { viewport()->update(); });
 
     // Actions
     hidePlain = new QAction(tr("Text messages"), this);
@@ -77,6 +121,52 @@ ChatView::ChatView(MessageFilter *model, QWidget *parent) :
 
     // Notify if window comes active, and so on...
     connect(qApp, &QApplication::applicationStateChanged, this, &ChatView::onApplicationStateChanged);
+
+    setOpenGLViewport(Settings::getInstance().isChatViewOpenGLEnabled());
+    connect(&Settings::getInstance(), &Settings::chatViewOpenGLChanged, this, [this]() {
+        setOpenGLViewport(Settings::getInstance().isChatViewOpenGLEnabled());
+    });
+
+    // the lines in view keep their documents, unless nothing is in view
+    MemoryPressure::getInstance().registerCache(this, MemoryPressure::LineDocuments, [this](MemoryPressure::Level level) {
+        if (level == MemoryPressure::Critical && !isVisible())
+            clearCache();
+        else
+            evictDocuments(_lastCacheTop, _lastCacheTop + viewport()->height(), 0);
+    });
+}
+
+void ChatView::setOpenGLViewport(bool enabled)
+{
+    enabled = enabled && QGLFormat::hasOpenGL();
+    if (enabled == _openGL)
+        return;
+
+    _openGL = enabled;
+    // QGraphicsView deletes the old viewport, the scene keeps its items and caches.
+    // The GL paint engine keeps drawn pixmaps as textures, so the cached lines and
+    // smileys are uploaded once and scrolling only composites them.
+    if (enabled) {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 4, 0)
+        QOpenGLWidget *glWidget = new QOpenGLWidget();
+        QSurfaceFormat format = glWidget->format();
+        format.setSamples(4);
+        glWidget->setFormat(format);
+        setViewport(glWidget);
+#else
+        setViewport(new QGLWidget(QGLFormat(QGL::SampleBuffers)));
+#endif
+    } else {
+        setViewport(new QWidget());
+    }
+    updateViewportUpdateMode();
+}
+
+void ChatView::updateViewportUpdateMode()
+{
+    // partial updates and scrolled pixels would smear the overlay, and a GL buffer is swapped as a whole
+    bool full = _openGL || ChatViewStats::isEnabled();
+    setViewportUpdateMode(full ? QGraphicsView::FullViewportUpdate : QGraphicsView::BoundingRectViewportUpdate);
 }
 
 MsgId ChatView::lastMsgId() const
@@ -88,7 +178,7 @@ MsgId ChatView::lastMsgId() const
     if (!model || model->rowCount() == 0)
         return MsgId();
 
-    return model->index(model->rowCount() - 1, 0).data(MessageModel::MsgIdRole).value<MsgId>();
+    return scene()->accessor()->msgId(model->rowCount() - 1);
 }
 
 MsgId ChatView::lastVisibleMsgId() const
@@ -101,50 +191,54 @@ MsgId ChatView::lastVisibleMsgId() const
     return MsgId();
 }
 
-bool chatLinePtrLessThan(ChatLine *one, ChatLine *other)
+MsgId ChatView::anchorMsgId() const
 {
-    return one->row() < other->row();
+    int first, last;
+    if (_atBottom || !visibleRows(first, last, Qt::IntersectsItemBoundingRect))
+        return MsgId();
+
+    return scene()->accessor()->msgId((first + last) / 2);
 }
 
-// TODO: figure out if it's cheaper to use a cached list (that we'd need to keep updated)
-QSet<ChatLine *> ChatView::visibleChatLines(Qt::ItemSelectionMode mode) const
+bool ChatView::visibleRows(int &first, int &last, Qt::ItemSelectionMode mode) const
 {
-    QSet<ChatLine *> result;
-    foreach(QGraphicsItem *item, items(viewport()->rect().adjusted(-1, -1, 1, 1), mode)) {
-        ChatLine *line = qgraphicsitem_cast<ChatLine *>(item);
-        if (line)
-            result.insert(line);
+    if (!scene() || !scene()->model())
+        return false;
+
+    int count = scene()->model()->rowCount();
+    if (count == 0)
+        return false;
+
+    QRectF rect = mapToScene(viewport()->rect().adjusted(-1, -1, 1, 1)).boundingRect();
+
+    // the first line reaching into the view, the first one reaching below it
+    first = scene()->rowAtOrBelow(rect.top());
+    last = qMin(scene()->rowAtOrBelow(rect.bottom()), count);
+
+    if (mode == Qt::ContainsItemBoundingRect || mode == Qt::ContainsItemShape) {
+        if (first < count && scene()->lineTop(first) < rect.top())
+            first++;
+        last--;
+    }
+    else if (last == count || scene()->lineTop(last) >= rect.bottom()) {
+        last--;
     }
-    return result;
-}
 
-QList<ChatLine *> ChatView::visibleChatLinesSorted(Qt::ItemSelectionMode mode) const
-{
-    QList<ChatLine *> result = visibleChatLines(mode).toList();
-    qSort(result.begin(), result.end(), chatLinePtrLessThan);
-    return result;
+    return first <= last && first < count;
 }
 
 ChatLine *ChatView::lastVisibleChatLine(bool ignoreDayChange) const
 {
-    if (!scene())
+    int first, last;
+    if (!visibleRows(first, last, Qt::ContainsItemBoundingRect))
         return 0;
 
-    QAbstractItemModel *model = scene()->model();
-    if (!model || model->rowCount() == 0)
-        return 0;
-
-    int row = -1;
-
-    QSet<ChatLine *> visibleLines = visibleChatLines(Qt::ContainsItemBoundingRect);
-    foreach(ChatLine *line, visibleLines) {
-        if (line->row() > row && (ignoreDayChange ? line->msgType() != Message::DayChange : true))
-            row = line->row();
+    for (int row = last; row >= first; row--) {
+        ChatLine *line = scene()->chatLine(row);
+        if (line && (!ignoreDayChange || line->msgType() != Message::DayChange))
+            return line;
     }
 
-    if (row >= 0)
-        return scene()->chatLine(row);
-
     return 0;
 }
 
@@ -166,21 +260,50 @@ void ChatView::addActionsToMenu(QMenu *menu, const QPointF &pos)
 
 void ChatView::setHasCache(ChatLine *line, bool hasCache)
 {
-    if (hasCache)
-        _linesWithCache.insert(line);
-    else
-        _linesWithCache.remove(line);
+    if (hasCache) {
+        if (_linesWithCache.contains(line))
+            return;
+
+        CacheEntry entry;
+        entry.lastUse = ++_cacheTick;
+        entry.cost = documentCost + documentCharCost * line->contentsItem()->displayText().length();
+        _linesWithCache.insert(line, entry);
+        _cacheCost += entry.cost;
+    }
+    else {
+        QHash<ChatLine *, CacheEntry>::iterator iter = _linesWithCache.find(line);
+        if (iter != _linesWithCache.end()) {
+            _cacheCost -= iter->cost;
+            _linesWithCache.erase(iter);
+        }
+    }
 }
 
 void ChatView::clearCache()
 {
-    QSet<ChatLine *>::iterator iter = _linesWithCache.begin();
+    QHash<ChatLine *, CacheEntry>::iterator iter = _linesWithCache.begin();
     while (iter != _linesWithCache.end()) {
-        ChatLine *line = *iter;
+        ChatLine *line = iter.key();
         line->clearCache();
         iter = _linesWithCache.erase(iter);
         line->update();
     }
+    _cacheCost = 0;
+}
+
+void ChatView::onStyleInvalidated(quint64 generation)
+{
+    Q_UNUSED(generation)
+    // the views shown go first, the hidden ones are only marked stale by the generation
+    if (isVisible())
+        restyle();
+}
+
+void ChatView::restyle()
+{
+    _styleGeneration = ChatStyle::instance()->generation();
+    clearCache();
+    _scene->relayout();
 }
 
 void ChatView::setTypingNotificationVisible(const QString &name, bool visible)
@@ -190,7 +313,53 @@ void ChatView::setTypingNotificationVisible(const QString &name, bool visible)
 
 void ChatView::scrollTo(const QPointF &position)
 {
-    ensureVisible(0, position.y(), 1, 1);
+    // like ensureVisible(), with its default margin
+    static const int margin = 50;
+    QRectF visible = mapToScene(viewport()->rect()).boundingRect();
+    int value = verticalScrollBar()->value();
+    if (position.y() < visible.top() + margin)
+        value += qFloor(position.y() - visible.top() - margin);
+    else if (position.y() > visible.bottom() - margin)
+        value += qCeil(position.y() - visible.bottom() + margin);
+    smoothScrollTo(value);
+}
+
+void ChatView::scrollToMsgId(MsgId msgId)
+{
+    ChatLine *line = scene()->chatLine(msgId, false);
+    if (!line)
+        return;
+
+    QRectF visible = mapToScene(viewport()->rect()).boundingRect();
+    qreal lineCenter = scene()->lineTop(line->row()) + line->height() / 2;
+    smoothScrollTo(verticalScrollBar()->value() + qRound(lineCenter - visible.center().y()));
+}
+
+void ChatView::smoothScrollTo(int value)
+{
+    QAbstractSlider *vbar = verticalScrollBar();
+    value = qBound(vbar->minimum(), value, vbar->maximum());
+    // either way a drag selection's autoscroll is over
+    _selectionFrameRunning = false;
+    if (!AnimationDriver::isEnabled() || !isVisible()) {
+        AnimationDriver::getInstance().stop(this);
+        vbar->setValue(value);
+        return;
+    }
+
+    // a far target is jumped close to first, every line passed on the way would be materialized
+    int maxDistance = smoothScrollMaxPages * viewport()->height();
+    if (qAbs(value - vbar->value()) > maxDistance)
+        vbar->setValue(value > vbar->value() ? value - maxDistance : value + maxDistance);
+
+    // scrolling moves the viewport's pixels and lays out only the lines coming into view
+    int start = vbar->value();
+    qreal progress = 0;
+    AnimationDriver::getInstance().animate(this, [this, start, value, progress](qreal elapsed) mutable {
+        progress += elapsed * 1000 / smoothScrollDuration;
+        verticalScrollBar()->setValue(start + qRound((value - start) * AnimationDriver::easeOut(progress)));
+        return progress < 1;
+    });
 }
 
 bool ChatView::event(QEvent *event)
@@ -222,6 +391,12 @@ bool ChatView::event(QEvent *event)
         }
     }
 
+    // the user takes over from a smooth scroll
+    if (event->type() == QEvent::Wheel || event->type() == QEvent::KeyPress) {
+        if (!scene()->isGloballySelecting())
+            AnimationDriver::getInstance().stop(this);
+    }
+
     return QGraphicsView::event(event);
 }
 
@@ -242,6 +417,38 @@ void ChatView::resizeEvent(QResizeEvent *event)
     checkChatLineCaches();
 }
 
+void ChatView::drawForeground(QPainter *painter, const QRectF &rect)
+{
+    QGraphicsView::drawForeground(painter, rect);
+
+    if (!ChatViewStats::isEnabled())
+        return;
+
+    ChatViewStats *stats = ChatViewStats::instance();
+    stats->recordFrame();
+    const QString text = stats->toString(_linesWithCache.count());
+
+    // in the viewport's coordinates, pinned to its top right corner
+    painter->save();
+    painter->resetTransform();
+    QRect bounds = painter->fontMetrics().boundingRect(viewport()->rect().adjusted(8, 8, -8, -8),
+                                                       Qt::AlignRight | Qt::AlignTop, text);
+    painter->fillRect(bounds.adjusted(-4, -4, 4, 4), QColor(0, 0, 0, 160));
+    painter->setPen(Qt::white);
+    painter->drawText(bounds, Qt::AlignLeft | Qt::AlignTop, text);
+    painter->restore();
+}
+
+void ChatView::setStatsOverlayEnabled(bool enabled)
+{
+    updateViewportUpdateMode();
+    if (enabled)
+        _statsTimer.start();
+    else
+        _statsTimer.stop();
+    viewport()->update();
+}
+
 void ChatView::scrollContentsBy(int dx, int dy)
 {
     QGraphicsView::scrollContentsBy(dx, dy);
@@ -251,12 +458,18 @@ void ChatView::scrollContentsBy(int dx, int dy)
 void ChatView::showEvent(QShowEvent *event)
 {
     scene()->setMarkerLineValid(false);
+    // while still suspended, so only the lines in view are laid out here and the rest in the background
+    if (_styleGeneration != ChatStyle::instance()->generation())
+        restyle();
+    scene()->setSuspended(false);
     QGraphicsView::showEvent(event);
 }
 
 void ChatView::hideEvent(QHideEvent *event)
 {
     scene()->setMarkerLineVisible(false);
+    // hidden pages of the stack and all pages of a minimized window stop rendering
+    scene()->setSuspended(true);
     QGraphicsView::hideEvent(event);
 }
 
@@ -271,8 +484,8 @@ void ChatView::verticalScrollbarChanged(int newPos)
         if (vbar->maximum() - vbar->minimum() != 0)
             relativePos = (newPos - vbar->minimum()) * 100 / (vbar->maximum() - vbar->minimum());
 
-        if (relativePos < 20) {
-            // TODO MKO scene()->requestBacklog();
+        if (relativePos < 20 && scene()->model()->canFetchMore(QModelIndex())) {
+            scene()->model()->fetchMore(QModelIndex());
         }
     }
     _lastScrollbarPos = newPos;
@@ -280,6 +493,12 @@ void ChatView::verticalScrollbarChanged(int newPos)
     // FIXME: Fugly workaround for the ChatView scrolling up 1px on buffer switch
     if (vbar->maximum() - newPos <= 2)
         vbar->setValue(vbar->maximum());
+
+    bool atBottom = (vbar->value() == vbar->maximum());
+    if (atBottom != _atBottom) {
+        _atBottom = atBottom;
+        emit atBottomChanged(atBottom);
+    }
 }
 
 void ChatView::lastLineChanged(QGraphicsItem *chatLine, qreal offset)
@@ -312,39 +531,136 @@ void ChatView::checkChatLineCaches()
 {
     qreal top = mapToScene(viewport()->rect().topLeft()).y() - 10; // some grace area to avoid premature cleaning
     qreal bottom = mapToScene(viewport()->rect().bottomRight()).y() + 10;
-    QSet<ChatLine *>::iterator iter = _linesWithCache.begin();
-    while (iter != _linesWithCache.end()) {
-        ChatLine *line = *iter;
-        if (line->pos().y() + line->height() < top || line->pos().y() > bottom) {
-            line->clearCache();
-            iter = _linesWithCache.erase(iter);
-        }
-        else
-            ++iter;
+    scene()->setVisibleRange(top, bottom);
+
+    int first, last;
+    if (visibleRows(first, last) && (first != _visibleFirst || last != _visibleLast)) {
+        _visibleFirst = first;
+        _visibleLast = last;
+        emit visibleRowsChanged(first, last);
+    }
+
+    // lines in view are the most recently used
+    quint64 tick = ++_cacheTick;
+    QHash<ChatLine *, CacheEntry>::iterator iter = _linesWithCache.begin();
+    for (; iter != _linesWithCache.end(); ++iter) {
+        qreal lineTop = scene()->lineTop(iter.key()->row());
+        if (lineTop + iter.key()->height() >= top && lineTop <= bottom)
+            iter->lastUse = tick;
+    }
+
+    prefetchAhead(top, bottom);
+    evictDocuments(top, bottom, qint64(Settings::getInstance().snapshot()->documentCacheSize) * 1024 * 1024);
+}
+
+void ChatView::prefetchAhead(qreal top, qreal bottom)
+{
+    // a scroll after a pause starts from rest
+    qint64 elapsed = _cacheClock.restart();
+    if (elapsed > 0 && elapsed < 500)
+        _cacheVelocity = (_cacheVelocity + (top - _lastCacheTop) / elapsed) / 2;
+    else
+        _cacheVelocity = 0;
+
+    qreal distance = top - _lastCacheTop;
+    _lastCacheTop = top;
+    if (distance == 0)
+        return;
+
+    // at least the next screenful in the scroll direction, further the faster the view moves
+    qreal screen = bottom - top;
+    qreal ahead = qBound(screen, qAbs(_cacheVelocity) * prefetchHorizon, prefetchMaxPages * screen);
+    if (distance > 0) {
+        prefetchDocuments(bottom, bottom + screen);
+        // nearest rows first
+        scene()->prefetchLayouts(scene()->rowAtOrBelow(bottom), scene()->rowAtOrBelow(bottom + ahead));
+    }
+    else {
+        prefetchDocuments(top - screen, top);
+        scene()->prefetchLayouts(scene()->rowAtOrBelow(top), scene()->rowAtOrBelow(top - ahead));
+    }
+}
+
+void ChatView::prefetchDocuments(qreal top, qreal bottom)
+{
+    int last = qMin(scene()->rowAtOrBelow(bottom), scene()->model()->rowCount() - 1);
+    for (int row = scene()->rowAtOrBelow(top); row <= last; row++) {
+        // only lines in the scene register their documents with the view
+        ChatLine *line = scene()->chatLine(row);
+        if (line && line->scene())
+            line->prefetchDocuments();
+    }
+}
+
+//! Clears the least recently visible documents until the cache fits its budget again, never the ones in view
+void ChatView::evictDocuments(qreal top, qreal bottom, qint64 budget)
+{
+    if (_cacheCost <= budget)
+        return;
+
+    QVector<QPair<quint64, ChatLine *> > candidates;
+    QHash<ChatLine *, CacheEntry>::const_iterator iter = _linesWithCache.constBegin();
+    for (; iter != _linesWithCache.constEnd(); ++iter) {
+        qreal lineTop = scene()->lineTop(iter.key()->row());
+        if (lineTop + iter.key()->height() < top || lineTop > bottom)
+            candidates << qMakePair(iter->lastUse, iter.key());
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    for (int i = 0; i < candidates.count() && _cacheCost > budget; i++) {
+        ChatLine *line = candidates.at(i).second;
+        setHasCache(line, false);
+        line->clearCache();
     }
 }
 
 void ChatView::mouseMoveWhileSelecting(const QPointF &scenePos)
 {
-    int y = (int)mapFromScene(scenePos).y();
-    _scrollOffset = 0;
-    if (y < 0)
-        _scrollOffset = y;
-    else if (y > height())
-        _scrollOffset = y - height();
+    _selectionCursorPos = mapFromScene(scenePos);
 
-    if (_scrollOffset && !_scrollTimer.isActive())
-        _scrollTimer.start();
+    // the further the cursor is outside the view, the faster it scrolls
+    int y = _selectionCursorPos.y();
+    int distance = 0;
+    if (y < 0)
+        distance = y;
+    else if (y > viewport()->height())
+        distance = y - viewport()->height();
+    _scrollSpeed = qBound(-maxScrollSpeed, distance * scrollSpeedPerPixel, maxScrollSpeed);
+
+    // replaces a smooth scroll, the selection decides where the view goes now
+    if (!_selectionFrameRunning) {
+        _selectionFrameRunning = true;
+        _scrollRemainder = 0;
+        AnimationDriver::getInstance().animate(this, [this](qreal elapsed) {
+            _selectionFrameRunning = selectionFrame(elapsed);
+            return _selectionFrameRunning;
+        });
+    }
 }
 
-void ChatView::scrollTimerTimeout()
+bool ChatView::selectionFrame(qreal elapsed)
 {
-    // scroll view
-    QAbstractSlider *vbar = verticalScrollBar();
-    if (_scrollOffset < 0 && vbar->value() > 0)
-        vbar->setValue(qMax(vbar->value() + _scrollOffset, 0));
-    else if (_scrollOffset > 0 && vbar->value() < vbar->maximum())
-        vbar->setValue(qMin(vbar->value() + _scrollOffset, vbar->maximum()));
+    if (!scene()->isGloballySelecting())
+        return false;
+
+    if (_scrollSpeed != 0) {
+        _scrollRemainder += _scrollSpeed * elapsed;
+        int step = (int)_scrollRemainder;
+        _scrollRemainder -= step;
+
+        QAbstractSlider *vbar = verticalScrollBar();
+        int value = qBound(vbar->minimum(), vbar->value() + step, vbar->maximum());
+        if (value != vbar->value()) {
+            vbar->setValue(value);
+            // the content moved under the cursor
+            scene()->selectTo(mapToScene(_selectionCursorPos));
+        }
+    }
+
+    scene()->flushSelection();
+
+    // nothing to do until the mouse moves again
+    return _scrollSpeed != 0;
 }
 
 void ChatView::onApplicationStateChanged(Qt::ApplicationState state)
@@ -19,7 +19,9 @@
 #define CHATVIEW_H
 
 #include <QGraphicsView>
+#include <QElapsedTimer>
 #include <QTimer>
+#include <QHash>
 #include <QMenu>
 #include <QApplication>
 #include "id.hpp"
@@ -36,22 +38,20 @@ public:
 
     virtual MsgId lastMsgId() const;
     virtual MsgId lastVisibleMsgId() const;
+    //! The message in the middle of the view, which scrollToMsgId() brings back there
+    /** \return An invalid MsgId while the view follows the newest line */
+    MsgId anchorMsgId() const;
     inline ChatScene *scene() const { return _scene; }
 
-    //! Return a set of ChatLines currently visible in the view
-    /** \param mode How partially visible ChatLines are handled
-     *  \return A set of visible ChatLines */
-    QSet<ChatLine *> visibleChatLines(Qt::ItemSelectionMode mode = Qt::ContainsItemBoundingRect) const;
-
-    //! Return a sorted list of ChatLines currently visible in the view
-    /** \param mode How partially visible ChatLines are handled
-     *  \return A list of visible ChatLines sorted by row
-     *  \note If the order of ChatLines does not matter, use visibleChatLines() instead */
-    QList<ChatLine *> visibleChatLinesSorted(Qt::ItemSelectionMode mode = Qt::ContainsItemBoundingRect) const;
+    //! The rows of the ChatLines currently visible in the view
+    /** Visible lines are contiguous, so they're found by a binary search in the scene's line heights,
+     *  without asking the QGraphicsScene for items or allocating anything.
+     *  \param mode How partially visible ChatLines are handled, Qt::ContainsItemBoundingRect or Qt::IntersectsItemBoundingRect
+     *  \return Whether any line is visible, first and last are only set if so */
+    bool visibleRows(int &first, int &last, Qt::ItemSelectionMode mode = Qt::ContainsItemBoundingRect) const;
 
     //! Return the last fully visible ChatLine in this view
-    /** Using this method more efficient than calling visibleChatLinesSorted() and taking its last element.
-     *  \return The last fully visible ChatLine in the view */
+    /** \return The last fully visible ChatLine in the view */
     ChatLine *lastVisibleChatLine(bool ignoreDayChange = false) const;
 
     void addActionsToMenu(QMenu *menu, const QPointF &pos);
@@ -70,10 +70,19 @@ public slots:
 
     void setTypingNotificationVisible(const QString &name, bool visible = true);
     void scrollTo(const QPointF &position);
+    //! Centers the line of msgId, or the nearest one if it's filtered out
+    void scrollToMsgId(MsgId msgId);
+
+signals:
+    //! Emitted when the view starts or stops following the newest line
+    void atBottomChanged(bool atBottom);
+    //! The rows of the view's model reaching into the viewport have changed
+    void visibleRowsChanged(int first, int last);
 
 protected:
     bool event(QEvent *event);
     void resizeEvent(QResizeEvent *event);
+    void drawForeground(QPainter *painter, const QRectF &rect);
     void scrollContentsBy(int dx, int dy);
     void showEvent(QShowEvent *event);
     void hideEvent(QHideEvent *event);
@@ -86,15 +95,52 @@ private slots:
     void adjustSceneRect();
     void checkChatLineCaches();
     void mouseMoveWhileSelecting(const QPointF &scenePos);
-    void scrollTimerTimeout();
+    //! Renders through an OpenGL widget instead of the raster engine, see Settings
+    void setOpenGLViewport(bool enabled);
     void onApplicationStateChanged(Qt::ApplicationState state);
+    //! Shows the ChatViewStats overlay, see MainWindow's menu
+    void setStatsOverlayEnabled(bool enabled);
+    //! Rebuilds a shown view right away, a hidden one once it is shown, see ChatStyle
+    void onStyleInvalidated(quint64 generation);
 
 private:
+    void prefetchDocuments(qreal top, qreal bottom);
+    //! Predicts where the view is heading from the scroll velocity and prefetches the lines there
+    void prefetchAhead(qreal top, qreal bottom);
+    //! One frame of a drag selection: autoscrolls and flushes the scene's selection, false once it's done
+    bool selectionFrame(qreal elapsed);
+    //! Scrolls to value, animated on the AnimationDriver when animations are enabled
+    void smoothScrollTo(int value);
+    void updateViewportUpdateMode();
+    void evictDocuments(qreal top, qreal bottom, qint64 budget);
+    //! Drops the documents and lays all lines out again for the current ChatStyle
+    void restyle();
+
     ChatScene *_scene;
     int _lastScrollbarPos;
-    QTimer _scrollTimer;
-    int _scrollOffset;
-    QSet<ChatLine *> _linesWithCache;
+    bool _atBottom;
+    // drag selection, stepped by the AnimationDriver
+    bool _selectionFrameRunning;
+    QPoint _selectionCursorPos; // in viewport coordinates, so it stays put while scrolling
+    qreal _scrollSpeed;         // px/s, negative is up
+    qreal _scrollRemainder;     // fractions of a pixel that weren't scrolled yet
+    QTimer _statsTimer; // repaints the overlay while nothing else does
+
+    //! Bookkeeping of the document cache, the least recently visible lines are cleared first
+    struct CacheEntry {
+        quint64 lastUse;
+        int cost;
+    };
+    QHash<ChatLine *, CacheEntry> _linesWithCache;
+    qint64 _cacheCost;  // estimated bytes held by all cached documents
+    quint64 _cacheTick;
+    qreal _lastCacheTop; // tells the scroll direction for prefetching
+    QElapsedTimer _cacheClock; // time since _lastCacheTop
+    qreal _cacheVelocity;      // px/ms, smoothed, tells how far ahead to prefetch
+    bool _openGL;
+    quint64 _styleGeneration; // the ChatStyle the lines were laid out for
+    int _visibleFirst;        // last rows reported by visibleRowsChanged()
+    int _visibleLast;
 
     // Filter actions
     QAction *hidePlain;
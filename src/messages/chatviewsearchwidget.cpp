@@ -19,17 +19,26 @@
 #include "chatitem.hpp"
 #include "chatline.hpp"
 #include <QLineEdit>
+#include <QThreadPool>
 #include <QDebug>
 #include "clickable.hpp"
 #include "Settings/settings.hpp"
 #include "smiley.hpp"
+#include "trace.hpp"
 #include <QToolBar>
+#include <algorithm>
 
 ChatViewSearchWidget::ChatViewSearchWidget(QWidget *parent) :
     QToolBar(parent),
     mScene(nullptr),
     mCaseSensitive(Qt::CaseInsensitive),
-    mRegularMsgOnly(true)
+    mRegularMsgOnly(true),
+    mWholeWords(false),
+    mRegularExpression(false),
+    mSearchGeneration(new QAtomicInt(0)),
+    mNextPendingRow(0),
+    mOldHighlightRow(-1),
+    mOldHighlightStart(0)
 {
     setHidden(true);
     setIconSize(QSize(16,16));
@@ -42,6 +51,8 @@ ChatViewSearchWidget::ChatViewSearchWidget(QWidget *parent) :
     connect(mSearchLineEdit, SIGNAL(textChanged(QString)), this, SLOT(delaySearch()));
     connect(&mSearchDelayTimer, &QTimer::timeout, this, &ChatViewSearchWidget::search);
 
+    qRegisterMetaType<ChatSearchChunk>("ChatSearchChunk");
+
     QAction *csCheckbox = new QAction(QIcon(":/icons/text_uppercase.png"), tr("Case sensitive"), this);
     csCheckbox->setCheckable(true);
     connect(csCheckbox, &QAction::toggled, this, &ChatViewSearchWidget::setCaseSensitive);
@@ -51,6 +62,14 @@ ChatViewSearchWidget::ChatViewSearchWidget(QWidget *parent) :
     regularMsgCheckBox->setChecked(mRegularMsgOnly);
     connect(regularMsgCheckBox, &QAction::toggled, this, &ChatViewSearchWidget::setSearchOnlyRegularMsgs);
 
+    QAction *wholeWordsCheckBox = new QAction(tr("Whole words"), this);
+    wholeWordsCheckBox->setCheckable(true);
+    connect(wholeWordsCheckBox, &QAction::toggled, this, &ChatViewSearchWidget::setWholeWords);
+
+    QAction *regexCheckBox = new QAction(tr("Regular expression"), this);
+    regexCheckBox->setCheckable(true);
+    connect(regexCheckBox, &QAction::toggled, this, &ChatViewSearchWidget::setRegularExpression);
+
     QAction *prevButton = new QAction(QIcon(":/icons/resultset_previous.png"), tr("Previous search result"), this);
     prevButton->setShortcut(QKeySequence::FindPrevious);
     connect(prevButton, &QAction::triggered, this, &ChatViewSearchWidget::highlightPrev);
@@ -65,6 +84,8 @@ ChatViewSearchWidget::ChatViewSearchWidget(QWidget *parent) :
     addSeparator();
     addAction(csCheckbox);
     addAction(regularMsgCheckBox);
+    addAction(wholeWordsCheckBox);
+    addAction(regexCheckBox);
     addSeparator();
     addAction(QIcon(":/icons/cross.png"), tr("Close search"), this, SLOT(closeSearch()));
 }
@@ -89,11 +110,19 @@ void ChatViewSearchWidget::setScene(ChatScene *scene)
     connect(mScene, SIGNAL(destroyed()), this, SLOT(sceneDestroyed()));
     connect(mScene, SIGNAL(rowsInserted()), this, SLOT(updateHighlights()));
     connect(&s, &Settings::smileyPackChanged, this, &ChatViewSearchWidget::updateExistingHighlights);
+    connect(&s, &Settings::smileyPackUpdated, this, &ChatViewSearchWidget::updateExistingHighlights);
     // TODO MKO Backlog
 
     connect(mScene, SIGNAL(rowsAboutToBeRemoved(int,int)), this, SLOT(rowsRemoved(int,int)), Qt::DirectConnection); // Direct connection is important
 }
 
+QString ChatViewSearchWidget::searchString() const
+{
+    if (!mSearchEnabled || isHidden())
+        return QString();
+    return mSearchLineEdit->text();
+}
+
 void ChatViewSearchWidget::enableSearch(bool enable)
 {
     mSearchEnabled = enable;
@@ -101,12 +130,20 @@ void ChatViewSearchWidget::enableSearch(bool enable)
     mSearchLineEdit->setFocus();
 }
 
+void ChatViewSearchWidget::openSearch(const QString &text)
+{
+    show();
+    enableSearch();
+    mSearchLineEdit->setText(text);
+}
+
 void ChatViewSearchWidget::setSearchString(const QString &searchString)
 {
     QString oldSearchString = mSearchString;
     mSearchString = searchString;
     if (mScene) {
-        if (!searchString.startsWith(oldSearchString) || oldSearchString.isEmpty()) {
+        // a longer pattern only restricts a literal search, not words or expressions
+        if (!searchString.startsWith(oldSearchString) || oldSearchString.isEmpty() || mWholeWords || mRegularExpression) {
             // we can't reuse our all findings... clear the scene and do it all over
             updateHighlights();
         }
@@ -142,6 +179,26 @@ void ChatViewSearchWidget::setSearchOnlyRegularMsgs(bool searchOnlyRegularMsgs)
     updateHighlights(searchOnlyRegularMsgs);
 }
 
+void ChatViewSearchWidget::setWholeWords(bool wholeWords)
+{
+    if (mWholeWords == wholeWords)
+        return;
+
+    mWholeWords = wholeWords;
+
+    // we can reuse the original search results if the new search parameters are a restriction of the original one
+    updateHighlights(wholeWords && !mRegularExpression);
+}
+
+void ChatViewSearchWidget::setRegularExpression(bool regularExpression)
+{
+    if (mRegularExpression == regularExpression)
+        return;
+
+    mRegularExpression = regularExpression;
+    updateHighlights();
+}
+
 void ChatViewSearchWidget::highlightNext()
 {
     if (mHighlights.isEmpty())
@@ -159,7 +216,7 @@ void ChatViewSearchWidget::highlightNext()
     mHighlights[mCurrentHighlight]->setCurrent(true);
     mHighlights.at(mCurrentHighlight)->item()->chatLine()->update();
 
-    emit newCurrentHighlight(mHighlights.at(mCurrentHighlight)->item()->chatLine()->scenePos());
+    showCurrentHighlight();
 }
 
 void ChatViewSearchWidget::highlightPrev()
@@ -179,126 +236,204 @@ void ChatViewSearchWidget::highlightPrev()
     mHighlights[mCurrentHighlight]->setCurrent(true);
     mHighlights.at(mCurrentHighlight)->item()->chatLine()->update();
 
-    emit newCurrentHighlight(mHighlights.at(mCurrentHighlight)->item()->chatLine()->scenePos());
+    showCurrentHighlight();
 }
 
 // Remove all highlights in mHighlights-list of removed rows
 void ChatViewSearchWidget::rowsRemoved(int start, int end)
 {
-
-    for (int i=0; i<mHighlights.count(); i++) {
-        Highlight *h = mHighlights.at(i);
-        if (!h)
-            mHighlights.removeAt(mHighlights.indexOf(h));
-
-        else if(h->item()->row()>= start && h->item()->row() <= end) {
-            // Highlights in item will deleted by deleting item
-            mHighlights.removeAt(mHighlights.indexOf(h));
-            i--;
+    // The highlights of the removed rows are one run of the ordered list
+    int first = lowerBound(start, 0);
+    int last  = lowerBound(end + 1, 0);
+    if (last > first) {
+        // Highlights in item will deleted by deleting item
+        mHighlights.erase(mHighlights.begin() + first, mHighlights.begin() + last);
+
+        if (mCurrentHighlight >= last) {
+            mCurrentHighlight -= last - first;
+        }
+        else if (mCurrentHighlight >= first && !mHighlights.isEmpty()) {
+            // The current highlight is gone, the next remaining one takes over
+            mCurrentHighlight = qMin(first, mHighlights.count() - 1);
+            mHighlights.at(mCurrentHighlight)->setCurrent(true);
+            mHighlights.at(mCurrentHighlight)->item()->chatLine()->update();
         }
     }
 
-    // Find new current highlight
-    updateCurrentHighlight(nullptr, 0);
+    // Rows still being searched move up with the remaining ones, the searcher's indexes stay valid
+    int removed = end - start + 1;
+    for (int i = mNextPendingRow; i < mPendingRows.count(); i++) {
+        int &row = mPendingRows[i];
+        if (row > end)
+            row -= removed;
+        else if (row >= start)
+            row = -1;
+    }
+    if (mOldHighlightRow > end)
+        mOldHighlightRow -= removed;
+    else if (mOldHighlightRow >= start)
+        mOldHighlightRow = -1;
 }
 
 void ChatViewSearchWidget::sceneDestroyed()
 {
     mScene = nullptr;
     mHighlights.clear();
+    mPendingRows.clear();
+    mNextPendingRow = 0;
+    mSearchGeneration->ref();
 }
 
 void ChatViewSearchWidget::updateHighlights(bool reuse)
 {
+    Trace::Span span("ChatViewSearchWidget::updateHighlights");
     if (!mScene)
         return;
 
     if(!mSearchEnabled)
         return;
 
+    // Remember the current highlight, unless an unfinished search already did
+    if (mNextPendingRow >= mPendingRows.count()) {
+        mOldHighlightRow = -1;
+        mOldHighlightStart = 0;
+        if (!mHighlights.isEmpty() && mCurrentHighlight < mHighlights.count()) {
+            mOldHighlightRow = mHighlights.at(mCurrentHighlight)->item()->row();
+            mOldHighlightStart = mHighlights.at(mCurrentHighlight)->start();
+        }
+    }
+
+    QVector<int> rows;
     if (reuse) {
-        QSet<ChatItem *> chatItems;
+        // The new search is a restriction of the old one, only rows with findings can match,
+        // plus the rows an unfinished search didn't get to
         for (Highlight *highlight : mHighlights) {
             ChatItem *item = highlight->item();
-            if (item)
-                chatItems << item;
+            if (item && (rows.isEmpty() || rows.last() != item->row()))
+                rows << item->row();
         }
-        for (ChatItem *item : QList<ChatItem *>(chatItems.toList())) {
-            updateHighlights(item);
+        for (int i = mNextPendingRow; i < mPendingRows.count(); i++) {
+            if (mPendingRows.at(i) >= 0)
+                rows << mPendingRows.at(i);
         }
     }
-    else {
-        ChatItem *oldItem = nullptr;
-        int oldStart = 0;
-        if (!mHighlights.isEmpty() && mCurrentHighlight < mHighlights.count()) {
-            oldItem = mHighlights.at(mCurrentHighlight)->item();
-            oldStart = mHighlights.at(mCurrentHighlight)->start();
-        }
+    else if (!mSearchString.isEmpty()) {
+        int count = mScene->model()->rowCount();
+        rows.reserve(count);
+        for (int row = 0; row < count; row++)
+            rows << row;
+    }
 
-        clearHightlights();
-        Q_ASSERT(mHighlights.isEmpty());
+    clearHightlights();
+    Q_ASSERT(mHighlights.isEmpty());
+
+    if (mSearchString.isEmpty() || rows.isEmpty())
+        return;
 
-        if (mSearchString.isEmpty())
+    if (mWholeWords || mRegularExpression) {
+        QString pattern = mRegularExpression ? mSearchString : QRegularExpression::escape(mSearchString);
+        if (mWholeWords)
+            pattern = QString("(?<!\\w)(?:%1)(?!\\w)").arg(pattern);
+        QRegularExpression::PatternOptions options = QRegularExpression::UseUnicodePropertiesOption | QRegularExpression::OptimizeOnFirstUsageOption;
+        if (mCaseSensitive == Qt::CaseInsensitive)
+            options |= QRegularExpression::CaseInsensitiveOption;
+        mExpression.setPattern(pattern);
+        mExpression.setPatternOptions(options);
+
+        // an incomplete expression while typing just finds nothing
+        if (!mExpression.isValid())
             return;
+    }
+    else {
+        mMatcher.setPattern(mSearchString);
+        mMatcher.setCaseSensitivity(mCaseSensitive);
+    }
 
-        checkMessagesForHighlight();
-        updateCurrentHighlight(oldItem, oldStart);
+    // Snapshot where the contents of the rows to search are, the searcher reads them itself
+    const MessageAccessor *accessor = mScene->accessor();
+    ContentsSnapshot contents;
+    for (int row : rows) {
+        if (mRegularMsgOnly && !checkType(accessor->msgType(row)))
+            continue;
+        mPendingRows << row;
+        accessor->snapshotContents(row, contents);
+    }
+    mNextPendingRow = 0;
+
+    if (mPendingRows.isEmpty()) {
+        finishSearch();
+        return;
     }
+
+    ChatSearcher *searcher = new ChatSearcher(mSearchGeneration, contents, mMatcher, mExpression, mWholeWords || mRegularExpression);
+    connect(searcher, SIGNAL(chunkFound(ChatSearchChunk)), this, SLOT(applySearchChunk(ChatSearchChunk)));
+    QThreadPool::globalInstance()->start(searcher);
 }
 
-// Find the nearest highlight to a given old one
-void ChatViewSearchWidget::updateCurrentHighlight(ChatItem *oldItem, int oldStart)
+// Highlight the matches of a chunk, they come in the order of the rows
+void ChatViewSearchWidget::applySearchChunk(const ChatSearchChunk &chunk)
 {
-    if (mHighlights.isEmpty())
+    Trace::Span span("ChatViewSearchWidget::applySearchChunk");
+    if (!mScene || chunk.generation != mSearchGeneration->load())
         return;
 
-    if (oldItem) {
-        int start = 0;
-        int end = mHighlights.count() - 1;
+    for (int i = 0; i < chunk.indexes.count(); i++) {
+        int row = mPendingRows.at(chunk.indexes.at(i));
+        if (row < 0)
+            continue;
 
-        Highlight *startPos;
-        Highlight *endPos;
+        ChatItem *item = mScene->chatLine(row)->contentsItem();
+        int start = chunk.starts.at(i);
+        int length = chunk.lengths.at(i);
 
-        while (1) {
-            startPos = mHighlights.at(start);
-            endPos = mHighlights.at(end);
+        // Calculate smiley offsets
+        Offsets offset;
+        offset.length = 0;
+        offset.start  = 0;
+        if (item->type() == ChatScene::ContentsChatItemType) {
+            ContentsChatItem *contentItem = static_cast<ContentsChatItem*>(item);
+            offset = calculateSmileyOffsets(contentItem->smileyList(), start, length);
+        }
 
-            if (startPos->item()->row() == oldItem->row() && startPos->start() == oldStart) {
-                mCurrentHighlight = start;
-                break;
-            }
+        if (length + offset.length > 0)
+            mHighlights << item->addHighlight(start + offset.start, length + offset.length);
+    }
 
-            if (endPos->item()->row() == oldItem->row() && endPos->start() == oldStart) {
-                mCurrentHighlight = end;
-                break;
-            }
+    mNextPendingRow = chunk.scanned;
+    if (mNextPendingRow >= mPendingRows.count())
+        finishSearch();
+}
 
-            if (end - start == 1) {
-                mCurrentHighlight = start;
-                break;
-            }
+void ChatViewSearchWidget::finishSearch()
+{
+    mPendingRows.clear();
+    mNextPendingRow = 0;
+    updateCurrentHighlight(mOldHighlightRow, mOldHighlightStart);
+}
 
-            if(end-start == 0) {
-                qDebug() << "you shouldn't see this..."; // TODO MKO pivot search
-                mCurrentHighlight = start;
-                break;
-            }
+// Index of the first highlight at or after start in row, highlights are ordered by (row, start)
+int ChatViewSearchWidget::lowerBound(int row, int start) const
+{
+    auto it = std::lower_bound(mHighlights.constBegin(), mHighlights.constEnd(), qMakePair(row, start),
+                               [](Highlight *h, const QPair<int, int> &pos) {
+        int hRow = h->item()->row();
+        return hRow < pos.first || (hRow == pos.first && h->start() < pos.second);
+    });
+    return it - mHighlights.constBegin();
+}
 
-            int pivot = (end + start) / 2;
-            Highlight *pivotPos = mHighlights.at(pivot);
-            if (startPos->item()->row() == endPos->item()->row()) {
-                if (oldStart <= pivotPos->start())
-                    end = pivot;
-                else
-                    start = pivot;
-            }
-            else {
-                if (oldItem->row() <= pivotPos->item()->row())
-                    end = pivot;
-                else
-                    start = pivot;
-            }
-        }
+// Find the nearest highlight to a given old one
+void ChatViewSearchWidget::updateCurrentHighlight(int oldRow, int oldStart)
+{
+    if (mHighlights.isEmpty())
+        return;
+
+    if (oldRow >= 0) {
+        // The old highlight itself if it's still there, otherwise the one before it
+        int idx = lowerBound(oldRow, oldStart);
+        if (idx == mHighlights.count() || mHighlights.at(idx)->item()->row() != oldRow || mHighlights.at(idx)->start() != oldStart)
+            idx = qMax(0, idx - 1);
+        mCurrentHighlight = idx;
     }
     else {
         mCurrentHighlight = mHighlights.count() - 1;
@@ -306,7 +441,20 @@ void ChatViewSearchWidget::updateCurrentHighlight(ChatItem *oldItem, int oldStar
 
     mHighlights.at(mCurrentHighlight)->setCurrent(true);
     mHighlights.at(mCurrentHighlight)->item()->chatLine()->update();
-    emit newCurrentHighlight(mHighlights.at(mCurrentHighlight)->item()->chatLine()->scenePos());
+    showCurrentHighlight();
+}
+
+// Expands the message of the current highlight if it's in the collapsed part, and scrolls to it
+void ChatViewSearchWidget::showCurrentHighlight()
+{
+    Highlight *h = mHighlights.at(mCurrentHighlight);
+    if (h->item()->type() == ChatScene::ContentsChatItemType) {
+        ContentsChatItem *contentItem = static_cast<ContentsChatItem*>(h->item());
+        if (contentItem->isCollapsed() && h->start() + h->length() > contentItem->shownLength())
+            contentItem->setExpanded(true);
+    }
+
+    emit newCurrentHighlight(QPointF(0, mScene->lineTop(h->item()->chatLine()->row())));
 }
 
 void ChatViewSearchWidget::closeSearch()
@@ -327,95 +475,6 @@ void ChatViewSearchWidget::search()
     setSearchString(mSearchLineEdit->text());
 }
 
-void ChatViewSearchWidget::checkMessagesForHighlight(int start, int end)
-{
-    QAbstractItemModel *model = mScene->model();
-    Q_ASSERT(model);
-
-    if (end == -1) {
-        end = model->rowCount() - 1;
-        if (end == -1)
-            return;
-    }
-
-    QModelIndex index;
-    for (int row = start; row <= end; row++) {
-        if (mRegularMsgOnly) {
-            index = model->index(row, 0);
-            if (!checkType((Message::Type)index.data(MessageModel::TypeRole).toInt()))
-                continue;
-        }
-        findHighlightInItem(mScene->chatLine(row)->contentsItem());
-    }
-}
-
-// Find new highlights in item and highlight them
-void ChatViewSearchWidget::findHighlightInItem(ChatItem *item)
-{
-    Offsets offset;
-    offset.length = 0;
-    offset.start  = 0;
-
-    for (int idx : findWords(item->data(MessageModel::DisplayRole).toString())) {
-        // Calculate smiley offsets
-        if (item->type() == ChatScene::ContentsChatItemType) {
-            ContentsChatItem *contentItem = static_cast<ContentsChatItem*>(item);
-            offset = calculateSmileyOffsets(contentItem->smileyList(), idx);
-        }
-
-        if (mSearchString.count() + offset.length > 0)
-            mHighlights << item->addHighlight(idx + offset.start, mSearchString.count() + offset.length);
-    }
-}
-
-// This function updates only highlights of 1 item (delete and search again)
-void ChatViewSearchWidget::updateHighlights(ChatItem *item)
-{
-    // Store the old current highlight
-    ChatItem *oldItem = nullptr;
-    int oldStart = 0;
-    if (!mHighlights.isEmpty() && mCurrentHighlight < mHighlights.count()) {
-        oldItem = mHighlights.at(mCurrentHighlight)->item();
-        oldStart = mHighlights.at(mCurrentHighlight)->start();
-    }
-
-    // Delete all highlights of this item
-    for (int i=0; i<item->highlights()->count(); i++) {
-        Highlight *highlightItem = item->highlights()->at(i);
-        if (!highlightItem)
-            continue;
-
-        highlightItem->item()->highlightRemove(highlightItem);
-        mHighlights.removeAt(mHighlights.indexOf(highlightItem));
-        i--;
-    }
-
-    // Find highlights of this item
-    if (!mRegularMsgOnly || checkType((Message::Type)item->data(MessageModel::TypeRole).toInt())) {
-        findHighlightInItem(item);
-    }
-
-    // set the current to the nearest highlight from the old one
-    updateCurrentHighlight(oldItem, oldStart);
-
-}
-
-QList<int> ChatViewSearchWidget::findWords(const QString &string)
-{
-    QList<int> result;
-
-    int searchIdx = 0;
-    do {
-        searchIdx = string.indexOf(mSearchString, searchIdx, mCaseSensitive);
-        if(searchIdx!=-1) {
-            result << searchIdx;
-            searchIdx++;
-        }
-    } while (searchIdx != -1);
-
-    return result;
-}
-
 void ChatViewSearchWidget::clearHightlights()
 {
     for (Highlight *sc : mHighlights) {
@@ -423,38 +482,44 @@ void ChatViewSearchWidget::clearHightlights()
             sc->item()->highlightRemove(sc);
     }
     mHighlights.clear();
+    mPendingRows.clear();
+    mNextPendingRow = 0;
+    mSearchGeneration->ref();
 }
 
-ChatViewSearchWidget::Offsets ChatViewSearchWidget::calculateSmileyOffsets(const SmileyList *smileys, int foundWordStart)
+ChatViewSearchWidget::Offsets ChatViewSearchWidget::calculateSmileyOffsets(const SmileyList *smileys, int foundWordStart, int foundWordLength)
 {
     Offsets r;
     r.length = 0;
     r.start  = 0;
 
-    for (int i=0; i<smileys->count(); i++) {
-        const Smiley s = smileys->at(i);
-        qint8 graphicsLength = (s.type() == Smiley::Emoji) ? s.graphics().count() : 1;
-        int searchStart      = foundWordStart;
-        int searchEnd        = foundWordStart + mSearchString.count() - 1;
+    int searchStart = foundWordStart;
+    int searchEnd   = foundWordStart + foundWordLength - 1;
+
+    // All smileys entirely before the found word just shift it
+    int first = smileys->firstEndingFrom(searchStart);
+    r.start -= smileys->offsetBefore(first);
+
+    // Only the few smileys overlapping the word are looked at one by one
+    for (int i=first; i<smileys->count(); i++) {
+        const Smiley &s = smileys->at(i);
+        int graphicsLength   = s.textLength() - (smileys->offsetBefore(i+1) - smileys->offsetBefore(i));
         int smileStart       = s.start();
         int smileEnd         = s.start() + s.textLength() - 1;
+        if (smileStart > searchEnd)
+            break;
 
         // Julians algorithm
         if (smileStart < searchStart) {
-            if (smileEnd < searchStart) {
-                r.start += graphicsLength - s.textLength();
+            if (smileEnd < searchEnd) {
+                r.start += smileStart + graphicsLength - searchStart;
+                r.length += searchStart - smileEnd - 1;
             }
-            else if (smileEnd >= searchStart) {
-                if (smileEnd < searchEnd) {
-                    r.start += smileStart + graphicsLength - searchStart;
-                    r.length += searchStart - smileEnd - 1;
-                }
-                else {
-                    r.length -= mSearchString.count();
-                }
+            else {
+                r.length -= foundWordLength;
             }
         }
-        else if (smileStart >= searchStart && smileStart <= searchEnd) {
+        else {
             if (smileEnd <= searchEnd) {
                 r.length += graphicsLength - s.textLength();
             }
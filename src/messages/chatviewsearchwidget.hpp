@@ -18,8 +18,14 @@
 #define CHATVIEWSEARCHWIDGET_HPP
 
 #include <QToolBar>
+#include <QAtomicInt>
+#include <QRegularExpression>
+#include <QSharedPointer>
+#include <QStringMatcher>
 #include <QTimer>
+#include <QVector>
 #include "message.hpp"
+#include "chatsearcher.hpp"
 
 class ChatScene;
 class QTextCursor;
@@ -35,12 +41,18 @@ class ChatViewSearchWidget : public QToolBar
 public:
     explicit ChatViewSearchWidget(QWidget *parent = 0);
     void setScene(ChatScene *scene);
+    //! What the open search bar searches for, empty while it's closed
+    QString searchString() const;
 
 public slots:
     void enableSearch(bool enable = true);
+    //! Opens the search bar with text in it, the search starts after the usual delay
+    void openSearch(const QString &text);
     void setSearchString(const QString &searchString);
     void setCaseSensitive(bool caseSensitive);
     void setSearchOnlyRegularMsgs(bool searchOnlyRegularMsgs);
+    void setWholeWords(bool wholeWords);
+    void setRegularExpression(bool regularExpression);
     void highlightNext();
     void highlightPrev();
     void rowsRemoved(int start, int end);
@@ -55,6 +67,7 @@ private slots:
     void closeSearch();
     void delaySearch();
     void search();
+    void applySearchChunk(const ChatSearchChunk &chunk);
 
 private:
     struct Offsets {
@@ -62,14 +75,13 @@ private:
         int start;
     };
 
-    void checkMessagesForHighlight(int start = 0, int end = -1);
-    void findHighlightInItem(ChatItem *item);
-    void updateHighlights(ChatItem *item);
-    void updateCurrentHighlight(ChatItem *oldItem, int oldStart);
+    void finishSearch();
+    void updateCurrentHighlight(int oldRow, int oldStart);
+    void showCurrentHighlight();
+    int lowerBound(int row, int start) const;
     inline bool checkType(Message::Type type) const { return type & (Message::Plain | Message::Action); }
-    QList<int> findWords(const QString &string);
     void clearHightlights();
-    Offsets calculateSmileyOffsets(const SmileyList *smileys, int foundWordStart);
+    Offsets calculateSmileyOffsets(const SmileyList *smileys, int foundWordStart, int foundWordLength);
 
     bool mSearchEnabled;
     ChatScene *mScene;
@@ -77,10 +89,25 @@ private:
     QLineEdit *mSearchLineEdit;
     Qt::CaseSensitivity mCaseSensitive;
     bool mRegularMsgOnly;
+    bool mWholeWords;
+    bool mRegularExpression;
+
+    // The query, compiled once per search: literal strings go through the matcher, whole words
+    // and regular expressions through the expression
+    QStringMatcher mMatcher;
+    QRegularExpression mExpression;
     QTimer mSearchDelayTimer;
 
+    // The rows a ChatSearcher is working on, in ascending order, -1 for rows removed since.
+    // Those before mNextPendingRow have been scanned
+    QSharedPointer<QAtomicInt> mSearchGeneration;
+    QVector<int> mPendingRows;
+    int mNextPendingRow;
+    int mOldHighlightRow;   // current highlight before the search started, to find the nearest one again
+    int mOldHighlightStart;
+
     int mCurrentHighlight;
-    QList<Highlight*> mHighlights; // A list of pointers to all highlights in all ContentItems
+    QList<Highlight*> mHighlights; // A list of pointers to all highlights in all ContentItems, ordered by (row, start)
 };
 
 #endif // CHATVIEWSEARCHWIDGET_HPP
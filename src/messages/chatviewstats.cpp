@@ -0,0 +1,118 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "chatviewstats.hpp"
+
+#include <algorithm>
+
+#include <QCoreApplication>
+
+bool ChatViewStats::_enabled = false;
+
+ChatViewStats::ChatViewStats() :
+    QObject(QCoreApplication::instance()),
+    _nextPaintTime(0),
+    _frames(0),
+    _fps(0)
+{
+    for (int i = 0; i < OPERATION_COUNT; i++) {
+        _time[i] = 0;
+        _last[i] = 0;
+        _timePerSecond[i] = 0;
+    }
+}
+
+ChatViewStats *ChatViewStats::instance()
+{
+    static ChatViewStats *stats = new ChatViewStats();
+    return stats;
+}
+
+void ChatViewStats::setEnabled(bool enabled)
+{
+    if (_enabled == enabled)
+        return;
+
+    _enabled = enabled;
+    _paintTimes.clear();
+    _nextPaintTime = 0;
+    startWindow();
+    emit enabledChanged(enabled);
+}
+
+void ChatViewStats::startWindow()
+{
+    _window.start();
+    _frames = 0;
+    for (int i = 0; i < OPERATION_COUNT; i++)
+        _time[i] = 0;
+}
+
+void ChatViewStats::recordLinePaint(qint64 nsecs)
+{
+    if (_paintTimes.count() < PAINT_SAMPLES) {
+        _paintTimes << nsecs;
+    } else {
+        _paintTimes[_nextPaintTime] = nsecs;
+        _nextPaintTime = (_nextPaintTime + 1) % PAINT_SAMPLES;
+    }
+}
+
+void ChatViewStats::recordFrame()
+{
+    _frames++;
+}
+
+void ChatViewStats::record(Operation operation, qint64 nsecs)
+{
+    if (operation == LinePaint)
+        recordLinePaint(nsecs);
+    _time[operation] += nsecs;
+    _last[operation] = nsecs;
+}
+
+QString ChatViewStats::toString(int linesWithCache)
+{
+    const qint64 elapsed = _window.elapsed();
+    if (elapsed >= WINDOW) {
+        _fps = _frames * 1000.0 / elapsed;
+        for (int i = 0; i < OPERATION_COUNT; i++)
+            _timePerSecond[i] = _time[i] / 1e6 * 1000.0 / elapsed;
+        startWindow();
+    }
+
+    // percentiles of the recent paints, the copy keeps the ring buffer in order
+    QVector<qint64> sorted = _paintTimes;
+    double p50 = 0;
+    double p99 = 0;
+    if (!sorted.isEmpty()) {
+        std::sort(sorted.begin(), sorted.end());
+        p50 = sorted.at(sorted.count() / 2) / 1000.0;
+        p99 = sorted.at(qMin(sorted.count() - 1, sorted.count() * 99 / 100)) / 1000.0;
+    }
+
+    return tr("%1 fps\n"
+              "line paint p50 %2 us, p99 %3 us\n"
+              "lines with documents %4\n"
+              "rowsInserted %5 ms/s, last %6 ms\n"
+              "layout %7 ms/s, last %8 ms")
+            .arg(_fps, 0, 'f', 1)
+            .arg(p50, 0, 'f', 0).arg(p99, 0, 'f', 0)
+            .arg(linesWithCache)
+            .arg(_timePerSecond[RowsInserted], 0, 'f', 1).arg(_last[RowsInserted] / 1e6, 0, 'f', 2)
+            .arg(_timePerSecond[Layout], 0, 'f', 1).arg(_last[Layout] / 1e6, 0, 'f', 2);
+}
@@ -0,0 +1,86 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef CHATVIEWSTATS_HPP
+#define CHATVIEWSTATS_HPP
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QVector>
+
+//! Paint and layout timings for the ChatView debug overlay
+/** Only collected while the overlay is on, everything else is a check of a static bool.
+ *  All of it happens on the GUI thread, there is only ever one chat shown, so the numbers are
+ *  shared by all views.
+ */
+class ChatViewStats : public QObject
+{
+    Q_OBJECT
+public:
+    enum Operation { LinePaint, RowsInserted, Layout, OPERATION_COUNT };
+
+    static ChatViewStats *instance();
+    static inline bool isEnabled() { return _enabled; }
+
+    //! Measures its own lifetime as one run of an operation
+    class Timer
+    {
+    public:
+        inline explicit Timer(Operation operation) : _operation(operation) { if (_enabled) _timer.start(); }
+        inline ~Timer() { if (_enabled && _timer.isValid()) instance()->record(_operation, _timer.nsecsElapsed()); }
+
+    private:
+        Operation _operation;
+        QElapsedTimer _timer;
+    };
+
+    void recordFrame();
+    void record(Operation operation, qint64 nsecs);
+
+    //! The overlay's text, with the number of lines holding documents in the asking view
+    QString toString(int linesWithCache);
+
+public slots:
+    void setEnabled(bool enabled);
+
+signals:
+    void enabledChanged(bool enabled);
+
+private:
+    ChatViewStats();
+
+    void startWindow();
+    void recordLinePaint(qint64 nsecs);
+
+    //! Line paint times of the last PAINT_SAMPLES paints, in ns
+    QVector<qint64> _paintTimes;
+    int _nextPaintTime;
+
+    //! Counted over about a second, then turned into rates
+    QElapsedTimer _window;
+    int _frames;
+    qint64 _time[OPERATION_COUNT];
+    qint64 _last[OPERATION_COUNT];
+    double _fps;
+    double _timePerSecond[OPERATION_COUNT];
+
+    static bool _enabled;
+    static const int PAINT_SAMPLES = 512;
+    static const int WINDOW = 1000; // ms
+};
+
+#endif // CHATVIEWSTATS_HPP
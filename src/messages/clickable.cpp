@@ -18,8 +18,11 @@
 #include "clickable.hpp"
 #include <QDesktopServices>
 #include <QModelIndex>
+#include <QRegularExpression>
 #include <QUrl>
 #include "chatitem.hpp"
+#include "objectpool.hpp"
+#include <algorithm>
 
 
 Clickable::Clickable(Clickable::Type type, quint16 start, quint16 length) :
@@ -34,84 +37,63 @@ void Clickable::activate(const QString &text) const
         return;
 
     switch (type()) {
-    case Clickable::Url:
-        QDesktopServices::openUrl(QUrl::fromEncoded(text.toUtf8(), QUrl::TolerantMode));
+    case Clickable::Url: {
+        QUrl url = QUrl::fromEncoded(text.toUtf8(), QUrl::TolerantMode);
+        // received files are linked as file://localhost/..., not every platform opens that as a local file
+        if (url.scheme() == "file" && url.host() == "localhost")
+            url.setHost(QString());
+        QDesktopServices::openUrl(url);
         break;
+    }
     default:
         break;
     }
 }
 
-// NOTE: This method is not threadsafe and not reentrant!
-//       (RegExps are not constant while matching, and they are static here for efficiency)
+// The regexp is compiled once, QRegularExpression JIT-compiles it after a few uses
 ClickableList ClickableList::fromString(const QString &str)
 {
     // For matching URLs
-    static QString scheme("(?:(?:mailto:|(?:[+.-]?\\w)+://)|www(?=\\.\\S+\\.))");
-    static QString authority("(?:(?:[,.;@:]?[-\\w]+)+\\.?|\\[[0-9a-f:.]+\\])(?::\\d+)?");
-    static QString urlChars("(?:[,.;:]*[\\w~@/?&=+$()!%#*{}\\[\\]\\|'^-])");
-    static QString urlEnd("(?:>|[,.;:\"]*\\s|\\b|$)");
-
-    static QRegExp regExp[] = {
-        // URL
-        // QRegExp(QString("((?:https?://|s?ftp://|irc://|mailto:|www\\.)%1+|%1+\\.[a-z]{2,4}(?:?=/%1+|\\b))%2").arg(urlChars, urlEnd)),
-        QRegExp(QString("\\b(%1%2(?:/%3*)?)%4").arg(scheme, authority, urlChars, urlEnd), Qt::CaseInsensitive),
-
-        // Channel name
-        // We don't match for channel names starting with + or &, because that gives us a lot of false positives.
-        //QRegExp("((?:#|![A-Z0-9]{5})[^,:\\s]+(?::[^,:\\s]+)?)\\b", Qt::CaseInsensitive)
-
-        // TODO: Nicks, we'll need a filtering for only matching known nicknames further down if we do this
-    };
+    static const QString scheme("(?:(?:mailto:|(?:[+.-]?\\w)+://)|www(?=\\.\\S+\\.))");
+    static const QString authority("(?:(?:[,.;@:]?[-\\w]+)+\\.?|\\[[0-9a-f:.]+\\])(?::\\d+)?");
+    static const QString urlChars("(?:[,.;:]*[\\w~@/?&=+$()!%#*{}\\[\\]\\|'^-])");
+    static const QString urlEnd("(?:>|[,.;:\"]*\\s|\\b|$)");
 
-    static const int regExpCount = 1; // number of regexps in the array above
+    // \w has to match letters of every script, like it did with QRegExp
+    static const QRegularExpression urlRegExp(QString("\\b(%1%2(?:/%3*)?)%4").arg(scheme, authority, urlChars, urlEnd),
+                                              QRegularExpression::CaseInsensitiveOption | QRegularExpression::UseUnicodePropertiesOption);
 
-    qint16 matches[] = { 0, 0, 0 };
-    qint16 matchEnd[] = { 0, 0, 0 };
+    // TODO: Nicks, we'll need a filtering for only matching known nicknames further down if we do this
 
     ClickableList result;
-    //QString str = data(ChatLineModel::DisplayRole).toString();
-
-    qint16 idx = 0;
-    qint16 minidx;
-    int type = -1;
-
-    do {
-        type = -1;
-        minidx = str.length();
-        for (int i = 0; i < regExpCount; i++) {
-            if (matches[i] < 0 || matchEnd[i] > str.length()) continue;
-            if (idx >= matchEnd[i]) {
-                matches[i] = regExp[i].indexIn(str, qMax(matchEnd[i], idx));
-                if (matches[i] >= 0) matchEnd[i] = matches[i] + regExp[i].cap(1).length();
-            }
-            if (matches[i] >= 0 && matches[i] < minidx) {
-                minidx = matches[i];
-                type = i;
-            }
-        }
-        if (type >= 0) {
-            idx = matchEnd[type];
-            QString match = str.mid(matches[type], matchEnd[type] - matches[type]);
-            if (type == Clickable::Url && str.at(idx-1) == ')') { // special case: closing paren only matches if we had an open one
-                if (!match.contains('(')) {
-                    matchEnd[type]--;
-                    match.chop(1);
-                }
-            }
-            result.append(Clickable((Clickable::Type)type, matches[type], matchEnd[type] - matches[type]));
-        }
+    int idx = 0;
+    while (idx < str.length()) {
+        QRegularExpressionMatch match = urlRegExp.match(str, idx);
+        if (!match.hasMatch())
+            break;
+
+        int start = match.capturedStart(1);
+        int end = match.capturedEnd(1);
+        idx = end;
+        if (str.at(end-1) == ')' && !match.captured(1).contains('(')) // special case: closing paren only matches if we had an open one
+            end--;
+        result.append(Clickable(Clickable::Url, start, end - start));
     }
-    while (type >= 0);
     return result;
 }
 
-Clickable ClickableList::atCursorPos(int idx)
+Clickable ClickableList::atCursorPos(int idx) const
 {
-    foreach(const Clickable &click, *this) {
-        if (idx >= click.start() && idx < click.start() + click.length())
-            return click;
-    }
+    // the last clickable starting at or before idx is the only one that can contain it
+    auto it = std::upper_bound(constBegin(), constEnd(), idx, [](int pos, const Clickable &click) {
+        return pos < click.start();
+    });
+    if (it == constBegin())
+        return Clickable();
+
+    --it;
+    if (idx < it->start() + it->length())
+        return *it;
     return Clickable();
 }
 
@@ -123,3 +105,17 @@ Highlight::Highlight(Highlight::Type type, ChatItem *item, quint16 start, quint1
     mStart(start),
     mLength(length)
 {}
+
+namespace {
+ObjectPool<Highlight> highlightPool;
+}
+
+void *Highlight::operator new(size_t size)
+{
+    return highlightPool.allocate(size);
+}
+
+void Highlight::operator delete(void *p, size_t size)
+{
+    highlightPool.release(p, size);
+}
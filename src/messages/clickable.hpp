@@ -39,6 +39,8 @@ public:
     inline quint16 length() const { return _length; }
 
     inline bool isValid() const { return _type != Invalid; }
+    inline bool operator==(const Clickable &other) const { return _type == other._type && _start == other._start && _length == other._length; }
+    inline bool operator!=(const Clickable &other) const { return !(*this == other); }
 
     void activate(const QString &text) const;
 
@@ -53,7 +55,8 @@ class ClickableList : public QList<Clickable>
 public:
     static ClickableList fromString(const QString &str);
 
-    Clickable atCursorPos(int idx);
+    //! The clickable containing idx, a binary search as clickables are sorted by start and don't overlap
+    Clickable atCursorPos(int idx) const;
 };
 
 // ============================================================================
@@ -69,6 +72,10 @@ public:
 
     explicit Highlight(Type type = Invalid, ChatItem *item = nullptr, quint16 start = 0, quint16 length = 0);
 
+    // a search creates one per hit, see ObjectPool
+    static void *operator new(size_t size);
+    static void operator delete(void *p, size_t size);
+
     inline Type type() const { return mType; }
     inline quint16 start() const { return mStart; }
     inline void setStart(quint16 s) { mStart = s; }
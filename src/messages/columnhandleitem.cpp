@@ -17,6 +17,7 @@
 
 #include "columnhandleitem.hpp"
 #include "chatview.hpp"
+#include "animationdriver.hpp"
 
 #include <QApplication>
 #include <QCursor>
@@ -24,6 +25,9 @@
 #include <QPainter>
 #include <QPalette>
 
+// minimum time between two positionMoving() signals, about one frame
+const qint64 moveUpdateInterval = 16;
+
 ColumnHandleItem::ColumnHandleItem(qreal w, QGraphicsItem *parent) :
     QGraphicsObject(parent),
     _width(w),
@@ -32,20 +36,11 @@ ColumnHandleItem::ColumnHandleItem(qreal w, QGraphicsItem *parent) :
     _offset(0),
     _minXPos(0),
     _maxXPos(0),
-    _opacity(0),
-    _animation(new QPropertyAnimation(this, "opacity", this))
+    _opacity(0)
 {
     setAcceptHoverEvents(true);
     setZValue(10);
     setCursor(QCursor(Qt::OpenHandCursor));
-
-    _animation->setStartValue(0);
-    _animation->setEndValue(1);
-    _animation->setDirection(QPropertyAnimation::Forward);
-    _animation->setDuration(350);
-    _animation->setEasingCurve(QEasingCurve::InOutSine);
-
-    //connect(&_timeLine, SIGNAL(valueChanged(qreal)), this, SLOT(hoverChanged(qreal)));
 }
 
 void ColumnHandleItem::setXPos(qreal xpos)
@@ -93,16 +88,29 @@ void ColumnHandleItem::hoverEnterEvent(QGraphicsSceneHoverEvent *event)
 {
     Q_UNUSED(event);
 
-    _animation->setDirection(QPropertyAnimation::Forward);
-    _animation->start();
+    fadeTo(1);
 }
 
 void ColumnHandleItem::hoverLeaveEvent(QGraphicsSceneHoverEvent *event)
 {
     Q_UNUSED(event);
 
-    _animation->setDirection(QPropertyAnimation::Backward);
-    _animation->start();
+    fadeTo(0);
+}
+
+void ColumnHandleItem::fadeTo(qreal opacity)
+{
+    if (!AnimationDriver::isEnabled()) {
+        setOpacity(opacity);
+        return;
+    }
+
+    // from wherever a fade the other way left it
+    AnimationDriver::getInstance().animate(this, [this, opacity](qreal elapsed) {
+        qreal step = elapsed * 1000 / FADE_DURATION;
+        setOpacity(opacity > _opacity ? qMin(opacity, _opacity + step) : qMax(opacity, _opacity - step));
+        return _opacity != opacity;
+    });
 }
 
 void ColumnHandleItem::mouseMoveEvent(QGraphicsSceneMouseEvent *event)
@@ -113,7 +121,11 @@ void ColumnHandleItem::mouseMoveEvent(QGraphicsSceneMouseEvent *event)
             newx = _minXPos;
         else if (newx + width() > _maxXPos)
             newx = _maxXPos - width();
-        setPos(newx, 0);
+        setXPos(newx);
+        if (_moveTimer.elapsed() >= moveUpdateInterval) {
+            _moveTimer.restart();
+            emit positionMoving(x());
+        }
         event->accept();
     }
     else {
@@ -128,6 +140,7 @@ void ColumnHandleItem::mousePressEvent(QGraphicsSceneMouseEvent *event)
         QApplication::setOverrideCursor(Qt::ClosedHandCursor);
         _moving = true;
         _offset = event->pos().x();
+        _moveTimer.start();
         event->accept();
     }
     else {
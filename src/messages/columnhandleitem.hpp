@@ -20,7 +20,7 @@
 
 #include <QGraphicsItem>
 #include <QGraphicsScene>
-#include <QPropertyAnimation>
+#include <QElapsedTimer>
 #include "chatscene.hpp"
 
 class ColumnHandleItem : public QGraphicsObject
@@ -52,6 +52,8 @@ public slots:
 
 signals:
     void positionChanged(qreal x);
+    //! Emitted at most once per frame while the handle is dragged, positionChanged() follows on release
+    void positionMoving(qreal x);
 
 protected:
     void hoverEnterEvent(QGraphicsSceneHoverEvent *event);
@@ -66,9 +68,13 @@ private:
     QRectF _boundingRect;
     bool _moving;
     qreal _offset;
+    QElapsedTimer _moveTimer;
     qreal _minXPos, _maxXPos;
     qreal _opacity;
-    QPropertyAnimation *_animation;
+
+    //! Fades the handle in or out on the AnimationDriver
+    void fadeTo(qreal opacity);
+    static const int FADE_DURATION = 350; // ms
 };
 
 #endif // COLUMNHANDLEITEM_HPP
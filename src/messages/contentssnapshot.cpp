@@ -0,0 +1,49 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "contentssnapshot.hpp"
+
+ContentsSnapshot::ContentsSnapshot() :
+    _hasStore(false),
+    _thawedBlock(-1)
+{
+}
+
+QString ContentsSnapshot::text(int index) const
+{
+    const int block = _blocks.at(index);
+    if (block == TEXT)
+        return _texts.at(_offsets.at(index));
+
+    const QChar *chars = _arena.constData();
+    if (block != ARENA) {
+        if (block != _thawedBlock) {
+            _thawedChars = qUncompress(_frozenBlocks.value(block));
+            _thawedBlock = block;
+        }
+        chars = reinterpret_cast<const QChar *>(_thawedChars.constData());
+    }
+    // the characters stay where they are, the string just points at them
+    return QString::fromRawData(chars + _offsets.at(index), _lengths.at(index));
+}
+
+void ContentsSnapshot::append(const QString &text)
+{
+    _blocks << TEXT;
+    _offsets << _texts.count();
+    _lengths << text.length();
+    _texts << text;
+}
@@ -0,0 +1,64 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef CONTENTSSNAPSHOT_HPP
+#define CONTENTSSNAPSHOT_HPP
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+//! The contents of some rows of a MessageStore as they were when taken, readable on another thread
+/** The character arena and the frozen blocks are shared with the store, so taking a snapshot
+ *  costs the offsets of its rows but not their text; the store's next write copies the arena
+ *  once instead. Frozen blocks are decompressed by whoever reads them. Rows whose display text
+ *  isn't their contents, like actions, are added with that text.
+ */
+class ContentsSnapshot
+{
+public:
+    ContentsSnapshot();
+
+    inline int count() const { return _blocks.count(); }
+    //! The text of the index-th row added, valid until the next call
+    QString text(int index) const;
+
+    //! Adds a row by its display text
+    void append(const QString &text);
+
+private:
+    friend class MessageStore;
+
+    // per row: the frozen block, ARENA or TEXT; the offset into the block, the arena or _texts; the length
+    QVector<int> _blocks;
+    QVector<int> _offsets;
+    QVector<int> _lengths;
+
+    bool _hasStore;
+    QVector<QChar> _arena;
+    QHash<int, QByteArray> _frozenBlocks;
+    QStringList _texts;
+
+    mutable int _thawedBlock;
+    mutable QByteArray _thawedChars;
+
+    static const int ARENA = -1;
+    static const int TEXT = -2;
+};
+
+#endif // CONTENTSSNAPSHOT_HPP
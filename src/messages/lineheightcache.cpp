@@ -0,0 +1,165 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+
+#include "lineheightcache.hpp"
+#include <QBuffer>
+#include <QDataStream>
+#include <QDebug>
+#include <QFile>
+
+#include <cstring>
+#include <sodium.h>
+
+static_assert(crypto_shorthash_KEYBYTES == 16, "LineHeightCache::_hashKey has the size of a shorthash key");
+
+LineHeightCache::LineHeightCache(const QString &filePath, const QByteArray &key, QObject *parent) :
+    QObject(parent),
+    _filePath(filePath),
+    _writer(filePath, SAVE_DELAY, "Line heights")
+{
+    // the history key isn't used as it is, so the hashes tell nothing about it
+    static const QByteArray context("line heights");
+    crypto_generichash_state state;
+    crypto_generichash_init(&state, NULL, 0, sizeof(_hashKey));
+    crypto_generichash_update(&state, reinterpret_cast<const unsigned char *>(context.constData()), context.size());
+    crypto_generichash_update(&state, reinterpret_cast<const unsigned char *>(key.constData()), key.size());
+    crypto_generichash_final(&state, _hashKey, sizeof(_hashKey));
+
+    connect(&_writer, SIGNAL(due()), SLOT(save()));
+
+    load();
+}
+
+LineHeightCache::~LineHeightCache()
+{
+    _writer.flush();
+}
+
+QString LineHeightCache::filePath(const QString &basePath)
+{
+    return basePath + ".heights";
+}
+
+void LineHeightCache::load()
+{
+    QFile file(_filePath);
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_2);
+    quint32 version;
+    quint32 layoutCount;
+    stream >> version >> layoutCount;
+    if (stream.status() != QDataStream::Ok || version != FILE_VERSION) {
+        qWarning() << "Line heights" << _filePath << "are unreadable, lines are measured again";
+        return;
+    }
+
+    for (quint32 i = 0; i < layoutCount && i < quint32(MAX_LAYOUTS) && stream.status() == QDataStream::Ok; i++) {
+        Layout layout;
+        double contentsWidth;
+        quint32 count;
+        stream >> layout.fontKey >> contentsWidth >> count;
+        layout.contentsWidth = contentsWidth;
+        layout.heights.reserve(qMin(count, quint32(MAX_HEIGHTS)));
+        for (quint32 j = 0; j < count && stream.status() == QDataStream::Ok; j++) {
+            quint64 hash;
+            qint32 height;
+            stream >> hash >> height;
+            layout.heights.insert(hash, height / float(HEIGHT_UNITS));
+        }
+        if (stream.status() == QDataStream::Ok)
+            _layouts << layout;
+    }
+}
+
+void LineHeightCache::save()
+{
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    QDataStream stream(&buffer);
+    stream.setVersion(QDataStream::Qt_5_2);
+    stream << FILE_VERSION << quint32(_layouts.count());
+    foreach (const Layout &layout, _layouts) {
+        stream << layout.fontKey << double(layout.contentsWidth) << quint32(layout.heights.count());
+        for (QHash<quint64, float>::const_iterator it = layout.heights.constBegin(); it != layout.heights.constEnd(); ++it)
+            stream << it.key() << qint32(qRound(it.value() * HEIGHT_UNITS));
+    }
+
+    _writer.replace(data);
+}
+
+void LineHeightCache::setLayout(const QFont &font, qreal contentsWidth)
+{
+    if (!_layouts.isEmpty() && _layouts.first().contentsWidth == contentsWidth && _layouts.first().fontKey == font.key())
+        return;
+
+    const QString fontKey = font.key();
+    for (int i = 1; i < _layouts.count(); i++) {
+        if (_layouts.at(i).contentsWidth == contentsWidth && _layouts.at(i).fontKey == fontKey) {
+            _layouts.move(i, 0);
+            return;
+        }
+    }
+
+    Layout layout;
+    layout.fontKey = fontKey;
+    layout.contentsWidth = contentsWidth;
+    _layouts.prepend(layout);
+    while (_layouts.count() > MAX_LAYOUTS)
+        _layouts.removeLast();
+}
+
+quint64 LineHeightCache::hash(const QString &text) const
+{
+    unsigned char out[crypto_shorthash_BYTES];
+    crypto_shorthash(out, reinterpret_cast<const unsigned char *>(text.constData()), text.size() * sizeof(QChar), _hashKey);
+    quint64 hash;
+    memcpy(&hash, out, sizeof(hash));
+    return hash;
+}
+
+bool LineHeightCache::height(quint64 hash, qreal &height) const
+{
+    if (_layouts.isEmpty())
+        return false;
+
+    QHash<quint64, float>::const_iterator it = _layouts.first().heights.constFind(hash);
+    if (it == _layouts.first().heights.constEnd())
+        return false;
+    height = it.value();
+    return true;
+}
+
+void LineHeightCache::setHeight(quint64 hash, qreal height)
+{
+    if (_layouts.isEmpty())
+        return;
+
+    QHash<quint64, float> &heights = _layouts.first().heights;
+    QHash<quint64, float>::iterator it = heights.find(hash);
+    if (it != heights.end() && it.value() == float(height))
+        return;
+
+    if (it == heights.end() && heights.count() >= MAX_HEIGHTS)
+        heights.clear();
+    heights.insert(hash, height);
+    _writer.schedule();
+}
@@ -0,0 +1,79 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+
+#ifndef LINEHEIGHTCACHE_HPP
+#define LINEHEIGHTCACHE_HPP
+
+#include <QFont>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include "delayedwriter.hpp"
+
+//! Contents heights of chat lines measured in earlier sessions, stored next to the chat's history
+/** Heights are kept for the MAX_LAYOUTS font and contents width combinations used last, each by a
+ *  hash of the text the line shows. A ChatScene opening a long chat takes the heights from here
+ *  instead of waiting for the ChatLineLayouter, so its scene rect and scrollbar are right at once.
+ *  The hashes are keyed with the history key, the file doesn't tell which texts the chat contains.
+ *  Scrolling through a chat measures lines by the thousands, the file is rewritten once that settles.
+ */
+class LineHeightCache : public QObject
+{
+    Q_OBJECT
+public:
+    LineHeightCache(const QString &filePath, const QByteArray &key, QObject *parent = 0);
+    ~LineHeightCache();
+
+    //! Where the heights of the history at basePath are kept, see HistoryStore
+    static QString filePath(const QString &basePath);
+
+    //! Selects the heights of lines laid out with font into contentsWidth
+    void setLayout(const QFont &font, qreal contentsWidth);
+
+    quint64 hash(const QString &text) const;
+    //! False if no line with the text was measured for the current layout
+    bool height(quint64 hash, qreal &height) const;
+    void setHeight(quint64 hash, qreal height);
+
+private slots:
+    void save();
+
+private:
+    void load();
+
+    struct Layout {
+        QString fontKey;
+        qreal contentsWidth;
+        QHash<quint64, float> heights;
+    };
+
+    const QString _filePath;
+    unsigned char _hashKey[16];
+    QList<Layout> _layouts; // the current one first
+    DelayedWriter _writer;
+
+    static const quint32 FILE_VERSION = 1;
+    static const int MAX_LAYOUTS = 3;
+    //! A layout holding more starts over, the lines still around are measured again soon enough
+    static const int MAX_HEIGHTS = 200000;
+    static const int SAVE_DELAY = 30 * 1000;
+    //! Heights are stored in fractions of a pixel, more precise than any layout needs
+    static const int HEIGHT_UNITS = 64;
+};
+
+#endif // LINEHEIGHTCACHE_HPP
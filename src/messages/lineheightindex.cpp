@@ -0,0 +1,104 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "lineheightindex.hpp"
+
+LineHeightIndex::LineHeightIndex() :
+    _dirty(false)
+{
+}
+
+void LineHeightIndex::insert(int row, const QVector<qreal> &heights)
+{
+    _heights.insert(row, heights.count(), 0);
+    for (int i = 0; i < heights.count(); i++)
+        _heights[row + i] = heights.at(i);
+    _dirty = true;
+}
+
+void LineHeightIndex::remove(int row, int count)
+{
+    _heights.remove(row, count);
+    _dirty = true;
+}
+
+void LineHeightIndex::clear()
+{
+    _heights.clear();
+    _tree.clear();
+    _dirty = false;
+}
+
+void LineHeightIndex::setHeight(int row, qreal height)
+{
+    qreal delta = height - _heights.at(row);
+    if (delta == 0)
+        return;
+
+    _heights[row] = height;
+    if (_dirty)
+        return;
+
+    for (int i = row + 1; i < _tree.count(); i += i & -i)
+        _tree[i] += delta;
+}
+
+qreal LineHeightIndex::offset(int row) const
+{
+    if (_dirty)
+        rebuild();
+
+    qreal sum = 0;
+    for (int i = row; i > 0; i -= i & -i)
+        sum += _tree.at(i);
+    return sum;
+}
+
+int LineHeightIndex::rowAt(qreal offset) const
+{
+    if (_dirty)
+        rebuild();
+
+    int n = count();
+    int step = 1;
+    while (step * 2 <= n)
+        step *= 2;
+
+    // descend to the last row whose bottom is still at or above offset
+    int row = 0;
+    for (; step > 0; step /= 2) {
+        if (row + step <= n && _tree.at(row + step) <= offset) {
+            row += step;
+            offset -= _tree.at(row);
+        }
+    }
+    return row;
+}
+
+void LineHeightIndex::rebuild() const
+{
+    int n = count();
+    _tree.resize(n + 1);
+    _tree[0] = 0;
+    for (int i = 1; i <= n; i++)
+        _tree[i] = _heights.at(i - 1);
+    for (int i = 1; i <= n; i++) {
+        int parent = i + (i & -i);
+        if (parent <= n)
+            _tree[parent] += _tree.at(i);
+    }
+    _dirty = false;
+}
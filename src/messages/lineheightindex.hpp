@@ -0,0 +1,56 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef LINEHEIGHTINDEX_HPP
+#define LINEHEIGHTINDEX_HPP
+
+#include <QVector>
+
+/**
+ * Heights of the rows of a ChatScene with their prefix sums in a Fenwick tree, so the
+ * offset of a row and the row at an offset are found in O(log n) and a height change
+ * costs O(log n) instead of moving every line above it.
+ * Inserting and removing rows only touches the plain heights, the tree is rebuilt from
+ * them in a single O(n) pass the next time it is needed.
+ */
+class LineHeightIndex
+{
+public:
+    LineHeightIndex();
+
+    inline int count() const { return _heights.count(); }
+    inline qreal height(int row) const { return _heights.at(row); }
+
+    void insert(int row, const QVector<qreal> &heights);
+    void remove(int row, int count);
+    void clear();
+    void setHeight(int row, qreal height);
+
+    //! The summed height of the rows before row, row may be count()
+    qreal offset(int row) const;
+    inline qreal total() const { return offset(count()); }
+    //! The row covering offset, 0 above the first row and count() below the last one
+    int rowAt(qreal offset) const;
+
+private:
+    void rebuild() const;
+
+    QVector<qreal> _heights;
+    mutable QVector<qreal> _tree; // 1-based, _tree[i] sums the (i & -i) heights ending at row i-1
+    mutable bool _dirty;
+};
+
+#endif // LINEHEIGHTINDEX_HPP
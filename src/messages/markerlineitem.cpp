@@ -21,7 +21,7 @@
 MarkerLineItem::MarkerLineItem(qreal sceneWidth, QGraphicsItem *parent) :
     QGraphicsObject(parent),
     _boundingRect(0, 0, sceneWidth, 1),
-    _chatLine(0)
+    _row(-1)
 {
     setVisible(false);
     setZValue(8);
@@ -36,10 +36,10 @@ void MarkerLineItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *op
     painter->fillRect(boundingRect(), _brush);
 }
 
-void MarkerLineItem::setChatLine(ChatLine *line)
+void MarkerLineItem::setRow(int row)
 {
-    _chatLine = line;
-    if (!line)
+    _row = row;
+    if (row < 0)
         setVisible(false);
 }
 
@@ -31,11 +31,12 @@ public:
     inline QRectF boundingRect() const { return _boundingRect; }
     void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget = 0);
 
-    inline ChatLine *chatLine() const { return _chatLine; }
+    //! Row of the ChatLine this MarkerLineItem is associated to, -1 if none
+    inline int row() const { return _row; }
 
 public slots:
-    //! Set the ChatLine this MarkerLineItem is associated to
-    void setChatLine(ChatLine *line);
+    //! Associates the MarkerLineItem with the ChatLine at row, the scene keeps it up to date as rows come and go
+    void setRow(int row);
     void sceneRectChanged(const QRectF &rect);
 
 private slots:
@@ -44,7 +45,7 @@ private slots:
 private:
     QRectF _boundingRect;
     QBrush _brush;
-    ChatLine *_chatLine;
+    int _row;
 };
 
 #endif // MARKERLINEITEM_HPP
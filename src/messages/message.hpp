@@ -48,6 +48,8 @@ public:
         Highlight = 0x02,
         Redirected = 0x04,
         ServerMsg = 0x08,
+        Pending = 0x10,
+        Unconfirmed = 0x20, // sent, but the receiver didn't confirm it yet
         Backlog = 0x80
     };
     Q_DECLARE_FLAGS(Flags, Flag)
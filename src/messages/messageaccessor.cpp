@@ -0,0 +1,62 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "messageaccessor.hpp"
+#include "contentssnapshot.hpp"
+#include "messagemodel.hpp"
+
+MsgId ItemModelMessageAccessor::msgId(int row) const
+{
+    return data(row, 0, MessageModel::MsgIdRole).value<MsgId>();
+}
+
+Message::Type ItemModelMessageAccessor::msgType(int row) const
+{
+    return (Message::Type)data(row, 0, MessageModel::TypeRole).toInt();
+}
+
+Message::Flags ItemModelMessageAccessor::msgFlags(int row) const
+{
+    return (Message::Flags)data(row, 0, MessageModel::FlagsRole).toInt();
+}
+
+QString ItemModelMessageAccessor::displayText(int row, int column) const
+{
+    return data(row, column, MessageModel::DisplayRole).toString();
+}
+
+QBrush ItemModelMessageAccessor::foreground(int row, int column) const
+{
+    return data(row, column, MessageModel::ForegroundRole).value<QBrush>();
+}
+
+MessageSpansPtr ItemModelMessageAccessor::contentsSpans(int row) const
+{
+    MessageSpansPtr spans = data(row, MessageModel::ContentsColumn, MessageModel::SpansRole).value<MessageSpansPtr>();
+    if (!spans)
+        spans = MessageSpans::fromText(displayText(row, MessageModel::ContentsColumn));
+    return spans;
+}
+
+void ItemModelMessageAccessor::snapshotContents(int row, ContentsSnapshot &snapshot) const
+{
+    snapshot.append(displayText(row, MessageModel::ContentsColumn));
+}
+
+QVariant ItemModelMessageAccessor::data(int row, int column, int role) const
+{
+    return mModel->index(row, column).data(role);
+}
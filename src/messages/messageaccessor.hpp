@@ -0,0 +1,73 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef MESSAGEACCESSOR_HPP
+#define MESSAGEACCESSOR_HPP
+
+#include <QBrush>
+#include "id.hpp"
+#include "message.hpp"
+#include "messagespans.hpp"
+
+class ContentsSnapshot;
+class QAbstractItemModel;
+
+//! Typed access to the rows of a message model
+/** ChatScene and its items read several fields of every visible line on each paint. Through
+ *  QAbstractItemModel::data() every one of them costs a QModelIndex and a QVariant, so the
+ *  models that can, MessageModel and MessageFilter, hand them out as they are. The strings
+ *  are implicitly shared, returning them is a reference count, not a copy.
+ */
+class MessageAccessor
+{
+public:
+    virtual ~MessageAccessor() {}
+
+    virtual MsgId msgId(int row) const = 0;
+    virtual Message::Type msgType(int row) const = 0;
+    virtual Message::Flags msgFlags(int row) const = 0;
+    //! What data() has for MessageModel::DisplayRole of column
+    virtual QString displayText(int row, int column) const = 0;
+    virtual QBrush foreground(int row, int column) const = 0;
+    virtual MessageSpansPtr contentsSpans(int row) const = 0;
+    //! Adds what displayText() has for MessageModel::ContentsColumn to snapshot, for reading it on another thread
+    virtual void snapshotContents(int row, ContentsSnapshot &snapshot) const = 0;
+
+    //! The accessor of model if it has one, 0 otherwise
+    static inline const MessageAccessor *fromModel(const QAbstractItemModel *model) { return dynamic_cast<const MessageAccessor *>(model); }
+};
+
+//! Fallback for models that only have data(), the fields are read through the roles of MessageModel
+class ItemModelMessageAccessor : public MessageAccessor
+{
+public:
+    explicit ItemModelMessageAccessor(const QAbstractItemModel *model) : mModel(model) {}
+
+    MsgId msgId(int row) const;
+    Message::Type msgType(int row) const;
+    Message::Flags msgFlags(int row) const;
+    QString displayText(int row, int column) const;
+    QBrush foreground(int row, int column) const;
+    MessageSpansPtr contentsSpans(int row) const;
+    void snapshotContents(int row, ContentsSnapshot &snapshot) const;
+
+private:
+    QVariant data(int row, int column, int role) const;
+
+    const QAbstractItemModel *mModel;
+};
+
+#endif // MESSAGEACCESSOR_HPP
@@ -0,0 +1,185 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "messagecodec.hpp"
+
+namespace {
+    // zigzag keeps small negative deltas, e.g. of out of order timestamps, short
+    inline quint64 zigzag(qint64 value) { return ((quint64)value << 1) ^ (quint64)(value >> 63); }
+    inline qint64 unzigzag(quint64 value) { return (qint64)(value >> 1) ^ -(qint64)(value & 1); }
+
+    // the types are single bits, so their index fits into TYPE_BITS
+    inline quint32 typeIndex(Message::Type type)
+    {
+        quint32 index = 0;
+        for (quint32 bits = (quint32)type; bits > 1; bits >>= 1)
+            index++;
+        return index;
+    }
+}
+
+bool MessageCodec::isEncoded(const char *data, int size)
+{
+    return size >= HEADER_SIZE && (quint8)data[0] == MAGIC && (quint8)data[1] == VERSION;
+}
+
+QByteArray MessageCodec::encode(const Message &msg, MsgId baseId)
+{
+    QByteArray buffer;
+    MessageEncoder encoder(buffer, baseId);
+    encoder.append(msg);
+    return buffer;
+}
+
+MessageEncoder::MessageEncoder(QByteArray &buffer, MsgId baseId) :
+    _buffer(buffer),
+    _lastId(baseId.toLong()),
+    _lastTimestamp(0),
+    _count(0)
+{
+    _buffer.append((char)MessageCodec::MAGIC);
+    _buffer.append((char)MessageCodec::VERSION);
+}
+
+void MessageEncoder::append(const Message &msg)
+{
+    append(msg.msgId(), msg.timestamp().toMSecsSinceEpoch(), msg.type(), msg.flags(),
+           msg.sender(), msg.contents().constData(), msg.contents().length());
+}
+
+void MessageEncoder::append(MsgId msgId, qint64 timestampMSecs, Message::Type type, Message::Flags flags,
+                            const QString &sender, const QChar *contents, int contentsLength)
+{
+    appendVarint(zigzag(msgId.toLong() - _lastId));
+    appendVarint(zigzag(timestampMSecs - _lastTimestamp));
+    appendVarint(typeIndex(type) | ((quint64)(quint8)flags << MessageCodec::TYPE_BITS));
+    appendString(sender.toUtf8());
+    appendString(QString::fromRawData(contents, contentsLength).toUtf8());
+
+    _lastId = msgId.toLong();
+    _lastTimestamp = timestampMSecs;
+    _count++;
+}
+
+void MessageEncoder::appendVarint(quint64 value)
+{
+    while (value >= 0x80) {
+        _buffer.append((char)(value | 0x80));
+        value >>= 7;
+    }
+    _buffer.append((char)value);
+}
+
+void MessageEncoder::appendString(const QByteArray &utf8)
+{
+    appendVarint(utf8.size());
+    _buffer.append(utf8);
+}
+
+Message MessageDecoder::Record::toMessage() const
+{
+    Message msg(QDateTime::fromMSecsSinceEpoch(timestampMSecs), type, contentsString(), senderString(), flags);
+    msg.setMsgId(msgId);
+    return msg;
+}
+
+MessageDecoder::MessageDecoder(const char *data, int size, MsgId baseId) :
+    _pos(data + MessageCodec::HEADER_SIZE),
+    _end(data + size),
+    _lastId(baseId.toLong()),
+    _lastTimestamp(0),
+    _valid(MessageCodec::isEncoded(data, size))
+{
+    if (!_valid)
+        _pos = _end;
+}
+
+MessageDecoder::MessageDecoder(const QByteArray &buffer, MsgId baseId) :
+    MessageDecoder(buffer.constData(), buffer.size(), baseId)
+{
+}
+
+bool MessageDecoder::next(Record &record)
+{
+    if (_pos == _end)
+        return false;
+
+    quint64 id, timestamp, typeAndFlags;
+    if (!readVarint(id) || !readVarint(timestamp) || !readVarint(typeAndFlags)
+            || !readString(record.sender, record.senderSize) || !readString(record.contents, record.contentsSize)) {
+        _valid = false;
+        _pos = _end;
+        return false;
+    }
+
+    _lastId += unzigzag(id);
+    _lastTimestamp += unzigzag(timestamp);
+    record.msgId = MsgId(_lastId);
+    record.timestampMSecs = _lastTimestamp;
+    record.type = (Message::Type)(1u << (typeAndFlags & ((1 << MessageCodec::TYPE_BITS) - 1)));
+    record.flags = (Message::Flags)(quint8)(typeAndFlags >> MessageCodec::TYPE_BITS);
+    return true;
+}
+
+bool MessageDecoder::readVarint(quint64 &value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64 && _pos != _end; shift += 7) {
+        const quint8 byte = (quint8)*_pos++;
+        value |= (quint64)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+bool MessageDecoder::readString(const char *&data, int &size)
+{
+    quint64 length;
+    if (!readVarint(length) || length > (quint64)(_end - _pos))
+        return false;
+
+    data = _pos;
+    size = (int)length;
+    _pos += length;
+    return true;
+}
+
+int MessageDecoder::countRecords(const QByteArray &buffer)
+{
+    MessageDecoder decoder(buffer);
+    int count = 0;
+    quint64 value;
+    const char *data;
+    int size;
+    while (decoder._pos != decoder._end) {
+        if (!decoder.readVarint(value) || !decoder.readVarint(value) || !decoder.readVarint(value)
+                || !decoder.readString(data, size) || !decoder.readString(data, size))
+            return -1;
+        count++;
+    }
+    return decoder.isValid() ? count : -1;
+}
+
+QList<Message> MessageDecoder::decode(const QByteArray &buffer, MsgId baseId)
+{
+    QList<Message> messages;
+    MessageDecoder decoder(buffer, baseId);
+    Record record;
+    while (decoder.next(record))
+        messages << record.toMessage();
+    return messages;
+}
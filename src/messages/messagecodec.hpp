@@ -0,0 +1,118 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef MESSAGECODEC_HPP
+#define MESSAGECODEC_HPP
+
+#include <QByteArray>
+#include "message.hpp"
+
+//! Compact, versioned binary encoding of messages
+/** Meant for history and scrollback, where the QDataStream operators of Message cost a full
+ *  timestamp, type, flags and two length prefixed strings per message. A buffer starts with
+ *  MAGIC and VERSION and is followed by records of
+ *    varint  msgId, zigzag delta to the previous record (to the base id for the first one)
+ *    varint  timestamp in ms, zigzag delta to the previous record
+ *    varint  bit index of the type | flags << TYPE_BITS
+ *    varint  size of the sender, followed by it in UTF-8
+ *    varint  size of the contents, followed by them in UTF-8
+ *  so consecutive messages of a chat cost a handful of bytes on top of their text.
+ *  MAGIC never starts a QDataStream'ed Message (its msgId is a positive big endian qint64),
+ *  which lets readers tell the two formats apart.
+ */
+namespace MessageCodec {
+    const quint8 MAGIC = 0xce;
+    const quint8 VERSION = 1;
+    const int HEADER_SIZE = 2;
+    const int TYPE_BITS = 5;
+
+    //! Whether data starts with the header of an encoded buffer of a version we can read
+    bool isEncoded(const char *data, int size);
+    inline bool isEncoded(const QByteArray &buffer) { return isEncoded(buffer.constData(), buffer.size()); }
+
+    //! Encodes a single message, relative to baseId, e.g. the id a history index already stores
+    QByteArray encode(const Message &msg, MsgId baseId = MsgId());
+}
+
+//! Appends messages to an encoded buffer
+class MessageEncoder
+{
+public:
+    //! Writes the header to buffer, which should be empty
+    explicit MessageEncoder(QByteArray &buffer, MsgId baseId = MsgId());
+
+    void append(const Message &msg);
+    void append(MsgId msgId, qint64 timestampMSecs, Message::Type type, Message::Flags flags,
+                const QString &sender, const QChar *contents, int contentsLength);
+    inline int count() const { return _count; }
+
+private:
+    void appendVarint(quint64 value);
+    void appendString(const QByteArray &utf8);
+
+    QByteArray &_buffer;
+    qint64 _lastId;
+    qint64 _lastTimestamp;
+    int _count;
+};
+
+//! Walks the records of an encoded buffer without copying anything
+/** The strings of a Record point into the buffer, which has to outlive it. MessageStore inserts
+ *  records straight into its columns, so bulk loads never build a Message at all.
+ */
+class MessageDecoder
+{
+public:
+    struct Record {
+        MsgId msgId;
+        qint64 timestampMSecs;
+        Message::Type type;
+        Message::Flags flags;
+        const char *sender;
+        int senderSize;
+        const char *contents;
+        int contentsSize;
+
+        inline QString senderString() const { return QString::fromUtf8(sender, senderSize); }
+        inline QString contentsString() const { return QString::fromUtf8(contents, contentsSize); }
+        Message toMessage() const;
+    };
+
+    MessageDecoder(const char *data, int size, MsgId baseId = MsgId());
+    explicit MessageDecoder(const QByteArray &buffer, MsgId baseId = MsgId());
+
+    //! False if the header is missing or a record was truncated
+    inline bool isValid() const { return _valid; }
+    //! Decodes the next record, returns false at the end of the buffer or on corrupt data
+    bool next(Record &record);
+
+    //! Number of records in a buffer, -1 if it's corrupt. Cheaper than decoding, the strings are skipped
+    static int countRecords(const QByteArray &buffer);
+    //! Decodes a buffer into messages in one go
+    static QList<Message> decode(const QByteArray &buffer, MsgId baseId = MsgId());
+
+private:
+    bool readVarint(quint64 &value);
+    bool readString(const char *&data, int &size);
+
+    const char *_pos;
+    const char *_end;
+    qint64 _lastId;
+    qint64 _lastTimestamp;
+    bool _valid;
+};
+
+#endif // MESSAGECODEC_HPP
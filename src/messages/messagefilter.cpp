@@ -20,18 +20,57 @@
 
 MessageFilter::MessageFilter(QObject *parent) :
     QSortFilterProxyModel(parent),
+    mMessageModel(0),
     mTypesToHide(0)
 {
 }
 
+void MessageFilter::setSourceModel(QAbstractItemModel *sourceModel)
+{
+    mMessageModel = qobject_cast<MessageModel *>(sourceModel);
+    QSortFilterProxyModel::setSourceModel(sourceModel);
+}
+
+MsgId MessageFilter::msgId(int row) const
+{
+    return mMessageModel->msgId(mapRowToSource(row));
+}
+
+Message::Type MessageFilter::msgType(int row) const
+{
+    return mMessageModel->msgType(mapRowToSource(row));
+}
+
+Message::Flags MessageFilter::msgFlags(int row) const
+{
+    return mMessageModel->msgFlags(mapRowToSource(row));
+}
+
+QString MessageFilter::displayText(int row, int column) const
+{
+    return mMessageModel->displayText(mapRowToSource(row), column);
+}
+
+QBrush MessageFilter::foreground(int row, int column) const
+{
+    return mMessageModel->foreground(mapRowToSource(row), column);
+}
+
+MessageSpansPtr MessageFilter::contentsSpans(int row) const
+{
+    return mMessageModel->contentsSpans(mapRowToSource(row));
+}
+
+void MessageFilter::snapshotContents(int row, ContentsSnapshot &snapshot) const
+{
+    mMessageModel->snapshotContents(mapRowToSource(row), snapshot);
+}
+
 bool MessageFilter::filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const
 {
     Q_UNUSED(sourceParent)
 
-    QModelIndex index = sourceModel()->index(sourceRow, 1);
-    Message::Type messageType = (Message::Type) index.data(MessageModel::TypeRole).toInt();
-
-    return (messageType & mTypesToHide) ? false : true;
+    return (mMessageModel->msgType(sourceRow) & mTypesToHide) ? false : true;
 }
 
 void MessageFilter::filterMessageType(bool hide, Message::Type type)
@@ -39,6 +78,8 @@ void MessageFilter::filterMessageType(bool hide, Message::Type type)
     int old = mTypesToHide;
     mTypesToHide = (hide) ? old | type : old & ~type;
 
-    if(old != mTypesToHide)
+    // a type without rows changes nothing, the others are applied by QSortFilterProxyModel
+    // as row removals and insertions of the affected ranges
+    if(old != mTypesToHide && mMessageModel && mMessageModel->containsTypes(type))
         invalidateFilter();
 }
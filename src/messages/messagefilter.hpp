@@ -19,13 +19,28 @@
 
 #include <QSortFilterProxyModel>
 #include "message.hpp"
+#include "messageaccessor.hpp"
 
-class MessageFilter : public QSortFilterProxyModel
+class MessageModel;
+
+class MessageFilter : public QSortFilterProxyModel, public MessageAccessor
 {
     Q_OBJECT
 public:
     explicit MessageFilter(QObject *parent = 0);
 
+    //! Only MessageModel sources are supported, their rows are filtered by type
+    void setSourceModel(QAbstractItemModel *sourceModel);
+
+    // MessageAccessor, filtered rows are mapped to the source's and read from its packed store
+    MsgId msgId(int row) const;
+    Message::Type msgType(int row) const;
+    Message::Flags msgFlags(int row) const;
+    QString displayText(int row, int column) const;
+    QBrush foreground(int row, int column) const;
+    MessageSpansPtr contentsSpans(int row) const;
+    void snapshotContents(int row, ContentsSnapshot &snapshot) const;
+
 signals:
 
 public slots:
@@ -39,9 +54,11 @@ protected:
     bool filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const;
 
 private:
+    MessageModel *mMessageModel;
     int mTypesToHide;
 
     void filterMessageType(bool hide, Message::Type type);
+    inline int mapRowToSource(int row) const { return mapToSource(index(row, 0)).row(); }
 };
 
 #endif // MESSAGEFILTER_HPP
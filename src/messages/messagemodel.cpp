@@ -17,9 +17,16 @@
 
 #include "messagemodel.hpp"
 #include "messagemodelitem.hpp"
+#include "chatmemoryusage.hpp"
+#include "Settings/settings.hpp"
+#include "memorypressure.hpp"
 
+#include <QCoreApplication>
+#include <QDebug>
 #include <QEvent>
 
+const int MessageModel::MAX_INSERT_GROUP_SIZE;
+
 class ProcessBufferEvent : public QEvent
 {
 public:
@@ -27,7 +34,10 @@ public:
 };
 
 MessageModel::MessageModel(QObject *parent) :
-    QAbstractItemModel(parent)
+    QAbstractItemModel(parent),
+    _lastMsgId(0),
+    _scrollbackLimit(Settings::getInstance().getScrollbackLimit()),
+    _scrollbackTrimmingEnabled(true)
 {
     // Daychange timer
     QDateTime now = QDateTime::currentDateTime();
@@ -38,6 +48,20 @@ MessageModel::MessageModel(QObject *parent) :
     _dayChangeTimer.setInterval(QDateTime::currentDateTime().secsTo(_nextDayChange) * 1000);
     _dayChangeTimer.start();
     connect(&_dayChangeTimer, SIGNAL(timeout()), this, SLOT(changeOfDay()));
+
+    _coldContentsTimer.setSingleShot(true);
+    _coldContentsTimer.setInterval(COLD_CONTENTS_DELAY);
+    connect(&_coldContentsTimer, SIGNAL(timeout()), this, SLOT(updateColdContents()));
+
+    connect(&Settings::getInstance(), &Settings::timestampFormatChanged, this, &MessageModel::onTimestampFormatChanged);
+    connect(&Settings::getInstance(), &Settings::scrollbackLimitChanged, this, &MessageModel::onScrollbackLimitChanged);
+    connect(&Settings::getInstance(), &Settings::smileyPackChanged, this, &MessageModel::onSmileySettingsChanged);
+    connect(&Settings::getInstance(), &Settings::smileyPackUpdated, this, &MessageModel::onSmileyPackUpdated);
+    connect(&Settings::getInstance(), &Settings::emojiFontChanged, this, &MessageModel::onSmileySettingsChanged);
+
+    MemoryPressure::getInstance().registerCache(this, MemoryPressure::ChatLines, [this](MemoryPressure::Level) {
+        shedScrollback();
+    });
 }
 
 QModelIndex MessageModel::index(int row, int column, const QModelIndex &parent) const
@@ -59,7 +83,7 @@ QVariant MessageModel::data(const QModelIndex &index, int role) const
     if (role == ColumnTypeRole)
         return column;
 
-    return messageItemAt(row)->data(index.column(), role);
+    return messageItemAt(row).data(index.column(), role);
 }
 
 bool MessageModel::setData(const QModelIndex &index, const QVariant &value, int role)
@@ -68,20 +92,22 @@ bool MessageModel::setData(const QModelIndex &index, const QVariant &value, int
     if (row < 0 || row >= messageCount())
         return false;
 
-    if (messageItemAt(row)->setData(index.column(), value, role)) {
+    switch (role) {
+    case FlagsRole:
+        _messageStore.setFlags(row, (Message::Flags)value.toUInt());
         emit dataChanged(index, index);
         return true;
+    default:
+        return false;
     }
-    return false;
 }
-/*
 bool MessageModel::insertMessage(const Message &msg)
 {
     MsgId id = msg.msgId();
 
     int idx = indexForId(id);
     if (idx < messageCount()) { // check for duplicate
-        if (messageItemAt(idx)->msgId() == id)
+        if (messageItemAt(idx).msgId() == id)
             return false;
     }
 
@@ -94,52 +120,67 @@ void MessageModel::insertMessages(const QList<Message> &msglist)
     if (msglist.isEmpty())
         return;
 
-    if (_messageBuffer.isEmpty()) {
-        int processedMsgs = insertMessagesGracefully(msglist);
-        int remainingMsgs = msglist.count() - processedMsgs;
-        if (remainingMsgs > 0) {
-            if (msglist.first().msgId() < msglist.last().msgId()) {
-                // in Order - we have just successfully processed "processedMsg" messages from the end of the list
-                _messageBuffer = msglist.mid(0, remainingMsgs);
-            }
-            else {
-                _messageBuffer = msglist.mid(processedMsgs);
-            }
-            qSort(_messageBuffer);
-            QCoreApplication::postEvent(this, new ProcessBufferEvent());
-        }
-    }
-    else {
-        _messageBuffer << msglist;
-        qSort(_messageBuffer);
-    }
+    // everything goes through the buffer, which is drained in groups of at most
+    // MAX_INSERT_GROUP_SIZE messages, one group per event loop iteration
+    bool processing = !_messageBuffer.isEmpty();
+    _messageBuffer << msglist;
+    qSort(_messageBuffer);
+
+    if (!processing)
+        processMessageBuffer();
 }
-*/
-MsgId MessageModel::insertNewMessage(const QString &content, const QString &sender, Message::Type type, Message::Flag flag)
+
+MsgId MessageModel::insertNewMessage(const QString &content, const QString &sender, Message::Type type, Message::Flags flags)
 {
     int idx = messageCount();
     beginInsertRows(QModelIndex(), idx, idx);
     Message msg(type, content, sender);
-    msg.setFlags(flag);
-    msg.setMsgId(QDateTime::currentMSecsSinceEpoch());
+    msg.setFlags(flags);
+    msg.setMsgId(nextMsgId());
     insertMessage__(idx, msg);
     endInsertRows();
 
+    trimScrollback();
+
     return msg.msgId();
 }
 
+MsgId MessageModel::nextMsgId()
+{
+    qint64 id = QDateTime::currentMSecsSinceEpoch() << MSGID_SEQUENCE_BITS;
+
+    // the clock may have been set back, or history with newer ids may have been inserted
+    if (id <= _lastMsgId)
+        id = _lastMsgId + 1;
+    if (!messagesIsEmpty() && id <= _messageStore.msgId(messageCount() - 1).toLong())
+        id = _messageStore.msgId(messageCount() - 1).toLong() + 1;
+
+    _lastMsgId = id;
+    return MsgId(id);
+}
+
 void MessageModel::removeMessage(const MsgId &msgid)
 {
-    for (int i=0; i<_messageList.count(); i++) {
-        if(_messageList.at(i).msgId() == msgid) {
+    for (int i=0; i<_messageStore.count(); i++) {
+        if(_messageStore.msgId(i) == msgid) {
             beginRemoveRows(QModelIndex(), i, i);
-            _messageList.removeAt(i);
+            _messageStore.remove(i);
             endRemoveRows();
             return;
         }
     }
 }
-/*
+bool MessageModel::setMessageFlags(const MsgId &msgid, Message::Flags flags)
+{
+    // Error and day change messages share the msgid of the preceding message, in that case the earliest one is meant,
+    // which is the one indexForId() finds
+    int row = indexForId(msgid);
+    if (row >= _messageStore.count() || _messageStore.msgId(row) != msgid || _messageStore.flags(row) == flags)
+        return false;
+
+    return setData(index(row, ContentsColumn), (int)flags, FlagsRole);
+}
+
 void MessageModel::insertMessageGroup(const QList<Message> &msglist)
 {
     Q_ASSERT(!msglist.isEmpty()); // the msglist can be assumed to be non empty
@@ -153,8 +194,8 @@ void MessageModel::insertMessageGroup(const QList<Message> &msglist)
         // check if the preceeding msg is a daychange message and if so if
         // we have to drop or relocate it at the end of this chunk
         int prevIdx = start - 1;
-        if (messageItemAt(prevIdx)->msgType() == Message::DayChange
-            && messageItemAt(prevIdx)->timestamp() > msglist.at(0).timestamp()) {
+        if (messageItemAt(prevIdx).msgType() == Message::DayChange
+            && messageItemAt(prevIdx).timestamp() > msglist.at(0).timestamp()) {
             beginRemoveRows(QModelIndex(), prevIdx, prevIdx);
             Message oldDayChangeMsg = takeMessageAt(prevIdx);
             if (msglist.last().timestamp() < oldDayChangeMsg.timestamp()) {
@@ -175,8 +216,8 @@ void MessageModel::insertMessageGroup(const QList<Message> &msglist)
 
         // if this assert triggers then indexForId() would have found a spot right before a DayChangeMsg
         // this should never happen as daychange messages share the msgId with the preceeding message
-        Q_ASSERT(messageItemAt(start)->msgType() != Message::DayChange);
-        QDateTime nextTs = messageItemAt(start)->timestamp();
+        Q_ASSERT(messageItemAt(start).msgType() != Message::DayChange);
+        QDateTime nextTs = messageItemAt(start).timestamp();
         QDateTime prevTs = msglist.last().timestamp();
         nextTs.setTimeSpec(Qt::UTC);
         prevTs.setTimeSpec(Qt::UTC);
@@ -193,17 +234,17 @@ void MessageModel::insertMessageGroup(const QList<Message> &msglist)
     if (dayChangeMsg.isValid())
         end++;
 
-    Q_ASSERT(start == 0 || messageItemAt(start - 1)->msgId() < msglist.first().msgId());
-    Q_ASSERT(start == messageCount() || messageItemAt(start)->msgId() > msglist.last().msgId());
+    Q_ASSERT(start == 0 || messageItemAt(start - 1).msgId() < msglist.first().msgId());
+    Q_ASSERT(start == messageCount() || messageItemAt(start).msgId() > msglist.last().msgId());
     beginInsertRows(QModelIndex(), start, end);
     insertMessages__(start, msglist);
     if (dayChangeMsg.isValid())
         insertMessage__(start + msglist.count(), dayChangeMsg);
     endInsertRows();
 
-    Q_ASSERT(start == end || messageItemAt(start)->msgId() != messageItemAt(end)->msgId() || messageItemAt(end)->msgType() == Message::DayChange);
-    Q_ASSERT(start == 0 || messageItemAt(start - 1)->msgId() < messageItemAt(start)->msgId());
-    Q_ASSERT(end + 1 == messageCount() || messageItemAt(end)->msgId() < messageItemAt(end + 1)->msgId());
+    Q_ASSERT(start == end || messageItemAt(start).msgId() != messageItemAt(end).msgId() || messageItemAt(end).msgType() == Message::DayChange);
+    Q_ASSERT(start == 0 || messageItemAt(start - 1).msgId() < messageItemAt(start).msgId());
+    Q_ASSERT(end + 1 == messageCount() || messageItemAt(end).msgId() < messageItemAt(end + 1).msgId());
 }
 
 int MessageModel::insertMessagesGracefully(const QList<Message> &msglist)
@@ -235,12 +276,12 @@ int MessageModel::insertMessagesGracefully(const QList<Message> &msglist)
 
     idx = indexForId((*iter).msgId());
     if (idx < messageCount())
-        dupeId = messageItemAt(idx)->msgId();
+        dupeId = messageItemAt(idx).msgId();
 
     // we always compare to the previous entry...
     // if there isn't, we can fastforward to the top
     if (idx - 1 >= 0)
-        minId = messageItemAt(idx - 1)->msgId();
+        minId = messageItemAt(idx - 1).msgId();
     else
         fastForward = true;
 
@@ -263,7 +304,7 @@ int MessageModel::insertMessagesGracefully(const QList<Message> &msglist)
             if (grouplist.isEmpty()) { // as long as we don't have a starting point, we have to update the dupeId
                 idx = indexForId((*iter).msgId());
                 if (idx >= 0 && !messagesIsEmpty())
-                    dupeId = messageItemAt(idx)->msgId();
+                    dupeId = messageItemAt(idx).msgId();
             }
             if ((*iter).msgId() != dupeId) {
                 if (!grouplist.isEmpty()) {
@@ -295,7 +336,7 @@ int MessageModel::insertMessagesGracefully(const QList<Message> &msglist)
             if (grouplist.isEmpty()) { // as long as we don't have a starting point, we have to update the dupeId
                 idx = indexForId((*iter).msgId());
                 if (idx >= 0 && !messagesIsEmpty())
-                    dupeId = messageItemAt(idx)->msgId();
+                    dupeId = messageItemAt(idx).msgId();
             }
             if ((*iter).msgId() != dupeId) {
                 if (!grouplist.isEmpty()) {
@@ -331,36 +372,53 @@ void MessageModel::customEvent(QEvent *event)
         return;
 
     event->accept();
+    processMessageBuffer();
+}
 
+void MessageModel::processMessageBuffer()
+{
     if (_messageBuffer.isEmpty())
         return;
 
-    int processedMsgs = insertMessagesGracefully(_messageBuffer);
-    int remainingMsgs = _messageBuffer.count() - processedMsgs;
+    // the buffer is sorted, take the newest messages first so that every
+    // group lands right before the previously inserted one
+    int groupStart = qMax(0, _messageBuffer.count() - MAX_INSERT_GROUP_SIZE);
+    int processedMsgs = insertMessagesGracefully(_messageBuffer.mid(groupStart));
 
-    QList<Message>::iterator removeStart = _messageBuffer.begin() + remainingMsgs;
+    QList<Message>::iterator removeStart = _messageBuffer.end() - processedMsgs;
     QList<Message>::iterator removeEnd = _messageBuffer.end();
     _messageBuffer.erase(removeStart, removeEnd);
     if (!_messageBuffer.isEmpty())
         QCoreApplication::postEvent(this, new ProcessBufferEvent());
 }
-*/
+
 void MessageModel::clear()
 {
+    _messageBuffer.clear();
+    _scrollback.clear();
     if (rowCount() > 0) {
         beginRemoveRows(QModelIndex(), 0, rowCount() - 1);
-        _messageList.clear();
+        _messageStore.clear();
         endRemoveRows();
     }
 }
-/*
+
+void MessageModel::addMemoryUsage(ChatMemoryUsage &usage) const
+{
+    _messageStore.addMemoryUsage(usage);
+
+    // evicted rows are on disk, only the buffer of incoming ones is in memory
+    for (const Message &msg : _messageBuffer)
+        usage.modelBytes += sizeof(Message) + ChatMemoryUsage::stringBytes(msg.contents()) + ChatMemoryUsage::stringBytes(msg.sender());
+}
+
 // returns index of msg with given Id or of the next message after that (i.e., the index where we'd insert this msg)
 int MessageModel::indexForId(MsgId id)
 {
-    if (messagesIsEmpty() || id <= messageItemAt(0)->msgId())
+    if (messagesIsEmpty() || id <= _messageStore.msgId(0))
         return 0;
 
-    if (id > lastMessageItem()->msgId())
+    if (id > _messageStore.msgId(messageCount() - 1))
         return messageCount();
 
     // binary search
@@ -369,53 +427,188 @@ int MessageModel::indexForId(MsgId id)
         if (end - start == 1)
             return end;
         int pivot = (end + start) / 2;
-        if (id <= messageItemAt(pivot)->msgId()) end = pivot;
+        if (id <= _messageStore.msgId(pivot)) end = pivot;
         else start = pivot;
     }
 }
-*/
+
 void MessageModel::changeOfDay()
 {
     _dayChangeTimer.setInterval(86400000);
     if (!messagesIsEmpty()) {
         int idx = messageCount();
-        while (idx > 0 && messageItemAt(idx - 1)->timestamp() > _nextDayChange) {
+        const qint64 nextDayChange = _nextDayChange.toMSecsSinceEpoch();
+        while (idx > 0 && _messageStore.timestampMSecs(idx - 1) > nextDayChange) {
             idx--;
         }
         beginInsertRows(QModelIndex(), idx, idx);
         Message dayChangeMsg = Message::changeOfDay(_nextDayChange);
-        dayChangeMsg.setMsgId(messageItemAt(idx - 1)->msgId());
+        dayChangeMsg.setMsgId(_messageStore.msgId(idx - 1));
         insertMessage__(idx, dayChangeMsg);
         endInsertRows();
     }
     _nextDayChange = _nextDayChange.addSecs(86400);
 }
 
+bool MessageModel::canFetchMore(const QModelIndex &parent) const
+{
+    return !parent.isValid() && !_scrollback.isEmpty();
+}
+
+void MessageModel::fetchMore(const QModelIndex &parent)
+{
+    if (parent.isValid())
+        return;
+
+    // the records go straight into the store, no Message is built on the way
+    int row = 0;
+    const QList<QByteArray> buffers = _scrollback.pop(SCROLLBACK_FETCH_SIZE);
+    for (const QByteArray &buffer : buffers) {
+        const int count = MessageDecoder::countRecords(buffer);
+        if (count <= 0) {
+            qWarning() << "MessageModel: dropping unreadable scrollback";
+            continue;
+        }
+
+        MessageDecoder decoder(buffer);
+        beginInsertRows(QModelIndex(), row, row + count - 1);
+        _messageStore.insert(row, decoder, count);
+        endInsertRows();
+        row += count;
+    }
+}
+
+void MessageModel::setScrollbackTrimmingEnabled(bool enabled)
+{
+    _scrollbackTrimmingEnabled = enabled;
+    trimScrollback();
+}
+
+void MessageModel::trimScrollback()
+{
+    if (!_scrollbackTrimmingEnabled || _scrollbackLimit <= 0 || messageCount() <= _scrollbackLimit + SCROLLBACK_SLACK)
+        return;
+
+    const int count = messageCount() - _scrollbackLimit;
+
+    // better keep everything in memory than lose history
+    if (!_scrollback.push(_messageStore, 0, count))
+        return;
+
+    beginRemoveRows(QModelIndex(), 0, count - 1);
+    _messageStore.remove(0, count);
+    endRemoveRows();
+}
+
+void MessageModel::shedScrollback()
+{
+    // like trimScrollback(), but down to the last screenfuls whatever the limit is
+    if (!_scrollbackTrimmingEnabled || messageCount() <= PRESSURE_SCROLLBACK)
+        return;
+
+    const int count = messageCount() - PRESSURE_SCROLLBACK;
+    if (!_scrollback.push(_messageStore, 0, count))
+        return;
+
+    beginRemoveRows(QModelIndex(), 0, count - 1);
+    _messageStore.remove(0, count);
+    endRemoveRows();
+
+    // the parsed spans of the others go too, they're parsed again when they're shown
+    _messageStore.clearContentsSpans();
+}
+
+void MessageModel::setViewportRows(int first, int last)
+{
+    if (first < 0 || last < first || last >= messageCount())
+        return;
+
+    _viewportFirst = _messageStore.msgId(first);
+    _viewportLast = _messageStore.msgId(last);
+    if (!_coldContentsTimer.isActive())
+        _coldContentsTimer.start();
+}
+
+void MessageModel::updateColdContents()
+{
+    if (messagesIsEmpty() || !_viewportLast.isValid())
+        return;
+
+    const int distance = Settings::getInstance().getColdContentsDistance();
+    if (distance <= 0) {
+        _messageStore.thaw(0, messageCount() - 1);
+        return;
+    }
+
+    const int first = qMax(indexForId(_viewportFirst) - distance, 0);
+    const int last = qMin(indexForId(_viewportLast) + distance, messageCount() - 1);
+    _messageStore.freeze(0, first - 1);
+    _messageStore.freeze(last + 1, messageCount() - 1);
+    _messageStore.thaw(first, last);
+}
+
+void MessageModel::onScrollbackLimitChanged()
+{
+    _scrollbackLimit = Settings::getInstance().getScrollbackLimit();
+    trimScrollback();
+}
+
+void MessageModel::onTimestampFormatChanged()
+{
+    _messageStore.clearTimestampTexts();
+}
+
+void MessageModel::onSmileySettingsChanged()
+{
+    // smileys are part of the parsed contents
+    _messageStore.clearContentsSpans();
+}
+
+void MessageModel::onSmileyPackUpdated(const QStringList &changedTexts)
+{
+    // rows that weren't parsed yet get the new pack anyway, the others only if they contain a changed smiley
+    int first = -1;
+    for (int row = 0; row <= messageCount(); row++) {
+        bool affected = false;
+        if (row < messageCount() && _messageStore.contentsSpans(row)) {
+            const QString contents = _messageStore.contents(row);
+            foreach (const QString &text, changedTexts) {
+                if (contents.contains(text)) {
+                    affected = true;
+                    break;
+                }
+            }
+        }
+
+        if (affected) {
+            _messageStore.contentsSpans(row).clear();
+            if (first < 0)
+                first = row;
+        } else if (first >= 0) {
+            // the scene re-renders every line of a run
+            emit dataChanged(index(first, 0), index(row - 1, TimestampColumn));
+            first = -1;
+        }
+    }
+}
+
 void MessageModel::insertErrorMessage(const QString &errorString)
 {
     int idx = messageCount();
     beginInsertRows(QModelIndex(), idx, idx);
     Message msg(Message::Error, errorString);
     if (!messagesIsEmpty())
-        msg.setMsgId(messageItemAt(idx-1)->msgId());
+        msg.setMsgId(_messageStore.msgId(idx-1));
     else
         msg.setMsgId(0);
     insertMessage__(idx, msg);
     endInsertRows();
-}
-/*
-void MessageModel::insertMessages__(int pos, const QList<Message> &messages)
-{
-    for (int i = 0; i < messages.count(); i++) {
-        _messageList.insert(pos, MessageModelItem(messages[i]));
-        pos++;
-    }
-}
 
+    trimScrollback();
+}
 Message MessageModel::takeMessageAt(int i)
 {
-    Message msg = _messageList[i].message();
-    _messageList.removeAt(i);
+    Message msg = _messageStore.message(i);
+    _messageStore.remove(i);
     return msg;
 }
-*/
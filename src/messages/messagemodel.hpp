@@ -22,9 +22,14 @@
 #include <QTimer>
 #include "id.hpp"
 #include "message.hpp"
+#include "messageaccessor.hpp"
 #include "messagemodelitem.hpp"
+#include "messagestore.hpp"
+#include "scrollbackstore.hpp"
 
-class MessageModel : public QAbstractItemModel
+struct ChatMemoryUsage;
+
+class MessageModel : public QAbstractItemModel, public MessageAccessor
 {
     Q_OBJECT
 public:
@@ -39,7 +44,8 @@ public:
         TimestampRole,
         ColumnTypeRole,
         UserRole,
-        MsgLabelRole
+        MsgLabelRole,
+        SpansRole // the contents parsed into a MessageSpansPtr
         };
 
     enum ColumnType {
@@ -58,49 +64,119 @@ public:
     virtual QVariant data(const QModelIndex &index, int role) const;
     virtual bool setData(const QModelIndex &index, const QVariant &value, int role);
 
-    //bool insertMessage(const Message &);
-    //void insertMessages(const QList<Message> &);
-    MsgId insertNewMessage(const QString& content, const QString& sender, Message::Type type, Message::Flag flag = Message::None);
+    // messages evicted by the scrollback limit are fetched back from disk
+    virtual bool canFetchMore(const QModelIndex &parent) const;
+    virtual void fetchMore(const QModelIndex &parent);
+
+    bool insertMessage(const Message &);
+    //! Inserts a list of existing messages, e.g. history, ordered or not.
+    /** The messages are inserted in contiguous groups spread over several event loop iterations,
+     *  messages whose msgId is already in the model are dropped.
+     */
+    void insertMessages(const QList<Message> &);
+    MsgId insertNewMessage(const QString& content, const QString& sender, Message::Type type, Message::Flags flags = Message::None);
     void removeMessage(const MsgId &msgid);
+    bool setMessageFlags(const MsgId &msgid, Message::Flags flags);
+
+    inline MessageModelItem messageItemAt(int i) const { return MessageModelItem(&_messageStore, i); }
+    inline bool containsTypes(int types) const { return _messageStore.containsTypes(types); }
 
-    inline const MessageModelItem *messageItemAt(int i) const { return &_messageList[i]; }
+    // MessageAccessor, the rows are read from the packed store without going through data()
+    inline MsgId msgId(int row) const { return _messageStore.msgId(row); }
+    inline Message::Type msgType(int row) const { return _messageStore.type(row); }
+    inline Message::Flags msgFlags(int row) const { return _messageStore.flags(row); }
+    inline QString displayText(int row, int column) const { return messageItemAt(row).displayText(column); }
+    inline QBrush foreground(int row, int column) const { return messageItemAt(row).foreground(column); }
+    inline MessageSpansPtr contentsSpans(int row) const { return messageItemAt(row).contentsSpans(); }
+    inline void snapshotContents(int row, ContentsSnapshot &snapshot) const { messageItemAt(row).addContentsTo(snapshot); }
 
     void clear();
 
+    //! Adds the rows held in memory, including those waiting to be inserted, to usage
+    void addMemoryUsage(ChatMemoryUsage &usage) const;
+
+    //! Low bits of a msgId below the time in ms, see nextMsgId()
+    static const int MSGID_SEQUENCE_BITS = 16;
+
 signals:
 
 public slots:
     void insertErrorMessage(const QString &errorString);
 
+    //! Allows or prevents evicting old messages to disk.
+    /** The view turns this off while the user is reading older messages, so that
+     *  lines don't disappear under them, and on again once it is back at the bottom.
+     */
+    void setScrollbackTrimmingEnabled(bool enabled);
+
+    //! Tells the model which rows are in view, the contents of rows far from them are compressed
+    /** Applied a moment later, so scrolling doesn't compress and decompress rows all the time.
+     *  See Settings::getColdContentsDistance() and MessageStore::freeze(). */
+    void setViewportRows(int first, int last);
+
 protected:
-    inline int messageCount() const { return _messageList.count(); }
-    inline bool messagesIsEmpty() const { return _messageList.isEmpty(); }
-    inline MessageModelItem *messageItemAt(int i) { return &_messageList[i]; }
+    inline int messageCount() const { return _messageStore.count(); }
+    inline bool messagesIsEmpty() const { return _messageStore.isEmpty(); }
     //inline const MessageModelItem *firstMessageItem() const { return &_messageList.first(); }
     //inline MessageModelItem *firstMessageItem() { return &_messageList.first(); }
     //inline const MessageModelItem *lastMessageItem() const { return &_messageList.last(); }
     //inline MessageModelItem *lastMessageItem() { return &_messageList.last(); }
-    inline void insertMessage__(int pos, const Message &msg) { _messageList.insert(pos, MessageModelItem(msg)); }
-    //void insertMessages__(int pos, const QList<Message> &messages);
+    inline void insertMessage__(int pos, const Message &msg) { _messageStore.insert(pos, msg); }
+    inline void insertMessages__(int pos, const QList<Message> &messages) { _messageStore.insert(pos, messages); }
     //inline void removeMessageAt(int i) { _messageList.removeAt(i); }
     //inline void removeAllMessages() { _messageList.clear(); }
-    //Message takeMessageAt(int i);
+    Message takeMessageAt(int i);
 
-    //void customEvent(QEvent *event);
+    void customEvent(QEvent *event);
 
 private slots:
     void changeOfDay();
+    void onTimestampFormatChanged();
+    void onSmileySettingsChanged();
+    void onSmileyPackUpdated(const QStringList &changedTexts);
+    void onScrollbackLimitChanged();
+    void updateColdContents();
 
 private:
-    //void insertMessageGroup(const QList<Message> &);
-    //int insertMessagesGracefully(const QList<Message> &); // inserts as many contiguous msgs as possible. returns numer of inserted msgs.
-    //int indexForId(MsgId);
+    void insertMessageGroup(const QList<Message> &);
+    int insertMessagesGracefully(const QList<Message> &); // inserts as many contiguous msgs as possible. returns numer of inserted msgs.
+    void processMessageBuffer();
+    int indexForId(MsgId);
+
+    //! Returns a msgId larger than every msgId handed out or stored so far.
+    /** The current time in ms makes up the high bits, the low MSGID_SEQUENCE_BITS are
+     *  a counter for messages created within the same millisecond.
+     */
+    MsgId nextMsgId();
+    qint64 _lastMsgId;
+
+    void trimScrollback();
+    //! Memory is short, see MemoryPressure
+    void shedScrollback();
+    ScrollbackStore _scrollback;
+    int _scrollbackLimit;
+    bool _scrollbackTrimmingEnabled;
+
+    // rows over the limit before a trim is done, so that we evict in chunks rather than line by line
+    static const int SCROLLBACK_SLACK = 100;
+    static const int SCROLLBACK_FETCH_SIZE = 200;
+    // rows kept when memory is short
+    static const int PRESSURE_SCROLLBACK = 200;
+
+    // the rows in view, by msgId, as rows move when the scrollback is trimmed or fetched
+    MsgId _viewportFirst;
+    MsgId _viewportLast;
+    QTimer _coldContentsTimer;
+    static const int COLD_CONTENTS_DELAY = 2000;
+
+    // upper bound for the rows added by a single beginInsertRows()/endInsertRows() while draining _messageBuffer
+    static const int MAX_INSERT_GROUP_SIZE = 500;
 
     QList<Message> _messageBuffer;
     QTimer _dayChangeTimer;
     QDateTime _nextDayChange;
 
-    QList<MessageModelItem> _messageList;
+    MessageStore _messageStore;
 
 };
 
@@ -21,9 +21,14 @@
 
 #include <QApplication>
 
-MessageModelItem::MessageModelItem(const Message &msg) :
-    mMsg(msg)
-{
+namespace {
+// Message::Type values are never 0 or negative, so these are free to key the palette's brushes
+const int MidForeground = 0;
+// halfway between the text and mid brushes
+const int UnconfirmedForeground = -1;
+
+QHash<int, QBrush> foregroundCache;
+qint64 foregroundPaletteKey = 0;
 }
 
 QVariant MessageModelItem::data(int column, int role) const
@@ -67,34 +72,65 @@ QVariant MessageModelItem::data(int column, int role) const
     }
 }
 
-bool MessageModelItem::setData(int column, const QVariant &value, int role)
+// Stuff for later
+bool MessageModelItem::lessThan(const MessageModelItem *m1, const MessageModelItem *m2)
 {
-    Q_UNUSED(column);
+    return (*m1) < (*m2);
+}
 
-    switch (role) {
-    case MessageModel::FlagsRole:
-        mMsg.setFlags((Message::Flags)value.toUInt());
-        return true;
+QString MessageModelItem::displayText(int column) const
+{
+    switch (column) {
+    case MessageModel::TimestampColumn:
+        return timestampText();
+    case MessageModel::SenderColumn:
+        return senderText();
+    case MessageModel::ContentsColumn:
+        return contentsText();
     default:
-        return false;
+        return QString();
     }
 }
 
-// Stuff for later
-bool MessageModelItem::lessThan(const MessageModelItem *m1, const MessageModelItem *m2)
+QBrush MessageModelItem::foreground(int column) const
 {
-    return (*m1) < (*m2);
+    switch (column) {
+    case MessageModel::TimestampColumn:
+        return cachedForeground(MidForeground);
+    case MessageModel::SenderColumn:
+        if((msgType() == Message::Plain) && (msgFlags().testFlag(Message::Self)))
+            return cachedForeground(MidForeground);
+        else
+            return cachedForeground(msgType());
+    case MessageModel::ContentsColumn:
+        if (msgFlags().testFlag(Message::Pending))
+            return cachedForeground(MidForeground);
+        else if (msgFlags().testFlag(Message::Unconfirmed))
+            return cachedForeground(UnconfirmedForeground);
+        else
+            return cachedForeground(msgType());
+    default:
+        return QBrush();
+    }
+}
+
+MessageSpansPtr MessageModelItem::contentsSpans() const
+{
+    MessageSpansPtr &spans = mStore->contentsSpans(mRow);
+    if (!spans)
+        spans = MessageSpans::fromText(contentsText());
+    return spans;
 }
 
 QVariant MessageModelItem::timestampData(int role) const
 {
     switch (role) {
     case MessageModel::DisplayRole:
-        return mMsg.timestamp().toLocalTime().toString(Settings::getInstance().getTimestampFormat());
+        return timestampText();
     case MessageModel::EditRole:
-        return mMsg.timestamp();
+        return timestamp();
     case MessageModel::ForegroundRole:
-        return QVariant::fromValue<QBrush>(QApplication::palette().mid());
+        return QVariant::fromValue<QBrush>(foreground(MessageModel::TimestampColumn));
     }
     return QVariant();
 }
@@ -103,35 +139,11 @@ QVariant MessageModelItem::senderData(int role) const
 {
     switch (role) {
     case MessageModel::DisplayRole:
-        switch (mMsg.type()) {
-        case Message::Plain:
-            return mMsg.sender();
-        case Message::Action:
-            return "*";
-        case Message::Nick:
-            return "<->";
-        case Message::Join:
-            return "-->";
-        case Message::Quit:
-            return "<--";
-        case Message::Info:
-            return "-i-";
-        case Message::Error:
-            return "-!-";
-        case Message::DayChange:
-            return "---";
-        case Message::Invite:
-            return "->";
-        default:
-            return mMsg.sender();
-        }
+        return senderText();
     case MessageModel::EditRole:
-        return mMsg.sender();
+        return mStore->sender(mRow);
     case MessageModel::ForegroundRole:
-        if((mMsg.type() == Message::Plain) && (mMsg.flags().testFlag(Message::Self)))
-            return QVariant::fromValue<QBrush>(QApplication::palette().mid());
-        else
-            return QVariant::fromValue<QBrush>(foreground(mMsg.type()));
+        return QVariant::fromValue<QBrush>(foreground(MessageModel::SenderColumn));
     }
     return QVariant();
 }
@@ -141,37 +153,135 @@ QVariant MessageModelItem::contentsData(int role) const
     switch (role) {
     case MessageModel::DisplayRole:
     case MessageModel::EditRole:
-        switch (mMsg.type()) {
-        case Message::Plain:
-            return mMsg.contents();
-        case Message::Action:
-            return QString("%1 %2").arg(mMsg.sender(), mMsg.contents());
-        case Message::Nick:
-            if (mMsg.flags().testFlag(Message::Self))
-                return tr("You are now known as %1").arg(mMsg.contents());
-            else
-                return tr("%1 is now known as %2").arg(mMsg.sender(), mMsg.contents());
-        case Message::Join:
-            return tr("%1 has joined.").arg(mMsg.sender());
-        case Message::Quit:
-            return tr("%1 has gone.").arg(mMsg.sender());
-        case Message::Info:
-            return mMsg.contents();
-        case Message::Error:
-            return tr("Couldn't send the message \"%1\"!").arg(mMsg.contents());
-        case Message::DayChange:
-            return tr("{Day changed to %1}").arg(mMsg.timestamp().date().toString(Qt::DefaultLocaleLongDate));
-        case Message::Invite:
-        default:
-            return mMsg.contents();
-        }
+        return contentsText();
+    case MessageModel::SpansRole:
+        return QVariant::fromValue<MessageSpansPtr>(contentsSpans());
     case MessageModel::ForegroundRole:
-        return QVariant::fromValue<QBrush>(foreground(mMsg.type()));
+        return QVariant::fromValue<QBrush>(foreground(MessageModel::ContentsColumn));
     }
     return QVariant();
 }
 
-QBrush MessageModelItem::foreground(Message::Type type) const
+QString MessageModelItem::timestampText() const
+{
+    QString &text = mStore->timestampText(mRow);
+    if (text.isNull())
+        text = timestamp().toLocalTime().toString(Settings::getInstance().snapshot()->timestampFormat);
+    return text;
+}
+
+QString MessageModelItem::senderText() const
+{
+    switch (msgType()) {
+    case Message::Plain:
+        return mStore->sender(mRow);
+    case Message::Action:
+        return "*";
+    case Message::Nick:
+        return "<->";
+    case Message::Join:
+        return "-->";
+    case Message::Quit:
+        return "<--";
+    case Message::Info:
+        return "-i-";
+    case Message::Error:
+        return "-!-";
+    case Message::DayChange:
+        return "---";
+    case Message::Invite:
+        return "->";
+    default:
+        return mStore->sender(mRow);
+    }
+}
+
+QString MessageModelItem::contentsText() const
+{
+    switch (msgType()) {
+    case Message::Plain:
+    case Message::Info:
+    case Message::Invite:
+        return mStore->contents(mRow);
+    default: {
+        // only the translated lines are worth keeping around
+        QString &text = mStore->contentsText(mRow);
+        if (text.isNull())
+            text = formatContents();
+        return text;
+    }
+    }
+}
+
+void MessageModelItem::addContentsTo(ContentsSnapshot &snapshot) const
+{
+    // the same cases as contentsText()
+    switch (msgType()) {
+    case Message::Plain:
+    case Message::Info:
+    case Message::Invite:
+        mStore->addContents(snapshot, mRow);
+        break;
+    default:
+        snapshot.append(contentsText());
+        break;
+    }
+}
+
+QString MessageModelItem::formatContents() const
+{
+    switch (msgType()) {
+    case Message::Action:
+        return QString("%1 %2").arg(mStore->sender(mRow), mStore->contents(mRow));
+    case Message::Nick:
+        if (msgFlags().testFlag(Message::Self))
+            return tr("You are now known as %1").arg(mStore->contents(mRow));
+        else
+            return tr("%1 is now known as %2").arg(mStore->sender(mRow), mStore->contents(mRow));
+    // group chats summarize several peers in the contents
+    case Message::Join:
+        if (!mStore->contents(mRow).isEmpty())
+            return mStore->contents(mRow);
+        return tr("%1 has joined.").arg(mStore->sender(mRow));
+    case Message::Quit:
+        if (!mStore->contents(mRow).isEmpty())
+            return mStore->contents(mRow);
+        return tr("%1 has gone.").arg(mStore->sender(mRow));
+    case Message::Error:
+        return tr("Couldn't send the message \"%1\"!").arg(mStore->contents(mRow));
+    case Message::DayChange:
+        return tr("{Day changed to %1}").arg(timestamp().date().toString(Qt::DefaultLocaleLongDate));
+    default:
+        return mStore->contents(mRow);
+    }
+}
+
+QBrush MessageModelItem::cachedForeground(int key) const
+{
+    const qint64 paletteKey = QApplication::palette().cacheKey();
+    if (paletteKey != foregroundPaletteKey) {
+        foregroundCache.clear();
+        foregroundPaletteKey = paletteKey;
+    }
+
+    QHash<int, QBrush>::const_iterator it = foregroundCache.constFind(key);
+    if (it != foregroundCache.constEnd())
+        return it.value();
+
+    QBrush brush;
+    if (key == MidForeground)
+        brush = QApplication::palette().mid();
+    else if (key == UnconfirmedForeground) {
+        QColor text = QApplication::palette().text().color();
+        QColor mid = QApplication::palette().mid().color();
+        brush = QColor((text.red() + mid.red()) / 2, (text.green() + mid.green()) / 2, (text.blue() + mid.blue()) / 2);
+    }
+    else
+        brush = typeForeground((Message::Type)key);
+    return foregroundCache.insert(key, brush).value();
+}
+
+QBrush MessageModelItem::typeForeground(Message::Type type) const
 {
     switch (type) {
     case Message::Plain:
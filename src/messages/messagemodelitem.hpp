@@ -19,28 +19,36 @@
 #define MESSAGEMODELITEM_HPP
 
 #include "message.hpp"
+#include "messagestore.hpp"
+#include <QBrush>
 #include <QObject>
 
 class MessageModelItem
 {
     Q_DECLARE_TR_FUNCTIONS(MessageModelItem)
 public:
-    //! Creates a MessageModelItem from a Message object.
-    /** This baseclass implementation takes care of all Message data *except* the stylable strings.
-     *  Subclasses need to provide Qt::DisplayRole at least, which should describe the plaintext
-     *  strings without formattings (e.g. for searching purposes).
+    //! Creates a MessageModelItem for a row of a MessageStore.
+    /** The item is a lightweight view, it doesn't own any message data and is only valid
+     *  as long as the row isn't moved or removed.
      */
-    MessageModelItem(const Message &msg);
-    inline virtual ~MessageModelItem() {}
+    inline MessageModelItem(const MessageStore *store, int row) : mStore(store), mRow(row) {}
 
     QVariant data(int column, int role) const;
-    bool setData(int column, const QVariant &value, int role);
 
-    inline const Message &message() const { return mMsg; }
-    inline const QDateTime &timestamp() const { return mMsg.timestamp(); }
-    inline const MsgId &msgId() const { return mMsg.msgId(); }
-    inline Message::Type msgType() const { return mMsg.type(); }
-    inline Message::Flags msgFlags() const { return mMsg.flags(); }
+    inline Message message() const { return mStore->message(mRow); }
+    inline QDateTime timestamp() const { return mStore->timestamp(mRow); }
+    inline MsgId msgId() const { return mStore->msgId(mRow); }
+    inline Message::Type msgType() const { return mStore->type(mRow); }
+    inline Message::Flags msgFlags() const { return mStore->flags(mRow); }
+
+    // the fields data() boxes into QVariants, for callers that can take them as they are
+    //! What data() has for DisplayRole of column
+    QString displayText(int column) const;
+    QBrush foreground(int column) const;
+    //! The contents parsed into spans, cached in the store
+    MessageSpansPtr contentsSpans() const;
+    //! Adds the display text of the contents to snapshot, untouched contents by reference into the store
+    void addContentsTo(ContentsSnapshot &snapshot) const;
 
     // For sorting
     bool operator<(const MessageModelItem &) const;
@@ -53,9 +61,17 @@ private:
     QVariant senderData(int role) const;
     QVariant contentsData(int role) const;
 
-    QBrush foreground(Message::Type type) const;
+    QString timestampText() const;
+    QString senderText() const;
+    QString contentsText() const;
+    QString formatContents() const;
+
+    // brushes only depend on the palette, so they are shared by all items
+    QBrush cachedForeground(int key) const;
+    QBrush typeForeground(Message::Type type) const;
 
-    Message mMsg;
+    const MessageStore *mStore;
+    int mRow;
 };
 
 
@@ -0,0 +1,416 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "messagesbenchmark.hpp"
+#include "chatscene.hpp"
+#include "chatview.hpp"
+#include "chatviewsearchwidget.hpp"
+#include "clickable.hpp"
+#include "messagecodec.hpp"
+#include "messagefilter.hpp"
+#include "messagemodel.hpp"
+#include "smiley.hpp"
+#include "smileymatcher.hpp"
+#include "core.hpp"
+
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QMap>
+#include <QRegExp>
+#include <QScrollBar>
+#include <QStringMatcher>
+#include <QThreadPool>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+const char *const MessagesBenchmark::ARGUMENT = "--benchmark-messages";
+
+namespace {
+
+//! ClickableList::fromString() as it was with the legacy QRegExp engine, the reference of checkClickables()
+ClickableList legacyClickables(const QString &str)
+{
+    static const QString scheme("(?:(?:mailto:|(?:[+.-]?\\w)+://)|www(?=\\.\\S+\\.))");
+    static const QString authority("(?:(?:[,.;@:]?[-\\w]+)+\\.?|\\[[0-9a-f:.]+\\])(?::\\d+)?");
+    static const QString urlChars("(?:[,.;:]*[\\w~@/?&=+$()!%#*{}\\[\\]\\|'^-])");
+    static const QString urlEnd("(?:>|[,.;:\"]*\\s|\\b|$)");
+    static QRegExp regExp(QString("\\b(%1%2(?:/%3*)?)%4").arg(scheme, authority, urlChars, urlEnd), Qt::CaseInsensitive);
+
+    ClickableList result;
+    int idx = 0;
+    while (idx < str.length()) {
+        const int start = regExp.indexIn(str, idx);
+        if (start < 0)
+            break;
+
+        int end = start + regExp.cap(1).length();
+        idx = end;
+        if (str.at(end-1) == ')' && !regExp.cap(1).contains('('))
+            end--;
+        result.append(Clickable(Clickable::Url, start, end - start));
+    }
+    return result;
+}
+
+//! The smiley search SmileyMatcher replaced, an indexOf() per smiley text and found smiley, returns how many it found
+int legacySmileyCount(const QString &text, const Smileypack::SmileypackList &list)
+{
+    int count = 0;
+    int searchStart = 0;
+    bool found;
+    do {
+        found = false;
+        QMap<int, QString> possibleTexts;
+        for (const auto &pair : list) {
+            for (const QString &smileyText : pair.second) {
+                const int pos = text.indexOf(smileyText, searchStart);
+                if (pos > -1) {
+                    possibleTexts.insertMulti(pos, smileyText);
+                    found = true;
+                }
+            }
+        }
+
+        if (!possibleTexts.isEmpty()) {
+            // the longest one at the first position
+            const int pos = possibleTexts.firstKey();
+            int length = 0;
+            for (const QString &smileyText : possibleTexts.values(pos))
+                length = qMax(length, smileyText.length());
+            searchStart = pos + length;
+            count++;
+        }
+    } while (found);
+    return count;
+}
+
+}
+
+MessagesBenchmark::MessagesBenchmark(QTextStream &out) :
+    _out(out),
+    _corpus(makeCorpus(CORPUS_SIZE))
+{
+}
+
+//! Messages of every kind the parsers care about: plain words, links, smileys and long lines
+QStringList MessagesBenchmark::makeCorpus(int count)
+{
+    static const char *const words[] = {
+        "tox", "message", "hello", "the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog",
+        ":)", ":D", ";)", ":(", "https://tox.im/", "www.example.com/some/path?query=1", "user@example.com"
+    };
+    static const int wordCount = sizeof(words) / sizeof(words[0]);
+
+    QStringList corpus;
+    // a fixed seed so that every run measures the same corpus
+    quint32 seed = 42;
+    for (int i = 0; i < count; i++) {
+        seed = seed * 1103515245 + 12345;
+        const int length = 3 + (seed >> 16) % (i % 10 == 0 ? 400 : 30);
+
+        QString text;
+        for (int j = 0; j < length; j++) {
+            seed = seed * 1103515245 + 12345;
+            if (j)
+                text += ' ';
+            text += QLatin1String(words[(seed >> 16) % wordCount]);
+        }
+        corpus << text;
+    }
+    return corpus;
+}
+
+QString MessagesBenchmark::makePaste(int length)
+{
+    static const char *const lines[] = {
+        "The quick brown fox jumps over the lazy dog, again and again. ",
+        "Съешь же ещё этих мягких французских булок, да выпей чаю. ",
+        "いろはにほへと ちりぬるを、わかよたれそ つねならむ。",
+        "敏捷的棕色狐狸跳过了那只懒狗，一次又一次。",
+        "Ξεσκεπάζω την ψυχοφθόρα βδελυγμία. 😀🚀 👍🏽 🦊🐶 ",
+    };
+    static const int lineCount = sizeof(lines) / sizeof(lines[0]);
+
+    QString paste;
+    paste.reserve(length + 100);
+    for (int i = 0; paste.length() < length; i++) {
+        paste += QString::fromUtf8(lines[i % lineCount]);
+        // a log has line breaks, and now and then a long run without any place to split
+        if (i % 7 == 6)
+            paste += '\n';
+        if (i % 97 == 96)
+            paste += QString(3000, QChar(0x4E00 + i % 100));
+        // what a cut emoji leaves behind, toUtf8() makes a single '?' of it
+        if (i % 53 == 52)
+            paste += QChar(0xD83D);
+    }
+    paste.truncate(length);
+    return paste;
+}
+
+bool MessagesBenchmark::checkClickables()
+{
+    // what people actually paste, the corner cases of the rules included
+    static const char *const lines[] = {
+        "see https://tox.im/ and http://wiki.tox.im/Main_Page.",
+        "(like this: https://en.wikipedia.org/wiki/Tox_(protocol)) or that",
+        "the docs are at www.example.com/docs, the code at https://github.com/tux3/qTox",
+        "mail me at mailto:someone@example.com or just someone@example.com",
+        "ftp://ftp.example.org:2121/pub/file.tar.gz; sftp://host/path",
+        "<https://example.com/path?a=1&b=2#anchor> and \"http://example.com/quoted\"",
+        "http://[2001:db8::1]:33445/ is the node, http://192.168.0.1/ the router",
+        "https://пример.рф/путь и https://例子.测试/路径 work too",
+        "www.example. is not a link, www.example.com is",
+        "irc://irc.freenode.net/#tox, magnet:?xt=urn:btih:abc isn't one",
+        "a.b.c.d: http://a.b/c/d/e/f/g/h/i/j/k/l/m/n/o/p, trailing dots...",
+        "https://example.com/wiki/Foo_(bar)_(baz) https://example.com/(x",
+        "no links here at all, just text :) and ;-)",
+        "http://x.y/z!http://x.y/z?http://x.y/z",
+    };
+
+    QStringList corpus = _corpus;
+    for (const char *line : lines)
+        corpus << QString::fromUtf8(line);
+
+    int differences = 0;
+    for (const QString &text : corpus) {
+        const ClickableList expected = legacyClickables(text);
+        const ClickableList actual = ClickableList::fromString(text);
+        if (actual == expected)
+            continue;
+
+        if (differences++ < 10) {
+            _out << "ClickableList::fromString differs from QRegExp on: " << text << "\n";
+            for (const Clickable &click : expected)
+                _out << "    QRegExp: " << text.mid(click.start(), click.length()) << "\n";
+            for (const Clickable &click : actual)
+                _out << "    scanner: " << text.mid(click.start(), click.length()) << "\n";
+        }
+    }
+    _out << QString("ClickableList::fromString self-check, %1 of %2 lines differ\n").arg(differences).arg(corpus.count());
+    _out.flush();
+    return differences == 0;
+}
+
+qint64 MessagesBenchmark::peakMemory()
+{
+#ifdef Q_OS_UNIX
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return -1;
+#ifdef Q_OS_MAC
+    return usage.ru_maxrss / 1024; // bytes there
+#else
+    return usage.ru_maxrss;
+#endif
+#else
+    return -1;
+#endif
+}
+
+void MessagesBenchmark::report(const QString &operation, int runs, qint64 nsecs)
+{
+    _out << QString("%1 %2 runs %3 us/run, peak memory %4 kB\n")
+            .arg(operation, -40)
+            .arg(runs, 6)
+            .arg(nsecs / 1000.0 / runs, 10, 'f', 1)
+            .arg(peakMemory());
+    _out.flush();
+}
+
+//! Lets the deferred work settle: buffered inserts, background layouts and searches
+void MessagesBenchmark::processEvents()
+{
+    // results of background work are delivered as queued signals, which may start more of it
+    do {
+        QCoreApplication::processEvents();
+        QThreadPool::globalInstance()->waitForDone(POLL_INTERVAL);
+    } while (QThreadPool::globalInstance()->activeThreadCount() > 0);
+    QCoreApplication::processEvents();
+    QCoreApplication::processEvents();
+}
+
+int MessagesBenchmark::run()
+{
+    QElapsedTimer timer;
+
+    const bool clickablesMatch = checkClickables();
+
+    // parsing, which every incoming message goes through
+    timer.start();
+    for (const QString &text : _corpus)
+        ClickableList::fromString(text);
+    report("ClickableList::fromString", _corpus.count(), timer.nsecsElapsed());
+
+    timer.start();
+    for (const QString &text : _corpus)
+        legacyClickables(text);
+    report("legacy QRegExp URL search", _corpus.count(), timer.nsecsElapsed());
+
+    timer.start();
+    for (const QString &text : _corpus)
+        SmileyList::fromText(text, ClickableList::fromString(text));
+    report("SmileyList::fromText (with clickables)", _corpus.count(), timer.nsecsElapsed());
+
+    // the largest pack there is, with its texts mixed into the corpus
+    const Smileypack::SmileypackList emojis = Smileypack::emojiList();
+    QStringList smileyCorpus;
+    for (int i = 0; i < _corpus.count(); i++) {
+        const QStringList &texts = emojis.at(i % emojis.count()).second;
+        smileyCorpus << _corpus.at(i) + ' ' + texts.at(i % texts.count()) + " ok";
+    }
+
+    timer.start();
+    SmileyMatcher emojiMatcher(emojis);
+    report(QString("SmileyMatcher, building for %1 emojis").arg(emojis.count()), 1, timer.nsecsElapsed());
+
+    timer.start();
+    int smileys = 0;
+    for (const QString &text : smileyCorpus)
+        smileys += emojiMatcher.findAll(text).count();
+    report(QString("SmileyMatcher::findAll, emoji pack, %1 found").arg(smileys), smileyCorpus.count(), timer.nsecsElapsed());
+
+    timer.start();
+    smileys = 0;
+    for (const QString &text : smileyCorpus)
+        smileys += legacySmileyCount(text, emojis);
+    report(QString("indexOf per smiley, emoji pack, %1 found").arg(smileys), smileyCorpus.count(), timer.nsecsElapsed());
+
+    // splitting, what sending a large paste costs before anything reaches toxcore
+    const QString paste = makePaste(PASTE_LENGTH);
+    const int pasteSize = paste.toUtf8().size();
+    timer.start();
+    const QVector<Core::MessageChunk> chunks = Core::splitMessage(paste, TOX_MAX_MESSAGE_LENGTH);
+    report(QString("Core::splitMessage, %1 kB paste, %2 chunks").arg(pasteSize / 1024).arg(chunks.count()), 1, timer.nsecsElapsed());
+
+    // the chunks have to end where the UTF-8 data does, or sending reads past it
+    const bool chunksMatch = !chunks.isEmpty() && chunks.last().utf8Offset + chunks.last().utf8Length == pasteSize;
+    if (!chunksMatch) {
+        _out << "Core::splitMessage doesn't end where the UTF-8 of the paste does\n";
+        _out.flush();
+    }
+
+    // the literal search of findWords(), without the scene around it
+    for (const QString &query : QStringList() << "Fox" << "EXAMPLE.com" << "zzz-absent") {
+        const QStringMatcher matcher(query, Qt::CaseInsensitive);
+        timer.start();
+        int hits = 0;
+        for (const QString &text : _corpus) {
+            for (int idx = matcher.indexIn(text, 0); idx != -1; idx = matcher.indexIn(text, idx + 1))
+                hits++;
+        }
+        report(QString("QStringMatcher, \"%1\", %2 hits").arg(query).arg(hits), _corpus.count(), timer.nsecsElapsed());
+
+        timer.start();
+        hits = 0;
+        for (const QString &text : _corpus) {
+            for (int idx = text.indexOf(query, 0, Qt::CaseInsensitive); idx != -1; idx = text.indexOf(query, idx + 1, Qt::CaseInsensitive))
+                hits++;
+        }
+        report(QString("QString::indexOf, \"%1\", %2 hits").arg(query).arg(hits), _corpus.count(), timer.nsecsElapsed());
+    }
+
+    // serialization, what history and scrollback pay per message
+    QList<Message> messages;
+    for (int i = 0; i < _corpus.count(); i++) {
+        Message msg(Message::Plain, _corpus.at(i), i % 2 ? "alice" : "bob");
+        msg.setMsgId(MsgId(i + 1));
+        messages << msg;
+    }
+
+    timer.start();
+    QByteArray streamed;
+    {
+        QDataStream out(&streamed, QIODevice::WriteOnly);
+        for (const Message &msg : messages)
+            out << msg;
+    }
+    QDataStream in(streamed);
+    for (int i = 0; i < messages.count(); i++) {
+        Message msg;
+        in >> msg;
+    }
+    report(QString("QDataStream round trip, %1 bytes").arg(streamed.size()), messages.count(), timer.nsecsElapsed());
+
+    timer.start();
+    QByteArray encoded;
+    MessageEncoder encoder(encoded);
+    for (const Message &msg : messages)
+        encoder.append(msg);
+    MessageDecoder decoder(encoded);
+    MessageDecoder::Record record;
+    while (decoder.next(record))
+        record.contentsString();
+    report(QString("MessageCodec round trip, %1 bytes").arg(encoded.size()), messages.count(), timer.nsecsElapsed());
+
+    MessageModel model;
+    MessageFilter filter;
+    filter.setSourceModel(&model);
+    ChatView view(&filter);
+    view.resize(800, 600);
+    view.show();
+    processEvents();
+
+    // bursts, like a friend pasting a lot or a history being loaded
+    timer.start();
+    int inserted = 0;
+    while (inserted < _corpus.count()) {
+        const int end = qMin(inserted + INSERT_BURST, _corpus.count());
+        for (; inserted < end; inserted++)
+            model.insertNewMessage(_corpus.at(inserted), inserted % 2 ? "alice" : "bob", Message::Plain);
+        processEvents();
+    }
+    report(QString("MessageModel::insertNewMessage, bursts of %1").arg(INSERT_BURST), inserted, timer.nsecsElapsed());
+
+    ChatScene *scene = view.scene();
+    for (qreal width : {320.0, 800.0, 1920.0}) {
+        timer.start();
+        scene->layout(0, model.rowCount() - 1, width);
+        processEvents();
+        report(QString("ChatScene::layout, all rows at %1 px").arg(width), 1, timer.nsecsElapsed());
+    }
+    view.resize(800, 600);
+    processEvents();
+
+    QScrollBar *scrollBar = view.verticalScrollBar();
+    const int step = qMax(1, scrollBar->pageStep());
+    timer.start();
+    int pages = 0;
+    for (int value = scrollBar->maximum(); value > scrollBar->minimum(); value -= step, pages++) {
+        scrollBar->setValue(value);
+        view.viewport()->repaint();
+        processEvents();
+    }
+    report("ChatView, scrolling up a page", qMax(1, pages), timer.nsecsElapsed());
+
+    ChatViewSearchWidget search;
+    search.setScene(scene);
+    search.enableSearch();
+    for (const QString &query : QStringList() << "fox" << "example.com" << "zzz-absent") {
+        timer.start();
+        search.setSearchString(query);
+        // skip the typing delay
+        QMetaObject::invokeMethod(&search, "search");
+        processEvents();
+        report(QString("ChatViewSearchWidget, searching \"%1\"").arg(query), 1, timer.nsecsElapsed());
+    }
+
+    return clickablesMatch && chunksMatch ? 0 : 1;
+}
@@ -0,0 +1,62 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef MESSAGESBENCHMARK_HPP
+#define MESSAGESBENCHMARK_HPP
+
+#include <QString>
+#include <QStringList>
+#include <QTextStream>
+
+//! Times the hot paths of the messages subsystem over a synthetic corpus
+/** Run with --benchmark-messages instead of starting the GUI. Every operation is reported
+ *  with its time per run and the peak memory use of the process after it, so the output of
+ *  two builds can be compared line by line. Parsers that replaced an older implementation
+ *  are timed next to it, and the URL scanner is checked against it, failing the run on a difference.
+ */
+class MessagesBenchmark
+{
+public:
+    explicit MessagesBenchmark(QTextStream &out);
+
+    //! Runs all operations, returns the process' exit code
+    int run();
+
+    static const char *const ARGUMENT;
+
+private:
+    static QStringList makeCorpus(int count);
+    //! A paste of length UTF-16 units mixing scripts of every UTF-8 length
+    static QString makePaste(int length);
+    //! Compares ClickableList::fromString() to the legacy QRegExp on the corpus, false on any difference
+    bool checkClickables();
+    //! In kB, -1 where we don't know how to find out
+    static qint64 peakMemory();
+
+    void report(const QString &operation, int runs, qint64 nsecs);
+    static void processEvents();
+
+    QTextStream &_out;
+    QStringList _corpus;
+
+    static const int CORPUS_SIZE = 5000;
+    static const int INSERT_BURST = 500;
+    static const int PASTE_LENGTH = 2 * 1024 * 1024;
+    static const int POLL_INTERVAL = 5; // ms
+};
+
+#endif // MESSAGESBENCHMARK_HPP
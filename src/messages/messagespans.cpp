@@ -0,0 +1,156 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "messagespans.hpp"
+#include "smileytextobject.hpp"
+#include "smileypack.hpp"
+#include "thumbnailcache.hpp"
+
+#include <QAbstractTextDocumentLayout>
+#include <QApplication>
+#include <QPalette>
+#include <QTextCursor>
+#include <QTextDocument>
+
+MessageSpansPtr MessageSpans::fromText(const QString &contents)
+{
+    // Reconvert emoji, they are shown as smileys of the pack
+    QString text = contents;
+    if (!Smileypack::current()->isEmoji())
+        text = Smileypack::deemojify(text);
+
+    // links are found once, smileys inside them are left alone
+    QSharedPointer<MessageSpans> result(new MessageSpans);
+    ClickableList clickables = ClickableList::fromString(text);
+    result->mSmileys = SmileyList::fromText(text, clickables);
+
+    // Replace smileys
+    int pos = 0;
+    for (const Smiley &smiley : result->mSmileys) {
+        result->mText += text.mid(pos, smiley.start() - pos);
+        if (smiley.type() == Smiley::Pixmap)
+            result->mText += QChar(QChar::ObjectReplacementCharacter);
+        else
+            result->mText += smiley.graphics();
+        pos = smiley.start() + smiley.textLength();
+    }
+    result->mText += text.mid(pos);
+
+    // Move the links to their positions in the smileyfied text, no smiley is inside of one
+    int smiley = 0;
+    int offset = 0;
+    for (const Clickable &click : clickables) {
+        while (smiley < result->mSmileys.count() && result->mSmileys.at(smiley).start() < click.start()) {
+            const Smiley &s = result->mSmileys.at(smiley++);
+            offset += s.textLength() - ((s.type() == Smiley::Pixmap) ? 1 : s.graphics().count());
+        }
+        result->mClickables << Clickable(click.type(), click.start() - offset, click.length());
+    }
+
+    // a single preview per message, so a line knows its height without looking at the images
+    for (const Clickable &click : result->mClickables) {
+        QString url = result->mText.mid(click.start(), click.length());
+        if (ThumbnailCache::isPreviewable(url)) {
+            result->mPreviewUrl = url;
+            break;
+        }
+    }
+
+    // Cut the text into runs
+    const SmileyList &smileys = result->mSmileys;
+    const ClickableList &clickables = result->mClickables;
+    int length = result->mText.length();
+    int nextSmiley = 0;
+    int nextClickable = 0;
+    pos = 0;
+    while (pos < length) {
+        int smileyStart = nextSmiley < smileys.count() ? smileys.at(nextSmiley).smileyfiedStart() : length;
+        int clickableStart = nextClickable < clickables.count() ? clickables.at(nextClickable).start() : length;
+
+        // a link never contains a smiley, but don't rely on it
+        if (smileyStart < pos) {
+            nextSmiley++;
+            continue;
+        }
+        if (clickableStart < pos) {
+            nextClickable++;
+            continue;
+        }
+
+        Span span;
+        span.start = pos;
+        if (pos == smileyStart) {
+            const Smiley &smiley = smileys.at(nextSmiley);
+            span.kind = (smiley.type() == Smiley::Pixmap) ? Span::PixmapSmiley : Span::EmojiSmiley;
+            span.length = (smiley.type() == Smiley::Pixmap) ? 1 : smiley.graphics().count();
+            span.index = nextSmiley++;
+        }
+        else if (pos == clickableStart) {
+            span.kind = Span::Link;
+            span.length = clickables.at(nextClickable).length();
+            span.index = nextClickable++;
+        }
+        else {
+            span.kind = Span::Text;
+            span.length = qMin(smileyStart, clickableStart) - pos;
+            span.index = -1;
+        }
+        span.length = qMin(span.length, length - pos);
+        result->mSpans << span;
+        pos += span.length;
+    }
+
+    return result;
+}
+
+void MessageSpans::buildDocument(QTextDocument *doc) const
+{
+    QTextCursor c(doc);
+    QTextCharFormat plain = c.charFormat();
+    bool smileyHandler = false;
+
+    for (const Span &span : mSpans) {
+        switch (span.kind) {
+        case Span::Text:
+            c.insertText(mText.mid(span.start, span.length), plain);
+            break;
+        case Span::Link: {
+            QTextCharFormat f = plain;
+            f.setAnchor(true);
+            f.setAnchorHref(mText.mid(span.start, span.length));
+            f.setForeground(QApplication::palette().brush(QPalette::Link));
+            c.insertText(mText.mid(span.start, span.length), f);
+            break;
+        }
+        case Span::PixmapSmiley:
+            // one handler draws all smileys of the document
+            if (!smileyHandler) {
+                doc->documentLayout()->registerHandler(SmileyTextObject::SmileyFormat, new SmileyTextObject(doc));
+                smileyHandler = true;
+            }
+            c.insertText(QString(QChar::ObjectReplacementCharacter),
+                         SmileyTextObject::smileyFormat(mSmileys.at(span.index).graphics(), plain));
+            break;
+        case Span::EmojiSmiley: {
+            QTextCharFormat f = plain;
+            f.setFont(mSmileys.at(span.index).emojiFont());
+            c.insertText(mSmileys.at(span.index).graphics(), f);
+            break;
+        }
+        }
+    }
+}
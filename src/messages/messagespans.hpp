@@ -0,0 +1,75 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef MESSAGESPANS_HPP
+#define MESSAGESPANS_HPP
+
+#include <QMetaType>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+#include "clickable.hpp"
+#include "smiley.hpp"
+
+class QTextDocument;
+
+/**
+ * The contents of a message, parsed once for display.
+ * The text has its smileys already replaced, pixmap smileys by an object replacement character and
+ * emoji by their graphics, and is cut into runs of plain text, links and smileys. Building a
+ * QTextDocument from it is a single pass of insertions, without any regex or cursor moves.
+ * All positions are in the smileyfied text, which is also the text of the document.
+ */
+class MessageSpans
+{
+public:
+    struct Span {
+        enum Kind {
+            Text,
+            Link,
+            PixmapSmiley,
+            EmojiSmiley
+        };
+        Kind kind;
+        int start;
+        int length;
+        int index; // into smileys or clickables
+    };
+
+    static QSharedPointer<const MessageSpans> fromText(const QString &text);
+
+    void buildDocument(QTextDocument *doc) const;
+
+    inline const QString &text() const { return mText; }
+    inline const SmileyList &smileys() const { return mSmileys; }
+    inline const ClickableList &clickables() const { return mClickables; }
+    inline const QVector<Span> &spans() const { return mSpans; }
+    //! The first link that gets an inline preview, see ThumbnailCache, empty if there is none
+    inline const QString &previewUrl() const { return mPreviewUrl; }
+
+private:
+    QString mText;
+    SmileyList mSmileys;
+    ClickableList mClickables;
+    QVector<Span> mSpans;
+    QString mPreviewUrl;
+};
+
+typedef QSharedPointer<const MessageSpans> MessageSpansPtr;
+Q_DECLARE_METATYPE(MessageSpansPtr)
+
+#endif // MESSAGESPANS_HPP
@@ -0,0 +1,377 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "messagestore.hpp"
+#include "chatmemoryusage.hpp"
+#include "stringpool.hpp"
+
+#include <algorithm>
+
+MessageStore::MessageStore() :
+    mLiveChars(0),
+    mNextBlock(0),
+    mThawedBlock(-1)
+{
+}
+
+void MessageStore::insert(int row, const Message &msg)
+{
+    insert(row, QList<Message>() << msg);
+}
+
+void MessageStore::insert(int row, const QList<Message> &messages)
+{
+    const int count = messages.count();
+    makeRoom(row, count);
+    for (int i = 0; i < count; i++)
+        set(row + i, messages.at(i));
+}
+
+int MessageStore::insert(int row, MessageDecoder &decoder, int count)
+{
+    makeRoom(row, count);
+
+    int decoded = 0;
+    MessageDecoder::Record record;
+    while (decoded < count && decoder.next(record))
+        set(row + decoded++, record);
+
+    // a truncated buffer leaves empty rows behind, they haven't been counted anywhere yet
+    if (decoded < count)
+        dropRows(row + decoded, count - decoded);
+    return decoded;
+}
+
+void MessageStore::encode(MessageEncoder &encoder, int row, int count) const
+{
+    for (int i = row; i < row + count; i++)
+        encoder.append(MsgId(mMsgIds.at(i)), mTimestamps.at(i), type(i), flags(i), sender(i),
+                       contentsChars(i), mContentsLengths.at(i));
+}
+
+void MessageStore::makeRoom(int row, int count)
+{
+    // make room in every column at once, so a group costs a single move of the rows behind it
+    mMsgIds.insert(row, count, 0);
+    mTimestamps.insert(row, count, 0);
+    mTypes.insert(row, count, 0);
+    mFlags.insert(row, count, 0);
+    mSenderIds.insert(row, count, 0);
+    mContentsOffsets.insert(row, count, 0);
+    mContentsLengths.insert(row, count, 0);
+    mContentsBlocks.insert(row, count, -1);
+    mTimestampTexts.insert(row, count, QString());
+    mContentsTexts.insert(row, count, QString());
+    mContentsSpans.insert(row, count, MessageSpansPtr());
+}
+
+void MessageStore::set(int row, const Message &msg)
+{
+    set(row, msg.msgId().toLong(), msg.timestamp().toMSecsSinceEpoch(), msg.type(), msg.flags(), msg.sender(), msg.contents());
+}
+
+void MessageStore::set(int row, const MessageDecoder::Record &record)
+{
+    set(row, record.msgId.toLong(), record.timestampMSecs, record.type, record.flags,
+        record.senderString(), record.contentsString());
+}
+
+void MessageStore::set(int row, qint64 msgId, qint64 timestampMSecs, Message::Type type, Message::Flags flags,
+                       const QString &sender, const QString &contents)
+{
+    int offset = mArena.count();
+    mArena.resize(offset + contents.length());
+    std::copy(contents.constBegin(), contents.constEnd(), mArena.begin() + offset);
+
+    mMsgIds[row] = msgId;
+    mTimestamps[row] = timestampMSecs;
+    mTypes[row] = (quint32)type;
+    mTypeCounts[mTypes.at(row)]++;
+    mFlags[row] = (quint8)flags;
+    mSenderIds[row] = internSender(sender);
+    mContentsOffsets[row] = offset;
+    mContentsLengths[row] = contents.length();
+    mLiveChars += contents.length();
+}
+
+void MessageStore::remove(int row, int count)
+{
+    for (int i = row; i < row + count; i++) {
+        if (mContentsBlocks.at(i) < 0)
+            mLiveChars -= mContentsLengths.at(i);
+        else
+            releaseBlock(mContentsBlocks.at(i));
+        if (--mTypeCounts[mTypes.at(i)] == 0)
+            mTypeCounts.remove(mTypes.at(i));
+    }
+
+    dropRows(row, count);
+
+    // don't let evicted rows keep their text alive for ever
+    if (mArena.count() > 2 * mLiveChars + 4096)
+        compactArena();
+}
+
+void MessageStore::dropRows(int row, int count)
+{
+    mMsgIds.remove(row, count);
+    mTimestamps.remove(row, count);
+    mTypes.remove(row, count);
+    mFlags.remove(row, count);
+    mSenderIds.remove(row, count);
+    mContentsOffsets.remove(row, count);
+    mContentsLengths.remove(row, count);
+    mContentsBlocks.remove(row, count);
+    mTimestampTexts.remove(row, count);
+    mContentsTexts.remove(row, count);
+    mContentsSpans.remove(row, count);
+}
+
+bool MessageStore::containsTypes(int types) const
+{
+    for (QHash<quint32, int>::const_iterator it = mTypeCounts.constBegin(); it != mTypeCounts.constEnd(); ++it) {
+        if (it.key() & types)
+            return true;
+    }
+    return false;
+}
+
+void MessageStore::addMemoryUsage(ChatMemoryUsage &usage) const
+{
+    usage.rows += count();
+
+    qint64 bytes = mMsgIds.capacity() * sizeof(qint64)
+            + mTimestamps.capacity() * sizeof(qint64)
+            + mTypes.capacity() * sizeof(quint32)
+            + mFlags.capacity() * sizeof(quint8)
+            + mSenderIds.capacity() * sizeof(int)
+            + mContentsOffsets.capacity() * sizeof(int)
+            + mContentsLengths.capacity() * sizeof(int)
+            + mContentsBlocks.capacity() * sizeof(int)
+            + mTimestampTexts.capacity() * sizeof(QString)
+            + mContentsTexts.capacity() * sizeof(QString)
+            + mContentsSpans.capacity() * sizeof(MessageSpansPtr)
+            + mArena.capacity() * sizeof(QChar)
+            + mThawedChars.capacity();
+
+    for (const FrozenBlock &block : mFrozenBlocks)
+        bytes += sizeof(FrozenBlock) + block.data.capacity();
+
+    for (int i = 0; i < count(); i++) {
+        bytes += ChatMemoryUsage::stringBytes(mTimestampTexts.at(i));
+        bytes += ChatMemoryUsage::stringBytes(mContentsTexts.at(i));
+
+        const MessageSpansPtr &spans = mContentsSpans.at(i);
+        if (spans) {
+            bytes += sizeof(MessageSpans) + ChatMemoryUsage::stringBytes(spans->text())
+                    + spans->spans().capacity() * sizeof(MessageSpans::Span)
+                    + spans->clickables().count() * sizeof(Clickable);
+            usage.addSmileys(spans->smileys());
+        }
+    }
+
+    // the list and the index share the buffer StringPool holds
+    for (const QString &sender : mSenders)
+        bytes += ChatMemoryUsage::stringBytes(sender) + sizeof(QString);
+
+    usage.modelBytes += bytes;
+}
+
+void MessageStore::compactArena()
+{
+    QVector<QChar> arena;
+    arena.reserve(mLiveChars);
+    for (int i = 0; i < mContentsOffsets.count(); i++) {
+        if (mContentsBlocks.at(i) >= 0)
+            continue;
+        const QChar *begin = mArena.constData() + mContentsOffsets.at(i);
+        mContentsOffsets[i] = arena.count();
+        arena.resize(arena.count() + mContentsLengths.at(i));
+        std::copy(begin, begin + mContentsLengths.at(i), arena.begin() + mContentsOffsets.at(i));
+    }
+    mArena = arena;
+}
+
+void MessageStore::clear()
+{
+    mMsgIds.clear();
+    mTimestamps.clear();
+    mTypes.clear();
+    mTypeCounts.clear();
+    mFlags.clear();
+    mSenderIds.clear();
+    mContentsOffsets.clear();
+    mContentsLengths.clear();
+    mContentsBlocks.clear();
+    mFrozenBlocks.clear();
+    mThawedBlock = -1;
+    mThawedChars.clear();
+    mTimestampTexts.clear();
+    mContentsTexts.clear();
+    mContentsSpans.clear();
+    mArena.clear();
+    mLiveChars = 0;
+    mSenders.clear();
+    mSenderIndex.clear();
+}
+
+Message MessageStore::message(int row) const
+{
+    Message msg(timestamp(row), type(row), contents(row), sender(row), flags(row));
+    msg.setMsgId(msgId(row));
+    return msg;
+}
+
+void MessageStore::clearTimestampTexts()
+{
+    for (int i = 0; i < mTimestampTexts.count(); i++)
+        mTimestampTexts[i] = QString();
+}
+
+void MessageStore::clearContentsSpans()
+{
+    for (int i = 0; i < mContentsSpans.count(); i++)
+        mContentsSpans[i].clear();
+}
+
+void MessageStore::freeze(int first, int last)
+{
+    first = qMax(first, 0);
+    last = qMin(last, count() - 1);
+
+    // runs of rows still in the arena are cut into blocks
+    int start = first;
+    int chars = 0;
+    for (int row = first; row <= last + 1; row++) {
+        bool live = row <= last && mContentsBlocks.at(row) < 0;
+        if (live && row - start < BLOCK_ROWS && chars + mContentsLengths.at(row) <= BLOCK_MAX_CHARS) {
+            chars += mContentsLengths.at(row);
+            continue;
+        }
+
+        if (chars >= BLOCK_MIN_CHARS)
+            freezeBlock(start, row - start, chars);
+        start = live ? row : row + 1;
+        chars = live ? mContentsLengths.at(row) : 0;
+    }
+
+    if (mArena.count() > 2 * mLiveChars + 4096)
+        compactArena();
+}
+
+void MessageStore::freezeBlock(int row, int count, int chars)
+{
+    QByteArray raw(chars * sizeof(QChar), Qt::Uninitialized);
+    QChar *out = reinterpret_cast<QChar *>(raw.data());
+    for (int i = row; i < row + count; i++) {
+        const QChar *begin = mArena.constData() + mContentsOffsets.at(i);
+        out = std::copy(begin, begin + mContentsLengths.at(i), out);
+    }
+
+    // speed over ratio, the block is decompressed whenever one of its rows is read
+    FrozenBlock block;
+    block.data = qCompress(raw, 1);
+    block.rows = count;
+    if (block.data.size() >= raw.size() * 3 / 4)
+        return;
+
+    int offset = 0;
+    for (int i = row; i < row + count; i++) {
+        mContentsOffsets[i] = offset;
+        mContentsBlocks[i] = mNextBlock;
+        offset += mContentsLengths.at(i);
+        // both are copies of the contents, built again when they are asked for
+        mContentsTexts[i] = QString();
+        mContentsSpans[i].clear();
+    }
+    mFrozenBlocks.insert(mNextBlock++, block);
+    mLiveChars -= chars;
+}
+
+void MessageStore::thaw(int first, int last)
+{
+    first = qMax(first, 0);
+    last = qMin(last, count() - 1);
+
+    for (int row = first; row <= last; row++) {
+        int block = mContentsBlocks.at(row);
+        if (block < 0)
+            continue;
+
+        // the characters are in mThawedChars, the arena may grow meanwhile
+        const QChar *begin = frozenChars(block) + mContentsOffsets.at(row);
+        int offset = mArena.count();
+        mArena.resize(offset + mContentsLengths.at(row));
+        std::copy(begin, begin + mContentsLengths.at(row), mArena.begin() + offset);
+
+        mContentsOffsets[row] = offset;
+        mContentsBlocks[row] = -1;
+        mLiveChars += mContentsLengths.at(row);
+        releaseBlock(block);
+    }
+}
+
+void MessageStore::addContents(ContentsSnapshot &snapshot, int row) const
+{
+    if (!snapshot._hasStore) {
+        snapshot._arena = mArena;
+        for (QHash<int, FrozenBlock>::const_iterator it = mFrozenBlocks.constBegin(); it != mFrozenBlocks.constEnd(); ++it)
+            snapshot._frozenBlocks.insert(it.key(), it->data);
+        snapshot._hasStore = true;
+    }
+
+    const int block = mContentsBlocks.at(row);
+    snapshot._blocks << (block < 0 ? ContentsSnapshot::ARENA : block);
+    snapshot._offsets << mContentsOffsets.at(row);
+    snapshot._lengths << mContentsLengths.at(row);
+}
+
+const QChar *MessageStore::frozenChars(int block) const
+{
+    if (block != mThawedBlock) {
+        mThawedChars = qUncompress(mFrozenBlocks.value(block).data);
+        mThawedBlock = block;
+    }
+    return reinterpret_cast<const QChar *>(mThawedChars.constData());
+}
+
+void MessageStore::releaseBlock(int block)
+{
+    QHash<int, FrozenBlock>::iterator it = mFrozenBlocks.find(block);
+    if (--it->rows > 0)
+        return;
+
+    mFrozenBlocks.erase(it);
+    if (mThawedBlock == block) {
+        mThawedBlock = -1;
+        mThawedChars.clear();
+    }
+}
+
+int MessageStore::internSender(const QString &sender)
+{
+    QHash<QString, int>::const_iterator it = mSenderIndex.constFind(sender);
+    if (it != mSenderIndex.constEnd())
+        return it.value();
+
+    // the same friends talk in every chat, so the names are shared between stores
+    const QString interned = StringPool::instance().intern(sender);
+    int id = mSenders.count();
+    mSenders << interned;
+    mSenderIndex.insert(interned, id);
+    return id;
+}
@@ -0,0 +1,153 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef MESSAGESTORE_HPP
+#define MESSAGESTORE_HPP
+
+#include <QByteArray>
+#include <QHash>
+#include <QStringList>
+#include <QVector>
+#include "contentssnapshot.hpp"
+#include "message.hpp"
+#include "messagecodec.hpp"
+#include "messagespans.hpp"
+
+struct ChatMemoryUsage;
+
+/**
+ * Column-wise storage for the rows of a MessageModel.
+ * Ids, timestamps, types and flags are kept in packed arrays, message contents are
+ * appended to a single character arena and senders are interned, so a chat line costs
+ * a few dozen bytes plus its text instead of a Message with its own QDateTime and QStrings.
+ * Contents of rows far from the viewport can be frozen into compressed blocks, they are
+ * decompressed again when they are read, a block at a time.
+ */
+class MessageStore
+{
+public:
+    MessageStore();
+
+    inline int count() const { return mMsgIds.count(); }
+    inline bool isEmpty() const { return mMsgIds.isEmpty(); }
+
+    void insert(int row, const Message &msg);
+    void insert(int row, const QList<Message> &messages);
+    //! Inserts up to count records straight from decoder, returns how many it got
+    int insert(int row, MessageDecoder &decoder, int count);
+    //! Appends count rows from row on to encoder
+    void encode(MessageEncoder &encoder, int row, int count) const;
+    void remove(int row, int count = 1);
+    void clear();
+
+    inline MsgId msgId(int row) const { return MsgId(mMsgIds.at(row)); }
+    inline qint64 timestampMSecs(int row) const { return mTimestamps.at(row); }
+    inline QDateTime timestamp(int row) const { return QDateTime::fromMSecsSinceEpoch(mTimestamps.at(row)); }
+    inline Message::Type type(int row) const { return (Message::Type)mTypes.at(row); }
+    //! Whether any row has one of the given types
+    bool containsTypes(int types) const;
+    inline Message::Flags flags(int row) const { return (Message::Flags)mFlags.at(row); }
+    inline void setFlags(int row, Message::Flags flags) { mFlags[row] = (quint8)flags; }
+    inline QString contents(int row) const { return QString(contentsChars(row), mContentsLengths.at(row)); }
+    inline const QString &sender(int row) const { return mSenders.at(mSenderIds.at(row)); }
+
+    Message message(int row) const;
+
+    // display strings built by MessageModelItem, null until they are first asked for
+    inline QString &timestampText(int row) const { return mTimestampTexts[row]; }
+    inline QString &contentsText(int row) const { return mContentsTexts[row]; }
+    void clearTimestampTexts();
+
+    // parsed contents, also null until first asked for
+    inline MessageSpansPtr &contentsSpans(int row) const { return mContentsSpans[row]; }
+    void clearContentsSpans();
+
+    //! Compresses the contents of the rows from first to last, dropping their cached strings and spans
+    void freeze(int first, int last);
+    //! Moves the contents of the frozen rows from first to last back into the arena
+    void thaw(int first, int last);
+
+    //! Adds the contents of row to snapshot, sharing the arena and frozen blocks with it
+    void addContents(ContentsSnapshot &snapshot, int row) const;
+
+    //! Adds the rows, their strings and parsed spans to usage
+    void addMemoryUsage(ChatMemoryUsage &usage) const;
+
+private:
+    //! The characters of the contents of row, valid until the next read of another frozen block
+    inline const QChar *contentsChars(int row) const
+    {
+        int block = mContentsBlocks.at(row);
+        return (block < 0 ? mArena.constData() : frozenChars(block)) + mContentsOffsets.at(row);
+    }
+    const QChar *frozenChars(int block) const;
+    //! Compresses the contents of count consecutive live rows from row on into a new block
+    void freezeBlock(int row, int count, int chars);
+    void releaseBlock(int block);
+
+    void makeRoom(int row, int count);
+    //! Removes the rows from the columns only
+    void dropRows(int row, int count);
+    void set(int row, const Message &msg);
+    void set(int row, const MessageDecoder::Record &record);
+    void set(int row, qint64 msgId, qint64 timestampMSecs, Message::Type type, Message::Flags flags,
+             const QString &sender, const QString &contents);
+    void compactArena();
+    int internSender(const QString &sender);
+
+    QVector<qint64> mMsgIds;
+    QVector<qint64> mTimestamps;
+    QVector<quint32> mTypes;
+    // rows per type, so filters can tell which types are present without a scan
+    QHash<quint32, int> mTypeCounts;
+    QVector<quint8> mFlags;
+    QVector<int> mSenderIds;
+    // offsets are into the arena, or into the frozen block if the row has one
+    QVector<int> mContentsOffsets;
+    QVector<int> mContentsLengths;
+    QVector<int> mContentsBlocks; // -1 for contents in the arena
+
+    mutable QVector<QString> mTimestampTexts;
+    mutable QVector<QString> mContentsTexts;
+    mutable QVector<MessageSpansPtr> mContentsSpans;
+
+    // contents of removed rows stay in the arena until it's compacted
+    QVector<QChar> mArena;
+    int mLiveChars;
+
+    //! UTF-16 contents of consecutive rows, compressed with qCompress()
+    struct FrozenBlock {
+        QByteArray data;
+        int rows; // rows still referring to the block
+    };
+    QHash<int, FrozenBlock> mFrozenBlocks;
+    int mNextBlock;
+    // the block read last, decompressed, as layout and search read rows in order
+    mutable int mThawedBlock;
+    mutable QByteArray mThawedChars;
+
+    //! Rows are frozen in blocks of up to this many, so a read decompresses little more than it needs
+    static const int BLOCK_ROWS = 64;
+    static const int BLOCK_MAX_CHARS = 32 * 1024;
+    //! Fewer characters don't compress well enough to be worth it
+    static const int BLOCK_MIN_CHARS = 512;
+
+    QStringList mSenders;
+    QHash<QString, int> mSenderIndex;
+};
+
+#endif // MESSAGESTORE_HPP
@@ -0,0 +1,112 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef OBJECTPOOL_HPP
+#define OBJECTPOOL_HPP
+
+#include <QVector>
+#include <new>
+#include <type_traits>
+
+//! Free list allocator for objects of a single type
+/** Chats create and drop their lines, items and highlights by the thousand. Taking them from
+ *  chunks of ChunkSize slots keeps them off the general purpose heap, so long sessions don't
+ *  fragment it, and a slot is reused without a round trip through malloc. Once the last object
+ *  is released all chunks but the first are given back.
+ *  Classes use it from their operator new and delete. Not thread safe, these objects only live
+ *  in the GUI thread.
+ */
+template <typename T, int ChunkSize = 256>
+class ObjectPool
+{
+public:
+    ObjectPool() : mFree(nullptr), mLive(0) {}
+    // objects still alive at exit keep their chunks, releasing them later mustn't touch freed memory
+    ~ObjectPool() { if (mLive == 0) freeChunks(0); }
+
+    //! A slot for a T, subclasses of another size are left to the heap
+    void *allocate(size_t size)
+    {
+        if (size != sizeof(T))
+            return ::operator new(size);
+        if (!mFree)
+            addChunk();
+
+        Slot *slot = mFree;
+        mFree = slot->next;
+        mLive++;
+        return slot;
+    }
+
+    void release(void *p, size_t size)
+    {
+        if (!p)
+            return;
+        if (size != sizeof(T)) {
+            ::operator delete(p);
+            return;
+        }
+
+        Slot *slot = static_cast<Slot *>(p);
+        slot->next = mFree;
+        mFree = slot;
+        if (--mLive == 0 && mChunks.count() > 1)
+            freeChunks(1);
+    }
+
+    inline int liveCount() const { return mLive; }
+    inline qint64 allocatedBytes() const { return (qint64)mChunks.count() * ChunkSize * sizeof(Slot); }
+
+private:
+    union Slot {
+        Slot *next;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+
+    void addChunk()
+    {
+        Slot *chunk = static_cast<Slot *>(::operator new(ChunkSize * sizeof(Slot)));
+        mChunks << chunk;
+        threadChunk(chunk);
+    }
+
+    //! Puts all slots of chunk on the free list
+    void threadChunk(Slot *chunk)
+    {
+        for (int i = ChunkSize - 1; i >= 0; i--) {
+            chunk[i].next = mFree;
+            mFree = &chunk[i];
+        }
+    }
+
+    //! Frees the chunks from keep on, only valid while nothing is allocated
+    void freeChunks(int keep)
+    {
+        for (int i = keep; i < mChunks.count(); i++)
+            ::operator delete(mChunks.at(i));
+        mChunks.resize(keep);
+
+        mFree = nullptr;
+        if (keep > 0)
+            threadChunk(mChunks.first());
+    }
+
+    Slot *mFree;
+    int mLive;
+    QVector<Slot *> mChunks;
+};
+
+#endif // OBJECTPOOL_HPP
@@ -0,0 +1,171 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "plaintextlayout.hpp"
+#include <QCache>
+#include <QPainter>
+#include <QTextBoundaryFinder>
+
+namespace {
+struct SharedKey
+{
+    QString text;
+    QString font;
+    int alignment;
+    int wrapMode;
+    qreal width;
+
+    bool operator==(const SharedKey &other) const
+    {
+        return width == other.width && alignment == other.alignment && wrapMode == other.wrapMode
+                && text == other.text && font == other.font;
+    }
+};
+
+inline uint qHash(const SharedKey &key)
+{
+    return qHash(key.text) ^ qHash(key.font) ^ qHash(int(key.width)) ^ uint(key.alignment << 8) ^ uint(key.wrapMode);
+}
+}
+
+// layouts nobody uses are dropped first, the others are kept alive by their items anyway
+static QCache<SharedKey, QSharedPointer<PlainTextLayout> > sharedLayouts(PlainTextLayout::SHARED_CACHE_SIZE);
+
+PlainTextLayout::PlainTextLayout(const QString &text, const QFont &font, const QTextOption &option) :
+    _text(text),
+    _width(-1),
+    _height(0),
+    _staticTextValid(false)
+{
+    // setPlainText() makes a block of every line, line separators give the same breaks in a
+    // single layout and keep the positions
+    QString layoutText = text;
+    layoutText.replace(QLatin1Char('\n'), QChar::LineSeparator);
+    _layout.setText(layoutText);
+    _layout.setFont(font);
+    _layout.setTextOption(option);
+    _layout.setCacheEnabled(true);
+}
+
+QSharedPointer<PlainTextLayout> PlainTextLayout::shared(const QString &text, const QFont &font, const QTextOption &option, qreal width)
+{
+    SharedKey key = { text, font.key(), int(option.alignment()), int(option.wrapMode()), width };
+    if (QSharedPointer<PlainTextLayout> *layout = sharedLayouts.object(key))
+        return *layout;
+
+    QSharedPointer<PlainTextLayout> layout(new PlainTextLayout(text, font, option));
+    layout->setTextWidth(width);
+    sharedLayouts.insert(key, new QSharedPointer<PlainTextLayout>(layout));
+    return layout;
+}
+
+int PlainTextLayout::sharedCount()
+{
+    return sharedLayouts.count();
+}
+
+void PlainTextLayout::clearShared()
+{
+    sharedLayouts.clear();
+}
+
+void PlainTextLayout::setTextWidth(qreal width)
+{
+    if (width == _width)
+        return;
+
+    _width = width;
+    doLayout();
+}
+
+void PlainTextLayout::doLayout()
+{
+    _staticTextValid = false;
+    _height = 0;
+
+    qreal lineWidth = qMax<qreal>(0, _width - 2 * DOCUMENT_MARGIN);
+    _layout.beginLayout();
+    forever {
+        QTextLine line = _layout.createLine();
+        if (!line.isValid())
+            break;
+        line.setLineWidth(lineWidth);
+        line.setPosition(QPointF(0, _height));
+        _height += line.height();
+    }
+    _layout.endLayout();
+
+    _height += 2 * DOCUMENT_MARGIN;
+}
+
+int PlainTextLayout::hitTest(const QPointF &pos) const
+{
+    if (_layout.lineCount() == 0)
+        return 0;
+
+    QPointF p = pos - QPointF(DOCUMENT_MARGIN, DOCUMENT_MARGIN);
+    QTextLine line = _layout.lineAt(_layout.lineCount() - 1);
+    for (int i = 0; i < _layout.lineCount(); i++) {
+        if (p.y() < _layout.lineAt(i).y() + _layout.lineAt(i).height()) {
+            line = _layout.lineAt(i);
+            break;
+        }
+    }
+    return line.xToCursor(p.x());
+}
+
+void PlainTextLayout::wordAt(int pos, int &start, int &end) const
+{
+    QTextBoundaryFinder finder(QTextBoundaryFinder::Word, _text);
+    finder.setPosition(qBound(0, pos, _text.length()));
+
+    start = finder.isAtBoundary() ? finder.position() : finder.toPreviousBoundary();
+    finder.setPosition(start);
+    end = finder.toNextBoundary();
+
+    if (start < 0)
+        start = 0;
+    if (end < 0)
+        end = _text.length();
+}
+
+void PlainTextLayout::draw(QPainter *painter, const QPointF &pos, const QVector<QTextLayout::FormatRange> &selections) const
+{
+    QPointF origin = pos + QPointF(DOCUMENT_MARGIN, DOCUMENT_MARGIN);
+
+    if (selections.isEmpty() && _layout.lineCount() == 1) {
+        QTextLine line = _layout.lineAt(0);
+        if (!_staticTextValid) {
+            _staticText.setText(_text);
+            _staticText.setTextFormat(Qt::PlainText);
+            _staticText.setTextOption(_layout.textOption());
+            _staticText.prepare(painter->transform(), _layout.font());
+            _staticTextValid = true;
+        }
+
+        // QTextLine applies the alignment only when it draws
+        qreal x = 0;
+        if (_layout.textOption().alignment() & Qt::AlignRight)
+            x = line.width() - line.naturalTextWidth();
+
+        painter->setFont(_layout.font());
+        painter->drawStaticText(origin + QPointF(x, line.y()), _staticText);
+        return;
+    }
+
+    _layout.draw(painter, origin, selections);
+}
@@ -0,0 +1,81 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef PLAINTEXTLAYOUT_HPP
+#define PLAINTEXTLAYOUT_HPP
+
+#include <QSharedPointer>
+#include <QStaticText>
+#include <QTextLayout>
+#include <QTextOption>
+
+class QPainter;
+
+//! Lays out and draws plain text the way a QTextDocument with setPlainText() would
+/** A QTextDocument costs a document, a frame, a block per line and a layout per block, which is a lot
+ *  for a sender name, a timestamp or a one-line message. This keeps a single QTextLayout instead, with
+ *  the document's margins and line breaks, and positions that match the document's cursor positions.
+ *  Single lines without a selection are drawn from a QStaticText, which caches the glyph positions.
+ */
+class PlainTextLayout
+{
+public:
+    PlainTextLayout(const QString &text, const QFont &font, const QTextOption &option);
+
+    inline const QString &text() const { return _text; }
+    //! Like QTextDocument::characterCount(), which counts the final paragraph separator
+    inline int characterCount() const { return _text.length() + 1; }
+    inline qreal height() const { return _height; }
+    inline qreal textWidth() const { return _width; }
+
+    void setTextWidth(qreal width);
+
+    //! The cursor position at pos, relative to the top left of the text, like QAbstractTextDocumentLayout::hitTest()
+    int hitTest(const QPointF &pos) const;
+    //! The word around cursor position pos, like QTextCursor::WordUnderCursor
+    void wordAt(int pos, int &start, int &end) const;
+
+    //! Draws the text at pos in the painter's pen, the selections are drawn in their order
+    void draw(QPainter *painter, const QPointF &pos, const QVector<QTextLayout::FormatRange> &selections) const;
+
+    //! A laid out text that is shared with every other user of the same text, font, option and width
+    /** Timestamps repeat every minute and a chat has only a few senders, so their columns take the
+     *  layouts from here instead of one per line. The text colour is the painter's pen, so it isn't part
+     *  of the key. Shared layouts must not be given another width, ask for a new one instead.
+     *  Only to be used on the GUI thread. */
+    static QSharedPointer<PlainTextLayout> shared(const QString &text, const QFont &font, const QTextOption &option, qreal width);
+    static int sharedCount();
+    //! Drops the shared layouts nobody but the cache holds on to
+    static void clearShared();
+
+    static const int DOCUMENT_MARGIN = 4; // QTextDocument's default documentMargin
+    static const int SHARED_CACHE_SIZE = 1024;
+
+private:
+    void doLayout();
+
+    QString _text;
+    QTextLayout _layout;
+    qreal _width;
+    qreal _height;
+
+    // only for text that is laid out in a single line
+    mutable QStaticText _staticText;
+    mutable bool _staticTextValid;
+};
+
+#endif // PLAINTEXTLAYOUT_HPP
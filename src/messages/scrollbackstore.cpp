@@ -0,0 +1,102 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "scrollbackstore.hpp"
+#include "messagestore.hpp"
+#include "historywriter.hpp"
+#include "Settings/settings.hpp"
+
+#include <QDebug>
+#include <QDir>
+
+#include <sodium.h>
+
+ScrollbackStore::ScrollbackStore() :
+    mFile(Settings::getSettingsDirPath() + "/scrollback/XXXXXX"),
+    mKey(crypto_aead_xchacha20poly1305_ietf_KEYBYTES, Qt::Uninitialized),
+    mCount(0)
+{
+    randombytes_buf(mKey.data(), mKey.size());
+}
+
+ScrollbackStore::~ScrollbackStore()
+{
+    sodium_memzero(mKey.data(), mKey.size());
+}
+
+bool ScrollbackStore::push(const MessageStore &store, int row, int count)
+{
+    if (!mFile.isOpen() && !(QDir().mkpath(Settings::getSettingsDirPath() + "/scrollback") && mFile.open())) {
+        qWarning() << "ScrollbackStore: couldn't open" << mFile.fileName();
+        return false;
+    }
+
+    QByteArray buffer;
+    MessageEncoder encoder(buffer);
+    store.encode(encoder, row, count);
+    // sealed together with its place on the stack, so buffers can't be swapped around
+    buffer = HistoryWriter::encryptRecord(buffer, MsgId(mChunks.count()), mKey);
+
+    const qint64 oldSize = mFile.size();
+    mFile.seek(oldSize);
+    if (mFile.write(buffer) != buffer.size()) {
+        qWarning() << "ScrollbackStore: couldn't write to" << mFile.fileName();
+        mFile.resize(oldSize);
+        return false;
+    }
+
+    Chunk chunk;
+    chunk.offset = oldSize;
+    chunk.count = count;
+    mChunks << chunk;
+    mCount += count;
+    return true;
+}
+
+QList<QByteArray> ScrollbackStore::pop(int count)
+{
+    QList<QByteArray> buffers;
+    if (mChunks.isEmpty())
+        return buffers;
+
+    int first = mChunks.count() - 1;
+    int popped = mChunks.at(first).count;
+    while (first > 0 && popped + mChunks.at(first - 1).count <= count)
+        popped += mChunks.at(--first).count;
+
+    qint64 end = mFile.size();
+    for (int i = mChunks.count() - 1; i >= first; i--) {
+        const qint64 offset = mChunks.at(i).offset;
+        mFile.seek(offset);
+        // one that can't be decrypted comes back empty and is dropped by the model
+        buffers.prepend(HistoryWriter::decryptRecord(mFile.read(end - offset), MsgId(i), mKey));
+        end = offset;
+    }
+
+    mFile.resize(end);
+    mChunks.resize(first);
+    mCount -= popped;
+    return buffers;
+}
+
+void ScrollbackStore::clear()
+{
+    if (mFile.isOpen())
+        mFile.resize(0);
+    mChunks.clear();
+    mCount = 0;
+}
@@ -0,0 +1,66 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef SCROLLBACKSTORE_HPP
+#define SCROLLBACKSTORE_HPP
+
+#include <QByteArray>
+#include <QTemporaryFile>
+#include <QVector>
+#include "messagecodec.hpp"
+
+class MessageStore;
+
+/**
+ * Keeps the messages a MessageModel evicted from memory in a temporary file.
+ * Messages are always evicted from the top of the model and fetched back to
+ * the top, so the file is used as a stack: the newest evicted message is last.
+ * Every push is written as one MessageCodec buffer and popped back as a whole,
+ * its records are delta encoded against each other.
+ * The file is kept in the settings directory and every buffer is sealed like a
+ * HistoryWriter record, with a random key that never leaves memory: what is read
+ * back is only needed by this session, whether the chat is logged or not.
+ */
+class ScrollbackStore
+{
+public:
+    ScrollbackStore();
+    ~ScrollbackStore();
+
+    inline int count() const { return mCount; }
+    inline bool isEmpty() const { return mChunks.isEmpty(); }
+
+    //! Appends count rows of store from row on, oldest first. Returns false if they couldn't be written.
+    bool push(const MessageStore &store, int row, int count);
+    //! Removes and returns the most recently pushed buffers, oldest first
+    /** At least one buffer is popped, and then as many as fit into count messages. */
+    QList<QByteArray> pop(int count);
+    void clear();
+
+private:
+    struct Chunk {
+        qint64 offset;
+        int count;
+    };
+
+    QTemporaryFile mFile;
+    QByteArray mKey;
+    QVector<Chunk> mChunks;
+    int mCount;
+};
+
+#endif // SCROLLBACKSTORE_HPP
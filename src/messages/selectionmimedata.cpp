@@ -0,0 +1,135 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "selectionmimedata.hpp"
+#include "messagemodel.hpp"
+
+static const QString plainMimeType = QStringLiteral("text/plain");
+static const QString htmlMimeType  = QStringLiteral("text/html");
+
+SelectionMimeData::SelectionMimeData(QAbstractItemModel *model, int firstRow, int lastRow, int columns) :
+    _model(model),
+    _firstMsgId(model->index(firstRow, 0).data(MessageModel::MsgIdRole).value<MsgId>()),
+    _lastMsgId(model->index(lastRow, 0).data(MessageModel::MsgIdRole).value<MsgId>()),
+    _columns(columns)
+{
+}
+
+QStringList SelectionMimeData::formats() const
+{
+    return QStringList() << plainMimeType << htmlMimeType;
+}
+
+bool SelectionMimeData::hasFormat(const QString &mimeType) const
+{
+    return mimeType == plainMimeType || mimeType == htmlMimeType;
+}
+
+QVariant SelectionMimeData::retrieveData(const QString &mimeType, QVariant::Type type) const
+{
+    Q_UNUSED(type)
+
+    if (mimeType == plainMimeType)
+        return plainText();
+    if (mimeType == htmlMimeType)
+        return htmlText();
+    return QVariant();
+}
+
+int SelectionMimeData::lowerBound(MsgId msgId) const
+{
+    int first = 0;
+    int count = _model->rowCount();
+    while (count > 0) {
+        int step = count / 2;
+        if (_model->index(first + step, 0).data(MessageModel::MsgIdRole).value<MsgId>() < msgId) {
+            first += step + 1;
+            count -= step + 1;
+        }
+        else
+            count = step;
+    }
+    return first;
+}
+
+bool SelectionMimeData::currentRows(int *first, int *last) const
+{
+    if (!_model)
+        return false;
+
+    *first = lowerBound(_firstMsgId);
+    *last = lowerBound(_lastMsgId);
+    if (*last == _model->rowCount() || _model->index(*last, 0).data(MessageModel::MsgIdRole).value<MsgId>() != _lastMsgId)
+        (*last)--;
+    return *first <= *last;
+}
+
+QString SelectionMimeData::display(int row, int column) const
+{
+    return _model->index(row, column).data(MessageModel::DisplayRole).toString();
+}
+
+QString SelectionMimeData::plainText() const
+{
+    if (!_plainText.isNull())
+        return _plainText;
+
+    int first, last;
+    if (!currentRows(&first, &last))
+        return QString("");
+
+    QString text;
+    for (int row = first; row <= last; row++) {
+        if (_columns & Timestamps)
+            text += QLatin1Char('[') + display(row, MessageModel::TimestampColumn) + QLatin1String("] ");
+        if (_columns & Senders)
+            text += display(row, MessageModel::SenderColumn) + QLatin1String(": ");
+        if (_columns & Contents)
+            text += display(row, MessageModel::ContentsColumn);
+        if (row < last)
+            text += QLatin1Char('\n');
+    }
+
+    _plainText = text;
+    return _plainText;
+}
+
+QString SelectionMimeData::htmlText() const
+{
+    if (!_htmlText.isNull())
+        return _htmlText;
+
+    int first, last;
+    if (!currentRows(&first, &last))
+        return QString("");
+
+    QString html = QLatin1String("<html><body>\n");
+    for (int row = first; row <= last; row++) {
+        html += QLatin1String("<div>");
+        if (_columns & Timestamps)
+            html += QLatin1String("<span>[") + display(row, MessageModel::TimestampColumn).toHtmlEscaped() + QLatin1String("]</span> ");
+        if (_columns & Senders)
+            html += QLatin1String("<b>") + display(row, MessageModel::SenderColumn).toHtmlEscaped() + QLatin1String(":</b> ");
+        if (_columns & Contents)
+            html += display(row, MessageModel::ContentsColumn).toHtmlEscaped().replace(QLatin1Char('\n'), QLatin1String("<br>"));
+        html += QLatin1String("</div>\n");
+    }
+    html += QLatin1String("</body></html>");
+
+    _htmlText = html;
+    return _htmlText;
+}
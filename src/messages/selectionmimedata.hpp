@@ -0,0 +1,73 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef SELECTIONMIMEDATA_HPP
+#define SELECTIONMIMEDATA_HPP
+
+#include <QMimeData>
+#include <QPointer>
+#include "id.hpp"
+
+class QAbstractItemModel;
+
+/**
+ * The rows of a global ChatScene selection, for the clipboard and for drags.
+ * Nothing is formatted until a target asks for text/plain or text/html, which for the X11 clipboard and
+ * most drops only happens when the user pastes. The text is then serialized from the model, row by
+ * row and without going through the ChatItems. The rows are remembered by their msgIds, so the data
+ * stays right while messages are inserted above, rows evicted from the model meanwhile are left out.
+ */
+class SelectionMimeData : public QMimeData
+{
+    Q_OBJECT
+public:
+    enum Column {
+        Timestamps = 0x01,
+        Senders    = 0x02,
+        Contents   = 0x04
+    };
+
+    SelectionMimeData(QAbstractItemModel *model, int firstRow, int lastRow, int columns);
+
+    virtual QStringList formats() const;
+    virtual bool hasFormat(const QString &mimeType) const;
+
+    //! [timestamp] sender: contents, one line per row
+    QString plainText() const;
+    QString htmlText() const;
+
+protected:
+    virtual QVariant retrieveData(const QString &mimeType, QVariant::Type type) const;
+
+private:
+    //! The current rows of the selected messages, false if none of them are left
+    bool currentRows(int *first, int *last) const;
+    //! The first row with a msgId not less than msgId, rows are ordered by msgId
+    int lowerBound(MsgId msgId) const;
+    QString display(int row, int column) const;
+
+    QPointer<QAbstractItemModel> _model;
+    MsgId _firstMsgId;
+    MsgId _lastMsgId;
+    int _columns;
+
+    // generated on the first request, targets tend to ask more than once
+    mutable QString _plainText;
+    mutable QString _htmlText;
+};
+
+#endif // SELECTIONMIMEDATA_HPP
@@ -17,11 +17,13 @@
 #include "smiley.hpp"
 #include <smileypack.hpp>
 #include "Settings/settings.hpp"
-#include <QMapIterator>
 #include <QDebug>
 #include <QApplication>
+#include <algorithm>
 
 #include "clickable.hpp"
+#include "smileymatcher.hpp"
+#include "stringpool.hpp"
 
 Smiley::Smiley(const QString &text, const QString &graphics, int start, int smileyfiedStart, Type type)
 {
@@ -35,87 +37,71 @@ Smiley::Smiley(const QString &text, const QString &graphics, int start, int smil
 }
 
 // Find smileys with original positions
-SmileyList SmileyList::fromText(QString text)
+SmileyList SmileyList::fromText(const QString &text, const ClickableList &clickables)
 {
     // Get current smileypack
-    Settings &settings = Settings::getInstance();
-    Smileypack pack(settings.getSmileyPack());
-
-    // Reconvert emoji
-    if (!pack.isEmoji()) {
-        text = Smileypack::deemojify(text);
+    std::shared_ptr<const Settings::Snapshot> settings = Settings::getInstance().snapshot();
+    QSharedPointer<const Smileypack> currentPack = Smileypack::current();
+    const Smileypack &pack = *currentPack;
+
+    // the automaton belongs to the pack it was built for
+    static QSharedPointer<const Smileypack> matcherPack;
+    static QSharedPointer<SmileyMatcher> matcher;
+    if (matcherPack != currentPack) {
+        matcher = QSharedPointer<SmileyMatcher>(new SmileyMatcher(pack.getList()));
+        matcherPack = currentPack;
     }
 
     SmileyList result;
-    ClickableList clickables = ClickableList::fromString(text);
+    result.mOffsets.append(0);
 
-    // Whlie smileys found to replace
-    bool found;
-    int searchStart = 0;
     int offset = 0;
-    do {
-        found = false;
-
-        // Fill a map with positions of possible smileys
-        QMap<int, QStringList> possibleTexts;
-        for (const auto& pair : pack.getList()) {
-            for (const QString& smileytext : pair.second) {
-                int pos = text.indexOf(smileytext, searchStart);
-                if (pos > -1) {
-                    possibleTexts.insertMulti(pos, {smileytext, pair.first});
-                    found = true;
-                }
-            }
+    for (const SmileyMatcher::Match &match : matcher->findAll(text)) {
+        // Check if there is a clickable
+        if (clickables.atCursorPos(match.start).isValid())
+            continue;
+
+        // a chat uses the same few smileys over and over, their strings are shared by all of them
+        StringPool &strings = StringPool::instance();
+        QString repSrt = strings.intern(text.constData() + match.start, match.length);
+        QString repRep = strings.intern(pack.getList().at(match.smiley).first);
+
+        // Add found smiley to List
+        Smiley smile = Smiley(repSrt, repRep, match.start, match.start - offset, (pack.isEmoji()) ? Smiley::Emoji : Smiley::Pixmap );
+        if (pack.isEmoji() && settings->customEmojiFont) {
+            QFont f = QApplication::font();
+            f.setFamily(settings->emojiFontFamily);
+            f.setPointSize(settings->emojiFontPointSize);
+            smile.setEmojiFont(f);
         }
+        result.append(smile);
 
-        // check the first smiley alternative representations
-        QMapIterator<int, QStringList> first(possibleTexts);
-        if (first.hasNext()) {
-            first.next();
-
-            int length = first.value().first().count();
-            QString repSrt = first.value().first();
-            int     repPos = first.key();
-            QString repRep = first.value().at(1);
-
-            QMapIterator<int, QStringList> i(possibleTexts);
-            i.next();
-
-            // Search for a longer smileyrepresentation at same position
-            while (i.hasNext() && i.key() < first.key() + length) {
-                i.next();
-
-                // If there is a longer smileyrepresentation, use it
-                if (i.value().count() > length) {
-                    repPos = i.key();
-                    repSrt = i.value().first();
-                    repRep = i.value().at(1);
-                }
-            }
-
-            // Check if there is a clickable
-            if(!clickables.atCursorPos(repPos).isValid()) {
-
-                // Add found smiley to List
-                Smiley smile = Smiley(repSrt, repRep, repPos, repPos - offset, (pack.isEmoji()) ? Smiley::Emoji : Smiley::Pixmap );
-                if (pack.isEmoji() && settings.isCurstomEmojiFont()) {
-                    QFont f = QApplication::font();
-                    f.setFamily(settings.getEmojiFontFamily());
-                    f.setPointSize(settings.getEmojiFontPointSize());
-                    smile.setEmojiFont(f);
-                }
-                result.append(smile);
-
-                // calculate offset for next smiley
-                offset += repSrt.count() - ((pack.isEmoji()) ? repRep.count() : 1);
-            }
-            searchStart = repPos + repSrt.count();
-        }
-    } while (found);
+        // calculate offset for next smiley
+        offset += repSrt.count() - ((pack.isEmoji()) ? repRep.count() : 1);
+        result.mOffsets.append(offset);
+    }
 
     return result;
 }
 
+int SmileyList::originalPosition(int smileyfiedPos) const
+{
+    // smileys starting before the position are replaced in front of it
+    auto it = std::lower_bound(constBegin(), constEnd(), smileyfiedPos, [](const Smiley &s, int pos) {
+        return s.smileyfiedStart() < pos;
+    });
+    return smileyfiedPos + offsetBefore(it - constBegin());
+}
+
+int SmileyList::firstEndingFrom(int pos) const
+{
+    // smileys don't overlap, so their ends are sorted like their starts
+    auto it = std::lower_bound(constBegin(), constEnd(), pos, [](const Smiley &s, int pos) {
+        return s.start() + s.textLength() - 1 < pos;
+    });
+    return it - constBegin();
+}
+
 
 QDebug operator<<(QDebug dbg, const Smiley &smiley)
 {
@@ -19,8 +19,11 @@
 
 #include <QString>
 #include <QList>
+#include <QVector>
 #include <QFont>
 
+class ClickableList;
+
 class Smiley
 {
 public:
@@ -59,7 +62,20 @@ private:
 class SmileyList : public QList<Smiley>
 {
 public:
-    static SmileyList fromText(QString text);
+    //! Finds the smileys of the current pack in text, except for those inside a clickable
+    /** For a pack without emoji, text is expected to have its emoji replaced already, see Smileypack::deemojify() */
+    static SmileyList fromText(const QString &text, const ClickableList &clickables);
+
+    //! Position in the original text of a position in the smileyfied text
+    int originalPosition(int smileyfiedPos) const;
+    //! Index of the first smiley whose original text ends at or after pos, count() if none
+    int firstEndingFrom(int pos) const;
+    //! How much longer the original text is than the smileyfied one, up to smiley i
+    inline int offsetBefore(int i) const { return mOffsets.value(i); }
+
+private:
+    // prefix sums of the length differences, filled by fromText()
+    QVector<int> mOffsets;
 };
 
 QDebug operator<<(QDebug dbg, const Smiley &smiley);
@@ -0,0 +1,121 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "smileymatcher.hpp"
+
+#include <algorithm>
+
+SmileyMatcher::SmileyMatcher(const Smileypack::SmileypackList &list)
+{
+    Node root;
+    root.fail = 0;
+    root.smiley = -1;
+    root.output = -1;
+    root.depth = 0;
+    mNodes << root;
+
+    for (int i = 0; i < list.count(); i++) {
+        for (const QString &text : list.at(i).second)
+            addPattern(text, i);
+    }
+    buildLinks();
+}
+
+void SmileyMatcher::addPattern(const QString &pattern, int smiley)
+{
+    if (pattern.isEmpty())
+        return;
+
+    int node = 0;
+    for (const QChar &c : pattern) {
+        int next = mNodes.at(node).next.value(c, -1);
+        if (next < 0) {
+            Node child;
+            child.fail = 0;
+            child.smiley = -1;
+            child.output = -1;
+            child.depth = mNodes.at(node).depth + 1;
+            next = mNodes.count();
+            mNodes << child;
+            mNodes[node].next.insert(c, next);
+        }
+        node = next;
+    }
+
+    // the first smiley with a text keeps it
+    if (mNodes.at(node).smiley < 0)
+        mNodes[node].smiley = smiley;
+}
+
+// breadth first, so the fail link of a node's parent is always done
+void SmileyMatcher::buildLinks()
+{
+    QVector<int> queue;
+    for (int child : mNodes.at(0).next)
+        queue << child;
+
+    for (int i = 0; i < queue.count(); i++) {
+        int node = queue.at(i);
+        QHash<QChar, int>::const_iterator it = mNodes.at(node).next.constBegin();
+        for (; it != mNodes.at(node).next.constEnd(); ++it) {
+            int child = it.value();
+            int fail = mNodes.at(node).fail;
+            while (fail > 0 && !mNodes.at(fail).next.contains(it.key()))
+                fail = mNodes.at(fail).fail;
+            mNodes[child].fail = mNodes.at(fail).next.value(it.key(), 0);
+
+            int childFail = mNodes.at(child).fail;
+            mNodes[child].output = mNodes.at(childFail).smiley >= 0 ? childFail : mNodes.at(childFail).output;
+            queue << child;
+        }
+    }
+}
+
+QVector<SmileyMatcher::Match> SmileyMatcher::findAll(const QString &text) const
+{
+    QVector<Match> matches;
+    int node = 0;
+    for (int pos = 0; pos < text.length(); pos++) {
+        QChar c = text.at(pos);
+        while (node > 0 && !mNodes.at(node).next.contains(c))
+            node = mNodes.at(node).fail;
+        node = mNodes.at(node).next.value(c, 0);
+
+        for (int out = mNodes.at(node).smiley >= 0 ? node : mNodes.at(node).output; out >= 0; out = mNodes.at(out).output) {
+            Match match;
+            match.length = mNodes.at(out).depth;
+            match.start = pos - match.length + 1;
+            match.smiley = mNodes.at(out).smiley;
+            matches << match;
+        }
+    }
+
+    // leftmost, then longest
+    std::sort(matches.begin(), matches.end(), [](const Match &a, const Match &b) {
+        return a.start != b.start ? a.start < b.start : a.length > b.length;
+    });
+
+    QVector<Match> result;
+    int end = 0;
+    for (const Match &match : matches) {
+        if (match.start >= end) {
+            result << match;
+            end = match.start + match.length;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,60 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef SMILEYMATCHER_HPP
+#define SMILEYMATCHER_HPP
+
+#include <QHash>
+#include <QStringList>
+#include <QVector>
+#include "smileypack.hpp"
+
+/**
+ * Finds the smileys of a pack in a text with an Aho-Corasick automaton, in a single pass over the text
+ * whatever the size of the pack. Of overlapping smileys the leftmost wins, and of those starting at
+ * the same position the longest.
+ */
+class SmileyMatcher
+{
+public:
+    struct Match {
+        int start;
+        int length;
+        int smiley; // index into the pack list
+    };
+
+    explicit SmileyMatcher(const Smileypack::SmileypackList &list);
+
+    //! All smileys in text, without overlaps and sorted by position
+    QVector<Match> findAll(const QString &text) const;
+
+private:
+    struct Node {
+        QHash<QChar, int> next;
+        int fail;
+        int smiley;  // the smiley ending here, -1 if none
+        int output;  // the next node on the fail chain that ends a smiley, -1 if none
+        int depth;
+    };
+
+    void addPattern(const QString &pattern, int smiley);
+    void buildLinks();
+
+    QVector<Node> mNodes;
+};
+
+#endif // SMILEYMATCHER_HPP
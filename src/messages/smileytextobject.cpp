@@ -17,29 +17,77 @@
 #include "smileytextobject.hpp"
 #include <QPainter>
 
+QHash<QPair<QString, int>, QPixmap> SmileyTextObject::sPixmaps;
 
-SmileyTextObject::SmileyTextObject(const QString &pixmap)
+SmileyTextObject::SmileyTextObject(QObject *parent) :
+    QObject(parent)
 {
-    mImage = QImage(pixmap);
+}
+
+QTextCharFormat SmileyTextObject::smileyFormat(const QString &path, const QTextCharFormat &base)
+{
+    QTextCharFormat format = base;
+    format.setObjectType(SmileyFormat);
+    format.setProperty(PathProperty, path);
+    return format;
+}
+
+QPixmap SmileyTextObject::pixmap(const QString &path, int maxHeight, int devicePixelRatio)
+{
+    QPair<QString, int> key(path, maxHeight * devicePixelRatio);
+    QHash<QPair<QString, int>, QPixmap>::const_iterator it = sPixmaps.constFind(key);
+    if (it != sPixmaps.constEnd())
+        return it.value();
+
+    QImage image(path);
+    // the size in device independent pixels is the same on every screen, only big images gain detail
+    const int logicalHeight = qMin(image.height(), maxHeight);
+    if (image.height() > key.second)
+        image = image.scaledToHeight(key.second, Qt::SmoothTransformation);
+    // one pixmap per smiley, so its cache key and texture stay the same for every draw
+    QPixmap pixmap = QPixmap::fromImage(image);
+    if (logicalHeight > 0)
+        pixmap.setDevicePixelRatio(qreal(pixmap.height()) / logicalHeight);
+    sPixmaps.insert(key, pixmap);
+    return pixmap;
+}
+
+qint64 SmileyTextObject::cachedImageBytes()
+{
+    qint64 bytes = 0;
+    foreach (const QPixmap &pixmap, sPixmaps)
+        bytes += qint64(pixmap.width()) * pixmap.height() * pixmap.depth() / 8;
+    return bytes;
+}
+
+void SmileyTextObject::forgetImage(const QString &path)
+{
+    QHash<QPair<QString, int>, QPixmap>::iterator it = sPixmaps.begin();
+    while (it != sPixmaps.end()) {
+        if (it.key().first == path)
+            it = sPixmaps.erase(it);
+        else
+            ++it;
+    }
+}
+
+void SmileyTextObject::clearImages()
+{
+    sPixmaps.clear();
 }
 
 QSizeF SmileyTextObject::intrinsicSize(QTextDocument *doc, int posInDocument, const QTextFormat &format)
 {
     Q_UNUSED(doc)
     Q_UNUSED(posInDocument)
-    Q_UNUSED(format)
-    QSize size = mImage.size();
-
-    if (size.height() > 25)
-        size *= 25.0 / (double) size.height();
 
-    return QSizeF(size);
+    return QSizeF(pixmap(format.stringProperty(PathProperty), MAX_HEIGHT).size());
 }
 
 void SmileyTextObject::drawObject(QPainter *painter, const QRectF &rect, QTextDocument *doc, int posInDocument, const QTextFormat &format)
 {
     Q_UNUSED(doc)
     Q_UNUSED(posInDocument)
-    Q_UNUSED(format)
-    painter->drawImage(rect, mImage);
+    QPixmap smiley = pixmap(format.stringProperty(PathProperty), MAX_HEIGHT, painter->device()->devicePixelRatio());
+    painter->drawPixmap(rect, smiley, smiley.rect());
 }
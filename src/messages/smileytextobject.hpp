@@ -18,19 +18,48 @@
 #define SMILEYTEXTOBJECT_HPP
 
 #include <QTextObjectInterface>
+#include <QHash>
+#include <QPixmap>
+#include <QPair>
 
+//! Draws the pixmap smileys of a QTextDocument
+/** One handler serves all smileys of a document, the image path is a property of the
+ *  character format. Images are decoded and scaled once, and shared by all documents.
+ *  They are kept as pixmaps, which a GL viewport keeps as textures between frames, and per
+ *  device pixel ratio, so smileys stay sharp on every screen. */
 class SmileyTextObject : public QObject, public QTextObjectInterface
 {
     Q_OBJECT
     Q_INTERFACES(QTextObjectInterface)
 public:
-    SmileyTextObject(const QString &pixmap);
+    enum {
+        SmileyFormat = QTextFormat::UserObject + 1,
+        PathProperty = QTextFormat::UserProperty + 1
+    };
+
+    explicit SmileyTextObject(QObject *parent = 0);
+
+    //! A format for a smiley character drawn by this handler
+    static QTextCharFormat smileyFormat(const QString &path, const QTextCharFormat &base = QTextCharFormat());
 
     QSizeF intrinsicSize(QTextDocument *doc, int posInDocument, const QTextFormat &format);
     void drawObject(QPainter *painter, const QRectF &rect, QTextDocument *doc, int posInDocument, const QTextFormat &format);
 
+    static const int MAX_HEIGHT = 25;
+
+    //! Bytes held by the decoded images, which all chats share
+    static qint64 cachedImageBytes();
+    //! Drops the decoded image, it is read again next time it's drawn
+    static void forgetImage(const QString &path);
+    //! Drops all decoded images, see MemoryPressure
+    static void clearImages();
+
 private:
-    QImage mImage;
+    //! The image at most maxHeight device independent pixels high, with devicePixelRatio set
+    static QPixmap pixmap(const QString &path, int maxHeight, int devicePixelRatio = 1);
+
+    // decoded and scaled images, by path and height limit in device pixels
+    static QHash<QPair<QString, int>, QPixmap> sPixmaps;
 };
 
 #endif // SMILEYTEXTOBJECT_HPP
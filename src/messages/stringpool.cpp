@@ -0,0 +1,46 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "stringpool.hpp"
+
+StringPool &StringPool::instance()
+{
+    static StringPool pool;
+    return pool;
+}
+
+QString StringPool::intern(const QString &string)
+{
+    if (string.length() > MAX_LENGTH)
+        return string;
+
+    QSet<QString>::const_iterator it = mStrings.constFind(string);
+    if (it != mStrings.constEnd())
+        return *it;
+    return *mStrings.insert(string);
+}
+
+QString StringPool::intern(const QChar *data, int length)
+{
+    if (length > MAX_LENGTH)
+        return QString(data, length);
+
+    // the raw string is only good for the lookup, it doesn't own data
+    QSet<QString>::const_iterator it = mStrings.constFind(QString::fromRawData(data, length));
+    if (it != mStrings.constEnd())
+        return *it;
+    return *mStrings.insert(QString(data, length));
+}
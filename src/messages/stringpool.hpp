@@ -0,0 +1,54 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef STRINGPOOL_HPP
+#define STRINGPOOL_HPP
+
+#include <QSet>
+#include <QString>
+
+//! Interning table for the short strings chats repeat on every line
+/** Sender names and smiley texts and graphics are the same handful of strings across
+ *  hundreds of thousands of lines. Interned, equal strings share one implicitly shared
+ *  buffer, so they cost a reference count instead of an allocation and two interned
+ *  strings are equal exactly if isSame() says so.
+ *  Strings longer than MAX_LENGTH are returned as they are, contents don't belong here.
+ *  Not thread safe, only the GUI thread builds chat lines.
+ */
+class StringPool
+{
+public:
+    static StringPool &instance();
+
+    QString intern(const QString &string);
+    //! Like intern(const QString &), but only allocates if the string isn't known yet
+    QString intern(const QChar *data, int length);
+
+    //! Equality of two interned strings, a pointer comparison
+    static inline bool isSame(const QString &a, const QString &b) { return a.constData() == b.constData(); }
+
+    inline int count() const { return mStrings.count(); }
+
+    static const int MAX_LENGTH = 64;
+
+private:
+    StringPool() {}
+    Q_DISABLE_COPY(StringPool)
+
+    QSet<QString> mStrings;
+};
+
+#endif // STRINGPOOL_HPP
@@ -0,0 +1,253 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "thumbnailcache.hpp"
+#include "memorypressure.hpp"
+
+#include <QBuffer>
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QStandardPaths>
+#include <QThreadPool>
+#include <QUrl>
+
+const int ThumbnailCache::PREVIEW_WIDTH;
+const int ThumbnailCache::PREVIEW_HEIGHT;
+
+ThumbnailCache *ThumbnailCache::instance()
+{
+    // goes with the application, along with its network access manager
+    static ThumbnailCache *cache = new ThumbnailCache(QCoreApplication::instance());
+    return cache;
+}
+
+ThumbnailCache::ThumbnailCache(QObject *parent) :
+    QObject(parent),
+    _network(nullptr),
+    _diskDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/thumbnails"),
+    _writesSincePrune(PRUNE_INTERVAL) // the first write looks at what earlier sessions left
+{
+    _memory.setMaxCost(MEMORY_LIMIT);
+
+    // they're read back from the disk cache, which stays
+    MemoryPressure::getInstance().registerCache(this, MemoryPressure::Thumbnails, [this](MemoryPressure::Level) {
+        _memory.clear();
+    });
+}
+
+bool ThumbnailCache::isPreviewable(const QString &url)
+{
+    static const char *const suffixes[] = { ".png", ".jpg", ".jpeg", ".gif", ".bmp", ".webp" };
+
+    if (!url.startsWith("http://", Qt::CaseInsensitive) && !url.startsWith("https://", Qt::CaseInsensitive)
+            && !url.startsWith("file://", Qt::CaseInsensitive))
+        return false;
+
+    // the extension of the path, without query or fragment
+    QString path = QUrl(url, QUrl::TolerantMode).path();
+    for (const char *suffix : suffixes) {
+        if (path.endsWith(QLatin1String(suffix), Qt::CaseInsensitive))
+            return true;
+    }
+    return false;
+}
+
+QString ThumbnailCache::localFile(const QString &url)
+{
+    QUrl u = QUrl::fromEncoded(url.toUtf8(), QUrl::TolerantMode);
+    if (u.host().compare("localhost", Qt::CaseInsensitive) == 0)
+        u.setHost(QString());
+    return u.toLocalFile();
+}
+
+bool ThumbnailCache::isLoaded(const QString &url, int devicePixelRatio) const
+{
+    return _memory.contains(key(url, devicePixelRatio)) || _failed.contains(url);
+}
+
+QPixmap ThumbnailCache::thumbnail(const QString &url, int devicePixelRatio)
+{
+    const QString k = key(url, devicePixelRatio);
+    if (QPixmap *pixmap = _memory.object(k))
+        return *pixmap;
+
+    if (!_loading.contains(k) && !_failed.contains(url)) {
+        _loading.insert(k);
+        // remote images are only downloaded if the disk cache doesn't have them
+        bool remote = !url.startsWith("file://", Qt::CaseInsensitive);
+        startJob(url, devicePixelRatio, QByteArray(), remote);
+    }
+    return QPixmap();
+}
+
+QString ThumbnailCache::key(const QString &url, int devicePixelRatio)
+{
+    return devicePixelRatio > 1 ? url + '@' + QString::number(devicePixelRatio) : url;
+}
+
+QString ThumbnailCache::diskPath(const QString &key) const
+{
+    return _diskDir + '/' + QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1).toHex() + ".thumb";
+}
+
+void ThumbnailCache::startJob(const QString &url, int devicePixelRatio, const QByteArray &data, bool cacheOnly)
+{
+    ThumbnailJob *job = new ThumbnailJob(url, devicePixelRatio, data, cacheOnly, diskPath(key(url, devicePixelRatio)));
+    if (!cacheOnly && ++_writesSincePrune >= PRUNE_INTERVAL) {
+        job->setPrune(_diskDir, DISK_LIMIT);
+        _writesSincePrune = 0;
+    }
+    connect(job, &ThumbnailJob::loaded, this, &ThumbnailCache::onThumbnailLoaded);
+    connect(job, &ThumbnailJob::notCached, this, &ThumbnailCache::onNotCached);
+    QThreadPool::globalInstance()->start(job);
+}
+
+void ThumbnailCache::onThumbnailLoaded(const QString &url, int devicePixelRatio, const QImage &image)
+{
+    const QString k = key(url, devicePixelRatio);
+    _loading.remove(k);
+    if (image.isNull()) {
+        _failed.insert(url);
+    }
+    else {
+        // pixmaps may only be created on the GUI thread
+        QPixmap *pixmap = new QPixmap(QPixmap::fromImage(image));
+        pixmap->setDevicePixelRatio(devicePixelRatio);
+        _memory.insert(k, pixmap, qMax(1, pixmap->width() * pixmap->height() * 4 / 1024));
+    }
+    emit thumbnailReady(url);
+}
+
+void ThumbnailCache::onNotCached(const QString &url, int devicePixelRatio)
+{
+    if (!_network)
+        _network = new QNetworkAccessManager(this);
+
+    QNetworkReply *reply = _network->get(QNetworkRequest(QUrl::fromEncoded(url.toUtf8(), QUrl::TolerantMode)));
+    _downloads.insert(reply, qMakePair(url, devicePixelRatio));
+    connect(reply, &QNetworkReply::downloadProgress, this, &ThumbnailCache::onDownloadProgress);
+    connect(reply, &QNetworkReply::finished, this, &ThumbnailCache::onDownloadFinished);
+}
+
+void ThumbnailCache::onDownloadProgress(qint64 received, qint64 total)
+{
+    if (received > MAX_DOWNLOAD_SIZE || total > MAX_DOWNLOAD_SIZE)
+        static_cast<QNetworkReply *>(sender())->abort();
+}
+
+void ThumbnailCache::onDownloadFinished()
+{
+    QNetworkReply *reply = static_cast<QNetworkReply *>(sender());
+    QPair<QString, int> download = _downloads.take(reply);
+    reply->deleteLater();
+
+    if (reply->error() != QNetworkReply::NoError) {
+        onThumbnailLoaded(download.first, download.second, QImage());
+        return;
+    }
+    startJob(download.first, download.second, reply->readAll(), false);
+}
+
+// ************************************************************
+// ThumbnailJob
+// ************************************************************
+
+ThumbnailJob::ThumbnailJob(const QString &url, int devicePixelRatio, const QByteArray &data, bool cacheOnly, const QString &diskPath) :
+    _url(url),
+    _devicePixelRatio(devicePixelRatio),
+    _data(data),
+    _cacheOnly(cacheOnly),
+    _diskPath(diskPath),
+    _pruneLimit(0)
+{
+}
+
+void ThumbnailJob::setPrune(const QString &dir, qint64 limit)
+{
+    _pruneDir = dir;
+    _pruneLimit = limit;
+}
+
+void ThumbnailJob::run()
+{
+    QImage image;
+    if (QFile::exists(_diskPath) && image.load(_diskPath)) {
+        emit loaded(_url, _devicePixelRatio, image);
+        return;
+    }
+    if (_cacheOnly) {
+        emit notCached(_url, _devicePixelRatio);
+        return;
+    }
+
+    if (_data.isEmpty()) {
+        QFile file(ThumbnailCache::localFile(_url));
+        if (file.open(QIODevice::ReadOnly))
+            image = decode(&file, _devicePixelRatio);
+    }
+    else {
+        QBuffer buffer(&_data);
+        buffer.open(QIODevice::ReadOnly);
+        image = decode(&buffer, _devicePixelRatio);
+    }
+
+    // photos are a lot smaller as JPEG, only images with transparency need PNG
+    if (!image.isNull() && QDir().mkpath(QFileInfo(_diskPath).absolutePath()))
+        image.save(_diskPath, image.hasAlphaChannel() ? "PNG" : "JPG", 85);
+    emit loaded(_url, _devicePixelRatio, image);
+
+    if (!_pruneDir.isEmpty())
+        prune(_pruneDir, _pruneLimit);
+}
+
+QImage ThumbnailJob::decode(QIODevice *device, int devicePixelRatio)
+{
+    const int width = ThumbnailCache::PREVIEW_WIDTH * devicePixelRatio;
+    const int height = ThumbnailCache::PREVIEW_HEIGHT * devicePixelRatio;
+
+    QImageReader reader(device);
+    QSize size = reader.size();
+    if (size.isValid()) {
+        if ((qint64)size.width() * size.height() > MAX_PIXELS)
+            return QImage();
+        // JPEG is decoded at the reduced size right away, the other formats are scaled by the reader
+        if (size.width() > width || size.height() > height)
+            reader.setScaledSize(size.scaled(width, height, Qt::KeepAspectRatio));
+    }
+
+    QImage image = reader.read();
+    if (image.width() > width || image.height() > height)
+        image = image.scaled(width, height, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    return image;
+}
+
+void ThumbnailJob::prune(const QString &dir, qint64 limit)
+{
+    // newest first, everything after the limit is reached goes
+    QFileInfoList files = QDir(dir).entryInfoList(QStringList("*.thumb"), QDir::Files, QDir::Time);
+    qint64 total = 0;
+    for (const QFileInfo &file : files) {
+        total += file.size();
+        if (total > limit)
+            QFile::remove(file.absoluteFilePath());
+    }
+}
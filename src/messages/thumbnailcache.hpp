@@ -0,0 +1,135 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef THUMBNAILCACHE_HPP
+#define THUMBNAILCACHE_HPP
+
+#include <QCache>
+#include <QHash>
+#include <QImage>
+#include <QObject>
+#include <QPixmap>
+#include <QRunnable>
+#include <QSet>
+
+class QIODevice;
+class QNetworkAccessManager;
+class QNetworkReply;
+
+/**
+ * Thumbnails for the inline previews of image links and received image files.
+ * Images are decoded and scaled down on QThreadPool, the thumbnails are kept in memory as pixmaps
+ * and on disk as small files, both bounded in size. Remote images are fetched by a
+ * QNetworkAccessManager, which doesn't block the GUI thread either.
+ * Every thumbnail fits into PREVIEW_WIDTH x PREVIEW_HEIGHT, so a line reserves the space of its
+ * preview up front and doesn't change its height once the image arrives. Thumbnails are kept per
+ * device pixel ratio, a window moved to a denser screen gets sharp ones without dropping the others.
+ */
+class ThumbnailCache : public QObject
+{
+    Q_OBJECT
+public:
+    static ThumbnailCache *instance();
+
+    //! Whether a link gets a preview, by its scheme and file extension
+    static bool isPreviewable(const QString &url);
+    //! The path of a file: link, which may name localhost as its host
+    static QString localFile(const QString &url);
+
+    //! The thumbnail if it's in memory, otherwise a null pixmap and it's loaded in the background
+    /** It has devicePixelRatio set, its size in device independent pixels fits into the preview. */
+    QPixmap thumbnail(const QString &url, int devicePixelRatio);
+    //! Whether thumbnail() has its answer for url right away, a pixmap or that there is none
+    bool isLoaded(const QString &url, int devicePixelRatio) const;
+
+    static const int PREVIEW_WIDTH = 320;
+    static const int PREVIEW_HEIGHT = 180;
+
+signals:
+    //! Loading url is done, whether or not there is a thumbnail
+    void thumbnailReady(const QString &url);
+
+private slots:
+    void onThumbnailLoaded(const QString &url, int devicePixelRatio, const QImage &image);
+    void onNotCached(const QString &url, int devicePixelRatio);
+    void onDownloadProgress(qint64 received, qint64 total);
+    void onDownloadFinished();
+
+private:
+    explicit ThumbnailCache(QObject *parent);
+    void startJob(const QString &url, int devicePixelRatio, const QByteArray &data, bool cacheOnly);
+    //! url itself at the ratio 1, so thumbnails cached before ratios were kept apart stay valid
+    static QString key(const QString &url, int devicePixelRatio);
+    QString diskPath(const QString &key) const;
+
+    QCache<QString, QPixmap> _memory;   // by key()
+    QSet<QString> _loading;             // by key()
+    QSet<QString> _failed;              // by url, at any ratio
+    QNetworkAccessManager *_network;
+    QHash<QNetworkReply *, QPair<QString, int> > _downloads;
+    QString _diskDir;
+    int _writesSincePrune;
+
+    // in KB, the cost of a pixmap in _memory
+    static const int MEMORY_LIMIT = 16 * 1024;
+    static const qint64 DISK_LIMIT = 64 * 1024 * 1024;
+    // bigger downloads are aborted, nobody links a 100 MB picture to look at a thumbnail of it
+    static const qint64 MAX_DOWNLOAD_SIZE = 10 * 1024 * 1024;
+    // thumbnails written to disk between two looks at its usage
+    static const int PRUNE_INTERVAL = 50;
+};
+
+/**
+ * Loads one thumbnail on QThreadPool, from the disk cache if it's there. Otherwise the downloaded
+ * data or the local file is decoded at the reduced size right away where the format allows it,
+ * and the result is added to the disk cache.
+ */
+class ThumbnailJob : public QObject, public QRunnable
+{
+    Q_OBJECT
+public:
+    //! data is a downloaded image, empty for a local file. With cacheOnly nothing is decoded,
+    //! notCached() is emitted if the disk cache doesn't have the thumbnail
+    ThumbnailJob(const QString &url, int devicePixelRatio, const QByteArray &data, bool cacheOnly, const QString &diskPath);
+
+    void run();
+    //! Makes the job delete the oldest thumbnails of dir until they take at most limit bytes, once it's done
+    void setPrune(const QString &dir, qint64 limit);
+
+    //! An image scaled down to fit the preview at the ratio, a null one if device has none or it's unreasonably big
+    static QImage decode(QIODevice *device, int devicePixelRatio = 1);
+
+signals:
+    //! image is null if there is no thumbnail
+    void loaded(const QString &url, int devicePixelRatio, const QImage &image);
+    void notCached(const QString &url, int devicePixelRatio);
+
+private:
+    static void prune(const QString &dir, qint64 limit);
+
+    QString _url;
+    int _devicePixelRatio;
+    QByteArray _data;
+    bool _cacheOnly;
+    QString _diskPath;
+    QString _pruneDir;
+    qint64 _pruneLimit;
+
+    // the decoded image is never bigger than the preview, but the header may announce anything
+    static const qint64 MAX_PIXELS = 64 * 1024 * 1024;
+};
+
+#endif // THUMBNAILCACHE_HPP
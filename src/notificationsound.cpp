@@ -0,0 +1,194 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "notificationsound.hpp"
+#include "Settings/settings.hpp"
+
+#include <QApplication>
+#include <QAudioDeviceInfo>
+#include <QAudioOutput>
+#include <QDebug>
+#include <QFile>
+#include <QtEndian>
+#include <QTimer>
+
+NotificationSound::NotificationSound(QObject* parent) :
+    QObject(parent), loaded(false), samples(SOUND_COUNT), lastPlayed(SOUND_COUNT), output(nullptr), device(nullptr)
+{
+    feedTimer = new QTimer(this);
+    feedTimer->setInterval(FEED_INTERVAL);
+    connect(feedTimer, &QTimer::timeout, this, &NotificationSound::feed);
+}
+
+NotificationSound& NotificationSound::getInstance()
+{
+    // parented to the application, so that the output is closed before Qt goes away
+    static NotificationSound* sound = new NotificationSound(qApp);
+    return *sound;
+}
+
+bool NotificationSound::decodeWav(const QByteArray& data, QAudioFormat& format, QByteArray& samples)
+{
+    const uchar* bytes = reinterpret_cast<const uchar*>(data.constData());
+    if (data.size() < 12 || !data.startsWith("RIFF") || data.mid(8, 4) != "WAVE") {
+        return false;
+    }
+
+    bool hasFormat = false;
+    int pos = 12;
+    while (pos + 8 <= data.size()) {
+        const QByteArray id = data.mid(pos, 4);
+        const int size = qFromLittleEndian<quint32>(bytes + pos + 4);
+        pos += 8;
+        if (size < 0 || pos + size > data.size()) {
+            return false;
+        }
+
+        if (id == "fmt ") {
+            if (size < 16 || qFromLittleEndian<quint16>(bytes + pos) != 1 || qFromLittleEndian<quint16>(bytes + pos + 14) != 16) {
+                return false;
+            }
+            format.setCodec("audio/pcm");
+            format.setChannelCount(qFromLittleEndian<quint16>(bytes + pos + 2));
+            format.setSampleRate(qFromLittleEndian<quint32>(bytes + pos + 4));
+            format.setSampleSize(16);
+            format.setSampleType(QAudioFormat::SignedInt);
+            format.setByteOrder(QAudioFormat::LittleEndian);
+            hasFormat = true;
+        } else if (id == "data" && hasFormat) {
+            samples = data.mid(pos, size - size % (format.channelCount() * 2));
+            return true;
+        }
+
+        // chunks are padded to an even size
+        pos += size + (size & 1);
+    }
+
+    return false;
+}
+
+void NotificationSound::load()
+{
+    if (loaded) {
+        return;
+    }
+    loaded = true;
+
+    static const char* const files[SOUND_COUNT] = {
+        ":/sounds/new_message.wav",
+        ":/sounds/contact_logs_in.wav",
+        ":/sounds/contact_logs_out.wav",
+        ":/sounds/log_in.wav",
+        ":/sounds/log_out.wav",
+        ":/sounds/error.wav",
+        ":/sounds/incoming_call.wav",
+        ":/sounds/transfer_pending.wav",
+        ":/sounds/transfer_complete.wav"
+    };
+
+    for (int i = 0; i < SOUND_COUNT; i ++) {
+        QFile file(files[i]);
+        if (!file.open(QIODevice::ReadOnly)) {
+            qWarning() << "File " << files[i] << " cannot be opened";
+            continue;
+        }
+
+        QAudioFormat soundFormat;
+        QByteArray soundSamples;
+        if (!decodeWav(file.readAll(), soundFormat, soundSamples)) {
+            qWarning() << "File " << files[i] << " is not a 16-bit PCM WAV file";
+            continue;
+        }
+
+        // everything is mixed into one output, so all sounds have to match the first one
+        if (!format.isValid()) {
+            format = soundFormat;
+        } else if (soundFormat != format) {
+            qWarning() << "File " << files[i] << " doesn't have the same format as the other sounds";
+            continue;
+        }
+        samples[i] = soundSamples;
+    }
+
+    if (!format.isValid() || !QAudioDeviceInfo::defaultOutputDevice().isFormatSupported(format)) {
+        qWarning() << "Notification sounds can't be played on this audio device";
+        return;
+    }
+
+    output = new QAudioOutput(format, this);
+    output->setBufferSize(format.sampleRate() * format.channelCount() * 2 * LATENCY / 1000);
+    // push mode, the device stays open between sounds
+    device = output->start();
+}
+
+void NotificationSound::play(Sound sound)
+{
+    if (device == nullptr || samples[sound].isEmpty() || !Settings::getInstance().snapshot()->notificationSounds) {
+        return;
+    }
+
+    QElapsedTimer& last = lastPlayed[sound];
+    if (last.isValid() && last.elapsed() < COALESCE_INTERVAL) {
+        return;
+    }
+    last.start();
+
+    voices << Voice{sound, 0};
+    if (!feedTimer->isActive()) {
+        feedTimer->start();
+        feed();
+    }
+}
+
+void NotificationSound::feed()
+{
+    if (voices.isEmpty()) {
+        feedTimer->stop();
+        return;
+    }
+
+    const int frameSize = format.channelCount() * 2;
+    int size = output->bytesFree();
+    int remaining = 0;
+    for (const Voice& voice : voices) {
+        remaining = qMax(remaining, samples[voice.sound].size() - voice.offset);
+    }
+    size = qMin(size - size % frameSize, remaining);
+    if (size <= 0) {
+        return;
+    }
+
+    QByteArray buffer(size, 0);
+    qint16* out = reinterpret_cast<qint16*>(buffer.data());
+    for (QList<Voice>::iterator it = voices.begin(); it != voices.end(); ) {
+        const QByteArray& sound = samples[it->sound];
+        const qint16* in = reinterpret_cast<const qint16*>(sound.constData() + it->offset);
+        const int count = qMin(size, sound.size() - it->offset) / 2;
+        for (int i = 0; i < count; i ++) {
+            out[i] = static_cast<qint16>(qBound(-32768, out[i] + in[i], 32767));
+        }
+
+        it->offset += count * 2;
+        if (it->offset >= sound.size()) {
+            it = voices.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    device->write(buffer);
+}
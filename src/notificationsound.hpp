@@ -0,0 +1,80 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef NOTIFICATIONSOUND_HPP
+#define NOTIFICATIONSOUND_HPP
+
+#include <QAudioFormat>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QList>
+#include <QObject>
+#include <QVector>
+
+class QAudioOutput;
+class QIODevice;
+class QTimer;
+
+// Plays the notification sounds. They are decoded into memory once and mixed
+// into a single audio output that's opened once and kept open, so playing a
+// sound is just copying samples. Repeats of a sound within COALESCE_INTERVAL
+// are dropped, a burst of messages after a reconnect chimes once.
+class NotificationSound : public QObject
+{
+    Q_OBJECT
+public:
+    enum Sound {NewMessage, ContactLogsIn, ContactLogsOut, LogIn, LogOut, Error, IncomingCall, TransferPending, TransferComplete, SOUND_COUNT};
+
+    static NotificationSound& getInstance();
+
+    // decodes the sounds and opens the output, until then play() does nothing
+    void load();
+    void play(Sound sound);
+
+private:
+    NotificationSound(QObject* parent);
+
+    struct Voice
+    {
+        int sound;
+        int offset;
+    };
+
+    // only 16-bit PCM is supported, that's what we ship and what we mix
+    static bool decodeWav(const QByteArray& data, QAudioFormat& format, QByteArray& samples);
+
+    static const int COALESCE_INTERVAL = 1500;
+    // how often the output is topped up while something plays, in ms
+    static const int FEED_INTERVAL = 10;
+    // size of the output's buffer, in ms
+    static const int LATENCY = 50;
+
+    bool loaded;
+    QAudioFormat format;
+    QVector<QByteArray> samples;
+    QVector<QElapsedTimer> lastPlayed;
+    QList<Voice> voices;
+    QAudioOutput* output;
+    QIODevice* device;
+    QTimer* feedTimer;
+
+private slots:
+    void feed();
+
+};
+
+#endif // NOTIFICATIONSOUND_HPP
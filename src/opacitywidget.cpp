@@ -15,9 +15,8 @@
 */
 
 #include "opacitywidget.hpp"
-#include <QPropertyAnimation>
 #include <QGraphicsOpacityEffect>
-#include "Settings/settings.hpp"
+#include "animationdriver.hpp"
 
 OpacityWidget::OpacityWidget(QWidget *parent) :
     QWidget(parent)
@@ -26,16 +25,6 @@ OpacityWidget::OpacityWidget(QWidget *parent) :
     effect = new QGraphicsOpacityEffect(this);
     setGraphicsEffect(effect);
     setOpacity(1);
-
-    // Animation
-    if (Settings::getInstance().isAnimationEnabled())
-    {
-        animation = new QPropertyAnimation(this, "opacity");
-        animation->setDuration(210);
-        animation->setKeyValueAt(0, 0);
-        animation->setKeyValueAt(1, 1);
-        animation->setLoopCount(1);
-    }
 }
 
 qreal OpacityWidget::opacity() const
@@ -47,12 +36,18 @@ void OpacityWidget::setOpacity(qreal arg)
 {
     mOpacity = arg;
     effect->setOpacity(arg);
+    effect->setEnabled(arg < 1);
 }
 
 void OpacityWidget::showEvent(QShowEvent *e)
 {
-    if (Settings::getInstance().isAnimationEnabled())
-        animation->start();
+    if (AnimationDriver::isEnabled()) {
+        setOpacity(0);
+        AnimationDriver::getInstance().animate(this, [this](qreal elapsed) {
+            setOpacity(qMin<qreal>(1, mOpacity + elapsed * 1000 / FADE_DURATION));
+            return mOpacity < 1;
+        });
+    }
 
     QWidget::showEvent(e);
 }
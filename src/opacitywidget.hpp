@@ -19,10 +19,11 @@
 
 #include <QWidget>
 
-class QPropertyAnimation;
 class QGraphicsOpacityEffect;
 
-/*! A widget, whith fade effect and opacity option. */
+/*! A widget, whith fade effect and opacity option.
+ *  The fade runs on the AnimationDriver. The opacity effect renders the widget into a cached
+ *  pixmap, it's only enabled while the widget is translucent, an opaque one paints directly. */
 class OpacityWidget : public QWidget
 {
     Q_OBJECT
@@ -39,9 +40,10 @@ protected:
     void showEvent(QShowEvent *e);
 
 private:
-    QPropertyAnimation     *animation;
     QGraphicsOpacityEffect *effect;
     qreal                   mOpacity;
+
+    static const int FADE_DURATION = 210; // ms
 };
 
 #endif // OPACITYWIDGET_HPP
@@ -16,16 +16,23 @@
 
 #include "ouruseritemwidget.hpp"
 #include "Settings/settings.hpp"
+#include "avatarstore.hpp"
 #include "closeapplicationdialog.hpp"
+#include "userid.hpp"
 
 #include <QAction>
 #include <QHBoxLayout>
 #include <QMenu>
 #include <QGuiApplication>
 #include <QClipboard>
-
-OurUserItemWidget::OurUserItemWidget(QWidget* parent) :
-    QWidget(parent)
+#include <QDir>
+#include <QFile>
+#include <QFileDialog>
+#include <QMessageBox>
+#include <QWindow>
+
+OurUserItemWidget::OurUserItemWidget(QWidget* parent, bool storeInSettings) :
+    QWidget(parent), storeInSettings(storeInSettings)
 {
     statusButton = createToolButton(QIcon(StatusHelper::getInfo(Status::Offline).iconPath), QSize(24, 24), "Change Status");
     statusButton->setPopupMode(QToolButton::InstantPopup);
@@ -49,10 +56,21 @@ OurUserItemWidget::OurUserItemWidget(QWidget* parent) :
         statusActions << statusAction;
     }
     statusMenu->addActions(QList<QAction*>() << statusActions);
+    statusMenu->addSeparator();
+    statusMenu->addAction(tr("Change Avatar..."), this, SLOT(onChangeAvatarActionTriggered()));
+    removeAvatarAction = statusMenu->addAction(tr("Remove Avatar"), this, SLOT(onRemoveAvatarActionTriggered()));
+    removeAvatarAction->setEnabled(false);
     statusButton->setMenu(statusMenu);
 
+    avatarLabel = new QLabel(this);
+    avatarLabel->setFixedSize(AVATAR_SIZE, AVATAR_SIZE);
+    avatarLabel->hide();
+    connect(&AvatarStore::getInstance(), &AvatarStore::avatarChanged, this, &OurUserItemWidget::onAvatarChanged);
+
     usernameWidget = new EditableLabelWidget(this);
-    usernameWidget->setText(Settings::getInstance().getUsername());
+    if (storeInSettings) {
+        usernameWidget->setText(Settings::getInstance().getUsername());
+    }
     usernameWidget->label->setTextElide(true);
     usernameWidget->label->setTextElideMode(Qt::ElideRight);
     usernameWidget->label->setShowToolTipOnElide(true);
@@ -60,7 +78,9 @@ OurUserItemWidget::OurUserItemWidget(QWidget* parent) :
     connect(usernameWidget, &EditableLabelWidget::textChanged, this, &OurUserItemWidget::onUsernameChanged);
 
     statusMessageWidget = new EditableLabelWidget(this);
-    statusMessageWidget->setText(Settings::getInstance().getStatusMessage());
+    if (storeInSettings) {
+        statusMessageWidget->setText(Settings::getInstance().getStatusMessage());
+    }
     statusMessageWidget->label->setTextElide(true);
     statusMessageWidget->label->setTextElideMode(Qt::ElideRight);
     statusMessageWidget->label->setShowToolTipOnElide(true);
@@ -82,6 +102,7 @@ OurUserItemWidget::OurUserItemWidget(QWidget* parent) :
     layout->setContentsMargins(2, 1, 2, 0);
     layout->setSpacing(2);
     layout->addLayout(statusButtonLayout, 0);
+    layout->addWidget(avatarLabel, 0, Qt::AlignVCenter);
     layout->addWidget(userInformationWidget);
     layout->addLayout(copyFriendAddressButtonLayout, 0);
 
@@ -111,7 +132,9 @@ void OurUserItemWidget::onUsernameChanged(const QString& newUsername, const QStr
 void OurUserItemWidget::setUsername(const QString& username)
 {
     usernameWidget->setText(username);
-    Settings::getInstance().setUsername(username);
+    if (storeInSettings) {
+        Settings::getInstance().setUsername(username);
+    }
 }
 
 void OurUserItemWidget::onStatusMessageChanged(const QString& newStatusMessage, const QString& oldStatusMessage)
@@ -126,7 +149,9 @@ void OurUserItemWidget::onStatusMessageChanged(const QString& newStatusMessage,
 void OurUserItemWidget::setStatusMessage(const QString &statusMessage)
 {
     statusMessageWidget->setText(statusMessage);
-    Settings::getInstance().setStatusMessage(statusMessage);
+    if (storeInSettings) {
+        Settings::getInstance().setStatusMessage(statusMessage);
+    }
 }
 
 void OurUserItemWidget::onStatusActionTriggered()
@@ -152,6 +177,65 @@ void OurUserItemWidget::onCopyFriendAddressButtonClicked()
 void OurUserItemWidget::setFriendAddress(const QString &friendAddress)
 {
     this->friendAddress = friendAddress;
+    updateAvatar();
+}
+
+QString OurUserItemWidget::getUserId() const
+{
+    return friendAddress.left(UserId::SIZE * 2).toUpper();
+}
+
+void OurUserItemWidget::onChangeAvatarActionTriggered()
+{
+    if (friendAddress.isEmpty()) {
+        return;
+    }
+
+    const QString filePath = QFileDialog::getOpenFileName(this, tr("Change Avatar"), QString(), tr("Images (*.png *.jpg *.jpeg *.gif *.bmp *.webp)"));
+    if (filePath.isEmpty()) {
+        return;
+    }
+
+    QFile file(filePath);
+    if (file.size() > AvatarStore::MAX_DATA_SIZE || !file.open(QIODevice::ReadOnly)
+            || !AvatarStore::getInstance().setAvatar(getUserId(), file.readAll())) {
+        QMessageBox::warning(this, tr("Change Avatar"), tr("%1 can't be used as an avatar, it has to be an image of at most %2 KB.")
+                             .arg(QDir::toNativeSeparators(filePath)).arg(AvatarStore::MAX_DATA_SIZE / 1024));
+    }
+}
+
+void OurUserItemWidget::onRemoveAvatarActionTriggered()
+{
+    AvatarStore::getInstance().removeAvatar(getUserId());
+}
+
+void OurUserItemWidget::onAvatarChanged(const QString& userId)
+{
+    if (!friendAddress.isEmpty() && userId == getUserId()) {
+        updateAvatar();
+    }
+}
+
+void OurUserItemWidget::showEvent(QShowEvent* event)
+{
+    QWidget::showEvent(event);
+    // the avatar is rendered at the pixel density of the screen the window is on
+    if (QWindow* handle = window()->windowHandle()) {
+        connect(handle, &QWindow::screenChanged, this, &OurUserItemWidget::updateAvatar, Qt::UniqueConnection);
+    }
+    updateAvatar();
+}
+
+void OurUserItemWidget::updateAvatar()
+{
+    AvatarStore& avatars = AvatarStore::getInstance();
+    const bool hasAvatar = !friendAddress.isEmpty() && avatars.hasAvatar(getUserId());
+    avatarLabel->setVisible(hasAvatar);
+    removeAvatarAction->setEnabled(hasAvatar);
+    if (hasAvatar) {
+        // null while it's decoded, onAvatarChanged() sets it then
+        avatarLabel->setPixmap(avatars.getAvatar(getUserId(), avatarLabel->size(), devicePixelRatio()));
+    }
 }
 
 void OurUserItemWidget::setStatus(Status status)
@@ -30,22 +30,39 @@ class OurUserItemWidget : public QWidget
 {
     Q_OBJECT
 public:
-    explicit OurUserItemWidget(QWidget* parent = 0);
+    // storeInSettings controls whether our username and status message are mirrored into Settings,
+    // only the default profile does that
+    explicit OurUserItemWidget(QWidget* parent = 0, bool storeInSettings = true);
 
 private:
     QToolButton* statusButton;
+    QLabel* avatarLabel;
+    QAction* removeAvatarAction;
     QString friendAddress;
+    const bool storeInSettings;
 
     EditableLabelWidget* usernameWidget;
     EditableLabelWidget* statusMessageWidget;
 
     QToolButton* createToolButton(const QIcon& icon, const QSize iconSize, const QString& toolTip);
+    // our User ID is the start of our Friend Address
+    QString getUserId() const;
+
+    static const int AVATAR_SIZE = 24;
+
+protected:
+    void showEvent(QShowEvent* event);
 
 private slots:
+    // also when the window moves to a screen of another pixel density
+    void updateAvatar();
     void onUsernameChanged(const QString& newUsername, const QString& oldUsername);
     void onStatusMessageChanged(const QString& newStatusMessage, const QString& oldStatusMessage);
     void onStatusActionTriggered();
     void onCopyFriendAddressButtonClicked();
+    void onChangeAvatarActionTriggered();
+    void onRemoveAvatarActionTriggered();
+    void onAvatarChanged(const QString& userId);
 
 public slots:
     void setFriendAddress(const QString &friendAddress);
@@ -0,0 +1,249 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "outboxjournal.hpp"
+#include "historywriter.hpp"
+#include "Settings/settings.hpp"
+
+#include <QBuffer>
+#include <QDataStream>
+#include <QDebug>
+#include <QFile>
+
+OutboxJournal::OutboxJournal(const QString& filePath, QObject* parent) :
+    QObject(parent),
+    filePath(filePath),
+    loaded(false),
+    writer(filePath, FLUSH_DELAY, "Outbox journal")
+{
+    connect(&writer, &DelayedWriter::due, this, &OutboxJournal::flush);
+}
+
+OutboxJournal::~OutboxJournal()
+{
+    flush();
+}
+
+void OutboxJournal::setKey(const QByteArray& key)
+{
+    if (loaded) {
+        return;
+    }
+    this->key = key;
+    loaded = true;
+
+    // the compacted log has what the records made so far did to pending
+    load();
+    records.clear();
+}
+
+void OutboxJournal::load()
+{
+    QFile file(filePath);
+    if (file.open(QIODevice::ReadOnly)) {
+        QDataStream stream(&file);
+        stream.setVersion(QDataStream::Qt_5_2);
+        quint32 version;
+        stream >> version;
+        if (stream.status() != QDataStream::Ok || version != FILE_VERSION) {
+            qWarning() << "Outbox journal" << filePath << "is unreadable, messages of the last session aren't sent";
+        } else {
+            // a record cut short by a crash, or sealed with another key, ends the log, everything before it still counts
+            while (!stream.atEnd()) {
+                quint32 header;
+                stream >> header;
+                const quint32 size = header & ~SEALED_RECORD;
+                if (stream.status() != QDataStream::Ok || size > quint32(file.size())) {
+                    break;
+                }
+                QByteArray payload(size, Qt::Uninitialized);
+                if (stream.readRawData(payload.data(), size) != int(size)) {
+                    break;
+                }
+                if (header & SEALED_RECORD) {
+                    payload = HistoryWriter::decryptRecord(payload, MsgId(), key);
+                    if (payload.isEmpty()) {
+                        break;
+                    }
+                }
+
+                QDataStream recordStream(payload);
+                recordStream.setVersion(QDataStream::Qt_5_2);
+                quint8 type;
+                QString userId;
+                Entry entry;
+                recordStream >> type >> userId >> entry.msgId;
+                if (type == Queued) {
+                    recordStream >> entry.isAction >> entry.text;
+                }
+                if (recordStream.status() != QDataStream::Ok) {
+                    break;
+                }
+                apply(pending, static_cast<RecordType>(type), userId, entry);
+            }
+        }
+        file.close();
+    }
+
+    // the waiting messages are queued again all the same, they just aren't kept for the next start
+    if (!Settings::getInstance().getEnableLogging()) {
+        writer.remove();
+        return;
+    }
+
+    // compact, the records of the last session apart from the waiting messages are of no use anymore
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    QDataStream stream(&buffer);
+    stream.setVersion(QDataStream::Qt_5_2);
+    stream << FILE_VERSION;
+    for (QHash<QString, QList<Entry>>::const_iterator it = pending.constBegin(); it != pending.constEnd(); ++it) {
+        for (const Entry& entry : it.value()) {
+            const QByteArray record = encodeRecord(Queued, it.key(), entry);
+            buffer.write(record);
+        }
+    }
+
+    writer.replace(data);
+}
+
+QByteArray OutboxJournal::encodeRecord(RecordType type, const QString& userId, const Entry& entry) const
+{
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_2);
+    stream << quint8(type) << userId << entry.msgId;
+    if (type == Queued) {
+        stream << entry.isAction << entry.text;
+    }
+
+    // the records are read before any msgId is known, so they are sealed without one
+    quint32 header = payload.size();
+    if (!key.isEmpty()) {
+        payload = HistoryWriter::encryptRecord(payload, MsgId(), key);
+        header = payload.size() | SEALED_RECORD;
+    }
+
+    QByteArray record;
+    QDataStream recordStream(&record, QIODevice::WriteOnly);
+    recordStream << header;
+    recordStream.writeRawData(payload.constData(), payload.size());
+    return record;
+}
+
+void OutboxJournal::apply(QHash<QString, QList<Entry>>& pending, RecordType type, const QString& userId, const Entry& entry)
+{
+    switch (type) {
+        case Queued:
+            pending[userId].append(entry);
+            break;
+        case Sent: {
+            QHash<QString, QList<Entry>>::iterator it = pending.find(userId);
+            if (it == pending.end()) {
+                break;
+            }
+            QList<Entry>& entries = it.value();
+            for (int i = 0; i < entries.size(); i++) {
+                if (entries[i].msgId == entry.msgId) {
+                    entries.removeAt(i);
+                    break;
+                }
+            }
+            if (entries.isEmpty()) {
+                pending.erase(it);
+            }
+            break;
+        }
+        case Dropped:
+            pending.remove(userId);
+            break;
+    }
+}
+
+void OutboxJournal::append(RecordType type, const QString& userId, MsgId msgId, bool isAction, const QString& text)
+{
+    Entry entry;
+    entry.msgId = msgId;
+    entry.isAction = isAction;
+    entry.text = text;
+    apply(pending, type, userId, entry);
+
+    // what isn't logged to the history doesn't end up on disk here either
+    if (!Settings::getInstance().getEnableLogging()) {
+        return;
+    }
+
+    Record record;
+    record.type = type;
+    record.userId = userId;
+    record.entry = entry;
+    records.append(record);
+
+    // a burst of messages results in a single write
+    writer.schedule();
+}
+
+void OutboxJournal::flush()
+{
+    // without the key nothing is written, setKey() logs what was queued meanwhile
+    if (!loaded || records.isEmpty()) {
+        return;
+    }
+
+    QByteArray data;
+    for (const Record& record : records) {
+        data += encodeRecord(record.type, record.userId, record.entry);
+    }
+    writer.append(data);
+    records.clear();
+}
+
+QList<OutboxJournal::Entry> OutboxJournal::getPending(int friendId) const
+{
+    return pending.value(userIds.value(friendId));
+}
+
+void OutboxJournal::addFriend(int friendId, const UserId& userId)
+{
+    userIds.insert(friendId, userId.toString());
+}
+
+void OutboxJournal::removeFriend(int friendId)
+{
+    // a removed friend added again doesn't get the old messages
+    const QString userId = userIds.take(friendId);
+    if (pending.contains(userId)) {
+        append(Dropped, userId, MsgId());
+    }
+}
+
+void OutboxJournal::addMessage(int friendId, MsgId msgId, bool isAction, const QString& text)
+{
+    QHash<int, QString>::const_iterator it = userIds.constFind(friendId);
+    if (it != userIds.constEnd()) {
+        append(Queued, it.value(), msgId, isAction, text);
+    }
+}
+
+void OutboxJournal::removeMessage(int friendId, MsgId msgId)
+{
+    QHash<int, QString>::const_iterator it = userIds.constFind(friendId);
+    if (it != userIds.constEnd()) {
+        append(Sent, it.value(), msgId);
+    }
+}
@@ -0,0 +1,99 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef OUTBOXJOURNAL_HPP
+#define OUTBOXJOURNAL_HPP
+
+#include "delayedwriter.hpp"
+#include "messages/id.hpp"
+#include "userid.hpp"
+
+#include <QHash>
+#include <QList>
+#include <QObject>
+
+// Our messages that the Core didn't hand over to toxcore yet, so that the ones still waiting for
+// an offline friend are queued again on the next start. Kept on disk by User ID as an append-only
+// log of queued and sent records, appended in batches half a second after a message was queued or
+// sent, and compacted to the messages still waiting when loaded. Records are sealed with the history key
+// like the ones of HistoryWriter, so the log is only read once setKey() is called, and nothing
+// is logged while the history isn't, see Settings::getEnableLogging().
+class OutboxJournal : public QObject
+{
+    Q_OBJECT
+public:
+    OutboxJournal(const QString& filePath, QObject* parent);
+    ~OutboxJournal();
+
+    struct Entry {
+        MsgId msgId;
+        bool isAction;
+        QString text;
+    };
+
+    // of the friend, oldest first
+    QList<Entry> getPending(int friendId) const;
+
+public slots:
+    // loads the log of the last session, records made before are written only now
+    void setKey(const QByteArray& key);
+
+    void addFriend(int friendId, const UserId& userId);
+    void removeFriend(int friendId);
+
+    void addMessage(int friendId, MsgId msgId, bool isAction, const QString& text);
+    void removeMessage(int friendId, MsgId msgId);
+
+private slots:
+    void flush();
+
+private:
+    enum RecordType : quint8 {
+        Queued = 1,
+        Sent,
+        Dropped // all of the friend's messages
+    };
+
+    void load();
+    void append(RecordType type, const QString& userId, MsgId msgId, bool isAction = false, const QString& text = QString());
+    // the record as it is logged, sealed if there is a key
+    QByteArray encodeRecord(RecordType type, const QString& userId, const Entry& entry) const;
+    static void apply(QHash<QString, QList<Entry>>& pending, RecordType type, const QString& userId, const Entry& entry);
+
+    const QString filePath;
+    QByteArray key;
+    bool loaded;
+    // by hex User ID, a friend the Core doesn't know yet keeps their messages until it does
+    QHash<QString, QList<Entry>> pending;
+    // friendId -> hex User ID
+    QHash<int, QString> userIds;
+    // records not written yet, and not sealed until the key is known
+    struct Record {
+        RecordType type;
+        QString userId;
+        Entry entry;
+    };
+    QList<Record> records;
+    DelayedWriter writer;
+
+    static const quint32 FILE_VERSION = 2;
+    // set in the size of a sealed record, like HistoryWriter::ENCRYPTED_RECORD
+    static const quint32 SEALED_RECORD = 0x80000000;
+    static const int FLUSH_DELAY = 500; // ms
+};
+
+#endif // OUTBOXJOURNAL_HPP
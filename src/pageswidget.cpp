@@ -15,90 +15,412 @@
 */
 
 #include "chatpagewidget.hpp"
+#include "chatwindow.hpp"
 #include "pageswidget.hpp"
+#include "groupchatpagewidget.hpp"
+#include "historyimporter.hpp"
+#include "historystore.hpp"
+#include "Settings/settings.hpp"
 
-PagesWidget::PagesWidget(QWidget* parent) :
-    QStackedWidget(parent)
+#include <QTimer>
+
+PagesWidget::PagesWidget(const QString& historyDirPath, QWidget* parent) :
+    QStackedWidget(parent), historyDirPath(historyDirPath)
 {
+    historyIndex = new HistoryIndex(this);
+
     addWidget(new QWidget(this));
 
     setFocusPolicy(Qt::ClickFocus);
+
+    idleTimer = new QTimer(this);
+    idleTimer->setInterval(PAGE_IDLE_TIMEOUT / 4);
+    connect(idleTimer, &QTimer::timeout, this, &PagesWidget::removeIdlePages);
+    idleTimer->start();
+
+    connect(&Settings::getInstance(), &Settings::logStorageOptsChanged, this, &PagesWidget::onLogStorageOptsChanged);
 }
 
-// if preformance would be critical, replace with QHash<int friendId, ChatPageWidget*>
 ChatPageWidget* PagesWidget::widget(int friendId) const
 {
-    for (int i = 0; i < count(); i++) {
-        ChatPageWidget* chatPage = dynamic_cast<ChatPageWidget*>(QStackedWidget::widget(i));
-        if (chatPage != nullptr && chatPage->getFriendId() == friendId) {
-            return chatPage;
+    QHash<int, Friend>::const_iterator it = friends.constFind(friendId);
+    return it != friends.constEnd() ? it->page : nullptr;
+}
+
+ChatPageWidget* PagesWidget::page(int friendId)
+{
+    QHash<int, Friend>::iterator it = friends.find(friendId);
+    if (it == friends.end()) {
+        return nullptr;
+    }
+
+    Friend& f = it.value();
+    if (f.page == nullptr) {
+        ChatPageWidget* chatPage = new ChatPageWidget(friendId, f.historyPath, historyKey, historyIndex, this);
+        chatPage->setUsername(f.username);
+        chatPage->setStatus(f.status);
+        chatPage->setStatusMessage(f.statusMessage);
+        chatPage->setUserId(f.userId.toString());
+        if (f.typing) {
+            chatPage->onFriendTypingChanged(true);
+        }
+        connect(chatPage, &ChatPageWidget::sendMessage, this, &PagesWidget::onMessageToSend);
+        connect(chatPage, &ChatPageWidget::sendAction,  this, &PagesWidget::onActionToSend);
+        connect(chatPage, &ChatPageWidget::sendTyping,  this, &PagesWidget::onTypingToSend);
+        connect(chatPage, &ChatPageWidget::startCall,   this, &PagesWidget::onCallToStart);
+        connect(chatPage, &ChatPageWidget::answerCall,  this, &PagesWidget::onCallToAnswer);
+        connect(chatPage, &ChatPageWidget::hangUpCall,  this, &PagesWidget::onCallToHangUp);
+        connect(chatPage, &ChatPageWidget::sendFile,    this, &PagesWidget::onFileToSend);
+        connect(chatPage, &ChatPageWidget::acceptFile,  this, &PagesWidget::onFileToAccept);
+        connect(chatPage, &ChatPageWidget::cancelFile,  this, &PagesWidget::onFileToCancel);
+        addWidget(chatPage);
+        f.page = chatPage;
+        if (f.anchor.isValid()) {
+            chatPage->showMessage(f.anchor);
+            f.anchor = MsgId();
         }
     }
-    return nullptr;
+    f.lastUsed.start();
+    return f.page;
 }
 
-void PagesWidget::addPage(int friendId, const QString& userId)
+void PagesWidget::touch(int friendId)
 {
-    ChatPageWidget* chatPage = new ChatPageWidget(friendId, this);
-    chatPage->setUsername(userId);
-    connect(chatPage, &ChatPageWidget::sendMessage, this, &PagesWidget::onMessageToSend);
-    connect(chatPage, &ChatPageWidget::sendAction,  this, &PagesWidget::onActionToSend);
-    connect(chatPage, &ChatPageWidget::sendTyping,  this, &PagesWidget::onTypingToSend);
-    addWidget(chatPage);
+    QHash<int, Friend>::iterator it = friends.find(friendId);
+    if (it != friends.end()) {
+        it->lastUsed.start();
+    }
+}
+
+QList<HistoryIndex::Result> PagesWidget::searchHistory(const QString& query, int maxResults) const
+{
+    return historyIndex->search(query, maxResults);
+}
+
+Message PagesWidget::historyMessage(int friendId, MsgId msgId) const
+{
+    ChatPageWidget* chatPage = widget(friendId);
+    if (chatPage) {
+        return chatPage->historyMessage(msgId);
+    }
+
+    // search results shouldn't create a page for every chat they come from
+    if (!friends.contains(friendId) || !Settings::getInstance().getEnableLogging()) {
+        return Message();
+    }
+    return HistoryStore::loadMessage(friends[friendId].historyPath, historyKey, msgId);
+}
+
+QString PagesWidget::getUsername(int friendId) const
+{
+    return friends.contains(friendId) ? friends[friendId].username : QString();
+}
+
+QString PagesWidget::getHistoryPath(int friendId) const
+{
+    return friends.contains(friendId) ? friends[friendId].historyPath : QString();
+}
+
+const QByteArray& PagesWidget::getHistoryKey() const
+{
+    return historyKey;
+}
+
+UserId PagesWidget::getUserId(int friendId) const
+{
+    return friends.contains(friendId) ? friends[friendId].userId : UserId();
+}
+
+bool PagesWidget::importHistory(int friendId, HistoryImporter* importer)
+{
+    ChatPageWidget* chatPage = page(friendId);
+    if (!chatPage || !chatPage->importHistory(importer)) {
+        return false;
+    }
+
+    // the index only learns of messages through addMessage(), it has to read the merged log again
+    connect(importer, &HistoryImporter::finished, this, [this, friendId](bool success) {
+        if (success && friends.contains(friendId) && Settings::getInstance().getEnableLogging()) {
+            historyIndex->removeChat(friendId);
+            historyIndex->addChat(friendId, friends[friendId].historyPath, historyKey);
+        }
+    });
+    return true;
+}
+
+QList<QPair<QString, ChatMemoryUsage>> PagesWidget::getMemoryUsage() const
+{
+    QList<QPair<QString, ChatMemoryUsage>> usage;
+    for (const Friend& f : friends) {
+        if (f.page) {
+            usage << qMakePair(f.username, f.page->getMemoryUsage());
+        }
+    }
+    return usage;
+}
+
+void PagesWidget::setHistoryKey(const QByteArray& key)
+{
+    historyKey = key;
+}
+
+// pages are only created once the chat is shown or a message arrives, but every
+// logged chat is indexed right away so that history search covers all of them
+void PagesWidget::addPage(int friendId, const UserId& userId)
+{
+    Friend f;
+    f.userId = userId;
+    f.historyPath = historyDirPath + '/' + userId.toString();
+    f.username = userId.toString();
+    f.status = Status::Offline;
+    f.typing = false;
+    f.page = nullptr;
+    f.window = nullptr;
+    friends.insert(friendId, f);
+
+    if (Settings::getInstance().getEnableLogging()) {
+        historyIndex->addChat(friendId, f.historyPath, historyKey);
+    }
+}
+
+bool PagesWidget::isChatShown(int friendId) const
+{
+    QHash<int, Friend>::const_iterator it = friends.constFind(friendId);
+    if (it == friends.constEnd() || it->page == nullptr) {
+        return false;
+    }
+    if (it->window != nullptr) {
+        return it->window->isVisible() && it->window->isActiveWindow();
+    }
+    return currentWidget() == it->page && isVisible() && window()->isActiveWindow();
+}
+
+int PagesWidget::getCurrentFriendId() const
+{
+    ChatPageWidget* current = dynamic_cast<ChatPageWidget*>(currentWidget());
+    return current != nullptr ? current->getFriendId() : -1;
+}
+
+MsgId PagesWidget::getAnchor(int friendId) const
+{
+    QHash<int, Friend>::const_iterator it = friends.constFind(friendId);
+    if (it == friends.constEnd()) {
+        return MsgId();
+    }
+    return it->page ? it->page->getAnchor() : it->anchor;
+}
+
+void PagesWidget::setAnchor(int friendId, MsgId anchor)
+{
+    QHash<int, Friend>::iterator it = friends.find(friendId);
+    if (it != friends.end() && it->page == nullptr) {
+        it->anchor = anchor;
+    }
+}
+
+QList<int> PagesWidget::getFriendIds() const
+{
+    return friends.keys();
+}
+
+QString PagesWidget::getSearchString(int friendId) const
+{
+    ChatPageWidget* chatPage = widget(friendId);
+    return chatPage ? chatPage->getSearchString() : QString();
+}
+
+void PagesWidget::openSearchBar(int friendId, const QString& searchString)
+{
+    if (ChatPageWidget* chatPage = page(friendId)) {
+        chatPage->openSearchBar(searchString);
+    }
 }
 
 void PagesWidget::activatePage(int friendId)
 {
-    setCurrentWidget(widget(friendId));
+    ChatPageWidget* current = dynamic_cast<ChatPageWidget*>(currentWidget());
+    if (current != nullptr) {
+        touch(current->getFriendId());
+    }
+
+    ChatPageWidget* chatPage = page(friendId);
+    if (chatPage == nullptr) {
+        return;
+    }
+    // a detached chat is brought to the front, the stack shows the empty page meanwhile
+    ChatWindow* chatWindow = friends[friendId].window;
+    if (chatWindow != nullptr) {
+        setCurrentIndex(0);
+        chatWindow->raise();
+        chatWindow->activateWindow();
+    } else {
+        setCurrentWidget(chatPage);
+    }
+}
+
+void PagesWidget::showMessage(int friendId, MsgId msgId)
+{
+    ChatPageWidget* chatPage = page(friendId);
+    if (chatPage) {
+        activatePage(friendId);
+        chatPage->showMessage(msgId);
+    }
+}
+
+void PagesWidget::detachPage(int friendId)
+{
+    ChatPageWidget* chatPage = page(friendId);
+    if (chatPage == nullptr) {
+        return;
+    }
+
+    Friend& f = friends[friendId];
+    if (f.window == nullptr) {
+        if (currentWidget() == chatPage) {
+            setCurrentIndex(0);
+        }
+        removeWidget(chatPage);
+        f.window = new ChatWindow(chatPage, this);
+        connect(f.window, &ChatWindow::closed, this, &PagesWidget::attachPage);
+    }
+    f.window->show();
+    f.window->raise();
+    f.window->activateWindow();
+}
+
+void PagesWidget::attachPage(int friendId)
+{
+    QHash<int, Friend>::iterator it = friends.find(friendId);
+    if (it == friends.end() || it->window == nullptr) {
+        return;
+    }
+
+    // the window deletes itself once it's closed
+    ChatPageWidget* chatPage = it->window->takePage();
+    it->window = nullptr;
+    addWidget(chatPage);
+    it->lastUsed.start();
+    if (currentIndex() == 0) {
+        setCurrentWidget(chatPage);
+    }
 }
 
 void PagesWidget::removePage(int friendId)
 {
     ChatPageWidget* chatPage = widget(friendId);
-    removeWidget(chatPage);
-    delete chatPage;
+    if (chatPage) {
+        removeWidget(chatPage);
+        if (ChatWindow* chatWindow = friends[friendId].window) {
+            chatWindow->takePage();
+            delete chatWindow;
+        }
+        delete chatPage;
+    }
+    friends.remove(friendId);
+    historyIndex->removeChat(friendId);
+}
+
+void PagesWidget::onLogStorageOptsChanged()
+{
+    bool enabled = Settings::getInstance().getEnableLogging();
+    for (auto it = friends.constBegin(); it != friends.constEnd(); ++it) {
+        if (enabled) {
+            historyIndex->addChat(it.key(), it.value().historyPath, historyKey);
+        } else {
+            historyIndex->removeChat(it.key());
+        }
+    }
+}
+
+// without logging a page holds the only copy of its chat, so it stays
+void PagesWidget::removeIdlePages()
+{
+    for (auto it = friends.begin(); it != friends.end(); ++it) {
+        Friend& f = it.value();
+        if (f.page == nullptr || f.page == currentWidget() || f.window != nullptr || !f.lastUsed.hasExpired(PAGE_IDLE_TIMEOUT) || !f.page->isIdle()) {
+            continue;
+        }
+        f.anchor = f.page->getAnchor();
+        removeWidget(f.page);
+        delete f.page;
+        f.page = nullptr;
+    }
 }
 
 void PagesWidget::onFriendUsernameChanged(int friendId, const QString& username)
 {
-    widget(friendId)->onFriendUsernameChanged(username);
+    // friends send their name on every connect, only a real change is shown and logged in the chat
+    if (!friends.contains(friendId) || friends[friendId].username == username) {
+        return;
+    }
+    page(friendId)->onFriendUsernameChanged(username);
+    friends[friendId].username = username;
+    if (ChatWindow* chatWindow = friends[friendId].window) {
+        chatWindow->updateTitle();
+    }
 }
 
 void PagesWidget::onFriendUsernameLoaded(int friendId, const QString& username)
 {
-    widget(friendId)->setUsername(username);
+    if (friends.contains(friendId)) {
+        friends[friendId].username = username;
+    }
+    if (ChatPageWidget* chatPage = widget(friendId)) {
+        chatPage->setUsername(username);
+    }
+    if (friends.contains(friendId) && friends[friendId].window) {
+        friends[friendId].window->updateTitle();
+    }
 }
 
 void PagesWidget::onOurUsernameChanged(const QString &username)
 {
-    for (int i = 0; i < count(); i++) {
-        ChatPageWidget* chatPage = dynamic_cast<ChatPageWidget*>(QStackedWidget::widget(i));
-        if (chatPage != nullptr) {
-            chatPage->onOurUsernameChanged(username);
+    // only chats with a page show the change
+    for (const Friend& f : friends) {
+        if (f.page != nullptr) {
+            f.page->onOurUsernameChanged(username);
         }
     }
 }
 
 void PagesWidget::onFriendTypingChanged(int friendId, bool isTyping)
 {
-    widget(friendId)->onFriendTypingChanged(isTyping);
+    QHash<int, Friend>::iterator it = friends.find(friendId);
+    if (it == friends.end() || it->typing == isTyping) {
+        return;
+    }
+    it->typing = isTyping;
+
+    if (ChatPageWidget* chatPage = widget(friendId)) {
+        chatPage->onFriendTypingChanged(isTyping);
+    }
 }
 
 void PagesWidget::onFriendStatusChanged(int friendId, Status status)
 {
-    widget(friendId)->setStatus(status);
+    if (friends.contains(friendId)) {
+        friends[friendId].status = status;
+    }
+    if (ChatPageWidget* chatPage = widget(friendId)) {
+        chatPage->setStatus(status);
+    }
 }
 
 void PagesWidget::onFriendStatusMessageChanged(int friendId, const QString& statusMessage)
 {
     // TODO: change status instead of setting (should also print message in the message view)
     // just like onOurUsernameChanged does. also, do the same with the regular status (online, away, busy, offline)
-    widget(friendId)->setStatusMessage(statusMessage);
+    onFriendStatusMessageLoaded(friendId, statusMessage);
 }
 
 void PagesWidget::onFriendStatusMessageLoaded(int friendId, const QString& statusMessage)
 {
-    widget(friendId)->setStatusMessage(statusMessage);
+    if (friends.contains(friendId)) {
+        friends[friendId].statusMessage = statusMessage;
+    }
+    if (ChatPageWidget* chatPage = widget(friendId)) {
+        chatPage->setStatusMessage(statusMessage);
+    }
 }
 
 void PagesWidget::onMessageToSend(const QString& message)
@@ -119,27 +441,206 @@ void PagesWidget::onTypingToSend(bool typing)
     emit sendTyping(chatPage->getFriendId(), typing);
 }
 
+void PagesWidget::onCallToStart(bool video)
+{
+    ChatPageWidget* chatPage = static_cast<ChatPageWidget*>(sender());
+    emit startCall(chatPage->getFriendId(), video);
+}
+
+void PagesWidget::onCallToAnswer()
+{
+    ChatPageWidget* chatPage = static_cast<ChatPageWidget*>(sender());
+    emit answerCall(chatPage->getFriendId());
+}
+
+void PagesWidget::onCallToHangUp()
+{
+    ChatPageWidget* chatPage = static_cast<ChatPageWidget*>(sender());
+    emit hangUpCall(chatPage->getFriendId());
+}
+
+void PagesWidget::onFileToSend(const QString& filePath)
+{
+    ChatPageWidget* chatPage = static_cast<ChatPageWidget*>(sender());
+    emit sendFile(chatPage->getFriendId(), filePath);
+}
+
+void PagesWidget::onFileToAccept(int fileNumber, const QString& savePath)
+{
+    ChatPageWidget* chatPage = static_cast<ChatPageWidget*>(sender());
+    emit acceptFile(chatPage->getFriendId(), fileNumber, savePath);
+}
+
+void PagesWidget::onFileToCancel(int fileNumber, FileTransferInfo::Direction direction)
+{
+    ChatPageWidget* chatPage = static_cast<ChatPageWidget*>(sender());
+    emit cancelFile(chatPage->getFriendId(), fileNumber, direction);
+}
+
+void PagesWidget::onFileTransfersUpdated(const FileTransferInfoList& transfers)
+{
+    for (const FileTransferInfo& info : transfers) {
+        // a page with a transfer in progress is never idle, so only a new one may need a page created
+        ChatPageWidget* chatPage = info.isOver() ? widget(info.friendId) : page(info.friendId);
+        if (chatPage) {
+            chatPage->updateFileTransfer(info);
+        }
+    }
+}
+
+void PagesWidget::onCallStateChanged(int friendId, CallState state, bool video)
+{
+    // an incoming call needs a page to be answered from, an ended one doesn't
+    ChatPageWidget* chatPage = state == CallState::None ? widget(friendId) : page(friendId);
+    if (chatPage) {
+        chatPage->setCallState(state, video);
+    }
+}
+
+void PagesWidget::onCallStatsReported(int friendId, const CallStats& stats)
+{
+    if (ChatPageWidget* chatPage = widget(friendId)) {
+        chatPage->setCallStats(stats);
+    }
+}
+
+void PagesWidget::onVideoFrameReceived(int friendId, const QImage& frame)
+{
+    if (ChatPageWidget* chatPage = widget(friendId)) {
+        chatPage->setVideoFrame(frame);
+    }
+}
+
 void PagesWidget::messageReceived(int friendId, const QString &message)
 {
-    widget(friendId)->messageReceived(message);
+    if (ChatPageWidget* chatPage = page(friendId)) {
+        chatPage->messageReceived(message);
+    }
 }
 
 void PagesWidget::actionReceived(int friendId, const QString &message)
 {
-    widget(friendId)->actionReceived(message);
+    if (ChatPageWidget* chatPage = page(friendId)) {
+        chatPage->actionReceived(message);
+    }
 }
 
-void PagesWidget::messageSentResult(int friendId, const QString &message, int messageId)
+void PagesWidget::messageQueued(int friendId, const QString &message, int queueId)
 {
-    widget(friendId)->messageSentResult(message, messageId);
+    if (ChatPageWidget* chatPage = page(friendId)) {
+        emit messagePending(friendId, chatPage->messageQueued(message, queueId), false, message);
+    }
 }
 
-void PagesWidget::actionResult(int friendId, const QString &action, int success)
+void PagesWidget::actionQueued(int friendId, const QString &action, int queueId)
 {
-    if (success) {
-        widget(friendId)->actionSentResult(action);
-    } else {
-        // FIXME: that is one confusing way of reporting a error
-        widget(friendId)->messageSentResult(action, success);
+    if (ChatPageWidget* chatPage = page(friendId)) {
+        emit messagePending(friendId, chatPage->actionQueued(action, queueId), true, action);
+    }
+}
+
+// pages with messages waiting for this aren't idle, so they are still there
+void PagesWidget::messageSent(int friendId, int queueId, int messageId)
+{
+    if (ChatPageWidget* chatPage = widget(friendId)) {
+        const MsgId msgId = chatPage->messageSent(queueId, messageId);
+        if (msgId.isValid()) {
+            emit messageLeftOutbox(friendId, msgId);
+        }
+    }
+}
+
+void PagesWidget::messageRestored(int friendId, const QString& message, bool isAction, qint64 msgId, int queueId)
+{
+    if (ChatPageWidget* chatPage = page(friendId)) {
+        const MsgId id = chatPage->messageRestored(message, isAction, MsgId(msgId), queueId);
+        // shown as a new message, the journal has to follow
+        if (id != MsgId(msgId)) {
+            emit messageLeftOutbox(friendId, MsgId(msgId));
+            emit messagePending(friendId, id, isAction, message);
+        }
+    }
+}
+
+// same for the messages waiting for a receipt
+void PagesWidget::messageDelivered(int friendId, int messageId)
+{
+    if (ChatPageWidget* chatPage = widget(friendId)) {
+        chatPage->messageDelivered(messageId);
+    }
+}
+
+QString PagesWidget::getGroupTitle(int groupId) const
+{
+    GroupChatPageWidget* groupPage = groups.value(groupId, nullptr);
+    return groupPage ? groupPage->getTitle() : QString();
+}
+
+void PagesWidget::addGroupPage(int groupId)
+{
+    if (groups.contains(groupId)) {
+        return;
+    }
+
+    GroupChatPageWidget* groupPage = new GroupChatPageWidget(groupId, this);
+    connect(groupPage, &GroupChatPageWidget::sendMessage, this, &PagesWidget::onGroupMessageToSend);
+    connect(groupPage, &GroupChatPageWidget::sendAction,  this, &PagesWidget::onGroupActionToSend);
+    addWidget(groupPage);
+    groups.insert(groupId, groupPage);
+}
+
+void PagesWidget::removeGroupPage(int groupId)
+{
+    GroupChatPageWidget* groupPage = groups.take(groupId);
+    if (groupPage) {
+        removeWidget(groupPage);
+        delete groupPage;
+    }
+}
+
+void PagesWidget::activateGroupPage(int groupId)
+{
+    ChatPageWidget* current = dynamic_cast<ChatPageWidget*>(currentWidget());
+    if (current != nullptr) {
+        touch(current->getFriendId());
+    }
+    if (GroupChatPageWidget* groupPage = groups.value(groupId, nullptr)) {
+        setCurrentWidget(groupPage);
     }
 }
+
+void PagesWidget::onGroupEvents(const GroupEventList& events)
+{
+    // each page gets its consecutive events in one go, so its summaries and title are updated once
+    int start = 0;
+    while (start < events.size()) {
+        const int groupId = events[start].groupId;
+        int end = start + 1;
+        while (end < events.size() && events[end].groupId == groupId) {
+            end++;
+        }
+        if (GroupChatPageWidget* groupPage = groups.value(groupId, nullptr)) {
+            groupPage->applyEvents(events.mid(start, end - start));
+        }
+        start = end;
+    }
+}
+
+void PagesWidget::onGroupMessageFailed(int groupId, const QString& message)
+{
+    if (GroupChatPageWidget* groupPage = groups.value(groupId, nullptr)) {
+        groupPage->messageFailed(message);
+    }
+}
+
+void PagesWidget::onGroupMessageToSend(const QString& message)
+{
+    GroupChatPageWidget* groupPage = static_cast<GroupChatPageWidget*>(sender());
+    emit sendGroupMessage(groupPage->getGroupId(), message);
+}
+
+void PagesWidget::onGroupActionToSend(const QString& action)
+{
+    GroupChatPageWidget* groupPage = static_cast<GroupChatPageWidget*>(sender());
+    emit sendGroupAction(groupPage->getGroupId(), action);
+}
@@ -18,27 +18,112 @@
 #define PAGESWIDGET_HPP
 
 #include "chatpagewidget.hpp"
+#include "groupchat.hpp"
+#include "historyindex.hpp"
+#include "userid.hpp"
 
+#include <QElapsedTimer>
+#include <QHash>
 #include <QStackedWidget>
 
+class ChatWindow;
+class GroupChatPageWidget;
+class HistoryImporter;
+class QTimer;
+
 class PagesWidget : public QStackedWidget
 {
     Q_OBJECT
 public:
-    PagesWidget(QWidget* parent);
+    // chat histories are kept in historyDirPath, one per friend
+    PagesWidget(const QString& historyDirPath, QWidget* parent);
+
+    // searches the logged messages of every chat, newest first
+    QList<HistoryIndex::Result> searchHistory(const QString& query, int maxResults) const;
+    Message historyMessage(int friendId, MsgId msgId) const;
+    QString getUsername(int friendId) const;
+    // where the chat is logged, for a HistoryExporter
+    QString getHistoryPath(int friendId) const;
+    const QByteArray& getHistoryKey() const;
+    UserId getUserId(int friendId) const;
+    // runs importer on the chat's history and reindexes it once done, returns false if logging is disabled
+    bool importHistory(int friendId, HistoryImporter* importer);
+    // estimated memory of every chat that has a page, by username
+    QList<QPair<QString, ChatMemoryUsage>> getMemoryUsage() const;
+    QString getGroupTitle(int groupId) const;
+    // whether the user is looking at the friend's chat, messages arriving there are read right away
+    bool isChatShown(int friendId) const;
+    // -1 if no friend's chat is shown
+    int getCurrentFriendId() const;
+    // where the chat is scrolled to, also for a chat without a page, see ChatPageWidget::getAnchor()
+    MsgId getAnchor(int friendId) const;
+    // a chat without a page is scrolled there once its page is created
+    void setAnchor(int friendId, MsgId anchor);
+    QList<int> getFriendIds() const;
+    // of the open search bar of the chat, empty if it's closed or the chat has no page
+    QString getSearchString(int friendId) const;
+    void openSearchBar(int friendId, const QString& searchString);
 
 private:
+    // what is known about a friend, whether or not there is a page for them
+    struct Friend
+    {
+        UserId userId;
+        QString historyPath;
+        QString username;
+        Status status;
+        QString statusMessage;
+        bool typing;
+        // null until the chat is first needed
+        ChatPageWidget* page;
+        // where the page is scrolled to when it's created
+        MsgId anchor;
+        // holds the page while it's detached from the stack, null while it's docked
+        ChatWindow* window;
+        QElapsedTimer lastUsed;
+    };
+
+    const QString historyDirPath;
+    QByteArray historyKey;
+    HistoryIndex* historyIndex;
+    QHash<int, Friend> friends;
+    // group chats aren't logged, so their pages exist as long as the groups do
+    QHash<int, GroupChatPageWidget*> groups;
+    QTimer* idleTimer;
+
+    // pages that weren't shown or written to for this long are destroyed, if they are idle
+    static const int PAGE_IDLE_TIMEOUT = 10 * 60 * 1000;
+
     ChatPageWidget* widget(int friendId) const;
+    // the page of a friend, created if it doesn't exist yet
+    ChatPageWidget* page(int friendId);
+    void touch(int friendId);
 
 private slots:
     void onMessageToSend(const QString& message);
     void onActionToSend(const QString& action);
     void onTypingToSend(bool typing);
+    void onCallToStart(bool video);
+    void onCallToAnswer();
+    void onCallToHangUp();
+    void onFileToSend(const QString& filePath);
+    void onFileToAccept(int fileNumber, const QString& savePath);
+    void onFileToCancel(int fileNumber, FileTransferInfo::Direction direction);
+    void onGroupMessageToSend(const QString& message);
+    void onGroupActionToSend(const QString& action);
+    void onLogStorageOptsChanged();
+    void removeIdlePages();
+    void attachPage(int friendId);
 
 public slots:
-    void addPage(int friendId, const QString& userId);
+    // has to be set before pages are added, their logs are opened with it
+    void setHistoryKey(const QByteArray& key);
+    void addPage(int friendId, const UserId& userId);
     void removePage(int friendId);
     void activatePage(int friendId);
+    // moves the chat into a window of its own, the same page keeps serving it
+    void detachPage(int friendId);
+    void showMessage(int friendId, MsgId msgId);
     void onFriendStatusChanged(int friendId, Status status);
     void onFriendUsernameChanged(int friendId, const QString& username);
     void onFriendUsernameLoaded(int friendId, const QString& username);
@@ -49,13 +134,39 @@ public slots:
     void messageReceived(int friendId, const QString& message);
     void actionReceived(int friendId, const QString& message);
 
-    void messageSentResult(int friendId, const QString& message, int messageId);
-    void actionResult(int friendId, const QString &action, int success);
+    void messageQueued(int friendId, const QString& message, int queueId);
+    void actionQueued(int friendId, const QString& action, int queueId);
+    void messageSent(int friendId, int queueId, int messageId);
+    void messageRestored(int friendId, const QString& message, bool isAction, qint64 msgId, int queueId);
+    void messageDelivered(int friendId, int messageId);
+
+    void onCallStateChanged(int friendId, CallState state, bool video);
+    void onCallStatsReported(int friendId, const CallStats& stats);
+    void onVideoFrameReceived(int friendId, const QImage& frame);
+
+    void onFileTransfersUpdated(const FileTransferInfoList& transfers);
+
+    void addGroupPage(int groupId);
+    void removeGroupPage(int groupId);
+    void activateGroupPage(int groupId);
+    void onGroupEvents(const GroupEventList& events);
+    void onGroupMessageFailed(int groupId, const QString& message);
 
 signals:
     void sendMessage(int friendId, const QString& message);
     void sendAction(int friendId, const QString& action);
     void sendTyping(int friendId, bool typing);
+    void startCall(int friendId, bool video);
+    void answerCall(int friendId);
+    void hangUpCall(int friendId);
+    void sendFile(int friendId, const QString& filePath);
+    void acceptFile(int friendId, int fileNumber, const QString& savePath);
+    void cancelFile(int friendId, int fileNumber, FileTransferInfo::Direction direction);
+    void sendGroupMessage(int groupId, const QString& message);
+    void sendGroupAction(int groupId, const QString& action);
+    // our messages while they wait in the Core's outbox
+    void messagePending(int friendId, MsgId msgId, bool isAction, const QString& text);
+    void messageLeftOutbox(int friendId, MsgId msgId);
 
 };
 
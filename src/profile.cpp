@@ -0,0 +1,627 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "profile.hpp"
+
+#include "activityindex.hpp"
+#include "callmanager.hpp"
+#include "friendrequestdialog.hpp"
+#include "friendlistsnapshot.hpp"
+#include "friendrequestmodel.hpp"
+#include "friendswidget.hpp"
+#include "notificationsound.hpp"
+#include "ouruseritemwidget.hpp"
+#include "pageswidget.hpp"
+#include "coreeventlog.hpp"
+#include "outboxjournal.hpp"
+#include "profilecipher.hpp"
+#include "sessionstate.hpp"
+#include "Settings/settings.hpp"
+#include "trace.hpp"
+
+#include <QApplication>
+#include <QMessageBox>
+#include <QVBoxLayout>
+
+const QString Profile::DEFAULT_NAME = "Default";
+
+Profile::Profile(const QString& name, QWidget* parentWidget) :
+    QObject(parentWidget), name(name), parentWidget(parentWidget), restoringSession(true), friendRequestDialog(nullptr), status(Status::Offline)
+{
+    friendsPanel = new QWidget(parentWidget);
+    QVBoxLayout* layout = new QVBoxLayout(friendsPanel);
+    layout->setMargin(0);
+    layout->setSpacing(0);
+
+    ourUserItem = new OurUserItemWidget(friendsPanel, isDefault());
+    friendsWidget = new FriendsWidget(friendsPanel);
+
+    layout->addWidget(ourUserItem);
+    layout->addWidget(friendsWidget);
+
+    pages = new PagesWidget(Settings::getSettingsDirPath() + "/history/" + name, parentWidget);
+    connect(friendsWidget, &FriendsWidget::friendSelectionChanged, pages, &PagesWidget::activatePage);
+    connect(friendsWidget, &FriendsWidget::chatDetachRequested, pages, &PagesWidget::detachPage);
+
+    activity = new ActivityIndex(Settings::getSettingsDirPath() + "/activity/" + name, this);
+    connect(activity, &ActivityIndex::activityChanged, friendsWidget, &FriendsWidget::setActivity);
+    connect(activity, &ActivityIndex::totalUnreadCountChanged, this, &Profile::unreadCountChanged);
+    connect(friendsWidget, &FriendsWidget::friendSelectionChanged, activity, &ActivityIndex::markRead);
+    connect(qApp, &QApplication::applicationStateChanged, this, &Profile::onApplicationStateChanged);
+
+    session = new SessionState(Settings::getSettingsDirPath() + "/session/" + name, this);
+    // after the page is activated, so the snapshot has the new current chat
+    connect(friendsWidget, &FriendsWidget::friendSelectionChanged, this, &Profile::saveSession);
+
+    friendList = new FriendListSnapshot(Settings::getSettingsDirPath() + "/friends/" + name, this);
+    if (ProfileCipher::isEncryptedFile(Settings::getSettingsDirPath() + '/' + getConfigFileName(name))) {
+        // names and ids of the friends would be readable next to the encrypted profile
+        friendList->disable();
+    }
+    for (const FriendListSnapshot::Friend& f : friendList->getFriends()) {
+        friendsWidget->addCachedFriend(f.friendId, f.userId, f.username, f.statusMessage, f.lastSeen);
+        activity->addFriend(f.friendId, f.userId);
+    }
+
+    eventRecorder = nullptr;
+    const QString recordPath = CoreEventLog::getRecordPath();
+    if (isDefault() && !recordPath.isEmpty()) {
+        eventRecorder = new CoreEventRecorder(recordPath, this);
+    }
+
+    outboxJournal = new OutboxJournal(Settings::getSettingsDirPath() + "/outbox/" + name, this);
+    connect(pages, &PagesWidget::messagePending, outboxJournal, &OutboxJournal::addMessage);
+    connect(pages, &PagesWidget::messageLeftOutbox, outboxJournal, &OutboxJournal::removeMessage);
+
+    friendRequests = new FriendRequestModel(this);
+    connect(friendRequests, &FriendRequestModel::requestsAdded, this, &Profile::onFriendRequestsAdded);
+
+    // the default profile keeps using the identity stored in Settings,
+    // the rest take theirs from their own Tox state
+    core = new Core(getConfigFileName(name), isDefault());
+
+    connect(core, &Core::connected, this, &Profile::onConnected);
+    connect(core, &Core::disconnected, this, &Profile::onDisconnected);
+    drainTimer = new QTimer(this);
+    drainTimer->setSingleShot(true);
+    connect(drainTimer, &QTimer::timeout, this, &Profile::drainCoreEvents);
+    connect(core, &Core::eventsReady, this, &Profile::onCoreEventsReady);
+    connect(core, &Core::friendAddressGenerated, ourUserItem, &OurUserItemWidget::setFriendAddress);
+    connect(core, &Core::historyKeyGenerated, pages, &PagesWidget::setHistoryKey);
+    connect(core, &Core::historyKeyGenerated, outboxJournal, &OutboxJournal::setKey);
+    connect(core, &Core::friendAdded, pages, &PagesWidget::addPage);
+    connect(core, &Core::friendAdded, friendsWidget, &FriendsWidget::addFriend);
+    // after the friend list, which shows what the index restores
+    connect(core, &Core::friendAdded, activity, &ActivityIndex::addFriend);
+    connect(core, &Core::friendAdded, this, &Profile::onFriendAdded);
+    connect(core, &Core::friendAdded, friendList, &FriendListSnapshot::addFriend);
+    connect(core, &Core::friendListLoaded, this, &Profile::onFriendListLoaded);
+    connect(core, &Core::friendRemoved, friendsWidget, &FriendsWidget::removeFriend);
+    connect(core, &Core::friendRemoved, friendList, &FriendListSnapshot::removeFriend);
+    connect(core, &Core::friendRemoved, activity, &ActivityIndex::removeFriend);
+    connect(core, &Core::friendRemoved, session, &SessionState::removeFriend);
+    connect(core, &Core::friendRemoved, pages, &PagesWidget::removePage);
+    connect(core, &Core::friendRemoved, this, [this](int friendId) {onlineFriends.remove(friendId);});
+    connect(core, &Core::failedToRemoveFriend, this, &Profile::onFailedToRemoveFriend);
+    connect(core, &Core::failedToAddFriend, this, &Profile::onFailedToAddFriend);
+    connect(core, &Core::messageQueued, pages, &PagesWidget::messageQueued);
+    connect(core, &Core::actionQueued, pages, &PagesWidget::actionQueued);
+    connect(core, &Core::messageSent, pages, &PagesWidget::messageSent);
+    connect(core, &Core::messageRestored, pages, &PagesWidget::messageRestored);
+    connect(this, &Profile::messageRestoreRequested, core, &Core::restoreMessage);
+    connect(core, &Core::friendRemoved, outboxJournal, &OutboxJournal::removeFriend);
+    connect(core, &Core::messageQueued, activity, [this](int friendId) {activity->recordMessage(friendId, false);});
+    connect(core, &Core::actionQueued, activity, [this](int friendId) {activity->recordMessage(friendId, false);});
+
+    connect(core, &Core::failedToStart, this, &Profile::onFailedToStartCore);
+    connect(core, &Core::callManagerCreated, this, &Profile::onCallManagerCreated);
+
+    connect(this, &Profile::metricsRequested, core, &Core::reportMetrics);
+    connect(this, &Profile::powerSavingRequested, core, &Core::setPowerSaving);
+
+    connect(this, &Profile::statusRequested, core, &Core::setStatus);
+    connect(core, &Core::statusSet, this, &Profile::onStatusSet);
+
+    connect(this, &Profile::friendRequested, core, &Core::requestFriendship);
+
+    connect(this, &Profile::friendRequestAccepted, core, &Core::acceptFriendRequest);
+
+    connect(ourUserItem, &OurUserItemWidget::usernameChanged, core, &Core::setUsername);
+    connect(core, &Core::usernameSet, ourUserItem, &OurUserItemWidget::setUsername);
+    connect(core, &Core::usernameSet, pages, &PagesWidget::onOurUsernameChanged);
+
+    connect(ourUserItem, &OurUserItemWidget::statusMessageChanged, core, &Core::setStatusMessage);
+    connect(core, &Core::statusMessageSet, ourUserItem, &OurUserItemWidget::setStatusMessage);
+
+    connect(ourUserItem, &OurUserItemWidget::statusSelected, core, &Core::setStatus);
+    connect(core, &Core::statusSet, ourUserItem, &OurUserItemWidget::setStatus);
+
+    connect(pages, &PagesWidget::sendMessage, core, &Core::sendMessage);
+    connect(pages, &PagesWidget::sendAction,  core, &Core::sendAction);
+    connect(pages, &PagesWidget::sendTyping,  core, &Core::sendTyping);
+
+    connect(pages, &PagesWidget::sendFile,   core, &Core::sendFile);
+    connect(pages, &PagesWidget::acceptFile, core, &Core::acceptFile);
+    connect(pages, &PagesWidget::cancelFile, core, &Core::cancelFile);
+    connect(core, &Core::fileTransfersUpdated, pages, &PagesWidget::onFileTransfersUpdated);
+    connect(core, &Core::fileTransfersUpdated, this, &Profile::onFileTransfersUpdated);
+    connect(core, &Core::failedToSendFile, this, &Profile::onFailedToSendFile);
+
+    connect(friendsWidget, &FriendsWidget::friendRemoved, core, &Core::removeFriend);
+
+    connect(this, &Profile::groupCreationRequested, core, &Core::createGroup);
+    connect(this, &Profile::groupJoinRequested, core, &Core::joinGroup);
+    connect(core, &Core::groupCreated, this, &Profile::onGroupCreated);
+    connect(core, &Core::groupRemoved, this, &Profile::onGroupRemoved);
+    connect(core, &Core::groupEventsReceived, this, &Profile::onGroupEvents);
+    connect(core, &Core::failedToCreateGroup, this, &Profile::onFailedToCreateGroup);
+    connect(this, &Profile::passwordChangeRequested, core, &Core::setPassword);
+    connect(core, &Core::failedToSetPassword, this, &Profile::onFailedToSetPassword);
+    connect(core, &Core::failedToJoinGroup, this, &Profile::onFailedToJoinGroup);
+    connect(core, &Core::failedToInviteToGroup, this, &Profile::onFailedToInviteToGroup);
+    connect(core, &Core::failedToSendGroupMessage, pages, &PagesWidget::onGroupMessageFailed);
+    connect(friendsWidget, &FriendsWidget::groupSelectionChanged, pages, &PagesWidget::activateGroupPage);
+    connect(friendsWidget, &FriendsWidget::inviteToGroupRequested, core, &Core::inviteToGroup);
+    connect(friendsWidget, &FriendsWidget::leaveGroupRequested, core, &Core::leaveGroup);
+    connect(pages, &PagesWidget::sendGroupMessage, core, &Core::sendGroupMessage);
+    connect(pages, &PagesWidget::sendGroupAction,  core, &Core::sendGroupAction);
+}
+
+// the Core's thread must be stopped before a Profile is destroyed
+Profile::~Profile()
+{
+    saveSession();
+    delete core;
+}
+
+const QString& Profile::getName() const
+{
+    return name;
+}
+
+bool Profile::isDefault() const
+{
+    return name == DEFAULT_NAME;
+}
+
+Core* Profile::getCore() const
+{
+    return core;
+}
+
+QWidget* Profile::getFriendsPanel() const
+{
+    return friendsPanel;
+}
+
+PagesWidget* Profile::getPages() const
+{
+    return pages;
+}
+
+Status Profile::getStatus() const
+{
+    return status;
+}
+
+int Profile::getUnreadCount() const
+{
+    return activity->getTotalUnreadCount();
+}
+
+QString Profile::getConfigFileName(const QString& name)
+{
+    return name == DEFAULT_NAME ? Core::CONFIG_FILE_NAME : name + ".tox";
+}
+
+void Profile::requestFriendship(const QString& friendAddress, const QString& message)
+{
+    emit friendRequested(friendAddress, message);
+}
+
+void Profile::setStatus(Status status)
+{
+    emit statusRequested(status);
+}
+
+void Profile::requestMetrics()
+{
+    emit metricsRequested();
+}
+
+void Profile::setPowerSaving(bool enabled)
+{
+    emit powerSavingRequested(enabled);
+}
+
+void Profile::showMessage(int friendId, MsgId msgId)
+{
+    friendsWidget->selectFriend(friendId);
+    pages->showMessage(friendId, msgId);
+}
+
+void Profile::onFriendRequestReceived(const UserId& userId, const QString& message)
+{
+    friendRequests->addRequest(userId, message);
+}
+
+void Profile::onFriendRequestsAdded()
+{
+    if (!friendRequestDialog) {
+        friendRequestDialog = new FriendRequestDialog(parentWidget, friendRequests);
+        connect(friendRequestDialog, &FriendRequestDialog::friendRequestAccepted, this, &Profile::friendRequestAccepted);
+    }
+    // later batches of a wave only grow the list
+    if (!friendRequestDialog->isVisible()) {
+        friendRequestDialog->show();
+    }
+}
+
+void Profile::onCoreEventsReady()
+{
+    if (drainTimer->isActive()) {
+        return;
+    }
+
+    // right away if the last drain was a frame ago, the core iterates much more often than that when busy
+    const qint64 sinceLastDrain = lastDrain.isValid() ? lastDrain.elapsed() : DRAIN_INTERVAL;
+    drainTimer->start(qMax<qint64>(0, DRAIN_INTERVAL - sinceLastDrain));
+}
+
+void Profile::drainCoreEvents()
+{
+    lastDrain.start();
+
+    CoreEventBatch events;
+    core->getEventQueue()->drain(events);
+    onCoreEvents(events);
+}
+
+void Profile::onCoreEvents(const CoreEventBatch& events)
+{
+    // the first event of a batch waited the longest
+    if (Trace::isEnabled() && !events.isEmpty() && events.first().queuedAt > 0) {
+        Trace::record("Core event to GUI latency", events.first().queuedAt, Trace::now());
+    }
+    Trace::Span span("Profile::onCoreEvents");
+
+    if (eventRecorder) {
+        eventRecorder->record(events);
+    }
+
+    for (const CoreEvent& event : events) {
+        switch (event.type) {
+            case CoreEvent::Type::Superseded:
+                break;
+            case CoreEvent::Type::FriendRequestReceived:
+                onFriendRequestReceived(event.userId, event.text);
+                break;
+            case CoreEvent::Type::FriendAdded:
+                pages->addPage(event.friendId, event.userId);
+                friendsWidget->addFriend(event.friendId, event.userId);
+                activity->addFriend(event.friendId, event.userId);
+                friendList->addFriend(event.friendId, event.userId);
+                onFriendAdded(event.friendId, event.userId);
+                break;
+            case CoreEvent::Type::FriendMessageReceived:
+                pages->messageReceived(event.friendId, event.text);
+                onMessageReceived(event.friendId);
+                break;
+            case CoreEvent::Type::FriendActionReceived:
+                pages->actionReceived(event.friendId, event.text);
+                onMessageReceived(event.friendId);
+                break;
+            case CoreEvent::Type::FriendUsernameChanged:
+                friendsWidget->setUsername(event.friendId, event.text);
+                friendList->setUsername(event.friendId, event.text);
+                pages->onFriendUsernameChanged(event.friendId, event.text);
+                break;
+            case CoreEvent::Type::FriendUsernameLoaded:
+                friendsWidget->setUsername(event.friendId, event.text);
+                friendList->setUsername(event.friendId, event.text);
+                pages->onFriendUsernameLoaded(event.friendId, event.text);
+                break;
+            case CoreEvent::Type::FriendStatusMessageChanged:
+                friendsWidget->setStatusMessage(event.friendId, event.text);
+                friendList->setStatusMessage(event.friendId, event.text);
+                pages->onFriendStatusMessageChanged(event.friendId, event.text);
+                break;
+            case CoreEvent::Type::FriendStatusMessageLoaded:
+                friendsWidget->setStatusMessage(event.friendId, event.text);
+                friendList->setStatusMessage(event.friendId, event.text);
+                pages->onFriendStatusMessageLoaded(event.friendId, event.text);
+                break;
+            case CoreEvent::Type::FriendStatusChanged:
+                friendsWidget->setStatus(event.friendId, event.status);
+                pages->onFriendStatusChanged(event.friendId, event.status);
+                if (event.status == Status::Offline) {
+                    if (onlineFriends.remove(event.friendId)) {
+                        NotificationSound::getInstance().play(NotificationSound::ContactLogsOut);
+                    }
+                } else if (!onlineFriends.contains(event.friendId)) {
+                    onlineFriends.insert(event.friendId);
+                    NotificationSound::getInstance().play(NotificationSound::ContactLogsIn);
+                }
+                break;
+            case CoreEvent::Type::FriendTypingChanged:
+                pages->onFriendTypingChanged(event.friendId, event.flag);
+                break;
+            case CoreEvent::Type::FriendLastSeenChanged:
+                friendsWidget->setLastSeen(event.friendId, event.dateTime);
+                friendList->setLastSeen(event.friendId, event.dateTime);
+                break;
+            case CoreEvent::Type::FriendMessageDelivered:
+                pages->messageDelivered(event.friendId, event.messageId);
+                break;
+        }
+    }
+}
+
+void Profile::onCallManagerCreated(CallManager* callManager)
+{
+    connect(pages, &PagesWidget::startCall, callManager, &CallManager::startCall);
+    connect(pages, &PagesWidget::answerCall, callManager, &CallManager::answerCall);
+    connect(pages, &PagesWidget::hangUpCall, callManager, &CallManager::hangUp);
+    connect(callManager, &CallManager::callStateChanged, pages, &PagesWidget::onCallStateChanged);
+    connect(callManager, &CallManager::statsReported, pages, &PagesWidget::onCallStatsReported);
+    connect(callManager, &CallManager::videoFrameReceived, pages, &PagesWidget::onVideoFrameReceived);
+    connect(callManager, &CallManager::callStateChanged, this, [](int /*friendId*/, CallState state, bool /*video*/) {
+        if (state == CallState::Incoming) {
+            NotificationSound::getInstance().play(NotificationSound::IncomingCall);
+        }
+    });
+}
+
+void Profile::onConnected()
+{
+    NotificationSound::getInstance().play(NotificationSound::LogIn);
+    emit statusRequested(Status::Online);
+}
+
+void Profile::onDisconnected()
+{
+    onlineFriends.clear();
+    NotificationSound::getInstance().play(NotificationSound::LogOut);
+    emit statusRequested(Status::Offline);
+}
+
+void Profile::onStatusSet(Status status)
+{
+    this->status = status;
+    emit statusChanged(status);
+}
+
+void Profile::onFailedToRemoveFriend(int friendId)
+{
+    NotificationSound::getInstance().play(NotificationSound::Error);
+    QMessageBox critical(parentWidget);
+    critical.setText(QString("Couldn't remove friend \"%1\"").arg(friendsWidget->getUsername(friendId)));
+    critical.setIcon(QMessageBox::Critical);
+    critical.exec();
+}
+
+void Profile::onFileTransfersUpdated(const FileTransferInfoList& transfers)
+{
+    for (const FileTransferInfo& info : transfers) {
+        if (info.state == FileTransferInfo::State::Finished) {
+            NotificationSound::getInstance().play(NotificationSound::TransferComplete);
+        } else if (info.direction == FileTransferInfo::Direction::Receiving && info.state == FileTransferInfo::State::Pending) {
+            NotificationSound::getInstance().play(NotificationSound::TransferPending);
+        }
+    }
+}
+
+void Profile::onFailedToSendFile(int friendId, const QString& filePath)
+{
+    NotificationSound::getInstance().play(NotificationSound::Error);
+    QMessageBox critical(parentWidget);
+    critical.setText(QString("Couldn't send \"%1\" to \"%2\"").arg(filePath).arg(friendsWidget->getUsername(friendId)));
+    critical.setIcon(QMessageBox::Critical);
+    critical.exec();
+}
+
+void Profile::onFailedToAddFriend(const QString& userId)
+{
+    NotificationSound::getInstance().play(NotificationSound::Error);
+    QMessageBox critical(parentWidget);
+    critical.setText(QString("Couldn't add friend with User ID\n\"%1\"").arg(userId));
+    critical.setIcon(QMessageBox::Critical);
+    critical.exec();
+}
+
+void Profile::createGroup()
+{
+    emit groupCreationRequested();
+}
+
+void Profile::startReplay(const QString& path, double speed)
+{
+    // the Core isn't started, nothing may call into it
+    for (QObject* sender : QList<QObject*>() << this << pages << friendsWidget << ourUserItem << &Settings::getInstance()) {
+        disconnect(sender, nullptr, core, nullptr);
+    }
+
+    CoreEventReplayer* replayer = new CoreEventReplayer(path, speed, this);
+    connect(replayer, &CoreEventReplayer::eventsReplayed, this, &Profile::onCoreEvents);
+    connect(replayer, &CoreEventReplayer::finished, replayer, &CoreEventReplayer::deleteLater);
+    replayer->start();
+}
+
+void Profile::setPassword(const QString& password)
+{
+    if (!password.isEmpty()) {
+        friendList->disable();
+    }
+    emit passwordChangeRequested(password);
+}
+
+void Profile::onGroupCreated(int groupId)
+{
+    pages->addGroupPage(groupId);
+    friendsWidget->addGroup(groupId, pages->getGroupTitle(groupId));
+    friendsWidget->selectGroup(groupId);
+}
+
+void Profile::onGroupRemoved(int groupId)
+{
+    friendsWidget->removeGroup(groupId);
+    pages->removeGroupPage(groupId);
+}
+
+void Profile::onGroupEvents(const GroupEventList& events)
+{
+    Trace::Span span("Profile::onGroupEvents");
+
+    GroupEventList groupEvents;
+    groupEvents.reserve(events.size());
+    for (const GroupEvent& event : events) {
+        if (event.type != GroupEvent::Type::Invited) {
+            groupEvents << event;
+            continue;
+        }
+
+        QMessageBox question(parentWidget);
+        question.setText(QString("\"%1\" invites you to a group chat. Do you want to join it?").arg(pages->getUsername(event.friendId)));
+        question.setIcon(QMessageBox::Question);
+        question.setStandardButtons(QMessageBox::Yes | QMessageBox::No);
+        if (question.exec() == QMessageBox::Yes) {
+            emit groupJoinRequested(event.friendId, event.inviteKey);
+        }
+    }
+
+    pages->onGroupEvents(groupEvents);
+}
+
+void Profile::onFailedToCreateGroup()
+{
+    NotificationSound::getInstance().play(NotificationSound::Error);
+    QMessageBox critical(parentWidget);
+    critical.setText("Couldn't create a group chat");
+    critical.setIcon(QMessageBox::Critical);
+    critical.exec();
+}
+
+void Profile::onFailedToSetPassword()
+{
+    NotificationSound::getInstance().play(NotificationSound::Error);
+    QMessageBox critical(parentWidget);
+    critical.setText(QString("Couldn't encrypt profile \"%1\", it stays saved as it was").arg(name));
+    critical.setIcon(QMessageBox::Critical);
+    critical.exec();
+}
+
+void Profile::onFailedToJoinGroup(int friendId)
+{
+    NotificationSound::getInstance().play(NotificationSound::Error);
+    QMessageBox critical(parentWidget);
+    critical.setText(QString("Couldn't join the group chat of \"%1\"").arg(pages->getUsername(friendId)));
+    critical.setIcon(QMessageBox::Critical);
+    critical.exec();
+}
+
+void Profile::onFailedToInviteToGroup(int friendId, int groupId)
+{
+    NotificationSound::getInstance().play(NotificationSound::Error);
+    QMessageBox critical(parentWidget);
+    critical.setText(QString("Couldn't invite \"%1\" to \"%2\"").arg(pages->getUsername(friendId)).arg(pages->getGroupTitle(groupId)));
+    critical.setIcon(QMessageBox::Critical);
+    critical.exec();
+}
+
+void Profile::onFailedToStartCore()
+{
+    QMessageBox critical(parentWidget);
+    if (isDefault()) {
+        critical.setText("If you see this message that means that something very bad has happened.\n\nYou could have reached a limit on how many instances of this program can be run on a single computer, or you could just run out of memory, or something else horrible has happened.\n\nWhichever is the case, the application will terminate after you close this message.");
+    } else {
+        critical.setText(QString("Couldn't start profile \"%1\".\n\nYou could have reached a limit on how many Tox instances can be run on a single computer, or you could just run out of memory.").arg(name));
+    }
+    critical.setIcon(QMessageBox::Critical);
+    critical.exec();
+    if (isDefault()) {
+        qApp->quit();
+    }
+}
+
+void Profile::onMessageReceived(int friendId)
+{
+    activity->recordMessage(friendId, !pages->isChatShown(friendId));
+    NotificationSound::getInstance().play(NotificationSound::NewMessage);
+}
+
+void Profile::onFriendListLoaded(const QList<int>& friendIds)
+{
+    const QSet<int> loaded = friendIds.toSet();
+    for (const FriendListSnapshot::Friend& f : friendList->getFriends()) {
+        if (!loaded.contains(f.friendId)) {
+            friendsWidget->removeFriend(f.friendId);
+            activity->removeFriend(f.friendId);
+        }
+    }
+    friendList->retainFriends(friendIds);
+}
+
+void Profile::onFriendAdded(int friendId, const UserId& userId)
+{
+    session->addFriend(friendId, userId);
+
+    // what the friend didn't get last time goes out before anything typed now
+    outboxJournal->addFriend(friendId, userId);
+    for (const OutboxJournal::Entry& entry : outboxJournal->getPending(friendId)) {
+        emit messageRestoreRequested(friendId, entry.text, entry.isAction, entry.msgId.toLong());
+    }
+
+    // only the chat that was open is restored right away, the others when their pages are created
+    pages->setAnchor(friendId, session->getAnchor(friendId));
+    if (restoringSession && session->isCurrentChat(friendId) && pages->getCurrentFriendId() < 0) {
+        restoringSession = false;
+        friendsWidget->selectFriend(friendId);
+        const QString searchString = session->getSearchString();
+        if (!searchString.isEmpty()) {
+            pages->openSearchBar(friendId, searchString);
+        }
+    }
+}
+
+void Profile::saveSession()
+{
+    for (int friendId : pages->getFriendIds()) {
+        session->setAnchor(friendId, pages->getAnchor(friendId));
+    }
+
+    // the chat to restore may just not be added yet
+    const int friendId = pages->getCurrentFriendId();
+    if (friendId >= 0) {
+        restoringSession = false;
+        session->setCurrentChat(friendId, pages->getSearchString(friendId));
+    } else if (!restoringSession) {
+        session->setCurrentChat(-1, QString());
+    }
+}
+
+void Profile::onApplicationStateChanged(Qt::ApplicationState state)
+{
+    // what arrived while the window was in the background is read once the user is back
+    if (state == Qt::ApplicationActive) {
+        const int friendId = pages->getCurrentFriendId();
+        // the window may not be active yet when the application is
+        if (friendId >= 0 && pages->isVisible()) {
+            activity->markRead(friendId);
+        }
+    } else {
+        saveSession();
+    }
+}
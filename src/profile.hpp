@@ -0,0 +1,156 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef PROFILE_HPP
+#define PROFILE_HPP
+
+#include "core.hpp"
+#include "messages/id.hpp"
+#include "status.hpp"
+#include "userid.hpp"
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QSet>
+
+class ActivityIndex;
+class CallManager;
+class FriendRequestDialog;
+class FriendRequestModel;
+class FriendListSnapshot;
+class FriendsWidget;
+class OurUserItemWidget;
+class PagesWidget;
+class CoreEventRecorder;
+class OutboxJournal;
+class SessionState;
+
+// One Tox identity: its Core together with the widgets showing it.
+// The Core lives on a CoreThreadPool thread, the widgets are owned by
+// whatever they get embedded into.
+class Profile : public QObject
+{
+    Q_OBJECT
+public:
+    Profile(const QString& name, QWidget* parentWidget);
+    ~Profile();
+
+    static const QString DEFAULT_NAME;
+
+    const QString& getName() const;
+    bool isDefault() const;
+
+    Core* getCore() const;
+    QWidget* getFriendsPanel() const;
+    PagesWidget* getPages() const;
+    Status getStatus() const;
+    // messages of all friends the user didn't see yet
+    int getUnreadCount() const;
+
+    static QString getConfigFileName(const QString& name);
+
+private:
+    const QString name;
+    QWidget* parentWidget;
+    Core* core;
+    QWidget* friendsPanel;
+    OurUserItemWidget* ourUserItem;
+    FriendsWidget* friendsWidget;
+    PagesWidget* pages;
+    FriendRequestModel* friendRequests;
+    // unread counts and last messages for the friend list
+    ActivityIndex* activity;
+    // the open chat and scroll positions, for the next start
+    SessionState* session;
+    // the friend list shown before the Core has loaded its own
+    FriendListSnapshot* friendList;
+    // our messages still waiting for their friends, queued again on the next start
+    OutboxJournal* outboxJournal;
+    // only if asked for, see CoreEventLog
+    CoreEventRecorder* eventRecorder;
+    // until the chat that was open last time is shown again, or the user opens another
+    bool restoringSession;
+    // created with the first request
+    FriendRequestDialog* friendRequestDialog;
+    Status status;
+    // to tell friends logging in from ones changing their status, for the notification sounds
+    QSet<int> onlineFriends;
+
+    // the core's events are drained at most once per frame
+    QTimer* drainTimer;
+    QElapsedTimer lastDrain;
+    static const int DRAIN_INTERVAL = 16; // ms
+
+public slots:
+    void requestFriendship(const QString& friendAddress, const QString& message);
+    void setStatus(Status status);
+    void requestMetrics();
+    // to be enabled while the window isn't shown
+    void setPowerSaving(bool enabled);
+    // selects the friend and scrolls its chat to the logged message
+    void showMessage(int friendId, MsgId msgId);
+    void createGroup();
+    // feeds a recorded session to the GUI in place of the Core's events, to be called instead of starting the Core
+    void startReplay(const QString& path, double speed);
+    // an empty password stores the profile unencrypted
+    void setPassword(const QString& password);
+
+private slots:
+    void onFriendAdded(int friendId, const UserId& userId);
+    // drops the friends shown from the FriendListSnapshot that the Core doesn't have
+    void onFriendListLoaded(const QList<int>& friendIds);
+    // hands the state of the pages to the SessionState
+    void saveSession();
+    void onConnected();
+    void onDisconnected();
+    void onCoreEventsReady();
+    void drainCoreEvents();
+    void onCoreEvents(const CoreEventBatch& events);
+    void onMessageReceived(int friendId);
+    void onApplicationStateChanged(Qt::ApplicationState state);
+    void onFriendRequestReceived(const UserId& userId, const QString& message);
+    void onFriendRequestsAdded();
+    void onFailedToRemoveFriend(int friendId);
+    void onFailedToAddFriend(const QString& userId);
+    void onFileTransfersUpdated(const FileTransferInfoList& transfers);
+    void onFailedToSendFile(int friendId, const QString& filePath);
+    void onFailedToStartCore();
+    void onCallManagerCreated(CallManager* callManager);
+    void onStatusSet(Status status);
+    void onGroupCreated(int groupId);
+    void onGroupRemoved(int groupId);
+    void onGroupEvents(const GroupEventList& events);
+    void onFailedToCreateGroup();
+    void onFailedToJoinGroup(int friendId);
+    void onFailedToInviteToGroup(int friendId, int groupId);
+    void onFailedToSetPassword();
+
+signals:
+    void friendRequestAccepted(const UserId& userId);
+    void friendRequested(const QString& friendAddress, const QString& message);
+    void statusRequested(Status status);
+    void metricsRequested();
+    void powerSavingRequested(bool enabled);
+    void statusChanged(Status status);
+    void unreadCountChanged(int count);
+    void groupCreationRequested();
+    void passwordChangeRequested(const QString& password);
+    void messageRestoreRequested(int friendId, const QString& message, bool isAction, qint64 tag);
+    void groupJoinRequested(int friendId, const QByteArray& inviteKey);
+
+};
+
+#endif // PROFILE_HPP
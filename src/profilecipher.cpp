@@ -0,0 +1,127 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "profilecipher.hpp"
+
+#include <QFile>
+#include <QMutexLocker>
+
+#include <sodium.h>
+
+const QByteArray ProfileCipher::MAGIC = QByteArrayLiteral("toxQtGUIenc1");
+const int ProfileCipher::HEADER_SIZE = MAGIC.size() + crypto_pwhash_SALTBYTES + crypto_aead_xchacha20poly1305_ietf_NPUBBYTES;
+
+QMutex ProfileCipher::keysMutex;
+QHash<QString, QByteArray> ProfileCipher::keys;
+
+bool ProfileCipher::isEncrypted(const QByteArray& data)
+{
+    return data.size() >= HEADER_SIZE + static_cast<int>(crypto_aead_xchacha20poly1305_ietf_ABYTES) && data.startsWith(MAGIC);
+}
+
+bool ProfileCipher::isEncryptedFile(const QString& path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    return file.read(MAGIC.size()) == MAGIC;
+}
+
+QByteArray ProfileCipher::generateSalt()
+{
+    QByteArray salt(crypto_pwhash_SALTBYTES, 0);
+    randombytes_buf(salt.data(), salt.size());
+    return salt;
+}
+
+QByteArray ProfileCipher::getSalt(const QByteArray& data)
+{
+    if (!isEncrypted(data)) {
+        return QByteArray();
+    }
+    return data.mid(MAGIC.size(), crypto_pwhash_SALTBYTES);
+}
+
+QByteArray ProfileCipher::deriveKey(const QString& password, const QByteArray& salt)
+{
+    QByteArray utf8Password = password.toUtf8();
+    QByteArray key(crypto_aead_xchacha20poly1305_ietf_KEYBYTES, 0);
+    const int result = crypto_pwhash(reinterpret_cast<unsigned char*>(key.data()), key.size(),
+                                     utf8Password.constData(), utf8Password.size(),
+                                     reinterpret_cast<const unsigned char*>(salt.constData()),
+                                     crypto_pwhash_OPSLIMIT_INTERACTIVE, crypto_pwhash_MEMLIMIT_INTERACTIVE, crypto_pwhash_ALG_DEFAULT);
+    sodium_memzero(utf8Password.data(), utf8Password.size());
+
+    // out of memory
+    if (result != 0) {
+        return QByteArray();
+    }
+    return key;
+}
+
+QByteArray ProfileCipher::encrypt(const QByteArray& data, const QByteArray& key, const QByteArray& salt)
+{
+    QByteArray nonce(crypto_aead_xchacha20poly1305_ietf_NPUBBYTES, 0);
+    randombytes_buf(nonce.data(), nonce.size());
+
+    QByteArray encrypted = MAGIC + salt + nonce;
+    encrypted.resize(HEADER_SIZE + data.size() + crypto_aead_xchacha20poly1305_ietf_ABYTES);
+
+    unsigned long long encryptedSize;
+    crypto_aead_xchacha20poly1305_ietf_encrypt(reinterpret_cast<unsigned char*>(encrypted.data()) + HEADER_SIZE, &encryptedSize,
+                                               reinterpret_cast<const unsigned char*>(data.constData()), data.size(),
+                                               reinterpret_cast<const unsigned char*>(encrypted.constData()), HEADER_SIZE,
+                                               nullptr,
+                                               reinterpret_cast<const unsigned char*>(nonce.constData()),
+                                               reinterpret_cast<const unsigned char*>(key.constData()));
+    return encrypted;
+}
+
+bool ProfileCipher::decrypt(const QByteArray& data, const QByteArray& key, QByteArray& plain)
+{
+    if (!isEncrypted(data) || key.size() != crypto_aead_xchacha20poly1305_ietf_KEYBYTES) {
+        return false;
+    }
+
+    const unsigned char* header = reinterpret_cast<const unsigned char*>(data.constData());
+    const unsigned char* nonce = header + MAGIC.size() + crypto_pwhash_SALTBYTES;
+
+    plain.resize(data.size() - HEADER_SIZE - crypto_aead_xchacha20poly1305_ietf_ABYTES);
+    unsigned long long plainSize;
+    if (crypto_aead_xchacha20poly1305_ietf_decrypt(reinterpret_cast<unsigned char*>(plain.data()), &plainSize, nullptr,
+                                                   header + HEADER_SIZE, data.size() - HEADER_SIZE,
+                                                   header, HEADER_SIZE,
+                                                   nonce,
+                                                   reinterpret_cast<const unsigned char*>(key.constData())) != 0) {
+        plain.clear();
+        return false;
+    }
+    return true;
+}
+
+void ProfileCipher::storeKey(const QString& configFileName, const QByteArray& key)
+{
+    QMutexLocker locker(&keysMutex);
+    keys.insert(configFileName, key);
+}
+
+QByteArray ProfileCipher::takeKey(const QString& configFileName)
+{
+    QMutexLocker locker(&keysMutex);
+    return keys.take(configFileName);
+}
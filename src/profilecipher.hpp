@@ -0,0 +1,60 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef PROFILECIPHER_HPP
+#define PROFILECIPHER_HPP
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+
+// Encrypts the Tox configuration files with a key derived from the user's password.
+// An encrypted file is MAGIC, the salt, the nonce and the ciphertext, the header is authenticated too.
+class ProfileCipher
+{
+public:
+    static bool isEncrypted(const QByteArray& data);
+    // reads just the header, cheap enough for the GUI thread
+    static bool isEncryptedFile(const QString& path);
+
+    static QByteArray generateSalt();
+    // empty unless data is encrypted
+    static QByteArray getSalt(const QByteArray& data);
+
+    // runs libsodium's password hashing, which is slow and memory hungry on purpose,
+    // never call it on the GUI thread
+    static QByteArray deriveKey(const QString& password, const QByteArray& salt);
+
+    // cheap, a fresh nonce is used every time
+    static QByteArray encrypt(const QByteArray& data, const QByteArray& key, const QByteArray& salt);
+    static bool decrypt(const QByteArray& data, const QByteArray& key, QByteArray& plain);
+
+    // keys unlocked at login are handed over to the Cores here, by configuration file name
+    static void storeKey(const QString& configFileName, const QByteArray& key);
+    static QByteArray takeKey(const QString& configFileName);
+
+private:
+    static const QByteArray MAGIC;
+    static const int HEADER_SIZE;
+
+    static QMutex keysMutex;
+    static QHash<QString, QByteArray> keys;
+
+};
+
+#endif // PROFILECIPHER_HPP
@@ -0,0 +1,143 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "sessionstate.hpp"
+
+#include <QBuffer>
+#include <QDataStream>
+#include <QDebug>
+#include <QFile>
+
+SessionState::SessionState(const QString& filePath, QObject* parent) :
+    QObject(parent),
+    filePath(filePath),
+    writer(filePath, SAVE_DELAY, "Session state")
+{
+    connect(&writer, &DelayedWriter::due, this, &SessionState::save);
+
+    load();
+}
+
+SessionState::~SessionState()
+{
+    writer.flush();
+}
+
+void SessionState::load()
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_2);
+    quint32 version;
+    quint32 count;
+    stream >> version >> currentChat >> searchString >> count;
+    if (stream.status() != QDataStream::Ok || version != FILE_VERSION) {
+        qWarning() << "Session state" << filePath << "is unreadable, the last session isn't restored";
+        currentChat.clear();
+        searchString.clear();
+        return;
+    }
+
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; i++) {
+        QString userId;
+        MsgId anchor;
+        stream >> userId >> anchor;
+        if (anchor.isValid()) {
+            anchors.insert(userId, anchor);
+        }
+    }
+}
+
+void SessionState::save()
+{
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    QDataStream stream(&buffer);
+    stream.setVersion(QDataStream::Qt_5_2);
+    stream << FILE_VERSION << currentChat << searchString << quint32(anchors.size());
+    for (QHash<QString, MsgId>::const_iterator it = anchors.constBegin(); it != anchors.constEnd(); ++it) {
+        stream << it.key() << it.value();
+    }
+
+    writer.replace(data);
+}
+
+void SessionState::changed()
+{
+    writer.schedule();
+}
+
+bool SessionState::isCurrentChat(int friendId) const
+{
+    QHash<int, QString>::const_iterator it = userIds.constFind(friendId);
+    return it != userIds.constEnd() && !currentChat.isEmpty() && it.value() == currentChat;
+}
+
+QString SessionState::getSearchString() const
+{
+    return searchString;
+}
+
+MsgId SessionState::getAnchor(int friendId) const
+{
+    return anchors.value(userIds.value(friendId));
+}
+
+void SessionState::setCurrentChat(int friendId, const QString& searchString)
+{
+    const QString userId = userIds.value(friendId);
+    if (userId == currentChat && searchString == this->searchString) {
+        return;
+    }
+    currentChat = userId;
+    this->searchString = searchString;
+    changed();
+}
+
+void SessionState::setAnchor(int friendId, MsgId anchor)
+{
+    QHash<int, QString>::const_iterator it = userIds.constFind(friendId);
+    if (it == userIds.constEnd() || anchors.value(it.value()) == anchor) {
+        return;
+    }
+
+    if (anchor.isValid()) {
+        anchors.insert(it.value(), anchor);
+    } else {
+        anchors.remove(it.value());
+    }
+    changed();
+}
+
+void SessionState::addFriend(int friendId, const UserId& userId)
+{
+    userIds.insert(friendId, userId.toString());
+}
+
+void SessionState::removeFriend(int friendId)
+{
+    // a removed friend added again starts at their newest message
+    const QString userId = userIds.take(friendId);
+    if (anchors.remove(userId) > 0) {
+        changed();
+    }
+}
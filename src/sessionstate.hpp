@@ -0,0 +1,73 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef SESSIONSTATE_HPP
+#define SESSIONSTATE_HPP
+
+#include "delayedwriter.hpp"
+#include "messages/id.hpp"
+#include "userid.hpp"
+
+#include <QHash>
+#include <QObject>
+
+// Which chat was open and where the chats were scrolled to, so the next start picks up there.
+// The Profile hands it the state of its pages whenever the user switches chats or leaves the
+// window. It is kept on disk by User ID as a small binary file, which is only rewritten half a
+// minute after the user stopped moving around, and on exit.
+class SessionState : public QObject
+{
+    Q_OBJECT
+public:
+    SessionState(const QString& filePath, QObject* parent);
+    ~SessionState();
+
+    bool isCurrentChat(int friendId) const;
+    // of the chat that was open, empty if its search bar wasn't
+    QString getSearchString() const;
+    // invalid if the chat followed its newest message
+    MsgId getAnchor(int friendId) const;
+
+    // -1 if no friend's chat is open
+    void setCurrentChat(int friendId, const QString& searchString);
+    void setAnchor(int friendId, MsgId anchor);
+
+public slots:
+    void addFriend(int friendId, const UserId& userId);
+    void removeFriend(int friendId);
+
+private slots:
+    void save();
+
+private:
+    void load();
+    void changed();
+
+    const QString filePath;
+    QString currentChat;
+    QString searchString;
+    // where each chat was scrolled to, kept for friends the Core hasn't reported yet as well
+    QHash<QString, MsgId> anchors;
+    // friendId -> hex User ID
+    QHash<int, QString> userIds;
+    DelayedWriter writer;
+
+    static const quint32 FILE_VERSION = 1;
+    static const int SAVE_DELAY = 30 * 1000;
+};
+
+#endif // SESSIONSTATE_HPP
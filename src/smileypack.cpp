@@ -16,15 +16,193 @@
 
 #include "smileypack.hpp"
 
-#include <QTextDocument>
+#include <QHash>
+#include <QSet>
 #include <QRegularExpression>
 #include <QFileInfo>
+#include <QSaveFile>
+#include <QDateTime>
 #include <QStandardPaths>
 #include <QDir>
 #include <QDataStream>
+#include <QTextBlock>
+#include <QTextDocument>
 #include "appinfo.hpp"
 #include "Settings/settings.hpp"
 
+namespace {
+QSharedPointer<const Smileypack> currentPack;
+int currentPackVersion = -1;
+
+// Compiled pack index, stored next to the theme file
+const char indexSuffix[] = ".index";
+const quint32 indexMagic = 0x54585350; // "TXSP"
+const quint32 indexVersion = 1;
+
+QSharedPointer<const Smileypack> imageTextsPack;
+QHash<QString, QString> imageTexts;
+
+// Code point starting at i, advancing i over the low surrogate of a pair
+uint codePointAt(const QString &text, int &i)
+{
+    QChar c = text.at(i);
+    if (c.isHighSurrogate() && i + 1 < text.length() && text.at(i + 1).isLowSurrogate())
+        return QChar::surrogateToUcs4(c, text.at(++i));
+    return c.unicode();
+}
+
+void appendCodePoint(QString &out, uint code)
+{
+    if (QChar::requiresSurrogates(code))
+        out.append(QChar(QChar::highSurrogate(code))).append(QChar(QChar::lowSurrogate(code)));
+    else
+        out += QChar(code);
+}
+
+// Value of the attribute name="..." (or '...') inside the tag text, empty if missing
+QString attribute(const QStringRef &tag, const QString &name)
+{
+    int i = 0;
+    while ((i = tag.indexOf(name, i, Qt::CaseInsensitive)) >= 0) {
+        int pos = i + name.length();
+        bool boundary = i > 0 && tag.at(i - 1).isSpace();
+        i = pos;
+        while (pos < tag.length() && tag.at(pos).isSpace())
+            ++pos;
+        if (!boundary || pos >= tag.length() || tag.at(pos) != '=')
+            continue;
+        ++pos;
+        while (pos < tag.length() && tag.at(pos).isSpace())
+            ++pos;
+        if (pos >= tag.length())
+            break;
+        QChar quote = tag.at(pos);
+        if (quote != '"' && quote != '\'') {
+            int valueEnd = pos;
+            while (valueEnd < tag.length() && !tag.at(valueEnd).isSpace() && tag.at(valueEnd) != '/')
+                ++valueEnd;
+            return QString(tag.unicode() + pos, valueEnd - pos);
+        }
+        int valueEnd = tag.indexOf(quote, pos + 1);
+        if (valueEnd < 0)
+            break;
+        return QString(tag.unicode() + pos + 1, valueEnd - pos - 1);
+    }
+    return QString();
+}
+
+// Append the character referenced by the entity (without '&' and ';') to out
+void appendEntity(const QStringRef &entity, QString &out)
+{
+    if (entity.startsWith('#')) {
+        bool ok;
+        bool hex = entity.startsWith("#x", Qt::CaseInsensitive);
+        int digits = hex ? 2 : 1;
+        uint code = QString(entity.unicode() + digits, entity.length() - digits).toUInt(&ok, hex ? 16 : 10);
+        if (!ok)
+            return;
+        if (code == QChar::Nbsp)
+            out += ' ';
+        else
+            appendCodePoint(out, code);
+    }
+    else if (entity == QLatin1String("lt"))   out += '<';
+    else if (entity == QLatin1String("gt"))   out += '>';
+    else if (entity == QLatin1String("amp"))  out += '&';
+    else if (entity == QLatin1String("quot")) out += '"';
+    else if (entity == QLatin1String("apos")) out += '\'';
+    else if (entity == QLatin1String("nbsp")) out += ' ';
+}
+
+bool isBlockTag(const QStringRef &name)
+{
+    static const QStringList blocks = {"p", "div", "li", "pre", "blockquote", "tr", "h1", "h2", "h3", "h4", "h5", "h6"};
+    for (const QString &block : blocks)
+        if (name.compare(block, Qt::CaseInsensitive) == 0)
+            return true;
+    return false;
+}
+
+/* Convert HTML as written by QTextDocument::toHtml() to plain text in a single pass, replacing
+ * <img> tags by the text their src maps to. Follows QTextDocument::toPlainText(): blocks are
+ * separated by newlines, line breaks and non-breaking spaces become '\n' and ' ', and unknown
+ * images become the object replacement character. */
+QString htmlToText(const QString &html, const QHash<QString, QString> &images)
+{
+    QString out;
+    out.reserve(html.length() / 4);
+
+    // Skip the head with its style sheet
+    int pos = html.indexOf(QLatin1String("<body"), 0, Qt::CaseInsensitive);
+    if (pos < 0)
+        pos = 0;
+
+    bool firstBlock = true;
+    bool emptyBlock = false;
+    while (pos < html.length()) {
+        QChar c = html.at(pos);
+        if (c == '<') {
+            int tagEnd = html.indexOf('>', pos);
+            if (tagEnd < 0)
+                break;
+            int tagStart = pos + 1;
+            QStringRef tag = html.midRef(tagStart, tagEnd - tagStart);
+            pos = tagEnd + 1;
+            if (tag.startsWith('!') || tag.startsWith('?'))
+                continue;
+
+            bool closing = tag.startsWith('/');
+            int nameStart = closing ? 1 : 0;
+            int nameEnd = nameStart;
+            while (nameEnd < tag.length() && !tag.at(nameEnd).isSpace() && tag.at(nameEnd) != '/')
+                ++nameEnd;
+            QStringRef name = html.midRef(tagStart + nameStart, nameEnd - nameStart);
+
+            if (name.compare(QLatin1String("img"), Qt::CaseInsensitive) == 0 && !closing) {
+                auto it = images.constFind(attribute(tag, "src"));
+                out += it != images.constEnd() ? *it : QString(QChar::ObjectReplacementCharacter);
+            }
+            else if (name.compare(QLatin1String("br"), Qt::CaseInsensitive) == 0) {
+                // Empty paragraphs hold a <br /> that isn't part of the text
+                if (!emptyBlock)
+                    out += '\n';
+            }
+            else if (isBlockTag(name)) {
+                if (closing) {
+                    emptyBlock = false;
+                } else {
+                    if (!firstBlock)
+                        out += '\n';
+                    firstBlock = false;
+                    emptyBlock = tag.contains(QLatin1String("-qt-paragraph-type:empty"));
+                }
+            }
+            else if (name.compare(QLatin1String("body"), Qt::CaseInsensitive) == 0 && closing) {
+                break;
+            }
+        }
+        else if (c == '&') {
+            int entityEnd = html.indexOf(';', pos);
+            if (entityEnd < 0 || entityEnd - pos > 10) {
+                out += c;
+                ++pos;
+            } else {
+                appendEntity(html.midRef(pos + 1, entityEnd - pos - 1), out);
+                pos = entityEnd + 1;
+            }
+        }
+        else {
+            // The exporter writes line breaks as tags, newlines in the source are formatting only
+            if (c != '\n' && c != '\r')
+                out += c;
+            ++pos;
+        }
+    }
+
+    return out;
+}
+}
+
 Smileypack::Smileypack(QObject *parent) :
     QObject(parent)
 {
@@ -49,67 +227,141 @@ void Smileypack::operator =(const Smileypack &other)
     icon = other.icon;
 }
 
-QString Smileypack::desmilify(QString htmlText)
+namespace {
+//! Image paths of the current pack mapped to the first text of their smiley; emoji are plain text already
+const QHash<QString, QString> &currentImageTexts()
 {
-    Smileypack pack(Settings::getInstance().getSmileyPack());
-    // Cancel if emoji
-    if (pack.isEmoji()) {
-        QTextDocument doc;
-        doc.setHtml(htmlText);
-        return doc.toPlainText();
+    QSharedPointer<const Smileypack> pack = Smileypack::current();
+    if (pack != imageTextsPack) {
+        imageTexts.clear();
+        if (!pack->isEmoji()) {
+            for (const auto& pair : pack->getList())
+                if (!imageTexts.contains(pair.first))
+                    imageTexts.insert(pair.first, pair.second.isEmpty() ? QString() : pair.second.first());
+        }
+        imageTextsPack = pack;
     }
+    return imageTexts;
+}
+}
 
-    // Replace smileys by their textual representation
-    int i = 0;
-    QRegularExpression re(R"_(<img[\s]+[^>]*?((alt*?[\s]?=[\s\"\']+(.*?)[\"\']+.*?)|(src*?[\s]?=[\s\"\']+(.*?)[\"\']+.*?))((src*?[\s]?=[\s\"\']+(.*?)[\"\']+.*?>)|(alt*?[\s]?=[\s\"\']+(.*?)[\"\']+.*?>)|>))_");
-    QRegularExpressionMatch match = re.match(htmlText, i);
-    while (match.hasMatch()) {
-        // Replace smiley and match next
-        for (const auto& pair : pack.getList()) {
-            if (pair.first == match.captured(5)) {
-                const QStringList& textSmilies = pair.second;
-                if (textSmilies.isEmpty()) {
-                    htmlText.remove(match.captured(0));
-                } else {
-                    htmlText.replace(match.captured(0), textSmilies.first());
-                }
-                break;
+QSharedPointer<const Smileypack> Smileypack::current()
+{
+    std::shared_ptr<const Settings::Snapshot> settings = Settings::getInstance().snapshot();
+    if (!currentPack || currentPackVersion != settings->smileyPackVersion) {
+        currentPack = QSharedPointer<const Smileypack>(new Smileypack(settings->smileyPack));
+        currentPackVersion = settings->smileyPackVersion;
+    }
+    return currentPack;
+}
+
+QString Smileypack::desmilify(QString htmlText)
+{
+    return htmlToText(htmlText, currentImageTexts());
+}
+
+QString Smileypack::desmilify(const QTextDocument *document, int from, int to)
+{
+    const QHash<QString, QString> &images = currentImageTexts();
+
+    // The last character is the document's closing paragraph separator
+    if (to < 0)
+        to = document->characterCount() - 1;
+
+    QString out;
+    out.reserve(to - from);
+    for (QTextBlock block = document->findBlock(from); block.isValid() && block.position() < to; block = block.next()) {
+        if (block.position() > from)
+            out += '
+';
+
+        for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+            const QTextFragment fragment = it.fragment();
+            const int start = qMax(fragment.position(), from);
+            const int end = qMin(fragment.position() + fragment.length(), to);
+            if (start >= end)
+                continue;
+
+            // Adjacent equal images share a fragment, one ObjectReplacementCharacter each
+            const QTextCharFormat format = fragment.charFormat();
+            if (format.isImageFormat()) {
+                auto image = images.constFind(format.toImageFormat().name());
+                const QString text = image != images.constEnd() ? *image : QString(QChar::ObjectReplacementCharacter);
+                for (int i = start; i < end; ++i)
+                    out += text;
+                continue;
+            }
+
+            const QString text = fragment.text();
+            for (int i = start - fragment.position(); i < end - fragment.position(); ++i) {
+                const QChar c = text.at(i);
+                if (c == QChar::Nbsp)
+                    out += ' ';
+                else if (c == QChar::LineSeparator)
+                    out += '\n';
+                else
+                    out += c;
             }
         }
-        match = re.match(htmlText, ++i);
     }
 
-    // convert to plain text
-    QTextDocument doc;
-    doc.setHtml(htmlText);
-    return doc.toPlainText();
+    return out;
 }
 
 /*! Replace Emoji by text strings */
 QString Smileypack::deemojify(QString text)
 {
-    for (const auto& pair : Smileypack::emojiList()) {
-        const QStringList& textSmilies = pair.second;
-        text.replace(pair.first, textSmilies.first().toHtmlEscaped());
+    static const QHash<uint, QString> texts = [] {
+        QHash<uint, QString> texts;
+        for (const auto& pair : Smileypack::emojiList())
+            texts.insert(pair.first.toUcs4().first(), pair.second.first().toHtmlEscaped());
+        return texts;
+    }();
+
+    QString result;
+    result.reserve(text.length() * 2);
+    for (int i = 0; i < text.length(); ++i) {
+        uint code = codePointAt(text, i);
+        auto it = texts.constFind(code);
+        if (it != texts.constEnd())
+            result += *it;
+        else
+            appendCodePoint(result, code);
     }
-    return text;
+    return result;
 }
 
 QString Smileypack::resizeEmoji(QString text)
 {
-    Settings &settings = Settings::getInstance();
+    std::shared_ptr<const Settings::Snapshot> settings = Settings::getInstance().snapshot();
 
     // All Unicode 6.2 emoji "Emoticons" and a some of "Miscellaneous Symbols and Pictographs"
-    // TODO find a regular expression for that
     // nurupo: that will do `text.replace(QRegularExpression("([\\x{1F600}-\\x{1F64F}])"), QString("<span style=\"font-family: '%1'; font-size: %2pt;\">\\1</span>").arg(settings.getEmojiFont(), QString::number(settings.getEmojiSize())));`
     //         except that you used symbols outside the Emoticons range (1F600-1F64F), so we need count for the too
-    QStringList foundEmojis({"😀","😁","😂","😃","😄","😅","😆","😇","😈","😉","😊","😋","😌","😍","😎","😏","😐","😑","😒","😓","😔","😕","😖","😗","😘","😙","😚","😛","😜","😝","😞","😟","😠","😡","😢","😣","😤","😥","😦","😧","😨","😩","😪","😫","😬","😭","😮","😯","😰","😱","😲","😳","😴","😵","😶","😷","😸","😹","😺","😻","😼","😽","😾","😿","🙀","🙅","🙆","🙇","🙈","🙉","🙊","🙋","🙌","🙍","🙎","🙏","☺","☹","⚇","🐱","♥","☔","☀","♫","☕","★"});
-
-    for (QString emo : foundEmojis) {
-        text.replace(emo, QString("<span style=\"font-family: '%1'; font-size: %2pt;\">%3</span>").arg(settings.getEmojiFontFamily(), QString::number(settings.getEmojiFontPointSize()), emo));
+    static const QSet<uint> foundEmojis = [] {
+        QSet<uint> foundEmojis;
+        for (const QString &emo : QStringList({"😀","😁","😂","😃","😄","😅","😆","😇","😈","😉","😊","😋","😌","😍","😎","😏","😐","😑","😒","😓","😔","😕","😖","😗","😘","😙","😚","😛","😜","😝","😞","😟","😠","😡","😢","😣","😤","😥","😦","😧","😨","😩","😪","😫","😬","😭","😮","😯","😰","😱","😲","😳","😴","😵","😶","😷","😸","😹","😺","😻","😼","😽","😾","😿","🙀","🙅","🙆","🙇","🙈","🙉","🙊","🙋","🙌","🙍","🙎","🙏","☺","☹","⚇","🐱","♥","☔","☀","♫","☕","★"}))
+            foundEmojis.insert(emo.toUcs4().first());
+        return foundEmojis;
+    }();
+
+    const QString spanStart = QString("<span style=\"font-family: '%1'; font-size: %2pt;\">").arg(settings->emojiFontFamily, QString::number(settings->emojiFontPointSize));
+    const QString spanEnd = "</span>";
+
+    QString result;
+    result.reserve(text.length());
+    for (int i = 0; i < text.length(); ++i) {
+        uint code = codePointAt(text, i);
+        if (foundEmojis.contains(code)) {
+            result += spanStart;
+            appendCodePoint(result, code);
+            result += spanEnd;
+        } else {
+            appendCodePoint(result, code);
+        }
     }
 
-    return text;
+    return result;
 }
 
 const Smileypack::SmileypackList Smileypack::emojiList()
@@ -237,6 +489,52 @@ void Smileypack::restore(const QByteArray &array)
     stream >> (*this);
 }
 
+bool Smileypack::load(const QString &filePath)
+{
+    QFileInfo theme(filePath);
+    if (!theme.exists())
+        return false;
+    qint64 mtime = theme.lastModified().toMSecsSinceEpoch();
+
+    // Take the index if it was compiled from this very theme file
+    QFile index(filePath + indexSuffix);
+    if (index.open(QIODevice::ReadOnly) && index.size() > 0) {
+        uchar *data = index.map(0, index.size());
+        if (data) {
+            // Strings are copied out while reading, nothing refers to the mapping afterwards
+            QByteArray mapped = QByteArray::fromRawData(reinterpret_cast<const char*>(data), index.size());
+            QDataStream stream(mapped);
+            stream.setVersion(QDataStream::Qt_5_2);
+
+            quint32 magic, version;
+            qint64 indexMtime, indexSize;
+            stream >> magic >> version >> indexMtime >> indexSize;
+            bool upToDate = stream.status() == QDataStream::Ok && magic == indexMagic && version == indexVersion
+                            && indexMtime == mtime && indexSize == theme.size();
+            if (upToDate)
+                stream >> (*this);
+            index.unmap(data);
+
+            if (upToDate && stream.status() == QDataStream::Ok && themeFile == filePath)
+                return true;
+        }
+    }
+    index.close();
+
+    if (!parseFile(filePath))
+        return false;
+
+    // Compile the index for the next start, a read-only pack folder just keeps getting parsed
+    QSaveFile out(filePath + indexSuffix);
+    if (out.open(QIODevice::WriteOnly)) {
+        QDataStream stream(&out);
+        stream.setVersion(QDataStream::Qt_5_2);
+        stream << indexMagic << indexVersion << mtime << theme.size() << (*this);
+        out.commit();
+    }
+    return true;
+}
+
 void Smileypack::processLine(const QString &xLine, const QString &xPath, ParserStates &xState)
 {
     // Trim spaces and exclue comment lines
@@ -248,15 +546,16 @@ void Smileypack::processLine(const QString &xLine, const QString &xPath, ParserS
     if (xState == StateHead) {
 
         // Switch on [theme]
-        QRegularExpression rx("\\[(theme|smileys)\\]");
+        static const QRegularExpression rx("\\[(theme|smileys)\\]");
         QRegularExpressionMatch match = rx.match(line);
         if (match.hasMatch()) {
             xState = StateSmileys;
             return;
         }
 
-        QString key   = line.section(QRegularExpression("\\s*\\=\\s*"), 0,0);
-        QString value = line.section(QRegularExpression("\\s*\\=\\s*"), 1);
+        static const QRegularExpression separator("\\s*\\=\\s*");
+        QString key   = line.section(separator, 0,0);
+        QString value = line.section(separator, 1);
 
         if      (key == "Name")        name        = value;
         else if (key == "Author")      author      = value;
@@ -266,10 +565,11 @@ void Smileypack::processLine(const QString &xLine, const QString &xPath, ParserS
         else if (key == "Icon")        icon        = value;
     }
     else if (xState == StateSmileys) {
-        QString key   = line.section(QRegularExpression("\\s+"), 0,0);
-        QString value = line.section(QRegularExpression("\\s+"), 1);
+        static const QRegularExpression spaces("\\s+");
+        QString key   = line.section(spaces, 0,0);
+        QString value = line.section(spaces, 1);
 
-        list.append({xPath+key, value.split(QRegularExpression("\\s+"))});
+        list.append({xPath+key, value.split(spaces)});
     }
 }
 
@@ -19,9 +19,12 @@
 
 #include <QObject>
 #include <QPair>
+#include <QSharedPointer>
 #include <QStringList>
 #include "messages/smiley.hpp"
 
+class QTextDocument;
+
 
 class Smileypack : public QObject
 {
@@ -34,6 +37,9 @@ public:
     void operator=(const Smileypack &other);
 
     bool parseFile(const QString &filePath);
+    //! Like parseFile(), but reads the compiled index next to the theme file while it is up to date
+    /** The index is rewritten whenever the theme file has changed since it was compiled. */
+    bool load(const QString &filePath);
 
     const QByteArray save();
     void restore(const QByteArray &array);
@@ -57,8 +63,16 @@ public:
     bool  isEmoji() const                           { return emoji;       }
     void setEmoji(bool x)                           { emoji = x;          }
 
+    //! The pack chosen in the settings
+    /** Deserialized once and shared by all readers, until another pack is set. Readers keep the
+     *  returned pointer as long as they need it, the pack itself is never modified. */
+    static QSharedPointer<const Smileypack> current();
+
     static const QString& packDir();
     static QString desmilify(QString htmlText);
+    //! Plain text of [from, to) in document, smiley images replaced by their text
+    /** Walks the fragments directly, without going through HTML. to = -1 means the end of the document. */
+    static QString desmilify(const QTextDocument *document, int from = 0, int to = -1);
     static QString deemojify(QString text);
     static QString resizeEmoji(QString text);
     static const SmileypackList emojiList();
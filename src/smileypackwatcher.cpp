@@ -0,0 +1,129 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "smileypackwatcher.hpp"
+#include "smileypack.hpp"
+#include "messages/smileytextobject.hpp"
+#include "Settings/settings.hpp"
+#include <QDebug>
+#include <QFileInfo>
+#include <QSet>
+
+namespace {
+//! Smiley text -> image path or emoji of a pack
+QHash<QString, QString> graphicsByText(const Smileypack &pack)
+{
+    QHash<QString, QString> result;
+    for (const auto &pair : pack.getList())
+        for (const QString &text : pair.second)
+            result.insert(text, pair.first);
+    return result;
+}
+}
+
+SmileypackWatcher &SmileypackWatcher::getInstance()
+{
+    static SmileypackWatcher instance;
+    return instance;
+}
+
+SmileypackWatcher::SmileypackWatcher()
+{
+    reloadTimer.setSingleShot(true);
+    reloadTimer.setInterval(RELOAD_DELAY);
+    connect(&reloadTimer, &QTimer::timeout, this, &SmileypackWatcher::reload);
+
+    // files replaced by renaming drop out of the watcher, their folder still tells
+    connect(&watcher, &QFileSystemWatcher::fileChanged, &reloadTimer, static_cast<void (QTimer::*)()>(&QTimer::start));
+    connect(&watcher, &QFileSystemWatcher::directoryChanged, &reloadTimer, static_cast<void (QTimer::*)()>(&QTimer::start));
+
+    connect(&Settings::getInstance(), &Settings::smileyPackChanged, this, &SmileypackWatcher::watchCurrentPack);
+    watchCurrentPack();
+}
+
+void SmileypackWatcher::watchCurrentPack()
+{
+    if (!watcher.files().isEmpty())
+        watcher.removePaths(watcher.files());
+    if (!watcher.directories().isEmpty())
+        watcher.removePaths(watcher.directories());
+    imageTimes.clear();
+
+    QSharedPointer<const Smileypack> pack = Smileypack::current();
+    themeFile = pack->getThemeFile();
+    // the built-in packs have no files
+    if (themeFile.isEmpty() || !QFileInfo(themeFile).exists())
+        return;
+
+    QStringList paths;
+    paths << themeFile << QFileInfo(themeFile).absolutePath();
+    if (!pack->isEmoji()) {
+        for (const auto &pair : pack->getList()) {
+            if (imageTimes.contains(pair.first))
+                continue;
+            QFileInfo image(pair.first);
+            imageTimes.insert(pair.first, image.lastModified());
+            if (image.exists())
+                paths << pair.first;
+        }
+    }
+    watcher.addPaths(paths);
+}
+
+void SmileypackWatcher::reload()
+{
+    if (themeFile.isEmpty())
+        return;
+
+    QSharedPointer<const Smileypack> oldPack = Smileypack::current();
+    Smileypack newPack;
+    if (!newPack.load(themeFile)) {
+        // likely still being written, the next change tries again
+        qWarning() << "Smiley pack" << themeFile << "can't be reloaded";
+        return;
+    }
+
+    // redrawn images keep their path, only their time tells them apart
+    QSet<QString> redrawn;
+    for (auto it = imageTimes.constBegin(); it != imageTimes.constEnd(); ++it) {
+        if (QFileInfo(it.key()).lastModified() != it.value()) {
+            redrawn.insert(it.key());
+            SmileyTextObject::forgetImage(it.key());
+        }
+    }
+
+    // texts whose graphics differ, appeared or disappeared
+    const QHash<QString, QString> oldGraphics = graphicsByText(*oldPack);
+    const QHash<QString, QString> newGraphics = graphicsByText(newPack);
+    QStringList changedTexts;
+    for (auto it = newGraphics.constBegin(); it != newGraphics.constEnd(); ++it) {
+        auto old = oldGraphics.constFind(it.key());
+        if (old == oldGraphics.constEnd() || old.value() != it.value() || redrawn.contains(it.value()))
+            changedTexts << it.key();
+    }
+    for (auto it = oldGraphics.constBegin(); it != oldGraphics.constEnd(); ++it) {
+        if (!newGraphics.contains(it.key()))
+            changedTexts << it.key();
+    }
+
+    const QByteArray data = newPack.save();
+    if (data != Settings::getInstance().getSmileyPack() || !changedTexts.isEmpty())
+        Settings::getInstance().updateSmileyPack(data, changedTexts);
+
+    // rewritten files have to be watched again
+    watchCurrentPack();
+}
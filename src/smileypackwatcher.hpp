@@ -0,0 +1,52 @@
+/*
+    Copyright (C) 2014 by Martin Kröll <technikschlumpf@web.de>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef SMILEYPACKWATCHER_HPP
+#define SMILEYPACKWATCHER_HPP
+
+#include <QDateTime>
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QObject>
+#include <QTimer>
+
+/*! Reloads the current smiley pack when its theme file or images change on disk.
+ * Only the smileys that were added, removed, remapped or redrawn are handed to
+ * Settings::updateSmileyPack(), so chats re-render just the lines showing them.
+ */
+class SmileypackWatcher : public QObject
+{
+    Q_OBJECT
+public:
+    static SmileypackWatcher &getInstance();
+
+private slots:
+    void watchCurrentPack();
+    void reload();
+
+private:
+    SmileypackWatcher();
+
+    QFileSystemWatcher watcher;
+    QTimer reloadTimer;     // editors write a file in several steps
+    QString themeFile;
+    QHash<QString, QDateTime> imageTimes;   // image path -> last modification, of pixmap packs
+
+    static const int RELOAD_DELAY = 500;    // ms
+};
+
+#endif // SMILEYPACKWATCHER_HPP
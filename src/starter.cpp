@@ -16,11 +16,25 @@
 
 #include "starter.hpp"
 #include "Settings/settings.hpp"
+#include "logindialog.hpp"
+#include "notificationsound.hpp"
+#include "profile.hpp"
+#include "profilecipher.hpp"
+#include "smileypack.hpp"
+#include "startuptrace.hpp"
+
+#include <QApplication>
+#include <QEvent>
+#include <QTimer>
 
 Starter::Starter(QObject* parent) :
     QObject(parent), mainWindow(nullptr)
 {
-    // place a login dialog here
+    if (!unlockProfiles()) {
+        // the event loop isn't running yet
+        QTimer::singleShot(0, qApp, SLOT(quit()));
+        return;
+    }
     createMainWindow();
 }
 
@@ -31,8 +45,57 @@ Starter::~Starter()
     }
 }
 
+bool Starter::unlockProfiles()
+{
+    QStringList profileNames = Settings::getInstance().getProfiles();
+    if (!profileNames.contains(Profile::DEFAULT_NAME)) {
+        profileNames.prepend(Profile::DEFAULT_NAME);
+    }
+
+    for (const QString& name : profileNames) {
+        const QString configFileName = Profile::getConfigFileName(name);
+        if (!ProfileCipher::isEncryptedFile(Settings::getSettingsDirPath() + '/' + configFileName)) {
+            continue;
+        }
+
+        LoginDialog dialog(name, configFileName);
+        // the other profiles just fail to start without their key
+        if (dialog.exec() != QDialog::Accepted && name == Profile::DEFAULT_NAME) {
+            return false;
+        }
+    }
+
+    StartupTrace::mark("profiles unlocked");
+    return true;
+}
+
 void Starter::createMainWindow()
 {
     mainWindow = new MainWindow();
+    StartupTrace::mark("main window created");
+    mainWindow->installEventFilter(this);
     mainWindow->show();
 }
+
+bool Starter::eventFilter(QObject* object, QEvent* event)
+{
+    if (object == mainWindow && event->type() == QEvent::Paint) {
+        StartupTrace::mark("first paint");
+        mainWindow->removeEventFilter(this);
+        // let the paint finish first
+        QTimer::singleShot(0, this, SLOT(onMainWindowShown()));
+    }
+    return QObject::eventFilter(object, event);
+}
+
+void Starter::onMainWindowShown()
+{
+    // everything not needed for the first frame
+    mainWindow->createTrayIcon();
+    // parses the smiley pack, the first chat page would do it otherwise
+    Smileypack::current();
+    NotificationSound::getInstance().load();
+    StartupTrace::mark("deferred work done");
+
+    StartupTrace::finish();
+}
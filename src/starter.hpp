@@ -28,11 +28,20 @@ public:
     Starter(QObject* parent = 0);
     ~Starter();
 
+protected:
+    bool eventFilter(QObject* object, QEvent* event);
+
 private:
     MainWindow* mainWindow;
 
+    // asks for the passwords of the encrypted profiles, false if the default one stays locked
+    bool unlockProfiles();
     void createMainWindow();
 
+private slots:
+    // runs once the first frame is on screen
+    void onMainWindowShown();
+
 };
 
 #endif // STARTER_HPP
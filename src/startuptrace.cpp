@@ -0,0 +1,124 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "startuptrace.hpp"
+#include "Settings/settings.hpp"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QTextStream>
+#include <QThread>
+#include <QVector>
+
+const QString StartupTrace::FILENAME = "startup.log";
+
+namespace {
+struct Phase
+{
+    qint64 time;
+    QString name;
+    QString thread;
+};
+
+QMutex mutex;
+QElapsedTimer timer;
+QVector<Phase> phases;
+bool finished = false;
+
+QString threadName()
+{
+    QThread* thread = QThread::currentThread();
+    if (!thread->objectName().isEmpty()) {
+        return thread->objectName();
+    }
+    return QString("0x%1").arg(reinterpret_cast<quintptr>(thread), 0, 16);
+}
+
+QString formatPhase(const Phase& phase)
+{
+    return QString("%1 ms\t%2\t[%3]\n").arg(phase.time, 6).arg(phase.name, phase.thread);
+}
+
+bool writeToFile(const QString& fileName, const QString& text, QIODevice::OpenMode mode)
+{
+    const QString dirPath = Settings::getSettingsDirPath();
+    QDir().mkpath(dirPath);
+
+    QFile file(dirPath + '/' + fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text | mode)) {
+        qWarning() << "File " << file.fileName() << " cannot be opened";
+        return false;
+    }
+
+    QTextStream out(&file);
+    out << text;
+    return true;
+}
+}
+
+void StartupTrace::start()
+{
+    QMutexLocker locker(&mutex);
+    if (!timer.isValid()) {
+        timer.start();
+        phases << Phase{0, "main", threadName()};
+    }
+}
+
+void StartupTrace::mark(const QString& phase)
+{
+    QMutexLocker locker(&mutex);
+    if (!timer.isValid()) {
+        return;
+    }
+
+    Phase p{timer.elapsed(), phase, threadName()};
+    phases << p;
+    if (finished) {
+        writeToFile(FILENAME, formatPhase(p), QIODevice::Append);
+    }
+}
+
+void StartupTrace::finish()
+{
+    QMutexLocker locker(&mutex);
+    if (!timer.isValid() || finished) {
+        return;
+    }
+    finished = true;
+
+    QString report = QDateTime::currentDateTime().toString(Qt::ISODate) + "\n";
+    for (const Phase& phase : phases) {
+        report += formatPhase(phase);
+    }
+    writeToFile(FILENAME, report, QIODevice::Truncate);
+}
+
+QString StartupTrace::toString()
+{
+    QMutexLocker locker(&mutex);
+    QString result;
+    for (const Phase& phase : phases) {
+        result += formatPhase(phase);
+    }
+    return result;
+}
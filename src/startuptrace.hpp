@@ -0,0 +1,42 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef STARTUPTRACE_HPP
+#define STARTUPTRACE_HPP
+
+#include <QString>
+
+// Records when the phases of startup were reached, counted from main().
+// Everything is thread-safe, cores mark their phases from their own threads.
+class StartupTrace
+{
+public:
+    static void start();
+    static void mark(const QString& phase);
+
+    // Writes the report to startup.log in the settings directory,
+    // phases marked after that, e.g. by slow cores, are appended to it
+    static void finish();
+
+    static QString toString();
+
+private:
+    static const QString FILENAME;
+
+};
+
+#endif // STARTUPTRACE_HPP
@@ -0,0 +1,33 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "toxwaiter.hpp"
+
+#include <tox/tox.h>
+
+ToxWaiter::ToxWaiter(QObject* parent) :
+    QObject(parent)
+{
+}
+
+void ToxWaiter::wait(const QByteArray& waitData, int timeout)
+{
+    // tox_wait_execute() only touches the buffer, not the Tox instance,
+    // so it's safe to block here while the core thread keeps running
+    QByteArray data = waitData;
+    tox_wait_execute(reinterpret_cast<uint8_t*>(data.data()), timeout / 1000, (timeout % 1000) * 1000);
+    emit ready();
+}
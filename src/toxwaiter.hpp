@@ -0,0 +1,41 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef TOXWAITER_HPP
+#define TOXWAITER_HPP
+
+#include <QByteArray>
+#include <QObject>
+
+// Blocks on the Tox sockets in a thread of its own and reports back as soon
+// as there is something for tox_do() to do, so that the core thread doesn't
+// have to wake up on a fixed schedule.
+class ToxWaiter : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ToxWaiter(QObject* parent = 0);
+
+public slots:
+    // waitData is the buffer filled by tox_wait_prepare(), timeout is in ms
+    void wait(const QByteArray& waitData, int timeout);
+
+signals:
+    void ready();
+
+};
+
+#endif // TOXWAITER_HPP
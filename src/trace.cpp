@@ -0,0 +1,184 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "trace.hpp"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QTextStream>
+#include <QThread>
+#include <QVector>
+
+std::atomic<bool> Trace::enabled(false);
+
+namespace {
+QMutex buffersMutex;
+int lastThreadId = 0; // guarded by buffersMutex
+}
+
+class Trace::BufferOwner
+{
+public:
+    BufferOwner() :
+        buffer(nullptr) {}
+
+    ~BufferOwner()
+    {
+        if (buffer) {
+            QMutexLocker locker(&buffersMutex);
+            freeBuffers() << buffer;
+        }
+    }
+
+    Buffer* buffer;
+};
+
+void Trace::setEnabled(bool enable)
+{
+    enabled.store(enable, std::memory_order_relaxed);
+}
+
+qint64 Trace::now()
+{
+    static const QElapsedTimer clock = [] {
+        QElapsedTimer timer;
+        timer.start();
+        return timer;
+    }();
+    return clock.nsecsElapsed();
+}
+
+QList<Trace::Buffer*>& Trace::buffers()
+{
+    static QList<Buffer*> list;
+    return list;
+}
+
+QList<Trace::Buffer*>& Trace::freeBuffers()
+{
+    static QList<Buffer*> list;
+    return list;
+}
+
+Trace::Buffer* Trace::threadBuffer()
+{
+    static thread_local BufferOwner owner;
+    if (!owner.buffer) {
+        QString threadName;
+        QThread* thread = QThread::currentThread();
+        if (QCoreApplication::instance() && thread == QCoreApplication::instance()->thread()) {
+            threadName = "GUI";
+        } else {
+            threadName = thread->objectName();
+        }
+
+        QMutexLocker locker(&buffersMutex);
+        Buffer* buffer;
+        if (freeBuffers().isEmpty()) {
+            buffer = new Buffer();
+            buffer->head.store(0, std::memory_order_relaxed);
+            buffers() << buffer;
+        } else {
+            // only this thread writes the buffer from now on, so head is stable here
+            buffer = freeBuffers().takeLast();
+        }
+        buffer->firstEvent = buffer->head.load(std::memory_order_relaxed);
+        buffer->threadId = ++lastThreadId;
+        buffer->threadName = threadName.isEmpty() ? QString("Thread %1").arg(buffer->threadId) : threadName;
+        owner.buffer = buffer;
+    }
+    return owner.buffer;
+}
+
+void Trace::record(const char* name, qint64 start, qint64 end)
+{
+    Buffer* buffer = threadBuffer();
+    const quint64 head = buffer->head.load(std::memory_order_relaxed);
+    Event& event = buffer->events[head % BUFFER_SIZE];
+    event.name = name;
+    event.start = start;
+    event.duration = end - start;
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+bool Trace::exportJson(const QString& filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+
+    struct Owner
+    {
+        Buffer* buffer;
+        quint64 firstEvent;
+        int threadId;
+        QString threadName;
+    };
+
+    QList<Owner> snapshot;
+    {
+        QMutexLocker locker(&buffersMutex);
+        for (Buffer* buffer : buffers()) {
+            snapshot << Owner{buffer, buffer->firstEvent, buffer->threadId, buffer->threadName};
+        }
+    }
+
+    QTextStream stream(&file);
+    stream << "{\"traceEvents\":[\n";
+    bool first = true;
+    for (const Owner& owner : snapshot) {
+        Buffer* buffer = owner.buffer;
+        stream << (first ? "" : ",\n")
+               << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << owner.threadId
+               << ",\"args\":{\"name\":\"" << owner.threadName << "\"}}";
+        first = false;
+
+        // the thread keeps recording while we read, events it may have overwritten meanwhile are skipped
+        const quint64 headBefore = buffer->head.load(std::memory_order_acquire);
+        QVector<Event> events;
+        const quint64 begin = qMax(owner.firstEvent, headBefore > quint64(BUFFER_SIZE) ? headBefore - BUFFER_SIZE : 0);
+        events.reserve(int(headBefore - begin));
+        for (quint64 i = begin; i < headBefore; i++) {
+            events << buffer->events[i % BUFFER_SIZE];
+        }
+        const quint64 headAfter = buffer->head.load(std::memory_order_acquire);
+        const quint64 firstIntact = headAfter >= quint64(BUFFER_SIZE) ? headAfter - BUFFER_SIZE + 1 : 0;
+
+        // events from a thread that took the buffer over since the snapshot aren't this thread's
+        quint64 end = headBefore;
+        {
+            QMutexLocker locker(&buffersMutex);
+            if (buffer->threadId != owner.threadId) {
+                end = qMin(end, buffer->firstEvent);
+            }
+        }
+
+        for (quint64 i = qMax(begin, firstIntact); i < end; i++) {
+            const Event& event = events.at(int(i - begin));
+            stream << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << owner.threadId
+                   << ",\"ts\":" << QString::number(event.start / 1000.0, 'f', 3)
+                   << ",\"dur\":" << QString::number(event.duration / 1000.0, 'f', 3) << "}";
+        }
+    }
+    stream << "\n]}\n";
+    stream.flush();
+
+    return file.error() == QFile::NoError;
+}
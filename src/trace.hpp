@@ -0,0 +1,105 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <atomic>
+
+#include <QList>
+#include <QString>
+
+// Scoped trace spans on the hot paths, exported as a Chrome trace that
+// chrome://tracing and ui.perfetto.dev open. Every thread records into a ring
+// buffer of its own, so recording takes no locks: a span is two clock reads
+// and a store. Nothing is recorded until setEnabled(true).
+class Trace
+{
+public:
+    // measures its scope, name has to be a string literal, only the pointer is kept
+    class Span
+    {
+    public:
+        explicit Span(const char* name) :
+            name(name), start(isEnabled() ? now() : -1) {}
+
+        ~Span()
+        {
+            if (start >= 0) {
+                record(name, start, now());
+            }
+        }
+
+    private:
+        const char* name;
+        qint64 start;
+
+        Span(const Span&);
+        Span& operator=(const Span&);
+    };
+
+    static bool isEnabled()
+    {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    static void setEnabled(bool enabled);
+
+    // ns on a clock shared by all threads
+    static qint64 now();
+
+    // for spans that don't fit a scope, like a queued signal that was emitted on another thread
+    static void record(const char* name, qint64 start, qint64 end);
+
+    // writes what the buffers hold in the Trace Event Format
+    static bool exportJson(const QString& filePath);
+
+    static const int BUFFER_SIZE = 16 * 1024; // events per thread
+
+private:
+    struct Event
+    {
+        const char* name;
+        qint64 start;
+        qint64 duration;
+    };
+
+    // written only by its thread, read by exportJson(). When its thread exits a buffer
+    // goes to the free list and its events are still exported until another thread takes
+    // it over, so there are only as many buffers as threads that were traced at once
+    struct Buffer
+    {
+        std::atomic<quint64> head; // events ever recorded
+        Event events[BUFFER_SIZE];
+        // guarded by the buffers mutex, they change when the buffer is taken over
+        quint64 firstEvent; // head when the current thread took the buffer
+        int threadId;
+        QString threadName;
+    };
+
+    // frees the buffer of its thread when the thread exits
+    class BufferOwner;
+
+    static Buffer* threadBuffer();
+    static QList<Buffer*>& buffers();
+    static QList<Buffer*>& freeBuffers();
+
+    static std::atomic<bool> enabled;
+
+};
+
+#endif // TRACE_HPP
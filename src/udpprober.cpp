@@ -0,0 +1,119 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "udpprober.hpp"
+
+#include <QDebug>
+
+UdpProber::UdpProber(QObject* parent) :
+    QObject(parent), done(false)
+{
+    crypto_box_keypair(publicKey, secretKey);
+
+    timeoutTimer.setSingleShot(true);
+    timeoutTimer.setInterval(TIMEOUT);
+    connect(&timeoutTimer, &QTimer::timeout, this, &UdpProber::onTimeout);
+    connect(&socket, &QUdpSocket::readyRead, this, &UdpProber::onReadyRead);
+}
+
+UdpProber::~UdpProber()
+{
+    abort();
+    sodium_memzero(secretKey, sizeof(secretKey));
+}
+
+void UdpProber::ping(const QHostAddress& address, quint16 port, const uint8_t* serverKey)
+{
+    if (done) {
+        return;
+    }
+
+    if (socket.state() != QAbstractSocket::BoundState && !socket.bind(QHostAddress::Any, 0)) {
+        qWarning() << "Couldn't bind the UDP probe socket:" << socket.errorString();
+        finish(false);
+        return;
+    }
+
+    // [type][our public key][nonce][encrypted: [type][ping id]], the way toxcore's ping.c builds it
+    uint8_t plain[1 + sizeof(quint64)];
+    plain[0] = PING_REQUEST;
+    randombytes_buf(plain + 1, sizeof(quint64));
+
+    QByteArray packet(1 + crypto_box_PUBLICKEYBYTES + crypto_box_NONCEBYTES + crypto_box_MACBYTES + sizeof(plain), 0);
+    uint8_t* data = reinterpret_cast<uint8_t*>(packet.data());
+    data[0] = PING_REQUEST;
+    memcpy(data + 1, publicKey, crypto_box_PUBLICKEYBYTES);
+    uint8_t* nonce = data + 1 + crypto_box_PUBLICKEYBYTES;
+    randombytes_buf(nonce, crypto_box_NONCEBYTES);
+    if (crypto_box_easy(nonce + crypto_box_NONCEBYTES, plain, sizeof(plain), nonce, serverKey, secretKey) != 0) {
+        return;
+    }
+
+    if (socket.writeDatagram(packet, address, port) != packet.size()) {
+        return;
+    }
+
+    servers.insert(address.toString() + ':' + QString::number(port));
+    if (!timeoutTimer.isActive()) {
+        timeoutTimer.start();
+    }
+}
+
+void UdpProber::abort()
+{
+    timeoutTimer.stop();
+    socket.close();
+    servers.clear();
+}
+
+bool UdpProber::isProbing() const
+{
+    return timeoutTimer.isActive();
+}
+
+void UdpProber::finish(bool udpWorks)
+{
+    abort();
+    done = true;
+    emit finished(udpWorks);
+}
+
+void UdpProber::onReadyRead()
+{
+    while (socket.hasPendingDatagrams()) {
+        // only the sender matters, the rest of the datagram is dropped
+        char byte;
+        QHostAddress sender;
+        quint16 senderPort;
+        if (socket.readDatagram(&byte, 1, &sender, &senderPort) < 0) {
+            continue;
+        }
+        // an IPv4 server may answer on the dual stack socket as a mapped address
+        bool ok;
+        const QHostAddress ipv4(sender.toIPv4Address(&ok));
+        const QString from = (ok ? ipv4 : sender).toString() + ':' + QString::number(senderPort);
+        if (servers.contains(from) && !done) {
+            finish(true);
+            return;
+        }
+    }
+}
+
+void UdpProber::onTimeout()
+{
+    finish(false);
+}
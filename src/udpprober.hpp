@@ -0,0 +1,70 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef UDPPROBER_HPP
+#define UDPPROBER_HPP
+
+#include <QHostAddress>
+#include <QObject>
+#include <QSet>
+#include <QTimer>
+#include <QUdpSocket>
+
+#include <sodium.h>
+
+// Finds out whether UDP gets through on the current network by sending DHT ping requests
+// to bootstrap servers from a socket of its own. DHT servers answer pings from any key,
+// so a throwaway key pair is used, and any datagram coming back from one of the servers
+// is enough, nothing is decrypted.
+class UdpProber : public QObject
+{
+    Q_OBJECT
+public:
+    explicit UdpProber(QObject* parent = 0);
+    ~UdpProber();
+
+    // Pings a server, the first ping starts the timeout
+    void ping(const QHostAddress& address, quint16 port, const uint8_t* publicKey);
+    void abort();
+    bool isProbing() const;
+
+    static const int TIMEOUT = 5000; // ms
+
+signals:
+    void finished(bool udpWorks);
+
+private:
+    void finish(bool udpWorks);
+
+    QUdpSocket socket;
+    QTimer timeoutTimer;
+    // address:port of the servers we pinged
+    QSet<QString> servers;
+    bool done;
+
+    uint8_t publicKey[crypto_box_PUBLICKEYBYTES];
+    uint8_t secretKey[crypto_box_SECRETKEYBYTES];
+
+    static const char PING_REQUEST = 0;
+
+private slots:
+    void onReadyRead();
+    void onTimeout();
+
+};
+
+#endif // UDPPROBER_HPP
@@ -0,0 +1,72 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "userid.hpp"
+
+UserId::UserId() :
+    hashValue(0)
+{
+    memset(bytes, 0, SIZE);
+}
+
+UserId::UserId(const uint8_t* data)
+{
+    memcpy(bytes, data, SIZE);
+    init();
+}
+
+UserId UserId::fromString(const QString& hex)
+{
+    UserId userId;
+
+    if (hex.length() != SIZE * 2) {
+        return userId;
+    }
+
+    const QChar* chars = hex.constData();
+    for (int i = 0; i < SIZE * 2; i ++) {
+        const ushort c = chars[i].unicode();
+        uint8_t nibble;
+        if (c >= '0' && c <= '9') {
+            nibble = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            nibble = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            nibble = c - 'A' + 10;
+        } else {
+            return UserId();
+        }
+        userId.bytes[i / 2] = (i % 2) ? (userId.bytes[i / 2] | nibble) : (nibble << 4);
+    }
+
+    userId.init();
+    return userId;
+}
+
+void UserId::init()
+{
+    static const char digits[] = "0123456789ABCDEF";
+
+    hex.resize(SIZE * 2);
+    QChar* chars = hex.data();
+    for (int i = 0; i < SIZE; i ++) {
+        chars[i * 2] = QLatin1Char(digits[bytes[i] >> 4]);
+        chars[i * 2 + 1] = QLatin1Char(digits[bytes[i] & 0xF]);
+    }
+
+    // public keys are uniformly distributed, so their first bytes make a good hash
+    memcpy(&hashValue, bytes, sizeof(hashValue));
+}
@@ -0,0 +1,62 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef USERID_HPP
+#define USERID_HPP
+
+#include <tox/tox.h>
+
+#include <QMetaType>
+#include <QString>
+
+#include <cstring>
+
+// Tox User ID (a friend's public key) in its raw form, along with its hex
+// representation and hash, which are computed only once, on construction.
+// Copying is cheap since the hex string is implicitly shared.
+class UserId
+{
+public:
+    static const int SIZE = TOX_CLIENT_ID_SIZE;
+
+    UserId();
+    explicit UserId(const uint8_t* data);
+
+    // returns an invalid UserId if hex isn't a hex encoded User ID
+    static UserId fromString(const QString& hex);
+
+    inline const uint8_t* data() const { return bytes; }
+    inline const QString& toString() const { return hex; }
+    inline bool isValid() const { return !hex.isEmpty(); }
+    inline uint hash() const { return hashValue; }
+
+    inline bool operator==(const UserId& other) const { return hashValue == other.hashValue && memcmp(bytes, other.bytes, SIZE) == 0; }
+    inline bool operator!=(const UserId& other) const { return !(*this == other); }
+    inline bool operator<(const UserId& other) const { return memcmp(bytes, other.bytes, SIZE) < 0; }
+
+private:
+    void init();
+
+    uint8_t bytes[SIZE];
+    QString hex;
+    uint hashValue;
+};
+
+inline uint qHash(const UserId& userId) { return userId.hash(); }
+
+Q_DECLARE_METATYPE(UserId)
+
+#endif // USERID_HPP
@@ -0,0 +1,62 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "videowidget.hpp"
+
+#include <QPainter>
+
+VideoWidget::VideoWidget(QWidget* parent) :
+    QGLWidget(parent)
+{
+    setAutoFillBackground(false);
+    setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
+}
+
+QSize VideoWidget::sizeHint() const
+{
+    return QSize(320, 240);
+}
+
+void VideoWidget::setFrame(const QImage& newFrame)
+{
+    frame = newFrame;
+    update();
+}
+
+void VideoWidget::clear()
+{
+    frame = QImage();
+    update();
+}
+
+void VideoWidget::paintEvent(QPaintEvent* /*event*/)
+{
+    QPainter painter(this);
+    painter.fillRect(rect(), Qt::black);
+
+    if (frame.isNull()) {
+        return;
+    }
+
+    // keep the aspect ratio, centered
+    QSize size = frame.size();
+    size.scale(this->size(), Qt::KeepAspectRatio);
+    const QRect target(QPoint((width() - size.width()) / 2, (height() - size.height()) / 2), size);
+
+    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    painter.drawImage(target, frame);
+}
@@ -0,0 +1,46 @@
+/*
+    Copyright (C) 2014 by Maxim Biro <nurupo.contributions@gmail.com>
+
+    This file is part of Tox Qt GUI.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef VIDEOWIDGET_HPP
+#define VIDEOWIDGET_HPP
+
+#include <QGLWidget>
+#include <QImage>
+
+// Shows the friend's video. It's painted with OpenGL, so scaling the frame to
+// the widget happens on the GPU, and frames are only ever shared, never copied.
+class VideoWidget : public QGLWidget
+{
+    Q_OBJECT
+public:
+    explicit VideoWidget(QWidget* parent = 0);
+
+    QSize sizeHint() const;
+
+public slots:
+    void setFrame(const QImage& frame);
+    void clear();
+
+protected:
+    void paintEvent(QPaintEvent* event);
+
+private:
+    QImage frame;
+
+};
+
+#endif // VIDEOWIDGET_HPP